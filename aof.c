@@ -38,6 +38,7 @@
 #include <sys/time.h>
 #include <sys/resource.h>
 #include <sys/wait.h>
+#include <pthread.h>
 
 void aofUpdateCurrentSize(void);
 void aofClosePipes(void);
@@ -240,6 +241,272 @@ void aof_background_fsync(int fd) {
     bioCreateBackgroundJob(REDIS_BIO_AOF_FSYNC,(void*)(long)fd,NULL,NULL);
 }
 
+/* ----------------------------------------------------------------------------
+ * AOF group commit
+ * -------------------------------------------------------------------------- */
+
+/*  appendfsync group：组提交模式。
+    主线程仍然像everysec一样在进入事件循环之前将AOF缓冲区write()到文件中，
+    但是fsync由一个专门的线程完成：它每次都同步当前已经写入的全部数据，
+    在一次fsync的过程中主线程写入的数据会被下一次fsync一起同步，这样多个事件循环的写入可以共享一次fsync。
+    server.aof_group_commit_delay（微秒）限制了最早一笔未同步的写入最多等待多久才开始fsync，
+    在此期间到来的写入也会被合并到这次fsync中。
+
+    执行了写命令的客户端的回复会被暂时扣留：call()执行写命令之后调用aofGroupCommitHoldReply()，
+    记录该命令在AOF中的结束偏移量并删除客户端的可写事件（prepareClientToWrite只会在输出缓冲区为空时注册可写事件，
+    所以后续的回复只会追加到缓冲区中）。等到fsync线程报告该偏移量已经持久化后再重新注册可写事件。
+    这样客户端收到回复时写入一定已经落盘，和always的持久化保证相同，但fsync不再阻塞主线程。
+
+    这里使用的偏移量都是单调递增的字节计数，与AOF文件的大小无关，所以AOF重写替换文件之后仍然有效。 */
+
+static struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int initialized;
+    // 需要同步的AOF文件
+    int fd;
+    // 主线程追加到AOF缓冲区中的字节数，只被主线程访问
+    long long appended;
+    // 已经写入AOF文件的字节数
+    long long written;
+    // 已经持久化到磁盘的字节数
+    long long synced;
+    // 最早一笔未同步的写入发生的时间（微秒）
+    long long pending_since;
+    // fsync开始前最多等待的时间（微秒）
+    long long delay;
+    // fsync线程是否正在执行fsync
+    int busy;
+    // AOF文件被替换，即使没有新的写入也需要执行一次fsync
+    int resync;
+    // fsync线程每完成一次fsync就往管道中写入一个字节，唤醒事件循环
+    int pipe[2];
+} aofCommit;
+
+/* The fsync thread: every fsync covers all the data written so far. */
+/* fsync线程：每次fsync都同步当前已经写入的所有数据 */
+static void *aofGroupCommitThread(void *arg) {
+    REDIS_NOTUSED(arg);
+
+    pthread_mutex_lock(&aofCommit.lock);
+    while(1) {
+        long long target;
+        int fd;
+
+        while (aofCommit.written == aofCommit.synced && !aofCommit.resync)
+            pthread_cond_wait(&aofCommit.cond,&aofCommit.lock);
+
+        /* Give the main thread up to 'delay' microseconds since the oldest
+         * unsynced write to add more data to this fsync. */
+        // 等待更多的写入合并到这次fsync中，但是最多等待到最早一笔未同步的写入之后delay微秒
+        while (aofCommit.delay > 0) {
+            long long deadline = aofCommit.pending_since+aofCommit.delay;
+            struct timespec ts;
+
+            if (ustime() >= deadline) break;
+            ts.tv_sec = deadline/1000000;
+            ts.tv_nsec = (deadline%1000000)*1000;
+            pthread_cond_timedwait(&aofCommit.cond,&aofCommit.lock,&ts);
+        }
+
+        target = aofCommit.written;
+        fd = aofCommit.fd;
+        aofCommit.busy = 1;
+        aofCommit.resync = 0;
+        pthread_mutex_unlock(&aofCommit.lock);
+
+        aof_fsync(fd);
+
+        pthread_mutex_lock(&aofCommit.lock);
+        aofCommit.busy = 0;
+        // aofGroupCommitMarkSynced()可能在fsync期间推进了synced
+        if (target > aofCommit.synced) aofCommit.synced = target;
+        if (aofCommit.written != aofCommit.synced)
+            aofCommit.pending_since = ustime();
+        pthread_cond_broadcast(&aofCommit.cond);
+        /* The pipe is non blocking: if it is full the event loop is going to
+         * wake up anyway. */
+        if (write(aofCommit.pipe[1],"!",1) == -1) {
+            /* Nothing to do. */
+        }
+    }
+    return NULL;
+}
+
+/* Release the clients whose writes are now on disk. */
+/* 释放那些写入已经持久化的客户端，重新为它们注册可写事件 */
+static void aofGroupCommitReleaseClients(long long synced) {
+    listIter li;
+    listNode *ln;
+
+    listRewind(server.aof_commit_clients,&li);
+    while((ln = listNext(&li))) {
+        redisClient *c = ln->value;
+
+        if (c->aof_commit_offset > synced) continue;
+        c->aof_commit_offset = 0;
+        listDelNode(server.aof_commit_clients,ln);
+        if ((c->bufpos || listLength(c->reply)) &&
+            aeCreateFileEvent(server.el,c->fd,AE_WRITABLE,
+                              sendReplyToClient,c) == AE_ERR)
+        {
+            freeClientAsync(c);
+        }
+    }
+}
+
+/* Event handler called when the fsync thread completed a fsync. */
+/* fsync线程完成一次fsync后被调用的事件处理函数 */
+static void aofGroupCommitReadable(aeEventLoop *el, int fd, void *privdata, int mask) {
+    char buf[64];
+    long long synced;
+    REDIS_NOTUSED(el);
+    REDIS_NOTUSED(privdata);
+    REDIS_NOTUSED(mask);
+
+    while (read(fd,buf,sizeof(buf)) > 0);
+    pthread_mutex_lock(&aofCommit.lock);
+    synced = aofCommit.synced;
+    pthread_mutex_unlock(&aofCommit.lock);
+    aofGroupCommitReleaseClients(synced);
+}
+
+/* Start the fsync thread the first time the group policy is used. The
+ * first 'written' bytes appended are already in the AOF file, and nobody
+ * waits for them to be synced. */
+/*  第一次使用组提交时启动fsync线程。参数written表示已经写入AOF文件的字节数，没有客户端在等待它们被同步。 */
+static void aofGroupCommitInit(long long written) {
+    if (aofCommit.initialized) return;
+
+    pthread_mutex_init(&aofCommit.lock,NULL);
+    pthread_cond_init(&aofCommit.cond,NULL);
+    aofCommit.fd = server.aof_fd;
+    aofCommit.written = aofCommit.synced = written;
+    aofCommit.busy = 0;
+    aofCommit.resync = 0;
+    if (pipe(aofCommit.pipe) == -1 ||
+        anetNonBlock(NULL,aofCommit.pipe[0]) != ANET_OK ||
+        anetNonBlock(NULL,aofCommit.pipe[1]) != ANET_OK ||
+        aeCreateFileEvent(server.el,aofCommit.pipe[0],AE_READABLE,
+                          aofGroupCommitReadable,NULL) == AE_ERR ||
+        pthread_create(&aofCommit.thread,NULL,aofGroupCommitThread,NULL) != 0)
+    {
+        redisLog(REDIS_WARNING,"Fatal: Can't initialize the AOF group commit thread.");
+        exit(1);
+    }
+    aofCommit.initialized = 1;
+}
+
+/* Called after write(2) stored 'nwritten' bytes of the AOF buffer into the
+ * AOF file: hand them to the fsync thread. */
+/* write(2)将AOF缓冲区中的nwritten字节写入文件之后调用，交给fsync线程同步 */
+static void aofGroupCommitWritten(ssize_t nwritten) {
+    /* The AOF buffer was already trimmed of the 'nwritten' bytes. */
+    aofGroupCommitInit(aofCommit.appended-sdslen(server.aof_buf)-nwritten);
+    pthread_mutex_lock(&aofCommit.lock);
+    if (aofCommit.written == aofCommit.synced && !aofCommit.resync)
+        aofCommit.pending_since = ustime();
+    /* Everything appended but what is left in the buffer is written: this
+     * also covers the writes done while the policy was not group. */
+    // 除了缓冲区中剩余的数据，追加的所有数据都已经写入文件：这也包括策略不是group期间的写入
+    aofCommit.written = aofCommit.appended-sdslen(server.aof_buf);
+    aofCommit.fd = server.aof_fd;
+    aofCommit.delay = server.aof_group_commit_delay;
+    pthread_cond_broadcast(&aofCommit.cond);
+    pthread_mutex_unlock(&aofCommit.lock);
+}
+
+/* Consider durable everything written so far without calling fsync (used
+ * when no-appendfsync-on-rewrite is in effect, or after a synchronous
+ * fsync), releasing the clients waiting for it. */
+/*  不调用fsync，直接认为目前写入的所有数据都已经持久化，并释放等待中的客户端。
+    在no-appendfsync-on-rewrite生效时或者已经同步地执行过fsync之后使用。 */
+void aofGroupCommitMarkSynced(void) {
+    if (!aofCommit.initialized) return;
+    pthread_mutex_lock(&aofCommit.lock);
+    aofCommit.written = aofCommit.appended;
+    aofCommit.synced = aofCommit.written;
+    pthread_mutex_unlock(&aofCommit.lock);
+    aofGroupCommitReleaseClients(aofCommit.appended);
+}
+
+/* Called by flushAppendOnlyFile() while the fsync policy is not group: it
+ * may have been changed at runtime (CONFIG SET appendfsync) while clients
+ * were waiting for a group commit. The data already written is synced once
+ * more, as those clients were promised, and they are released. The
+ * offsets are also kept aligned with what is written, so that the state is
+ * still valid if the policy is set back to group later. */
+/*  fsync策略不是group时由flushAppendOnlyFile调用：策略可能在运行时被修改（CONFIG SET appendfsync），
+    而此时还有客户端在等待组提交。已经写入的数据会再同步一次（这是之前对这些客户端的承诺），然后释放这些客户端。
+    同时让偏移量与已经写入的数据保持一致，这样之后策略重新设置为group时状态仍然有效。 */
+static void aofGroupCommitStop(void) {
+    long long written;
+
+    if (!aofCommit.initialized) return;
+    written = aofCommit.appended-sdslen(server.aof_buf);
+    if (listLength(server.aof_commit_clients)) aof_fsync(server.aof_fd);
+    pthread_mutex_lock(&aofCommit.lock);
+    if (written > aofCommit.synced) aofCommit.written = aofCommit.synced = written;
+    pthread_mutex_unlock(&aofCommit.lock);
+    aofGroupCommitReleaseClients(written);
+}
+
+/* The AOF rewrite replaced the AOF with 'fd', which already contains all the
+ * data appended so far: wait for any fsync against the old file to finish,
+ * then make the fsync thread sync the new file. */
+/*  AOF重写用fd替换了原来的AOF文件，新文件中已经包含了目前追加的所有数据。
+    等待正在对旧文件执行的fsync完成，然后让fsync线程同步新文件。 */
+static void aofGroupCommitSwitchFile(int fd) {
+    if (!aofCommit.initialized) return;
+    pthread_mutex_lock(&aofCommit.lock);
+    while (aofCommit.busy) pthread_cond_wait(&aofCommit.cond,&aofCommit.lock);
+    aofCommit.fd = fd;
+    if (aofCommit.written == aofCommit.synced && !aofCommit.resync)
+        aofCommit.pending_since = ustime();
+    aofCommit.written = aofCommit.appended;
+    /* Whatever was synced on the old file is in the new one as well, but
+     * not on disk yet: sync the new file even if nothing new was written. */
+    aofCommit.resync = 1;
+    pthread_cond_broadcast(&aofCommit.cond);
+    pthread_mutex_unlock(&aofCommit.lock);
+}
+
+/* Called by call() after a command was propagated: if the group policy is
+ * active hold the replies of the client until the AOF is synced up to this
+ * command. */
+/*  call()在传播命令之后调用：如果使用组提交，则扣留客户端的回复，直到AOF同步到该命令为止 */
+void aofGroupCommitHoldReply(redisClient *c) {
+    long long synced;
+
+    if (server.aof_fsync != AOF_FSYNC_GROUP ||
+        server.aof_state != REDIS_AOF_ON ||
+        c->fd == -1 || (c->flags & REDIS_MASTER)) return;
+
+    aofGroupCommitInit(aofCommit.appended-sdslen(server.aof_buf));
+    pthread_mutex_lock(&aofCommit.lock);
+    synced = aofCommit.synced;
+    pthread_mutex_unlock(&aofCommit.lock);
+    if (aofCommit.appended <= synced) return;
+
+    if (c->aof_commit_offset == 0)
+        listAddNodeTail(server.aof_commit_clients,c);
+    c->aof_commit_offset = aofCommit.appended;
+    aeDeleteFileEvent(server.el,c->fd,AE_WRITABLE);
+}
+
+/* Called by freeClient(). */
+/* 释放客户端时调用，将其从等待列表中删除 */
+void aofGroupCommitUnlinkClient(redisClient *c) {
+    listNode *ln;
+
+    if (c->aof_commit_offset == 0) return;
+    ln = listSearchKey(server.aof_commit_clients,c);
+    redisAssert(ln != NULL);
+    listDelNode(server.aof_commit_clients,ln);
+    c->aof_commit_offset = 0;
+}
+
 /* Called when the user switches from "appendonly yes" to "appendonly no"
  * at runtime using the CONFIG command. */
 /*	在Redis运行时，如果用户通过CONFIG命令关闭了AOF功能时调用该函数。	*/
@@ -249,6 +516,8 @@ void stopAppendOnly(void) {
     // flush操作，将AOF缓存中的内容写入AOF文件中
     flushAppendOnlyFile(1);
     aof_fsync(server.aof_fd);
+    // 所有数据都已经同步，释放等待组提交的客户端
+    aofGroupCommitMarkSynced();
     // 关闭AOF文件
     close(server.aof_fd);
 
@@ -277,6 +546,7 @@ void stopAppendOnly(void) {
         /* close pipes used for IPC between the two processes. */
         // 关闭管道文件
         aofClosePipes();
+        closeChildInfoPipe(REDIS_CHILD_INFO_TYPE_AOF);
     }
 }
 
@@ -294,8 +564,15 @@ int startAppendOnly(void) {
         redisLog(REDIS_WARNING,"Redis needs to enable the AOF but can't open the append only file: %s",strerror(errno));
         return REDIS_ERR;
     }
+    /* An RDB child is saving: the rewrite is scheduled, serverCron() starts
+     * it once the child exits, as BGREWRITEAOF does. */
+    // 正在执行BGSAVE时与BGREWRITEAOF一样只是安排重写，等RDB子进程退出后由serverCron执行
+    if (server.rdb_child_pid != -1) {
+        server.aof_rewrite_scheduled = 1;
+        redisLog(REDIS_WARNING,"AOF was enabled but there is already a child process saving an RDB file on disk. An AOF background was scheduled to start when possible.");
+    }
     // 执行AOF重写操作
-    if (rewriteAppendOnlyFileBackground() == REDIS_ERR) {
+    else if (rewriteAppendOnlyFileBackground() == REDIS_ERR) {
         close(server.aof_fd);
         redisLog(REDIS_WARNING,"Redis needs to enable the AOF but can't trigger a background AOF rewrite operation. Check the above logs for more info about the error.");
         return REDIS_ERR;
@@ -336,13 +613,17 @@ int startAppendOnly(void) {
  * fsync. 
  *	但是，如果参数force被设置为1，则不管后台是否正在执行fsync操作都会直接将AOF缓存写入文件中。
  *
- *	AOF支持三种fsync同步策略：always、everysec、no，默认是everysec。
+ *	AOF支持四种fsync同步策略：always、everysec、group、no，默认是everysec。
  */
 #define AOF_WRITE_LOG_ERROR_RATE 30 /* Seconds between errors logging. */
 void flushAppendOnlyFile(int force) {
     ssize_t nwritten;
     int sync_in_progress = 0;
     mstime_t latency;
+    long long probe;
+
+    // fsync策略已经不是group，释放仍在等待组提交的客户端
+    if (server.aof_fsync != AOF_FSYNC_GROUP) aofGroupCommitStop();
 
     // 缓冲区中没有没有任何内容，直接返回
     if (sdslen(server.aof_buf) == 0) return;
@@ -388,8 +669,10 @@ void flushAppendOnlyFile(int force) {
     /*	这里我们要执行单次写操作，如果我们写入的文件系统是物理设备的话需要保证这个操作是原子的。 */
 
     latencyStartMonitor(latency);
+    latencyProbeStart(probe);
     // 将server.aof_buf缓冲区中的数据写入文件中
     nwritten = write(server.aof_fd,server.aof_buf,sdslen(server.aof_buf));
+    latencyProbeEnd(LATENCY_PROBE_AOF_WRITE,probe);
     latencyEndMonitor(latency);
     /* We want to capture different events for delayed writes:
      * when the delay happens with a pending fsync, or with a saving child
@@ -479,6 +762,8 @@ void flushAppendOnlyFile(int force) {
             if (nwritten > 0) {
                 server.aof_current_size += nwritten;
                 sdsrange(server.aof_buf,nwritten,-1);
+                if (server.aof_fsync == AOF_FSYNC_GROUP)
+                    aofGroupCommitWritten(nwritten);
             }
             return; /* We'll try again on the next call... */
         }
@@ -515,7 +800,12 @@ void flushAppendOnlyFile(int force) {
     // 如果Redis的no-appendfsync-on-rewrite选项被开启，且后台有子进程正在执行IO操作，则不执行fsync操作，直接返回
     if (server.aof_no_fsync_on_rewrite &&
         (server.aof_child_pid != -1 || server.rdb_child_pid != -1))
-            return;
+    {
+        /* Don't hold the replies of the group commit clients forever. */
+        // 不能无限期地扣留组提交客户端的回复
+        if (server.aof_fsync == AOF_FSYNC_GROUP) aofGroupCommitMarkSynced();
+        return;
+    }
 
     /* Perform the fsync if needed. */
     // 如果有需要，执行fsync操作
@@ -525,7 +815,9 @@ void flushAppendOnlyFile(int force) {
         /* aof_fsync is defined as fdatasync() for Linux in order to avoid
          * flushing metadata. */
         latencyStartMonitor(latency);
+        latencyProbeStart(probe);
         aof_fsync(server.aof_fd); /* Let's try to get this data on the disk */
+        latencyProbeEnd(LATENCY_PROBE_AOF_FSYNC,probe);
         latencyEndMonitor(latency);
         latencyAddSampleIfNeeded("aof-fsync-always",latency);
         server.aof_last_fsync = server.unixtime;
@@ -537,6 +829,11 @@ void flushAppendOnlyFile(int force) {
         if (!sync_in_progress) aof_background_fsync(server.aof_fd);
         server.aof_last_fsync = server.unixtime;
     }
+    // 当前的fsync策略为AOF_FSYNC_GROUP，交给fsync线程批量同步
+    else if (server.aof_fsync == AOF_FSYNC_GROUP) {
+        aofGroupCommitWritten(nwritten);
+        server.aof_last_fsync = server.unixtime;
+    }
 }
 
 /*	根据传入命令和该命令的参数将其构造成符合AOF文件格式的字符串形式 	*/
@@ -613,12 +910,105 @@ sds catAppendOnlyExpireAtCommand(sds buf, struct redisCommand *cmd, robj *key, r
     return buf;
 }
 
+/* While EXEC runs a transaction, the commands it propagates are serialized
+ * one after the other into a single buffer, appended to the AOF buffer (and
+ * to the rewrite buffer) at once by aofBatchEnd(), instead of allocating,
+ * copying and appending a buffer for every command.
+ *
+ * The state of the AOF and of the rewrite child when the batch began is
+ * remembered: if one of them changes in the middle of the transaction (for
+ * instance CONFIG SET appendonly inside MULTI), what was accumulated so far
+ * is appended first, so every command ends in the same buffers where it
+ * would have ended without the batch. */
+/*  EXEC执行事务期间，事务传播的命令被依次序列化到同一个缓冲区中，由aofBatchEnd()一次性追加到AOF缓冲区
+    （以及AOF重写缓存）中，而不是为每条命令分配、复制、追加一个缓冲区。
+    批量开始时会记录AOF以及重写子进程的状态：如果事务执行过程中其中之一发生了变化（例如在MULTI中执行
+    CONFIG SET appendonly），先把已经累积的内容追加出去，这样每条命令最终进入的缓冲区与没有批量时完全相同。 */
+#define AOF_BATCH_KEEP_BYTES (1024*64) /* Buffer kept between transactions. */
+
+static struct {
+    int active;
+    // 累积的命令
+    sds buf;
+    // 批量开始（或者上一次追加）时的server.aof_state和server.aof_child_pid
+    int aof_state;
+    pid_t child_pid;
+} aofBatch;
+
+/* Append 'buf' to the AOF buffer and, if a rewrite is in progress, to the
+ * rewrite buffer. */
+/* 将buf追加到AOF缓冲区中，如果正在执行AOF重写，同时追加到AOF重写缓存中 */
+static void aofAppendToBuffers(sds buf, int aof_state, pid_t child_pid) {
+    /* Append to the AOF buffer. This will be flushed on disk just before
+     * of re-entering the event loop, so before the client will get a
+     * positive reply about the operation performed. */
+    // 将重构后的命令字符串追加到AOF缓冲区中。AOF缓冲区中的数据会在重新进入时间循环前写入磁盘中，相应的客户端
+    // 也会受到一个关于此次操作的回复消息
+    if (aof_state == REDIS_AOF_ON) {
+        server.aof_buf = sdscatlen(server.aof_buf,buf,sdslen(buf));
+        aofCommit.appended += sdslen(buf);
+    }
+
+    /* If a background append only file rewriting is in progress we want to
+     * accumulate the differences between the child DB and the current one
+     * in a buffer, so that when the child process will do its work we
+     * can append the differences to the new append only file. */
+    // 如果后台正在执行AOF文件重写操作（即BGREWRITEAOF命令），为了记录当前正在重写的AOF文件和当前数据库的
+    // 差异信息，我们还需要将重构后的命令追加到AOF重写缓存中。
+    if (child_pid != -1)
+        aofRewriteBufferAppend((unsigned char*)buf,sdslen(buf));
+}
+
+/* Append what the batch accumulated so far. */
+/* 追加批量中已经累积的内容 */
+static void aofBatchFlush(void) {
+    if (sdslen(aofBatch.buf)) {
+        aofAppendToBuffers(aofBatch.buf,aofBatch.aof_state,aofBatch.child_pid);
+        sdsclear(aofBatch.buf);
+    }
+    aofBatch.aof_state = server.aof_state;
+    aofBatch.child_pid = server.aof_child_pid;
+}
+
+/* Start accumulating the propagated commands, see aofBatchEnd(). */
+/* 开始累积传播的命令 */
+void aofBatchBegin(void) {
+    if (aofBatch.buf == NULL) aofBatch.buf = sdsempty();
+    aofBatch.aof_state = server.aof_state;
+    aofBatch.child_pid = server.aof_child_pid;
+    aofBatch.active = 1;
+}
+
+/* Append the accumulated commands to the AOF buffers at once. */
+/* 将累积的命令一次性追加到AOF缓冲区中 */
+void aofBatchEnd(void) {
+    if (!aofBatch.active) return;
+    aofBatchFlush();
+    aofBatch.active = 0;
+    /* Don't keep the memory of a huge transaction around. */
+    // 不要一直占用一个大事务的内存
+    if (sdsAllocSize(aofBatch.buf) > AOF_BATCH_KEEP_BYTES) {
+        sdsfree(aofBatch.buf);
+        aofBatch.buf = NULL;
+    }
+}
+
 /* 	将命令还原后追加到AOF缓冲区server.aof_buf中，该缓冲区的内容将会在某个时刻被写入磁盘。
-	另外，如果后台正在执行AOF文件重写操作，还需要将该命令追加到AOF重写缓存中。 */  
+	另外，如果后台正在执行AOF文件重写操作，还需要将该命令追加到AOF重写缓存中。
+	事务执行期间命令被追加到批量缓冲区中，见aofBatchBegin()。 */
 void feedAppendOnlyFile(struct redisCommand *cmd, int dictid, robj **argv, int argc) {
-    sds buf = sdsempty();
+    sds buf;
     robj *tmpargv[3];
 
+    // 事务执行期间直接序列化到批量缓冲区中
+    if (aofBatch.active) {
+        if (aofBatch.aof_state != server.aof_state ||
+            aofBatch.child_pid != server.aof_child_pid) aofBatchFlush();
+        buf = aofBatch.buf;
+    } else {
+        buf = sdsempty();
+    }
+
     /* The DB this command was targeting is not the same as the last command
      * we appended. To issue a SELECT command is needed. */
     // 如果当前命令涉及的数据库与server.aof_selected_db指明的数据库不一致，需要加入SELECT命令显式设置
@@ -658,23 +1048,11 @@ void feedAppendOnlyFile(struct redisCommand *cmd, int dictid, robj **argv, int a
         buf = catAppendOnlyGenericCommand(buf,argc,argv);
     }
 
-    /* Append to the AOF buffer. This will be flushed on disk just before
-     * of re-entering the event loop, so before the client will get a
-     * positive reply about the operation performed. */
-    // 将重构后的命令字符串追加到AOF缓冲区中。AOF缓冲区中的数据会在重新进入时间循环前写入磁盘中，相应的客户端
-    // 也会受到一个关于此次操作的回复消息
-    if (server.aof_state == REDIS_AOF_ON)
-        server.aof_buf = sdscatlen(server.aof_buf,buf,sdslen(buf));
-
-    /* If a background append only file rewriting is in progress we want to
-     * accumulate the differences between the child DB and the current one
-     * in a buffer, so that when the child process will do its work we
-     * can append the differences to the new append only file. */
-    // 如果后台正在执行AOF文件重写操作（即BGREWRITEAOF命令），为了记录当前正在重写的AOF文件和当前数据库的
-    // 差异信息，我们还需要将重构后的命令追加到AOF重写缓存中。
-    if (server.aof_child_pid != -1)
-        aofRewriteBufferAppend((unsigned char*)buf,sdslen(buf));
-
+    if (aofBatch.active) {
+        aofBatch.buf = buf;
+        return;
+    }
+    aofAppendToBuffers(buf,server.aof_state,server.aof_child_pid);
     sdsfree(buf);
 }
 
@@ -960,64 +1338,47 @@ int rioWriteBulkObject(rio *r, robj *obj) {
 int rewriteListObject(rio *r, robj *key, robj *o) {
     long long count = 0, items = listTypeLength(o);
 
-    // 处理ziplist编码的list对象
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-        unsigned char *zl = o->ptr;
-        unsigned char *p = ziplistIndex(zl,0);
-        unsigned char *vstr;
-        unsigned int vlen;
-        long long vlong;
+    // 处理quicklist编码的list对象
+    if (o->encoding == REDIS_ENCODING_QUICKLIST) {
+        quicklist *list = o->ptr;
+        quicklistIter *li = quicklistGetIterator(list, AL_START_HEAD);
+        quicklistEntry entry;
 
         // 在AOF文件中，每条RPUSH命令只能添加REDIS_AOF_REWRITE_ITEMS_PER_CMD个元素
-        // 这里遍历ziplist，将每REDIS_AOF_REWRITE_ITEMS_PER_CMD个元素组装到一条RPUSH命令中去
+        // 这里遍历quicklist，将每REDIS_AOF_REWRITE_ITEMS_PER_CMD个元素组装到一条RPUSH命令中去
         // 想想为什么要这么做？如果list对象中存在大量的元素，将它们放到一条RPUSH命令中会如何
-        while(ziplistGet(p,&vstr,&vlen,&vlong)) {
+        while (quicklistNext(li,&entry)) {
             if (count == 0) {
                 int cmd_items = (items > REDIS_AOF_REWRITE_ITEMS_PER_CMD) ?
                     REDIS_AOF_REWRITE_ITEMS_PER_CMD : items;
 
-                if (rioWriteBulkCount(r,'*',2+cmd_items) == 0) return 0;
-                if (rioWriteBulkString(r,"RPUSH",5) == 0) return 0;
-                if (rioWriteBulkObject(r,key) == 0) return 0;
+                if (rioWriteBulkCount(r,'*',2+cmd_items) == 0 ||
+                    rioWriteBulkString(r,"RPUSH",5) == 0 ||
+                    rioWriteBulkObject(r,key) == 0)
+                {
+                    quicklistReleaseIterator(li);
+                    return 0;
+                }
             }
 
             // 取出元素值并写入rio对象中
-            if (vstr) {
-                if (rioWriteBulkString(r,(char*)vstr,vlen) == 0) return 0;
+            if (entry.value) {
+                if (rioWriteBulkString(r,(char*)entry.value,entry.sz) == 0) {
+                    quicklistReleaseIterator(li);
+                    return 0;
+                }
             } else {
-                if (rioWriteBulkLongLong(r,vlong) == 0) return 0;
+                if (rioWriteBulkLongLong(r,entry.longval) == 0) {
+                    quicklistReleaseIterator(li);
+                    return 0;
+                }
             }
-            // 移动迭代器，除以下一个元素
-            p = ziplistNext(zl,p);
             // 取出元素个数加1，如果取出元素个数等于REDIS_AOF_REWRITE_ITEMS_PER_CMD规定的数量
             // 则剩余元素放到另一条RPUSH命令中
             if (++count == REDIS_AOF_REWRITE_ITEMS_PER_CMD) count = 0;
             items--;
         }
-    } 
-    // 处理linked list编码的list对象
-    else if (o->encoding == REDIS_ENCODING_LINKEDLIST) {
-        list *list = o->ptr;
-        listNode *ln;
-        listIter li;
-
-        // 类似ziplist的处理方式，遍历linked list将每REDIS_AOF_REWRITE_ITEMS_PER_CMD个元素组装到一条RPUSH命令中
-        listRewind(list,&li);
-        while((ln = listNext(&li))) {
-            robj *eleobj = listNodeValue(ln);
-
-            if (count == 0) {
-                int cmd_items = (items > REDIS_AOF_REWRITE_ITEMS_PER_CMD) ?
-                    REDIS_AOF_REWRITE_ITEMS_PER_CMD : items;
-
-                if (rioWriteBulkCount(r,'*',2+cmd_items) == 0) return 0;
-                if (rioWriteBulkString(r,"RPUSH",5) == 0) return 0;
-                if (rioWriteBulkObject(r,key) == 0) return 0;
-            }
-            if (rioWriteBulkObject(r,eleobj) == 0) return 0;
-            if (++count == REDIS_AOF_REWRITE_ITEMS_PER_CMD) count = 0;
-            items--;
-        }
+        quicklistReleaseIterator(li);
     } else {
         redisPanic("Unknown list encoding");
     }
@@ -1054,6 +1415,26 @@ int rewriteSetObject(rio *r, robj *key, robj *o) {
             items--;
         }
     } 
+    // 处理roaring编码的set对象，按从小到大的顺序写出元素
+    else if (o->encoding == REDIS_ENCODING_ROARING) {
+        roaringIterator it;
+        int64_t llval;
+
+        roaringIterInit(&it,o->ptr,INT64_MIN);
+        while(roaringIterNext(&it,&llval)) {
+            if (count == 0) {
+                int cmd_items = (items > REDIS_AOF_REWRITE_ITEMS_PER_CMD) ?
+                    REDIS_AOF_REWRITE_ITEMS_PER_CMD : items;
+
+                if (rioWriteBulkCount(r,'*',2+cmd_items) == 0) return 0;
+                if (rioWriteBulkString(r,"SADD",4) == 0) return 0;
+                if (rioWriteBulkObject(r,key) == 0) return 0;
+            }
+            if (rioWriteBulkLongLong(r,llval) == 0) return 0;
+            if (++count == REDIS_AOF_REWRITE_ITEMS_PER_CMD) count = 0;
+            items--;
+        }
+    } 
     // 处理dict编码的set对象
     else if (o->encoding == REDIS_ENCODING_HT) {
         dictIterator *di = dictGetIterator(o->ptr);
@@ -1091,7 +1472,7 @@ int rewriteSetObject(rio *r, robj *key, robj *o) {
 int rewriteSortedSetObject(rio *r, robj *key, robj *o) {
     long long count = 0, items = zsetLength(o);
 
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl = o->ptr;
         unsigned char *eptr, *sptr;
         unsigned char *vstr;
@@ -1099,13 +1480,13 @@ int rewriteSortedSetObject(rio *r, robj *key, robj *o) {
         long long vll;
         double score;
 
-        eptr = ziplistIndex(zl,0);
+        eptr = lpIndex(zl,0);
         redisAssert(eptr != NULL);
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
         redisAssert(sptr != NULL);
 
         while (eptr != NULL) {
-            redisAssert(ziplistGet(eptr,&vstr,&vlen,&vll));
+            redisAssert(lpGet(eptr,&vstr,&vlen,&vll));
             score = zzlGetScore(sptr);
 
             if (count == 0) {
@@ -1171,13 +1552,14 @@ int rewriteSortedSetObject(rio *r, robj *key, robj *o) {
 
 	该函数如果出错返回0，如果成功返回非0值。*/
 static int rioWriteHashIteratorCursor(rio *r, hashTypeIterator *hi, int what) {
-	// 处理ziplist编码的情况
-    if (hi->encoding == REDIS_ENCODING_ZIPLIST) {
+	// 处理listpack编码和hashpack编码的情况
+    if (hi->encoding == REDIS_ENCODING_LISTPACK ||
+        hi->encoding == REDIS_ENCODING_LISTPACK_EX) {
         unsigned char *vstr = NULL;
         unsigned int vlen = UINT_MAX;
         long long vll = LLONG_MAX;
 
-        hashTypeCurrentFromZiplist(hi, what, &vstr, &vlen, &vll);
+        hashTypeCurrentFromListpack(hi, what, &vstr, &vlen, &vll);
         if (vstr) {
             return rioWriteBulkString(r, (char*)vstr, vlen);
         } else {
@@ -1204,6 +1586,7 @@ static int rioWriteHashIteratorCursor(rio *r, hashTypeIterator *hi, int what) {
 	
 	这里的处理方式和list类型对象一直：遍历hash对象，将每REDIS_AOF_REWRITE_ITEMS_PER_CMD个元素
 	组成成一条HMSET命令写入rio对象中。
+	设置了过期时间的域随后用HPEXPIREAT命令保存其过期时间，已经过期的域载入之后会被删除。
 */
 int rewriteHashObject(rio *r, robj *key, robj *o) {
     hashTypeIterator *hi;
@@ -1228,6 +1611,83 @@ int rewriteHashObject(rio *r, robj *key, robj *o) {
 
     hashTypeReleaseIterator(hi);
 
+    /* Save the field expires */
+    // 使用HPEXPIREAT命令保存域的过期时间
+    if (hashTypeHasFieldExpires(o)) {
+        hashpack *hp = o->ptr;
+        unsigned char *fptr, *vstr;
+        unsigned int vlen;
+        long long vll, when;
+
+        for (fptr = hpFirst(hp); fptr != NULL; fptr = hpNextField(hp,fptr)) {
+            if ((when = hpGetExpire(hp,fptr)) == 0) continue;
+            if (rioWriteBulkCount(r,'*',4) == 0) return 0;
+            if (rioWriteBulkString(r,"HPEXPIREAT",10) == 0) return 0;
+            if (rioWriteBulkObject(r,key) == 0) return 0;
+            if (rioWriteBulkLongLong(r,when) == 0) return 0;
+            redisAssert(lpGet(fptr,&vstr,&vlen,&vll));
+            if (vstr) {
+                if (rioWriteBulkString(r,(char*)vstr,vlen) == 0) return 0;
+            } else {
+                if (rioWriteBulkLongLong(r,vll) == 0) return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+/* Emit the commands needed to rebuild the key 'key' of the database 'db',
+ * including its expire time. Returns 1 on success, 0 if the key is already
+ * expired and was skipped, -1 on error. */
+/*	将重建数据库db中的key需要的命令（包括设置过期时间的命令）写入rio对象中。
+	成功返回1，如果该key已经过期则跳过并返回0，出错返回-1。*/
+static int rewriteKeyValuePair(rio *aof, redisDb *db, robj *key, robj *o, long long now) {
+    // 取出该key的过期时间
+    long long expiretime = getExpire(db,key);
+
+    /* If this key is already expired skip it */
+    // 如果该key已经过期，则跳过该key
+    if (expiretime != -1 && expiretime < now) return 0;
+
+    /* Save the key and associated value */
+    // 处理string类型对象
+    if (o->type == REDIS_STRING) {
+        /* Emit a SET command */
+        // 构造SET命令来保存string类型对象
+        char cmd[]="*3\r\n$3\r\nSET\r\n";
+        if (rioWrite(aof,cmd,sizeof(cmd)-1) == 0) return -1;
+        /* Key and value */
+        //	保存key值和value值
+        if (rioWriteBulkObject(aof,key) == 0) return -1;
+        if (rioWriteBulkObject(aof,o) == 0) return -1;
+    } 
+    // 保存list类型对象
+    else if (o->type == REDIS_LIST) {
+        if (rewriteListObject(aof,key,o) == 0) return -1;
+    } 
+    // 保存set类型对象
+    else if (o->type == REDIS_SET) {
+        if (rewriteSetObject(aof,key,o) == 0) return -1;
+    } 
+    //	保存zset类型对象
+    else if (o->type == REDIS_ZSET) {
+        if (rewriteSortedSetObject(aof,key,o) == 0) return -1;
+    } 
+    //	保存hash类型对象
+    else if (o->type == REDIS_HASH) {
+        if (rewriteHashObject(aof,key,o) == 0) return -1;
+    } else {
+        redisPanic("Unknown object type");
+    }
+    // 使用PEXPIREAT命令保存该key的过期时间
+    /* Save the expire time */
+    if (expiretime != -1) {
+        char cmd[]="*3\r\n$9\r\nPEXPIREAT\r\n";
+        if (rioWrite(aof,cmd,sizeof(cmd)-1) == 0) return -1;
+        if (rioWriteBulkObject(aof,key) == 0) return -1;
+        if (rioWriteBulkLongLong(aof,expiretime) == 0) return -1;
+    }
     return 1;
 }
 
@@ -1249,6 +1709,297 @@ ssize_t aofReadDiffFromParent(void) {
     return total;
 }
 
+/* ----------------------------------------------------------------------------
+ * Multi threaded AOF rewrite
+ * -------------------------------------------------------------------------- */
+
+/*  多线程AOF重写：键空间被切分成若干片段（以数据库和dictScan游标范围划分），
+    由server.aof_rewrite_threads个线程并行地重写，每个线程通过rio将命令写入自己的段文件中。
+    与此同时主线程不断读取父进程通过管道发送的差异数据并写入一个单独的差异文件，
+    这样父进程的aof_rewrite_buf_blocks不会因为子进程来不及读取而不断增长，
+    子进程也不需要在内存中保存大量的差异数据。
+    所有线程结束后，依次把各个段文件和差异文件拼接到最终的AOF文件中。
+
+    AOF中不同key的命令之间没有顺序要求，所以各个段文件可以以任意顺序拼接，
+    每个段文件都会在开头以及切换数据库时写入SELECT命令。
+    重写期间各个线程会并发地查找键空间和过期字典，所以必须暂停所有数据库的渐进式rehash。 */
+
+#define AOF_REWRITE_MAX_THREADS 64
+/* DBs with less buckets than this are not split. */
+#define AOF_REWRITE_MIN_SLICE_BUCKETS 1024
+/* Slices per thread of a big DB, so that threads finishing early can help
+ * with the rest. */
+#define AOF_REWRITE_SLICES_PER_THREAD 4
+
+/* A range [start,end) of the dictScan() cursor space of a DB. */
+/* 数据库中一段dictScan游标范围[start,end) */
+typedef struct aofRewriteSlice {
+    int dbid;
+    int bits;
+    unsigned long start, end;
+} aofRewriteSlice;
+
+/* State shared by the rewriting threads. */
+/* 所有重写线程共享的状态 */
+typedef struct aofRewriteJob {
+    aofRewriteSlice *slices;
+    int numslices;
+    // 下一个待处理的片段
+    int next;
+    // 还在运行的线程数量
+    int running;
+    pthread_mutex_t lock;
+    long long now;
+} aofRewriteJob;
+
+/* State of a rewriting thread. */
+/* 重写线程的状态 */
+typedef struct aofRewriteWorker {
+    pthread_t thread;
+    aofRewriteJob *job;
+    // 段文件
+    char filename[256];
+    FILE *fp;
+    rio aof;
+    // 段文件中最后一条SELECT命令选择的数据库
+    int seldb;
+    redisDb *db;
+    int error;
+    // 出错时的errno
+    int saved_errno;
+} aofRewriteWorker;
+
+/* dictScan() callback rewriting one key. */
+/* dictScan的回调函数，重写一个key */
+static void aofRewriteScanCallback(void *privdata, const dictEntry *de) {
+    aofRewriteWorker *w = privdata;
+    sds keystr = dictGetKey(de);
+    packedObjectView view;
+    robj key;
+
+    if (w->error) return;
+    initStaticStringObject(key,keystr);
+    if (rewriteKeyValuePair(&w->aof,w->db,&key,
+            keyspaceValueView(dictGetVal(de),&view),w->job->now) == -1) {
+        w->error = 1;
+        w->saved_errno = errno;
+    }
+}
+
+/* Rewriting thread: take slices until there are no more, writing the
+ * commands to the segment file of the thread. */
+/* 重写线程：不断领取片段进行重写，直到所有片段都被处理，命令被写入该线程的段文件中 */
+static void *aofRewriteWorkerMain(void *arg) {
+    aofRewriteWorker *w = arg;
+    aofRewriteJob *job = w->job;
+
+    while(!w->error) {
+        aofRewriteSlice *slice;
+        unsigned long v;
+        dict *d;
+
+        pthread_mutex_lock(&job->lock);
+        slice = (job->next < job->numslices) ? job->slices+job->next++ : NULL;
+        pthread_mutex_unlock(&job->lock);
+        if (slice == NULL) break;
+
+        // 切换数据库时写入SELECT命令
+        if (slice->dbid != w->seldb) {
+            char selectcmd[] = "*2\r\n$6\r\nSELECT\r\n";
+
+            if (rioWrite(&w->aof,selectcmd,sizeof(selectcmd)-1) == 0 ||
+                rioWriteBulkLongLong(&w->aof,slice->dbid) == 0)
+            {
+                w->error = 1;
+                w->saved_errno = errno;
+                break;
+            }
+            w->seldb = slice->dbid;
+        }
+
+        w->db = server.db+slice->dbid;
+        d = w->db->dict;
+        v = dictScanCursorAt(slice->start,slice->bits);
+        do {
+            v = dictScan(d,v,aofRewriteScanCallback,w);
+        } while (!w->error && v != 0 &&
+                 dictScanCursorPos(v,slice->bits) < slice->end);
+    }
+
+    if (!w->error && (fflush(w->fp) == EOF || fsync(fileno(w->fp)) == -1)) {
+        w->error = 1;
+        w->saved_errno = errno;
+    }
+
+    pthread_mutex_lock(&job->lock);
+    job->running--;
+    pthread_mutex_unlock(&job->lock);
+    return NULL;
+}
+
+/* Append the whole content of 'fp' to 'aof'. Returns 0 on error. */
+/* 将文件fp中的全部内容追加到aof中，出错时返回0 */
+static int aofRewriteAppendFile(rio *aof, FILE *fp) {
+    char buf[65536];
+    size_t nread;
+
+    if (fflush(fp) == EOF) return 0;
+    rewind(fp);
+    while ((nread = fread(buf,1,sizeof(buf),fp)) > 0)
+        if (rioWrite(aof,buf,nread) == 0) return 0;
+    return ferror(fp) ? 0 : 1;
+}
+
+/* Write the dataset to 'aof' using 'numthreads' threads. The diff read from
+ * the parent meanwhile is spilled into a temp file and appended after the
+ * segments. Returns 1 on success, 0 on error. */
+/*  使用numthreads个线程将数据集重写到aof中。在此期间从父进程读到的差异数据被写入临时文件，
+    并在所有段文件之后追加到aof中。成功返回1，出错返回0。 */
+static int rewriteAppendOnlyFileThreaded(rio *aof, int numthreads, long long now) {
+    aofRewriteWorker workers[AOF_REWRITE_MAX_THREADS];
+    aofRewriteJob job;
+    char difffile[256];
+    FILE *difffp;
+    int j, k, running, started = 0, error = 0, saved_errno = 0;
+
+    if (numthreads > AOF_REWRITE_MAX_THREADS) numthreads = AOF_REWRITE_MAX_THREADS;
+
+    // 切分键空间：小的数据库作为一个片段，大的数据库按照游标空间切分成多个片段
+    job.slices = zmalloc(sizeof(aofRewriteSlice)*server.dbnum*
+                         numthreads*AOF_REWRITE_SLICES_PER_THREAD);
+    job.numslices = 0;
+    for (j = 0; j < server.dbnum; j++) {
+        dict *d = server.db[j].dict;
+        unsigned long buckets;
+        int bits, n;
+
+        if (dictSize(d) == 0) continue;
+        bits = dictScanCursorBits(d);
+        buckets = 1UL << bits;
+        n = numthreads*AOF_REWRITE_SLICES_PER_THREAD;
+        if (buckets/AOF_REWRITE_MIN_SLICE_BUCKETS < (unsigned long)n)
+            n = buckets/AOF_REWRITE_MIN_SLICE_BUCKETS;
+        if (n < 1) n = 1;
+        for (k = 0; k < n; k++) {
+            aofRewriteSlice *slice = job.slices+job.numslices++;
+
+            slice->dbid = j;
+            slice->bits = bits;
+            slice->start = (buckets/n)*k;
+            slice->end = (k == n-1) ? buckets : (buckets/n)*(k+1);
+        }
+        // 各个线程并发地查找键空间和过期字典，在此期间必须暂停渐进式rehash
+        dictPauseRehashing(server.db[j].dict);
+        dictPauseRehashing(server.db[j].expires);
+    }
+    job.next = 0;
+    job.now = now;
+    pthread_mutex_init(&job.lock,NULL);
+    for (j = 0; j < numthreads; j++) {
+        memset(workers+j,0,sizeof(aofRewriteWorker));
+        workers[j].job = &job;
+        workers[j].seldb = -1;
+    }
+
+    snprintf(difffile,sizeof(difffile),"temp-rewriteaof-diff-%d.aof",
+        (int) getpid());
+    if ((difffp = fopen(difffile,"w+")) == NULL) {
+        saved_errno = errno;
+        error = 1;
+        goto cleanup;
+    }
+
+    // 创建重写线程，每个线程有自己的段文件
+    job.running = numthreads;
+    for (j = 0; j < numthreads; j++) {
+        aofRewriteWorker *w = workers+j;
+
+        snprintf(w->filename,sizeof(w->filename),"temp-rewriteaof-seg-%d-%d.aof",
+            (int) getpid(), j);
+        if ((w->fp = fopen(w->filename,"w+")) == NULL) {
+            saved_errno = errno;
+            error = 1;
+            break;
+        }
+        rioInitWithFile(&w->aof,w->fp);
+        if (server.aof_rewrite_incremental_fsync)
+            rioSetAutoSync(&w->aof,REDIS_AOF_AUTOSYNC_BYTES);
+        if (pthread_create(&w->thread,NULL,aofRewriteWorkerMain,w) != 0) {
+            redisLog(REDIS_WARNING,"Fatal: Can't create AOF rewriting threads.");
+            exit(1);
+        }
+        started++;
+    }
+    if (started != numthreads) {
+        // 没有启动的线程不会再递减running
+        pthread_mutex_lock(&job.lock);
+        job.running -= numthreads-started;
+        job.next = job.numslices;
+        pthread_mutex_unlock(&job.lock);
+    }
+
+    /* While the threads are working keep draining the diff from the parent,
+     * spilling it to disk so that neither the parent rewrite buffer nor the
+     * child diff buffer can grow much. */
+    // 线程运行期间不断读取父进程发送的差异数据并写入差异文件
+    do {
+        if (aeWait(server.aof_pipe_read_data_from_parent,AE_READABLE,10) > 0)
+            aofReadDiffFromParent();
+        if (!error && sdslen(server.aof_child_diff)) {
+            if (fwrite(server.aof_child_diff,sdslen(server.aof_child_diff),1,
+                       difffp) != 1)
+            {
+                saved_errno = errno;
+                error = 1;
+            }
+            sdsclear(server.aof_child_diff);
+        }
+        pthread_mutex_lock(&job.lock);
+        running = job.running;
+        pthread_mutex_unlock(&job.lock);
+    } while (running);
+
+    for (j = 0; j < started; j++) {
+        pthread_join(workers[j].thread,NULL);
+        if (workers[j].error && !error) {
+            saved_errno = workers[j].saved_errno;
+            error = 1;
+        }
+    }
+
+    // 拼接段文件和差异文件
+    for (j = 0; !error && j < started; j++) {
+        if (aofRewriteAppendFile(aof,workers[j].fp) == 0) {
+            saved_errno = errno;
+            error = 1;
+        }
+    }
+    if (!error && aofRewriteAppendFile(aof,difffp) == 0) {
+        saved_errno = errno;
+        error = 1;
+    }
+
+cleanup:
+    for (j = 0; j < numthreads; j++) {
+        if (workers[j].fp == NULL) continue;
+        fclose(workers[j].fp);
+        unlink(workers[j].filename);
+    }
+    if (difffp) {
+        fclose(difffp);
+        unlink(difffile);
+    }
+    for (j = 0; j < server.dbnum; j++) {
+        if (dictSize(server.db[j].dict) == 0) continue;
+        dictResumeRehashing(server.db[j].dict);
+        dictResumeRehashing(server.db[j].expires);
+    }
+    pthread_mutex_destroy(&job.lock);
+    zfree(job.slices);
+    if (error) errno = saved_errno;
+    return error ? 0 : 1;
+}
+
 /* Write a sequence of commands able to fully rebuild the dataset into
  * "filename". Used both by REWRITEAOF and BGREWRITEAOF.
  *	将一系列足以重建数据集的命令写入到filename指定的文件中，该函数将被REWRITEAOF和BGREWRITEAOF命令调用。
@@ -1289,96 +2040,60 @@ int rewriteAppendOnlyFile(char *filename) {
     // 每写入REDIS_AOF_AUTOSYNC_BYTES个字节数据就执行一个sync同步操作
     if (server.aof_rewrite_incremental_fsync)
         rioSetAutoSync(&aof,REDIS_AOF_AUTOSYNC_BYTES);
-    // 遍历所有的数据库，重构命令
-    for (j = 0; j < server.dbnum; j++) {
-    	// SELECT命令
-        char selectcmd[] = "*2\r\n$6\r\nSELECT\r\n";
-        // 指向当前数据库
-        redisDb *db = server.db+j;
-        // 指向当前数据库的键空间
-        dict *d = db->dict;
-        // 如果当前键空间为空，处理下一个数据库
-        if (dictSize(d) == 0) continue;
-        // 创建键空间的迭代器
-        di = dictGetSafeIterator(d);
-        if (!di) {
-            fclose(fp);
-            return REDIS_ERR;
-        }
-
-        /* SELECT the new DB */
-        // 写入SELECT命令，确保数据恢复到相应数据库中
-        if (rioWrite(&aof,selectcmd,sizeof(selectcmd)-1) == 0) goto werr;
-        if (rioWriteBulkLongLong(&aof,j) == 0) goto werr;
-
-        /* Iterate this DB writing every entry */
-        // 遍历键空间中的所有key
-        while((de = dictNext(di)) != NULL) {
-            sds keystr;
-            robj key, *o;
-            long long expiretime;
-
-            // 取出key值
-            keystr = dictGetKey(de);
-            // 取出对应的value值
-            o = dictGetVal(de);
-            initStaticStringObject(key,keystr);
-
-            // 取出该key的过期时间
-            expiretime = getExpire(db,&key);
-
-            /* If this key is already expired skip it */
-            // 如果该key已经过期，则跳过该key
-            if (expiretime != -1 && expiretime < now) continue;
-
-            /* Save the key and associated value */
-            // 根据value值对象的类型还远成相应的命令进行保存
-
-            // 处理string类型对象
-            if (o->type == REDIS_STRING) {
-                /* Emit a SET command */
-                // 构造SET命令来保存string类型对象
-                char cmd[]="*3\r\n$3\r\nSET\r\n";
-                if (rioWrite(&aof,cmd,sizeof(cmd)-1) == 0) goto werr;
-                /* Key and value */
-                //	保存key值和value值
-                if (rioWriteBulkObject(&aof,&key) == 0) goto werr;
-                if (rioWriteBulkObject(&aof,o) == 0) goto werr;
-            } 
-            // 保存list类型对象
-            else if (o->type == REDIS_LIST) {
-                if (rewriteListObject(&aof,&key,o) == 0) goto werr;
-            } 
-            // 保存set类型对象
-            else if (o->type == REDIS_SET) {
-                if (rewriteSetObject(&aof,&key,o) == 0) goto werr;
-            } 
-            //	保存zset类型对象
-            else if (o->type == REDIS_ZSET) {
-                if (rewriteSortedSetObject(&aof,&key,o) == 0) goto werr;
-            } 
-            //	保存hash类型对象
-            else if (o->type == REDIS_HASH) {
-                if (rewriteHashObject(&aof,&key,o) == 0) goto werr;
-            } else {
-                redisPanic("Unknown object type");
-            }
-            // 使用PEXPIREAT命令保存该key的过期时间
-            /* Save the expire time */
-            if (expiretime != -1) {
-                char cmd[]="*3\r\n$9\r\nPEXPIREAT\r\n";
-                if (rioWrite(&aof,cmd,sizeof(cmd)-1) == 0) goto werr;
-                if (rioWriteBulkObject(&aof,&key) == 0) goto werr;
-                if (rioWriteBulkLongLong(&aof,expiretime) == 0) goto werr;
+    if (server.aof_rewrite_threads > 1) {
+        /* Shard the keyspace across threads, each one writing a segment
+         * file, while we keep draining the diff from the parent. */
+        // 由多个线程并行重写，主线程同时读取父进程发送的差异数据
+        if (rewriteAppendOnlyFileThreaded(&aof,server.aof_rewrite_threads,now) == 0)
+            goto werr;
+    } else {
+        // 遍历所有的数据库，重构命令
+        for (j = 0; j < server.dbnum; j++) {
+            // SELECT命令
+            char selectcmd[] = "*2\r\n$6\r\nSELECT\r\n";
+            // 指向当前数据库
+            redisDb *db = server.db+j;
+            // 指向当前数据库的键空间
+            dict *d = db->dict;
+            // 如果当前键空间为空，处理下一个数据库
+            if (dictSize(d) == 0) continue;
+            // 创建键空间的迭代器
+            di = dictGetSafeIterator(d);
+            if (!di) {
+                fclose(fp);
+                return REDIS_ERR;
             }
-            /* Read some diff from the parent process from time to time. */
-            if (aof.processed_bytes > processed+1024*10) {
-                processed = aof.processed_bytes;
-                aofReadDiffFromParent();
+
+            /* SELECT the new DB */
+            // 写入SELECT命令，确保数据恢复到相应数据库中
+            if (rioWrite(&aof,selectcmd,sizeof(selectcmd)-1) == 0) goto werr;
+            if (rioWriteBulkLongLong(&aof,j) == 0) goto werr;
+
+            /* Iterate this DB writing every entry */
+            // 遍历键空间中的所有key
+            while((de = dictNext(di)) != NULL) {
+                sds keystr;
+                packedObjectView view;
+                robj key, *o;
+
+                // 取出key值
+                keystr = dictGetKey(de);
+                // 取出对应的value值，打包的值解码到view中
+                o = keyspaceValueView(dictGetVal(de),&view);
+                initStaticStringObject(key,keystr);
+
+                // 根据value值对象的类型还原成相应的命令进行保存
+                if (rewriteKeyValuePair(&aof,db,&key,o,now) == -1) goto werr;
+
+                /* Read some diff from the parent process from time to time. */
+                if (aof.processed_bytes > processed+1024*10) {
+                    processed = aof.processed_bytes;
+                    aofReadDiffFromParent();
+                }
             }
+            dictReleaseIterator(di);
+            di = NULL;
         }
-        dictReleaseIterator(di);
-        di = NULL;
     }
 
     /* Do an initial slow fsync here while the parent is still sending
@@ -1557,10 +2272,13 @@ int rewriteAppendOnlyFileBackground(void) {
     pid_t childpid;
     long long start;
 
-    // 当前正在执行AOF文件重写操作，直接退出
-    if (server.aof_child_pid != -1) return REDIS_ERR;
+    // 当前正在执行AOF文件重写操作，或者有RDB子进程（两者共用子进程报告管道），直接退出。
+    // 调用者应该在RDB子进程存在时设置aof_rewrite_scheduled，由serverCron稍后执行重写
+    if (server.aof_child_pid != -1 || server.rdb_child_pid != -1) return REDIS_ERR;
     // 创建父子进程间通信用的匿名管道
     if (aofCreatePipes() != REDIS_OK) return REDIS_ERR;
+    // 打开子进程报告写时复制开销用的管道
+    openChildInfoPipe(REDIS_CHILD_INFO_TYPE_AOF);
     // 记录当前时间
     start = ustime();
     // 调用forks函数创建子进程
@@ -1578,13 +2296,7 @@ int rewriteAppendOnlyFileBackground(void) {
         snprintf(tmpfile,256,"temp-rewriteaof-bg-%d.aof", (int) getpid());
         // AOF文件重写
         if (rewriteAppendOnlyFile(tmpfile) == REDIS_OK) {
-            size_t private_dirty = zmalloc_get_private_dirty();
-
-            if (private_dirty) {
-                redisLog(REDIS_NOTICE,
-                    "AOF rewrite: %zu MB of memory used by copy-on-write",
-                    private_dirty/(1024*1024));
-            }
+            sendChildInfo(REDIS_CHILD_INFO_TYPE_AOF,"AOF rewrite");
             // 重写成功
             exitFromChild(0);
         } else {
@@ -1599,9 +2311,11 @@ int rewriteAppendOnlyFileBackground(void) {
         server.stat_fork_time = ustime()-start;
         server.stat_fork_rate = (double) zmalloc_used_memory() * 1000000 / server.stat_fork_time / (1024*1024*1024); /* GB per second. */
         latencyAddSampleIfNeeded("fork",server.stat_fork_time/1000);
+        latencyProbeAddIfNeeded(LATENCY_PROBE_FORK,server.stat_fork_time);
 
         // 处理fork执行失败的情况
         if (childpid == -1) {
+            closeChildInfoPipe(REDIS_CHILD_INFO_TYPE_AOF);
             redisLog(REDIS_WARNING,
                 "Can't rewrite append only file in background: fork: %s",
                 strerror(errno));
@@ -1687,6 +2401,8 @@ void backgroundRewriteDoneHandler(int exitcode, int bysignal) {
 
         redisLog(REDIS_NOTICE,
             "Background AOF rewrite terminated with success");
+        // 读取子进程报告的写时复制开销
+        receiveChildInfo(REDIS_CHILD_INFO_TYPE_AOF);
 
         /* Flush the differences accumulated by the parent to the
          * rewritten AOF. */
@@ -1801,6 +2517,8 @@ void backgroundRewriteDoneHandler(int exitcode, int bysignal) {
                 aof_fsync(newfd);
             else if (server.aof_fsync == AOF_FSYNC_EVERYSEC)
                 aof_background_fsync(newfd);
+            else if (server.aof_fsync == AOF_FSYNC_GROUP)
+                aofGroupCommitSwitchFile(newfd);
 
             // 强制引发SELECT
             server.aof_selected_db = -1; /* Make sure SELECT is re-issued */
@@ -1844,6 +2562,7 @@ void backgroundRewriteDoneHandler(int exitcode, int bysignal) {
 cleanup:
 	// 释放匿名管道
     aofClosePipes();
+    closeChildInfoPipe(REDIS_CHILD_INFO_TYPE_AOF);
     // 重置AOF重写缓存
     aofRewriteBufferReset();
     // 移除临时文件
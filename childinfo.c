@@ -0,0 +1,151 @@
+/* childinfo.c - Report the copy-on-write cost of fork children to the parent.
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "redis.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+
+/* While a child saves the dataset, every page the parent writes is copied
+ * by the kernel: the pages the child owns privately when it is done are
+ * the memory the save cost on top of the dataset. The child measures them
+ * from /proc/self/smaps right before exiting, and sends the figure to the
+ * parent through a pipe opened before the fork, so that it is exposed by
+ * INFO (rdb_last_cow_size, aof_last_cow_size) and not just logged.
+ *
+ * The report is a single fixed size struct smaller than PIPE_BUF, so it is
+ * written atomically, and it is read by the parent after the child exited:
+ * the read end is non blocking, a child that died before reporting leaves
+ * the stats untouched. */
+/*  子进程保存数据集期间，父进程写入的每一个内存页都会被内核复制一份：子进程退出前私有的页面，
+    就是这次保存在数据集之外额外消耗的内存。子进程在退出前通过/proc/self/smaps统计这些页面，
+    并通过fork之前创建的管道发送给父进程，这样就可以在INFO中（rdb_last_cow_size和aof_last_cow_size）看到，
+    而不是只记录在日志中。
+    报告是一个小于PIPE_BUF的定长结构体，因此写入是原子的；父进程在子进程退出之后读取，
+    读端是非阻塞的，没有来得及报告就退出的子进程不会修改统计值。 */
+
+/* There is a single pipe, so it remembers the kind of child it was opened
+ * for, and the done handler of another kind of child neither reads nor
+ * closes it. AOF rewrites are not started while an RDB child exists, but
+ * an RDB child started for replication during a rewrite takes the pipe
+ * over: the report of the rewrite is then lost, and nothing else. */
+/*  管道只有一个，因此记录它是为哪一类子进程打开的，其他类型子进程的完成处理函数既不读取也不关闭它。
+    存在RDB子进程时不会启动AOF重写，但AOF重写期间为复制启动的RDB子进程会接管管道：
+    此时只是丢失AOF重写的报告，不会有其他影响。 */
+
+#define CHILD_INFO_MAGIC 0xC17DDA7A12345678LL
+
+typedef struct childInfo {
+    // 子进程类型，REDIS_CHILD_INFO_TYPE_RDB或REDIS_CHILD_INFO_TYPE_AOF
+    int process_type;
+    // 子进程退出前私有的脏页字节数
+    size_t cow_size;
+    // 用于校验报告的完整性
+    unsigned long long magic;
+} childInfo;
+
+// 管道所属的子进程类型，管道未打开时为-1
+static int child_info_owner = -1;
+
+/* 关闭管道（如果已经打开），不论它属于哪一类子进程 */
+static void childInfoClosePipe(void) {
+    if (server.child_info_pipe[0] != -1 ||
+        server.child_info_pipe[1] != -1)
+    {
+        close(server.child_info_pipe[0]);
+        close(server.child_info_pipe[1]);
+        server.child_info_pipe[0] = -1;
+        server.child_info_pipe[1] = -1;
+    }
+    child_info_owner = -1;
+}
+
+/* Open the pipe used by the next child, of kind 'ptype', to report to the
+ * parent. A pipe still open for another child is closed first, so its fds
+ * are never leaked. On error the pipe is just not used: both ends are set
+ * to -1. */
+/*  为下一个类型为ptype的子进程打开向父进程报告用的管道。如果管道还属于另一个子进程，先将其关闭，
+    避免泄漏文件描述符。出错时不使用管道：两端都设置为-1 */
+void openChildInfoPipe(int ptype) {
+    childInfoClosePipe();
+    if (pipe(server.child_info_pipe) == -1) {
+        server.child_info_pipe[0] = -1;
+        server.child_info_pipe[1] = -1;
+    } else if (anetNonBlock(NULL,server.child_info_pipe[0]) != ANET_OK) {
+        childInfoClosePipe();
+    } else {
+        child_info_owner = ptype;
+    }
+}
+
+/* Close the pipe, if it is open for a child of kind 'ptype'. */
+/* 如果管道是为类型为ptype的子进程打开的，将其关闭 */
+void closeChildInfoPipe(int ptype) {
+    if (child_info_owner == ptype) childInfoClosePipe();
+}
+
+/* Called by the child right before exiting with success: measure the
+ * copy-on-write cost of the child, log it, and send it to the parent.
+ * 'name' is the job used in the log line ("RDB", "AOF rewrite"). */
+/*  子进程成功完成任务、即将退出前调用：统计子进程的写时复制开销，记录到日志中，并发送给父进程。
+    name为日志中使用的任务名称（"RDB"、"AOF rewrite"）。 */
+void sendChildInfo(int ptype, char *name) {
+    childInfo info;
+    size_t private_dirty = zmalloc_get_private_dirty();
+
+    if (private_dirty) {
+        redisLog(REDIS_NOTICE,
+            "%s: %zu MB of memory used by copy-on-write",
+            name, private_dirty/(1024*1024));
+    }
+    if (server.child_info_pipe[1] == -1) return;
+    memset(&info,0,sizeof(info));
+    info.process_type = ptype;
+    info.cow_size = private_dirty;
+    info.magic = CHILD_INFO_MAGIC;
+    if (write(server.child_info_pipe[1],&info,sizeof(info)) != sizeof(info)) {
+        /* Nothing to do on error: the parent keeps the old stats. */
+    }
+}
+
+/* Called by the parent once the child of kind 'ptype' exited: read the
+ * report, if any, and update the copy-on-write stats of that kind of child. */
+/* 类型为ptype的子进程退出后由父进程调用：读取子进程的报告（如果有的话），更新该类型子进程的写时复制统计值 */
+void receiveChildInfo(int ptype) {
+    childInfo info;
+
+    if (child_info_owner != ptype || server.child_info_pipe[0] == -1) return;
+    if (read(server.child_info_pipe[0],&info,sizeof(info)) != sizeof(info) ||
+        info.magic != CHILD_INFO_MAGIC || info.process_type != ptype) return;
+    if (info.process_type == REDIS_CHILD_INFO_TYPE_RDB)
+        server.stat_rdb_cow_bytes = info.cow_size;
+    else if (info.process_type == REDIS_CHILD_INFO_TYPE_AOF)
+        server.stat_aof_cow_bytes = info.cow_size;
+}
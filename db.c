@@ -39,22 +39,227 @@ void SlotToKeyDel(robj *key);
  * C-level DB API
  *----------------------------------------------------------------------------*/
 
+/* While EXEC runs a transaction, the last looked up entries of the keyspace
+ * are remembered, so that the commands of a MULTI block operating again and
+ * again on the same few keys (HINCRBY, LPUSH, ...) find them by comparing
+ * the key strings, without hashing them and walking the buckets.
+ *
+ * Dict entries never move while the table is rehashed, so a cached entry
+ * stays valid until it is deleted: every function removing keys from the
+ * keyspace resets the cache. */
+/*  EXEC执行事务期间会记住最近查找过的键空间节点，这样MULTI中反复操作同样几个key的命令（HINCRBY、LPUSH等）
+    只需要比较key字符串就可以找到它们，不需要计算哈希值以及遍历哈希桶。
+    哈希表rehash时节点本身不会移动，所以缓存的节点在被删除之前一直有效：所有从键空间中删除key的函数都会清空缓存。 */
+#define DB_LOOKUP_CACHE_SIZE 8
+
+static struct {
+    int active;
+    // 下一个被替换的位置
+    int next;
+    struct {
+        redisDb *db;
+        dictEntry *de;
+    } slots[DB_LOOKUP_CACHE_SIZE];
+} dbLookupCache;
+
+/* Start caching lookups, see dbLookupCacheStop(). */
+/* 开始缓存键空间的查找结果 */
+void dbLookupCacheStart(void) {
+    memset(&dbLookupCache,0,sizeof(dbLookupCache));
+    dbLookupCache.active = 1;
+}
+
+/* Stop caching lookups and forget the cached entries. */
+/* 停止缓存并丢弃已经缓存的节点 */
+void dbLookupCacheStop(void) {
+    memset(&dbLookupCache,0,sizeof(dbLookupCache));
+}
+
+/* Forget the cached entries: called every time keys are deleted. */
+/* 丢弃已经缓存的节点，每次删除key时调用 */
+void dbLookupCacheReset(void) {
+    if (dbLookupCache.active) dbLookupCacheStart();
+}
+
+/* Return the cached entry of 'key' in 'db', or NULL. */
+/* 返回缓存的key在db中的节点，如果没有缓存则返回NULL */
+static dictEntry *dbLookupCacheFind(redisDb *db, robj *key) {
+    size_t len;
+    int j;
+
+    if (!dbLookupCache.active) return NULL;
+    len = sdslen(key->ptr);
+    for (j = 0; j < DB_LOOKUP_CACHE_SIZE; j++) {
+        dictEntry *de = dbLookupCache.slots[j].de;
+        sds k;
+
+        if (de == NULL || dbLookupCache.slots[j].db != db) continue;
+        k = dictGetKey(de);
+        if (sdslen(k) == len && memcmp(k,key->ptr,len) == 0) return de;
+    }
+    return NULL;
+}
+
+static void dbLookupCacheAdd(redisDb *db, dictEntry *de) {
+    if (!dbLookupCache.active) return;
+    dbLookupCache.slots[dbLookupCache.next].db = db;
+    dbLookupCache.slots[dbLookupCache.next].de = de;
+    dbLookupCache.next = (dbLookupCache.next+1) % DB_LOOKUP_CACHE_SIZE;
+}
+
+/* Find the entry of 'key' in the keyspace of 'db'. */
+/* 在db的键空间中查找key对应的节点 */
+static dictEntry *dbFindEntry(redisDb *db, robj *key) {
+    dictEntry *de = dbLookupCacheFind(db,key);
+
+    if (de == NULL && (de = dictFind(db->dict,key->ptr)) != NULL)
+        dbLookupCacheAdd(db,de);
+    return de;
+}
+
+/* When the scan-prefix-index option is on, the keys of every db are also
+ * kept in a skiplist where all the scores are zero, so that the nodes are
+ * sorted by key name: a SCAN with a literal prefix walks just the range of
+ * keys starting with it, instead of the whole hash table.
+ *
+ * The index costs a string object and a skiplist node for every key, so it
+ * is off by default. It is built from the keyspace the first time a prefix
+ * SCAN needs it, and dropped the first time it is used again after the
+ * option was turned off. */
+/*  打开scan-prefix-index选项后，每个数据库的key还会保存在一个所有分值都为0的跳跃表中，这样节点就按照key排序：
+    带有字面前缀的SCAN只需要遍历以该前缀开头的那一段key，而不需要遍历整个哈希表。
+    索引中每个key需要一个字符串对象和一个跳跃表节点，所以该选项默认关闭。索引在第一次被带前缀的SCAN用到时
+    根据键空间创建，选项关闭后第一次再用到索引时将其释放。 */
+static zskiplist **scanIndexes = NULL;
+
+/* Return the prefix index of 'db', or NULL if there is none. */
+/* 返回数据库db的前缀索引，如果没有则返回NULL */
+static zskiplist *scanIndexGet(redisDb *db) {
+    zskiplist *zsl;
+
+    if (scanIndexes == NULL || (zsl = scanIndexes[db->id]) == NULL)
+        return NULL;
+    // 选项已经关闭，释放索引
+    if (!server.scan_prefix_index) {
+        zslFree(zsl);
+        scanIndexes[db->id] = NULL;
+        return NULL;
+    }
+    return zsl;
+}
+
+/* Return the prefix index of 'db', building it if the option is on. The
+ * keys are loaded with zslBulkSort()/zslBulkLoad() from t_zset.c, declared
+ * in redis.h. */
+/* 返回数据库db的前缀索引，如果选项打开而索引还不存在，则先创建索引。
+   key通过t_zset.c中的zslBulkSort和zslBulkLoad批量加载，它们声明在redis.h中 */
+static zskiplist *scanIndexBuild(redisDb *db) {
+    zskiplist *zsl = scanIndexGet(db);
+    dictIterator *di;
+    dictEntry *de;
+    zslBulkEntry *e;
+    unsigned long n = 0;
+
+    if (zsl != NULL || !server.scan_prefix_index) return zsl;
+    if (scanIndexes == NULL)
+        scanIndexes = zcalloc(sizeof(zskiplist*)*server.dbnum);
+
+    // 所有key的分值都为0，排序后一次性追加到跳跃表中
+    e = zmalloc(sizeof(*e)*(dictSize(db->dict)+1));
+    di = dictGetIterator(db->dict);
+    while((de = dictNext(di)) != NULL) {
+        sds key = dictGetKey(de);
+
+        e[n].obj = createStringObject(key,sdslen(key));
+        e[n].score = 0;
+        n++;
+    }
+    dictReleaseIterator(di);
+    zslBulkSort(e,n,1);
+    zsl = zslCreate();
+    zslBulkLoad(zsl,e,n);
+    zfree(e);
+    scanIndexes[db->id] = zsl;
+    return zsl;
+}
+
+/* 将key添加到数据库db的前缀索引中 */
+static void scanIndexAdd(redisDb *db, sds key) {
+    zskiplist *zsl = scanIndexGet(db);
+
+    if (zsl) zslInsert(zsl,0,createStringObject(key,sdslen(key)));
+}
+
+/* Remove 'key' from the prefix index of 'db': called every time a key is
+ * removed from the keyspace. */
+/* 从数据库db的前缀索引中删除key，每次从键空间中删除key时调用 */
+void scanIndexDelete(redisDb *db, robj *key) {
+    zskiplist *zsl = scanIndexGet(db);
+
+    if (zsl) zslDelete(zsl,0,key);
+}
+
+/* Return the estimated bytes used by the prefix index of 'db', 0 if there
+ * is none. Used by MEMORY STATS. */
+/* 估计数据库db的前缀索引占用的内存字节数，没有索引时返回0。供MEMORY STATS使用 */
+size_t scanIndexAllocSize(redisDb *db) {
+    zskiplist *zsl;
+    zskiplistNode *x;
+    size_t size = 0, n = 0;
+
+    if (scanIndexes == NULL || (zsl = scanIndexes[db->id]) == NULL) return 0;
+    // 索引中的字符串对象都是key的副本，采样前几个节点即可
+    for (x = zsl->header->level[0].forward; x && n < 16; x = x->level[0].forward) {
+        size += stringObjectAllocSize(x->obj);
+        n++;
+    }
+    if (n) size = (double)size/n*zsl->length;
+    return size + zslAllocSize(zsl);
+}
+
+/* Replace the prefix index of 'db' with an empty one when the keyspace is
+ * emptied, returning the old index (to be freed by the caller, possibly in
+ * background), or NULL if there is no index. */
+/*  清空键空间时用一个空的索引替换数据库db的前缀索引，返回旧的索引（由调用者释放，可以交给后台线程），
+    如果没有索引则返回NULL。 */
+zskiplist *scanIndexDetach(redisDb *db) {
+    zskiplist *zsl = scanIndexGet(db);
+
+    if (zsl) scanIndexes[db->id] = zslCreate();
+    return zsl;
+}
+
+/* 清空键空间时同步释放数据库db的前缀索引 */
+static void scanIndexEmpty(redisDb *db) {
+    zskiplist *zsl = scanIndexDetach(db);
+
+    if (zsl) zslFree(zsl);
+}
+
 /*  从Redis数据库db中取出指定key的对象（即五种不同的数据类型对象），
     如果key存在，则返回相应对象，否则返回NULL。   */
 robj *lookupKey(redisDb *db, robj *key) {
     // 查找指定key对应的dictEntry结构体，里面存放键值对信息
-    dictEntry *de = dictFind(db->dict,key->ptr);
+    dictEntry *de = dbFindEntry(db,key);
     // 节点存在
     if (de) {
         // 取得相应的value，即目标对象
         robj *val = dictGetVal(de);
 
+        /* Packed values are turned again into objects on access, since the
+         * commands expect a robj they can reference or modify. */
+        // 打包的值在访问时重新解包为对象，因为命令需要一个可以引用或者修改的robj
+        if (objectIsPacked(val)) {
+            val = unpackObject(val);
+            dictSetVal(db->dict,de,val);
+        }
+
         /* Update the access time for the ageing algorithm.
          * Don't do it if we have a saving child, as this will trigger
          * a copy on write madness. */
-        /* 更新时间信息 */
+        /* 更新时间信息（LFU策略下更新访问计数器） */
         if (server.rdb_child_pid == -1 && server.aof_child_pid == -1)
-            val->lru = server.lruclock;
+            objectTouchAccess(val);
         return val;
     } 
     // 节点不存在
@@ -121,10 +326,16 @@ void dbAdd(redisDb *db, robj *key, robj *val) {
     // 复制key
     sds copy = sdsdup(key->ptr);
     // 往db中添加键值对
-    int retval = dictAdd(db->dict, copy, val);
+    dictEntry *de = dictAddRaw(db->dict, copy);
 
-    redisAssertWithInfo(NULL,key,retval == REDIS_OK);
+    redisAssertWithInfo(NULL,key,de != NULL);
+    dictSetVal(db->dict, de, val);
+    dbLookupCacheAdd(db,de);
+    scanIndexAdd(db,copy);
     if (val->type == REDIS_LIST) signalListAsReady(db, key);
+    // 载入、RENAME、MOVE等操作添加的hash可能带有域过期时间，登记到过期循环中
+    if (val->type == REDIS_HASH && hashTypeHasFieldExpires(val))
+        hashFieldExpireTrack(db,key);
  }
 
 /* Overwrite an existing key with a new value. Incrementing the reference
@@ -137,12 +348,21 @@ void dbAdd(redisDb *db, robj *key, robj *val) {
     如果指定key不存在，则程序abort。  */
 void dbOverwrite(redisDb *db, robj *key, robj *val) {
     // 在db中查找指定的键值对
-    struct dictEntry *de = dictFind(db->dict,key->ptr);
+    struct dictEntry *de = dbFindEntry(db,key);
+    robj *old;
 
     // 如果指定key的键值对不存在，则abort
     redisAssertWithInfo(NULL,key,de != NULL);
-    // 赋新值
-    dictReplace(db->dict, key->ptr, val);
+    // 赋新值，旧值在lazyfree-lazy-server-del打开时交给后台线程释放
+    old = dictGetVal(de);
+    dictSetVal(db->dict, de, val);
+    // 打包的值没有单独分配内存
+    if (objectIsPacked(old))
+        return;
+    if (server.lazyfree_lazy_server_del)
+        freeObjAsync(old);
+    else
+        decrRefCount(old);
 }
 
 /* High level Set operation. This function can be used in order to set
@@ -218,9 +438,9 @@ robj *dbRandomKey(redisDb *db) {
 }
 
 /* Delete a key, value, and associated expiration entry if any, from the DB */
-/*  从数据库中删除一个给定的key、相应的值value以及该key的过期时间。   
+/*  从数据库中删除一个给定的key、相应的值value以及该key的过期时间，值被同步释放。
     如果操作成功返回1，否则返回0。    */
-int dbDelete(redisDb *db, robj *key) {
+int dbSyncDelete(redisDb *db, robj *key) {
     /* Deleting an entry from the expires dict will not free the sds of
      * the key, because it is shared with the main dictionary. */
     //  从db->expires中删除一个键值对并不会释放key字符串对象，因为db->expires和db->dict是共享
@@ -228,14 +448,26 @@ int dbDelete(redisDb *db, robj *key) {
 
     // 删除key的过期时间
     if (dictSize(db->expires) > 0) dictDelete(db->expires,key->ptr);
+    dbLookupCacheReset();
     // 从键空间中删除key和相应的value
     if (dictDelete(db->dict,key->ptr) == DICT_OK) {
+        scanIndexDelete(db,key);
         return 1;
     } else {
         return 0;
     }
 }
 
+/* Delete a key as a side effect of another operation (expire, eviction,
+ * RENAME, ...): the value is reclaimed in background when the
+ * lazyfree-lazy-server-del option is on. */
+/*  作为其它操作（过期、淘汰、RENAME等）的副作用删除一个key：
+    如果开启了lazyfree-lazy-server-del选项，值由后台线程释放。 */
+int dbDelete(redisDb *db, robj *key) {
+    return server.lazyfree_lazy_server_del ? dbAsyncDelete(db,key) :
+                                             dbSyncDelete(db,key);
+}
+
 /* Prepare the string object stored at 'key' to be modified destructively
  * to implement commands like SETBIT or APPEND.
  *
@@ -279,13 +511,18 @@ long long emptyDb(void(callback)(void*)) {
     int j;
     long long removed = 0;
 
+    dbLookupCacheReset();
     // 将该服务器中所有的数据库db清空
     for (j = 0; j < server.dbnum; j++) {
         // 记录被删除key的数量
         removed += dictSize(server.db[j].dict);
         dictEmpty(server.db[j].dict,callback);
         dictEmpty(server.db[j].expires,callback);
+        scanIndexEmpty(&server.db[j]);
     }
+    // 时间轮中的项以及域过期的登记项已经全部失效
+    expireWheelFlush(-1);
+    hashFieldExpireFlush(-1);
     return removed;
 }
 
@@ -299,6 +536,81 @@ int selectDb(redisClient *c, int id) {
     return REDIS_OK;
 }
 
+/*-----------------------------------------------------------------------------
+ * Packed keyspace values (see object.c)
+ * 键空间中值的打包表示（见object.c）
+ *----------------------------------------------------------------------------*/
+
+/* Values accessed in the last REDIS_PACK_MIN_IDLE milliseconds are not
+ * packed: they would be unpacked again by the next lookup. */
+/* 最近REDIS_PACK_MIN_IDLE毫秒内被访问过的值不打包：下一次访问又会把它解包 */
+#define REDIS_PACK_MIN_IDLE 60000
+
+/* Number of keyspace buckets visited by every call of keyspacePackCycle(). */
+/* 每次调用keyspacePackCycle访问的键空间桶的个数 */
+#define REDIS_PACK_BUCKETS_PER_CALL 1000
+
+/* Value destructor of the keyspace dict type: packed values have nothing to
+ * free. */
+/* 键空间字典的值析构函数：打包的值不需要释放 */
+void dictKeyspaceValDestructor(void *privdata, void *val) {
+    DICT_NOTUSED(privdata);
+
+    if (val == NULL || objectIsPacked(val)) return;
+    decrRefCount(val);
+}
+
+/* Return 1 if 'o' was not accessed for at least REDIS_PACK_MIN_IDLE
+ * milliseconds. */
+/* 如果对象o至少REDIS_PACK_MIN_IDLE毫秒没有被访问，返回1 */
+static int keyspaceValueIsCold(robj *o) {
+    if (REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy))
+        return LFUTimeElapsed(o->lru >> 8) >= REDIS_PACK_MIN_IDLE/60000;
+    return estimateObjectIdleTime(o) >= REDIS_PACK_MIN_IDLE;
+}
+
+/* dictScan() callback packing the value of one key if possible. Only the
+ * value pointer of the entry is modified, that's safe while scanning. */
+/* dictScan的回调函数，尽可能打包一个key的值。只修改节点的值指针，在遍历过程中是安全的 */
+static void keyspacePackCallback(void *privdata, const dictEntry *de) {
+    dict *d = privdata;
+    dictEntry *entry = (dictEntry*)de;
+    robj *o = dictGetVal(entry);
+    void *packed;
+
+    if (objectIsPacked(o) || !keyspaceValueIsCold(o)) return;
+    if ((packed = tryObjectPacking(o)) == NULL) return;
+    dictSetVal(d,entry,packed);
+    decrRefCount(o);
+}
+
+/* Incrementally pack the cold values of the keyspace, visiting
+ * REDIS_PACK_BUCKETS_PER_CALL buckets of one DB at every call. Called by
+ * databasesCron() when keyspace-pack-values is enabled. Nothing is done
+ * while a child is saving, since it would trigger copy on write. */
+/*  渐进式地打包键空间中的冷数据，每次调用访问一个数据库的REDIS_PACK_BUCKETS_PER_CALL个桶。
+    开启keyspace-pack-values时由databasesCron调用。有子进程正在保存时不执行，避免触发写时复制。 */
+void keyspacePackCycle(void) {
+    static unsigned int current_db = 0;
+    static unsigned long cursor = 0;
+    redisDb *db;
+    int j;
+
+    if (!server.keyspace_pack_values ||
+        server.rdb_child_pid != -1 || server.aof_child_pid != -1) return;
+
+    db = server.db+(current_db % server.dbnum);
+    for (j = 0; j < REDIS_PACK_BUCKETS_PER_CALL && dictSize(db->dict); j++) {
+        cursor = dictScan(db->dict,cursor,keyspacePackCallback,db->dict);
+        if (cursor == 0) break;
+    }
+    // 当前数据库遍历完成（或者为空），下一次处理下一个数据库
+    if (cursor == 0 || dictSize(db->dict) == 0) {
+        cursor = 0;
+        current_db++;
+    }
+}
+
 /*-----------------------------------------------------------------------------
  * Hooks for key space changes.
  *
@@ -316,6 +628,8 @@ void signalModifiedKey(redisDb *db, robj *key) {
 /*  每当一个数据库被flushdb命令情况后都要调用该函数。 */
 void signalFlushedDb(int dbid) {
     touchWatchedKeysOnFlush(dbid);
+    expireWheelFlush(dbid);
+    hashFieldExpireFlush(dbid);
 }
 
 /*-----------------------------------------------------------------------------
@@ -323,22 +637,54 @@ void signalFlushedDb(int dbid) {
  *  键空间中与类型无关的命令
  *----------------------------------------------------------------------------*/
 
-/* flushdb命令实现，清空指定数据库  */
+/* Parse the optional ASYNC argument of FLUSHDB and FLUSHALL. Returns
+ * REDIS_ERR (after replying) on syntax error. */
+/* 解析FLUSHDB和FLUSHALL命令可选的ASYNC参数，*async为1表示在后台释放。语法错误时回复客户端并返回REDIS_ERR */
+static int getFlushCommandFlags(redisClient *c, int *async) {
+    *async = 0;
+    if (c->argc > 1) {
+        if (c->argc > 2 || strcasecmp(c->argv[1]->ptr,"async")) {
+            addReply(c,shared.syntaxerr);
+            return REDIS_ERR;
+        }
+        *async = 1;
+    }
+    return REDIS_OK;
+}
+
+/* flushdb命令实现，清空指定数据库，命令格式为FLUSHDB [ASYNC]  */
 void flushdbCommand(redisClient *c) {
+    int async;
+
+    if (getFlushCommandFlags(c,&async) == REDIS_ERR) return;
     server.dirty += dictSize(c->db->dict);
     signalFlushedDb(c->db->id);
-    // 清空键空间和过期时间
-    dictEmpty(c->db->dict,NULL);
-    dictEmpty(c->db->expires,NULL);
+    // 清空键空间和过期时间，ASYNC时由后台线程释放
+    if (async) {
+        emptyDbAsync(c->db);
+    } else {
+        dbLookupCacheReset();
+        dictEmpty(c->db->dict,NULL);
+        dictEmpty(c->db->expires,NULL);
+        scanIndexEmpty(c->db);
+    }
     // 发送回复信息
     addReply(c,shared.ok);
 }
 
-/* 清空所有数据库  */
+/* 清空所有数据库，命令格式为FLUSHALL [ASYNC]  */
 void flushallCommand(redisClient *c) {
+    int async, j;
+
+    if (getFlushCommandFlags(c,&async) == REDIS_ERR) return;
     signalFlushedDb(-1);
-    // 清空所有数据库
-    server.dirty += emptyDb(NULL);
+    // 清空所有数据库，ASYNC时由后台线程释放
+    if (async) {
+        for (j = 0; j < server.dbnum; j++)
+            server.dirty += emptyDbAsync(&server.db[j]);
+    } else {
+        server.dirty += emptyDb(NULL);
+    }
     addReply(c,shared.ok);
     // 如果正在保存RDB，取消该操作。关于RDB我们以后再分析
     if (server.rdb_child_pid != -1) {
@@ -357,16 +703,17 @@ void flushallCommand(redisClient *c) {
     server.dirty++;
 }
 
-/* DEL命令实现，删除key。 */
-void delCommand(redisClient *c) {
+/* DEL和UNLINK命令的底层实现，lazy为1时值由后台线程释放。 */
+void delGenericCommand(redisClient *c, int lazy) {
     int deleted = 0, j;
 
     // 遍历所有的输入key，逐一删除
     for (j = 1; j < c->argc; j++) {
         // 如果该key已过期，删除
         expireIfNeeded(c->db,c->argv[j]);
-        // 调用dbDelete删除key，若删除成功返回1
-        if (dbDelete(c->db,c->argv[j])) {
+        // 删除key，若删除成功返回1
+        if (lazy ? dbAsyncDelete(c->db,c->argv[j]) :
+                   dbSyncDelete(c->db,c->argv[j])) {
             // 成功删除key，发送通知
             signalModifiedKey(c->db,c->argv[j]);
             notifyKeyspaceEvent(REDIS_NOTIFY_GENERIC,
@@ -379,6 +726,16 @@ void delCommand(redisClient *c) {
     addReplyLongLong(c,deleted);
 }
 
+/* DEL命令实现，同步删除key。 */
+void delCommand(redisClient *c) {
+    delGenericCommand(c,0);
+}
+
+/* UNLINK命令实现：key立即从键空间中删除，较大的值由后台线程释放。 */
+void unlinkCommand(redisClient *c) {
+    delGenericCommand(c,1);
+}
+
 /* EXISTS命令实现，检查给定的key是否存在。 */
 void existsCommand(redisClient *c) {
     // 检查该key是否过期，如果过期则删除
@@ -461,31 +818,105 @@ void keysCommand(redisClient *c) {
     setDeferredMultiBulkLength(c,replylen,numkeys);
 }
 
+/* The filters of a SCAN call. They are evaluated while the hash table is
+ * visited, before the elements are collected, so that the elements that
+ * are going to be filtered anyway are never turned into objects. */
+/*  SCAN调用的过滤条件。过滤在遍历哈希表的同时进行，在收集元素之前完成，这样会被过滤掉的元素就不需要创建对象。 */
+typedef struct scanFilter {
+    // MATCH选项指定的模式
+    sds pat;
+    int patlen;
+    int use_pattern;
+    // 字面前缀：PREFIX选项，或者从MATCH模式中提取的前缀；prefixlen为0时不过滤
+    sds prefix;
+    size_t prefixlen;
+    // TYPE选项指定的值类型，-1表示不过滤
+    int type;
+} scanFilter;
+
+/* The state passed to scanCallback(). */
+/* 传给scanCallback的状态 */
+typedef struct scanData {
+    // 存放收集到的元素的链表
+    list *keys;
+    // 被迭代的对象，为NULL时迭代键空间
+    robj *o;
+    scanFilter *filter;
+    // 已经访问的元素个数（被过滤掉的也计算在内），hash和zset的每个元素计为2
+    unsigned long visited;
+} scanData;
+
+/* Return true if the string 's' passes the prefix and pattern filters. */
+/* 如果字符串s满足前缀和模式两个过滤条件，返回1，否则返回0 */
+static int scanFilterString(scanFilter *f, const char *s, size_t len) {
+    if (f->prefixlen &&
+        (len < f->prefixlen || memcmp(s,f->prefix,f->prefixlen) != 0))
+        return 0;
+    if (f->use_pattern && !stringmatchlen(f->pat,f->patlen,s,len,0))
+        return 0;
+    return 1;
+}
+
+/* Like scanFilterString() but for an element object, that may be integer
+ * encoded. */
+/* 与scanFilterString相同，只是参数为元素对象，该对象可能是整数编码的 */
+static int scanFilterObject(scanFilter *f, robj *o) {
+    if (o->encoding == REDIS_ENCODING_INT) {
+        char buf[REDIS_LONGSTR_SIZE];
+        int len = ll2string(buf,sizeof(buf),(long)o->ptr);
+
+        return scanFilterString(f,buf,len);
+    }
+    return scanFilterString(f,o->ptr,sdslen(o->ptr));
+}
+
+/* Return true if the keyspace entry 'de' passes all the filters. */
+/* 如果键空间节点de满足全部过滤条件，返回1，否则返回0 */
+static int scanFilterKeyspaceEntry(scanFilter *f, dictEntry *de) {
+    sds key = dictGetKey(de);
+
+    if (!scanFilterString(f,key,sdslen(key))) return 0;
+    if (f->type != -1) {
+        packedObjectView view;
+
+        if (keyspaceValueView(dictGetVal(de),&view)->type != f->type)
+            return 0;
+    }
+    return 1;
+}
+
 /* This callback is used by scanGenericCommand in order to collect elements
  * returned by the dictionary iterator into a list. */
-/*  该函数为scanGenericCommand的回调函数，将给定dictEntry结构中的key和value存入一个链表list中。*/
+/*  该函数为scanGenericCommand的回调函数，将给定dictEntry结构中满足过滤条件的key和value存入一个链表list中。*/
 void scanCallback(void *privdata, const dictEntry *de) {
-    // 由下面的scanGenericCommand函数可以知道，privdata[0]指向相应的key，privdata[1]指向相应的对象;
-    void **pd = (void**) privdata;
-    list *keys = pd[0];
-    robj *o = pd[1];
+    // privdata指向scanGenericCommand中的scanData结构
+    scanData *data = privdata;
+    list *keys = data->keys;
+    robj *o = data->o;
     robj *key, *val = NULL;
 
+    data->visited += (o == NULL || o->type == REDIS_SET) ? 1 : 2;
+
     // 根据当前遍历的不同类型的对象进行相应的处理
     if (o == NULL) {
         sds sdskey = dictGetKey(de);
+
+        if (!scanFilterKeyspaceEntry(data->filter,(dictEntry*)de)) return;
         key = createStringObject(sdskey, sdslen(sdskey));
     } else if (o->type == REDIS_SET) {
         key = dictGetKey(de);
+        if (!scanFilterObject(data->filter,key)) return;
         incrRefCount(key);
     } else if (o->type == REDIS_HASH) {
         key = dictGetKey(de);
+        if (!scanFilterObject(data->filter,key)) return;
         incrRefCount(key);
         // 如果是哈希类型对象，还要取出key对应的值
         val = dictGetVal(de);
         incrRefCount(val);
     } else if (o->type == REDIS_ZSET) {
         key = dictGetKey(de);
+        if (!scanFilterObject(data->filter,key)) return;
         incrRefCount(key);
         val = createStringObjectFromLongDouble(*(double*)dictGetVal(de),0);
     } else {
@@ -497,6 +928,143 @@ void scanCallback(void *privdata, const dictEntry *de) {
     if (val) listAddNodeTail(keys, val);
 }
 
+/* Return the literal prefix of the glob-style pattern 'pat', that is the
+ * part before the first special character, with the escapes resolved the
+ * same way stringmatchlen() does. '*rest' is set to the remaining part of
+ * the pattern. */
+/*  返回glob风格模式pat的字面前缀，即第一个特殊字符之前的部分，转义字符的处理方式与stringmatchlen相同。
+    *rest被设置为模式中剩下的部分。 */
+static sds scanPatternPrefix(const char *pat, int patlen, const char **rest) {
+    sds prefix = sdsempty();
+    int j = 0;
+
+    while (j < patlen && pat[j] != '*' && pat[j] != '?' && pat[j] != '[') {
+        if (pat[j] == '\\' && j+1 < patlen) j++;
+        prefix = sdscatlen(prefix,pat+j,1);
+        j++;
+    }
+    *rest = pat+j;
+    return prefix;
+}
+
+/* Map a type name of the TYPE option to the object type, or -1. */
+/* 将TYPE选项中的类型名转换为对象类型，类型名不合法时返回-1 */
+static int scanTypeFromName(char *name) {
+    if (!strcasecmp(name,"string")) return REDIS_STRING;
+    if (!strcasecmp(name,"list")) return REDIS_LIST;
+    if (!strcasecmp(name,"set")) return REDIS_SET;
+    if (!strcasecmp(name,"zset")) return REDIS_ZSET;
+    if (!strcasecmp(name,"hash")) return REDIS_HASH;
+    return -1;
+}
+
+/* The cursors of a SCAN using the prefix index have the most significant
+ * bit set (a dictScan() cursor never does), then the rank of the next key
+ * in the index, and in the 32 low bits the hash of that key.
+ *
+ * Keys added or removed before the cursor shift the ranks, so the next call
+ * looks for the key with the same hash in a window around the rank. If the
+ * key is not found (it was deleted, or too many keys were added or removed
+ * meanwhile) the iteration restarts from the start of the range: elements
+ * may be returned again, but no key present for the whole iteration is
+ * missed, the same guarantee as a normal SCAN. */
+/*  使用前缀索引的SCAN游标的最高位为1（dictScan的游标最高位不会为1），接下来是下一个key在索引中的排位，
+    低32位为该key的哈希值。
+    在游标之前添加或删除key会使排位发生变化，所以下一次调用时会在该排位附近的窗口中查找哈希值相同的key。
+    如果找不到（该key已经被删除，或者期间添加删除的key太多），则从前缀范围的开头重新开始迭代：元素可能被重复返回，
+    但整个迭代期间一直存在的key不会被漏掉，这与普通的SCAN提供的保证相同。 */
+#define SCAN_INDEX_CURSOR_FLAG (1UL<<63)
+#define SCAN_INDEX_MAX_RANK ((1UL<<31)-1)
+#define SCAN_INDEX_RESUME_WINDOW 64
+
+/* 判断索引节点x的key是否以前缀开头 */
+static int scanIndexNodeInRange(zskiplistNode *x, scanFilter *f) {
+    sds key;
+
+    if (x == NULL) return 0;
+    key = x->obj->ptr;
+    return sdslen(key) >= f->prefixlen &&
+           memcmp(key,f->prefix,f->prefixlen) == 0;
+}
+
+/* 根据排位rank以及该排位上的节点x生成游标 */
+static unsigned long scanIndexCursor(unsigned long rank, zskiplistNode *x) {
+    sds key = x->obj->ptr;
+
+    return SCAN_INDEX_CURSOR_FLAG | (rank << 32) |
+           dictGenHashFunction(key,sdslen(key));
+}
+
+/* Return true if the prefix index of the current db can serve this SCAN. */
+/* 判断当前数据库的前缀索引能否用于此次SCAN */
+static int scanIndexUsable(redisDb *db, scanFilter *f, unsigned long cursor) {
+    zskiplist *zsl;
+
+    if (sizeof(unsigned long) < 8 || f->prefixlen == 0) return 0;
+    // 普通SCAN的游标，继续使用哈希表迭代
+    if (cursor != 0 && !(cursor & SCAN_INDEX_CURSOR_FLAG)) return 0;
+    if ((zsl = scanIndexBuild(db)) == NULL) return 0;
+    return zsl->length <= SCAN_INDEX_MAX_RANK;
+}
+
+/* Visit up to 'count' keys of the prefix index from 'cursor' on, adding the
+ * ones that pass the filters to 'keys'. Returns the next cursor. */
+/* 从cursor开始访问前缀索引中至多count个key，将满足过滤条件的key加入keys链表中，返回下一个游标 */
+static unsigned long scanIndexRange(redisDb *db, scanFilter *f,
+                                    unsigned long cursor, long count,
+                                    list *keys)
+{
+    zskiplist *zsl = scanIndexGet(db);
+    robj *min = createStringObject(f->prefix,f->prefixlen);
+    zlexrangespec range;
+    zskiplistNode *x;
+    unsigned long rank, first;
+
+    // 找到第一个大于等于前缀的key
+    range.min = min;
+    range.max = shared.maxstring;
+    range.minex = range.maxex = 0;
+    x = zslFirstInLexRange(zsl,&range);
+    decrRefCount(min);
+    if (!scanIndexNodeInRange(x,f)) return 0;
+    first = rank = zslGetRank(zsl,0,x->obj);
+
+    // 在游标记录的排位附近查找游标保存的key，找不到时从头开始
+    if (cursor != 0) {
+        unsigned long want = (cursor >> 32) & SCAN_INDEX_MAX_RANK;
+        unsigned int hash = cursor & 0xffffffff;
+        unsigned long r = (want > first+SCAN_INDEX_RESUME_WINDOW) ?
+                          want-SCAN_INDEX_RESUME_WINDOW : first;
+        zskiplistNode *y = zslGetElementByRank(zsl,r);
+        int j;
+
+        for (j = 0; j <= SCAN_INDEX_RESUME_WINDOW*2; j++) {
+            sds key;
+
+            if (!scanIndexNodeInRange(y,f)) break;
+            key = y->obj->ptr;
+            if (dictGenHashFunction(key,sdslen(key)) == hash) {
+                x = y;
+                rank = r;
+                break;
+            }
+            y = y->level[0].forward;
+            r++;
+        }
+    }
+
+    while (count-- && scanIndexNodeInRange(x,f)) {
+        sds key = x->obj->ptr;
+        dictEntry *de = dictFind(db->dict,key);
+
+        if (de && scanFilterKeyspaceEntry(f,de))
+            listAddNodeTail(keys,createStringObject(key,sdslen(key)));
+        x = x->level[0].forward;
+        rank++;
+    }
+    return scanIndexNodeInRange(x,f) ? scanIndexCursor(rank,x) : 0;
+}
+
 /* Try to parse a SCAN cursor stored at object 'o':
  * if the cursor is valid, store it as unsigned integer into *cursor and
  * returns REDIS_OK. Otherwise return REDIS_ERR and send an error to the
@@ -540,10 +1108,14 @@ void scanGenericCommand(redisClient *c, robj *o, unsigned long cursor) {
     listNode *node, *nextnode;
     // count选项默认值为10
     long count = 10;
-    sds pat;
-    int patlen, use_pattern = 0;
+    scanFilter filters;
+    // 元素是否已经在遍历时过滤过
+    int filtered = 0;
     dict *ht;
 
+    memset(&filters,0,sizeof(filters));
+    filters.type = -1;
+
     /* Object must be NULL (to iterate keys names), or the type of the object
      * must be Set, Sorted Set, or Hash. */
     // 参数o只能是NULL、hash对象、set对象或者sorted set对象
@@ -578,32 +1150,62 @@ void scanGenericCommand(redisClient *c, robj *o, unsigned long cursor) {
         } 
         // match选项
         else if (!strcasecmp(c->argv[i]->ptr, "match") && j >= 2) {
-            pat = c->argv[i+1]->ptr;
-            patlen = sdslen(pat);
+            filters.pat = c->argv[i+1]->ptr;
+            filters.patlen = sdslen(filters.pat);
 
             /* The pattern always matches if it is exactly "*", so it is
              * equivalent to disabling it. */
             // 判断match的选项是否为‘*’，即匹配全部
-            use_pattern = !(pat[0] == '*' && patlen == 1);
+            filters.use_pattern = !(filters.pat[0] == '*' && filters.patlen == 1);
 
             i += 2;
-        } 
-        // 除了count、match，其余都是错误的
+        }
+        // prefix选项，只返回以给定字面前缀开头的元素
+        else if (!strcasecmp(c->argv[i]->ptr, "prefix") && j >= 2) {
+            sdsfree(filters.prefix);
+            filters.prefix = sdsdup(c->argv[i+1]->ptr);
+            filters.prefixlen = sdslen(filters.prefix);
+            i += 2;
+        }
+        // type选项，只返回值为给定类型的key，只能用于SCAN
+        else if (!strcasecmp(c->argv[i]->ptr, "type") && j >= 2 && o == NULL) {
+            if ((filters.type = scanTypeFromName(c->argv[i+1]->ptr)) == -1) {
+                addReplyError(c,"unknown type name");
+                goto cleanup;
+            }
+            i += 2;
+        }
+        // 除了count、match、prefix、type，其余都是错误的
         else {
             addReply(c,shared.syntaxerr);
             goto cleanup;
         }
     }
 
+    /* Without an explicit PREFIX, the literal prefix of the pattern is used:
+     * it is cheaper to test, and it lets the prefix index serve the SCAN.
+     * When the pattern is just the prefix followed by "*", the prefix test
+     * alone is enough. */
+    // 没有指定PREFIX时使用模式的字面前缀：前缀的判断代价更小，并且可以使用前缀索引。
+    // 如果模式只是前缀加上一个“*”，只判断前缀就足够了
+    if (filters.prefix == NULL && filters.use_pattern) {
+        const char *rest;
+
+        filters.prefix = scanPatternPrefix(filters.pat,filters.patlen,&rest);
+        filters.prefixlen = sdslen(filters.prefix);
+        if (rest[0] == '*' && rest+1 == filters.pat+filters.patlen)
+            filters.use_pattern = 0;
+    }
+
     /* Step 2: Iterate the collection.
      *
-     * Note that if the object is encoded with a ziplist, intset, or any other
+     * Note that if the object is encoded with a listpack, intset, or any other
      * representation that is not a hash table, we are sure that it is also
      * composed of a small number of elements. So to avoid taking state we
      * just return everything inside the object in a single call, setting the
      * cursor to zero to signal the end of the iteration. */
     //  步骤2：迭代集合
-    //  如果目标对象是ziplist、intset或者其它非哈希表编码，那么该对象只包含少量的元素。
+    //  如果目标对象是listpack、intset或者其它非哈希表编码，那么该对象只包含少量的元素。
     //  在这种情况下，为了避免服务器记录迭代状态，我们将一次性返回该对象的所有元素，同时将游标设置为0表示迭代介绍。
 
     /* Handle the case of a hash table. */
@@ -624,9 +1226,14 @@ void scanGenericCommand(redisClient *c, robj *o, unsigned long cursor) {
         count *= 2; /* We return key / value for this type. */
     }
 
+    // 使用前缀索引遍历键空间中以前缀开头的key
+    if (o == NULL && scanIndexUsable(c->db,&filters,cursor)) {
+        cursor = scanIndexRange(c->db,&filters,cursor,count,keys);
+        filtered = 1;
+    }
     // 处理哈希表编码
-    if (ht) {
-        void *privdata[2];
+    else if (ht) {
+        scanData data;
         /* We set the max number of iterations to ten times the specified
          * COUNT, so if the hash table is in a pathological state (very
          * sparsely populated) we avoid to block too much time at the cost
@@ -634,18 +1241,45 @@ void scanGenericCommand(redisClient *c, robj *o, unsigned long cursor) {
         // 将最大的迭代次数设置为COUNT值的10倍大小
         long maxiterations = count*10;
 
-        /* We pass two pointers to the callback: the list to which it will
-         * add new elements, and the object containing the dictionary so that
-         * it is possible to fetch more data in a type-dependent way. */
-        // 我们向回调函数中传入两个指针：一个是用来存放迭代元素的链表list，另一个是保存字典结构的迭代对象
-        privdata[0] = keys;
-        privdata[1] = o;
+        // 前缀索引已经不可用，索引的游标对哈希表没有意义，从头开始迭代
+        if (cursor & SCAN_INDEX_CURSOR_FLAG) cursor = 0;
+
+        /* We pass to the callback the list to which it will add new
+         * elements, the object containing the dictionary so that it is
+         * possible to fetch more data in a type-dependent way, and the
+         * filters. The number of visited elements, not the number of the
+         * collected ones, bounds the work of the call. */
+        // 我们向回调函数中传入用来存放迭代元素的链表list、保存字典结构的迭代对象以及过滤条件。
+        // 限制单次调用工作量的是访问过的元素个数，而不是收集到的元素个数
+        data.keys = keys;
+        data.o = o;
+        data.filter = &filters;
+        data.visited = 0;
         do {
-            cursor = dictScan(ht, cursor, scanCallback, privdata);
+            cursor = dictScan(ht, cursor, scanCallback, &data);
         } while (cursor &&
               maxiterations-- &&
-              listLength(keys) < (unsigned long)count);
+              data.visited < (unsigned long)count);
+        filtered = 1;
     } 
+    // 处理roaring编码的set对象
+    // roaring集合可能非常大，不能一次性返回。由于元素是有序的，这里直接用“上次返回的最大值+1”作为游标，
+    // 游标中的值经过符号位翻转（v ^ 1<<63），保证有符号整数的顺序与无符号游标的顺序一致，游标0表示从最小值开始。
+    else if (o->type == REDIS_SET && o->encoding == REDIS_ENCODING_ROARING) {
+        roaringIterator it;
+        int64_t ll;
+
+        roaringIterInit(&it,o->ptr,(int64_t)(cursor ^ (1ULL<<63)));
+        cursor = 0;
+        while(listLength(keys) < (unsigned long)count &&
+              roaringIterNext(&it,&ll))
+        {
+            listAddNodeTail(keys,createStringObjectFromLongLong(ll));
+            cursor = ((uint64_t)ll ^ (1ULL<<63)) + 1;
+        }
+        // 已经遍历完所有元素，游标置0
+        if (!roaringIterNext(&it,&ll)) cursor = 0;
+    }
     // 处理inset编码的zet对象
     else if (o->type == REDIS_SET) {
         int pos = 0;
@@ -657,20 +1291,26 @@ void scanGenericCommand(redisClient *c, robj *o, unsigned long cursor) {
         // 游标置0
         cursor = 0;
     } 
-    // 处理ziplist编码的hash对象和zset对象
+    // 处理listpack编码（以及hashpack编码）的hash对象和zset对象
     else if (o->type == REDIS_HASH || o->type == REDIS_ZSET) {
-        unsigned char *p = ziplistIndex(o->ptr,0);
+        // hashpack编码的hash中每个域占用三个节点，跳过其中的过期时间节点
+        int packed_ex = (o->encoding == REDIS_ENCODING_LISTPACK_EX);
+        unsigned char *lp = packed_ex ? ((hashpack*)o->ptr)->lp : o->ptr;
+        unsigned char *p = lpIndex(lp,0);
         unsigned char *vstr;
-        unsigned int vlen;
+        unsigned int vlen, j = 0;
         long long vll;
 
-        // 一次性遍历ziplist，将当前元素放入keys链表中
+        // 一次性遍历listpack，将当前元素放入keys链表中
         while(p) {
-            ziplistGet(p,&vstr,&vlen,&vll);
-            listAddNodeTail(keys,
-                (vstr != NULL) ? createStringObject((char*)vstr,vlen) :
-                                 createStringObjectFromLongLong(vll));
-            p = ziplistNext(o->ptr,p);
+            if (!packed_ex || j % 3 != 2) {
+                lpGet(p,&vstr,&vlen,&vll);
+                listAddNodeTail(keys,
+                    (vstr != NULL) ? createStringObject((char*)vstr,vlen) :
+                                     createStringObjectFromLongLong(vll));
+            }
+            p = lpNext(lp,p);
+            j++;
         }
         // 游标置0
         cursor = 0;
@@ -687,23 +1327,11 @@ void scanGenericCommand(redisClient *c, robj *o, unsigned long cursor) {
         nextnode = listNextNode(node);
         int filter = 0;
 
-        /* Filter element if it does not match the pattern. */
-        if (!filter && use_pattern) {
-            // 当前元素如果是整型编码，先转换为字符串后再比较
-            if (kobj->encoding == REDIS_ENCODING_INT) {
-                char buf[REDIS_LONGSTR_SIZE];
-                int len;
-
-                redisAssert(kobj->encoding == REDIS_ENCODING_INT);
-                len = ll2string(buf,sizeof(buf),(long)kobj->ptr);
-                if (!stringmatchlen(pat, patlen, buf, len, 0)) filter = 1;
-            } 
-            // 字符串匹配
-            else {
-                if (!stringmatchlen(pat, patlen, kobj->ptr, sdslen(kobj->ptr), 0))
-                    filter = 1;
-            }
-        }
+        /* Filter element if it does not match the prefix or the pattern,
+         * unless this was already done while iterating. */
+        // 遍历哈希表或前缀索引时已经过滤过的元素不需要再次判断
+        if (!filter && !filtered && !scanFilterObject(&filters,kobj))
+            filter = 1;
 
         /* Filter element if it is an expired key. */
         // 如果该元素与给定模式匹配，继续判断该key是否已经过期
@@ -749,6 +1377,7 @@ void scanGenericCommand(redisClient *c, robj *o, unsigned long cursor) {
 cleanup:
     listSetFreeMethod(keys,decrRefCountVoid);
     listRelease(keys);
+    sdsfree(filters.prefix);
 }
 
 /* The SCAN command completely relies on scanGenericCommand. */
@@ -962,16 +1591,23 @@ int removeExpire(redisDb *db, robj *key) {
 /* 为指定key设置过期时间 */
 void setExpire(redisDb *db, robj *key, long long when) {
     dictEntry *kde, *de;
+    long long old = -1;
 
     /* Reuse the sds from the main dict in the expire dict */
     // db->dict和db->expires是共用key字符串对象的
     // 取出key
     kde = dictFind(db->dict,key->ptr);
     redisAssertWithInfo(NULL,key,kde != NULL);
-    // 取出过期时间
-    de = dictReplaceRaw(db->expires,dictGetKey(kde));
+    // 取出过期时间，key原来没有过期时间时添加一项
+    de = dictFind(db->expires,dictGetKey(kde));
+    if (de)
+        old = dictGetSignedIntegerVal(de);
+    else
+        de = dictAddRaw(db->expires,dictGetKey(kde));
     // 重置key的过期时间
     dictSetSignedIntegerVal(de,when);
+    // 开启active-expire-wheel时将key加入过期时间轮
+    expireWheelAdd(db,key,old,when);
 }
 
 /* Return the expire time of the specified key, or -1 if no expire
@@ -1031,6 +1667,8 @@ int expireIfNeeded(redisDb *db, robj *key) {
     // 获取key的过期时间
     mstime_t when = getExpire(db,key);
     mstime_t now;
+    long long probe;
+    int deleted;
 
     // 如果该key没有过期时间，返回0
     if (when < 0) return 0; /* No expire for this key */
@@ -1063,12 +1701,15 @@ int expireIfNeeded(redisDb *db, robj *key) {
     if (now <= when) return 0;
 
     /* Delete the key */
-    // 如果已过期，删除该key
+    // 如果已过期，删除该key，删除的耗时记录在expire-del探针中
+    latencyProbeStart(probe);
     server.stat_expiredkeys++;
     propagateExpire(db,key);
     notifyKeyspaceEvent(REDIS_NOTIFY_EXPIRED,
         "expired",key,db->id);
-    return dbDelete(db,key);
+    deleted = dbDelete(db,key);
+    latencyProbeEnd(LATENCY_PROBE_EXPIRE_DEL,probe);
+    return deleted;
 }
 
 /*-----------------------------------------------------------------------------
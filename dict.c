@@ -42,6 +42,8 @@
 #include <limits.h>
 #include <sys/time.h>
 #include <ctype.h>
+#include <strings.h>
+#include <unistd.h>
 
 #include "dict.h"
 #include "zmalloc.h"
@@ -54,12 +56,14 @@
  *
  * Note that even when dict_can_resize is set to 0, not all resizes are
  * prevented: a hash table is still allowed to grow if the ratio between
- * the number of elements and the buckets > dict_force_resize_ratio. */
+ * the number of elements and the buckets > dict_force_resize_ratio.
+ * A rehash in progress is paused as well, see dictRehash(). */
 /*通过dictEnableResize() / dictDisableResize()方法我们可以启用/禁用ht空间重新分配.  
 * 这对于Redis来说很重要, 因为我们用的是写时复制机制而且不想在子进程执行保存操作时移动过多的内存. 
 * 
 * 需要注意的是，即使dict_can_resize设置为0, 并不意味着所有的resize操作都被禁止: 
 * 一个a hash table仍然可以拓展空间，如果bucket与element数量之间的比例  > dict_force_resize_ratio。 
+* 已经开始的rehash也会暂停，参见dictRehash函数。
 */ 
 static int dict_can_resize = 1;
 static unsigned int dict_force_resize_ratio = 5;
@@ -76,6 +80,14 @@ static int _dictKeyIndex(dict *ht, const void *key);
 // 字典的初始化
 static int _dictInit(dict *ht, dictType *type, void *privDataPtr);
 
+/* Buckets of ht[0] with an index lower than rehashidx were already moved to
+ * ht[1] and are guaranteed to be empty: lookups can skip them and probe only
+ * the new table. */
+/*  rehash过程中，ht[0]中下标小于rehashidx的bucket已经迁移到ht[1]，一定为空。
+    查找时可以直接跳过这些bucket，只探测ht[1]，避免每次查找都访问两个表。 */
+#define _dictBucketMigrated(d, table, idx) \
+    ((table) == 0 && dictIsRehashing(d) && (long)(idx) < (d)->rehashidx)
+
 /* -------------------------- hash functions -------------------------------- */
 
 /* Thomas Wang's 32 bit Mix Function */
@@ -174,6 +186,248 @@ unsigned int dictGenCaseHashFunction(const unsigned char *buf, int len) {
     return hash;
 }
 
+/* -------------------------- pluggable hash kernels ------------------------ */
+
+/*  除了上面的MurmurHash2和djb，这里再提供几种可供dictType选择的哈希算法：
+        xxHash32：非加密哈希，速度快，适合set/hash/zset等内部使用的字典；
+        SipHash-2-4：带128位密钥的哈希，能够抵御哈希洪水攻击，适合保存客户端可控key的键空间字典。
+    每个dictType通过自己的hashFunction回调决定使用哪一种算法。 */
+
+// SipHash使用的128位密钥
+static uint8_t dict_hash_function_seed_key[16];
+
+/* 设置SipHash使用的128位密钥 */
+void dictSetHashFunctionSeedKey(const uint8_t *seed) {
+    memcpy(dict_hash_function_seed_key,seed,sizeof(dict_hash_function_seed_key));
+}
+
+/* 获取SipHash使用的128位密钥 */
+uint8_t *dictGetHashFunctionSeedKey(void) {
+    return dict_hash_function_seed_key;
+}
+
+/* Initialize both the 32 bit seed and the SipHash key with random bytes
+ * taken from /dev/urandom, falling back to time and pid when it is not
+ * available. Should be called once at startup before any dict is used. */
+/*  初始化哈希种子：优先从/dev/urandom读取随机字节，读取失败时退回到使用时间和进程id。
+    需要在服务器启动、创建任何字典之前调用。 */
+void dictInitHashFunctionSeed(void) {
+    uint8_t seed[sizeof(dict_hash_function_seed_key)+sizeof(uint32_t)];
+    FILE *fp = fopen("/dev/urandom","r");
+    uint32_t seed32;
+
+    if (fp == NULL || fread(seed,sizeof(seed),1,fp) != 1) {
+        struct timeval tv;
+        unsigned int j;
+        uint64_t mix;
+
+        gettimeofday(&tv,NULL);
+        mix = ((uint64_t)tv.tv_sec << 20) ^ tv.tv_usec ^ ((uint64_t)getpid() << 40);
+        for (j = 0; j < sizeof(seed); j++) {
+            /* xorshift64 to spread the few bits of entropy we have. */
+            mix ^= mix << 13;
+            mix ^= mix >> 7;
+            mix ^= mix << 17;
+            seed[j] = (uint8_t)mix;
+        }
+    }
+    if (fp) fclose(fp);
+
+    dictSetHashFunctionSeedKey(seed);
+    memcpy(&seed32,seed+sizeof(dict_hash_function_seed_key),sizeof(seed32));
+    dictSetHashFunctionSeed(seed32);
+}
+
+/* SipHash-2-4, by Jean-Philippe Aumasson and Daniel J. Bernstein. */
+#define SIP_ROTL(x,b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIP_U8TO64_LE(p)                                                       \
+    (((uint64_t)((p)[0])) | ((uint64_t)((p)[1]) << 8) |                        \
+     ((uint64_t)((p)[2]) << 16) | ((uint64_t)((p)[3]) << 24) |                 \
+     ((uint64_t)((p)[4]) << 32) | ((uint64_t)((p)[5]) << 40) |                 \
+     ((uint64_t)((p)[6]) << 48) | ((uint64_t)((p)[7]) << 56))
+
+#define SIP_U8TO64_LE_NOCASE(p)                                                \
+    (((uint64_t)(tolower((p)[0]))) | ((uint64_t)(tolower((p)[1])) << 8) |      \
+     ((uint64_t)(tolower((p)[2])) << 16) | ((uint64_t)(tolower((p)[3])) << 24) |\
+     ((uint64_t)(tolower((p)[4])) << 32) | ((uint64_t)(tolower((p)[5])) << 40) |\
+     ((uint64_t)(tolower((p)[6])) << 48) | ((uint64_t)(tolower((p)[7])) << 56))
+
+#define SIPROUND                                                               \
+    do {                                                                       \
+        v0 += v1; v1 = SIP_ROTL(v1,13); v1 ^= v0; v0 = SIP_ROTL(v0,32);        \
+        v2 += v3; v3 = SIP_ROTL(v3,16); v3 ^= v2;                              \
+        v0 += v3; v3 = SIP_ROTL(v3,21); v3 ^= v0;                              \
+        v2 += v1; v1 = SIP_ROTL(v1,17); v1 ^= v2; v2 = SIP_ROTL(v2,32);        \
+    } while(0)
+
+/* 计算in的SipHash-2-4值，k为128位密钥，nocase为1时按忽略大小写的方式计算 */
+static uint64_t _dictSipHash(const uint8_t *in, size_t inlen, const uint8_t *k,
+                             int nocase)
+{
+    uint64_t k0 = SIP_U8TO64_LE(k);
+    uint64_t k1 = SIP_U8TO64_LE(k+8);
+    uint64_t v0 = 0x736f6d6570736575ULL ^ k0;
+    uint64_t v1 = 0x646f72616e646f6dULL ^ k1;
+    uint64_t v2 = 0x6c7967656e657261ULL ^ k0;
+    uint64_t v3 = 0x7465646279746573ULL ^ k1;
+    const uint8_t *end = in + inlen - (inlen % 8);
+    uint64_t b = ((uint64_t)inlen) << 56;
+    uint64_t m;
+
+    // 每次处理8个字节
+    for (; in != end; in += 8) {
+        m = nocase ? SIP_U8TO64_LE_NOCASE(in) : SIP_U8TO64_LE(in);
+        v3 ^= m;
+        SIPROUND;
+        SIPROUND;
+        v0 ^= m;
+    }
+
+    // 处理剩余不足8个字节的部分
+    switch (inlen & 7) {
+    case 7: b |= ((uint64_t)(nocase ? tolower(in[6]) : in[6])) << 48;
+    case 6: b |= ((uint64_t)(nocase ? tolower(in[5]) : in[5])) << 40;
+    case 5: b |= ((uint64_t)(nocase ? tolower(in[4]) : in[4])) << 32;
+    case 4: b |= ((uint64_t)(nocase ? tolower(in[3]) : in[3])) << 24;
+    case 3: b |= ((uint64_t)(nocase ? tolower(in[2]) : in[2])) << 16;
+    case 2: b |= ((uint64_t)(nocase ? tolower(in[1]) : in[1])) << 8;
+    case 1: b |= ((uint64_t)(nocase ? tolower(in[0]) : in[0])); break;
+    case 0: break;
+    }
+
+    v3 ^= b;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= b;
+
+    v2 ^= 0xff;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/* Keyed SipHash-2-4 of the buffer, using the key set by
+ * dictSetHashFunctionSeedKey(). */
+/* 使用SipHash-2-4对给定字符串进行哈希，密钥由dictSetHashFunctionSeedKey设置 */
+uint64_t dictSipHash64(const void *key, int len) {
+    return _dictSipHash(key,len,dict_hash_function_seed_key,0);
+}
+
+/* dictSipHash64的截断版本，可以直接作为dictType的哈希函数使用 */
+unsigned int dictSipHashFunction(const void *key, int len) {
+    return (unsigned int)_dictSipHash(key,len,dict_hash_function_seed_key,0);
+}
+
+/* Case insensitive version of dictSipHashFunction(). */
+/* 忽略大小写的SipHash，可以代替dictGenCaseHashFunction */
+unsigned int dictSipHashCaseFunction(const unsigned char *buf, int len) {
+    return (unsigned int)_dictSipHash(buf,len,dict_hash_function_seed_key,1);
+}
+
+/* xxHash32, by Yann Collet. */
+#define XXH_PRIME32_1 2654435761U
+#define XXH_PRIME32_2 2246822519U
+#define XXH_PRIME32_3 3266489917U
+#define XXH_PRIME32_4 668265263U
+#define XXH_PRIME32_5 374761393U
+
+#define XXH_ROTL32(x,r) (((x) << (r)) | ((x) >> (32 - (r))))
+
+/* 以小端字节序从p读取一个32位整数，p不要求对齐 */
+static uint32_t _dictRead32LE(const unsigned char *p) {
+    return ((uint32_t)p[0]) | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* xxHash32的一轮计算 */
+static uint32_t _dictXXH32Round(uint32_t acc, uint32_t input) {
+    acc += input * XXH_PRIME32_2;
+    acc = XXH_ROTL32(acc,13);
+    acc *= XXH_PRIME32_1;
+    return acc;
+}
+
+/* Fast non cryptographic hash, using dict_hash_function_seed as seed. */
+/*  xxHash32哈希算法，使用dict_hash_function_seed作为种子。对于较长的key，每次并行处理16个字节，
+    速度明显快于MurmurHash2，适合不直接暴露给客户端的内部字典。 */
+unsigned int dictXXHashFunction(const void *key, int len) {
+    const unsigned char *p = key;
+    const unsigned char *end = p + len;
+    uint32_t seed = dict_hash_function_seed;
+    uint32_t h32;
+
+    if (len >= 16) {
+        const unsigned char *limit = end - 16;
+        uint32_t v1 = seed + XXH_PRIME32_1 + XXH_PRIME32_2;
+        uint32_t v2 = seed + XXH_PRIME32_2;
+        uint32_t v3 = seed;
+        uint32_t v4 = seed - XXH_PRIME32_1;
+
+        // 使用4个累加器并行处理，每轮16个字节
+        do {
+            v1 = _dictXXH32Round(v1,_dictRead32LE(p)); p += 4;
+            v2 = _dictXXH32Round(v2,_dictRead32LE(p)); p += 4;
+            v3 = _dictXXH32Round(v3,_dictRead32LE(p)); p += 4;
+            v4 = _dictXXH32Round(v4,_dictRead32LE(p)); p += 4;
+        } while (p <= limit);
+
+        h32 = XXH_ROTL32(v1,1) + XXH_ROTL32(v2,7) +
+              XXH_ROTL32(v3,12) + XXH_ROTL32(v4,18);
+    } else {
+        h32 = seed + XXH_PRIME32_5;
+    }
+
+    h32 += (uint32_t)len;
+
+    // 处理剩余的字节
+    while (p + 4 <= end) {
+        h32 += _dictRead32LE(p) * XXH_PRIME32_3;
+        h32 = XXH_ROTL32(h32,17) * XXH_PRIME32_4;
+        p += 4;
+    }
+    while (p < end) {
+        h32 += (*p) * XXH_PRIME32_5;
+        h32 = XXH_ROTL32(h32,11) * XXH_PRIME32_1;
+        p++;
+    }
+
+    // 最后的混合，保证每一位输入都能影响到输出
+    h32 ^= h32 >> 15;
+    h32 *= XXH_PRIME32_2;
+    h32 ^= h32 >> 13;
+    h32 *= XXH_PRIME32_3;
+    h32 ^= h32 >> 16;
+    return h32;
+}
+
+/* All the hash kernels that can be selected by name, for instance from a
+ * configuration directive. */
+/* 可以通过名字选择的哈希算法，比如用于配置文件 */
+static struct {
+    const char *name;
+    dictHashKernel *kernel;
+} dictHashKernels[] = {
+    {"murmur2", dictGenHashFunction},
+    {"xxhash32", dictXXHashFunction},
+    {"siphash", dictSipHashFunction},
+    {NULL, NULL}
+};
+
+/* Return the hash kernel with the given name, or NULL if not found. */
+/* 根据名字返回对应的哈希算法，找不到返回NULL */
+dictHashKernel *dictGetHashKernelByName(const char *name) {
+    int j;
+
+    for (j = 0; dictHashKernels[j].name != NULL; j++) {
+        if (!strcasecmp(dictHashKernels[j].name,name))
+            return dictHashKernels[j].kernel;
+    }
+    return NULL;
+}
+
 /* ----------------------------- API implementation ------------------------- */
 
 /* Reset a hash table already initialized with ht_init().
@@ -273,11 +527,34 @@ int dictExpand(dict *d, unsigned long size)
 /* Performs N steps of incremental rehashing. Returns 1 if there are still
  * keys to move from the old to the new hash table, otherwise 0 is returned.
  * Note that a rehashing step consists in moving a bucket (that may have more
- * than one key as we use chaining) from the old to the new hash table. */
-/* 执行n步渐进式的rehash操作，如果还有key需要从旧表迁移到新表则返回1，否则返回0 */
+ * than one key as we use chaining) from the old to the new hash table.
+ *
+ * Since part of the hash table may be composed of empty spaces, it is not
+ * guaranteed that this function will rehash even a single bucket, since it
+ * will visit at max N*10 empty buckets in total, otherwise the amount of
+ * work it does would be unbound and the function may block for a long time. */
+/*  执行n步渐进式的rehash操作，如果还有key需要从旧表迁移到新表则返回1，否则返回0。
+    哈希表中可能存在大量连续的空bucket，为了避免单次调用耗时过长，每次最多访问n*10个空bucket。 */
 int dictRehash(dict *d, int n) {
+    int empty_visits = n*10; /* Max number of empty buckets to visit. */
     if (!dictIsRehashing(d)) return 0;
 
+    /* While resizing is disabled a rehash already in progress is paused
+     * too: moving the entries writes every bucket and entry of the table,
+     * so all their pages would be copied while a child is saving. It goes
+     * on only if the tables are too different in size, or the new table is
+     * too loaded, for lookups to stay fast. */
+    /*  禁止resize期间，已经开始的rehash也会暂停：迁移节点需要写入哈希表的每一个bucket和节点，
+        子进程正在保存数据时会导致这些内存页全部被复制。只有当新旧两个表的大小相差太多，
+        或者新表的负载太高、查找无法保持高效时，rehash才继续进行。 */
+    if (!dict_can_resize) {
+        unsigned long s0 = d->ht[0].size, s1 = d->ht[1].size;
+
+        if (((s1 > s0 && s1/s0 < dict_force_resize_ratio) ||
+             (s1 < s0 && s0/s1 < dict_force_resize_ratio)) &&
+            d->ht[1].used/s1 <= dict_force_resize_ratio) return 0;
+    }
+
     // n步渐进式的rehash操作就是每次只迁移哈希数组中的n个bucket
     while(n--) {
         dictEntry *de, *nextde;
@@ -296,8 +573,11 @@ int dictRehash(dict *d, int n) {
          * elements because ht[0].used != 0 */
         // rehashidx标记的是当前rehash操作进行到了ht[0]旧表的那个位置（下标），因此需要判断它是否操作ht[0]的长度
         assert(d->ht[0].size > (unsigned long)d->rehashidx);
-        // 跳过ht[0]中前面为空的位置
-        while(d->ht[0].table[d->rehashidx] == NULL) d->rehashidx++;
+        // 跳过ht[0]中前面为空的位置，访问的空bucket数量达到上限则提前返回
+        while(d->ht[0].table[d->rehashidx] == NULL) {
+            d->rehashidx++;
+            if (--empty_visits == 0) return 1;
+        }
         de = d->ht[0].table[d->rehashidx];
         /* Move all the keys in this bucket from the old to the new hash HT */
         // 下面的操作将每个节点（键值对）从ht[0]迁移到ht[1],此过程需要重新计算每个节点key的哈希值
@@ -327,19 +607,103 @@ long long timeInMilliseconds(void) {
     return (((long long)tv.tv_sec)*1000)+(tv.tv_usec/1000);
 }
 
+// 获取当前的时间戳（以微秒为单位）
+long long timeInMicroseconds(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv,NULL);
+    return (((long long)tv.tv_sec)*1000000)+tv.tv_usec;
+}
+
+/* Called after every batch of timed rehashing, NULL if nobody cares. */
+/* 每一批限时rehash之后调用的回调函数，为NULL时不调用 */
+static dictRehashObserverProc *dictRehashObserver = NULL;
+
+/* Set the observer of the timed rehashing batches (NULL to remove it). The
+ * incremental steps done by lookups and updates are not reported: they are
+ * too short to be worth timing. */
+/* 设置限时rehash的观察者，参数为NULL时取消。查找和更新操作附带的单步rehash不会报告，它们太短了，不值得计时 */
+void dictSetRehashObserver(dictRehashObserverProc *proc) {
+    dictRehashObserver = proc;
+}
+
 /* Rehash for an amount of time between ms milliseconds and ms+1 milliseconds */
 /* 在指定的时间内执行rehash操作 */
 int dictRehashMilliseconds(dict *d, int ms) {
     long long start = timeInMilliseconds();
+    long long ustart = dictRehashObserver ? timeInMicroseconds() : 0;
     int rehashes = 0;
 
     while(dictRehash(d,100)) {
         rehashes += 100;
         if (timeInMilliseconds()-start > ms) break;
     }
+    if (dictRehashObserver && rehashes)
+        dictRehashObserver(timeInMicroseconds()-ustart,rehashes);
+    return rehashes;
+}
+
+/* Rehash for about 'us' microseconds. Work is done in small batches so that
+ * the time limit is respected even when the budget is well below one
+ * millisecond. Returns the number of rehash steps performed. */
+/*  在大约us微秒的时间内执行rehash操作，返回执行的rehash步数。
+    每批只迁移20个bucket，这样即使预算远小于1毫秒也能较准确地控制耗时。 */
+int dictRehashMicroseconds(dict *d, long long us) {
+    long long start = timeInMicroseconds();
+    int rehashes = 0;
+
+    if (d->iterators != 0) return 0;
+    while(dictRehash(d,20)) {
+        rehashes += 20;
+        if (timeInMicroseconds()-start >= us) break;
+    }
+    if (dictRehashObserver && rehashes)
+        dictRehashObserver(timeInMicroseconds()-start,rehashes);
     return rehashes;
 }
 
+/* Initialize an adaptive rehashing budget. The budget starts at 'min_us'
+ * and is tuned by dictRehashBudgetObserve() between 'min_us' and 'max_us',
+ * trying to keep the observed command latency below 'target_us'. */
+/*  初始化一个自适应的rehash时间预算。预算从min_us开始，随后由dictRehashBudgetObserve
+    根据观察到的命令延迟在[min_us, max_us]之间调整，目标是让命令延迟不超过target_us。 */
+void dictRehashBudgetInit(dictRehashBudget *b, long long min_us,
+                          long long max_us, long long target_us)
+{
+    if (min_us < 1) min_us = 1;
+    if (max_us < min_us) max_us = min_us;
+    b->min_us = min_us;
+    b->max_us = max_us;
+    b->target_us = target_us;
+    b->us = min_us;
+}
+
+/* Feed the budget with the latency observed since the last call (for
+ * instance the slowest command executed in the last cron period).
+ * Additive increase / multiplicative decrease: while latency stays under the
+ * target the budget grows by 'min_us' per call, as soon as the target is
+ * exceeded the budget is halved. */
+/*  根据最近观察到的延迟（比如上一个cron周期内最慢的命令耗时）调整预算，采用“加性增、乘性减”策略：
+    延迟低于目标值时每次增加min_us，超过目标值时预算减半。这样在负载较低时rehash能尽快完成，
+    在负载较高时rehash会主动让出CPU，从而降低rehash期间的p99延迟。 */
+void dictRehashBudgetObserve(dictRehashBudget *b, long long latency_us) {
+    if (latency_us > b->target_us) {
+        b->us /= 2;
+        if (b->us < b->min_us) b->us = b->min_us;
+    } else {
+        b->us += b->min_us;
+        if (b->us > b->max_us) b->us = b->max_us;
+    }
+}
+
+/* Perform incremental rehashing using the current value of the budget.
+ * Returns the number of rehash steps performed. */
+/* 按照当前的预算执行一次后台rehash操作，返回执行的rehash步数 */
+int dictRehashWithBudget(dict *d, dictRehashBudget *b) {
+    if (!dictIsRehashing(d)) return 0;
+    return dictRehashMicroseconds(d,b->us);
+}
+
 /* This function performs just a step of rehashing, and only if there are
  * no safe iterators bound to our hash table. When we have iterators in the
  * middle of a rehashing we can't mess with the two hash tables otherwise
@@ -469,6 +833,7 @@ static int dictGenericDelete(dict *d, const void *key, int nofree)
 
     for (table = 0; table <= 1; table++) {
         idx = h & d->ht[table].sizemask;
+        if (_dictBucketMigrated(d,table,idx)) continue;
         // 找到目标节点所在的链表，下面的操作就成了如何在链表中删除一个指定元素
         he = d->ht[table].table[idx];   
         prevHe = NULL;
@@ -557,6 +922,7 @@ dictEntry *dictFind(dict *d, const void *key)
     h = dictHashKey(d, key);
     for (table = 0; table <= 1; table++) {
         idx = h & d->ht[table].sizemask;
+        if (_dictBucketMigrated(d,table,idx)) continue;
         he = d->ht[table].table[idx];
         while(he) {
             if (dictCompareKeys(d, key, he->key))
@@ -741,6 +1107,107 @@ dictEntry *dictGetRandomKey(dict *d)
     return he;
 }
 
+/* This function samples the dictionary to return a few keys from random
+ * locations.
+ *
+ * It does not guarantee to return all the keys specified in 'count', nor
+ * it does guarantee to return non-duplicated elements, however it will make
+ * some effort to do both things.
+ *
+ * Returned pointers to hash table entries are stored into 'des' that
+ * points to an array of dictEntry pointers. The array must have room for
+ * at least 'count' elements, that is the argument we pass to the function
+ * to tell how many random elements we need.
+ *
+ * The function returns the number of items stored into 'des', that may
+ * be less than 'count' if the hash table has less than 'count' elements
+ * inside, or if not enough elements were found in a reasonable amount of
+ * steps.
+ *
+ * Note that this function is not suitable when you need a good distribution
+ * of the returned items, but only when you need to "sample" a given number
+ * of continuous elements to run some kind of algorithm or to produce
+ * statistics. However the function is much faster than dictGetRandomKey()
+ * at producing N elements. */
+/*  从字典中随机的位置采样若干个键值对，保存在des数组中，des至少要能容纳count个元素。
+    该函数不保证一定返回count个元素，也不保证元素不重复，但会尽量做到这两点。函数返回实际保存到des中的元素个数。
+    注意返回的元素的随机分布并不好：函数从一个随机的槽开始，连续地取出相邻槽中的元素，
+    因此只适合于采样（比如近似LRU/LFU淘汰算法），但是取N个元素比调用N次dictGetRandomKey快得多。 */
+unsigned int dictGetSomeKeys(dict *d, dictEntry **des, unsigned int count) {
+    unsigned long j; /* internal hash table id, 0 or 1. */
+    unsigned long tables; /* 1 or 2 tables? */
+    unsigned long stored = 0, maxsizemask;
+    unsigned long maxsteps;
+    unsigned long i, emptylen = 0;
+
+    if (dictSize(d) < count) count = dictSize(d);
+    maxsteps = count*10;
+
+    /* Try to do a rehashing work proportional to 'count'. */
+    // 执行与count成比例的rehash操作
+    for (j = 0; j < count; j++) {
+        if (dictIsRehashing(d))
+            _dictRehashStep(d);
+        else
+            break;
+    }
+
+    tables = dictIsRehashing(d) ? 2 : 1;
+    maxsizemask = d->ht[0].sizemask;
+    if (tables > 1 && maxsizemask < d->ht[1].sizemask)
+        maxsizemask = d->ht[1].sizemask;
+
+    /* Pick a random point inside the larger table. */
+    // 在较大的哈希表中随机选取一个起始位置
+    i = random() & maxsizemask;
+    while(stored < count && maxsteps--) {
+        for (j = 0; j < tables; j++) {
+            dictEntry *he;
+
+            /* Invariant of the dict.c rehashing: up to the indexes already
+             * visited in ht[0] during the rehashing, there are no populated
+             * buckets, so we can skip ht[0] for indexes between 0 and idx-1. */
+            // rehash过程中ht[0]中下标小于rehashidx的槽都已经为空，可以跳过
+            if (tables == 2 && j == 0 && i < (unsigned long) d->rehashidx) {
+                /* Moreover, if we are currently out of range in the second
+                 * table, there will be no elements in both tables up to
+                 * the current rehashing index, so we jump if possible.
+                 * (this happens when going from big to small table). */
+                if (i >= d->ht[1].size)
+                    i = d->rehashidx;
+                else
+                    continue;
+            }
+            if (i >= d->ht[j].size) continue; /* Out of range for this table. */
+            he = d->ht[j].table[i];
+
+            /* Count contiguous empty buckets, and jump to other
+             * locations if they reach 'count' (with a minimum of 5). */
+            // 连续遇到的空槽数量达到count（至少为5）时，跳到另一个随机位置
+            if (he == NULL) {
+                emptylen++;
+                if (emptylen >= 5 && emptylen > count) {
+                    i = random() & maxsizemask;
+                    emptylen = 0;
+                }
+            } else {
+                emptylen = 0;
+                while (he) {
+                    /* Collect all the elements of the buckets found non
+                     * empty while iterating. */
+                    *des = he;
+                    des++;
+                    he = he->next;
+                    stored++;
+                    if (stored == count) return stored;
+                }
+            }
+        }
+        i = (i+1) & maxsizemask;
+    }
+    return stored;
+}
+
 /* Function to reverse bits. Algorithm from:
  * http://graphics.stanford.edu/~seander/bithacks.html#ReverseParallel */
 /* 位翻转操作 */
@@ -910,6 +1377,38 @@ unsigned long dictScan(dict *d,
     return v;
 }
 
+/* dictScan() visits the cursors in reverse binary order, so the cursor space
+ * of a table of 2^bits buckets can be split in contiguous slices of that
+ * order and every slice scanned on its own (e.g. by different threads),
+ * provided that the dict is not rehashed in the meantime.
+ *
+ * dictScanCursorBits() returns 'bits' for the smaller table of 'd'.
+ * dictScanCursorPos() returns the position of the cursor 'v' in the visiting
+ * order, and dictScanCursorAt() the cursor at position 'pos'. */
+/*  dictScan按照反向二进制的顺序访问游标，所以一个大小为2^bits的哈希表的游标空间可以按照这个顺序
+    切分成若干连续的片段，每个片段单独遍历（比如由不同的线程负责），前提是在此期间不能执行rehash。
+
+    dictScanCursorBits返回字典中较小的哈希表对应的bits，
+    dictScanCursorPos返回游标v在遍历顺序中的位置，dictScanCursorAt返回遍历顺序中第pos个位置对应的游标。 */
+int dictScanCursorBits(dict *d) {
+    unsigned long size = d->ht[0].size;
+    int bits = 0;
+
+    if (dictIsRehashing(d) && d->ht[1].size < size) size = d->ht[1].size;
+    while ((1UL << bits) < size) bits++;
+    return bits;
+}
+
+unsigned long dictScanCursorPos(unsigned long v, int bits) {
+    if (bits == 0) return 0;
+    return rev(v) >> (sizeof(v)*8-bits);
+}
+
+unsigned long dictScanCursorAt(unsigned long pos, int bits) {
+    if (bits == 0) return 0;
+    return rev(pos << (sizeof(pos)*8-bits));
+}
+
 /* ------------------------- private functions ------------------------------ */
 
 /* Expand the hash table if needed */
@@ -974,6 +1473,7 @@ static int _dictKeyIndex(dict *d, const void *key)
     h = dictHashKey(d, key);
     for (table = 0; table <= 1; table++) {
         idx = h & d->ht[table].sizemask;
+        if (_dictBucketMigrated(d,table,idx)) continue;
         /* Search if this slot does not already contain the given key */
         he = d->ht[table].table[idx];
         // 依次比较该slot上的所有键值对的key是否和给定key相等
@@ -1128,3 +1628,38 @@ dictType dictTypeHeapStringCopyKeyValue = {
     _dictStringDestructor,         /* val destructor */
 };
 #endif
+
+#ifdef DICT_BENCHMARK_MAIN
+/* 比较各个哈希算法在不同key长度下的吞吐量 */
+int main(int argc, char **argv) {
+    static const int lens[] = {4, 8, 16, 32, 64, 128, 512, 4096};
+    long long iterations = (argc > 1) ? atoll(argv[1]) : 10000000;
+    unsigned char buf[4096];
+    unsigned int j, l, sink = 0;
+
+    for (j = 0; j < sizeof(buf); j++) buf[j] = (unsigned char)(j*31+7);
+    dictInitHashFunctionSeed();
+
+    printf("%-10s %8s %12s %10s\n","kernel","keylen","Mkeys/sec","MB/sec");
+    for (j = 0; dictHashKernels[j].name != NULL; j++) {
+        for (l = 0; l < sizeof(lens)/sizeof(*lens); l++) {
+            int len = lens[l];
+            long long loops = iterations / (1 + len/16), i;
+            long long start = timeInMicroseconds(), elapsed;
+
+            for (i = 0; i < loops; i++) {
+                /* Change the key at every iteration so the compiler can't
+                 * hoist the call out of the loop. */
+                buf[0] = (unsigned char)i;
+                sink ^= dictHashKernels[j].kernel(buf,len);
+            }
+            elapsed = timeInMicroseconds()-start;
+            if (elapsed == 0) elapsed = 1;
+            printf("%-10s %8d %12.2f %10.2f\n", dictHashKernels[j].name, len,
+                (double)loops/elapsed,
+                (double)loops*len/elapsed);
+        }
+    }
+    return sink == 0xdeadbeef; /* Use the result. */
+}
+#endif
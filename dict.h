@@ -128,6 +128,25 @@ typedef struct dictIterator {
     long long fingerprint;
 } dictIterator;
 
+/* Adaptive budget for background incremental rehashing. */
+/* 自适应的后台rehash时间预算，根据观察到的命令延迟调整每次后台rehash允许占用的时间 */
+typedef struct dictRehashBudget {
+    // 当前预算，单位为微秒
+    long long us;
+    // 预算的下限和上限
+    long long min_us, max_us;
+    // 目标延迟，观察到的延迟超过该值时收缩预算
+    long long target_us;
+} dictRehashBudget;
+
+/* Observer of the batches of rehashing done by dictRehashMilliseconds() and
+ * dictRehashMicroseconds(): duration in microseconds and rehash steps. */
+/* 观察dictRehashMilliseconds和dictRehashMicroseconds执行的每一批rehash的回调函数，参数为耗时（微秒）和步数 */
+typedef void (dictRehashObserverProc)(long long us, int steps);
+
+/* 哈希算法的函数原型，dictType的hashFunction回调可以选择调用其中任意一种 */
+typedef unsigned int (dictHashKernel)(const void *key, int len);
+
 /* 遍历回调函数 */
 typedef void (dictScanFunction)(void *privdata, const dictEntry *de);
 
@@ -200,6 +219,11 @@ typedef void (dictScanFunction)(void *privdata, const dictEntry *de);
 #define dictSize(d) ((d)->ht[0].used+(d)->ht[1].used)
 /* 判断字典dict是否正在执行rehash操作 */
 #define dictIsRehashing(d) ((d)->rehashidx != -1)
+/* Stop / resume incremental rehashing, e.g. while several threads read the
+ * dict concurrently. Lookups don't move buckets while rehashing is paused. */
+/* 暂停和恢复渐进式rehash，比如多个线程同时读取字典时，需要保证查找操作不会移动节点 */
+#define dictPauseRehashing(d) ((d)->iterators++)
+#define dictResumeRehashing(d) ((d)->iterators--)
 
 /* API */
 /* 下面定义了操作字典的方法 */
@@ -235,19 +259,37 @@ dictEntry *dictNext(dictIterator *iter);
 void dictReleaseIterator(dictIterator *iter);
 // 随机获取一个键值对
 dictEntry *dictGetRandomKey(dict *d);
+// 从随机的位置采样最多count个键值对
+unsigned int dictGetSomeKeys(dict *d, dictEntry **des, unsigned int count);
 // 打印字典当前状态
 void dictPrintStats(dict *d);
 unsigned int dictGenHashFunction(const void *key, int len);
 unsigned int dictGenCaseHashFunction(const unsigned char *buf, int len);
+unsigned int dictXXHashFunction(const void *key, int len);
+unsigned int dictSipHashFunction(const void *key, int len);
+unsigned int dictSipHashCaseFunction(const unsigned char *buf, int len);
+uint64_t dictSipHash64(const void *key, int len);
+dictHashKernel *dictGetHashKernelByName(const char *name);
 // 清空字典
 void dictEmpty(dict *d, void(callback)(void*));
 void dictEnableResize(void);
 void dictDisableResize(void);
 int dictRehash(dict *d, int n);
 int dictRehashMilliseconds(dict *d, int ms);
+int dictRehashMicroseconds(dict *d, long long us);
+void dictRehashBudgetInit(dictRehashBudget *b, long long min_us, long long max_us, long long target_us);
+void dictRehashBudgetObserve(dictRehashBudget *b, long long latency_us);
+int dictRehashWithBudget(dict *d, dictRehashBudget *b);
+void dictSetRehashObserver(dictRehashObserverProc *proc);
 void dictSetHashFunctionSeed(unsigned int initval);
 unsigned int dictGetHashFunctionSeed(void);
+void dictSetHashFunctionSeedKey(const uint8_t *seed);
+uint8_t *dictGetHashFunctionSeedKey(void);
+void dictInitHashFunctionSeed(void);
 unsigned long dictScan(dict *d, unsigned long v, dictScanFunction *fn, void *privdata);
+int dictScanCursorBits(dict *d);
+unsigned long dictScanCursorPos(unsigned long v, int bits);
+unsigned long dictScanCursorAt(unsigned long pos, int bits);
 
 /* Hash table types */
 /* 哈希表类型 */
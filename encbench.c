@@ -0,0 +1,1189 @@
+/* encbench.c - Fixed-seed benchmarks of the data structure encodings.
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* The benchmarks in this file exercise the encodings with synthetic,
+ * fixed-seed workloads, so that two runs of the same build do the same
+ * work, and two builds can be compared. They exist to justify threshold
+ * changes (zset-max-ziplist-entries and friends: the point where a compact
+ * encoding stops being faster than the hash table or the skiplist) and to
+ * spot regressions across releases.
+ *
+ * Every result is printed as one JSON object per line:
+ *
+ *   {"suite":"dict","op":"lookup-hit","encoding":"hashtable",
+ *    "elements":100000,"value_size":16,"ops":200000,"ops_sec":...,
+ *    "p50_ns":...,"p99_ns":...,"bytes_per_elem":...}
+ *
+ * Read/write mixes also report "write_pct". Latency percentiles come from
+ * a latencyHistogram fed with the average time per operation of every
+ * batch of ENCBENCH_BATCH operations: most operations take less time than
+ * reading the clock, so timing them one by one would measure the clock.
+ * bytes_per_elem is what the structure asked to the allocator, divided by
+ * the number of elements.
+ *
+ * Compiled with -DENCBENCH_MAIN this file is a standalone program running
+ * the suites of the structures that don't need the server (sds, dict,
+ * ziplist, listpack, intset). Linked in the server it also runs the suites
+ * that need real objects (the zset encodings, RDB and AOF serialization),
+ * and is started with "redis-server --encbench [options]".
+ *
+ * Options: --seed <n> (default 1234), --quick (smaller sizes and fewer
+ * operations, for CI), --suite <name> (run just that suite). */
+/*  本文件使用固定随机种子的合成负载对各种编码做基准测试，这样同一个版本的两次运行执行的是完全相同的操作，
+    不同版本之间的结果也可以直接比较。用于为阈值的调整提供依据（例如zset-max-ziplist-entries：紧凑编码
+    从哪个长度开始不再比哈希表或者跳跃表更快），以及发现不同版本之间的性能退化。
+    每个结果以一行JSON对象的形式输出，读写混合负载还会输出write_pct。延迟百分位数来自一个latencyHistogram，
+    记录的是每批ENCBENCH_BATCH个操作的平均耗时：大部分操作的耗时比读取一次时钟还短，逐个计时测量到的只是时钟本身。
+    bytes_per_elem为数据结构向分配器申请的字节数除以元素个数。
+    使用-DENCBENCH_MAIN编译时，本文件是一个独立的程序，只运行不依赖服务器的数据结构的测试（sds、dict、ziplist、
+    listpack、intset）；链接到服务器中时还会运行需要真实对象的测试（zset的两种编码、RDB和AOF的序列化），
+    通过"redis-server --encbench [选项]"启动。
+    选项：--seed <n>（默认为1234），--quick（使用更小的规模和更少的操作次数，用于CI），--suite <name>（只运行指定的测试）。 */
+
+#ifdef ENCBENCH_MAIN
+#include "fmacros.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "sds.h"
+#include "dict.h"
+#include "ziplist.h"
+#include "listpack.h"
+#include "intset.h"
+#include "zmalloc.h"
+#else
+#include "redis.h"
+#endif
+
+#include <time.h>
+#include "lathist.h"
+
+#define ENCBENCH_SEED 1234
+#define ENCBENCH_BATCH 32
+
+/* Operations of every run, in quick mode and in normal mode. */
+// 每项测试执行的操作次数，分别对应quick模式和正常模式
+#define ENCBENCH_OPS_QUICK 20000
+#define ENCBENCH_OPS 200000
+
+static struct {
+    uint64_t seed;
+    int quick;
+    long long ops;
+} bench;
+
+/* Results of the operations are accumulated here, so that the compiler
+ * can't drop the calls. */
+// 操作的结果累加到这里，防止编译器把调用优化掉
+static volatile long long benchSink;
+
+/* -----------------------------------------------------------------------------
+ * Harness
+ * -------------------------------------------------------------------------- */
+
+/* The pseudo random generator is splitmix64: it is tiny, fast, and its
+ * output only depends on the seed, unlike rand() across libcs. */
+/* 伪随机数生成器采用splitmix64：实现简单、速度快，而且输出只取决于种子，不像rand()那样因libc而异 */
+typedef struct benchRng {
+    uint64_t state;
+} benchRng;
+
+static uint64_t benchRand(benchRng *r) {
+    uint64_t z = (r->state += 0x9E3779B97F4A7C15ULL);
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/* Seed 'r' for the suite 'name': every suite gets its own sequence, so its
+ * workload doesn't change when other suites are skipped. */
+/* 为名为name的测试设置随机种子：每个测试都有自己的随机序列，跳过其他测试不会改变它的负载 */
+static void benchSeed(benchRng *r, const char *name) {
+    r->state = bench.seed;
+    while (*name) r->state = r->state*31 + (unsigned char)*name++;
+}
+
+/* Fill 'buf' with 'len' random lowercase letters. */
+/* 用len个随机的小写字母填充buf */
+static void benchRandLetters(benchRng *r, char *buf, size_t len) {
+    size_t j;
+
+    for (j = 0; j < len; j++) buf[j] = 'a' + benchRand(r)%26;
+}
+
+/* Return the unique string number 'i' of 'size' bytes: a prefix, the
+ * number, then random letters, so it is never encoded as an integer. */
+/* 返回第i个长度为size的字符串：前缀、编号以及随机字母，保证互不相同，而且不会被编码为整数 */
+static sds benchString(benchRng *r, char prefix, long i, size_t size) {
+    sds s = sdscatprintf(sdsempty(),"%c%ld:",prefix,i);
+    size_t len = sdslen(s);
+
+    if (len < size) {
+        s = sdsgrowzero(s,size);
+        benchRandLetters(r,s+len,size-len);
+    }
+    return s;
+}
+
+/* 返回单调时钟的纳秒时间戳 */
+static long long benchNow(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (long long)ts.tv_sec*1000000000LL + ts.tv_nsec;
+}
+
+/* The result of a run, printed by benchReport(). */
+/* 一项测试的结果，由benchReport输出 */
+typedef struct benchResult {
+    const char *suite;
+    const char *op;
+    const char *encoding;
+    // 数据结构中的元素个数以及元素的大小
+    long elements;
+    long value_size;
+    // 读写混合负载中写操作的百分比，其他负载为-1
+    int write_pct;
+    // 执行的操作次数以及总耗时
+    long long ops;
+    long long ns;
+    double bytes_per_elem;
+    latencyHistogram hist;
+} benchResult;
+
+/* The operation number 'i' of a run, and the setup of every round. */
+/* 测试中的第i个操作，以及每一轮开始之前的准备工作 */
+typedef void benchOpProc(void *ctx, long long i);
+typedef void benchSetupProc(void *ctx);
+
+static void benchInit(benchResult *r, const char *suite, const char *op,
+                      const char *encoding, long elements, long value_size)
+{
+    r->suite = suite;
+    r->op = op;
+    r->encoding = encoding;
+    r->elements = elements;
+    r->value_size = value_size;
+    r->write_pct = -1;
+    r->ops = 0;
+    r->ns = 0;
+    r->bytes_per_elem = 0;
+    lhReset(&r->hist);
+}
+
+/* Run 'rounds' rounds of 'ops' calls of 'proc'. 'setup', if not NULL, is
+ * called before every round and is not timed: runs building a structure
+ * from scratch use it to start again from an empty one. */
+/*  执行rounds轮测试，每轮调用ops次proc。setup不为NULL时在每一轮开始之前调用，且不计入耗时：
+    从空结构开始构建的测试通过它在每一轮重新创建一个空的数据结构。 */
+static void benchRun(benchResult *r, benchSetupProc *setup, benchOpProc *proc,
+                     void *ctx, long long ops, long long rounds)
+{
+    long long round, i, j, t, now;
+
+    for (round = 0; round < rounds; round++) {
+        if (setup) setup(ctx);
+        t = benchNow();
+        for (i = 0; i < ops; i = j) {
+            long long end = (i+ENCBENCH_BATCH < ops) ? i+ENCBENCH_BATCH : ops;
+
+            for (j = i; j < end; j++) proc(ctx,j);
+            now = benchNow();
+            lhRecord(&r->hist,(now-t)/(end-i));
+            r->ns += now-t;
+            t = now;
+        }
+        r->ops += ops;
+    }
+}
+
+/* Rounds needed to perform about bench.ops operations, 'ops' per round. */
+/* 每轮执行ops个操作时，总共执行约bench.ops个操作需要的轮数 */
+static long long benchRounds(long long ops) {
+    return (ops >= bench.ops) ? 1 : bench.ops/ops;
+}
+
+static void benchReport(benchResult *r) {
+    printf("{\"suite\":\"%s\",\"op\":\"%s\",\"encoding\":\"%s\","
+           "\"elements\":%ld,\"value_size\":%ld",
+           r->suite, r->op, r->encoding, r->elements, r->value_size);
+    if (r->write_pct >= 0) printf(",\"write_pct\":%d",r->write_pct);
+    printf(",\"ops\":%lld,\"ops_sec\":%.0f,\"p50_ns\":%lld,\"p99_ns\":%lld,"
+           "\"bytes_per_elem\":%.2f}\n",
+           r->ops, r->ns ? (double)r->ops*1e9/r->ns : 0,
+           lhPercentile(&r->hist,50), lhPercentile(&r->hist,99),
+           r->bytes_per_elem);
+    fflush(stdout);
+}
+
+/* -----------------------------------------------------------------------------
+ * sds
+ * -------------------------------------------------------------------------- */
+
+typedef struct sdsBench {
+    sds s, other;
+    char *buf;
+    size_t size;
+} sdsBench;
+
+static void sdsBenchNewFree(void *ctx, long long i) {
+    sdsBench *b = ctx;
+    ((void) i);
+    sdsfree(sdsnewlen(b->buf,b->size));
+}
+
+static void sdsBenchAppendSetup(void *ctx) {
+    sdsBench *b = ctx;
+    sdsfree(b->s);
+    b->s = sdsempty();
+}
+
+static void sdsBenchAppend(void *ctx, long long i) {
+    sdsBench *b = ctx;
+    ((void) i);
+    b->s = sdscatlen(b->s,b->buf,b->size);
+}
+
+static void sdsBenchCmp(void *ctx, long long i) {
+    sdsBench *b = ctx;
+    ((void) i);
+    // 比较两个相同的字符串，这是sdscmp最慢的情况
+    benchSink += sdscmp(b->s,b->other);
+}
+
+/* 测试创建和释放、追加以及比较不同长度的字符串 */
+static void benchSds(void) {
+    static const size_t sizes[] = {8, 64, 512, 4096};
+    benchRng rng;
+    unsigned int k;
+
+    benchSeed(&rng,"sds");
+    for (k = 0; k < sizeof(sizes)/sizeof(*sizes); k++) {
+        sdsBench b;
+        benchResult r;
+        long long per_round = (1<<20)/sizes[k];
+        double bytes;
+
+        b.size = sizes[k];
+        b.buf = zmalloc(b.size);
+        benchRandLetters(&rng,b.buf,b.size);
+        b.s = sdsnewlen(b.buf,b.size);
+        bytes = sdsAllocSize(b.s);
+
+        benchInit(&r,"sds","new-free","raw",1,b.size);
+        benchRun(&r,NULL,sdsBenchNewFree,&b,bench.ops,1);
+        r.bytes_per_elem = bytes;
+        benchReport(&r);
+
+        b.other = sdsdup(b.s);
+        benchInit(&r,"sds","cmp","raw",1,b.size);
+        benchRun(&r,NULL,sdsBenchCmp,&b,bench.ops,1);
+        r.bytes_per_elem = bytes;
+        benchReport(&r);
+
+        // 不断追加直到字符串达到1MB，然后从空字符串重新开始，包括了所有的扩容开销
+        benchInit(&r,"sds","append","raw",per_round,b.size);
+        benchRun(&r,sdsBenchAppendSetup,sdsBenchAppend,&b,per_round,
+                 benchRounds(per_round));
+        r.bytes_per_elem = (double)sdsAllocSize(b.s)/per_round;
+        benchReport(&r);
+
+        sdsfree(b.s);
+        sdsfree(b.other);
+        zfree(b.buf);
+    }
+}
+
+/* -----------------------------------------------------------------------------
+ * dict
+ * -------------------------------------------------------------------------- */
+
+static unsigned int benchSdsHash(const void *key) {
+    return dictGenHashFunction((unsigned char*)key,sdslen((sds)key));
+}
+
+static int benchSdsCompare(void *privdata, const void *key1, const void *key2) {
+    DICT_NOTUSED(privdata);
+    return sdslen((sds)key1) == sdslen((sds)key2) &&
+           memcmp(key1,key2,sdslen((sds)key1)) == 0;
+}
+
+/* The keys are owned by the benchmark, the dict never frees them. */
+/* key由测试代码持有，字典不会释放它们 */
+static dictType benchDictType = {
+    benchSdsHash,               /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    benchSdsCompare,            /* key compare */
+    NULL,                       /* key destructor */
+    NULL                        /* val destructor */
+};
+
+#define ENCBENCH_MISSES 4096
+
+typedef struct dictBench {
+    dict *d;
+    sds *keys, *misses;
+    long n;
+    int write_pct;
+    benchRng rng;
+} dictBench;
+
+static void dictBenchSetup(void *ctx) {
+    dictBench *b = ctx;
+    if (b->d) dictRelease(b->d);
+    b->d = dictCreate(&benchDictType,NULL);
+}
+
+static void dictBenchInsert(void *ctx, long long i) {
+    dictBench *b = ctx;
+    dictAdd(b->d,b->keys[i],NULL);
+}
+
+static void dictBenchLookupHit(void *ctx, long long i) {
+    dictBench *b = ctx;
+    ((void) i);
+    benchSink += dictFind(b->d,b->keys[benchRand(&b->rng)%b->n]) != NULL;
+}
+
+static void dictBenchLookupMiss(void *ctx, long long i) {
+    dictBench *b = ctx;
+    ((void) i);
+    benchSink += dictFind(b->d,b->misses[benchRand(&b->rng)%ENCBENCH_MISSES]) != NULL;
+}
+
+/* Writes delete a random key and add it back, so the size doesn't change. */
+/* 写操作删除一个随机的key然后重新添加，保持字典大小不变 */
+static void dictBenchMix(void *ctx, long long i) {
+    dictBench *b = ctx;
+    sds key = b->keys[benchRand(&b->rng)%b->n];
+    ((void) i);
+
+    if ((int)(benchRand(&b->rng)%100) < b->write_pct) {
+        dictDelete(b->d,key);
+        dictAdd(b->d,key,NULL);
+    } else {
+        benchSink += dictFind(b->d,key) != NULL;
+    }
+}
+
+/* 测试不同大小的字典的插入、命中查找、未命中查找以及读写混合负载 */
+static void benchDict(void) {
+    static const long counts[] = {1000, 100000, 1000000};
+    const size_t keylen = 16;
+    unsigned int k, ncounts = sizeof(counts)/sizeof(*counts) - bench.quick;
+
+    for (k = 0; k < ncounts; k++) {
+        dictBench b;
+        benchResult r;
+        long j;
+        size_t used, keybytes = 0;
+        double bytes;
+
+        benchSeed(&b.rng,"dict");
+        b.n = counts[k];
+        b.d = NULL;
+        b.keys = zmalloc(sizeof(sds)*b.n);
+        b.misses = zmalloc(sizeof(sds)*ENCBENCH_MISSES);
+        for (j = 0; j < b.n; j++) {
+            b.keys[j] = benchString(&b.rng,'k',j,keylen);
+            keybytes += sdsAllocSize(b.keys[j]);
+        }
+        for (j = 0; j < ENCBENCH_MISSES; j++)
+            b.misses[j] = benchString(&b.rng,'m',j,keylen);
+
+        // 键占用的内存也计入每个元素的字节数
+        used = zmalloc_used_memory();
+        dictBenchSetup(&b);
+        for (j = 0; j < b.n; j++) dictBenchInsert(&b,j);
+        bytes = (double)(zmalloc_used_memory()-used+keybytes)/b.n;
+
+        benchInit(&r,"dict","insert","hashtable",b.n,keylen);
+        benchRun(&r,dictBenchSetup,dictBenchInsert,&b,b.n,benchRounds(b.n));
+        r.bytes_per_elem = bytes;
+        benchReport(&r);
+
+        benchInit(&r,"dict","lookup-hit","hashtable",b.n,keylen);
+        benchRun(&r,NULL,dictBenchLookupHit,&b,bench.ops,1);
+        r.bytes_per_elem = bytes;
+        benchReport(&r);
+
+        benchInit(&r,"dict","lookup-miss","hashtable",b.n,keylen);
+        benchRun(&r,NULL,dictBenchLookupMiss,&b,bench.ops,1);
+        r.bytes_per_elem = bytes;
+        benchReport(&r);
+
+        b.write_pct = 10;
+        benchInit(&r,"dict","mix","hashtable",b.n,keylen);
+        r.write_pct = b.write_pct;
+        benchRun(&r,NULL,dictBenchMix,&b,bench.ops,1);
+        r.bytes_per_elem = bytes;
+        benchReport(&r);
+
+        dictRelease(b.d);
+        for (j = 0; j < b.n; j++) sdsfree(b.keys[j]);
+        for (j = 0; j < ENCBENCH_MISSES; j++) sdsfree(b.misses[j]);
+        zfree(b.keys);
+        zfree(b.misses);
+    }
+}
+
+/* -----------------------------------------------------------------------------
+ * ziplist and listpack
+ *
+ * Both are run with the same values and operations, at the element counts
+ * around the *-max-ziplist-entries thresholds. */
+/*  ziplist和listpack使用相同的数据和操作，元素个数取*-max-ziplist-entries阈值附近的值 */
+/* -------------------------------------------------------------------------- */
+
+/* The operations a compact list is tested with. */
+/* 紧凑列表需要实现的测试操作 */
+typedef struct blobListType {
+    const char *suite;
+    unsigned char *(*create)(void);
+    unsigned char *(*push)(unsigned char *zl, sds value);
+    // 读取下标为index的元素
+    long long (*get)(unsigned char *zl, long index);
+    // 查找元素，返回是否找到
+    int (*find)(unsigned char *zl, sds value);
+    // 删除第一个元素并将其追加到尾部
+    unsigned char *(*rotate)(unsigned char *zl);
+    size_t (*bytes)(unsigned char *zl);
+} blobListType;
+
+static unsigned char *zlBenchPush(unsigned char *zl, sds value) {
+    return ziplistPush(zl,(unsigned char*)value,sdslen(value),ZIPLIST_TAIL);
+}
+
+static long long zlBenchGet(unsigned char *zl, long index) {
+    unsigned char *sval = NULL;
+    unsigned int slen;
+    long long lval;
+
+    ziplistGet(ziplistIndex(zl,index),&sval,&slen,&lval);
+    return sval ? slen : lval;
+}
+
+static int zlBenchFind(unsigned char *zl, sds value) {
+    return ziplistFind(ziplistIndex(zl,0),(unsigned char*)value,sdslen(value),0) != NULL;
+}
+
+static unsigned char *zlBenchRotate(unsigned char *zl) {
+    unsigned char *p = ziplistIndex(zl,0), *sval = NULL;
+    unsigned int slen;
+    long long lval;
+    char buf[4096];
+
+    ziplistGet(p,&sval,&slen,&lval);
+    memcpy(buf,sval,slen);
+    zl = ziplistDelete(zl,&p);
+    return ziplistPush(zl,(unsigned char*)buf,slen,ZIPLIST_TAIL);
+}
+
+static unsigned char *lpBenchPush(unsigned char *lp, sds value) {
+    return lpPush(lp,(unsigned char*)value,sdslen(value),LP_TAIL);
+}
+
+static long long lpBenchGet(unsigned char *lp, long index) {
+    unsigned char *sval = NULL;
+    unsigned int slen;
+    long long lval;
+
+    lpGet(lpIndex(lp,index),&sval,&slen,&lval);
+    return sval ? slen : lval;
+}
+
+static int lpBenchFind(unsigned char *lp, sds value) {
+    return lpFind(lpIndex(lp,0),(unsigned char*)value,sdslen(value),0) != NULL;
+}
+
+static unsigned char *lpBenchRotate(unsigned char *lp) {
+    unsigned char *p = lpIndex(lp,0), *sval = NULL;
+    unsigned int slen;
+    long long lval;
+    char buf[4096];
+
+    lpGet(p,&sval,&slen,&lval);
+    memcpy(buf,sval,slen);
+    lp = lpDelete(lp,&p);
+    return lpPush(lp,(unsigned char*)buf,slen,LP_TAIL);
+}
+
+static blobListType benchZiplistType = {
+    "ziplist", ziplistNew, zlBenchPush, zlBenchGet, zlBenchFind,
+    zlBenchRotate, ziplistBlobLen
+};
+
+static blobListType benchListpackType = {
+    "listpack", lpNew, lpBenchPush, lpBenchGet, lpBenchFind,
+    lpBenchRotate, lpBytes
+};
+
+typedef struct blobListBench {
+    blobListType *type;
+    unsigned char *zl;
+    sds *values;
+    long n;
+    int write_pct;
+    benchRng rng;
+} blobListBench;
+
+static void blobListBenchSetup(void *ctx) {
+    blobListBench *b = ctx;
+    zfree(b->zl);
+    b->zl = b->type->create();
+}
+
+static void blobListBenchPush(void *ctx, long long i) {
+    blobListBench *b = ctx;
+    b->zl = b->type->push(b->zl,b->values[i]);
+}
+
+static void blobListBenchIndex(void *ctx, long long i) {
+    blobListBench *b = ctx;
+    ((void) i);
+    benchSink += b->type->get(b->zl,benchRand(&b->rng)%b->n);
+}
+
+static void blobListBenchFind(void *ctx, long long i) {
+    blobListBench *b = ctx;
+    ((void) i);
+    benchSink += b->type->find(b->zl,b->values[benchRand(&b->rng)%b->n]);
+}
+
+static void blobListBenchMix(void *ctx, long long i) {
+    blobListBench *b = ctx;
+
+    if ((int)(benchRand(&b->rng)%100) < b->write_pct)
+        b->zl = b->type->rotate(b->zl);
+    else
+        blobListBenchFind(ctx,i);
+}
+
+/* 测试紧凑列表的追加、按下标读取、查找以及读写混合负载 */
+static void benchBlobList(blobListType *type) {
+    static const long counts[] = {16, 64, 128, 256, 512, 1024};
+    static const size_t sizes[] = {8, 64};
+    unsigned int k, v;
+
+    for (v = 0; v < sizeof(sizes)/sizeof(*sizes); v++) {
+        for (k = 0; k < sizeof(counts)/sizeof(*counts); k++) {
+            blobListBench b;
+            benchResult r;
+            long j;
+            double bytes;
+
+            benchSeed(&b.rng,type->suite);
+            b.type = type;
+            b.n = counts[k];
+            b.zl = NULL;
+            b.values = zmalloc(sizeof(sds)*b.n);
+            for (j = 0; j < b.n; j++)
+                b.values[j] = benchString(&b.rng,'v',j,sizes[v]);
+
+            benchInit(&r,type->suite,"push",type->suite,b.n,sizes[v]);
+            benchRun(&r,blobListBenchSetup,blobListBenchPush,&b,b.n,benchRounds(b.n));
+            bytes = (double)type->bytes(b.zl)/b.n;
+            r.bytes_per_elem = bytes;
+            benchReport(&r);
+
+            benchInit(&r,type->suite,"index",type->suite,b.n,sizes[v]);
+            benchRun(&r,NULL,blobListBenchIndex,&b,bench.ops,1);
+            r.bytes_per_elem = bytes;
+            benchReport(&r);
+
+            benchInit(&r,type->suite,"find",type->suite,b.n,sizes[v]);
+            benchRun(&r,NULL,blobListBenchFind,&b,bench.ops,1);
+            r.bytes_per_elem = bytes;
+            benchReport(&r);
+
+            b.write_pct = 10;
+            benchInit(&r,type->suite,"mix",type->suite,b.n,sizes[v]);
+            r.write_pct = b.write_pct;
+            benchRun(&r,NULL,blobListBenchMix,&b,bench.ops,1);
+            r.bytes_per_elem = bytes;
+            benchReport(&r);
+
+            zfree(b.zl);
+            for (j = 0; j < b.n; j++) sdsfree(b.values[j]);
+            zfree(b.values);
+        }
+    }
+}
+
+static void benchZiplist(void) {
+    benchBlobList(&benchZiplistType);
+}
+
+static void benchListpack(void) {
+    benchBlobList(&benchListpackType);
+}
+
+/* -----------------------------------------------------------------------------
+ * intset
+ * -------------------------------------------------------------------------- */
+
+typedef struct intsetBench {
+    intset *is;
+    int64_t *values;
+    long n;
+    int write_pct;
+    benchRng rng;
+} intsetBench;
+
+static void intsetBenchSetup(void *ctx) {
+    intsetBench *b = ctx;
+    zfree(b->is);
+    b->is = intsetNew();
+}
+
+static void intsetBenchAdd(void *ctx, long long i) {
+    intsetBench *b = ctx;
+    uint8_t success;
+    b->is = intsetAdd(b->is,b->values[i],&success);
+}
+
+static void intsetBenchFindHit(void *ctx, long long i) {
+    intsetBench *b = ctx;
+    ((void) i);
+    benchSink += intsetFind(b->is,b->values[benchRand(&b->rng)%b->n]);
+}
+
+/* The values are even, so odd values always miss. */
+/* 集合中的值都是偶数，因此奇数总是查找失败 */
+static void intsetBenchFindMiss(void *ctx, long long i) {
+    intsetBench *b = ctx;
+    ((void) i);
+    benchSink += intsetFind(b->is,b->values[benchRand(&b->rng)%b->n]+1);
+}
+
+static void intsetBenchMix(void *ctx, long long i) {
+    intsetBench *b = ctx;
+    int64_t value = b->values[benchRand(&b->rng)%b->n];
+    uint8_t success;
+    int removed;
+    ((void) i);
+
+    if ((int)(benchRand(&b->rng)%100) < b->write_pct) {
+        b->is = intsetRemove(b->is,value,&removed);
+        b->is = intsetAdd(b->is,value,&success);
+    } else {
+        benchSink += intsetFind(b->is,value);
+    }
+}
+
+/* 测试intset的添加、命中查找、未命中查找以及读写混合负载，元素为32位的整数 */
+static void benchIntset(void) {
+    static const long counts[] = {16, 128, 512, 4096, 65536};
+    unsigned int k;
+
+    for (k = 0; k < sizeof(counts)/sizeof(*counts); k++) {
+        intsetBench b;
+        benchResult r;
+        long j;
+        double bytes;
+
+        benchSeed(&b.rng,"intset");
+        b.n = counts[k];
+        b.is = NULL;
+        b.values = zmalloc(sizeof(int64_t)*b.n);
+        for (j = 0; j < b.n; j++)
+            b.values[j] = (int32_t)(benchRand(&b.rng) & ~1ULL);
+
+        benchInit(&r,"intset","add","intset",b.n,sizeof(int32_t));
+        benchRun(&r,intsetBenchSetup,intsetBenchAdd,&b,b.n,benchRounds(b.n));
+        bytes = (double)intsetBlobLen(b.is)/intsetLen(b.is);
+        r.bytes_per_elem = bytes;
+        benchReport(&r);
+
+        benchInit(&r,"intset","find-hit","intset",b.n,sizeof(int32_t));
+        benchRun(&r,NULL,intsetBenchFindHit,&b,bench.ops,1);
+        r.bytes_per_elem = bytes;
+        benchReport(&r);
+
+        benchInit(&r,"intset","find-miss","intset",b.n,sizeof(int32_t));
+        benchRun(&r,NULL,intsetBenchFindMiss,&b,bench.ops,1);
+        r.bytes_per_elem = bytes;
+        benchReport(&r);
+
+        b.write_pct = 10;
+        benchInit(&r,"intset","mix","intset",b.n,sizeof(int32_t));
+        r.write_pct = b.write_pct;
+        benchRun(&r,NULL,intsetBenchMix,&b,bench.ops,1);
+        r.bytes_per_elem = bytes;
+        benchReport(&r);
+
+        zfree(b.is);
+        zfree(b.values);
+    }
+}
+
+#ifndef ENCBENCH_MAIN
+/* -----------------------------------------------------------------------------
+ * Sorted sets: listpack versus skiplist
+ *
+ * The same members and scores are stored in both encodings, at element
+ * counts around zset-max-ziplist-entries: where the listpack becomes slower
+ * than the skiplist is where the threshold should be. The objects are never
+ * converted, whatever the configuration. */
+/*  在两种编码中保存相同的成员和分值，元素个数取zset-max-ziplist-entries附近的值：
+    listpack开始比跳跃表慢的地方就是阈值应该在的位置。无论配置如何，测试中的对象都不会被转换编码。 */
+/* -------------------------------------------------------------------------- */
+
+/* 返回[0,1)之间的随机浮点数 */
+static double benchRandDouble(benchRng *r) {
+    return (benchRand(r) >> 11) * (1.0/9007199254740992.0);
+}
+
+typedef struct zsetBench {
+    robj *zobj;
+    int encoding;
+    robj **members;
+    double *scores;
+    long n;
+    int write_pct;
+    benchRng rng;
+} zsetBench;
+
+/* Add or update 'ele' with 'score', as ZADD does, without converting. */
+/* 与ZADD一样添加或者更新成员ele的分值，但不会转换编码 */
+static void zsetBenchAdd(robj *zobj, robj *ele, double score) {
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
+        unsigned char *eptr;
+        double curscore;
+
+        if ((eptr = zzlFind(zobj->ptr,ele,&curscore)) != NULL) {
+            if (score == curscore) return;
+            zobj->ptr = zzlDelete(zobj->ptr,eptr);
+        }
+        zobj->ptr = zzlInsert(zobj->ptr,ele,score);
+    } else {
+        zset *zs = zobj->ptr;
+        zskiplistNode *znode;
+        dictEntry *de = dictFind(zs->dict,ele);
+
+        if (de != NULL) {
+            robj *curobj = dictGetKey(de);
+            double curscore = *(double*)dictGetVal(de);
+
+            if (score == curscore) return;
+            redisAssert(zslDelete(zs->zsl,curscore,curobj));
+            znode = zslInsert(zs->zsl,score,curobj);
+            incrRefCount(curobj);
+            dictGetVal(de) = &znode->score;
+        } else {
+            znode = zslInsert(zs->zsl,score,ele);
+            incrRefCount(ele);
+            redisAssert(dictAdd(zs->dict,ele,&znode->score) == DICT_OK);
+            incrRefCount(ele);
+        }
+    }
+}
+
+static void zsetBenchSetup(void *ctx) {
+    zsetBench *b = ctx;
+    if (b->zobj) decrRefCount(b->zobj);
+    b->zobj = (b->encoding == REDIS_ENCODING_LISTPACK) ?
+        createZsetListpackObject() : createZsetObject();
+}
+
+static void zsetBenchInsert(void *ctx, long long i) {
+    zsetBench *b = ctx;
+    zsetBenchAdd(b->zobj,b->members[i],b->scores[i]);
+}
+
+/* ZSCORE */
+static void zsetBenchScore(void *ctx, long long i) {
+    zsetBench *b = ctx;
+    robj *ele = b->members[benchRand(&b->rng)%b->n];
+    double score = 0;
+    ((void) i);
+
+    if (b->zobj->encoding == REDIS_ENCODING_LISTPACK) {
+        zzlFind(b->zobj->ptr,ele,&score);
+    } else {
+        dictEntry *de = dictFind(((zset*)b->zobj->ptr)->dict,ele);
+        if (de) score = *(double*)dictGetVal(de);
+    }
+    benchSink += (long long)score;
+}
+
+/* ZRANK, computed the way zrankGenericCommand() does. */
+/* ZRANK，计算方式与zrankGenericCommand相同 */
+static void zsetBenchRank(void *ctx, long long i) {
+    zsetBench *b = ctx;
+    robj *ele = b->members[benchRand(&b->rng)%b->n];
+    unsigned long rank = 0;
+    ((void) i);
+
+    if (b->zobj->encoding == REDIS_ENCODING_LISTPACK) {
+        unsigned char *zl = b->zobj->ptr, *eptr, *sptr;
+
+        eptr = lpIndex(zl,0);
+        sptr = lpNext(zl,eptr);
+        rank = 1;
+        while(eptr != NULL) {
+            if (zzlCompareElements(eptr,ele->ptr,sdslen(ele->ptr))) break;
+            rank++;
+            zzlNext(zl,&eptr,&sptr);
+        }
+    } else {
+        zset *zs = b->zobj->ptr;
+        dictEntry *de = dictFind(zs->dict,ele);
+
+        if (de) rank = zslGetRank(zs->zsl,*(double*)dictGetVal(de),ele);
+    }
+    benchSink += rank;
+}
+
+/* Writes give a new score to a random member. */
+/* 写操作为一个随机成员设置新的分值 */
+static void zsetBenchMix(void *ctx, long long i) {
+    zsetBench *b = ctx;
+
+    if ((int)(benchRand(&b->rng)%100) < b->write_pct) {
+        zsetBenchAdd(b->zobj,b->members[benchRand(&b->rng)%b->n],
+                     benchRandDouble(&b->rng));
+    } else {
+        zsetBenchScore(ctx,i);
+    }
+}
+
+static void benchZset(void) {
+    static const long counts[] = {16, 64, 128, 256, 512, 1024};
+    static const size_t sizes[] = {8, 32};
+    static const int encodings[] = {REDIS_ENCODING_LISTPACK, REDIS_ENCODING_SKIPLIST};
+    unsigned int k, v, e;
+
+    for (v = 0; v < sizeof(sizes)/sizeof(*sizes); v++) {
+        for (k = 0; k < sizeof(counts)/sizeof(*counts); k++) {
+            for (e = 0; e < sizeof(encodings)/sizeof(*encodings); e++) {
+                zsetBench b;
+                benchResult r;
+                const char *enc = strEncoding(encodings[e]);
+                long j;
+                double bytes;
+
+                benchSeed(&b.rng,"zset");
+                b.encoding = encodings[e];
+                b.n = counts[k];
+                b.zobj = NULL;
+                b.members = zmalloc(sizeof(robj*)*b.n);
+                b.scores = zmalloc(sizeof(double)*b.n);
+                for (j = 0; j < b.n; j++) {
+                    sds s = benchString(&b.rng,'m',j,sizes[v]);
+
+                    b.members[j] = createObject(REDIS_STRING,s);
+                    b.scores[j] = benchRandDouble(&b.rng);
+                }
+
+                benchInit(&r,"zset","insert",enc,b.n,sizes[v]);
+                benchRun(&r,zsetBenchSetup,zsetBenchInsert,&b,b.n,benchRounds(b.n));
+                bytes = (double)objectComputeSize(b.zobj,0)/b.n;
+                r.bytes_per_elem = bytes;
+                benchReport(&r);
+
+                benchInit(&r,"zset","score",enc,b.n,sizes[v]);
+                benchRun(&r,NULL,zsetBenchScore,&b,bench.ops,1);
+                r.bytes_per_elem = bytes;
+                benchReport(&r);
+
+                benchInit(&r,"zset","rank",enc,b.n,sizes[v]);
+                benchRun(&r,NULL,zsetBenchRank,&b,bench.ops,1);
+                r.bytes_per_elem = bytes;
+                benchReport(&r);
+
+                b.write_pct = 10;
+                benchInit(&r,"zset","mix",enc,b.n,sizes[v]);
+                r.write_pct = b.write_pct;
+                benchRun(&r,NULL,zsetBenchMix,&b,bench.ops,1);
+                r.bytes_per_elem = bytes;
+                benchReport(&r);
+
+                decrRefCount(b.zobj);
+                for (j = 0; j < b.n; j++) decrRefCount(b.members[j]);
+                zfree(b.members);
+                zfree(b.scores);
+            }
+        }
+    }
+}
+
+/* -----------------------------------------------------------------------------
+ * RDB and AOF serialization
+ * -------------------------------------------------------------------------- */
+
+/* A value of every type, in every encoding the size leads to. */
+/* 各种类型、由元素个数决定的各种编码的测试值 */
+typedef struct serialBenchValue {
+    int type;
+    int encoding;
+    long elements;
+} serialBenchValue;
+
+/* Build the value described by 'v' with 16 bytes elements. */
+/* 根据v创建一个测试值，元素的长度为16字节 */
+static robj *serialBenchCreate(serialBenchValue *v, benchRng *rng) {
+    robj *o = NULL;
+    long j;
+
+    switch(v->type) {
+    case REDIS_STRING:
+        return createObject(REDIS_STRING,benchString(rng,'s',0,v->elements));
+    case REDIS_LIST:
+        o = createQuicklistObject();
+        break;
+    case REDIS_SET:
+        o = (v->encoding == REDIS_ENCODING_INTSET) ?
+            createIntsetObject() : createSetObject();
+        break;
+    case REDIS_ZSET:
+        o = (v->encoding == REDIS_ENCODING_LISTPACK) ?
+            createZsetListpackObject() : createZsetObject();
+        break;
+    case REDIS_HASH:
+        o = createHashObject();
+        break;
+    }
+    for (j = 0; j < v->elements; j++) {
+        robj *ele = (v->encoding == REDIS_ENCODING_INTSET) ?
+            createStringObjectFromLongLong(benchRand(rng)%1000000000) :
+            createObject(REDIS_STRING,benchString(rng,'e',j,16));
+
+        if (v->type == REDIS_LIST) {
+            listTypePush(o,ele,REDIS_TAIL);
+        } else if (v->type == REDIS_SET) {
+            setTypeAdd(o,ele);
+        } else if (v->type == REDIS_ZSET) {
+            zsetBenchAdd(o,ele,benchRandDouble(rng));
+        } else {
+            robj *val = createObject(REDIS_STRING,benchString(rng,'f',j,16));
+
+            hashTypeSet(o,ele,val);
+            decrRefCount(val);
+        }
+        decrRefCount(ele);
+    }
+    if (v->type == REDIS_HASH && o->encoding != v->encoding)
+        hashTypeConvert(o,v->encoding);
+    return o;
+}
+
+typedef struct serialBench {
+    robj *o, *key;
+    sds buf;
+    sds payload;
+} serialBench;
+
+static void rdbBenchSave(void *ctx, long long i) {
+    serialBench *b = ctx;
+    rio rdb;
+    ((void) i);
+
+    sdsclear(b->buf);
+    rioInitWithBuffer(&rdb,b->buf);
+    redisAssert(rdbSaveObjectType(&rdb,b->o) != -1);
+    redisAssert(rdbSaveObject(&rdb,b->o) != -1);
+    b->buf = rdb.io.buffer.ptr;
+}
+
+static void rdbBenchLoad(void *ctx, long long i) {
+    serialBench *b = ctx;
+    rio rdb;
+    robj *o;
+    int type;
+    ((void) i);
+
+    rioInitWithBuffer(&rdb,b->payload);
+    type = rdbLoadObjectType(&rdb);
+    redisAssert(type != -1 && (o = rdbLoadObject(type,&rdb)) != NULL);
+    decrRefCount(o);
+}
+
+static void aofBenchRewrite(void *ctx, long long i) {
+    serialBench *b = ctx;
+    rio aof;
+    int retval = 0;
+    ((void) i);
+
+    sdsclear(b->buf);
+    rioInitWithBuffer(&aof,b->buf);
+    switch(b->o->type) {
+    case REDIS_STRING:
+        retval = rioWriteBulkCount(&aof,'*',3) &&
+                 rioWriteBulkString(&aof,"SET",3) &&
+                 rioWriteBulkObject(&aof,b->key) &&
+                 rioWriteBulkObject(&aof,b->o);
+        break;
+    case REDIS_LIST: retval = rewriteListObject(&aof,b->key,b->o); break;
+    case REDIS_SET: retval = rewriteSetObject(&aof,b->key,b->o); break;
+    case REDIS_ZSET: retval = rewriteSortedSetObject(&aof,b->key,b->o); break;
+    case REDIS_HASH: retval = rewriteHashObject(&aof,b->key,b->o); break;
+    }
+    redisAssert(retval != 0);
+    b->buf = aof.io.buffer.ptr;
+}
+
+static serialBenchValue serialBenchValues[] = {
+    {REDIS_STRING, REDIS_ENCODING_RAW, 64},
+    {REDIS_STRING, REDIS_ENCODING_RAW, 4096},
+    {REDIS_LIST, REDIS_ENCODING_QUICKLIST, 1000},
+    {REDIS_SET, REDIS_ENCODING_INTSET, 512},
+    {REDIS_SET, REDIS_ENCODING_HT, 1000},
+    {REDIS_ZSET, REDIS_ENCODING_LISTPACK, 128},
+    {REDIS_ZSET, REDIS_ENCODING_SKIPLIST, 1000},
+    {REDIS_HASH, REDIS_ENCODING_LISTPACK, 128},
+    {REDIS_HASH, REDIS_ENCODING_HT, 1000},
+    {-1, 0, 0}
+};
+
+/*  测试每种值的RDB保存、RDB载入以及AOF重写，每个操作处理一个完整的值。
+    字符串的elements为字符串的长度，bytes_per_elem为序列化之后每个元素的字节数。 */
+static void benchSerialization(int aof) {
+    serialBenchValue *v;
+    benchRng rng;
+
+    benchSeed(&rng,aof ? "aof" : "rdb");
+    for (v = serialBenchValues; v->type != -1; v++) {
+        serialBench b;
+        benchResult r;
+        const char *enc;
+        long elements = (v->type == REDIS_STRING) ? 1 : v->elements;
+        long vsize = (v->type == REDIS_STRING) ? v->elements : 16;
+        long long ops = bench.ops/elements;
+
+        if (ops < 100) ops = 100;
+        b.o = serialBenchCreate(v,&rng);
+        b.key = createStringObject("encbench",8);
+        b.buf = sdsempty();
+        enc = strEncoding(b.o->encoding);
+
+        if (aof) {
+            benchInit(&r,"aof","rewrite",enc,elements,vsize);
+            benchRun(&r,NULL,aofBenchRewrite,&b,ops,1);
+            r.bytes_per_elem = (double)sdslen(b.buf)/elements;
+            benchReport(&r);
+        } else {
+            rdbBenchSave(&b,0);
+            b.payload = sdsdup(b.buf);
+
+            benchInit(&r,"rdb","save",enc,elements,vsize);
+            benchRun(&r,NULL,rdbBenchSave,&b,ops,1);
+            r.bytes_per_elem = (double)sdslen(b.payload)/elements;
+            benchReport(&r);
+
+            benchInit(&r,"rdb","load",enc,elements,vsize);
+            benchRun(&r,NULL,rdbBenchLoad,&b,ops,1);
+            r.bytes_per_elem = (double)sdslen(b.payload)/elements;
+            benchReport(&r);
+            sdsfree(b.payload);
+        }
+        decrRefCount(b.o);
+        decrRefCount(b.key);
+        sdsfree(b.buf);
+    }
+}
+
+static void benchRdb(void) {
+    benchSerialization(0);
+}
+
+static void benchAof(void) {
+    benchSerialization(1);
+}
+#endif
+
+/* -----------------------------------------------------------------------------
+ * Entry point
+ * -------------------------------------------------------------------------- */
+
+static struct {
+    const char *name;
+    void (*proc)(void);
+} benchSuites[] = {
+    {"sds", benchSds},
+    {"dict", benchDict},
+    {"ziplist", benchZiplist},
+    {"listpack", benchListpack},
+    {"intset", benchIntset},
+#ifndef ENCBENCH_MAIN
+    {"zset", benchZset},
+    {"rdb", benchRdb},
+    {"aof", benchAof},
+#endif
+    {NULL, NULL}
+};
+
+/* Run the suites according to the options in argv[1..argc-1]. Returns the
+ * exit code of the program. */
+/* 根据argv[1..argc-1]中的选项运行测试，返回程序的退出码 */
+int encbenchMain(int argc, char **argv) {
+    const char *only = NULL;
+    int j;
+
+    bench.seed = ENCBENCH_SEED;
+    bench.quick = 0;
+    for (j = 1; j < argc; j++) {
+        if (!strcmp(argv[j],"--seed") && j+1 < argc) {
+            bench.seed = strtoull(argv[++j],NULL,10);
+        } else if (!strcmp(argv[j],"--quick")) {
+            bench.quick = 1;
+        } else if (!strcmp(argv[j],"--suite") && j+1 < argc) {
+            only = argv[++j];
+        } else {
+            fprintf(stderr,"Usage: %s [--seed <n>] [--quick] [--suite <name>]\n",argv[0]);
+            return 1;
+        }
+    }
+    bench.ops = bench.quick ? ENCBENCH_OPS_QUICK : ENCBENCH_OPS;
+    for (j = 0; only && benchSuites[j].name != NULL; j++)
+        if (!strcmp(only,benchSuites[j].name)) break;
+    if (only && benchSuites[j].name == NULL) {
+        fprintf(stderr,"Unknown suite '%s'\n",only);
+        return 1;
+    }
+
+    // 第一行输出运行参数，便于比较不同的运行结果
+    printf("{\"encbench\":1,\"seed\":%llu,\"quick\":%d,\"batch\":%d}\n",
+        (unsigned long long)bench.seed, bench.quick, ENCBENCH_BATCH);
+    for (j = 0; benchSuites[j].name != NULL; j++) {
+        if (only && strcmp(only,benchSuites[j].name)) continue;
+        benchSuites[j].proc();
+    }
+    return 0;
+}
+
+#ifdef ENCBENCH_MAIN
+int main(int argc, char **argv) {
+    return encbenchMain(argc,argv);
+}
+#endif
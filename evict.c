@@ -0,0 +1,483 @@
+/* Maxmemory directive handling (LRU / LFU / TTL eviction with an eviction
+ * pool).
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "redis.h"
+
+/* ----------------------------------------------------------------------------
+ * LFU (Least Frequently Used) implementation.
+ *
+ * With the LFU policies the 24 bits of the 'lru' field of every object are
+ * split in two parts:
+ *
+ *          16 bits      8 bits
+ *     +----------------+--------+
+ *     + Last decr time | LOG_C  |
+ *     +----------------+--------+
+ *
+ * LOG_C is a logarithmic access counter: it saturates at 255, and the
+ * probability of an increment gets smaller as the counter grows, according
+ * to lfu-log-factor. New keys start at REDIS_LFU_INIT_VAL so that they are
+ * not evicted before they have a chance to be accessed again.
+ *
+ * The last decrement time is the time, in minutes (reduced to 16 bits), at
+ * which the counter was last updated. Every lfu-decay-time minutes elapsed
+ * since then the counter is decremented by one, so keys that were hot a long
+ * time ago eventually become candidates for eviction.
+ *
+ * 使用LFU淘汰策略时，每个对象的24位lru字段被分为两部分：高16位保存上一次更新计数器的时间（分钟，取低16位），
+ * 低8位LOG_C是一个对数计数器：最大为255，计数器越大，每次访问使其加1的概率越小（由lfu-log-factor控制）。
+ * 新的key的计数器初始值为REDIS_LFU_INIT_VAL，避免还没来得及被再次访问就被淘汰。
+ * 距离上次更新每经过lfu-decay-time分钟，计数器减1，这样很久以前的热点key最终也会成为淘汰的候选。
+ * --------------------------------------------------------------------------*/
+
+/* Return the current time in minutes, just taking the least significant
+ * 16 bits. The returned time is suitable to be stored as LDT (last decrement
+ * time) for the LFU implementation. */
+/* 返回以分钟为单位的当前时间的低16位，用作LFU的上次更新时间 */
+unsigned long LFUGetTimeInMinutes(void) {
+    return (server.unixtime/60) & 65535;
+}
+
+/* Given an object last access time, compute the minimum number of minutes
+ * that elapsed since the last access. Handle overflow (ldt greater than
+ * the current 16 bits minutes time) considering the time as wrapping
+ * exactly once. */
+/* 计算距离上次更新ldt经过的分钟数，考虑16位时间回绕一次的情况 */
+unsigned long LFUTimeElapsed(unsigned long ldt) {
+    unsigned long now = LFUGetTimeInMinutes();
+
+    if (now >= ldt) return now-ldt;
+    return 65535-ldt+now;
+}
+
+/* Logarithmically increment a counter. The greater is the current counter
+ * value the less likely is that it gets really implemented. Saturate it at
+ * 255. */
+/* 以对数的方式增加计数器：当前值越大，真正加1的概率越小，最大为255 */
+uint8_t LFULogIncr(uint8_t counter) {
+    double r, baseval, p;
+
+    if (counter == 255) return 255;
+    r = (double)rand()/RAND_MAX;
+    baseval = counter - REDIS_LFU_INIT_VAL;
+    if (baseval < 0) baseval = 0;
+    p = 1.0/(baseval*server.lfu_log_factor+1);
+    if (r < p) counter++;
+    return counter;
+}
+
+/* If the object decrement time is reached decrement the LFU counter but
+ * do not update the LFU fields of the object, we update the access time
+ * and counter in an explicit way when the object is really accessed.
+ * And we will times halve the counter according to the times of
+ * elapsed time than server.lfu_decay_time.
+ * Return the object frequency counter.
+ *
+ * This function is used in order to scan the dataset for the best object
+ * to fit: as we check for the candidate, we incrementally decrement the
+ * counter of the scanned objects if needed. */
+/*  返回对象o经过衰减之后的访问计数器，但不修改对象本身，对象的计数器只在真正被访问时才更新。 */
+unsigned long LFUDecrAndReturn(robj *o) {
+    unsigned long ldt = o->lru >> 8;
+    unsigned long counter = o->lru & 255;
+    unsigned long num_periods = server.lfu_decay_time ?
+        LFUTimeElapsed(ldt) / server.lfu_decay_time : 0;
+
+    if (num_periods)
+        counter = (num_periods > counter) ? 0 : counter - num_periods;
+    return counter;
+}
+
+/* The 'lru' field of a newly created object. */
+/* 新创建对象的lru字段初始值：LFU策略下为当前时间和初始计数器，否则为LRU时钟 */
+unsigned int objectInitialLRU(void) {
+    if (REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy))
+        return (LFUGetTimeInMinutes()<<8) | REDIS_LFU_INIT_VAL;
+    return server.lruclock;
+}
+
+/* Update the access information of 'o' on a key lookup. */
+/* 访问key时更新对象o的访问信息：LFU策略下先衰减再对数递增计数器，否则更新LRU时钟 */
+void objectTouchAccess(robj *o) {
+    if (REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy)) {
+        uint8_t counter = LFUDecrAndReturn(o);
+
+        counter = LFULogIncr(counter);
+        o->lru = (LFUGetTimeInMinutes()<<8) | counter;
+    } else {
+        o->lru = server.lruclock;
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * The eviction pool.
+ *
+ * Evicting the best of N random keys is a poor approximation of the real
+ * algorithm with small N. Instead every eviction samples maxmemory-samples
+ * keys from every DB and merges them into a pool of the best EVPOOL_SIZE
+ * candidates seen so far, sorted by ascending "idle" score (the higher the
+ * score, the better the candidate). The pool survives across calls, so a
+ * good candidate found in an old sampling round is still evicted before a
+ * worse one found later, and a small number of samples gives results close
+ * to the exact algorithm.
+ *
+ * The score is the idle time for LRU, 255 minus the decayed counter for
+ * LFU, and the reverse of the expire time for volatile-ttl.
+ *
+ *  淘汰池：从N个随机key中淘汰最好的一个，在N较小时与精确算法相差较大。因此每次淘汰时，
+ *  从每个数据库中采样maxmemory-samples个key，合并到一个大小为EVPOOL_SIZE的淘汰池中，
+ *  淘汰池按"idle"分值升序保存目前为止见过的最好的候选（分值越大越应该被淘汰）。
+ *  淘汰池在多次调用之间保留，因此旧的采样轮次中找到的好候选仍然会先于后来找到的较差候选被淘汰，
+ *  较少的采样次数也能得到接近精确算法的结果。
+ *  LRU的分值为空闲时间，LFU的分值为255减去衰减后的计数器，volatile-ttl的分值为过期时间取反。
+ * --------------------------------------------------------------------------*/
+
+#define EVPOOL_SIZE 16
+#define EVPOOL_CACHED_SDS_SIZE 255
+
+/* 淘汰池中的一个候选 */
+struct evictionPoolEntry {
+    // 淘汰分值，越大越应该被淘汰
+    unsigned long long idle;
+    // 候选key
+    sds key;
+    // 预先分配的sds，短key直接复制到这里，避免每次都分配内存
+    sds cached;
+    // key所在的数据库
+    int dbid;
+};
+
+static struct evictionPoolEntry *EvictionPoolLRU;
+
+/* Create a new eviction pool. */
+/* 创建淘汰池 */
+static void evictionPoolAlloc(void) {
+    struct evictionPoolEntry *ep;
+    int j;
+
+    ep = zmalloc(sizeof(*ep)*EVPOOL_SIZE);
+    for (j = 0; j < EVPOOL_SIZE; j++) {
+        ep[j].idle = 0;
+        ep[j].key = NULL;
+        ep[j].cached = sdsnewlen(NULL,EVPOOL_CACHED_SDS_SIZE);
+        ep[j].dbid = 0;
+    }
+    EvictionPoolLRU = ep;
+}
+
+/* Release the key of the pool entry k. */
+/* 释放淘汰池中第k项的key */
+static void evictionPoolClearEntry(struct evictionPoolEntry *pool, int k) {
+    if (pool[k].key != pool[k].cached) sdsfree(pool[k].key);
+    pool[k].key = NULL;
+    pool[k].idle = 0;
+}
+
+/* This is an helper function for freeMemoryIfNeeded(), it is used in order
+ * to populate the evictionPool with a few entries every time we want to
+ * expire a key. Keys with idle time smaller than one of the current
+ * keys are added. Keys are always added if there are free entries.
+ *
+ * We insert keys on place in ascending order, so keys with the smaller
+ * idle time are on the left, and keys with the higher idle time on the
+ * right. */
+/*  freeMemoryIfNeeded的辅助函数：从sampledict中采样若干个key加入淘汰池。
+    如果淘汰池还有空位则总是加入，否则只有分值比池中某个候选大时才加入（替换掉分值最小的候选）。
+    淘汰池按分值升序排列，分值最大的候选在最右边。 */
+static void evictionPoolPopulate(int dbid, dict *sampledict, dict *keydict,
+                                 struct evictionPoolEntry *pool)
+{
+    int j, k, count;
+    dictEntry **samples;
+    dictEntry *_samples[16];
+
+    if (server.maxmemory_samples <= 16)
+        samples = _samples;
+    else
+        samples = zmalloc(sizeof(samples[0])*server.maxmemory_samples);
+
+    count = dictGetSomeKeys(sampledict,samples,server.maxmemory_samples);
+    for (j = 0; j < count; j++) {
+        unsigned long long idle;
+        sds key;
+        robj *o = NULL;
+        packedObjectView view;
+        dictEntry *de;
+
+        de = samples[j];
+        key = dictGetKey(de);
+
+        /* If the dictionary we are sampling from is not the main
+         * dictionary (but the expires one) we need to lookup the key
+         * again in the key dictionary to obtain the value object. */
+        // 如果采样的是过期字典，需要到键空间中再查找一次以获得值对象（volatile-ttl不需要值对象）
+        if (server.maxmemory_policy != REDIS_MAXMEMORY_VOLATILE_TTL) {
+            if (sampledict != keydict) de = dictFind(keydict, key);
+            o = keyspaceValueView(dictGetVal(de),&view);
+        }
+
+        // 计算候选的淘汰分值
+        if (REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy)) {
+            idle = 255-LFUDecrAndReturn(o);
+        } else if (server.maxmemory_policy == REDIS_MAXMEMORY_VOLATILE_TTL) {
+            /* In this case the sooner the expire the better. */
+            idle = ULLONG_MAX - (long)dictGetVal(de);
+        } else {
+            idle = estimateObjectIdleTime(o);
+        }
+
+        /* Insert the element inside the pool.
+         * First, find the first empty bucket or the first populated
+         * bucket that has an idle time smaller than our idle time. */
+        // 找到第一个空位或者第一个分值不小于当前候选的位置
+        k = 0;
+        while (k < EVPOOL_SIZE &&
+               pool[k].key &&
+               pool[k].idle < idle) k++;
+        if (k == 0 && pool[EVPOOL_SIZE-1].key != NULL) {
+            /* Can't insert if the element is < the worst element we have
+             * and there are no empty buckets. */
+            // 淘汰池已满且当前候选比池中所有候选都差，不能插入
+            continue;
+        } else if (k < EVPOOL_SIZE && pool[k].key == NULL) {
+            /* Inserting into empty position. No setup needed before insert. */
+        } else {
+            /* Inserting in the middle. Now k points to the first element
+             * greater than the element to insert.  */
+            if (pool[EVPOOL_SIZE-1].key == NULL) {
+                /* Free space on the right? Insert at k shifting
+                 * all the elements from k to end to the right. */
+                // 右边还有空位，将k及其右边的元素右移一位；移动时保留最后一个空位的cached
+                sds cached = pool[EVPOOL_SIZE-1].cached;
+                memmove(pool+k+1,pool+k,
+                    sizeof(pool[0])*(EVPOOL_SIZE-k-1));
+                pool[k].cached = cached;
+            } else {
+                /* No free space on right? Insert at k-1 */
+                // 右边没有空位，丢弃最左边分值最小的候选，将k左边的元素左移一位
+                sds cached = pool[0].cached;
+                k--;
+                if (pool[0].key != pool[0].cached) sdsfree(pool[0].key);
+                memmove(pool,pool+1,sizeof(pool[0])*k);
+                pool[k].cached = cached;
+            }
+        }
+
+        /* Try to reuse the cached SDS string allocated in the pool entry,
+         * because allocating and deallocating this object is costly. */
+        // 短key复制到预先分配的cached中，避免分配内存
+        if (sdslen(key) > EVPOOL_CACHED_SDS_SIZE) {
+            pool[k].key = sdsdup(key);
+        } else {
+            /* The cached sds has room for EVPOOL_CACHED_SDS_SIZE bytes,
+             * so sdscpylen() never reallocates it. */
+            pool[k].cached = sdscpylen(pool[k].cached,key,sdslen(key));
+            pool[k].key = pool[k].cached;
+        }
+        pool[k].idle = idle;
+        pool[k].dbid = dbid;
+    }
+    if (samples != _samples) zfree(samples);
+}
+
+/* ----------------------------------------------------------------------------
+ * Eviction entry point.
+ * --------------------------------------------------------------------------*/
+
+/* This function gets called when 'maxmemory' is set on the config file to
+ * limit the max memory used by the server, before processing a command.
+ *
+ * The goal of the function is to free enough memory to keep Redis under the
+ * configured memory limit.
+ *
+ * Returns REDIS_OK if we are under the memory limit (or we were over the
+ * limit but freed enough memory), REDIS_ERR if we are still over the limit
+ * and no more keys can be evicted. */
+/*  设置了maxmemory时，在执行命令之前调用该函数，释放足够的内存使Redis的内存使用量不超过限制。
+    如果内存使用量在限制之内（或者已经释放了足够的内存）返回REDIS_OK，否则返回REDIS_ERR。 */
+int freeMemoryIfNeeded(void) {
+    size_t mem_used, mem_tofree, mem_freed;
+    int slaves = listLength(server.slaves);
+
+    /* Remove the size of slaves output buffers and AOF buffer from the
+     * count of used memory. */
+    // 从使用的内存中减去从服务器输出缓冲区和AOF缓冲区占用的内存
+    mem_used = zmalloc_used_memory();
+    if (slaves) {
+        listIter li;
+        listNode *ln;
+
+        listRewind(server.slaves,&li);
+        while((ln = listNext(&li))) {
+            redisClient *slave = listNodeValue(ln);
+            unsigned long obuf_bytes = getClientOutputBufferMemoryUsage(slave);
+            if (obuf_bytes > mem_used)
+                mem_used = 0;
+            else
+                mem_used -= obuf_bytes;
+        }
+    }
+    if (server.aof_state != REDIS_AOF_OFF) {
+        mem_used -= sdslen(server.aof_buf);
+        mem_used -= aofRewriteBufferSize();
+    }
+
+    /* Check if we are over the memory limit. */
+    if (mem_used <= server.maxmemory) return REDIS_OK;
+
+    if (server.maxmemory_policy == REDIS_MAXMEMORY_NO_EVICTION)
+        return REDIS_ERR; /* We need to free memory, but policy forbids. */
+
+    /* Compute how much memory we need to free. */
+    mem_tofree = mem_used - server.maxmemory;
+    mem_freed = 0;
+    if (EvictionPoolLRU == NULL) evictionPoolAlloc();
+
+    while (mem_freed < mem_tofree) {
+        int j, k, i;
+        int bestdbid = 0;
+        sds bestkey = NULL;
+        redisDb *db;
+        dict *dict;
+        dictEntry *de;
+
+        if (server.maxmemory_policy == REDIS_MAXMEMORY_ALLKEYS_RANDOM ||
+            server.maxmemory_policy == REDIS_MAXMEMORY_VOLATILE_RANDOM)
+        {
+            /* When evicting a random key, we try to evict a key for
+             * each DB, so we use the static 'next_db' variable to
+             * incrementally visit all DBs. */
+            // 随机淘汰时轮流访问每个数据库
+            static unsigned int next_db = 0;
+
+            for (i = 0; i < server.dbnum; i++) {
+                j = (++next_db) % server.dbnum;
+                db = server.db+j;
+                dict = (server.maxmemory_policy == REDIS_MAXMEMORY_ALLKEYS_RANDOM) ?
+                        db->dict : db->expires;
+                if (dictSize(dict) != 0) {
+                    de = dictGetRandomKey(dict);
+                    bestkey = dictGetKey(de);
+                    bestdbid = j;
+                    break;
+                }
+            }
+        } else {
+            struct evictionPoolEntry *pool = EvictionPoolLRU;
+
+            while(bestkey == NULL) {
+                unsigned long total_keys = 0, keys;
+
+                /* We don't want to make local-db choices when expiring keys,
+                 * so to start populate the eviction pool sampling keys from
+                 * every DB. */
+                // 从每个数据库中采样，淘汰池中的候选跨越所有数据库
+                for (i = 0; i < server.dbnum; i++) {
+                    db = server.db+i;
+                    dict = (server.maxmemory_policy == REDIS_MAXMEMORY_ALLKEYS_LRU ||
+                            server.maxmemory_policy == REDIS_MAXMEMORY_ALLKEYS_LFU) ?
+                            db->dict : db->expires;
+                    if ((keys = dictSize(dict)) != 0) {
+                        evictionPoolPopulate(i, dict, db->dict, pool);
+                        total_keys += keys;
+                    }
+                }
+                if (!total_keys) break; /* No keys to evict. */
+
+                /* Go backward from best to worst element to evict. */
+                // 从分值最大的候选开始，找到第一个仍然存在的key
+                for (k = EVPOOL_SIZE-1; k >= 0; k--) {
+                    if (pool[k].key == NULL) continue;
+                    bestdbid = pool[k].dbid;
+
+                    if (server.maxmemory_policy == REDIS_MAXMEMORY_ALLKEYS_LRU ||
+                        server.maxmemory_policy == REDIS_MAXMEMORY_ALLKEYS_LFU) {
+                        de = dictFind(server.db[pool[k].dbid].dict,
+                            pool[k].key);
+                    } else {
+                        de = dictFind(server.db[pool[k].dbid].expires,
+                            pool[k].key);
+                    }
+
+                    /* Remove the entry from the pool. */
+                    evictionPoolClearEntry(pool,k);
+
+                    /* If the key exists, is our pick. Otherwise it is
+                     * a ghost and we need to try the next element. */
+                    // key已经不存在（被删除或者过期），尝试下一个候选
+                    if (de) {
+                        bestkey = dictGetKey(de);
+                        break;
+                    } else {
+                        /* Ghost... Iterate again. */
+                    }
+                }
+            }
+        }
+
+        /* Finally remove the selected key. */
+        if (bestkey) {
+            long long delta;
+            robj *keyobj;
+
+            db = server.db+bestdbid;
+            keyobj = createStringObject(bestkey,sdslen(bestkey));
+            propagateExpire(db,keyobj);
+            /* We compute the amount of memory freed by dbSyncDelete() alone.
+             * It is possible that actually the memory needed to propagate
+             * the DEL in AOF and replication link is greater than the one
+             * we are freeing removing the key, but we can't account for
+             * that otherwise we would never exit the loop.
+             *
+             * The value is always freed synchronously here: with the lazy
+             * free thread the memory would not be reclaimed yet, and we
+             * would evict many more keys than needed. */
+            // 这里总是同步释放值：如果交给后台线程，内存还没来得及释放，会导致淘汰远多于需要的key
+            delta = (long long) zmalloc_used_memory();
+            dbSyncDelete(db,keyobj);
+            delta -= (long long) zmalloc_used_memory();
+            mem_freed += delta;
+            server.stat_evictedkeys++;
+            notifyKeyspaceEvent(REDIS_NOTIFY_EVICTED, "evicted",
+                keyobj, db->id);
+            decrRefCount(keyobj);
+
+            /* When the memory to free starts to be big enough, we may
+             * start spending so much time here that is impossible to
+             * deliver data to the slaves fast enough, so we force the
+             * transmission here inside the loop. */
+            if (slaves) flushSlavesOutputBuffers();
+        } else {
+            return REDIS_ERR; /* nothing to free... */
+        }
+    }
+    return REDIS_OK;
+}
@@ -0,0 +1,714 @@
+/* Implementation of the active expire cycle and of the expire time wheel.
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "redis.h"
+
+/* Keys with an expire are reclaimed in two ways: lazily, when they are
+ * accessed (see expireIfNeeded() in db.c), and actively by the cycle in
+ * this file, called by the server cron (slow cycle) and before sleeping in
+ * the event loop (fast cycle).
+ *
+ * The cycle samples the expires dict of every DB and keeps, for each DB, a
+ * moving average of the fraction of sampled keys that were already expired
+ * (the "stale ratio"). The effort is adapted to that estimate: DBs with
+ * many stale keys are sampled harder, and the time budget is only fully
+ * used when the stale ratio is above the acceptable level, so a dataset
+ * with few expired keys costs little CPU while a mass expiration is
+ * reclaimed as fast as the budget allows.
+ *
+ * When active-expire-wheel is enabled, setExpire() also indexes the key in a
+ * hashed time wheel, and the cycle first reclaims the keys of the elapsed
+ * wheel slots, without random sampling at all.
+ *
+ * Hash fields with an expire (HEXPIRE) are reclaimed the same two ways: by
+ * hashTypeExpireFields() when the hash is accessed, and by the cycle, that
+ * samples a per DB registry of the hashes having field expires.
+ *
+ * 设置了过期时间的key通过两种方式回收：访问时惰性删除（见db.c中的expireIfNeeded），以及由本文件中的
+ * 过期循环主动删除，serverCron调用慢速循环，事件循环进入睡眠之前调用快速循环。
+ * 过期循环对每个数据库的过期字典进行采样，并为每个数据库维护采样到的key中已过期key所占比例的滑动平均值（过期比例）。
+ * 过期循环根据该估计值调整工作量：过期key较多的数据库采样更多；只有当过期比例超过可接受的水平时才用满时间预算，
+ * 因此过期key很少时几乎不消耗CPU，而大量key同时过期时能在预算允许的范围内尽快回收。
+ * 开启active-expire-wheel时，setExpire还会将key加入一个时间轮，过期循环首先回收时间轮中已经过去的槽中的key，
+ * 完全不需要随机采样。
+ * 设置了过期时间的hash域（HEXPIRE）也通过这两种方式回收：访问hash时由hashTypeExpireFields删除，
+ * 以及由过期循环对每个数据库中设置了域过期时间的hash的登记表进行采样。 */
+
+/* Effort derived from active-expire-effort (1..10, default 1). */
+/* 由active-expire-effort（1~10，默认为1）换算出的工作量参数 */
+#define EXPIRE_EFFORT (server.active_expire_effort-1) /* 0..9 */
+// 每次采样的key的个数
+#define EXPIRE_KEYS_PER_LOOP \
+    (ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP + ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP/4*EXPIRE_EFFORT)
+// 快速循环的最长执行时间，单位为微秒
+#define EXPIRE_FAST_DURATION \
+    (ACTIVE_EXPIRE_CYCLE_FAST_DURATION + ACTIVE_EXPIRE_CYCLE_FAST_DURATION/4*EXPIRE_EFFORT)
+// 慢速循环可以使用的CPU时间百分比
+#define EXPIRE_SLOW_TIME_PERC (ACTIVE_EXPIRE_CYCLE_SLOW_TIME_PERC + 2*EXPIRE_EFFORT)
+// 可接受的过期比例（百分比），超过时过期循环会用满时间预算
+#define EXPIRE_ACCEPTABLE_STALE (10-EXPIRE_EFFORT)
+
+/* A DB whose stale ratio is above the acceptable one is sampled up to this
+ * many times harder in a single loop. */
+/* 过期比例超过可接受水平的数据库，单次采样的key的个数最多放大到该倍数 */
+#define EXPIRE_MAX_SAMPLE_SCALE 4
+
+/* Weight of the newest sample in the moving average of the stale ratio. */
+/* 计算过期比例滑动平均值时最新一次采样的权重 */
+#define EXPIRE_STALE_ALPHA 0.05
+
+/* The time wheel has EXPIRE_WHEEL_SLOTS slots of EXPIRE_WHEEL_RESOLUTION
+ * milliseconds each. A key is stored in the slot of its expire time modulo
+ * the wheel size: keys expiring further than one turn stay in their slot
+ * until the wheel reaches them again. */
+/*  时间轮由EXPIRE_WHEEL_SLOTS个槽组成，每个槽覆盖EXPIRE_WHEEL_RESOLUTION毫秒。
+    key保存在其过期时间对时间轮大小取模所对应的槽中，过期时间超过一圈的key留在原来的槽中，直到时间轮再次转到那里。 */
+#define EXPIRE_WHEEL_SLOTS 4096
+#define EXPIRE_WHEEL_RESOLUTION 1000
+
+/* The wheel of a DB holds at most EXPIRE_WHEEL_MAX_RATIO entries per key
+ * with an expire (plus one per slot): above that new expires are not
+ * indexed, and the keys are found by sampling like without the wheel. */
+/*  每个数据库的时间轮中，平均每个设置了过期时间的key最多对应EXPIRE_WHEEL_MAX_RATIO项（另外每个槽再加一项），
+    超过之后新的过期时间不再加入时间轮，这些key和没有时间轮时一样通过采样找到。 */
+#define EXPIRE_WHEEL_MAX_RATIO 2
+
+/* 时间轮中的一项 */
+typedef struct expireWheelEntry {
+    // key的副本（时间轮中的项可能比key本身存活得更久，因此不能和键空间共享）
+    sds key;
+    // 加入时间轮时key的过期时间，单位为毫秒
+    long long when;
+} expireWheelEntry;
+
+/* 时间轮中的一个槽 */
+typedef struct expireWheelSlot {
+    expireWheelEntry *entries;
+    unsigned int len, size;
+} expireWheelSlot;
+
+/* The per DB state of the expire engine. */
+/* 每个数据库的过期状态 */
+typedef struct expireDbState {
+    // 过期比例的滑动平均值，取值为0~1
+    double stale;
+    // 时间轮，未开启active-expire-wheel时为NULL
+    expireWheelSlot *wheel;
+    // 下一个待处理的槽的起始时间，单位为毫秒
+    long long wheel_cursor;
+    // 时间轮中的项数
+    unsigned long wheel_entries;
+    // 设置了域过期时间的hash的key名（sds副本），没有时为NULL
+    dict *hash_keys;
+} expireDbState;
+
+static expireDbState *ExpireDbState;
+
+/* Statistics reported by INFO. */
+/* INFO命令输出的统计信息 */
+static struct {
+    // 过期循环主动删除的key的个数
+    long long expired_keys;
+    // 其中通过时间轮删除的key的个数
+    long long wheel_expired_keys;
+    // 因为时间轮已满而没有加入时间轮的过期时间的个数
+    long long wheel_skipped;
+    // 过期循环主动删除的hash域的个数
+    long long expired_fields;
+    // 过期循环消耗的总时间，单位为微秒
+    long long time_used;
+    // 所有数据库过期比例的估计值（按过期字典大小加权），取值为0~1
+    double stale;
+} ExpireStats;
+
+/* Return the state of the DB 'dbid', allocating the states the first time. */
+/* 返回数据库dbid的过期状态，第一次调用时分配所有数据库的状态 */
+static expireDbState *expireGetDbState(int dbid) {
+    if (ExpireDbState == NULL)
+        ExpireDbState = zcalloc(sizeof(expireDbState)*server.dbnum);
+    return ExpireDbState+dbid;
+}
+
+/*-----------------------------------------------------------------------------
+ * Expire time wheel
+ * 过期时间轮
+ *----------------------------------------------------------------------------*/
+
+/* Return the slot for the expire time 'when'. */
+/* 返回过期时间when所在的槽 */
+static expireWheelSlot *expireWheelSlotOf(expireDbState *st, long long when) {
+    return st->wheel + (when/EXPIRE_WHEEL_RESOLUTION) % EXPIRE_WHEEL_SLOTS;
+}
+
+/* Index 'key', expiring at 'when', in the time wheel of 'db'. Called by
+ * setExpire(), 'old' is the previous expire of the key or -1. The entries
+ * are never removed when the expire is changed or the key is deleted:
+ * entries whose slot no longer matches the expires dict are simply dropped
+ * when their slot is processed. So when the expire only moves inside its
+ * slot the entry already there is enough. */
+/*  将过期时间为when的key加入数据库db的时间轮，由setExpire调用，old为key原来的过期时间，没有则为-1。
+    修改过期时间或者删除key时不会删除时间轮中的项：处理槽的时候，所在槽与过期字典不一致的项会被直接丢弃。
+    因此过期时间只在同一个槽内变化时，槽中已有的项就足够了。 */
+void expireWheelAdd(redisDb *db, robj *key, long long old, long long when) {
+    expireDbState *st;
+    expireWheelSlot *slot;
+
+    /* On slaves keys are expired by the master, the wheel would only grow. */
+    // 从服务器上key由主服务器负责过期，时间轮只会不断增长
+    if (!server.active_expire_wheel || server.masterhost != NULL) return;
+    if (old != -1 && old/EXPIRE_WHEEL_RESOLUTION == when/EXPIRE_WHEEL_RESOLUTION)
+        return;
+
+    st = expireGetDbState(db->id);
+    if (st->wheel == NULL) {
+        st->wheel = zcalloc(sizeof(expireWheelSlot)*EXPIRE_WHEEL_SLOTS);
+        st->wheel_cursor = mstime()/EXPIRE_WHEEL_RESOLUTION*EXPIRE_WHEEL_RESOLUTION;
+    }
+
+    /* Keys whose expire is refreshed often leave stale entries behind until
+     * their slot is reached: bound them. */
+    // 频繁刷新过期时间的key会留下过时的项，直到时间轮转到它们所在的槽，因此需要限制项数
+    if (st->wheel_entries >= dictSize(db->expires)*EXPIRE_WHEEL_MAX_RATIO +
+                             EXPIRE_WHEEL_SLOTS)
+    {
+        ExpireStats.wheel_skipped++;
+        return;
+    }
+
+    /* A time already elapsed goes into the next slot to process. */
+    // 已经过去的时间放入下一个待处理的槽中
+    slot = expireWheelSlotOf(st, when < st->wheel_cursor ? st->wheel_cursor : when);
+    if (slot->len == slot->size) {
+        slot->size = slot->size ? slot->size*2 : 4;
+        slot->entries = zrealloc(slot->entries,sizeof(expireWheelEntry)*slot->size);
+    }
+    slot->entries[slot->len].key = sdsdup(key->ptr);
+    slot->entries[slot->len].when = when;
+    slot->len++;
+    st->wheel_entries++;
+}
+
+/* Release the time wheel of 'dbid', or of every DB if dbid is -1. Called
+ * when DBs are flushed, and when active-expire-wheel is turned off. */
+/* 释放数据库dbid的时间轮，dbid为-1时释放所有数据库的时间轮。在清空数据库以及关闭active-expire-wheel时调用 */
+void expireWheelFlush(int dbid) {
+    int j, k;
+    unsigned int i;
+
+    if (ExpireDbState == NULL) return;
+    for (j = 0; j < server.dbnum; j++) {
+        expireDbState *st = ExpireDbState+j;
+
+        if ((dbid != -1 && dbid != j) || st->wheel == NULL) continue;
+        for (k = 0; k < EXPIRE_WHEEL_SLOTS; k++) {
+            expireWheelSlot *slot = st->wheel+k;
+
+            for (i = 0; i < slot->len; i++) sdsfree(slot->entries[i].key);
+            zfree(slot->entries);
+        }
+        zfree(st->wheel);
+        st->wheel = NULL;
+        st->wheel_entries = 0;
+    }
+}
+
+/*-----------------------------------------------------------------------------
+ * Hash field expires
+ * hash域的过期
+ *----------------------------------------------------------------------------*/
+
+static unsigned int expireHashKeysHash(const void *key) {
+    return dictGenHashFunction(key,(int)sdslen((sds)key));
+}
+
+static int expireHashKeysCompare(void *privdata, const void *key1,
+                                 const void *key2)
+{
+    size_t l1 = sdslen((sds)key1), l2 = sdslen((sds)key2);
+
+    DICT_NOTUSED(privdata);
+    return l1 == l2 && memcmp(key1,key2,l1) == 0;
+}
+
+static void expireHashKeysDestructor(void *privdata, void *key) {
+    DICT_NOTUSED(privdata);
+    sdsfree(key);
+}
+
+/* The registry owns copies of the key names: like the time wheel entries
+ * they may outlive the keys. */
+/* 登记表保存key名的副本：和时间轮中的项一样，它们可能比key本身存活得更久 */
+static dictType expireHashKeysDictType = {
+    expireHashKeysHash,         /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    expireHashKeysCompare,      /* key compare */
+    expireHashKeysDestructor,   /* key destructor */
+    NULL                        /* val destructor */
+};
+
+/* Register the hash at 'key', that has fields with an expire, for the active
+ * expire cycle. Called by HEXPIRE and by dbAdd(). Entries are not removed
+ * when the key is deleted or loses its field expires: the cycle drops them
+ * when they are sampled.
+ *
+ * Slaves register their hashes too, even if they don't expire fields by
+ * themselves (hashTypeExpireFields() does nothing there): this way a slave
+ * promoted to master already knows the hashes it loaded or received. */
+/*  将设置了域过期时间的hash的key登记到过期循环中，由HEXPIRE命令和dbAdd调用。
+    key被删除或者不再有域过期时间时并不会删除登记项，过期循环采样到它们时会将其丢弃。
+    从服务器也会登记hash，尽管它们自己并不删除过期的域（hashTypeExpireFields在从服务器上什么也不做）：
+    这样从服务器被提升为主服务器之后，就已经知道它载入或者接收到的hash。 */
+void hashFieldExpireTrack(redisDb *db, robj *key) {
+    expireDbState *st;
+    sds name;
+
+    st = expireGetDbState(db->id);
+    if (st->hash_keys == NULL)
+        st->hash_keys = dictCreate(&expireHashKeysDictType,NULL);
+    name = sdsdup(key->ptr);
+    if (dictAdd(st->hash_keys,name,NULL) != DICT_OK) sdsfree(name);
+}
+
+/* Release the registry of 'dbid', or of every DB if dbid is -1. Called when
+ * DBs are flushed. */
+/* 释放数据库dbid的登记表，dbid为-1时释放所有数据库的登记表，在清空数据库时调用 */
+void hashFieldExpireFlush(int dbid) {
+    int j;
+
+    if (ExpireDbState == NULL) return;
+    for (j = 0; j < server.dbnum; j++) {
+        expireDbState *st = ExpireDbState+j;
+
+        if ((dbid != -1 && dbid != j) || st->hash_keys == NULL) continue;
+        dictRelease(st->hash_keys);
+        st->hash_keys = NULL;
+    }
+}
+
+/* Sample the registry of 'db' and delete the expired fields of the sampled
+ * hashes, until the time 'deadline' (in microseconds) is reached or few of
+ * the sampled hashes had expired fields. Returns the number of expired
+ * fields. */
+/*  对数据库db的登记表进行采样，删除采样到的hash中已经过期的域，直到到达deadline（单位为微秒），
+    或者采样到的hash中有过期域的比例低于可接受水平。返回删除的域的个数。 */
+static long long hashFieldExpireProcess(redisDb *db, long long deadline) {
+    expireDbState *st = expireGetDbState(db->id);
+    long long expired = 0;
+
+    while (st->hash_keys != NULL && dictSize(st->hash_keys) != 0) {
+        dictEntry *samples[ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP*13/4];
+        sds drop[ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP*13/4];
+        unsigned long num = EXPIRE_KEYS_PER_LOOP, k, ndrop = 0, hit = 0;
+
+        if (num > sizeof(samples)/sizeof(samples[0]))
+            num = sizeof(samples)/sizeof(samples[0]);
+        num = dictGetSomeKeys(st->hash_keys,samples,num);
+        for (k = 0; k < num; k++) {
+            sds name = dictGetKey(samples[k]);
+            dictEntry *de = dictFind(db->dict,name);
+            robj *o = de ? dictGetVal(de) : NULL, *keyobj;
+            unsigned long fields;
+
+            if (o != NULL && !objectIsPacked(o) && o->type == REDIS_HASH &&
+                hashTypeHasFieldExpires(o))
+            {
+                keyobj = createStringObject(name,sdslen(name));
+                o = hashTypeExpireFields(db,keyobj,o,&fields);
+                decrRefCount(keyobj);
+                if (fields) hit++;
+                expired += fields;
+            }
+            /* Deleted only after the loop: samples may repeat. */
+            // 不再需要的登记项在循环结束之后才删除，因为采样结果可能重复
+            if (o == NULL || objectIsPacked(o) || o->type != REDIS_HASH ||
+                !hashTypeHasFieldExpires(o)) drop[ndrop++] = sdsdup(name);
+        }
+        for (k = 0; k < ndrop; k++) {
+            dictDelete(st->hash_keys,drop[k]);
+            sdsfree(drop[k]);
+        }
+        if (ustime() > deadline) break;
+        if (num == 0 || hit*100 <= num*EXPIRE_ACCEPTABLE_STALE) break;
+    }
+    ExpireStats.expired_fields += expired;
+    return expired;
+}
+
+/* Delete the key of the expires dict entry 'de' if it is expired at 'now'.
+ * Returns 1 if the key was deleted. */
+/* 如果过期字典中de对应的key在now时刻已经过期，删除之并返回1，否则返回0 */
+static int activeExpireCycleTryExpire(redisDb *db, dictEntry *de, long long now) {
+    long long t = dictGetSignedIntegerVal(de);
+
+    if (now > t) {
+        sds key = dictGetKey(de);
+        robj *keyobj = createStringObject(key,sdslen(key));
+
+        propagateExpire(db,keyobj);
+        dbDelete(db,keyobj);
+        notifyKeyspaceEvent(REDIS_NOTIFY_EXPIRED,
+            "expired",keyobj,db->id);
+        decrRefCount(keyobj);
+        server.stat_expiredkeys++;
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+static int expireCompareEntries(const void *a, const void *b) {
+    const dictEntry *ea = *(dictEntry* const *)a, *eb = *(dictEntry* const *)b;
+
+    return ea < eb ? -1 : (ea > eb);
+}
+
+/* Remove the repeated entries from the array 'samples' returned by
+ * dictGetSomeKeys(), that may return the same entry more than once. Once
+ * an entry is expired it is freed, so a repeated entry must not be visited
+ * again. Returns the new number of entries. */
+/*  删除dictGetSomeKeys返回的数组samples中重复的项，因为它可能多次返回同一个项。
+    项对应的key过期后该项就被释放了，因此重复的项不能再被访问。返回去重之后项的个数。 */
+static unsigned long expireUniqueSamples(dictEntry **samples, unsigned long num) {
+    unsigned long j, k = 0;
+
+    if (num < 2) return num;
+    qsort(samples,num,sizeof(dictEntry*),expireCompareEntries);
+    for (j = 1; j < num; j++)
+        if (samples[j] != samples[k]) samples[++k] = samples[j];
+    return k+1;
+}
+
+/* Reclaim the keys of the elapsed slots of the time wheel of 'db', until
+ * the time 'deadline' (in microseconds) is reached. Returns the number of
+ * expired keys. */
+/* 回收数据库db的时间轮中已经过去的槽中的key，直到到达deadline（单位为微秒）。返回删除的key的个数 */
+static long long expireWheelProcess(redisDb *db, long long now, long long deadline) {
+    expireDbState *st = expireGetDbState(db->id);
+    long long expired = 0;
+    unsigned int checked = 0;
+
+    if (st->wheel == NULL) return 0;
+
+    /* Only slots entirely in the past are processed. */
+    // 只处理完全过去的槽
+    while (st->wheel_cursor + EXPIRE_WHEEL_RESOLUTION <= now) {
+        expireWheelSlot *slot = expireWheelSlotOf(st,st->wheel_cursor);
+        unsigned int i, keep = 0;
+
+        for (i = 0; i < slot->len; i++) {
+            expireWheelEntry *e = slot->entries+i;
+            dictEntry *de;
+
+            if ((++checked & 63) == 0 && ustime() > deadline) break;
+            if (e->when >= now) {
+                /* Expires one or more turns later: keep it. */
+                // 在之后的某一圈才过期，保留
+                slot->entries[keep++] = *e;
+                continue;
+            }
+            /* Drop the entry unless the expire of the key is still in the
+             * slot of this entry, and delete the expired key. When the
+             * expire moved to another slot the new time was indexed again
+             * by setExpire(). */
+            // 只有当key的过期时间仍然在该项所在的槽中时才删除key，否则直接丢弃该项：过期时间移动到其他槽时setExpire已经再次加入了时间轮
+            de = dictFind(db->expires,e->key);
+            if (de && dictGetSignedIntegerVal(de)/EXPIRE_WHEEL_RESOLUTION ==
+                      e->when/EXPIRE_WHEEL_RESOLUTION &&
+                activeExpireCycleTryExpire(db,de,now)) expired++;
+            sdsfree(e->key);
+            st->wheel_entries--;
+        }
+        if (i < slot->len) {
+            /* Out of time: keep the entries not yet processed. */
+            // 时间用完了，保留尚未处理的项
+            memmove(slot->entries+keep,slot->entries+i,
+                sizeof(expireWheelEntry)*(slot->len-i));
+            slot->len = keep+(slot->len-i);
+            break;
+        }
+        slot->len = keep;
+        if (slot->len == 0 && slot->size > 4) {
+            zfree(slot->entries);
+            slot->entries = NULL;
+            slot->size = 0;
+        }
+        st->wheel_cursor += EXPIRE_WHEEL_RESOLUTION;
+    }
+    ExpireStats.wheel_expired_keys += expired;
+    return expired;
+}
+
+/*-----------------------------------------------------------------------------
+ * Active expire cycle
+ * 主动过期循环
+ *----------------------------------------------------------------------------*/
+
+/* Try to expire a few timed out keys. The algorithm used is adaptive and
+ * will use few CPU cycles if there are few expiring keys, otherwise
+ * it will get more aggressive to avoid that too much memory is used by
+ * keys that can be removed from the keyspace.
+ *
+ * No more than REDIS_DBCRON_DBS_PER_CALL databases are tested at every
+ * iteration.
+ *
+ * This kind of call is used when Redis detects that timelimit_exit is
+ * true, so there is more work to do, and we do it more incrementally from
+ * the beforeSleep() function of the event loop.
+ *
+ * If type is ACTIVE_EXPIRE_CYCLE_FAST the function will try to run a
+ * "fast" expire cycle that takes no longer than EXPIRE_FAST_DURATION
+ * microseconds, and is not repeated again before the same amount of time.
+ * It only runs when the previous cycle ran out of time, or when the
+ * estimated stale ratio is above the acceptable one.
+ *
+ * If type is ACTIVE_EXPIRE_CYCLE_SLOW, that normal expire cycle is
+ * executed, where the time limit is a percentage of the REDIS_HZ period
+ * as specified by EXPIRE_SLOW_TIME_PERC. The limit is scaled down when the
+ * estimated stale ratio is below the acceptable one. */
+/*  主动删除一些过期的key。该算法是自适应的：过期key较少时只消耗很少的CPU，否则会更加积极地删除过期key，
+    避免它们占用太多内存。每次调用最多检查REDIS_DBCRON_DBS_PER_CALL个数据库。
+    type为ACTIVE_EXPIRE_CYCLE_FAST时执行快速循环，执行时间不超过EXPIRE_FAST_DURATION微秒，并且在同样长的时间内不会重复执行，
+    只有当上一次循环因为超时而退出，或者过期比例的估计值超过可接受水平时才执行。
+    type为ACTIVE_EXPIRE_CYCLE_SLOW时执行慢速循环，时间限制为每个REDIS_HZ周期的EXPIRE_SLOW_TIME_PERC百分比，
+    过期比例的估计值低于可接受水平时按比例减少时间限制。 */
+void activeExpireCycle(int type) {
+    /* This function has some global state in order to continue the work
+     * incrementally across calls. */
+    static unsigned int current_db = 0; /* Last DB tested. */
+    static int timelimit_exit = 0;      /* Time limit hit in previous call? */
+    static long long last_fast_cycle = 0; /* When last fast cycle ran. */
+
+    int j, iteration = 0;
+    int dbs_per_call = REDIS_DBCRON_DBS_PER_CALL;
+    double acceptable = EXPIRE_ACCEPTABLE_STALE/100.0;
+    long long start = ustime(), timelimit, deadline, elapsed;
+    long long total_keys = 0;
+    double total_stale = 0;
+
+    if (type == ACTIVE_EXPIRE_CYCLE_FAST) {
+        /* Don't start a fast cycle if the previous cycle did not exit
+         * for time limit and the stale ratio is acceptable. Also don't
+         * repeat a fast cycle for the same period as the fast cycle
+         * total duration itself. */
+        // 如果上一次循环不是因为超时退出，并且过期比例可以接受，则不执行快速循环。另外，在快速循环的执行时长内不重复执行
+        if (!timelimit_exit && ExpireStats.stale < acceptable) return;
+        if (start < last_fast_cycle + EXPIRE_FAST_DURATION*2) return;
+        last_fast_cycle = start;
+    }
+
+    /* We usually should test REDIS_DBCRON_DBS_PER_CALL per iteration, with
+     * two exceptions:
+     *
+     * 1) Don't test more DBs than we have.
+     * 2) If last time we hit the time limit, we want to scan all DBs
+     * in this iteration, as there is work to do in some DB and we don't want
+     * expired keys to use memory for too much time. */
+    if (dbs_per_call > server.dbnum || timelimit_exit)
+        dbs_per_call = server.dbnum;
+
+    /* We can use at max EXPIRE_SLOW_TIME_PERC percentage of CPU time
+     * per iteration. Since this function gets called with a frequency of
+     * server.hz times per second, the following is the max amount of
+     * microseconds we can spend in this function. While the stale ratio
+     * is acceptable only a quarter of it (at least) is used. */
+    // 每秒调用server.hz次，每次最多使用EXPIRE_SLOW_TIME_PERC百分比的CPU时间；过期比例可以接受时按比例减少，最少为四分之一
+    timelimit = 1000000*EXPIRE_SLOW_TIME_PERC/server.hz/100;
+    if (ExpireStats.stale < acceptable) {
+        double scale = ExpireStats.stale/acceptable;
+
+        if (scale < 0.25) scale = 0.25;
+        timelimit = (long long)(timelimit*scale);
+    }
+    if (timelimit <= 0) timelimit = 1;
+    if (type == ACTIVE_EXPIRE_CYCLE_FAST)
+        timelimit = EXPIRE_FAST_DURATION; /* in microseconds. */
+    deadline = start+timelimit;
+    timelimit_exit = 0;
+
+    for (j = 0; j < dbs_per_call && !timelimit_exit; j++) {
+        unsigned long expired_total = 0;
+        redisDb *db = server.db+(current_db % server.dbnum);
+        expireDbState *st = expireGetDbState(db->id);
+        long long now = mstime();
+        unsigned long expired;
+
+        /* Increment the DB now so we are sure if we run out of time
+         * in the current DB we'll restart from the next. This allows to
+         * distribute the time evenly across DBs. */
+        current_db++;
+
+        /* Keys in the elapsed slots of the time wheel first: no sampling
+         * needed for them. */
+        // 首先回收时间轮中已经过去的槽中的key，不需要采样
+        ExpireStats.expired_keys += expireWheelProcess(db,now,deadline);
+        if (ustime() > deadline) timelimit_exit = 1;
+
+        /* Then the expired fields of the hashes with field expires. */
+        // 然后删除设置了域过期时间的hash中已经过期的域
+        if (!timelimit_exit) {
+            hashFieldExpireProcess(db,deadline);
+            if (ustime() > deadline) timelimit_exit = 1;
+        }
+
+        /* Continue to expire if at the end of the cycle more than the
+         * acceptable ratio of the sampled keys were expired. */
+        // 如果采样到的key中过期key的比例超过可接受水平，继续处理该数据库
+        while (!timelimit_exit) {
+            dictEntry *samples[EXPIRE_MAX_SAMPLE_SCALE*
+                               (ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP*13/4)];
+            unsigned long num, slots, count, k;
+            long long ttl_sum = 0;
+            int ttl_samples = 0;
+
+            /* If there is nothing to expire try next DB ASAP. */
+            // 该数据库中没有设置过期时间的key，处理下一个数据库
+            if ((num = dictSize(db->expires)) == 0) {
+                db->avg_ttl = 0;
+                break;
+            }
+            slots = dictSlots(db->expires);
+            now = mstime();
+
+            /* When there are less than 1% filled slots getting random
+             * keys is expensive, so stop here waiting for better times...
+             * The dictionary will be resized asap. */
+            // 如果过期字典的填充率低于1%，采样的代价太高，等待字典缩容后再处理
+            if (num && slots > DICT_HT_INITIAL_SIZE &&
+                (num*100/slots < 1)) break;
+
+            /* The number of keys sampled grows with the stale ratio
+             * estimated for this DB, up to EXPIRE_MAX_SAMPLE_SCALE times
+             * the base amount. */
+            // 采样的key的个数随着该数据库的过期比例增长，最多为基本数量的EXPIRE_MAX_SAMPLE_SCALE倍
+            count = EXPIRE_KEYS_PER_LOOP;
+            if (st->stale > acceptable) {
+                double scale = st->stale/acceptable;
+
+                if (scale > EXPIRE_MAX_SAMPLE_SCALE) scale = EXPIRE_MAX_SAMPLE_SCALE;
+                count = (unsigned long)(count*scale);
+            }
+            if (count > sizeof(samples)/sizeof(samples[0]))
+                count = sizeof(samples)/sizeof(samples[0]);
+            if (num > count) num = count;
+
+            num = dictGetSomeKeys(db->expires,samples,num);
+            num = expireUniqueSamples(samples,num);
+            expired = 0;
+            for (k = 0; k < num; k++) {
+                long long ttl = dictGetSignedIntegerVal(samples[k])-now;
+
+                if (activeExpireCycleTryExpire(db,samples[k],now)) expired++;
+                if (ttl > 0) {
+                    /* We want the average TTL of keys yet not expired. */
+                    ttl_sum += ttl;
+                    ttl_samples++;
+                }
+            }
+            expired_total += expired;
+
+            /* Update the average TTL stats for this database. */
+            // 更新该数据库的平均TTL
+            if (ttl_samples) {
+                long long avg_ttl = ttl_sum/ttl_samples;
+
+                /* Do a simple running average with a few samples.
+                 * We just use the current estimate with a weight of 2%
+                 * and the previous estimate with a weight of 98%. */
+                if (db->avg_ttl == 0) db->avg_ttl = avg_ttl;
+                db->avg_ttl = (db->avg_ttl/50)*49 + (avg_ttl/50);
+            }
+
+            /* Update the stale ratio estimate of this database. */
+            // 更新该数据库过期比例的滑动平均值
+            if (num) {
+                st->stale = st->stale*(1-EXPIRE_STALE_ALPHA) +
+                            ((double)expired/num)*EXPIRE_STALE_ALPHA;
+            }
+
+            /* We can't block forever here even if there are many keys to
+             * expire. So after a given amount of milliseconds return to the
+             * caller waiting for the other active expire cycle. */
+            // 即使还有很多过期key也不能一直执行下去，超过时间限制后返回
+            iteration++;
+            if ((iteration & 0xf) == 0 && ustime() > deadline)
+                timelimit_exit = 1;
+
+            if (num == 0 || expired*100 <= num*EXPIRE_ACCEPTABLE_STALE) break;
+        }
+        ExpireStats.expired_keys += expired_total;
+    }
+
+    /* Update the global stale ratio, weighting every DB by the size of its
+     * expires dict. */
+    // 更新全局过期比例，每个数据库按照其过期字典的大小加权
+    for (j = 0; j < server.dbnum; j++) {
+        unsigned long keys = dictSize(server.db[j].expires);
+
+        total_keys += keys;
+        total_stale += expireGetDbState(j)->stale*keys;
+    }
+    ExpireStats.stale = total_keys ? total_stale/total_keys : 0;
+    elapsed = ustime()-start;
+    ExpireStats.time_used += elapsed;
+    latencyProbeAddIfNeeded(LATENCY_PROBE_EXPIRE_CYCLE,elapsed);
+}
+
+/* Append the expire statistics to the INFO output 'info'. */
+/* 将过期相关的统计信息追加到INFO命令的输出info中 */
+sds genExpireInfoString(sds info) {
+    unsigned long wheel_entries = 0, hash_keys = 0;
+    int j;
+
+    if (ExpireDbState) {
+        for (j = 0; j < server.dbnum; j++) {
+            wheel_entries += ExpireDbState[j].wheel_entries;
+            if (ExpireDbState[j].hash_keys)
+                hash_keys += dictSize(ExpireDbState[j].hash_keys);
+        }
+    }
+    return sdscatprintf(info,
+        "expire_cycle_expired_keys:%lld\r\n"
+        "expire_cycle_wheel_expired_keys:%lld\r\n"
+        "expire_cycle_cpu_milliseconds:%lld\r\n"
+        "expired_stale_perc:%.2f\r\n"
+        "expire_wheel_entries:%lu\r\n"
+        "expire_wheel_skipped:%lld\r\n"
+        "expire_cycle_expired_fields:%lld\r\n"
+        "expire_hash_field_keys:%lu\r\n",
+        ExpireStats.expired_keys,
+        ExpireStats.wheel_expired_keys,
+        ExpireStats.time_used/1000,
+        ExpireStats.stale*100,
+        wheel_entries,
+        ExpireStats.wheel_skipped,
+        ExpireStats.expired_fields,
+        hash_keys);
+}
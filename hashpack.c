@@ -0,0 +1,547 @@
+/* hashpack.c - Listpack encoded hashes with a field index and field TTLs.
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hashpack.h"
+#include "listpack.h"
+#include "dict.h"
+#include "zmalloc.h"
+#include "util.h"
+
+/* A listpack hash looks fields up comparing them one by one, and a hash
+ * table hash pays a dict entry and two objects for every field. A hashpack
+ * keeps the listpack layout, with every field followed by its value and its
+ * expire time (a millisecond unix time, 0 for none), and adds an open
+ * addressing table of the offsets of the field entries, so a lookup hashes
+ * the field and compares just the entries found in its probe sequence.
+ *
+ * The index is built on the first lookup of a hashpack having at least
+ * HP_INDEX_MIN_FIELDS fields, and kept up to date by every change: entries
+ * after a modified one shift by the same amount of bytes, so their offsets
+ * are just adjusted. It is kept at most half full.
+ *
+ * listpack编码的hash需要逐个比较域来查找，dict编码的hash每个域都要花费一个字典节点和两个对象。
+ * hashpack保持listpack的布局，每个域后面跟着它的值以及过期时间（毫秒时间戳，0表示没有过期时间），
+ * 另外增加一个开放寻址的哈希表保存每个域节点的偏移量，查找时只需要计算域的哈希值，并比较探测序列上的节点。
+ * 域的个数不少于HP_INDEX_MIN_FIELDS时，第一次查找会创建索引，之后的每次修改都会更新它：
+ * 被修改的节点之后的所有节点移动了相同的字节数，只需调整它们的偏移量即可。索引最多使用一半的槽。 */
+
+#define HP_INDEX_MIN_FIELDS 16
+#define HP_INDEX_MIN_SIZE 32
+
+/* Hash the entry at 'p' by its string representation, that is the same
+ * hash of the string the entry was created from. */
+/* 按照字符串形式计算节点p的哈希值，与创建该节点时使用的字符串的哈希值相同 */
+static uint32_t hpHashEntry(unsigned char *p) {
+    unsigned char *s, buf[32];
+    unsigned int len;
+    long long v;
+
+    lpGet(p,&s,&len,&v);
+    if (s == NULL) {
+        len = ll2string((char*)buf,sizeof(buf),v);
+        s = buf;
+    }
+    return dictGenHashFunction(s,len);
+}
+
+/* Store the offset of the field entry 'fptr' in the index. */
+/* 将域节点fptr的偏移量加入索引 */
+static void hpIndexAdd(hashpack *hp, unsigned char *fptr) {
+    uint32_t mask = hp->index_size-1, i = hpHashEntry(fptr) & mask;
+
+    while (hp->index[i]) i = (i+1) & mask;
+    hp->index[i] = (uint32_t)(fptr - hp->lp);
+}
+
+/* (Re)build the index, sized for the current number of fields. */
+/* 根据当前域的个数（重新）创建索引 */
+static void hpIndexBuild(hashpack *hp) {
+    unsigned char *p;
+    uint32_t size = HP_INDEX_MIN_SIZE;
+
+    while (size < hp->count*2) size *= 2;
+    zfree(hp->index);
+    hp->index = zcalloc(sizeof(uint32_t)*size);
+    hp->index_size = size;
+    for (p = hpFirst(hp); p; p = hpNextField(hp,p)) hpIndexAdd(hp,p);
+}
+
+/* 释放索引，下一次查找时重新创建 */
+static void hpIndexDrop(hashpack *hp) {
+    zfree(hp->index);
+    hp->index = NULL;
+    hp->index_size = 0;
+}
+
+/* Remove the field entry 'fptr' from the index, moving back the entries
+ * of its probe sequence that would no longer be reachable. */
+/* 从索引中删除域节点fptr，并将同一探测序列中之后无法再被找到的项向前移动 */
+static void hpIndexRemove(hashpack *hp, unsigned char *fptr) {
+    uint32_t mask = hp->index_size-1, i = hpHashEntry(fptr) & mask, j, k;
+    uint32_t off = (uint32_t)(fptr - hp->lp);
+
+    while (hp->index[i] != off) i = (i+1) & mask;
+    for (j = i; ; ) {
+        j = (j+1) & mask;
+        if (hp->index[j] == 0) break;
+        k = hpHashEntry(hp->lp+hp->index[j]) & mask;
+        // 槽j中的项的初始位置k不在(i,j]区间内时，需要移动到槽i
+        if ((j > i && (k <= i || k > j)) || (j < i && k <= i && k > j)) {
+            hp->index[i] = hp->index[j];
+            i = j;
+        }
+    }
+    hp->index[i] = 0;
+}
+
+/* Adjust by 'delta' the offsets of the entries after the offset 'after'. */
+/* 将偏移量大于after的项调整delta个字节 */
+static void hpIndexShift(hashpack *hp, uint32_t after, long delta) {
+    uint32_t j;
+
+    if (hp->index == NULL || delta == 0) return;
+    for (j = 0; j < hp->index_size; j++)
+        if (hp->index[j] > after) hp->index[j] += delta;
+}
+
+/* Replace the entry at 'p' with the string 's'. Returns the pointer to the
+ * new entry. The index is not updated. */
+/* 将节点p替换为字符串s，返回新节点的指针，不更新索引 */
+static unsigned char *hpReplaceEntry(hashpack *hp, unsigned char *p,
+                                     unsigned char *s, unsigned int slen)
+{
+    size_t off = p - hp->lp;
+
+    hp->lp = lpDelete(hp->lp,&p);
+    hp->lp = lpInsert(hp->lp,p,s,slen);
+    return hp->lp+off;
+}
+
+/* The expire 'old' of a field was changed, or the field deleted. If it was
+ * the min_expire of the hashpack, compute it again scanning the fields, so
+ * that a hashpack whose last TTL is gone has min_expire 0. Otherwise
+ * min_expire is still a valid lower bound. */
+/*  某个域原来的过期时间old被修改了，或者该域被删除了。如果old正是hashpack的min_expire，重新遍历所有域计算它，
+    这样最后一个过期时间被移除之后min_expire为0；否则min_expire仍然是一个有效的下界。 */
+static void hpMinExpireUpdate(hashpack *hp, long long old) {
+    unsigned char *p;
+    long long min_expire = 0;
+
+    if (old == 0 || old != hp->min_expire) return;
+    for (p = hpFirst(hp); p; p = hpNextField(hp,p)) {
+        long long when = hpGetExpire(hp,p);
+
+        if (when && (min_expire == 0 || when < min_expire))
+            min_expire = when;
+    }
+    hp->min_expire = min_expire;
+}
+
+hashpack *hpNew(void) {
+    hashpack *hp = zmalloc(sizeof(*hp));
+
+    hp->lp = lpNew();
+    hp->index = NULL;
+    hp->index_size = 0;
+    hp->count = 0;
+    hp->min_expire = 0;
+    return hp;
+}
+
+hashpack *hpFromListpack(unsigned char *lp) {
+    hashpack *hp = hpNew();
+    unsigned char *p = lpIndex(lp,0), *s, buf[32];
+    unsigned int len;
+    long long v;
+
+    while (p) {
+        lpGet(p,&s,&len,&v);
+        if (s == NULL) {
+            len = ll2string((char*)buf,sizeof(buf),v);
+            s = buf;
+        }
+        hp->lp = lpPush(hp->lp,s,len,LP_TAIL);
+        // 每个值之后追加过期时间0
+        if (lpLen(hp->lp) % 3 == 2) {
+            hp->lp = lpPush(hp->lp,(unsigned char*)"0",1,LP_TAIL);
+            hp->count++;
+        }
+        p = lpNext(lp,p);
+    }
+    lpFree(lp);
+    return hp;
+}
+
+hashpack *hpLoad(unsigned char *lp) {
+    unsigned char *p, *s;
+    unsigned int len, j = 0;
+    long long v, min_expire = 0;
+    hashpack *hp;
+
+    if (lpLen(lp) % 3 != 0) return NULL;
+    // 每三个节点中的最后一个必须是非负整数
+    for (p = lpIndex(lp,0); p; p = lpNext(lp,p), j++) {
+        if (j % 3 != 2) continue;
+        lpGet(p,&s,&len,&v);
+        if (s != NULL || v < 0) return NULL;
+        if (v && (min_expire == 0 || v < min_expire)) min_expire = v;
+    }
+    hp = zmalloc(sizeof(*hp));
+    hp->lp = lp;
+    hp->index = NULL;
+    hp->index_size = 0;
+    hp->count = j/3;
+    hp->min_expire = min_expire;
+    return hp;
+}
+
+void hpFree(hashpack *hp) {
+    lpFree(hp->lp);
+    zfree(hp->index);
+    zfree(hp);
+}
+
+unsigned long hpLength(hashpack *hp) {
+    return hp->count;
+}
+
+size_t hpBytes(hashpack *hp) {
+    return sizeof(*hp)+lpBytes(hp->lp)+sizeof(uint32_t)*hp->index_size;
+}
+
+unsigned char *hpFind(hashpack *hp, unsigned char *f, unsigned int flen) {
+    uint32_t mask, i;
+
+    if (hp->count == 0) return NULL;
+    if (hp->index == NULL) {
+        // 域很少时直接顺序查找，跳过值和过期时间
+        if (hp->count < HP_INDEX_MIN_FIELDS)
+            return lpFind(lpIndex(hp->lp,0),f,flen,2);
+        hpIndexBuild(hp);
+    }
+    mask = hp->index_size-1;
+    i = dictGenHashFunction(f,flen) & mask;
+    while (hp->index[i]) {
+        unsigned char *p = hp->lp+hp->index[i];
+
+        if (lpCompare(p,f,flen)) return p;
+        i = (i+1) & mask;
+    }
+    return NULL;
+}
+
+unsigned char *hpFirst(hashpack *hp) {
+    return lpIndex(hp->lp,0);
+}
+
+unsigned char *hpNextField(hashpack *hp, unsigned char *fptr) {
+    return lpNext(hp->lp,lpNext(hp->lp,lpNext(hp->lp,fptr)));
+}
+
+unsigned char *hpValue(hashpack *hp, unsigned char *fptr) {
+    return lpNext(hp->lp,fptr);
+}
+
+long long hpGetExpire(hashpack *hp, unsigned char *fptr) {
+    unsigned char *s;
+    unsigned int len;
+    long long v;
+
+    lpGet(lpNext(hp->lp,lpNext(hp->lp,fptr)),&s,&len,&v);
+    return (s == NULL) ? v : 0;
+}
+
+int hpSet(hashpack *hp, unsigned char *f, unsigned int flen,
+          unsigned char *v, unsigned int vlen)
+{
+    unsigned char *fptr = hpFind(hp,f,flen);
+    size_t oldbytes = lpBytes(hp->lp);
+
+    if (fptr != NULL) {
+        uint32_t foff = (uint32_t)(fptr - hp->lp);
+        long long old = hpGetExpire(hp,fptr);
+        unsigned char *p;
+
+        // 替换值，如果设置了过期时间则清除之
+        p = hpReplaceEntry(hp,lpNext(hp->lp,fptr),v,vlen);
+        p = lpNext(hp->lp,p);
+        if (old != 0) hpReplaceEntry(hp,p,(unsigned char*)"0",1);
+        hpIndexShift(hp,foff,(long)lpBytes(hp->lp)-(long)oldbytes);
+        hpMinExpireUpdate(hp,old);
+        return 1;
+    }
+
+    // 新的域追加到尾部，之前的节点的偏移量都不变
+    hp->lp = lpPush(hp->lp,f,flen,LP_TAIL);
+    hp->lp = lpPush(hp->lp,v,vlen,LP_TAIL);
+    hp->lp = lpPush(hp->lp,(unsigned char*)"0",1,LP_TAIL);
+    hp->count++;
+    if (hp->index) {
+        if (hp->count*2 > hp->index_size)
+            hpIndexBuild(hp);
+        else
+            hpIndexAdd(hp,hp->lp+oldbytes-1);
+    }
+    return 0;
+}
+
+int hpDelete(hashpack *hp, unsigned char *f, unsigned int flen) {
+    unsigned char *fptr = hpFind(hp,f,flen);
+    size_t oldbytes = lpBytes(hp->lp);
+    long long old;
+    uint32_t foff;
+
+    if (fptr == NULL) return 0;
+    foff = (uint32_t)(fptr - hp->lp);
+    old = hpGetExpire(hp,fptr);
+    if (hp->index) hpIndexRemove(hp,fptr);
+    // 连续删除域、值、过期时间三个节点
+    hp->lp = lpDelete(hp->lp,&fptr);
+    hp->lp = lpDelete(hp->lp,&fptr);
+    hp->lp = lpDelete(hp->lp,&fptr);
+    hp->count--;
+    hpIndexShift(hp,foff,(long)lpBytes(hp->lp)-(long)oldbytes);
+    hpMinExpireUpdate(hp,old);
+    return 1;
+}
+
+void hpSetExpire(hashpack *hp, unsigned char *fptr, long long when) {
+    unsigned char buf[32];
+    uint32_t foff = (uint32_t)(fptr - hp->lp);
+    size_t oldbytes = lpBytes(hp->lp);
+    long long old = hpGetExpire(hp,fptr);
+    int len = ll2string((char*)buf,sizeof(buf),when);
+
+    hpReplaceEntry(hp,lpNext(hp->lp,lpNext(hp->lp,fptr)),buf,len);
+    hpIndexShift(hp,foff,(long)lpBytes(hp->lp)-(long)oldbytes);
+    if (when && (hp->min_expire == 0 || when < hp->min_expire))
+        hp->min_expire = when;
+    else if (when != old)
+        hpMinExpireUpdate(hp,old);
+}
+
+unsigned long hpExpire(hashpack *hp, long long now, hpExpireProc *proc,
+                       void *privdata)
+{
+    unsigned char *p;
+    unsigned long deleted = 0;
+    long long min_expire = 0;
+
+    // 过期时间的下界还没有到，不可能有过期的域
+    if (hp->min_expire == 0 || hp->min_expire >= now) return 0;
+
+    p = hpFirst(hp);
+    while (p) {
+        long long when = hpGetExpire(hp,p);
+
+        if (when && when < now) {
+            if (proc) proc(privdata,p);
+            hp->lp = lpDelete(hp->lp,&p);
+            hp->lp = lpDelete(hp->lp,&p);
+            hp->lp = lpDelete(hp->lp,&p);
+            // 删除之后p指向下一个域节点，到达结尾时指向结尾符
+            if ((size_t)(p - hp->lp) == lpBytes(hp->lp)-1) p = NULL;
+            deleted++;
+        } else {
+            if (when && (min_expire == 0 || when < min_expire))
+                min_expire = when;
+            p = hpNextField(hp,p);
+        }
+    }
+    hp->count -= deleted;
+    hp->min_expire = min_expire;
+    // 一次删除了多个域，直接丢弃索引，下次查找时重新创建
+    if (deleted) hpIndexDrop(hp);
+    return deleted;
+}
+
+#ifdef HASHPACK_TEST_MAIN
+#include <sys/time.h>
+#include <assert.h>
+
+static long long usec(void) {
+    struct timeval tv;
+    gettimeofday(&tv,NULL);
+    return (((long long)tv.tv_sec)*1000000)+tv.tv_usec;
+}
+
+#define REF_FIELDS 600
+
+/* The reference: value and expire of every field "f<j>", value -1 when
+ * the field does not exist. */
+static long long refval[REF_FIELDS], refexp[REF_FIELDS];
+
+static unsigned int fieldName(char *buf, int j) {
+    // 一部分域是整数，会以整数编码保存
+    return (j % 3 == 0) ? (unsigned int)sprintf(buf,"%d",j) :
+                          (unsigned int)sprintf(buf,"f%d",j);
+}
+
+static void countExpired(void *privdata, unsigned char *fptr) {
+    (void)fptr;
+    (*(unsigned long*)privdata)++;
+}
+
+static void check(hashpack *hp) {
+    char buf[32];
+    unsigned long count = 0;
+    unsigned char *p, *s;
+    unsigned int len;
+    long long v;
+    int j;
+
+    for (j = 0; j < REF_FIELDS; j++) {
+        p = hpFind(hp,(unsigned char*)buf,fieldName(buf,j));
+        if (refval[j] == -1) {
+            assert(p == NULL);
+            continue;
+        }
+        assert(p != NULL);
+        lpGet(hpValue(hp,p),&s,&len,&v);
+        assert(s == NULL && v == refval[j]);
+        assert(hpGetExpire(hp,p) == refexp[j]);
+        count++;
+    }
+    assert(hpLength(hp) == count);
+    for (p = hpFirst(hp), count = 0; p; p = hpNextField(hp,p)) count++;
+    assert(hpLength(hp) == count);
+    // min_expire必须等于所有域中最小的过期时间，没有域设置过期时间时为0
+    for (j = 0, v = 0; j < REF_FIELDS; j++)
+        if (refval[j] != -1 && refexp[j] && (v == 0 || refexp[j] < v))
+            v = refexp[j];
+    assert(hp->min_expire == v);
+}
+
+int main(void) {
+    hashpack *hp = hpNew();
+    char buf[32], vbuf[32];
+    long long now = 1000, start;
+    unsigned char *lp;
+    int j, iter;
+
+    for (j = 0; j < REF_FIELDS; j++) refval[j] = -1;
+    srand(42);
+    for (iter = 0; iter < 200000; iter++) {
+        int op = rand() % 10;
+        unsigned int len;
+
+        j = rand() % REF_FIELDS;
+        len = fieldName(buf,j);
+        if (op < 5) {
+            long long v = rand() % 100000;
+
+            // 值有时很长，节点长度变化时之后的偏移量都要调整
+            if (rand() % 4 == 0) v *= 100000000LL;
+            assert(hpSet(hp,(unsigned char*)buf,len,(unsigned char*)vbuf,
+                         sprintf(vbuf,"%lld",v)) == (refval[j] != -1));
+            refval[j] = v;
+            refexp[j] = 0;
+        } else if (op < 7) {
+            assert(hpDelete(hp,(unsigned char*)buf,len) == (refval[j] != -1));
+            refval[j] = -1;
+        } else if (op < 9) {
+            unsigned char *p = hpFind(hp,(unsigned char*)buf,len);
+            long long when = (rand() % 3) ? now+1+rand() % 50 : 0;
+
+            assert((p != NULL) == (refval[j] != -1));
+            if (p) {
+                hpSetExpire(hp,p,when);
+                refexp[j] = when;
+            }
+        } else {
+            unsigned long expired = 0, expected = 0;
+
+            now += rand() % 10;
+            for (j = 0; j < REF_FIELDS; j++) {
+                if (refval[j] != -1 && refexp[j] && refexp[j] < now) {
+                    refval[j] = -1;
+                    expected++;
+                }
+            }
+            assert(hpExpire(hp,now,countExpired,&expired) == expected);
+            assert(expired == expected);
+        }
+        if (iter % 1000 == 0) check(hp);
+    }
+    check(hp);
+
+    /* Reload from the serialized listpack. */
+    lp = zmalloc(lpBytes(hp->lp));
+    memcpy(lp,hp->lp,lpBytes(hp->lp));
+    hpFree(hp);
+    assert((hp = hpLoad(lp)) != NULL);
+    check(hp);
+    hpFree(hp);
+    printf("hashpack: random operations OK\n");
+
+    /* Lookups in a 2000 fields hash: listpack scan against the index. */
+    {
+        int fields = 2000, lookups = 200000;
+        unsigned char *plain = lpNew();
+        long long t1, t2;
+        long found = 0;
+
+        for (j = 0; j < fields; j++) {
+            plain = lpPush(plain,(unsigned char*)buf,
+                           sprintf(buf,"session:field:%d",j),LP_TAIL);
+            plain = lpPush(plain,(unsigned char*)"value",5,LP_TAIL);
+        }
+        lp = zmalloc(lpBytes(plain));
+        memcpy(lp,plain,lpBytes(plain));
+        hp = hpFromListpack(lp);
+
+        start = usec();
+        for (j = 0; j < lookups; j++) {
+            unsigned int len = sprintf(buf,"session:field:%d",j % fields);
+            found += lpFind(lpIndex(plain,0),(unsigned char*)buf,len,1) != NULL;
+        }
+        t1 = usec()-start;
+        start = usec();
+        for (j = 0; j < lookups; j++) {
+            unsigned int len = sprintf(buf,"session:field:%d",j % fields);
+            found += hpFind(hp,(unsigned char*)buf,len) != NULL;
+        }
+        t2 = usec()-start;
+        assert(found == lookups*2);
+        printf("%d lookups in %d fields: listpack %lld us, hashpack %lld us\n",
+            lookups,fields,t1,t2);
+        printf("bytes: listpack %lu, hashpack %lu\n",
+            (unsigned long)lpBytes(plain),(unsigned long)hpBytes(hp));
+        lpFree(plain);
+        hpFree(hp);
+    }
+    return 0;
+}
+#endif
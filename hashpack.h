@@ -0,0 +1,90 @@
+/* hashpack.h - Listpack encoded hashes with a field index and field TTLs.
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __HASHPACK_H
+#define __HASHPACK_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*  hashpack是介于listpack编码和dict编码之间的hash编码：所有的域和值仍然紧凑地保存在一个listpack中，
+    每个域占用三个相邻的节点：域、值、过期时间（毫秒时间戳，0表示没有过期时间）。
+    另外还有一个按需创建的开放寻址哈希表，保存每个域节点在listpack中的偏移量，这样查找一个域只需要O(1)，
+    而不需要像listpack编码那样从头到尾比较。 */
+
+typedef struct hashpack {
+    // 域、值、过期时间三个一组的listpack
+    unsigned char *lp;
+    // 开放寻址的哈希表，每个槽保存域节点在lp中的偏移量，0表示空槽；第一次查找之前为NULL
+    uint32_t *index;
+    // 哈希表的槽数，总是2的幂
+    uint32_t index_size;
+    // 域的个数
+    uint32_t count;
+    // 所有域的过期时间的下界，0表示没有域设置了过期时间
+    long long min_expire;
+} hashpack;
+
+/* 删除过期的域之前调用的回调函数，fptr指向被删除的域节点 */
+typedef void hpExpireProc(void *privdata, unsigned char *fptr);
+
+/* 创建一个空的hashpack */
+hashpack *hpNew(void);
+/* 根据域、值两个一组的listpack创建hashpack，lp会被释放 */
+hashpack *hpFromListpack(unsigned char *lp);
+/* 根据lp（例如从RDB中读出的三个一组的listpack）创建hashpack，格式不正确时返回NULL，lp仍由调用者负责释放 */
+hashpack *hpLoad(unsigned char *lp);
+/* 释放hashpack */
+void hpFree(hashpack *hp);
+/* 返回域的个数 */
+unsigned long hpLength(hashpack *hp);
+/* 返回hashpack占用的字节数，包括索引 */
+size_t hpBytes(hashpack *hp);
+/* 查找域f，返回域节点的指针，域不存在时返回NULL */
+unsigned char *hpFind(hashpack *hp, unsigned char *f, unsigned int flen);
+/* 返回第一个域节点，hashpack为空时返回NULL */
+unsigned char *hpFirst(hashpack *hp);
+/* 返回域节点fptr之后的下一个域节点，没有时返回NULL */
+unsigned char *hpNextField(hashpack *hp, unsigned char *fptr);
+/* 返回域节点fptr对应的值节点 */
+unsigned char *hpValue(hashpack *hp, unsigned char *fptr);
+/* 返回域节点fptr的过期时间，0表示没有过期时间 */
+long long hpGetExpire(hashpack *hp, unsigned char *fptr);
+/* 设置域f的值，并清除它的过期时间。域已经存在时返回1，新增域时返回0 */
+int hpSet(hashpack *hp, unsigned char *f, unsigned int flen, unsigned char *v, unsigned int vlen);
+/* 删除域f，成功返回1，域不存在时返回0 */
+int hpDelete(hashpack *hp, unsigned char *f, unsigned int flen);
+/* 设置域节点fptr的过期时间，when为0时清除过期时间。调用之后所有节点指针都失效 */
+void hpSetExpire(hashpack *hp, unsigned char *fptr, long long when);
+/* 删除所有在now时刻已经过期的域，对每个被删除的域先调用proc（可以为NULL），返回删除的域的个数 */
+unsigned long hpExpire(hashpack *hp, long long now, hpExpireProc *proc, void *privdata);
+
+#endif
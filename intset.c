@@ -128,6 +128,40 @@ static intset *intsetResize(intset *is, uint32_t len) {
     return is;
 }
 
+/* On little endian hosts the contents array can be read in place as an array
+ * of the native integer type, so the search and set operation kernels below
+ * access it directly instead of going through _intsetGetEncoded(). */
+/*  intset中的数据统一以小端模式存放，在小端机器上可以直接把contents当做对应类型的整型数组访问，
+    下面的查找和集合运算都利用了这一点，避免每次都调用_intsetGetEncoded进行解码。 */
+#if (BYTE_ORDER == LITTLE_ENDIAN)
+#define INTSET_NATIVE_LAYOUT 1
+#endif
+
+#if defined(INTSET_NATIVE_LAYOUT) && defined(__SSE2__)
+#include <emmintrin.h>
+#define INTSET_USE_SSE2 1
+#endif
+
+#ifdef INTSET_NATIVE_LAYOUT
+/* Branchless lower bound: return the index of the first element >= value.
+ * Every iteration halves the range with a conditional move instead of a
+ * data dependent branch, so the cost no longer depends on how well the
+ * comparisons can be predicted. */
+/*  无分支的二分查找，返回第一个大于等于value的元素的位置。每次循环用条件传送而不是条件跳转来缩小区间，
+    查找随机值时不会因为分支预测失败而浪费大量时钟周期。 */
+#define INTSET_LOWER_BOUND(type, contents, len, value, pos) do { \
+    const type *_base = (const type*)(contents); \
+    const type *_arr = _base; \
+    uint32_t _n = (len); \
+    while (_n > 1) { \
+        uint32_t _half = _n >> 1; \
+        _base = (_base[_half] < (value)) ? _base+_half : _base; \
+        _n -= _half; \
+    } \
+    (pos) = (uint32_t)(_base-_arr) + (*_base < (value)); \
+} while(0)
+#endif
+
 /* Search for the position of "value". Return 1 when the value was found and
  * sets "pos" to the position of the value within the intset. Return 0 when
  * the value is not present in the intset and sets "pos" to the position
@@ -157,6 +191,28 @@ static uint8_t intsetSearch(intset *is, int64_t value, uint32_t *pos) {
         }
     }
 
+#ifdef INTSET_NATIVE_LAYOUT
+    {
+        // 经过上面的检查，value一定落在[第一个元素, 最后一个元素]区间内，也就一定能用当前编码表示
+        uint32_t len = intrev32ifbe(is->length), p;
+        uint8_t enc = intrev32ifbe(is->encoding);
+        int found;
+
+        if (enc == INTSET_ENC_INT16) {
+            INTSET_LOWER_BOUND(int16_t,is->contents,len,value,p);
+            found = ((int16_t*)is->contents)[p] == value;
+        } else if (enc == INTSET_ENC_INT32) {
+            INTSET_LOWER_BOUND(int32_t,is->contents,len,value,p);
+            found = ((int32_t*)is->contents)[p] == value;
+        } else {
+            INTSET_LOWER_BOUND(int64_t,is->contents,len,value,p);
+            found = ((int64_t*)is->contents)[p] == value;
+        }
+        if (pos) *pos = p;
+        return found;
+    }
+#endif
+
     // 利用二分法查找一个插入位置
     while(max >= min) {
         mid = ((unsigned int)min + (unsigned int)max) >> 1;
@@ -344,6 +400,343 @@ size_t intsetBlobLen(intset *is) {
     return sizeof(intset)+intrev32ifbe(is->length)*intrev32ifbe(is->encoding);
 }
 
+/* Return a copy of the intset. */
+/*  复制一个intset */
+intset *intsetDup(intset *is) {
+    size_t len = intsetBlobLen(is);
+    intset *copy = zmalloc(len);
+    memcpy(copy,is,len);
+    return copy;
+}
+
+/* ----------------------------- Set operations ------------------------------
+ * Intersection, union and difference of two intsets. The elements of an
+ * intset are sorted, so all three are computed with a single merge pass
+ * instead of probing one set for every element of the other. When both
+ * inputs share the same encoding the merge runs directly on the native
+ * arrays: branchless for union and difference, SSE2 block compares for the
+ * intersection of int16 and int32 sets, and galloping (exponential search)
+ * when one input is much smaller than the other. Mixed encodings fall back
+ * to a generic merge that decodes every element.
+ * -------------------------------------------------------------------------- */
+/*  两个intset的交集、并集和差集运算。
+    intset中的元素是有序的，所以这三种运算都可以通过一次归并完成，而不需要对一个集合的每个元素都到另一个集合中查找。
+    如果两个集合使用相同的编码，则直接在原生整型数组上归并：并集和差集使用无分支的归并，int16和int32编码的交集使用
+    SSE2指令一次比较一个数据块，两个集合大小相差悬殊时使用galloping（指数查找）跳过大集合中不可能匹配的部分。
+    编码不同时退化为逐个解码元素的通用归并。 */
+
+/* When the larger input is at least this many times bigger than the smaller
+ * one, intersection and difference gallop into the larger input instead of
+ * scanning it linearly. */
+// 大集合的元素个数至少是小集合的这么多倍时，交集和差集运算改为在大集合中galloping查找
+#define INTSET_GALLOP_RATIO 32
+
+#define INTSET_OP_INTER 0
+#define INTSET_OP_UNION 1
+#define INTSET_OP_DIFF 2
+
+/* Create an empty intset with the given encoding and room for "len"
+ * elements. The caller fills the contents and sets the final length. */
+/*  创建一个指定编码、可以容纳len个元素的空intset，由调用者负责填充元素并设置最终的长度 */
+static intset *intsetNewWithCapacity(uint8_t enc, uint32_t len) {
+    intset *is = zmalloc(sizeof(intset)+(size_t)len*enc);
+    is->encoding = intrev32ifbe(enc);
+    is->length = 0;
+    return is;
+}
+
+/* Set the final length of a result intset and release the unused room. */
+/*  设置结果intset的最终长度，并释放多余的空间 */
+static intset *intsetTrim(intset *is, uint32_t len) {
+    is->length = intrev32ifbe(len);
+    return intsetResize(is,len);
+}
+
+/* Generic merge for inputs with different encodings. The result must already
+ * use an encoding able to represent every element it can receive. */
+/*  编码不同的两个集合的通用归并，结果集合res的编码必须能够表示所有可能写入的元素 */
+static uint32_t intsetMergeGeneric(intset *a, intset *b, intset *res, int op) {
+    uint32_t na = intrev32ifbe(a->length), nb = intrev32ifbe(b->length);
+    uint8_t aenc = intrev32ifbe(a->encoding), benc = intrev32ifbe(b->encoding);
+    uint32_t i = 0, j = 0, k = 0;
+
+    while (i < na && j < nb) {
+        int64_t x = _intsetGetEncoded(a,i,aenc);
+        int64_t y = _intsetGetEncoded(b,j,benc);
+
+        if (x < y) {
+            if (op != INTSET_OP_INTER) _intsetSet(res,k++,x);
+            i++;
+        } else if (x > y) {
+            if (op == INTSET_OP_UNION) _intsetSet(res,k++,y);
+            j++;
+        } else {
+            if (op != INTSET_OP_DIFF) _intsetSet(res,k++,x);
+            i++;
+            j++;
+        }
+    }
+    // 交集运算到这里已经结束，并集需要追加两个集合剩下的元素，差集只需要追加集合a剩下的元素
+    if (op != INTSET_OP_INTER)
+        while (i < na) _intsetSet(res,k++,_intsetGetEncoded(a,i++,aenc));
+    if (op == INTSET_OP_UNION)
+        while (j < nb) _intsetSet(res,k++,_intsetGetEncoded(b,j++,benc));
+    return k;
+}
+
+#ifdef INTSET_NATIVE_LAYOUT
+/* Advance "j" to the first element of b[0..nb) that is >= x, probing
+ * b[j+1], b[j+2], b[j+4], ... before a binary search in the last step. */
+/*  将j移动到b[0..nb)中第一个大于等于x的元素：先以1、2、4、8...的步长向后探测，再在最后一步的区间内二分查找 */
+#define INTSET_GALLOP(type, b, nb, j, x) do { \
+    uint32_t _step = 1, _lo = (j), _p; \
+    while (_lo+_step < (nb) && (b)[_lo+_step] < (x)) { \
+        _lo += _step; \
+        _step <<= 1; \
+    } \
+    _step = (_lo+_step < (nb)) ? _step+1 : (nb)-_lo; \
+    INTSET_LOWER_BOUND(type,(b)+_lo,_step,x,_p); \
+    (j) = _lo+_p; \
+} while(0)
+
+/* Intersection of a (the smaller input) and b, both of "type". Uses a
+ * galloping search when b is much larger, a branchless merge otherwise. */
+/*  类型为type的集合a（较小的集合）和b的交集。b比a大很多时使用galloping查找，否则使用无分支的归并 */
+#define INTSET_INTER_BODY(type) do { \
+    const type *_a = (const type*)a->contents, *_b = (const type*)b->contents; \
+    type *_out = (type*)res->contents; \
+    if (nb/na >= INTSET_GALLOP_RATIO) { \
+        for (i = 0; i < na && j < nb; i++) { \
+            INTSET_GALLOP(type,_b,nb,j,_a[i]); \
+            if (j < nb && _b[j] == _a[i]) _out[k++] = _a[i]; \
+        } \
+    } else { \
+        while (i < na && j < nb) { \
+            type _x = _a[i], _y = _b[j]; \
+            _out[k] = _x; \
+            k += (_x == _y); \
+            i += (_x <= _y); \
+            j += (_y <= _x); \
+        } \
+    } \
+} while(0)
+
+#ifdef INTSET_USE_SSE2
+/* Rotate the 16 bit lanes of v left by n lanes. */
+// 将v中的16位整数循环移动n个位置
+#define INTSET_ROT16(v,n) _mm_or_si128(_mm_srli_si128(v,2*(n)),_mm_slli_si128(v,16-2*(n)))
+
+/* SSE2 intersection of two same sized blocks: every element of the 8 (int16)
+ * or 4 (int32) element block of a is compared against every element of the
+ * block of b, the matching elements of a are emitted in order, then the
+ * block with the smaller maximum is advanced (both when they are equal).
+ * Returns with i/j pointing to the first elements not yet fully compared,
+ * the caller finishes with the scalar merge. */
+/*  SSE2版本的交集运算：每次取出a和b中各一个数据块（int16编码为8个元素，int32编码为4个元素），
+    将a块中的每个元素与b块中的所有元素比较，按顺序输出a块中匹配的元素，然后移动最大值较小的那个数据块
+    （最大值相等时两个都移动）。剩下不足一个数据块的元素由调用者使用普通的归并处理。 */
+static uint32_t intsetInterSSE16(const int16_t *a, uint32_t na, const int16_t *b,
+                                 uint32_t nb, int16_t *out, uint32_t *pi, uint32_t *pj) {
+    uint32_t i = 0, j = 0, k = 0;
+
+    while (i+8 <= na && j+8 <= nb) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a+i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b+j));
+        __m128i c0 = _mm_or_si128(_mm_cmpeq_epi16(va,vb),
+                                  _mm_cmpeq_epi16(va,INTSET_ROT16(vb,1)));
+        __m128i c1 = _mm_or_si128(_mm_cmpeq_epi16(va,INTSET_ROT16(vb,2)),
+                                  _mm_cmpeq_epi16(va,INTSET_ROT16(vb,3)));
+        __m128i c2 = _mm_or_si128(_mm_cmpeq_epi16(va,INTSET_ROT16(vb,4)),
+                                  _mm_cmpeq_epi16(va,INTSET_ROT16(vb,5)));
+        __m128i c3 = _mm_or_si128(_mm_cmpeq_epi16(va,INTSET_ROT16(vb,6)),
+                                  _mm_cmpeq_epi16(va,INTSET_ROT16(vb,7)));
+        // 每个16位整数对应掩码中的两位，只保留低位
+        unsigned int mask = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(c0,c1),
+                                                           _mm_or_si128(c2,c3))) & 0x5555;
+        int16_t amax = a[i+7], bmax = b[j+7];
+
+        while (mask) {
+            out[k++] = a[i+(__builtin_ctz(mask)>>1)];
+            mask &= mask-1;
+        }
+        i += (amax <= bmax) << 3;
+        j += (bmax <= amax) << 3;
+    }
+    *pi = i;
+    *pj = j;
+    return k;
+}
+
+static uint32_t intsetInterSSE32(const int32_t *a, uint32_t na, const int32_t *b,
+                                 uint32_t nb, int32_t *out, uint32_t *pi, uint32_t *pj) {
+    uint32_t i = 0, j = 0, k = 0;
+
+    while (i+4 <= na && j+4 <= nb) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a+i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b+j));
+        __m128i c0 = _mm_or_si128(_mm_cmpeq_epi32(va,vb),
+                     _mm_cmpeq_epi32(va,_mm_shuffle_epi32(vb,_MM_SHUFFLE(0,3,2,1))));
+        __m128i c1 = _mm_or_si128(
+                     _mm_cmpeq_epi32(va,_mm_shuffle_epi32(vb,_MM_SHUFFLE(1,0,3,2))),
+                     _mm_cmpeq_epi32(va,_mm_shuffle_epi32(vb,_MM_SHUFFLE(2,1,0,3))));
+        unsigned int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_or_si128(c0,c1)));
+        int32_t amax = a[i+3], bmax = b[j+3];
+
+        while (mask) {
+            out[k++] = a[i+__builtin_ctz(mask)];
+            mask &= mask-1;
+        }
+        i += (amax <= bmax) << 2;
+        j += (bmax <= amax) << 2;
+    }
+    *pi = i;
+    *pj = j;
+    return k;
+}
+#endif
+
+/* Union of a and b, both of "type": a branchless merge that always emits the
+ * smaller head, followed by a copy of whatever tail is left. */
+/*  类型为type的集合a和b的并集：无分支归并，每次输出两个集合头部中较小的元素，最后复制剩下的尾部 */
+#define INTSET_UNION_BODY(type) do { \
+    const type *_a = (const type*)a->contents, *_b = (const type*)b->contents; \
+    type *_out = (type*)res->contents; \
+    while (i < na && j < nb) { \
+        type _x = _a[i], _y = _b[j]; \
+        _out[k++] = (_x <= _y) ? _x : _y; \
+        i += (_x <= _y); \
+        j += (_y <= _x); \
+    } \
+    memcpy(_out+k,_a+i,(na-i)*sizeof(type)); \
+    k += na-i; \
+    memcpy(_out+k,_b+j,(nb-j)*sizeof(type)); \
+    k += nb-j; \
+} while(0)
+
+/* Difference a - b, both of "type": galloping into b when it is much larger
+ * than a, a branchless merge otherwise. */
+/*  类型为type的集合a和b的差集a - b：b比a大很多时使用galloping查找，否则使用无分支的归并 */
+#define INTSET_DIFF_BODY(type) do { \
+    const type *_a = (const type*)a->contents, *_b = (const type*)b->contents; \
+    type *_out = (type*)res->contents; \
+    if (nb/na >= INTSET_GALLOP_RATIO) { \
+        for (; i < na && j < nb; i++) { \
+            INTSET_GALLOP(type,_b,nb,j,_a[i]); \
+            if (j == nb || _b[j] != _a[i]) _out[k++] = _a[i]; \
+        } \
+    } else { \
+        while (i < na && j < nb) { \
+            type _x = _a[i], _y = _b[j]; \
+            _out[k] = _x; \
+            k += (_x < _y); \
+            i += (_x <= _y); \
+            j += (_y <= _x); \
+        } \
+    } \
+    memcpy(_out+k,_a+i,(na-i)*sizeof(type)); \
+    k += na-i; \
+} while(0)
+#endif
+
+/* Return a new intset holding the elements present in both a and b. */
+/*  返回一个新的intset，包含同时存在于a和b中的元素 */
+intset *intsetIntersect(intset *a, intset *b) {
+    uint32_t na, nb, i = 0, j = 0, k = 0;
+    uint8_t aenc, benc;
+    intset *res;
+
+    // 让a指向较小的集合
+    if (intrev32ifbe(a->length) > intrev32ifbe(b->length)) {
+        intset *t = a;
+        a = b;
+        b = t;
+    }
+    na = intrev32ifbe(a->length);
+    nb = intrev32ifbe(b->length);
+    aenc = intrev32ifbe(a->encoding);
+    benc = intrev32ifbe(b->encoding);
+
+    /* Every element of the result belongs to both inputs, so the smaller of
+     * the two encodings is always enough to represent it. */
+    // 交集中的元素同时属于两个集合，所以两者中较小的编码一定足以表示
+    res = intsetNewWithCapacity(aenc < benc ? aenc : benc,na);
+    if (na == 0) return intsetTrim(res,0);
+
+#ifdef INTSET_NATIVE_LAYOUT
+    if (aenc == benc) {
+        if (aenc == INTSET_ENC_INT16) {
+#ifdef INTSET_USE_SSE2
+            if (nb/na < INTSET_GALLOP_RATIO)
+                k = intsetInterSSE16((int16_t*)a->contents,na,(int16_t*)b->contents,nb,
+                                     (int16_t*)res->contents,&i,&j);
+#endif
+            INTSET_INTER_BODY(int16_t);
+        } else if (aenc == INTSET_ENC_INT32) {
+#ifdef INTSET_USE_SSE2
+            if (nb/na < INTSET_GALLOP_RATIO)
+                k = intsetInterSSE32((int32_t*)a->contents,na,(int32_t*)b->contents,nb,
+                                     (int32_t*)res->contents,&i,&j);
+#endif
+            INTSET_INTER_BODY(int32_t);
+        } else {
+            INTSET_INTER_BODY(int64_t);
+        }
+        return intsetTrim(res,k);
+    }
+#endif
+    k = intsetMergeGeneric(a,b,res,INTSET_OP_INTER);
+    return intsetTrim(res,k);
+}
+
+/* Return a new intset holding the elements present in a, b or both. */
+/*  返回一个新的intset，包含存在于a或b中的所有元素 */
+intset *intsetUnion(intset *a, intset *b) {
+    uint32_t na = intrev32ifbe(a->length), nb = intrev32ifbe(b->length);
+    uint32_t i = 0, j = 0, k = 0;
+    uint8_t aenc = intrev32ifbe(a->encoding), benc = intrev32ifbe(b->encoding);
+    // 并集需要使用两者中较大的编码
+    intset *res = intsetNewWithCapacity(aenc > benc ? aenc : benc,na+nb);
+
+#ifdef INTSET_NATIVE_LAYOUT
+    if (aenc == benc) {
+        if (aenc == INTSET_ENC_INT16)
+            INTSET_UNION_BODY(int16_t);
+        else if (aenc == INTSET_ENC_INT32)
+            INTSET_UNION_BODY(int32_t);
+        else
+            INTSET_UNION_BODY(int64_t);
+        return intsetTrim(res,k);
+    }
+#endif
+    k = intsetMergeGeneric(a,b,res,INTSET_OP_UNION);
+    return intsetTrim(res,k);
+}
+
+/* Return a new intset holding the elements of a that are not in b. */
+/*  返回一个新的intset，包含存在于a但不存在于b中的元素 */
+intset *intsetDifference(intset *a, intset *b) {
+    uint32_t na = intrev32ifbe(a->length), nb = intrev32ifbe(b->length);
+    uint32_t i = 0, j = 0, k = 0;
+    uint8_t aenc = intrev32ifbe(a->encoding), benc = intrev32ifbe(b->encoding);
+    // 差集中的元素都来自a，沿用a的编码即可
+    intset *res = intsetNewWithCapacity(aenc,na);
+
+    if (na == 0) return intsetTrim(res,0);
+#ifdef INTSET_NATIVE_LAYOUT
+    if (aenc == benc) {
+        if (aenc == INTSET_ENC_INT16)
+            INTSET_DIFF_BODY(int16_t);
+        else if (aenc == INTSET_ENC_INT32)
+            INTSET_DIFF_BODY(int32_t);
+        else
+            INTSET_DIFF_BODY(int64_t);
+        return intsetTrim(res,k);
+    }
+#endif
+    k = intsetMergeGeneric(a,b,res,INTSET_OP_DIFF);
+    return intsetTrim(res,k);
+}
+
 /* 下面是一些测试代码 */
 #ifdef INTSET_TEST_MAIN
 #include <sys/time.h>
@@ -412,6 +805,51 @@ void checkConsistency(intset *is) {
     }
 }
 
+/* Like createSet() but optionally forces a larger encoding by adding and
+ * removing a value that needs it. */
+intset *createSetWithEncoding(int bits, int size, int64_t upgrade) {
+    intset *is = createSet(bits,size);
+    if (upgrade) {
+        is = intsetAdd(is,upgrade,NULL);
+        is = intsetRemove(is,upgrade,NULL);
+    }
+    return is;
+}
+
+/* Check the result of the set operations against intsetFind(). */
+void checkSetOps(intset *a, intset *b) {
+    intset *inter = intsetIntersect(a,b);
+    intset *uni = intsetUnion(a,b);
+    intset *diff = intsetDifference(a,b);
+    uint32_t i, common = 0;
+    int64_t v;
+
+    for (i = 0; i < intsetLen(a); i++) {
+        intsetGet(a,i,&v);
+        if (intsetFind(b,v)) {
+            common++;
+            assert(intsetFind(inter,v));
+            assert(!intsetFind(diff,v));
+        } else {
+            assert(intsetFind(diff,v));
+        }
+        assert(intsetFind(uni,v));
+    }
+    for (i = 0; i < intsetLen(b); i++) {
+        intsetGet(b,i,&v);
+        assert(intsetFind(uni,v));
+    }
+    assert(intsetLen(inter) == common);
+    assert(intsetLen(diff) == intsetLen(a)-common);
+    assert(intsetLen(uni) == intsetLen(a)+intsetLen(b)-common);
+    if (intsetLen(inter) > 1) checkConsistency(inter);
+    if (intsetLen(uni) > 1) checkConsistency(uni);
+    if (intsetLen(diff) > 1) checkConsistency(diff);
+    zfree(inter);
+    zfree(uni);
+    zfree(diff);
+}
+
 int main(int argc, char **argv) {
     uint8_t success;
     int i;
@@ -543,5 +981,78 @@ int main(int argc, char **argv) {
         checkConsistency(is);
         ok();
     }
+
+    printf("Intersection, union and difference: "); {
+        int64_t upgrades[] = {0, 65535, 4294967295LL};
+        int sizes[] = {0, 1, 7, 100, 3000};
+        int ua, ub, sa, sb;
+
+        for (ua = 0; ua < 3; ua++) for (ub = 0; ub < 3; ub++)
+        for (sa = 0; sa < 5; sa++) for (sb = 0; sb < 5; sb++) {
+            intset *a = createSetWithEncoding(12,sizes[sa],upgrades[ua]);
+            intset *b = createSetWithEncoding(12,sizes[sb],upgrades[ub]);
+            checkSetOps(a,b);
+            checkSetOps(b,a);
+            checkSetOps(a,a);
+            zfree(a);
+            zfree(b);
+        }
+
+        /* Negative values and a small set galloping through a large one. */
+        is = intsetNew();
+        for (i = -20000; i < 20000; i += 3) is = intsetAdd(is,i,NULL);
+        {
+            intset *small = intsetNew();
+            small = intsetAdd(small,-19999,NULL);
+            small = intsetAdd(small,-19997,NULL);
+            small = intsetAdd(small,0,NULL);
+            small = intsetAdd(small,19999,NULL);
+            small = intsetAdd(small,30000,NULL);
+            checkSetOps(small,is);
+            checkSetOps(is,small);
+            zfree(small);
+        }
+        zfree(is);
+        ok();
+    }
+
+    printf("Stress intersection: "); {
+        int sizes[][2] = {{512,512}, {5000,5000}, {100,20000}};
+        int bits[] = {15, 20};
+        int s, b, rounds = 200;
+
+        for (b = 0; b < 2; b++) for (s = 0; s < 3; s++) {
+            intset *x = createSet(bits[b],sizes[s][0]);
+            intset *y = createSet(bits[b],sizes[s][1]);
+            long long start, lookup, merge;
+            uint32_t found = 0, len = 0;
+            int64_t v;
+
+            /* Per element lookups, as SINTER used to do. */
+            start = usec();
+            for (i = 0; i < rounds; i++) {
+                uint32_t j;
+                for (j = 0; j < intsetLen(x); j++) {
+                    intsetGet(x,j,&v);
+                    found += intsetFind(y,v);
+                }
+            }
+            lookup = usec()-start;
+
+            start = usec();
+            for (i = 0; i < rounds; i++) {
+                intset *r = intsetIntersect(x,y);
+                len += intsetLen(r);
+                zfree(r);
+            }
+            merge = usec()-start;
+            assert(found == len);
+            printf("\n  %d bits, %u x %u: lookups %lldusec, intersect %lldusec",
+                bits[b],intsetLen(x),intsetLen(y),lookup,merge);
+            zfree(x);
+            zfree(y);
+        }
+        printf("\n");
+    }
 }
 #endif
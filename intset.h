@@ -58,5 +58,13 @@ uint8_t intsetGet(intset *is, uint32_t pos, int64_t *value);
 uint32_t intsetLen(intset *is);
 /* 返回intset所占用的字节数 */
 size_t intsetBlobLen(intset *is);
+/* 复制一个intset */
+intset *intsetDup(intset *is);
+/* 返回一个新的intset，保存a和b的交集 */
+intset *intsetIntersect(intset *a, intset *b);
+/* 返回一个新的intset，保存a和b的并集 */
+intset *intsetUnion(intset *a, intset *b);
+/* 返回一个新的intset，保存a和b的差集a - b */
+intset *intsetDifference(intset *a, intset *b);
 
 #endif // __INTSET_H
@@ -0,0 +1,147 @@
+/* Named latency probes and the LATENCY HISTOGRAM command, see latencyprobe.h.
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "redis.h"
+
+/* The probes. 'monitor' tells if the samples above latency-monitor-threshold
+ * are also sent to the latency monitor: it is not the case of the events
+ * the code already samples by itself, with the same name. */
+/*  所有的探针。monitor表示超过latency-monitor-threshold的样本是否也交给延迟监视器：
+    代码中已经以相同的名称自行采样的事件不需要重复提交。 */
+static struct latencyProbe {
+    char *name;
+    int monitor;
+    latencyHistogram hist;
+} LatencyProbes[LATENCY_PROBE_NUM] = {
+    {"dict-rehash",1,{0}},
+    {"expire-del",1,{0}},
+    {"expire-cycle",1,{0}},
+    {"aof-write",0,{0}},
+    {"aof-fsync-always",0,{0}},
+    {"fork",0,{0}},
+    {"exec",1,{0}},
+    {"command",0,{0}}
+};
+
+void latencyProbeAdd(int probe, long long us) {
+    struct latencyProbe *lp = LatencyProbes+probe;
+
+    lhRecord(&lp->hist,us);
+    if (lp->monitor) latencyAddSampleIfNeeded(lp->name,us/1000);
+}
+
+/* dict.c knows nothing about the server: it reports the duration of every
+ * batch of background rehashing to this observer. */
+/* dict.c并不了解服务器，它通过这个回调函数报告每一批后台rehash的耗时 */
+static void latencyProbeRehashObserver(long long us, int steps) {
+    REDIS_NOTUSED(steps);
+    latencyProbeAddIfNeeded(LATENCY_PROBE_DICT_REHASH,us);
+}
+
+void latencyProbeInit(void) {
+    int j;
+
+    for (j = 0; j < LATENCY_PROBE_NUM; j++) lhReset(&LatencyProbes[j].hist);
+    dictSetRehashObserver(latencyProbeRehashObserver);
+}
+
+int latencyProbeReset(char *name) {
+    int j, resets = 0;
+
+    for (j = 0; j < LATENCY_PROBE_NUM; j++) {
+        if (name && strcasecmp(name,LatencyProbes[j].name)) continue;
+        lhReset(&LatencyProbes[j].hist);
+        resets++;
+    }
+    return resets;
+}
+
+/* Reply with the histogram of a probe: calls, average, a few percentiles,
+ * the max, and the non empty buckets as [highest value, count] pairs. */
+/* 回复一个探针的直方图：调用次数、平均值、几个百分位数、最大值，以及所有非空的桶，每个桶为[最大值, 个数]对 */
+static void addReplyLatencyProbe(redisClient *c, struct latencyProbe *lp) {
+    latencyHistogram *h = &lp->hist;
+    int b, nonempty = 0;
+
+    for (b = 0; b < LH_BUCKETS; b++) if (h->buckets[b]) nonempty++;
+
+    addReplyBulkCString(c,lp->name);
+    addReplyMultiBulkLen(c,16);
+    addReplyBulkCString(c,"calls");
+    addReplyLongLong(c,h->count);
+    addReplyBulkCString(c,"avg_usec");
+    addReplyLongLong(c,h->count ? (long long)(h->sum/h->count) : 0);
+    addReplyBulkCString(c,"p50_usec");
+    addReplyLongLong(c,lhPercentile(h,50));
+    addReplyBulkCString(c,"p99_usec");
+    addReplyLongLong(c,lhPercentile(h,99));
+    addReplyBulkCString(c,"p99.9_usec");
+    addReplyLongLong(c,lhPercentile(h,99.9));
+    addReplyBulkCString(c,"max_usec");
+    addReplyLongLong(c,h->max);
+    addReplyBulkCString(c,"min_usec");
+    addReplyLongLong(c,h->min);
+    addReplyBulkCString(c,"buckets");
+    addReplyMultiBulkLen(c,nonempty);
+    for (b = 0; b < LH_BUCKETS; b++) {
+        if (h->buckets[b] == 0) continue;
+        addReplyMultiBulkLen(c,2);
+        addReplyLongLong(c,lhBucketHigh(b));
+        addReplyLongLong(c,h->buckets[b]);
+    }
+}
+
+/* LATENCY HISTOGRAM [event ...]
+ *
+ * Without arguments every probe that recorded something is reported,
+ * otherwise the named probes are, in the given order. Unknown names are
+ * skipped. Called by latencyCommand(). */
+/*  LATENCY HISTOGRAM [event ...]：不带参数时回复所有记录过数据的探针，否则按照给定的顺序回复指定的探针，
+    不存在的探针会被跳过。由latencyCommand调用。 */
+void latencyHistogramCommand(redisClient *c) {
+    struct latencyProbe *found[LATENCY_PROBE_NUM];
+    int j, k, n = 0;
+
+    if (c->argc == 2) {
+        for (k = 0; k < LATENCY_PROBE_NUM; k++)
+            if (LatencyProbes[k].hist.count) found[n++] = LatencyProbes+k;
+    } else {
+        for (j = 2; j < c->argc && n < LATENCY_PROBE_NUM; j++) {
+            for (k = 0; k < LATENCY_PROBE_NUM; k++) {
+                if (!strcasecmp(c->argv[j]->ptr,LatencyProbes[k].name)) {
+                    found[n++] = LatencyProbes+k;
+                    break;
+                }
+            }
+        }
+    }
+    addReplyMultiBulkLen(c,n*2);
+    for (j = 0; j < n; j++) addReplyLatencyProbe(c,found[j]);
+}
@@ -0,0 +1,75 @@
+/* latencyprobe.h - Named latency probes in the server hot paths.
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __LATENCYPROBE_H
+#define __LATENCYPROBE_H
+
+#include "lathist.h"
+
+/*  延迟探针：在服务器的热点路径上（rehash、过期删除、AOF写入、fork、事务等）以微秒为单位计时，
+    每个探针的耗时记录在一个对数分桶的直方图中（见lathist.c），通过LATENCY HISTOGRAM命令查看。
+    所有探针都是预先定义好的，记录时直接按编号访问，不需要查找，开销只有两次ustime()调用和一次直方图更新，
+    可以在生产环境一直开启（latency-histograms配置项，默认开启）。
+    超过latency-monitor-threshold的样本同时也会交给延迟监视器，出现在LATENCY LATEST和LATENCY HISTORY中。 */
+
+#define LATENCY_PROBE_DICT_REHASH 0     /* Background rehash of the DBs. */
+#define LATENCY_PROBE_EXPIRE_DEL 1      /* Lazy deletion of an expired key. */
+#define LATENCY_PROBE_EXPIRE_CYCLE 2    /* Active expire cycle. */
+#define LATENCY_PROBE_AOF_WRITE 3       /* write(2) of the AOF buffer. */
+#define LATENCY_PROBE_AOF_FSYNC 4       /* fsync with appendfsync always. */
+#define LATENCY_PROBE_FORK 5            /* fork() of BGSAVE / BGREWRITEAOF. */
+#define LATENCY_PROBE_EXEC 6            /* Whole MULTI/EXEC transaction. */
+#define LATENCY_PROBE_COMMAND 7         /* Every command, fed by call(). */
+#define LATENCY_PROBE_NUM 8
+
+/* Start and stop timing a probe, 'var' is a long long. Nothing is timed when
+ * latency-histograms is off. */
+/* 开始和结束一次探针计时，var为long long类型的变量。关闭latency-histograms时不计时 */
+#define latencyProbeStart(var) do { \
+    (var) = server.latency_histograms ? ustime() : 0; \
+} while(0)
+#define latencyProbeEnd(probe,var) do { \
+    if (var) latencyProbeAdd((probe),ustime()-(var)); \
+} while(0)
+
+/* Record a duration already measured by the caller. */
+/* 记录一个调用者已经测量好的耗时 */
+#define latencyProbeAddIfNeeded(probe,us) do { \
+    if (server.latency_histograms) latencyProbeAdd((probe),(us)); \
+} while(0)
+
+/* 记录探针probe的一次耗时，单位为微秒 */
+void latencyProbeAdd(int probe, long long us);
+/* 初始化探针，在initServer中调用 */
+void latencyProbeInit(void);
+/* 清空名为name的探针的直方图，name为NULL时清空所有探针，返回清空的直方图个数 */
+int latencyProbeReset(char *name);
+
+#endif
@@ -0,0 +1,161 @@
+/* Log-bucketed latency histograms, see lathist.h.
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "lathist.h"
+
+/* A value below LH_SUB_BUCKETS has its own bucket. A larger value with its
+ * most significant bit at position 'msb' falls in the power of two range
+ * number msb-LH_SUB_BUCKET_BITS+1, and in the sub bucket given by the
+ * LH_SUB_BUCKET_BITS bits following the most significant one, so a bucket
+ * is never wider than 1/LH_SUB_BUCKETS of the values it contains.
+ *
+ * 小于LH_SUB_BUCKETS的值各自占用一个桶。更大的值如果最高位为msb，则落在第msb-LH_SUB_BUCKET_BITS+1个2的幂区间中，
+ * 子桶由最高位之后的LH_SUB_BUCKET_BITS位决定，因此每个桶的宽度不会超过其中的值的1/LH_SUB_BUCKETS。 */
+int lhBucketOf(long long value) {
+    int msb;
+
+    if (value < LH_SUB_BUCKETS) return value < 0 ? 0 : (int)value;
+    if (value > LH_MAX_VALUE) value = LH_MAX_VALUE;
+    msb = 63-__builtin_clzll((unsigned long long)value);
+    return (msb-LH_SUB_BUCKET_BITS+1)*LH_SUB_BUCKETS +
+           (int)((value >> (msb-LH_SUB_BUCKET_BITS)) & (LH_SUB_BUCKETS-1));
+}
+
+long long lhBucketLow(int b) {
+    int range = b/LH_SUB_BUCKETS, sub = b%LH_SUB_BUCKETS;
+
+    if (range == 0) return b;
+    return (long long)(LH_SUB_BUCKETS+sub) << (range-1);
+}
+
+long long lhBucketHigh(int b) {
+    int range = b/LH_SUB_BUCKETS, sub = b%LH_SUB_BUCKETS;
+
+    if (range == 0) return b;
+    return ((long long)(LH_SUB_BUCKETS+sub+1) << (range-1)) - 1;
+}
+
+void lhReset(latencyHistogram *h) {
+    memset(h,0,sizeof(*h));
+}
+
+void lhRecord(latencyHistogram *h, long long value) {
+    if (value < 0) value = 0;
+    if (h->count == 0 || (uint64_t)value < h->min) h->min = value;
+    if ((uint64_t)value > h->max) h->max = value;
+    h->count++;
+    h->sum += value;
+    h->buckets[lhBucketOf(value)]++;
+}
+
+long long lhPercentile(latencyHistogram *h, double p) {
+    uint64_t target, seen = 0;
+    int b;
+
+    if (h->count == 0) return 0;
+    if (p >= 100) return h->max;
+    target = (uint64_t)ceil(p/100*h->count);
+    if (target == 0) target = 1;
+    for (b = 0; b < LH_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen >= target) {
+            long long high = lhBucketHigh(b);
+
+            if (high < (long long)h->min) high = h->min;
+            return ((uint64_t)high > h->max) ? (long long)h->max : high;
+        }
+    }
+    return h->max;
+}
+
+#ifdef LATHIST_TEST_MAIN
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <sys/time.h>
+
+static long long usec(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv,NULL);
+    return ((long long)tv.tv_sec)*1000000+tv.tv_usec;
+}
+
+static int cmpll(const void *a, const void *b) {
+    long long x = *(long long*)a, y = *(long long*)b;
+    return x < y ? -1 : x > y;
+}
+
+int main(void) {
+    static latencyHistogram h;
+    static long long values[100000];
+    long long v, start;
+    int b, j, n = sizeof(values)/sizeof(values[0]);
+    double ps[] = {50, 90, 99, 99.9};
+
+    /* Buckets are contiguous and every value falls in its own bucket. */
+    for (b = 0; b < LH_BUCKETS-1; b++)
+        assert(lhBucketHigh(b)+1 == lhBucketLow(b+1));
+    assert(lhBucketHigh(LH_BUCKETS-1) == LH_MAX_VALUE);
+    for (v = 0; v < 1000000; v++) {
+        b = lhBucketOf(v);
+        assert(lhBucketLow(b) <= v && v <= lhBucketHigh(b));
+        assert(lhBucketHigh(b)-lhBucketLow(b) <= lhBucketLow(b)/LH_SUB_BUCKETS);
+    }
+    assert(lhBucketOf(-5) == 0 && lhBucketOf(1LL<<50) == LH_BUCKETS-1);
+
+    /* Percentiles are within one bucket of the exact ones. */
+    lhReset(&h);
+    srand(1);
+    for (j = 0; j < n; j++) {
+        /* Log-normal-ish: mostly small, with a long tail. */
+        values[j] = (long long)exp((rand()%1400)/100.0);
+        lhRecord(&h,values[j]);
+    }
+    qsort(values,n,sizeof(long long),cmpll);
+    for (j = 0; j < 4; j++) {
+        long long exact = values[(int)ceil(ps[j]/100*n)-1];
+        long long got = lhPercentile(&h,ps[j]);
+
+        printf("p%g exact %lld histogram %lld\n", ps[j], exact, got);
+        assert(got >= exact && got <= exact+exact/LH_SUB_BUCKETS);
+    }
+    assert(lhPercentile(&h,100) == values[n-1]);
+    assert(h.min == (uint64_t)values[0] && h.count == (uint64_t)n);
+
+    start = usec();
+    for (j = 0; j < 100000000; j++) lhRecord(&h,j&0xfffff);
+    printf("%.2f ns per lhRecord()\n", (usec()-start)*1000.0/100000000);
+    return 0;
+}
+#endif
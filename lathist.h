@@ -0,0 +1,72 @@
+/* lathist.h - Log-bucketed latency histograms.
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __LATHIST_H
+#define __LATHIST_H
+
+#include <stdint.h>
+
+/*  latencyHistogram以对数分桶的方式（与HdrHistogram相同的思路）记录耗时的分布，单位为微秒。
+    每个2的幂区间被等分为LH_SUB_BUCKETS个子桶，所以任意取值的相对误差不超过1/LH_SUB_BUCKETS，
+    而且记录一个值只需要几次位运算和一次数组自增，不需要分配内存。
+    小于LH_SUB_BUCKETS的值各自占用一个桶，超过LH_MAX_VALUE的值记录在最后一个桶中。 */
+
+// 每个2的幂区间的子桶个数的对数
+#define LH_SUB_BUCKET_BITS 3
+#define LH_SUB_BUCKETS (1<<LH_SUB_BUCKET_BITS)
+// 能够精确分桶的最大值的位数，2^36微秒约为19个小时
+#define LH_MAX_BITS 36
+#define LH_MAX_VALUE ((1LL<<LH_MAX_BITS)-1)
+#define LH_BUCKETS ((LH_MAX_BITS-LH_SUB_BUCKET_BITS+1)*LH_SUB_BUCKETS)
+
+typedef struct latencyHistogram {
+    // 记录的值的个数
+    uint64_t count;
+    // 所有值的和，用于计算平均值
+    uint64_t sum;
+    // 记录过的最小值和最大值
+    uint64_t min, max;
+    // 每个桶中的值的个数
+    uint64_t buckets[LH_BUCKETS];
+} latencyHistogram;
+
+/* 清空直方图 */
+void lhReset(latencyHistogram *h);
+/* 记录一个值，负数按0处理 */
+void lhRecord(latencyHistogram *h, long long value);
+/* 返回值value所在的桶 */
+int lhBucketOf(long long value);
+/* 返回桶b所包含的最小值和最大值 */
+long long lhBucketLow(int b);
+long long lhBucketHigh(int b);
+/* 返回百分位数p（0~100）对应的值，即所在桶的最大值（不超过记录过的最大值），直方图为空时返回0 */
+long long lhPercentile(latencyHistogram *h, double p);
+
+#endif
@@ -0,0 +1,326 @@
+/* lazyfree.c - Reclaim large values and whole databases in background.
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "redis.h"
+
+#include <pthread.h>
+
+/* Freeing a value made of millions of elements takes hundreds of
+ * milliseconds, during which the event loop is blocked. The functions in
+ * this file detach such values (or whole databases) from the keyspace in
+ * O(1), and hand them to a background thread that releases the memory.
+ *
+ * Only objects that are not referenced elsewhere can be freed in another
+ * thread, since reference counts are not atomic. This is not only about
+ * the value itself: its elements may still be referenced by the main
+ * thread, for instance by the argv of a slowlog entry, or by a client
+ * reply list after SMEMBERS. So the thread first checks that the value and
+ * every element robj it holds only have the references of the value itself
+ * (1, or 2 for sorted set elements that are both in the dict and in the
+ * skiplist). A detached value can't gain new references, so the check
+ * can't be invalidated later. Values failing the check are handed back to
+ * the main thread, that frees them in lazyfreeReclaimDeferred(). Shared
+ * objects use REDIS_SHARED_REFCOUNT, which is never modified, so they
+ * don't make a value fail the check.
+ *
+ * 由上百万个元素组成的值释放起来需要几百毫秒，这期间事件循环被阻塞。本文件中的函数以O(1)的代价
+ * 将这样的值（或者整个数据库）从键空间中摘下，交给后台线程去释放内存。
+ * 引用计数不是原子操作，因此只有没有被其它地方引用的对象才能在其它线程中释放。这不只是值本身的问题：
+ * 值的元素仍然可能被主线程引用，例如慢查询日志中保存的argv，或者执行SMEMBERS之后客户端的回复链表。
+ * 因此后台线程会先检查值本身以及它所包含的每个元素对象的引用计数都只来自该值本身（为1，有序集合的元素
+ * 同时被字典和跳跃表引用，为2）。已经摘下的值不会再获得新的引用，所以检查的结果之后不会失效。
+ * 检查不通过的值交还给主线程，由lazyfreeReclaimDeferred释放。共享对象的引用计数为REDIS_SHARED_REFCOUNT，
+ * 永远不会被修改，因此不会导致检查失败。 */
+
+/* Values whose free effort (see objectFreeEffort()) is not above this
+ * threshold are freed inline: handing them to the thread would cost more
+ * than freeing them. */
+/* 释放代价不超过该阈值的值直接同步释放：交给后台线程的开销比直接释放还要大 */
+#define LAZYFREE_THRESHOLD 64
+
+/* 后台释放任务的类型 */
+#define LAZYFREE_JOB_OBJECT 0   /* 释放一个对象 */
+#define LAZYFREE_JOB_DB 1       /* 释放一个数据库的dict和expires */
+#define LAZYFREE_JOB_SKIPLIST 2 /* 释放一个数据库的前缀索引 */
+
+typedef struct lazyfreeJob {
+    int type;
+    // LAZYFREE_JOB_OBJECT时为待释放的对象，LAZYFREE_JOB_DB时ptr为键空间，ptr2为过期字典，
+    // LAZYFREE_JOB_SKIPLIST时为待释放的跳跃表
+    void *ptr, *ptr2;
+    struct lazyfreeJob *next;
+} lazyfreeJob;
+
+static struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int initialized;
+    // 待处理任务组成的单向链表，新任务追加到尾部
+    lazyfreeJob *head, *tail;
+    // 后台线程交还给主线程释放的对象（LAZYFREE_JOB_OBJECT类型的任务）组成的单向链表
+    lazyfreeJob *deferred;
+} lazyfree;
+
+/* Number of objects (or keys of a database) not yet reclaimed. */
+/* 仍在等待后台线程释放的对象个数（释放整个数据库时为键的个数） */
+static size_t lazyfree_pending_objects = 0;
+
+/* Number of objects in lazyfree.deferred. */
+/* lazyfree.deferred中的对象个数 */
+static size_t lazyfree_deferred_objects = 0;
+
+/* Return 1 if the only references to 'o' are the 'owned' ones held by the
+ * value being freed. */
+/* 如果对象o的引用全部来自正在释放的值（共owned个），返回1 */
+static int lazyfreeRefsOwned(robj *o, int owned) {
+    int refcount = __atomic_load_n(&o->refcount,__ATOMIC_ACQUIRE);
+
+    return refcount == owned || refcount == REDIS_SHARED_REFCOUNT;
+}
+
+/* Return 1 if the detached value 'o' and the element objects it holds are
+ * referenced by nothing else, so that the thread can free them. Called by
+ * the thread. */
+/* 如果已经摘下的值o以及它包含的元素对象没有被其它地方引用，返回1，此时后台线程可以释放它。由后台线程调用 */
+static int lazyfreeObjectIsPrivate(robj *o) {
+    if (!lazyfreeRefsOwned(o,1)) return 0;
+
+    if ((o->type == REDIS_SET || o->type == REDIS_HASH) &&
+        o->encoding == REDIS_ENCODING_HT)
+    {
+        dictIterator *di = dictGetIterator(o->ptr);
+        dictEntry *de;
+        int private = 1;
+
+        while(private && (de = dictNext(di)) != NULL) {
+            if (!lazyfreeRefsOwned(dictGetKey(de),1) ||
+                (o->type == REDIS_HASH && !lazyfreeRefsOwned(dictGetVal(de),1)))
+                private = 0;
+        }
+        dictReleaseIterator(di);
+        return private;
+    } else if (o->type == REDIS_ZSET && o->encoding == REDIS_ENCODING_SKIPLIST) {
+        zskiplistNode *x = ((zset*)o->ptr)->zsl->header->level[0].forward;
+
+        // 元素同时被字典和跳跃表引用
+        for (; x; x = x->level[0].forward)
+            if (!lazyfreeRefsOwned(x->obj,2)) return 0;
+    }
+    return 1;
+}
+
+/* Hand the object 'o' back to the main thread. Called by the thread. */
+/* 将对象o交还给主线程释放，由后台线程调用 */
+static void lazyfreeDefer(lazyfreeJob *job, robj *o) {
+    job->type = LAZYFREE_JOB_OBJECT;
+    job->ptr = o;
+    __sync_add_and_fetch(&lazyfree_deferred_objects,1);
+    pthread_mutex_lock(&lazyfree.lock);
+    job->next = lazyfree.deferred;
+    lazyfree.deferred = job;
+    pthread_mutex_unlock(&lazyfree.lock);
+}
+
+/* The background thread: pop the jobs in order and free them. */
+/* 后台线程：依次取出任务并释放 */
+static void *lazyfreeThread(void *arg) {
+    REDIS_NOTUSED(arg);
+
+    pthread_mutex_lock(&lazyfree.lock);
+    while(1) {
+        lazyfreeJob *job;
+        size_t count;
+
+        while (lazyfree.head == NULL)
+            pthread_cond_wait(&lazyfree.cond,&lazyfree.lock);
+        job = lazyfree.head;
+        lazyfree.head = job->next;
+        if (lazyfree.head == NULL) lazyfree.tail = NULL;
+        pthread_mutex_unlock(&lazyfree.lock);
+
+        if (job->type == LAZYFREE_JOB_OBJECT) {
+            // 仍然被其它地方引用，将任务移到交还给主线程的链表中
+            if (!lazyfreeObjectIsPrivate(job->ptr)) {
+                lazyfreeDefer(job,job->ptr);
+                pthread_mutex_lock(&lazyfree.lock);
+                continue;
+            }
+            decrRefCount(job->ptr);
+            count = 1;
+        } else if (job->type == LAZYFREE_JOB_SKIPLIST) {
+            count = ((zskiplist*)job->ptr)->length;
+            zslFree(job->ptr);
+        } else {
+            dictIterator *di = dictGetIterator(job->ptr);
+            dictEntry *de;
+
+            count = dictSize((dict*)job->ptr);
+            /* Values still referenced elsewhere are detached from their
+             * entry (the value destructor ignores NULL) and handed back. */
+            // 仍然被其它地方引用的值从字典节点上摘下（值的析构函数会忽略NULL），交还给主线程
+            while((de = dictNext(di)) != NULL) {
+                robj *val = dictGetVal(de);
+
+                if (val == NULL || objectIsPacked(val) ||
+                    lazyfreeObjectIsPrivate(val)) continue;
+                lazyfreeDefer(zmalloc(sizeof(lazyfreeJob)),val);
+                dictSetVal((dict*)job->ptr,de,NULL);
+                count--;
+            }
+            dictReleaseIterator(di);
+            /* The expires dict shares the keys with the main dict: release
+             * it first, it doesn't free anything but its own table. */
+            // 过期字典和键空间共享key，因此先释放它，它只释放自己的哈希表
+            dictRelease(job->ptr2);
+            dictRelease(job->ptr);
+        }
+        zfree(job);
+        __sync_sub_and_fetch(&lazyfree_pending_objects,count);
+
+        pthread_mutex_lock(&lazyfree.lock);
+    }
+    return NULL;
+}
+
+/* Queue a job, starting the thread the first time. */
+/* 添加一个后台释放任务，第一次调用时启动后台线程 */
+static void lazyfreeCreateJob(int type, void *ptr, void *ptr2, size_t count) {
+    lazyfreeJob *job = zmalloc(sizeof(*job));
+
+    if (!lazyfree.initialized) {
+        pthread_mutex_init(&lazyfree.lock,NULL);
+        pthread_cond_init(&lazyfree.cond,NULL);
+        if (pthread_create(&lazyfree.thread,NULL,lazyfreeThread,NULL) != 0) {
+            redisLog(REDIS_WARNING,"Fatal: Can't initialize the lazy free thread.");
+            exit(1);
+        }
+        lazyfree.initialized = 1;
+    }
+    job->type = type;
+    job->ptr = ptr;
+    job->ptr2 = ptr2;
+    job->next = NULL;
+    __sync_add_and_fetch(&lazyfree_pending_objects,count);
+
+    pthread_mutex_lock(&lazyfree.lock);
+    if (lazyfree.tail)
+        lazyfree.tail->next = job;
+    else
+        lazyfree.head = job;
+    lazyfree.tail = job;
+    pthread_cond_signal(&lazyfree.cond);
+    pthread_mutex_unlock(&lazyfree.lock);
+}
+
+/* Return the number of objects waiting to be reclaimed. */
+/* 返回仍在等待后台释放的对象个数 */
+size_t lazyfreeGetPendingObjectsCount(void) {
+    return __sync_add_and_fetch(&lazyfree_pending_objects,0);
+}
+
+/* Free the objects the thread handed back because they were still
+ * referenced elsewhere. Called by serverCron(), and every time a new
+ * object is freed asynchronously. */
+/* 释放后台线程因为仍然被其它地方引用而交还的对象。由serverCron调用，每次异步释放对象时也会调用 */
+void lazyfreeReclaimDeferred(void) {
+    lazyfreeJob *job, *next;
+
+    if (__sync_add_and_fetch(&lazyfree_deferred_objects,0) == 0) return;
+    pthread_mutex_lock(&lazyfree.lock);
+    job = lazyfree.deferred;
+    lazyfree.deferred = NULL;
+    pthread_mutex_unlock(&lazyfree.lock);
+
+    for (; job; job = next) {
+        next = job->next;
+        decrRefCount(job->ptr);
+        zfree(job);
+        __sync_sub_and_fetch(&lazyfree_deferred_objects,1);
+        __sync_sub_and_fetch(&lazyfree_pending_objects,1);
+    }
+}
+
+/* Release the reference to 'o' the caller owns. When this is the last
+ * reference and the object is big, it is freed by the background thread. */
+/* 释放调用者持有的对象o的引用。如果这是最后一个引用并且对象较大，则交给后台线程释放 */
+void freeObjAsync(robj *o) {
+    lazyfreeReclaimDeferred();
+    if (o->refcount == 1 && objectFreeEffort(o) > LAZYFREE_THRESHOLD)
+        lazyfreeCreateJob(LAZYFREE_JOB_OBJECT,o,NULL,1);
+    else
+        decrRefCount(o);
+}
+
+/* Delete a key, value, and associated expiration entry if any, from the DB.
+ * The key is removed from the keyspace immediately, the value may be
+ * reclaimed later by the background thread. */
+/*  从数据库中删除一个给定的key、相应的值value以及该key的过期时间。
+    key立即从键空间中删除，而值可能稍后由后台线程释放。如果操作成功返回1，否则返回0。 */
+int dbAsyncDelete(redisDb *db, robj *key) {
+    dictEntry *de;
+
+    // 删除key的过期时间，过期字典与键空间共享key，这里不会释放key
+    if (dictSize(db->expires) > 0) dictDelete(db->expires,key->ptr);
+
+    if ((de = dictFind(db->dict,key->ptr)) == NULL) return 0;
+    dbLookupCacheReset();
+
+    /* Detach the value from the entry: dictDelete() below won't free it
+     * (the value destructor ignores NULL). */
+    // 将值从字典节点上摘下，这样下面的dictDelete不会释放它（值的析构函数会忽略NULL）
+    // 打包的值没有单独分配内存，不需要释放
+    if (!objectIsPacked(dictGetVal(de))) freeObjAsync(dictGetVal(de));
+    dictSetVal(db->dict,de,NULL);
+    dictDelete(db->dict,key->ptr);
+    scanIndexDelete(db,key);
+    return 1;
+}
+
+/* Empty the DB in O(1): the dictionaries are replaced with new empty ones,
+ * and the old ones are released by the background thread. Returns the
+ * number of keys removed. */
+/*  以O(1)的代价清空数据库db：用新的空字典替换键空间和过期字典，旧的字典由后台线程释放。返回被删除key的数量。 */
+long long emptyDbAsync(redisDb *db) {
+    dict *oldht = db->dict, *oldexp = db->expires;
+    zskiplist *oldindex = scanIndexDetach(db);
+    long long removed = dictSize(oldht);
+
+    lazyfreeReclaimDeferred();
+    dbLookupCacheReset();
+    db->dict = dictCreate(&dbDictType,NULL);
+    db->expires = dictCreate(&keyptrDictType,NULL);
+    /* Even a few keys may hold huge values: always use the thread. */
+    // 即使key的数量很少，它们的值也可能很大，所以总是交给后台线程
+    lazyfreeCreateJob(LAZYFREE_JOB_DB,oldht,oldexp,removed);
+    if (oldindex)
+        lazyfreeCreateJob(LAZYFREE_JOB_SKIPLIST,oldindex,NULL,oldindex->length);
+    return removed;
+}
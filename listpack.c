@@ -0,0 +1,972 @@
+/* listpack.c - A cascade-update-free list of strings and integers
+ *
+ * The listpack stores strings and integers in a single block of memory,
+ * exactly like the ziplist, and is meant to replace it wherever a small
+ * list, hash or sorted set is encoded compactly.
+ *
+ * The difference is in the entry header. A ziplist entry starts with the
+ * length of the *previous* entry, stored in 1 or 5 bytes: when an insert
+ * changes the length of an entry from less than 254 bytes to 254 or more,
+ * the next entry has to grow its prevlen field from 1 to 5 bytes, which can
+ * make it cross the same threshold, and so forth, rewriting the whole list
+ * (see __ziplistCascadeUpdate). A listpack entry only describes itself: its
+ * encoding and length come first, and the same length is repeated at the
+ * end of the entry so that the list can be traversed backward. Inserting or
+ * deleting an entry never touches its neighbours.
+ *
+ *  listpack与ziplist一样使用一整块连续内存保存字符串和整数，用来替代小list、小hash以及小有序集合所使用的ziplist。
+ *
+ *  两者的区别在于节点头部。ziplist的节点头部记录的是前一个节点的长度，占用1个或5个字节：
+ *  当插入操作使某个节点的长度从小于254字节变为不小于254字节时，后一个节点的prevlen字段就要从1个字节扩展为5个字节，
+ *  而这又可能使后一个节点跨过同样的阈值，如此反复，最坏情况下要重写整个ziplist（见__ziplistCascadeUpdate）。
+ *  listpack的节点只描述自身：开头是编码方式和长度，节点的末尾再保存一次整个节点（不含末尾这部分）的长度，
+ *  以便从后往前遍历。所以插入或删除节点永远不会影响相邻的节点。
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * LISTPACK OVERALL LAYOUT:
+ * <lpbytes><lplen><entry><entry>...<entry><lpend>
+ *
+ * <lpbytes> is a 4 bytes unsigned integer holding the total size of the
+ * listpack. <lplen> is a 2 bytes unsigned integer holding the number of
+ * entries, or 65535 when the number is too big to be stored, in which case
+ * the list has to be traversed to count the entries. <lpend> is a single
+ * byte equal to 255. All the integers are stored in little endian order.
+ *
+ *  lpbytes是一个4字节无符号整型，保存整个listpack占用的字节数。
+ *  lplen是一个2字节无符号整型，保存节点的个数，超过65534时值为65535，这时需要遍历整个listpack才能知道节点个数。
+ *  lpend是结尾符，占用1个字节，值为255。所有整数都以小端模式存储。
+ *
+ * LISTPACK ENTRIES:
+ * <encoding-and-length><data><backlen>
+ *
+ * The first byte of the entry tells the encoding:
+ *  节点的第一个字节表示编码方式：
+ *
+ * |0xxxxxxx| - 1 byte
+ *      7 bit unsigned integer, no data follows.
+ *      7位无符号整数，没有数据部分
+ * |10xxxxxx| - 1 byte
+ *      String of up to 63 bytes, the length is in the 6 lower bits.
+ *      长度不超过63字节的字符串，后6位保存字符串长度
+ * |110xxxxx|yyyyyyyy| - 2 bytes
+ *      13 bit signed integer, no data follows.
+ *      13位有符号整数，没有数据部分
+ * |1110xxxx|yyyyyyyy| - 2 bytes
+ *      String of up to 4095 bytes, the length is in the remaining 12 bits.
+ *      长度不超过4095字节的字符串，剩下的12位保存字符串长度
+ * |11110000|aaaaaaaa|bbbbbbbb|cccccccc|dddddddd| - 5 bytes
+ *      String of any length, the length is in the next 4 bytes.
+ *      任意长度的字符串，接下来的4个字节保存字符串长度
+ * |11110001| |11110010| |11110011| |11110100| - 1 byte
+ *      16, 24, 32 and 64 bit signed integer, stored in the next 2, 3, 4
+ *      or 8 bytes.
+ *      16、24、32和64位有符号整数，保存在接下来的2、3、4、8个字节中
+ * |11111111| - End of listpack.
+ *
+ * <backlen> is the size of <encoding-and-length><data>, stored in 1 to 5
+ * bytes to be read from right to left: every byte holds 7 bits of the value,
+ * and the high bit of a byte is set when more bytes follow on its left.
+ *
+ *  backlen保存的是encoding-and-length和data两部分的总长度，占用1~5个字节，需要从右往左读取：
+ *  每个字节保存7位数值，最高位为1表示左边还有更多的字节。
+ *
+ * Copyright (c) 2009-2012, Pieter Noordhuis <pcnoordhuis at gmail dot com>
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include "zmalloc.h"
+#include "util.h"
+#include "listpack.h"
+#include "ziplist.h"
+#include "redisassert.h"
+
+// 头部大小：4字节的lpbytes加上2字节的lplen
+#define LP_HDR_SIZE 6
+// 节点个数未知
+#define LP_HDR_NUMELE_UNKNOWN UINT16_MAX
+// 结尾符
+#define LP_EOF 0xFF
+
+/* Encodings. */
+/* 编码方式 */
+#define LP_ENCODING_7BIT_UINT 0x00
+#define LP_ENCODING_7BIT_UINT_MASK 0x80
+#define LP_ENCODING_6BIT_STR 0x80
+#define LP_ENCODING_6BIT_STR_MASK 0xC0
+#define LP_ENCODING_13BIT_INT 0xC0
+#define LP_ENCODING_13BIT_INT_MASK 0xE0
+#define LP_ENCODING_12BIT_STR 0xE0
+#define LP_ENCODING_12BIT_STR_MASK 0xF0
+#define LP_ENCODING_32BIT_STR 0xF0
+#define LP_ENCODING_16BIT_INT 0xF1
+#define LP_ENCODING_24BIT_INT 0xF2
+#define LP_ENCODING_32BIT_INT 0xF3
+#define LP_ENCODING_64BIT_INT 0xF4
+
+#define LP_ENCODING_IS_7BIT_UINT(b) (((b) & LP_ENCODING_7BIT_UINT_MASK) == LP_ENCODING_7BIT_UINT)
+#define LP_ENCODING_IS_6BIT_STR(b) (((b) & LP_ENCODING_6BIT_STR_MASK) == LP_ENCODING_6BIT_STR)
+#define LP_ENCODING_IS_13BIT_INT(b) (((b) & LP_ENCODING_13BIT_INT_MASK) == LP_ENCODING_13BIT_INT)
+#define LP_ENCODING_IS_12BIT_STR(b) (((b) & LP_ENCODING_12BIT_STR_MASK) == LP_ENCODING_12BIT_STR)
+
+/* Integer encodings need at most 9 bytes, string headers at most 5. */
+/* 整数编码最多占用9个字节，字符串的头部最多占用5个字节 */
+#define LP_MAX_INT_ENCODING_LEN 9
+#define LP_MAX_BACKLEN_SIZE 5
+
+/* Little endian accessors for the header fields. */
+/* 以小端模式读写头部字段 */
+#define lpGetTotalBytes(p) \
+    ((uint32_t)(p)[0] | ((uint32_t)(p)[1] << 8) | \
+     ((uint32_t)(p)[2] << 16) | ((uint32_t)(p)[3] << 24))
+#define lpGetNumElements(p) ((uint32_t)(p)[4] | ((uint32_t)(p)[5] << 8))
+#define lpSetTotalBytes(p,v) do { \
+    (p)[0] = (v) & 0xff; \
+    (p)[1] = ((v) >> 8) & 0xff; \
+    (p)[2] = ((v) >> 16) & 0xff; \
+    (p)[3] = ((v) >> 24) & 0xff; \
+} while(0)
+#define lpSetNumElements(p,v) do { \
+    (p)[4] = (v) & 0xff; \
+    (p)[5] = ((v) >> 8) & 0xff; \
+} while(0)
+
+/* 获取第一个节点（可能是结尾符） */
+#define lpFirstEntry(lp) ((lp)+LP_HDR_SIZE)
+/* 获取结尾符 */
+#define lpEndEntry(lp) ((lp)+lpGetTotalBytes(lp)-1)
+
+/* Add 'incr' to the number of elements, unless it is already unknown. */
+/* 更新节点个数，节点个数已经未知时不做任何操作 */
+static void lpIncrNumElements(unsigned char *lp, int incr) {
+    uint32_t num = lpGetNumElements(lp);
+    if (num == LP_HDR_NUMELE_UNKNOWN) return;
+    num += incr;
+    if (num > LP_HDR_NUMELE_UNKNOWN) num = LP_HDR_NUMELE_UNKNOWN;
+    lpSetNumElements(lp,num);
+}
+
+/* Check if the string can be stored as an integer and return its value.
+ * Exactly like the ziplist, strings are encoded as integers only if they
+ * convert back to the very same string. */
+/* 判断字符串s能否编码为整数，规则与ziplist相同：只有转换回字符串后与原字符串完全相同时才编码为整数 */
+static int lpStringToInt64(unsigned char *s, unsigned int slen, long long *v) {
+    if (slen >= 32 || slen == 0) return 0;
+    return string2ll((char*)s,slen,v);
+}
+
+/* Write the encoding of integer 'v' at 'buf' (if not NULL) and return
+ * its length. */
+/* 将整数v的编码写入buf（buf不为NULL时），返回编码的长度 */
+static unsigned int lpEncodeInteger(unsigned char *buf, long long v) {
+    uint64_t uv;
+    unsigned int len, j;
+
+    if (v >= 0 && v <= 127) {
+        if (buf) buf[0] = v;
+        return 1;
+    } else if (v >= -4096 && v <= 4095) {
+        // 13位有符号整数，负数以补码形式保存
+        uv = v < 0 ? ((uint64_t)1<<13)+v : (uint64_t)v;
+        if (buf) {
+            buf[0] = LP_ENCODING_13BIT_INT | (uv >> 8);
+            buf[1] = uv & 0xff;
+        }
+        return 2;
+    }
+
+    uv = (uint64_t)v;
+    if (v >= INT16_MIN && v <= INT16_MAX) {
+        if (buf) buf[0] = LP_ENCODING_16BIT_INT;
+        len = 2;
+    } else if (v >= -8388608 && v <= 8388607) {
+        if (buf) buf[0] = LP_ENCODING_24BIT_INT;
+        len = 3;
+    } else if (v >= INT32_MIN && v <= INT32_MAX) {
+        if (buf) buf[0] = LP_ENCODING_32BIT_INT;
+        len = 4;
+    } else {
+        if (buf) buf[0] = LP_ENCODING_64BIT_INT;
+        len = 8;
+    }
+    if (buf) {
+        for (j = 0; j < len; j++) buf[1+j] = (uv >> (8*j)) & 0xff;
+    }
+    return len+1;
+}
+
+/* Write the header of a string of length 'len' at 'buf' (if not NULL) and
+ * return the header length. */
+/* 将长度为len的字符串的头部写入buf（buf不为NULL时），返回头部的长度 */
+static unsigned int lpEncodeStringHeader(unsigned char *buf, uint32_t len) {
+    if (len < 64) {
+        if (buf) buf[0] = LP_ENCODING_6BIT_STR | len;
+        return 1;
+    } else if (len < 4096) {
+        if (buf) {
+            buf[0] = LP_ENCODING_12BIT_STR | (len >> 8);
+            buf[1] = len & 0xff;
+        }
+        return 2;
+    } else {
+        if (buf) {
+            buf[0] = LP_ENCODING_32BIT_STR;
+            buf[1] = len & 0xff;
+            buf[2] = (len >> 8) & 0xff;
+            buf[3] = (len >> 16) & 0xff;
+            buf[4] = (len >> 24) & 0xff;
+        }
+        return 5;
+    }
+}
+
+/* Return the number of bytes needed to store 'l' as backlen. */
+/* 返回保存backlen所需的字节数 */
+static unsigned int lpBacklenSize(uint64_t l) {
+    if (l < (1<<7)) return 1;
+    else if (l < (1<<14)) return 2;
+    else if (l < (1<<21)) return 3;
+    else if (l < (1<<28)) return 4;
+    else return 5;
+}
+
+/* Write 'l' as backlen at 'buf', using 'size' bytes. The rightmost byte
+ * holds the 7 lower bits, every byte but the leftmost one has the high bit
+ * set to tell that the value goes on at its left. */
+/* 将l作为backlen写入buf，占用size个字节。最右边的字节保存最低的7位，除了最左边的字节外，其他字节的最高位都为1 */
+static void lpEncodeBacklen(unsigned char *buf, uint64_t l, unsigned int size) {
+    unsigned int j;
+
+    for (j = size; j > 0; j--) {
+        buf[j-1] = (l & 127) | (j == 1 ? 0 : 128);
+        l >>= 7;
+    }
+}
+
+/* Decode the backlen whose last byte is pointed by 'p', storing in 'size'
+ * the number of bytes it uses. */
+/* 解码最后一个字节位于p的backlen，并将其占用的字节数保存在size中 */
+static uint64_t lpDecodeBacklen(unsigned char *p, unsigned int *size) {
+    uint64_t val = 0;
+    unsigned int shift = 0, n = 0;
+
+    do {
+        val |= (uint64_t)(p[0] & 127) << shift;
+        n++;
+        if (!(p[0] & 128)) break;
+        shift += 7;
+        p--;
+    } while (n < LP_MAX_BACKLEN_SIZE);
+    if (size) *size = n;
+    return val;
+}
+
+/* Return the size of the encoding-and-length plus data parts of the entry
+ * at 'p', that is, everything but the backlen. The result is 64 bit since a
+ * corrupted 32 bit string header may claim up to 5+(2^32-1) bytes. */
+/*  返回p指向的节点中encoding-and-length和data两部分的总长度，即除backlen外的部分。
+    返回值是64位的，因为损坏的32位字符串头部声明的长度最大可达5+(2^32-1)个字节 */
+static uint64_t lpCurrentEncodedSize(unsigned char *p) {
+    unsigned char b = p[0];
+
+    if (LP_ENCODING_IS_7BIT_UINT(b)) return 1;
+    if (LP_ENCODING_IS_6BIT_STR(b)) return 1+(b & 0x3f);
+    if (LP_ENCODING_IS_13BIT_INT(b)) return 2;
+    if (LP_ENCODING_IS_12BIT_STR(b)) return 2+(((b & 0x0f) << 8) | p[1]);
+    switch (b) {
+    case LP_ENCODING_16BIT_INT: return 3;
+    case LP_ENCODING_24BIT_INT: return 4;
+    case LP_ENCODING_32BIT_INT: return 5;
+    case LP_ENCODING_64BIT_INT: return 9;
+    case LP_ENCODING_32BIT_STR:
+        return 5+(uint64_t)((uint32_t)p[1] | ((uint32_t)p[2] << 8) |
+                            ((uint32_t)p[3] << 16) | ((uint32_t)p[4] << 24));
+    }
+    assert(NULL);
+    return 0;
+}
+
+/* Return the pointer to the entry after the one at 'p'. */
+/* 返回p指向的节点的下一个节点（可能是结尾符） */
+static inline unsigned char *lpSkip(unsigned char *p) {
+    uint32_t encsize = lpCurrentEncodedSize(p);
+    return p + encsize + lpBacklenSize(encsize);
+}
+
+/* Decode the entry at 'p'. Strings are returned by reference setting 'sstr'
+ * and 'slen', integers setting 'sstr' to NULL and 'sval' to the value. */
+/* 解码p指向的节点：字符串通过sstr和slen返回，整数则将sstr设置为NULL并把值保存在sval中 */
+static void lpDecode(unsigned char *p, unsigned char **sstr, unsigned int *slen, long long *sval) {
+    unsigned char b = p[0];
+    uint64_t uv;
+    int64_t negstart, negmax;
+    unsigned int bytes = 0, j;
+
+    if (LP_ENCODING_IS_7BIT_UINT(b)) {
+        *sstr = NULL;
+        *sval = b & 0x7f;
+        return;
+    } else if (LP_ENCODING_IS_6BIT_STR(b)) {
+        *sstr = p+1;
+        *slen = b & 0x3f;
+        return;
+    } else if (LP_ENCODING_IS_13BIT_INT(b)) {
+        uv = ((b & 0x1f) << 8) | p[1];
+        negstart = (uint64_t)1<<12;
+        negmax = 8191;
+    } else if (LP_ENCODING_IS_12BIT_STR(b)) {
+        *sstr = p+2;
+        *slen = ((b & 0x0f) << 8) | p[1];
+        return;
+    } else if (b == LP_ENCODING_32BIT_STR) {
+        *sstr = p+5;
+        *slen = (uint32_t)p[1] | ((uint32_t)p[2] << 8) |
+                ((uint32_t)p[3] << 16) | ((uint32_t)p[4] << 24);
+        return;
+    } else {
+        switch (b) {
+        case LP_ENCODING_16BIT_INT: bytes = 2; break;
+        case LP_ENCODING_24BIT_INT: bytes = 3; break;
+        case LP_ENCODING_32BIT_INT: bytes = 4; break;
+        case LP_ENCODING_64BIT_INT: bytes = 8; break;
+        default: assert(NULL);
+        }
+        uv = 0;
+        for (j = 0; j < bytes; j++) uv |= (uint64_t)p[1+j] << (8*j);
+        if (bytes == 8) {
+            *sstr = NULL;
+            *sval = (int64_t)uv;
+            return;
+        }
+        negstart = (uint64_t)1<<(bytes*8-1);
+        negmax = ((uint64_t)1<<(bytes*8))-1;
+    }
+
+    /* Convert the two's complement representation of the value. */
+    // 将补码转换为有符号整数
+    *sstr = NULL;
+    if (uv >= (uint64_t)negstart)
+        *sval = -((int64_t)(negmax-uv))-1;
+    else
+        *sval = uv;
+}
+
+/* Create a new empty listpack. */
+/* 创建一个空的listpack */
+unsigned char *lpNew(void) {
+    unsigned char *lp = zmalloc(LP_HDR_SIZE+1);
+    lpSetTotalBytes(lp,LP_HDR_SIZE+1);
+    lpSetNumElements(lp,0);
+    lp[LP_HDR_SIZE] = LP_EOF;
+    return lp;
+}
+
+/* Free the listpack. */
+/* 释放listpack */
+void lpFree(unsigned char *lp) {
+    zfree(lp);
+}
+
+/* Insert the string 's' (encoded as integer when possible) before the entry
+ * pointed by 'p', that can also point to the terminator to append. Nothing
+ * but the new entry is written: the neighbours stay exactly as they are. */
+/*  在p指向的节点之前插入字符串s（可以的话编码为整数），p也可以指向结尾符，这时相当于追加到尾部。
+    这里只需要写入新节点，相邻节点完全不受影响。 */
+unsigned char *lpInsert(unsigned char *lp, unsigned char *p, unsigned char *s, unsigned int slen) {
+    unsigned char intenc[LP_MAX_INT_ENCODING_LEN];
+    unsigned char backlen[LP_MAX_BACKLEN_SIZE];
+    size_t offset = p-lp, oldbytes = lpGetTotalBytes(lp), newbytes;
+    uint32_t encsize, hdrlen = 0;
+    unsigned int backlensize;
+    long long v;
+    int isint;
+
+    // 计算新节点的编码和长度
+    if ((isint = lpStringToInt64(s,slen,&v))) {
+        encsize = lpEncodeInteger(intenc,v);
+    } else {
+        hdrlen = lpEncodeStringHeader(NULL,slen);
+        encsize = hdrlen+slen;
+    }
+    backlensize = lpBacklenSize(encsize);
+    lpEncodeBacklen(backlen,encsize,backlensize);
+    newbytes = oldbytes+encsize+backlensize;
+    assert(newbytes <= UINT32_MAX);
+
+    // 重新分配空间，把p之后（包括结尾符）的数据整体后移
+    lp = zrealloc(lp,newbytes);
+    p = lp+offset;
+    memmove(p+encsize+backlensize,p,oldbytes-offset);
+
+    // 写入新节点
+    if (isint) {
+        memcpy(p,intenc,encsize);
+    } else {
+        lpEncodeStringHeader(p,slen);
+        memcpy(p+hdrlen,s,slen);
+    }
+    memcpy(p+encsize,backlen,backlensize);
+
+    lpSetTotalBytes(lp,newbytes);
+    lpIncrNumElements(lp,1);
+    return lp;
+}
+
+/* Push a new entry at the head or at the tail of the listpack. */
+/* 往listpack的头部或尾部插入一个节点 */
+unsigned char *lpPush(unsigned char *lp, unsigned char *s, unsigned int slen, int where) {
+    unsigned char *p = (where == LP_HEAD) ? lpFirstEntry(lp) : lpEndEntry(lp);
+    return lpInsert(lp,p,s,slen);
+}
+
+/* Return the entry at 'index', negative indexes counting from the tail
+ * (-1 is the last entry). Returns NULL if the index is out of range. */
+/* 根据索引获取listpack节点，负数表示从尾部开始计算（-1表示最后一个节点），索引越界时返回NULL */
+unsigned char *lpIndex(unsigned char *lp, int index) {
+    unsigned char *p;
+
+    if (index < 0) {
+        index = (-index)-1;
+        p = lpPrev(lp,lpEndEntry(lp));
+        while (p != NULL && index--) p = lpPrev(lp,p);
+    } else {
+        p = lpFirstEntry(lp);
+        while (p[0] != LP_EOF && index--) p = lpSkip(p);
+        if (p[0] == LP_EOF) p = NULL;
+    }
+    return p;
+}
+
+/* Return the entry after 'p', or NULL if 'p' is the last one. */
+/* 获取p节点的下一个节点，p是最后一个节点时返回NULL */
+unsigned char *lpNext(unsigned char *lp, unsigned char *p) {
+    ((void) lp);
+    if (p[0] == LP_EOF) return NULL;
+    p = lpSkip(p);
+    if (p[0] == LP_EOF) return NULL;
+    return p;
+}
+
+/* Return the entry before 'p', or NULL if 'p' is the first one. When 'p'
+ * points to the terminator the last entry is returned. */
+/* 获取p节点的前一个节点，p是第一个节点时返回NULL。如果p指向结尾符，则返回最后一个节点 */
+unsigned char *lpPrev(unsigned char *lp, unsigned char *p) {
+    uint64_t prevlen;
+    unsigned int backlensize;
+
+    if (p == lpFirstEntry(lp)) return NULL;
+    // 前一个节点的backlen紧挨着p
+    prevlen = lpDecodeBacklen(p-1,&backlensize);
+    return p-backlensize-prevlen;
+}
+
+/* Get the value of the entry at 'p', with the same conventions of
+ * ziplistGet(): returns 0 if 'p' is NULL or points to the terminator. */
+/* 获取p指向的节点的值，约定与ziplistGet相同：p为NULL或指向结尾符时返回0 */
+unsigned int lpGet(unsigned char *p, unsigned char **sstr, unsigned int *slen, long long *sval) {
+    if (p == NULL || p[0] == LP_EOF) return 0;
+    lpDecode(p,sstr,slen,sval);
+    return 1;
+}
+
+/* Delete the entry at '*p', that is updated to point to the entry that
+ * took its place (or to the terminator). */
+/* 删除*p指向的节点，完成后*p指向被删除节点的下一个节点（或者结尾符） */
+unsigned char *lpDelete(unsigned char *lp, unsigned char **p) {
+    size_t offset = *p-lp, oldbytes = lpGetTotalBytes(lp);
+    size_t entrysize = lpSkip(*p)-*p;
+
+    memmove(*p,*p+entrysize,oldbytes-offset-entrysize);
+    lp = zrealloc(lp,oldbytes-entrysize);
+    lpSetTotalBytes(lp,oldbytes-entrysize);
+    lpIncrNumElements(lp,-1);
+    *p = lp+offset;
+    return lp;
+}
+
+/* Delete 'num' entries starting at 'index'. */
+/* 从index开始删除num个节点 */
+unsigned char *lpDeleteRange(unsigned char *lp, int index, unsigned int num) {
+    unsigned char *first, *p;
+    size_t removed, oldbytes = lpGetTotalBytes(lp);
+    unsigned int deleted = 0;
+    uint32_t numele = lpGetNumElements(lp);
+
+    if ((first = lpIndex(lp,index)) == NULL || num == 0) return lp;
+    p = first;
+    while (p[0] != LP_EOF && deleted < num) {
+        p = lpSkip(p);
+        deleted++;
+    }
+
+    // 把被删除的节点之后的数据（包括结尾符）整体前移
+    removed = p-first;
+    memmove(first,p,oldbytes-(p-lp));
+    lp = zrealloc(lp,oldbytes-removed);
+    lpSetTotalBytes(lp,oldbytes-removed);
+    if (numele != LP_HDR_NUMELE_UNKNOWN) lpSetNumElements(lp,numele-deleted);
+    return lp;
+}
+
+/* Return 1 if the entry at 'p' is equal to 's', 0 otherwise. Integer
+ * entries are compared by value, so an integer entry matches "10" but not
+ * "010". */
+/* 比较p指向的节点与字符串s是否相等，相等返回1，否则返回0。整数节点按数值比较 */
+unsigned int lpCompare(unsigned char *p, unsigned char *s, unsigned int slen) {
+    unsigned char *vstr;
+    unsigned int vlen;
+    long long vll, sll;
+
+    if (p[0] == LP_EOF) return 0;
+    lpDecode(p,&vstr,&vlen,&vll);
+    if (vstr) return vlen == slen && memcmp(vstr,s,slen) == 0;
+    return lpStringToInt64(s,slen,&sll) && sll == vll;
+}
+
+/* Load 2, 4 or 8 unaligned bytes from 'p', only compared for equality. */
+/* 从p中读取2、4、8个字节（不要求对齐），只用于比较是否相等 */
+static inline uint16_t lpLoad16(const unsigned char *p) { uint16_t v; memcpy(&v,p,2); return v; }
+static inline uint32_t lpLoad32(const unsigned char *p) { uint32_t v; memcpy(&v,p,4); return v; }
+static inline uint64_t lpLoad64(const unsigned char *p) { uint64_t v; memcpy(&v,p,8); return v; }
+
+/* Find the entry equal to 'vstr', starting at 'p' and skipping 'skip'
+ * entries after every comparison. Returns NULL if not found. Strings are
+ * compared a word at a time like in ziplistFind(), and the searched value
+ * is converted to an integer at most once. */
+/*  从p开始查找与vstr相等的节点，每次比较之后跳过skip个节点，找不到时返回NULL。
+    与ziplistFind一样，字符串以字为单位比较，被查找的值最多只转换一次整数。 */
+unsigned char *lpFind(unsigned char *p, unsigned char *vstr, unsigned int vlen, unsigned int skip) {
+    unsigned int skipcnt = 0, tailpos = 0;
+    int vencoded = 0; /* 0: not tried yet, 1: integer, -1: not an integer. */
+    long long vll = 0;
+    uint64_t vhead = 0, vtail = 0;
+
+    // 预先计算被查找字符串开头和结尾的字
+    if (vlen >= 8) {
+        vhead = lpLoad64(vstr);
+        vtail = lpLoad64(vstr+vlen-8);
+        tailpos = vlen-8;
+    } else if (vlen >= 4) {
+        vhead = lpLoad32(vstr);
+        vtail = lpLoad32(vstr+vlen-4);
+        tailpos = vlen-4;
+    } else if (vlen >= 2) {
+        vhead = lpLoad16(vstr);
+        vtail = lpLoad16(vstr+vlen-2);
+        tailpos = vlen-2;
+    } else if (vlen == 1) {
+        vhead = vtail = vstr[0];
+    }
+
+    while (p[0] != LP_EOF) {
+        if (skipcnt == 0) {
+            unsigned char *q;
+            unsigned int len;
+            long long ll;
+
+            lpDecode(p,&q,&len,&ll);
+            if (q) {
+                if (len == vlen) {
+                    int match;
+
+                    if (vlen >= 8)
+                        match = lpLoad64(q) == vhead &&
+                                lpLoad64(q+tailpos) == vtail &&
+                                (vlen <= 16 || memcmp(q+8,vstr+8,vlen-16) == 0);
+                    else if (vlen >= 4)
+                        match = lpLoad32(q) == vhead && lpLoad32(q+tailpos) == vtail;
+                    else if (vlen >= 2)
+                        match = lpLoad16(q) == vhead && lpLoad16(q+tailpos) == vtail;
+                    else
+                        match = vlen == 0 || q[0] == vhead;
+                    if (match) return p;
+                }
+            } else {
+                // 只在第一次遇到整数节点时尝试将被查找的值转换为整数
+                if (vencoded == 0)
+                    vencoded = lpStringToInt64(vstr,vlen,&vll) ? 1 : -1;
+                if (vencoded == 1 && ll == vll) return p;
+            }
+            skipcnt = skip;
+        } else {
+            skipcnt--;
+        }
+        p = lpSkip(p);
+    }
+    return NULL;
+}
+
+/* Return the number of entries. When the header does not know it the list
+ * is traversed, and the header updated if the number fits again. */
+/* 返回节点个数。如果头部中的节点个数未知，需要遍历整个listpack，如果结果能保存在头部中则同时更新头部 */
+unsigned int lpLen(unsigned char *lp) {
+    uint32_t num = lpGetNumElements(lp);
+    unsigned char *p;
+
+    if (num != LP_HDR_NUMELE_UNKNOWN) return num;
+    num = 0;
+    p = lpFirstEntry(lp);
+    while (p[0] != LP_EOF) {
+        p = lpSkip(p);
+        num++;
+    }
+    if (num < LP_HDR_NUMELE_UNKNOWN) lpSetNumElements(lp,num);
+    return num;
+}
+
+/* Return the total size in bytes of the listpack. */
+/* 获取整个listpack占用的字节数，这个信息保存在头部，直接获取即可 */
+size_t lpBytes(unsigned char *lp) {
+    return lpGetTotalBytes(lp);
+}
+
+/* Upper bound of the bytes an entry holding a string of 'slen' bytes adds
+ * to the listpack. Used by callers limiting the listpack size. */
+/* 插入一个长度为slen的字符串节点会使listpack增加的字节数的上限，用于限制listpack大小的场合 */
+size_t lpEntrySizeUpperBound(unsigned int slen) {
+    uint32_t encsize = lpEncodeStringHeader(NULL,slen)+slen;
+    return encsize+lpBacklenSize(encsize);
+}
+
+/* Create a listpack with the same entries of the ziplist 'zl', that is not
+ * freed. Used when loading old RDB files. */
+/* 根据ziplist创建一个包含相同节点的listpack，zl不会被释放。用于载入旧的RDB文件 */
+unsigned char *lpFromZiplist(unsigned char *zl) {
+    unsigned char *lp = lpNew(), *p = ziplistIndex(zl,0);
+    unsigned char *vstr;
+    unsigned int vlen;
+    long long vll;
+    char buf[32];
+
+    while (ziplistGet(p,&vstr,&vlen,&vll)) {
+        if (vstr) {
+            lp = lpPush(lp,vstr,vlen,LP_TAIL);
+        } else {
+            vlen = ll2string(buf,sizeof(buf),vll);
+            lp = lpPush(lp,(unsigned char*)buf,vlen,LP_TAIL);
+        }
+        p = ziplistNext(zl,p);
+    }
+    return lp;
+}
+
+/* Return 1 if the 'size' bytes at 'lp' are a well formed listpack: the
+ * header matches the size, every entry (read forward) has a backlen that
+ * matches its length, and the terminator is where expected. */
+/*  检查lp开头的size个字节是否是一个完整的listpack：头部记录的大小与size一致，
+    每个节点的backlen与实际长度一致，并且结尾符在预期的位置上。是的话返回1，否则返回0。 */
+int lpValidate(unsigned char *lp, size_t size) {
+    unsigned char *p, *end;
+    uint32_t num = 0;
+
+    if (size < LP_HDR_SIZE+1 || lpGetTotalBytes(lp) != size) return 0;
+    end = lp+size-1;
+    if (end[0] != LP_EOF) return 0;
+    p = lpFirstEntry(lp);
+    while (p < end) {
+        // 节点之后（结尾符之前）剩余的字节数，所有的边界检查都使用无溢出的size_t/uint64_t运算
+        size_t avail = (size_t)(end-p);
+        uint64_t encsize, backlen;
+        unsigned int backlensize, decodedsize;
+
+        // 读取节点长度之前先确认头部没有越界
+        if (p[0] > LP_ENCODING_64BIT_INT) return 0;
+        if (p[0] == LP_ENCODING_32BIT_STR && avail < 5) return 0;
+        if (LP_ENCODING_IS_12BIT_STR(p[0]) && avail < 2) return 0;
+        encsize = lpCurrentEncodedSize(p);
+        backlensize = lpBacklenSize(encsize);
+        if (encsize > avail || backlensize > avail-encsize) return 0;
+        backlen = lpDecodeBacklen(p+encsize+backlensize-1,&decodedsize);
+        if (backlen != encsize || decodedsize != backlensize) return 0;
+        p += encsize+backlensize;
+        num++;
+    }
+    if (p != end) return 0;
+    if (lpGetNumElements(lp) != LP_HDR_NUMELE_UNKNOWN && lpGetNumElements(lp) != num)
+        return 0;
+    return 1;
+}
+
+/* 格式化输出，打印出整个listpack的信息 */
+void lpRepr(unsigned char *lp) {
+    unsigned char *p, *vstr;
+    unsigned int vlen;
+    long long vll;
+    int index = 0;
+
+    printf("{total bytes %u} {num entries %u}\n",
+        (unsigned)lpGetTotalBytes(lp), (unsigned)lpGetNumElements(lp));
+    p = lpFirstEntry(lp);
+    while (p[0] != LP_EOF) {
+        uint32_t encsize = lpCurrentEncodedSize(p);
+
+        printf("{index %3d, offset %5ld, size %5u, backlen %u} ",
+            index, (long)(p-lp), (unsigned)encsize,
+            (unsigned)lpBacklenSize(encsize));
+        lpDecode(p,&vstr,&vlen,&vll);
+        if (vstr) {
+            if (vlen > 40) {
+                if (fwrite(vstr,40,1,stdout) == 0) perror("fwrite");
+                printf("...");
+            } else if (vlen && fwrite(vstr,vlen,1,stdout) == 0) {
+                perror("fwrite");
+            }
+        } else {
+            printf("%lld", vll);
+        }
+        printf("\n");
+        p = lpSkip(p);
+        index++;
+    }
+    printf("{end}\n\n");
+}
+
+/* 下面是一些测试代码 */
+
+#ifdef LISTPACK_TEST_MAIN
+#include <sys/time.h>
+#include "testhelp.h"
+
+static long long usec(void) {
+    struct timeval tv;
+    gettimeofday(&tv,NULL);
+    return (((long long)tv.tv_sec)*1000000)+tv.tv_usec;
+}
+
+/* Check that the entry at 'p' is the integer 'v'. */
+/* 检查p指向的节点是否为整数v */
+static int lpIsInt(unsigned char *p, long long v) {
+    unsigned char *vstr;
+    unsigned int vlen;
+    long long vll;
+    return lpGet(p,&vstr,&vlen,&vll) && vstr == NULL && vll == v;
+}
+
+/* Check that the entry at 'p' is the string 's'. */
+/* 检查p指向的节点是否为字符串s */
+static int lpIsStr(unsigned char *p, const char *s, unsigned int slen) {
+    unsigned char *vstr;
+    unsigned int vlen;
+    long long vll;
+    return lpGet(p,&vstr,&vlen,&vll) && vstr != NULL && vlen == slen &&
+           memcmp(vstr,s,slen) == 0;
+}
+
+int main(void) {
+    unsigned char *lp, *p;
+    char buf[8192];
+    int i, ok;
+
+    {
+        long long ints[] = {0, 127, 128, -1, 4095, -4096, 4096, -4097,
+                            32767, -32768, 32768, 8388607, -8388608,
+                            2147483647LL, -2147483648LL, 2147483648LL,
+                            LLONG_MAX, LLONG_MIN};
+        int n = sizeof(ints)/sizeof(ints[0]);
+
+        lp = lpNew();
+        for (i = 0; i < n; i++) {
+            int len = ll2string(buf,sizeof(buf),ints[i]);
+            lp = lpPush(lp,(unsigned char*)buf,len,LP_TAIL);
+        }
+        ok = lpLen(lp) == (unsigned)n && lpValidate(lp,lpBytes(lp));
+        for (i = 0; i < n; i++)
+            if (!lpIsInt(lpIndex(lp,i),ints[i])) ok = 0;
+        test_cond("Integers at every encoding boundary", ok);
+        lpFree(lp);
+    }
+
+    {
+        unsigned int lens[] = {0, 1, 63, 64, 4095, 4096, 8000};
+        int n = sizeof(lens)/sizeof(lens[0]);
+
+        lp = lpNew();
+        for (i = 0; i < n; i++) {
+            memset(buf,'a'+i,lens[i]);
+            lp = lpPush(lp,(unsigned char*)buf,lens[i],LP_HEAD);
+        }
+        ok = lpLen(lp) == (unsigned)n && lpValidate(lp,lpBytes(lp));
+        /* Walk backward from the tail: the first pushed string is last. */
+        p = lpIndex(lp,-1);
+        for (i = 0; i < n; i++) {
+            memset(buf,'a'+i,lens[i]);
+            if (!lpIsStr(p,buf,lens[i])) ok = 0;
+            p = lpPrev(lp,p);
+        }
+        test_cond("Strings at every encoding boundary, walking backward",
+            ok && p == NULL);
+        lpFree(lp);
+    }
+
+    {
+        lp = lpNew();
+        lp = lpPush(lp,(unsigned char*)"b",1,LP_TAIL);
+        lp = lpPush(lp,(unsigned char*)"d",1,LP_TAIL);
+        lp = lpInsert(lp,lpIndex(lp,1),(unsigned char*)"c",1);
+        lp = lpPush(lp,(unsigned char*)"a",1,LP_HEAD);
+        lp = lpInsert(lp,lpIndex(lp,0),(unsigned char*)"0",1);
+        ok = lpLen(lp) == 5 && lpIsInt(lpIndex(lp,0),0) &&
+             lpIsStr(lpIndex(lp,1),"a",1) && lpIsStr(lpIndex(lp,2),"b",1) &&
+             lpIsStr(lpIndex(lp,3),"c",1) && lpIsStr(lpIndex(lp,-1),"d",1) &&
+             lpIndex(lp,5) == NULL && lpIndex(lp,-6) == NULL;
+        test_cond("Insert in the middle and at both ends", ok);
+
+        p = lpIndex(lp,2);
+        lp = lpDelete(lp,&p);
+        ok = lpIsStr(p,"c",1) && lpLen(lp) == 4;
+        p = lpIndex(lp,-1);
+        lp = lpDelete(lp,&p);
+        ok = ok && !lpGet(p,NULL,NULL,NULL) && lpLen(lp) == 3 &&
+             lpIsStr(lpPrev(lp,p),"c",1);
+        lp = lpDeleteRange(lp,1,10);
+        test_cond("Delete entries and ranges", ok && lpLen(lp) == 1 &&
+            lpIsInt(lpIndex(lp,0),0) && lpValidate(lp,lpBytes(lp)));
+        lpFree(lp);
+    }
+
+    {
+        lp = lpNew();
+        for (i = 0; i < 100; i++) {
+            int len = snprintf(buf,sizeof(buf),"field:%04d",i);
+            lp = lpPush(lp,(unsigned char*)buf,len,LP_TAIL);
+            len = snprintf(buf,sizeof(buf),"%d",i);
+            lp = lpPush(lp,(unsigned char*)buf,len,LP_TAIL);
+        }
+        ok = 1;
+        for (i = 0; i < 100; i++) {
+            char val[32];
+            int len = snprintf(buf,sizeof(buf),"field:%04d",i);
+            int vlen = snprintf(val,sizeof(val),"%d",i);
+
+            p = lpFind(lpIndex(lp,0),(unsigned char*)buf,len,1);
+            if (p != lpIndex(lp,i*2) ||
+                !lpCompare(lpNext(lp,p),(unsigned char*)val,vlen)) ok = 0;
+        }
+        /* Values are skipped, so "7" is never found as a field. */
+        ok = ok && lpFind(lpIndex(lp,0),(unsigned char*)"7",1,1) == NULL &&
+             lpFind(lpIndex(lp,1),(unsigned char*)"7",1,1) == lpIndex(lp,15);
+        test_cond("Find with skip and compare", ok);
+        lpFree(lp);
+    }
+
+    {
+        lp = lpNew();
+        for (i = 0; i < 70000; i++)
+            lp = lpPush(lp,(unsigned char*)"x",1,LP_TAIL);
+        ok = lpLen(lp) == 70000;
+        lp = lpDeleteRange(lp,0,10000);
+        test_cond("More than 65534 entries", ok && lpLen(lp) == 60000 &&
+            lpValidate(lp,lpBytes(lp)));
+        lpFree(lp);
+    }
+
+    {
+        unsigned char *zl = ziplistNew();
+        zl = ziplistPush(zl,(unsigned char*)"hello",5,ZIPLIST_TAIL);
+        zl = ziplistPush(zl,(unsigned char*)"-100",4,ZIPLIST_TAIL);
+        zl = ziplistPush(zl,(unsigned char*)"4294967296",10,ZIPLIST_TAIL);
+        lp = lpFromZiplist(zl);
+        test_cond("Convert from ziplist", lpLen(lp) == 3 &&
+            lpIsStr(lpIndex(lp,0),"hello",5) && lpIsInt(lpIndex(lp,1),-100) &&
+            lpIsInt(lpIndex(lp,2),4294967296LL));
+        /* Truncated or corrupted blobs are refused. */
+        ok = !lpValidate(lp,lpBytes(lp)-1);
+        lp[LP_HDR_SIZE] = 0xF7;
+        ok = ok && !lpValidate(lp,lpBytes(lp));
+        /* A 32 bit string header claiming ~4GB: its size must not wrap. */
+        for (i = 0; i < 4; i++) {
+            static const unsigned char lens[][4] = {
+                {0xff,0xff,0xff,0xff}, {0xfb,0xff,0xff,0xff},
+                {0xfc,0xff,0xff,0xff}, {0xfe,0xff,0xff,0xff}};
+            lp[LP_HDR_SIZE] = LP_ENCODING_32BIT_STR;
+            memcpy(lp+LP_HDR_SIZE+1,lens[i],4);
+            if (lpValidate(lp,lpBytes(lp))) ok = 0;
+        }
+        test_cond("Validate refuses corrupted listpacks", ok);
+        lpFree(lp);
+        zfree(zl);
+    }
+
+    /* The cascade update worst case: a list of entries of 250 bytes, whose
+     * ziplist prevlen fields use 1 byte, gets an entry of 300 bytes pushed
+     * at the head. The ziplist has to grow every prevlen field from 1 to 5
+     * bytes, the listpack only moves the memory once. Every round works on
+     * a fresh copy, since the ziplist never shrinks the fields back. */
+    /*  连锁更新的最坏情况：在由长度为250字节的节点（ziplist中prevlen字段只需1个字节）组成的列表头部插入一个300字节的节点。
+        ziplist需要把所有prevlen字段从1个字节扩展为5个字节，listpack只需要移动一次内存。
+        由于ziplist不会把prevlen字段缩小回去，每一轮都在一份新的拷贝上进行。 */
+    {
+        int sizes[] = {64, 128, 256, 512};
+        unsigned int s;
+
+        printf("%8s %14s %14s\n","entries","ziplist us","listpack us");
+        for (s = 0; s < sizeof(sizes)/sizeof(int); s++) {
+            unsigned char *zl = ziplistNew(), *copy;
+            long long start, zltime, lptime;
+            int j;
+
+            lp = lpNew();
+            memset(buf,'v',300);
+            for (j = 0; j < sizes[s]; j++) {
+                zl = ziplistPush(zl,(unsigned char*)buf,250,ZIPLIST_TAIL);
+                lp = lpPush(lp,(unsigned char*)buf,250,LP_TAIL);
+            }
+
+            start = usec();
+            for (j = 0; j < 200; j++) {
+                copy = zmalloc(ziplistBlobLen(zl));
+                memcpy(copy,zl,ziplistBlobLen(zl));
+                copy = ziplistPush(copy,(unsigned char*)buf,300,ZIPLIST_HEAD);
+                zfree(copy);
+            }
+            zltime = usec()-start;
+
+            start = usec();
+            for (j = 0; j < 200; j++) {
+                copy = zmalloc(lpBytes(lp));
+                memcpy(copy,lp,lpBytes(lp));
+                copy = lpPush(copy,(unsigned char*)buf,300,LP_HEAD);
+                lpFree(copy);
+            }
+            lptime = usec()-start;
+
+            printf("%8d %14lld %14lld\n",sizes[s],zltime,lptime);
+            zfree(zl);
+            lpFree(lp);
+        }
+    }
+
+    test_report();
+    return 0;
+}
+#endif
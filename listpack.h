@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2009-2012, Pieter Noordhuis <pcnoordhuis at gmail dot com>
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __LISTPACK_H__
+#define __LISTPACK_H__
+
+#include <stddef.h>
+
+/*  listpack是ziplist的替代者，同样以一整块连续内存保存字符串和整数。
+    与ziplist不同的是，listpack的每个节点只记录自身的长度（保存在节点的尾部），而不记录前一个节点的长度，
+    因此插入或删除节点不会再引起连锁更新。接口与ziplist一一对应，具体格式见listpack.c。 */
+
+#define LP_HEAD 0
+#define LP_TAIL 1
+
+/* 创建一个空的listpack */
+unsigned char *lpNew(void);
+/* 释放listpack */
+void lpFree(unsigned char *lp);
+/* 往listpack的头部或尾部插入一个节点 */
+unsigned char *lpPush(unsigned char *lp, unsigned char *s, unsigned int slen, int where);
+/* 根据索引获取listpack节点，负数表示从尾部开始计算 */
+unsigned char *lpIndex(unsigned char *lp, int index);
+/* 获取listpack中p节点的下一个节点 */
+unsigned char *lpNext(unsigned char *lp, unsigned char *p);
+/* 获取listpack中p节点的前一个节点 */
+unsigned char *lpPrev(unsigned char *lp, unsigned char *p);
+/* 获取p指针指向的节点的值 */
+unsigned int lpGet(unsigned char *p, unsigned char **sval, unsigned int *slen, long long *lval);
+/* 在p指针指向的位置之前插入一个节点，p可以指向结尾符 */
+unsigned char *lpInsert(unsigned char *lp, unsigned char *p, unsigned char *s, unsigned int slen);
+/* 删除p指针指向的节点，操作成功后p指向被删除节点的下一个节点 */
+unsigned char *lpDelete(unsigned char *lp, unsigned char **p);
+/* 删除连续的一批节点 */
+unsigned char *lpDeleteRange(unsigned char *lp, int index, unsigned int num);
+/* 将p指针指向的节点的值与s作比较，如果两者相等返回1，否则返回0 */
+unsigned int lpCompare(unsigned char *p, unsigned char *s, unsigned int slen);
+/* 在listpack中查找包含给定数据的节点，可以通过参数skip指定跳过的节点数 */
+unsigned char *lpFind(unsigned char *p, unsigned char *vstr, unsigned int vlen, unsigned int skip);
+/* 获取listpack中元素的个数 */
+unsigned int lpLen(unsigned char *lp);
+/* 获取整个listpack占用的字节数 */
+size_t lpBytes(unsigned char *lp);
+/* 估算插入一个长度为slen的字符串节点会使listpack增加的字节数（按字符串编码计算，是一个上限） */
+size_t lpEntrySizeUpperBound(unsigned int slen);
+/* 根据一个旧的ziplist创建内容相同的listpack，zl不会被释放 */
+unsigned char *lpFromZiplist(unsigned char *zl);
+/* 检查从RDB中读出的一段数据是否是一个完整的listpack */
+int lpValidate(unsigned char *lp, size_t size);
+/* 格式化输出，打印出整个listpack的信息 */
+void lpRepr(unsigned char *lp);
+
+#endif /* __LISTPACK_H__ */
@@ -29,6 +29,8 @@
 
 #include "redis.h"
 
+static int watchedKeysTouched(redisClient *c);
+
 /* ================================ MULTI/EXEC ============================== */
 /* multi / exec 命令相关操作 */
 
@@ -151,6 +153,7 @@ void execCommand(redisClient *c) {
     struct redisCommand *orig_cmd;
     // 是否需要将MULTI/EXEC命令传播到slave节点/AOF
     int must_propagate = 0; /* Need to propagate MULTI/EXEC to AOF / slaves? */
+    long long start, duration;
 
     // 如果客户端当前不处于事务状态，直接返回
     if (!(c->flags & REDIS_MULTI)) {
@@ -169,6 +172,7 @@ void execCommand(redisClient *c) {
     // （2）、命令入队的时候发生错误
     //  对于第一种情况，Redis返回多个nil空对象（准确地说这种情况并不是错误，应视为一种特殊的行为）
     //  对于第二种情况则返回一个EXECABORT错误
+    if (watchedKeysTouched(c)) c->flags |= REDIS_DIRTY_CAS;
     if (c->flags & (REDIS_DIRTY_CAS|REDIS_DIRTY_EXEC)) {
         addReply(c, c->flags & REDIS_DIRTY_EXEC ? shared.execaborterr :
                                                   shared.nullmultibulk);
@@ -187,6 +191,16 @@ void execCommand(redisClient *c) {
     orig_argc = c->argc;
     orig_cmd = c->cmd;
     addReplyMultiBulkLen(c,c->mstate.count);
+
+    /* The queued commands run as a batch: the keys they look up are
+     * cached for the whole transaction, what they propagate is appended to
+     * the AOF buffers at once, and the slow log and the latency probe see
+     * the whole transaction instead of command by command. */
+    // 事务中的命令作为一个批量执行：它们查找的key在整个事务期间被缓存，它们传播的内容一次性追加到AOF缓冲区中，
+    // 并且慢查询日志和延迟探针按照整个事务记录，而不是逐条命令记录
+    dbLookupCacheStart();
+    aofBatchBegin();
+    start = ustime();
     // 逐一将事务中的命令交给客户端redisClient执行
     for (j = 0; j < c->mstate.count; j++) {
         // 将事务命令队列中的命令设置给客户端
@@ -206,8 +220,12 @@ void execCommand(redisClient *c) {
             must_propagate = 1;
         }
 
-        // 真正执行命令
-        call(c,REDIS_CALL_FULL);
+        /* No slow log entry per command, the transaction is logged as a
+         * whole below, but calls and microseconds are still accounted to
+         * every command so that INFO commandstats stays consistent. */
+        // 真正执行命令，不单独记录慢查询（整个事务在下面统一记录），但仍然统计每条命令的调用次数和耗时，
+        // 这样INFO commandstats中的calls和usec保持一致
+        call(c,REDIS_CALL_PROPAGATE|REDIS_CALL_STATS);
 
         /* Commands may alter argc/argv, restore mstate. */
         // 命令执行后可能会被修改，需要更新操作
@@ -215,10 +233,17 @@ void execCommand(redisClient *c) {
         c->mstate.commands[j].argv = c->argv;
         c->mstate.commands[j].cmd = c->cmd;
     }
+    duration = ustime()-start;
+    latencyProbeAddIfNeeded(LATENCY_PROBE_EXEC,duration);
+    aofBatchEnd();
+    dbLookupCacheStop();
     // 恢复原命令
     c->argv = orig_argv;
     c->argc = orig_argc;
     c->cmd = orig_cmd;
+    /* call() leaves EXEC out of the slow log: log the whole transaction. */
+    // call()不会将EXEC记录到慢查询日志中，这里以整个事务为单位记录
+    slowlogPushEntryIfNeeded(c->argv,c->argc,duration);
     // 清除事务状态
     discardTransaction(c);
     /* Make sure the EXEC command will be propagated as well if MULTI
@@ -238,19 +263,40 @@ handle_monitor:
 /* ===================== WATCH (CAS alike for MULTI/EXEC) ===================
  *              WATCH命令
  *
- * The implementation uses a per-DB hash table mapping keys to list of clients
- * WATCHing those keys, so that given a key that is going to be modified
- * we can mark all the associated clients as dirty.
+ * WATCH is implemented with modification epochs. A global counter is
+ * incremented every time a watched key is modified: the key takes the new
+ * value as its epoch. WATCH records the current value of the counter, and
+ * EXEC fails if the key epoch, or the flush epoch of its DB, is greater.
+ *
+ *  WATCH通过修改纪元（epoch）实现。每当一个被监控的key被修改，全局计数器加1，新的计数值即为该key的纪元。
+ *  WATCH时记录下当前的计数值，EXEC时如果key的纪元或者其所在数据库的清空纪元比它大，则事务失败。
+ *
+ * Only watched keys have an epoch: they are stored in a per-DB hash table
+ * mapping keys to their epoch and to the number of clients WATCHing them.
+ * A write just updates the epoch of the key when it is watched, without
+ * visiting the clients, and FLUSHDB/FLUSHALL just update the epoch of the
+ * DB, whatever the number of watched keys is.
  *
- *  该实现在每个redisDB数据库使用一个哈希表来维护key和所有监控该key的客户端列表的映射关系。
- *  这样当一个key被修改后，我们就可以对所有监控该key的客户端设置dirty标识。
+ *  只有被监控的key才有纪元：每个redisDB中的哈希表将key映射到它的纪元以及监控它的客户端数量。
+ *  写命令只需要在key被监控时更新它的纪元，不需要访问客户端；FLUSHDB/FLUSHALL只需要更新数据库的纪元，
+ *  与被监控的key的数量无关。
  *
  * Also every client contains a list of WATCHed keys so that's possible to
- * un-watch such keys when the client is freed or when UNWATCH is called. 
+ * validate and un-watch such keys on EXEC, when the client is freed or
+ * when UNWATCH is called.
  *
- *  另外，每个客户端redisClient也维护着一个保存所有被监控的key的列表，这样就可以方便地对key取消监控
+ *  另外，每个客户端redisClient也维护着一个保存所有被监控的key的列表，用于EXEC时的检查以及取消监控
  */
 
+/* The value of db->watched_keys entries. */
+/* db->watched_keys中保存的值 */
+typedef struct watchedKeyEpoch {
+    // 该key最近一次被修改时的纪元
+    unsigned long long epoch;
+    // 监控该key的客户端数量
+    unsigned long watchers;
+} watchedKeyEpoch;
+
 /* In the client->watched_keys list we need to use watchedKey structures
  * as in order to identify a key in Redis we need both the key name and the
  * DB */
@@ -261,12 +307,28 @@ typedef struct watchedKey {
     robj *key;
     // key所在的数据库
     redisDb *db;
+    // db->watched_keys中该key的纪元，在取消监控之前一直有效
+    watchedKeyEpoch *ke;
+    // WATCH时的计数值
+    unsigned long long epoch;
+    // WATCH时key是否存在
+    int existed;
 } watchedKey;
 
+/* The global epoch counter, and the epoch of the last flush of every DB. */
+/* 全局纪元计数器，以及每个数据库最近一次被清空时的纪元 */
+static unsigned long long watch_epoch = 0;
+static unsigned long long *watch_flush_epochs = NULL;
+
+/* Return the epoch of the last flush of the DB 'id'. */
+static unsigned long long watchFlushEpoch(int id) {
+    return watch_flush_epochs ? watch_flush_epochs[id] : 0;
+}
+
 /* Watch for the specified key */
 /* 对一个给定的key进行监控。*/
 void watchForKey(redisClient *c, robj *key) {
-    list *clients = NULL;
+    watchedKeyEpoch *ke;
     listIter li;
     listNode *ln;
     watchedKey *wk;
@@ -284,23 +346,25 @@ void watchForKey(redisClient *c, robj *key) {
     }
 
     /* This key is not already watched in this DB. Let's add it */
-    // 检查redisDB->watched_keys是否保存了该key和客户端的映射关系，如果没有则添加之
-    // 获取监控给定key的客户端列表
-    clients = dictFetchValue(c->db->watched_keys,key);
-    // 如果该列表为空，则创建一个
-    if (!clients) {
-        clients = listCreate();
-        dictAdd(c->db->watched_keys,key,clients);
+    // 检查redisDB->watched_keys是否保存了该key，如果没有则添加之
+    ke = dictFetchValue(c->db->watched_keys,key);
+    if (!ke) {
+        ke = zmalloc(sizeof(*ke));
+        ke->epoch = 0;
+        ke->watchers = 0;
+        dictAdd(c->db->watched_keys,key,ke);
         incrRefCount(key);
     }
-    // 并加入当前客户端
-    listAddNodeTail(clients,c);
+    ke->watchers++;
 
     /* Add the new key to the list of keys watched by this client */
-    // 将一个新的watchedKey结构添加到client->watched_keys列表中
+    // 将一个新的watchedKey结构添加到client->watched_keys列表中，并记录当前的纪元
     wk = zmalloc(sizeof(*wk));
     wk->key = key;
     wk->db = c->db;
+    wk->ke = ke;
+    wk->epoch = watch_epoch;
+    wk->existed = dictFind(c->db->dict,key->ptr) != NULL;
     incrRefCount(key);
     listAddNodeTail(c->watched_keys,wk);
 }
@@ -318,20 +382,11 @@ void unwatchAllKeys(redisClient *c) {
     listRewind(c->watched_keys,&li);
     // 遍历c->watched_keys列表，逐一删除被该客户端监视的key
     while((ln = listNext(&li))) {
-        list *clients;
-        watchedKey *wk;
-
-        /* Lookup the watched key -> clients list and remove the client
-         * from the list */
-        wk = listNodeValue(ln);
-        // 将当前客户端从db->watched_keys中删除
-        clients = dictFetchValue(wk->db->watched_keys, wk->key);
-        redisAssertWithInfo(c,NULL,clients != NULL);
-        listDelNode(clients,listSearchKey(clients,c));
+        watchedKey *wk = listNodeValue(ln);
 
         /* Kill the entry at all if this was the only client */
-        // 如果没有任何客户端监控该key，则将该key从db->watched_keys中删除
-        if (listLength(clients) == 0)
+        // 如果没有任何客户端监控该key，则将该key从db->watched_keys中删除（同时释放其纪元）
+        if (--wk->ke->watchers == 0)
             dictDelete(wk->db->watched_keys, wk->key);
 
         /* Remove this watched key from the client->watched list */
@@ -344,29 +399,41 @@ void unwatchAllKeys(redisClient *c) {
     }
 }
 
+/* Return 1 if some key WATCHed by the client was touched since it was
+ * watched, 0 otherwise. */
+/*  如果客户端监控的某个key在WATCH之后被修改过，返回1，否则返回0 */
+static int watchedKeysTouched(redisClient *c) {
+    listIter li;
+    listNode *ln;
+
+    listRewind(c->watched_keys,&li);
+    while((ln = listNext(&li))) {
+        watchedKey *wk = listNodeValue(ln);
+
+        // key被修改过
+        if (wk->ke->epoch > wk->epoch) return 1;
+        /* A flush only touches the keys that existed: if the key was
+         * created after WATCH its epoch already changed. */
+        // 数据库清空只会影响到已经存在的key：如果key是在WATCH之后被创建的，它的纪元已经改变了
+        if (wk->existed && watchFlushEpoch(wk->db->id) > wk->epoch) return 1;
+    }
+    return 0;
+}
+
 /* "Touch" a key, so that if this key is being WATCHed by some client the
  * next EXEC will fail. */
-/* 如果某个被监控的key被修改（触碰touch），则设置REDIS_DIRTY_CAS标识，随着这些客户端client在执行EXEC命令时将失败返回。*/
+/* 如果某个被监控的key被修改（触碰touch），则更新它的纪元，随后这些客户端client在执行EXEC命令时将失败返回。*/
 void touchWatchedKey(redisDb *db, robj *key) {
-    list *clients;
-    listIter li;
-    listNode *ln;
+    watchedKeyEpoch *ke;
 
     // 如果没有任何键被监控，直接返回
     if (dictSize(db->watched_keys) == 0) return;
-    // 找到监控该key的客户端列表
-    clients = dictFetchValue(db->watched_keys, key);
-    if (!clients) return;
+    ke = dictFetchValue(db->watched_keys, key);
+    if (!ke) return;
 
-    /* Mark all the clients watching this key as REDIS_DIRTY_CAS */
-    /* Check if we are already watching for this key */
-    // 遍历监控该key的所有客户端列表，设置其flags标识为REDIS_DIRTY_CAS
-    listRewind(clients,&li);
-    while((ln = listNext(&li))) {
-        redisClient *c = listNodeValue(ln);
-
-        c->flags |= REDIS_DIRTY_CAS;
-    }
+    /* Clients watching the key will find out at EXEC time. */
+    // 不需要访问监控该key的客户端，它们在EXEC时会发现纪元已经改变
+    ke->epoch = ++watch_epoch;
 }
 
 /* On FLUSHDB or FLUSHALL all the watched keys that are present before the
@@ -374,36 +441,18 @@ void touchWatchedKey(redisDb *db, robj *key) {
  * be touched. "dbid" is the DB that's getting the flush. -1 if it is
  * a FLUSHALL operation (all the DBs flushed). */
 /*  当执行FLUSHDB或FLUSHALL命令时候，该数据库内的所有被监控的key都被touch，也就是认为这些
-    key已经被修改。
+    key已经被修改。这里只需要更新数据库的纪元，代价为O(1)。
 
     参数dbid是flush操作的目标数据库，如果dbid为-1，则表示所有的数据库都要被flush。
 */
 void touchWatchedKeysOnFlush(int dbid) {
-    listIter li1, li2;
-    listNode *ln;
+    int j;
 
-    // 这里的做法是遍历所有的客户端client，对于每一个客户端，遍历其监视的所有key，设置相应客户端的flag标识
-
-    /* For every client, check all the waited keys */
-    // 遍历所有的客户端client
-    listRewind(server.clients,&li1);
-    while((ln = listNext(&li1))) {
-        redisClient *c = listNodeValue(ln);
-
-        // 遍历该客户端监控的所有key，保存在c->watched_keys中，每一个节点为watchedKey结构
-        listRewind(c->watched_keys,&li2);
-        while((ln = listNext(&li2))) {
-            watchedKey *wk = listNodeValue(ln);
-
-            /* For every watched key matching the specified DB, if the
-             * key exists, mark the client as dirty, as the key will be
-             * removed. */
-            // 设置flags标识为REDIS_DIRTY_CAS
-            if (dbid == -1 || wk->db->id == dbid) {
-                if (dictFind(wk->db->dict, wk->key->ptr) != NULL)
-                    c->flags |= REDIS_DIRTY_CAS;
-            }
-        }
+    if (watch_flush_epochs == NULL)
+        watch_flush_epochs = zcalloc(sizeof(unsigned long long)*server.dbnum);
+    watch_epoch++;
+    for (j = 0; j < server.dbnum; j++) {
+        if (dbid == -1 || j == dbid) watch_flush_epochs[j] = watch_epoch;
     }
 }
 
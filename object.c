@@ -45,8 +45,10 @@ robj *createObject(int type, void *ptr) {
     o->ptr = ptr;
     o->refcount = 1;
 
-    /* Set the LRU to the current lruclock (minutes resolution). */
-    o->lru = server.lruclock;
+    /* Set the LRU to the current lruclock (minutes resolution), or the
+     * initial LFU access counter when an LFU policy is in use. */
+    // 设置lru字段：LRU时钟，或者LFU策略下的初始访问计数器
+    o->lru = objectInitialLRU();
     return o;
 }
 
@@ -63,7 +65,10 @@ robj *createStringObject(char *ptr, size_t len) {
 /* 根据一个long long类型整数创建一个字符串对象，编码方式为REDIS_ENCODING_INT */
 robj *createStringObjectFromLongLong(long long value) {
     robj *o;
-    if (value >= 0 && value < REDIS_SHARED_INTEGERS) {
+    /* Shared integers can't be used by the threaded RDB loader workers,
+     * since the refcount is not updated atomically. */
+    // 多线程载入RDB时，工作线程不能使用共享整数对象，因为引用计数的更新不是原子操作
+    if (value >= 0 && value < REDIS_SHARED_INTEGERS && !server.loading_threaded) {
         incrRefCount(shared.integers[value]);
         o = shared.integers[value];
     } else {
@@ -129,12 +134,11 @@ robj *dupStringObject(robj *o) {
     return createStringObject(o->ptr,sdslen(o->ptr));
 }
 
-/* 创建一个list对象 */
-robj *createListObject(void) {
-    list *l = listCreate();
+/* 创建一个quicklist编码的list对象，单个ziplist的大小限制由list_max_ziplist_entries决定 */
+robj *createQuicklistObject(void) {
+    quicklist *l = quicklistNew(server.list_max_ziplist_entries);
     robj *o = createObject(REDIS_LIST,l);
-    listSetFreeMethod(l,decrRefCountVoid);
-    o->encoding = REDIS_ENCODING_LINKEDLIST;
+    o->encoding = REDIS_ENCODING_QUICKLIST;
     return o;
 }
 
@@ -162,11 +166,11 @@ robj *createIntsetObject(void) {
     return o;
 }
 
-/* 创建一个Hash对象，默认以ziplist为底层实现 */
+/* 创建一个Hash对象，默认以listpack为底层实现 */
 robj *createHashObject(void) {
-    unsigned char *zl = ziplistNew();
-    robj *o = createObject(REDIS_HASH, zl);
-    o->encoding = REDIS_ENCODING_ZIPLIST;
+    unsigned char *lp = lpNew();
+    robj *o = createObject(REDIS_HASH, lp);
+    o->encoding = REDIS_ENCODING_LISTPACK;
     return o;
 }
 
@@ -182,11 +186,11 @@ robj *createZsetObject(void) {
     return o;
 }
 
-/* 创建一个以ziplist为底层实现的zset对象 */
-robj *createZsetZiplistObject(void) {
-    unsigned char *zl = ziplistNew();
-    robj *o = createObject(REDIS_ZSET,zl);
-    o->encoding = REDIS_ENCODING_ZIPLIST;
+/* 创建一个以listpack为底层实现的zset对象 */
+robj *createZsetListpackObject(void) {
+    unsigned char *lp = lpNew();
+    robj *o = createObject(REDIS_ZSET,lp);
+    o->encoding = REDIS_ENCODING_LISTPACK;
     return o;
 }
 
@@ -203,22 +207,17 @@ void freeStringObject(robj *o) {
 
 /* 释放一个list对象 */
 void freeListObject(robj *o) {
-    // list有两种不同的实现，根据不同的实现释放资源
-    switch (o->encoding) {
-    case REDIS_ENCODING_LINKEDLIST:
-        listRelease((list*) o->ptr);
-        break;
-    case REDIS_ENCODING_ZIPLIST:
-        zfree(o->ptr);
-        break;
-    default:
+    // list统一以quicklist为底层实现
+    if (o->encoding == REDIS_ENCODING_QUICKLIST) {
+        quicklistRelease(o->ptr);
+    } else {
         redisPanic("Unknown list encoding type");
     }
 }
 
 /* 释放一个set对象 */
 void freeSetObject(robj *o) {
-    // set有两种不同的实现，根据不同的实现释放资源
+    // set有三种不同的实现，根据不同的实现释放资源
     switch (o->encoding) {
     case REDIS_ENCODING_HT:
         dictRelease((dict*) o->ptr);
@@ -226,6 +225,9 @@ void freeSetObject(robj *o) {
     case REDIS_ENCODING_INTSET:
         zfree(o->ptr);
         break;
+    case REDIS_ENCODING_ROARING:
+        roaringFree(o->ptr);
+        break;
     default:
         redisPanic("Unknown set encoding type");
     }
@@ -242,8 +244,8 @@ void freeZsetObject(robj *o) {
         zslFree(zs->zsl);
         zfree(zs);
         break;
-    case REDIS_ENCODING_ZIPLIST:
-        zfree(o->ptr);
+    case REDIS_ENCODING_LISTPACK:
+        lpFree(o->ptr);
         break;
     default:
         redisPanic("Unknown sorted set encoding");
@@ -257,8 +259,11 @@ void freeHashObject(robj *o) {
     case REDIS_ENCODING_HT:
         dictRelease((dict*) o->ptr);
         break;
-    case REDIS_ENCODING_ZIPLIST:
-        zfree(o->ptr);
+    case REDIS_ENCODING_LISTPACK:
+        lpFree(o->ptr);
+        break;
+    case REDIS_ENCODING_LISTPACK_EX:
+        hpFree(o->ptr);
         break;
     default:
         redisPanic("Unknown hash encoding type");
@@ -266,13 +271,23 @@ void freeHashObject(robj *o) {
     }
 }
 
-/* 增加对象的引用计数值 */
+/* The reference count is only modified by the thread owning the object,
+ * but the lazy free thread reads the count of objects the main thread may
+ * still be releasing (see lazyfree.c): the stores are atomic so that such
+ * a read is well defined. They are plain stores, not read-modify-write
+ * operations, since there is a single writer. */
+/*  引用计数只会被拥有对象的线程修改，但lazy free后台线程会读取主线程可能仍在释放的对象的引用计数（见lazyfree.c），
+    因此使用原子写入，保证这样的读取是有定义的。只有一个写入者，所以使用普通的原子写入而不是读-改-写操作。 */
+
+/* 增加对象的引用计数值，共享对象的引用计数值保持不变 */
 void incrRefCount(robj *o) {
-    o->refcount++;
+    if (o->refcount != REDIS_SHARED_REFCOUNT)
+        __atomic_store_n(&o->refcount,o->refcount+1,__ATOMIC_RELAXED);
 }
 
-/* 减少对象的引用计数值，如果当前值为1则释放对象 */
+/* 减少对象的引用计数值，如果当前值为1则释放对象，共享对象永远不会被释放 */
 void decrRefCount(robj *o) {
+    if (o->refcount == REDIS_SHARED_REFCOUNT) return;
     if (o->refcount <= 0) redisPanic("decrRefCount against refcount <= 0");
     if (o->refcount == 1) {
         // 根据不同的对象类型调用相应的方法进行释放
@@ -286,10 +301,169 @@ void decrRefCount(robj *o) {
         }
         zfree(o);
     } else {
-        o->refcount--;
+        __atomic_store_n(&o->refcount,o->refcount-1,__ATOMIC_RELEASE);
     }
 }
 
+/* Make 'o' a shared object: its reference count is never modified again,
+ * so it can be referenced by values that are freed in the lazy free thread
+ * without racing with the main thread. Returns 'o'. */
+/*  将对象o设置为共享对象：此后它的引用计数不会再被修改，因此即使引用它的值在后台线程中释放，
+    也不会与主线程产生竞争。返回对象o。 */
+robj *makeObjectShared(robj *o) {
+    redisAssert(o->refcount == 1);
+    o->refcount = REDIS_SHARED_REFCOUNT;
+    return o;
+}
+
+/* Return the number of allocations freeing 'o' involves, roughly: the
+ * elements count for values made of one allocation per element, 1 for the
+ * values that are a single allocation (strings, listpacks, intsets). Used
+ * by the lazy free code to decide if freeing in background is worth it. */
+/*  返回释放对象o大致需要执行的内存释放次数：每个元素单独分配内存的值返回元素个数，
+    只有一块内存的值（字符串、listpack、intset）返回1。lazy free根据该值判断是否值得交给后台线程释放。 */
+size_t objectFreeEffort(robj *o) {
+    if (o->type == REDIS_LIST && o->encoding == REDIS_ENCODING_QUICKLIST) {
+        quicklist *ql = o->ptr;
+        return listLength(ql->nodes);
+    } else if (o->type == REDIS_SET && o->encoding == REDIS_ENCODING_HT) {
+        return dictSize((dict*)o->ptr);
+    } else if (o->type == REDIS_SET && o->encoding == REDIS_ENCODING_ROARING) {
+        return ((roaring*)o->ptr)->len;
+    } else if (o->type == REDIS_ZSET && o->encoding == REDIS_ENCODING_SKIPLIST) {
+        zset *zs = o->ptr;
+        return zs->zsl->length;
+    } else if (o->type == REDIS_HASH && o->encoding == REDIS_ENCODING_HT) {
+        return dictSize((dict*)o->ptr);
+    } else {
+        return 1;
+    }
+}
+
+/*-----------------------------------------------------------------------------
+ * Packed keyspace values
+ *
+ * Under the LRU and LFU policies shared integers can't be used, since every
+ * value needs its own lru field, so a dataset of millions of counters pays
+ * a whole robj per key. Cold string values holding an integer or a very
+ * short string are instead stored directly in the value pointer of the
+ * keyspace dict entry, together with their lru field:
+ *
+ *   bit 0       always 1 (a robj pointer is always aligned)
+ *   bits 1-24   the lru field of the object (LRU clock or LFU data)
+ *   bit 25      0: integer, 1: string
+ *   bits 26-63  integer: the value (38 bits, signed)
+ *               string: the length (3 bits) and up to 4 bytes
+ *
+ * Packing is only used on 64 bit systems. Values are packed by
+ * keyspacePackCycle() in db.c and unpacked again by lookupKey(), so the
+ * commands never see a packed value. Code iterating the keyspace directly
+ * must use keyspaceValueView().
+ *
+ * 键空间中值的打包表示：在LRU或LFU淘汰策略下不能使用共享整数（每个值都需要自己的lru字段），
+ * 因此由数百万个计数器组成的数据集每个key都要分配一个完整的robj。
+ * 保存整数或者很短的字符串的冷数据会被直接保存在键空间字典节点的值指针中，与它的lru字段放在一起，格式如上。
+ * 只在64位系统上使用。值由db.c中的keyspacePackCycle打包，由lookupKey解包，因此命令永远不会看到打包的值。
+ * 直接遍历键空间的代码必须使用keyspaceValueView获取值对象。
+ *----------------------------------------------------------------------------*/
+
+#define REDIS_PACKED_TAG 1
+#define REDIS_PACKED_LRU_SHIFT 1
+#define REDIS_PACKED_STR_BIT (1ULL<<25)
+#define REDIS_PACKED_VALUE_SHIFT 26
+#define REDIS_PACKED_LEN_BITS 3
+#define REDIS_PACKED_INT_MIN (-(1LL<<37))
+#define REDIS_PACKED_INT_MAX ((1LL<<37)-1)
+
+/* Return 1 if the keyspace value 'v' is packed. */
+/* 判断键空间中的值v是否是打包表示 */
+int objectIsPacked(const void *v) {
+    return ((uintptr_t)v & REDIS_PACKED_TAG) != 0;
+}
+
+/* Return the packed representation of 'o', or NULL if 'o' can't be packed.
+ * The caller releases 'o' when the packed value is stored. */
+/* 返回对象o的打包表示，如果不能打包则返回NULL。调用者保存打包值之后释放o */
+void *tryObjectPacking(robj *o) {
+    uint64_t v = REDIS_PACKED_TAG | ((uint64_t)o->lru << REDIS_PACKED_LRU_SHIFT);
+
+    if (sizeof(void*) != 8 || o->type != REDIS_STRING || o->refcount != 1)
+        return NULL;
+
+    if (o->encoding == REDIS_ENCODING_INT) {
+        long value = (long)o->ptr;
+
+        if (value < REDIS_PACKED_INT_MIN || value > REDIS_PACKED_INT_MAX)
+            return NULL;
+        v |= (uint64_t)value << REDIS_PACKED_VALUE_SHIFT;
+    } else {
+        size_t len = sdslen(o->ptr), j;
+
+        if (len > REDIS_PACKED_STRLEN_MAX) return NULL;
+        v |= REDIS_PACKED_STR_BIT | ((uint64_t)len << REDIS_PACKED_VALUE_SHIFT);
+        for (j = 0; j < len; j++) {
+            v |= (uint64_t)(unsigned char)((char*)o->ptr)[j] <<
+                 (REDIS_PACKED_VALUE_SHIFT+REDIS_PACKED_LEN_BITS+j*8);
+        }
+    }
+    return (void*)(uintptr_t)v;
+}
+
+/* Decode the packed value 'v' into the string object 'o'. The sds of a
+ * string value is built in 'buf', with a sdshdr8 header: 'o' can only be
+ * used for reading, and must never be freed. */
+/* 将打包值v解码到字符串对象o中，字符串值的sds（使用sdshdr8头部）构建在buf中：o只能用于读取，永远不能被释放 */
+static void decodePackedObject(const void *v, robj *o, char *buf) {
+    uint64_t p = (uintptr_t)v;
+
+    o->type = REDIS_STRING;
+    o->refcount = 1;
+    o->lru = (p >> REDIS_PACKED_LRU_SHIFT) & REDIS_LRU_CLOCK_MAX;
+    if (p & REDIS_PACKED_STR_BIT) {
+        struct sdshdr8 *sh = (void*)buf;
+        size_t len = (p >> REDIS_PACKED_VALUE_SHIFT) & ((1<<REDIS_PACKED_LEN_BITS)-1), j;
+
+        o->encoding = REDIS_ENCODING_RAW;
+        o->ptr = sh->buf;
+        sh->len = len;
+        sh->alloc = len;
+        sh->flags = SDS_TYPE_8;
+        for (j = 0; j < len; j++)
+            sh->buf[j] = p >> (REDIS_PACKED_VALUE_SHIFT+REDIS_PACKED_LEN_BITS+j*8);
+        sh->buf[len] = '\0';
+    } else {
+        o->encoding = REDIS_ENCODING_INT;
+        o->ptr = (void*)(long)((int64_t)p >> REDIS_PACKED_VALUE_SHIFT);
+    }
+}
+
+/* Return a new object with the value (and lru field) of the packed value
+ * 'v'. */
+/* 根据打包值v创建一个新的对象，lru字段保持不变 */
+robj *unpackObject(const void *v) {
+    packedObjectView view;
+    robj *o;
+
+    decodePackedObject(v,&view.o,view.buf);
+    if (view.o.encoding == REDIS_ENCODING_INT) {
+        o = createObject(REDIS_STRING,view.o.ptr);
+        o->encoding = REDIS_ENCODING_INT;
+    } else {
+        o = createStringObject(view.o.ptr,sdslen(view.o.ptr));
+    }
+    o->lru = view.o.lru;
+    return o;
+}
+
+/* Return the object of the keyspace value 'v' for read only use, without
+ * allocating: packed values are decoded into 'view'. */
+/* 以只读的方式获取键空间中的值v对应的对象，不分配内存：打包的值被解码到view中 */
+robj *keyspaceValueView(void *v, packedObjectView *view) {
+    if (!objectIsPacked(v)) return v;
+    decodePackedObject(v,&view->o,view->buf);
+    return &view->o;
+}
+
 /* This variant of decrRefCount() gets its argument as void, and is useful
  * as free method in data structures that expect a 'void free_object(void*)'
  * prototype for the free method. */
@@ -385,7 +559,9 @@ robj *tryObjectEncoding(robj *o) {
      * algorithm to work well. */
     if ((server.maxmemory == 0 ||
          (server.maxmemory_policy != REDIS_MAXMEMORY_VOLATILE_LRU &&
-          server.maxmemory_policy != REDIS_MAXMEMORY_ALLKEYS_LRU)) &&
+          server.maxmemory_policy != REDIS_MAXMEMORY_ALLKEYS_LRU &&
+          !REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy))) &&
+        !server.loading_threaded &&
         value >= 0 && value < REDIS_SHARED_INTEGERS)
     {
         decrRefCount(o);
@@ -657,8 +833,12 @@ char *strEncoding(int encoding) {
     case REDIS_ENCODING_INT: return "int";
     case REDIS_ENCODING_HT: return "hashtable";
     case REDIS_ENCODING_LINKEDLIST: return "linkedlist";
+    case REDIS_ENCODING_QUICKLIST: return "quicklist";
     case REDIS_ENCODING_ZIPLIST: return "ziplist";
+    case REDIS_ENCODING_LISTPACK: return "listpack";
+    case REDIS_ENCODING_LISTPACK_EX: return "listpackex";
     case REDIS_ENCODING_INTSET: return "intset";
+    case REDIS_ENCODING_ROARING: return "roaring";
     case REDIS_ENCODING_SKIPLIST: return "skiplist";
     default: return "unknown";
     }
@@ -683,6 +863,9 @@ robj *objectCommandLookup(redisClient *c, robj *key) {
     dictEntry *de;
 
     if ((de = dictFind(c->db->dict,key->ptr)) == NULL) return NULL;
+    // 打包的值先解包，解包不会修改lru字段
+    if (objectIsPacked(dictGetVal(de)))
+        dictSetVal(c->db->dict,de,unpackObject(dictGetVal(de)));
     return (robj*) dictGetVal(de);
 }
 
@@ -695,7 +878,7 @@ robj *objectCommandLookupOrReply(redisClient *c, robj *key, robj *reply) {
 }
 
 /* Object command allows to inspect the internals of an Redis Object.
- * Usage: OBJECT <refcount|encoding|idletime> <key> */
+ * Usage: OBJECT <refcount|encoding|idletime|freq> <key> */
 /* OBJECT命令的实现，命令允许从内部察看给定key的Redis对象。*/
 void objectCommand(redisClient *c) {
     robj *o;
@@ -711,9 +894,295 @@ void objectCommand(redisClient *c) {
     } else if (!strcasecmp(c->argv[1]->ptr,"idletime") && c->argc == 3) {
         if ((o = objectCommandLookupOrReply(c,c->argv[2],shared.nullbulk))
                 == NULL) return;
+        // LFU策略下lru字段保存的是访问计数器，无法计算空闲时间
+        if (REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy)) {
+            addReplyError(c,"An LFU maxmemory policy is selected, idle time not tracked. Please note that when switching between policies at runtime LRU and LFU data will take some time to adjust.");
+            return;
+        }
         addReplyLongLong(c,estimateObjectIdleTime(o));
+    } else if (!strcasecmp(c->argv[1]->ptr,"freq") && c->argc == 3) {
+        if ((o = objectCommandLookupOrReply(c,c->argv[2],shared.nullbulk))
+                == NULL) return;
+        // 只有LFU策略下才会维护访问计数器
+        if (!REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy)) {
+            addReplyError(c,"An LFU maxmemory policy is not selected, access frequency not tracked. Please note that when switching between policies at runtime LRU and LFU data will take some time to adjust.");
+            return;
+        }
+        addReplyLongLong(c,LFUDecrAndReturn(o));
+    } else {
+        addReplyError(c,"Syntax error. Try OBJECT (refcount|encoding|idletime|freq)");
+    }
+}
+
+
+/*-----------------------------------------------------------------------------
+ * Memory introspection (MEMORY command)
+ *
+ * The sizes are estimations of the bytes asked to the allocator: the
+ * internal fragmentation of the allocator is not counted. Values made of a
+ * single blob (listpacks, intsets, roaring sets) are measured exactly, while
+ * for hash tables and skiplists only the size of the first 'samples'
+ * elements is computed, and the average is multiplied by the number of
+ * elements.
+ *
+ * 内存使用分析：计算的是向分配器申请的字节数，不包括分配器内部的碎片。由单块内存组成的值（listpack、intset、roaring）
+ * 的大小是精确的；哈希表和跳跃表只计算前samples个元素的大小，再用平均值乘以元素个数得到估计值。
+ *----------------------------------------------------------------------------*/
+
+#define REDIS_MEMORY_DEFAULT_SAMPLES 5
+
+/* Return the bytes allocated for the string object 'o', robj included. */
+/* 返回字符串对象o占用的内存字节数，包括robj结构本身 */
+size_t stringObjectAllocSize(robj *o) {
+    size_t size = sizeof(*o);
+
+    if (sdsEncodedObject(o)) size += sdsAllocSize(o->ptr);
+    return size;
+}
+
+/* Return the bytes allocated for the structure of the dict 'd': the dict
+ * itself, the buckets of both tables and the entries. Keys and values are
+ * not counted. */
+/* 返回字典d结构本身占用的内存字节数：dict结构、两个哈希表的桶数组以及所有节点，不包括键和值 */
+size_t dictAllocSize(dict *d) {
+    return sizeof(*d) +
+           (d->ht[0].size + d->ht[1].size) * sizeof(dictEntry*) +
+           dictSize(d) * sizeof(dictEntry);
+}
+
+/* Return the estimated bytes used by the keys (and by the values too, if
+ * 'values' is non zero) of the dict 'd', whose keys and values are string
+ * objects. Only the first 'samples' entries are measured, 0 means all. */
+/*  估计字典d中所有键（values不为0时也包括值）占用的内存字节数，键和值都是字符串对象。
+    只计算前samples个节点，samples为0表示计算所有节点。 */
+static size_t dictElementsAllocSize(dict *d, size_t samples, int values) {
+    dictIterator *di;
+    dictEntry *de;
+    size_t size = 0, n = 0;
+
+    if (dictSize(d) == 0) return 0;
+    di = dictGetIterator(d);
+    while((de = dictNext(di)) != NULL && (samples == 0 || n < samples)) {
+        size += stringObjectAllocSize(dictGetKey(de));
+        if (values) size += stringObjectAllocSize(dictGetVal(de));
+        n++;
+    }
+    dictReleaseIterator(di);
+    return (double)size/n*dictSize(d);
+}
+
+/* Return the estimated bytes allocated for the object 'o', robj included,
+ * sampling 'samples' elements of the aggregated values (0 means all the
+ * elements, which is exact but O(N)). */
+/*  估计对象o占用的内存字节数（包括robj结构本身），对于聚合类型只采样samples个元素，
+    samples为0表示计算所有元素，结果精确但复杂度为O(N)。 */
+size_t objectComputeSize(robj *o, size_t samples) {
+    size_t size = 0, n = 0, elesize = 0;
+
+    if (o->type == REDIS_STRING) {
+        return stringObjectAllocSize(o);
+    } else if (o->type == REDIS_LIST) {
+        if (o->encoding == REDIS_ENCODING_QUICKLIST) {
+            quicklist *ql = o->ptr;
+            listIter li;
+            listNode *ln;
+
+            size = sizeof(*ql) + sizeof(list);
+            // 采样若干个listpack节点，用平均大小估计所有节点
+            listRewind(ql->nodes,&li);
+            while((ln = listNext(&li)) != NULL && (samples == 0 || n < samples)) {
+                quicklistNode *node = listNodeValue(ln);
+                elesize += sizeof(listNode) + sizeof(*node) + lpBytes(node->lp);
+                n++;
+            }
+            if (n) size += (double)elesize/n*listLength(ql->nodes);
+        } else {
+            redisPanic("Unknown list encoding");
+        }
+    } else if (o->type == REDIS_SET) {
+        if (o->encoding == REDIS_ENCODING_HT) {
+            size = dictAllocSize(o->ptr) + dictElementsAllocSize(o->ptr,samples,0);
+        } else if (o->encoding == REDIS_ENCODING_INTSET) {
+            size = intsetBlobLen(o->ptr);
+        } else if (o->encoding == REDIS_ENCODING_ROARING) {
+            size = roaringBytes(o->ptr);
+        } else {
+            redisPanic("Unknown set encoding");
+        }
+    } else if (o->type == REDIS_ZSET) {
+        if (o->encoding == REDIS_ENCODING_LISTPACK) {
+            size = lpBytes(o->ptr);
+        } else if (o->encoding == REDIS_ENCODING_SKIPLIST) {
+            zset *zs = o->ptr;
+            zskiplistNode *x = zs->zsl->header->level[0].forward;
+
+            // 成员对象由字典和跳跃表共享，只计算一次：字典中保存的是指向节点分值的指针
+            size = sizeof(*zs) + dictAllocSize(zs->dict) + zslAllocSize(zs->zsl);
+            while(x && (samples == 0 || n < samples)) {
+                elesize += stringObjectAllocSize(x->obj);
+                x = x->level[0].forward;
+                n++;
+            }
+            if (n) size += (double)elesize/n*zs->zsl->length;
+        } else {
+            redisPanic("Unknown sorted set encoding");
+        }
+    } else if (o->type == REDIS_HASH) {
+        if (o->encoding == REDIS_ENCODING_LISTPACK) {
+            size = lpBytes(o->ptr);
+        } else if (o->encoding == REDIS_ENCODING_LISTPACK_EX) {
+            size = hpBytes(o->ptr);
+        } else if (o->encoding == REDIS_ENCODING_HT) {
+            size = dictAllocSize(o->ptr) + dictElementsAllocSize(o->ptr,samples,1);
+        } else {
+            redisPanic("Unknown hash encoding");
+        }
     } else {
-        addReplyError(c,"Syntax error. Try OBJECT (refcount|encoding|idletime)");
+        redisPanic("Unknown object type");
     }
+    return size + sizeof(*o);
 }
 
+/* Return the bytes used by the output buffers and the query buffer of the
+ * client 'c', the client structure included. */
+/* 返回客户端c的输出缓冲区和查询缓冲区占用的内存字节数，包括客户端结构本身 */
+static size_t clientAllocSize(redisClient *c) {
+    return sizeof(*c) + sdsAllocSize(c->querybuf) +
+           getClientOutputBufferMemoryUsage(c);
+}
+
+/* MEMORY STATS: reply with the breakdown of the memory used by the server
+ * as a flat list of name/value pairs, one nested list for every not empty
+ * db. Everything that isn't overhead is reported as dataset. */
+/*  MEMORY STATS：以名称/数值对组成的列表回复服务器的内存使用情况，每个非空的数据库对应一个嵌套列表。
+    所有不属于额外开销的内存都计入dataset。 */
+static void memoryStatsCommand(redisClient *c) {
+    size_t used = zmalloc_used_memory(), overhead = 0, mem;
+    size_t clients_normal = 0, clients_slaves = 0, keys = 0;
+    void *replylen = addDeferredMultiBulkLength(c);
+    long pairs = 0;
+    listIter li;
+    listNode *ln;
+    int j;
+
+    addReplyBulkCString(c,"peak.allocated");
+    addReplyLongLong(c,server.stat_peak_memory);
+    addReplyBulkCString(c,"total.allocated");
+    addReplyLongLong(c,used);
+    pairs += 2;
+
+    mem = server.repl_backlog ? (size_t)server.repl_backlog_size : 0;
+    addReplyBulkCString(c,"replication.backlog");
+    addReplyLongLong(c,mem);
+    overhead += mem;
+    pairs++;
+
+    // 从服务器的输出缓冲区保存的是复制流，与普通客户端分开统计
+    listRewind(server.clients,&li);
+    while((ln = listNext(&li)) != NULL) {
+        redisClient *client = listNodeValue(ln);
+
+        if ((client->flags & REDIS_SLAVE) && !(client->flags & REDIS_MONITOR))
+            clients_slaves += clientAllocSize(client);
+        else
+            clients_normal += clientAllocSize(client);
+    }
+    addReplyBulkCString(c,"clients.slaves");
+    addReplyLongLong(c,clients_slaves);
+    addReplyBulkCString(c,"clients.normal");
+    addReplyLongLong(c,clients_normal);
+    overhead += clients_slaves + clients_normal;
+    pairs += 2;
+
+    // AOF缓冲区以及AOF重写缓冲区
+    mem = sdsAllocSize(server.aof_buf) + aofRewriteBufferSize();
+    addReplyBulkCString(c,"aof.buffer");
+    addReplyLongLong(c,mem);
+    overhead += mem;
+    pairs++;
+
+    // 每个数据库的键空间字典、过期字典以及前缀索引的结构开销
+    for (j = 0; j < server.dbnum; j++) {
+        redisDb *db = server.db+j;
+        size_t mem_main, mem_expires, mem_index;
+
+        if (dictSize(db->dict) == 0) continue;
+        keys += dictSize(db->dict);
+        mem_main = dictAllocSize(db->dict);
+        mem_expires = dictAllocSize(db->expires);
+        mem_index = scanIndexAllocSize(db);
+        addReplyBulkSds(c,sdscatprintf(sdsempty(),"db.%d",j));
+        addReplyMultiBulkLen(c,6);
+        addReplyBulkCString(c,"overhead.hashtable.main");
+        addReplyLongLong(c,mem_main);
+        addReplyBulkCString(c,"overhead.hashtable.expires");
+        addReplyLongLong(c,mem_expires);
+        addReplyBulkCString(c,"overhead.prefix-index");
+        addReplyLongLong(c,mem_index);
+        overhead += mem_main + mem_expires + mem_index;
+        pairs++;
+    }
+
+    if (overhead > used) overhead = used;
+    addReplyBulkCString(c,"overhead.total");
+    addReplyLongLong(c,overhead);
+    addReplyBulkCString(c,"keys.count");
+    addReplyLongLong(c,keys);
+    addReplyBulkCString(c,"keys.bytes-per-key");
+    addReplyLongLong(c,keys ? (used-overhead)/keys : 0);
+    addReplyBulkCString(c,"dataset.bytes");
+    addReplyLongLong(c,used-overhead);
+    addReplyBulkCString(c,"dataset.percentage");
+    addReplyDouble(c,used ? (double)(used-overhead)*100/used : 0);
+    pairs += 5;
+
+    setDeferredMultiBulkLength(c,replylen,pairs*2);
+}
+
+/* The MEMORY command.
+ * Usage: MEMORY USAGE <key> [SAMPLES <count>]
+ *        MEMORY STATS */
+/*  MEMORY命令的实现。
+    MEMORY USAGE返回key及其值占用的内存字节数的估计值，SAMPLES指定聚合类型采样的元素个数，0表示计算所有元素；
+    MEMORY STATS返回服务器内存使用情况的分类统计。 */
+void memoryCommand(redisClient *c) {
+    if (!strcasecmp(c->argv[1]->ptr,"usage") && c->argc >= 3) {
+        long long samples = REDIS_MEMORY_DEFAULT_SAMPLES;
+        dictEntry *de;
+        void *v;
+        size_t usage;
+        int j;
+
+        for (j = 3; j < c->argc; j++) {
+            if (!strcasecmp(c->argv[j]->ptr,"samples") && j+1 < c->argc) {
+                if (getLongLongFromObjectOrReply(c,c->argv[j+1],&samples,NULL)
+                    == REDIS_ERR) return;
+                if (samples < 0) {
+                    addReply(c,shared.syntaxerr);
+                    return;
+                }
+                j++;
+            } else {
+                addReply(c,shared.syntaxerr);
+                return;
+            }
+        }
+        // 直接查找字典节点：不修改lru字段，也不解包打包的值
+        if ((de = dictFind(c->db->dict,c->argv[2]->ptr)) == NULL) {
+            addReply(c,shared.nullbulk);
+            return;
+        }
+        // 打包的值保存在字典节点的值指针中，不占用额外的内存
+        v = dictGetVal(de);
+        usage = objectIsPacked(v) ? 0 : objectComputeSize(v,samples);
+        usage += sdsAllocSize(dictGetKey(de)) + sizeof(dictEntry);
+        // 过期字典与键空间共享key，只需要计算节点
+        if (dictFind(c->db->expires,c->argv[2]->ptr) != NULL)
+            usage += sizeof(dictEntry);
+        addReplyLongLong(c,usage);
+    } else if (!strcasecmp(c->argv[1]->ptr,"stats") && c->argc == 2) {
+        memoryStatsCommand(c);
+    } else {
+        addReplyError(c,"Syntax error. Try MEMORY (usage <key> [samples <count>]|stats)");
+    }
+}
@@ -0,0 +1,573 @@
+/* patindex.c - Index of glob-style patterns by literal prefix.
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "patindex.h"
+#include "dict.h"
+#include "zmalloc.h"
+#include "util.h"
+
+/* Every string matching a pattern starts with the pattern's literal prefix,
+ * that is, the characters before the first '*', '?' or '[' (with the
+ * backslash escapes resolved). Patterns are stored in a radix tree keyed by
+ * that prefix: the patterns that may match a string are only the ones
+ * hanging from the nodes along the path of the string itself, and only the
+ * part of the pattern after the prefix needs to be matched.
+ *
+ * Patterns without wildcards are matched by the walk alone, patterns
+ * starting with a wildcard hang from the root and are matched against every
+ * string.
+ *
+ * 匹配某个模式的字符串一定以该模式的字面前缀开头，字面前缀即第一个'*'、'?'或'['之前的字符（反斜杠转义
+ * 已经被解析）。模式以字面前缀为key保存在一棵基数树中：可能匹配字符串s的模式只会挂在s自己经过的路径上，
+ * 并且只需要对模式中前缀之后的部分做匹配。
+ * 不含通配符的模式仅通过路径本身就可以判断是否匹配，以通配符开头的模式挂在根节点上，要和每个字符串做匹配。 */
+
+typedef struct patIndexNode patIndexNode;
+
+/* 索引中的一个模式 */
+typedef struct patIndexEntry {
+    // 模式本身，同时也是patterns字典的key
+    sds pattern;
+    // 调用者关联的指针
+    void *value;
+    // 字面前缀在模式中占用的字节数（包括转义用的反斜杠）
+    size_t rawoff;
+    // 模式是否不含通配符
+    int literal;
+    // 模式所在的节点
+    patIndexNode *node;
+    // 同一节点上同类模式组成的双向链表
+    struct patIndexEntry *prev, *next;
+} patIndexEntry;
+
+/* 基数树节点，从根节点到该节点路径上的label连接起来即为挂在该节点上的模式的字面前缀 */
+struct patIndexNode {
+    patIndexNode *parent;
+    // 父节点到本节点的边
+    unsigned char *label;
+    size_t labellen;
+    // 子节点数组，按照label的第一个字节升序排列
+    patIndexNode **children;
+    unsigned int numchildren;
+    // 不含通配符、且解析转义后等于该前缀的模式（例如"x"和"\\x"）
+    patIndexEntry *exact;
+    // 字面前缀为该前缀的通配模式
+    patIndexEntry *globs;
+};
+
+struct patIndex {
+    patIndexNode *root;
+    // 模式到patIndexEntry的映射，用于去重和删除
+    dict *patterns;
+};
+
+static unsigned int patIndexHashPattern(const void *key) {
+    return dictGenHashFunction(key,(int)sdslen((sds)key));
+}
+
+static int patIndexComparePatterns(void *privdata, const void *key1,
+                                   const void *key2)
+{
+    size_t l1 = sdslen((sds)key1), l2 = sdslen((sds)key2);
+
+    DICT_NOTUSED(privdata);
+    return l1 == l2 && memcmp(key1,key2,l1) == 0;
+}
+
+/* Keys and values are owned by the entries: no destructors. */
+static dictType patIndexDictType = {
+    patIndexHashPattern,        /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    patIndexComparePatterns,    /* key compare */
+    NULL,                       /* key destructor */
+    NULL                        /* val destructor */
+};
+
+/* ----------------------------- Radix tree -------------------------------- */
+
+static patIndexNode *patIndexNodeCreate(patIndexNode *parent,
+                                        const unsigned char *label,
+                                        size_t labellen)
+{
+    patIndexNode *n = zcalloc(sizeof(*n));
+
+    n->parent = parent;
+    if (labellen) {
+        n->label = zmalloc(labellen);
+        memcpy(n->label,label,labellen);
+        n->labellen = labellen;
+    }
+    return n;
+}
+
+static void patIndexNodeFree(patIndexNode *n) {
+    zfree(n->label);
+    zfree(n->children);
+    zfree(n);
+}
+
+/* Return the position of the child whose label starts with 'c', or the
+ * position where it should be inserted, setting *found accordingly. */
+/* 二分查找label以c开头的子节点，返回它的位置；如果不存在返回应该插入的位置。*found表示是否找到 */
+static unsigned int patIndexChildPos(patIndexNode *n, unsigned char c,
+                                     int *found)
+{
+    unsigned int lo = 0, hi = n->numchildren;
+
+    while (lo < hi) {
+        unsigned int mid = (lo+hi)/2;
+        unsigned char mc = n->children[mid]->label[0];
+
+        if (mc == c) {
+            *found = 1;
+            return mid;
+        }
+        if (mc < c) lo = mid+1; else hi = mid;
+    }
+    *found = 0;
+    return lo;
+}
+
+static void patIndexAddChild(patIndexNode *n, unsigned int pos,
+                             patIndexNode *child)
+{
+    n->children = zrealloc(n->children,sizeof(patIndexNode*)*(n->numchildren+1));
+    memmove(n->children+pos+1,n->children+pos,
+        sizeof(patIndexNode*)*(n->numchildren-pos));
+    n->children[pos] = child;
+    n->numchildren++;
+}
+
+static void patIndexRemoveChild(patIndexNode *n, patIndexNode *child) {
+    int found;
+    unsigned int pos = patIndexChildPos(n,child->label[0],&found);
+
+    memmove(n->children+pos,n->children+pos+1,
+        sizeof(patIndexNode*)*(n->numchildren-pos-1));
+    n->numchildren--;
+}
+
+/* Return the node for the prefix 'p', creating it (and splitting the edge
+ * it falls in) when needed. */
+/* 返回前缀p对应的节点，如果不存在则创建它，必要时将其所在的边一分为二 */
+static patIndexNode *patIndexInsertPrefix(patIndex *pi, const unsigned char *p,
+                                          size_t plen)
+{
+    patIndexNode *node = pi->root;
+    size_t i = 0;
+
+    while (i < plen) {
+        int found;
+        unsigned int pos = patIndexChildPos(node,p[i],&found);
+        patIndexNode *child;
+        size_t common = 0;
+
+        if (!found) {
+            child = patIndexNodeCreate(node,p+i,plen-i);
+            patIndexAddChild(node,pos,child);
+            return child;
+        }
+        child = node->children[pos];
+        while (common < child->labellen && i+common < plen &&
+               child->label[common] == p[i+common]) common++;
+        if (common < child->labellen) {
+            /* The prefix ends or diverges inside the edge: split it. */
+            // 前缀在边的中间结束或者分叉，将边一分为二
+            patIndexNode *mid = patIndexNodeCreate(node,child->label,common);
+
+            memmove(child->label,child->label+common,child->labellen-common);
+            child->labellen -= common;
+            child->parent = mid;
+            patIndexAddChild(mid,0,child);
+            node->children[pos] = mid;
+            child = mid;
+        }
+        node = child;
+        i += common;
+    }
+    return node;
+}
+
+/* Remove the nodes left without patterns, merging the ones left with a
+ * single child into it, so that the tree stays compact. */
+/*  删除不再挂有任何模式的节点，如果节点只剩下一个子节点则和子节点合并，保持基数树的紧凑 */
+static void patIndexPrune(patIndexNode *node) {
+    while (node->parent && node->exact == NULL && node->globs == NULL) {
+        patIndexNode *parent = node->parent;
+
+        if (node->numchildren == 0) {
+            patIndexRemoveChild(parent,node);
+            patIndexNodeFree(node);
+            node = parent;
+        } else if (node->numchildren == 1) {
+            patIndexNode *child = node->children[0];
+            unsigned char *label = zmalloc(node->labellen+child->labellen);
+            int found;
+            unsigned int pos = patIndexChildPos(parent,node->label[0],&found);
+
+            memcpy(label,node->label,node->labellen);
+            memcpy(label+node->labellen,child->label,child->labellen);
+            zfree(child->label);
+            child->label = label;
+            child->labellen += node->labellen;
+            child->parent = parent;
+            parent->children[pos] = child;
+            patIndexNodeFree(node);
+            break;
+        } else {
+            break;
+        }
+    }
+}
+
+static void patIndexFreeEntries(patIndexEntry *e) {
+    patIndexEntry *next;
+
+    for (; e; e = next) {
+        next = e->next;
+        sdsfree(e->pattern);
+        zfree(e);
+    }
+}
+
+static void patIndexFreeNode(patIndexNode *n) {
+    unsigned int j;
+
+    for (j = 0; j < n->numchildren; j++) patIndexFreeNode(n->children[j]);
+    patIndexFreeEntries(n->globs);
+    patIndexFreeEntries(n->exact);
+    patIndexNodeFree(n);
+}
+
+/* ------------------------------- API ------------------------------------- */
+
+patIndex *patIndexCreate(void) {
+    patIndex *pi = zmalloc(sizeof(*pi));
+
+    pi->root = patIndexNodeCreate(NULL,NULL,0);
+    pi->patterns = dictCreate(&patIndexDictType,NULL);
+    return pi;
+}
+
+void patIndexRelease(patIndex *pi) {
+    dictRelease(pi->patterns);
+    patIndexFreeNode(pi->root);
+    zfree(pi);
+}
+
+/* Add 'pattern' associated with 'value', that must not be NULL. Returns 0
+ * if the pattern was already in the index, 1 otherwise. */
+int patIndexAdd(patIndex *pi, sds pattern, void *value) {
+    size_t len = sdslen(pattern), j = 0, plen = 0;
+    unsigned char *prefix;
+    patIndexEntry *e, **head;
+    patIndexNode *node;
+
+    if (dictFind(pi->patterns,pattern) != NULL) return 0;
+
+    /* Extract the literal prefix, resolving the escapes the same way
+     * stringmatchlen() does. */
+    // 提取字面前缀，反斜杠转义的处理方式和stringmatchlen相同
+    prefix = zmalloc(len ? len : 1);
+    while (j < len) {
+        char c = pattern[j];
+
+        if (c == '*' || c == '?' || c == '[') break;
+        if (c == '\\' && j+1 < len) c = pattern[++j];
+        prefix[plen++] = c;
+        j++;
+    }
+    node = patIndexInsertPrefix(pi,prefix,plen);
+    zfree(prefix);
+
+    e = zmalloc(sizeof(*e));
+    e->pattern = sdsdup(pattern);
+    e->value = value;
+    e->rawoff = j;
+    /* No wildcards: the pattern matches the prefix itself only. */
+    // 不含通配符，模式只匹配前缀本身
+    e->literal = (j == len);
+    e->node = node;
+    head = e->literal ? &node->exact : &node->globs;
+    e->prev = NULL;
+    e->next = *head;
+    if (*head) (*head)->prev = e;
+    *head = e;
+    dictAdd(pi->patterns,e->pattern,e);
+    return 1;
+}
+
+/* Remove 'pattern' from the index, returning its value, or NULL if the
+ * pattern was not there. */
+void *patIndexDelete(patIndex *pi, sds pattern) {
+    dictEntry *de = dictFind(pi->patterns,pattern);
+    patIndexEntry *e;
+    void *value;
+
+    if (de == NULL) return NULL;
+    e = dictGetVal(de);
+    dictDelete(pi->patterns,pattern);
+
+    if (e->prev)
+        e->prev->next = e->next;
+    else if (e->literal)
+        e->node->exact = e->next;
+    else
+        e->node->globs = e->next;
+    if (e->next) e->next->prev = e->prev;
+    patIndexPrune(e->node);
+    value = e->value;
+    sdsfree(e->pattern);
+    zfree(e);
+    return value;
+}
+
+void *patIndexFind(patIndex *pi, sds pattern) {
+    dictEntry *de = dictFind(pi->patterns,pattern);
+
+    return de ? ((patIndexEntry*)dictGetVal(de))->value : NULL;
+}
+
+/* Call 'proc' for every pattern matching the string 's', in no particular
+ * order. 'proc' must not modify the index. Returns the number of matching
+ * patterns. */
+/*  对每个与字符串s匹配的模式调用proc，调用顺序不确定，proc中不能修改索引。返回匹配的模式数量 */
+unsigned long patIndexMatch(patIndex *pi, const char *s, size_t len,
+                            patIndexMatchProc *proc, void *privdata)
+{
+    patIndexNode *node = pi->root;
+    unsigned long matches = 0;
+    size_t depth = 0;
+
+    while (1) {
+        patIndexEntry *e;
+        patIndexNode *child;
+        unsigned int pos;
+        int found;
+
+        /* The prefix of these patterns already matched: only match the
+         * rest of the pattern against the rest of the string. */
+        // 这些模式的前缀已经匹配，只需要用模式剩下的部分去匹配字符串剩下的部分
+        for (e = node->globs; e; e = e->next) {
+            if (stringmatchlen(e->pattern+e->rawoff,
+                               (int)(sdslen(e->pattern)-e->rawoff),
+                               s+depth,(int)(len-depth),0))
+            {
+                proc(privdata,e->value);
+                matches++;
+            }
+        }
+        if (depth == len) {
+            for (e = node->exact; e; e = e->next) {
+                proc(privdata,e->value);
+                matches++;
+            }
+            break;
+        }
+
+        pos = patIndexChildPos(node,(unsigned char)s[depth],&found);
+        if (!found) break;
+        child = node->children[pos];
+        if (child->labellen > len-depth ||
+            memcmp(child->label,s+depth,child->labellen) != 0) break;
+        depth += child->labellen;
+        node = child;
+    }
+    return matches;
+}
+
+unsigned long patIndexSize(patIndex *pi) {
+    return dictSize(pi->patterns);
+}
+
+/* 下面是一些测试代码 */
+#ifdef PATINDEX_TEST_MAIN
+#include <sys/time.h>
+#include <assert.h>
+
+static long long usec(void) {
+    struct timeval tv;
+    gettimeofday(&tv,NULL);
+    return (((long long)tv.tv_sec)*1000000)+tv.tv_usec;
+}
+
+static void countMatch(void *privdata, void *value) {
+    ((long*)privdata)[0]++;
+    ((long*)privdata)[1] += (long)value;
+}
+
+/* Brute force reference: what PUBLISH did before the index. */
+static void linearMatch(sds *pats, int n, const char *s, size_t len,
+                        long *res)
+{
+    int j;
+
+    for (j = 0; j < n; j++) {
+        if (pats[j] && stringmatchlen(pats[j],(int)sdslen(pats[j]),
+                                      s,(int)len,0))
+        {
+            res[0]++;
+            res[1] += j+1;
+        }
+    }
+}
+
+static sds randomPattern(void) {
+    static const char *pieces[] = {"a","b","ab","ba","*","?","[ab]","\\*",
+                                   "\\","news.","x"};
+    sds p = sdsempty();
+    int parts = rand()%5, j;
+
+    for (j = 0; j < parts; j++)
+        p = sdscat(p,pieces[rand()%(sizeof(pieces)/sizeof(*pieces))]);
+    return p;
+}
+
+static sds randomChannel(void) {
+    static const char chars[] = "ab*\\.x";
+    sds s = sdsempty();
+    int len = rand()%7, j;
+
+    for (j = 0; j < len; j++) s = sdscatlen(s,&chars[rand()%6],1);
+    return s;
+}
+
+/* Pattern mix for the benchmark: mostly prefixed subscriptions, with some
+ * without a prefix that must be matched against every channel. */
+static sds benchPattern(int i) {
+    switch(i % 16) {
+    case 0: return sdscatprintf(sdsempty(),"*.%d.alert",i);
+    case 1: case 2: case 3: return sdscatprintf(sdsempty(),"user:%d:*",i);
+    case 4: case 5: return sdscatprintf(sdsempty(),"chat.room%d.?",i);
+    default: return sdscatprintf(sdsempty(),"news.%d.*",i);
+    }
+}
+
+int main(int argc, char **argv) {
+    static const int counts[] = {100, 1000, 5000, 20000};
+    int publishes = (argc > 1) ? atoi(argv[1]) : 20000;
+    unsigned int c;
+    int i, j;
+
+    srand(1234);
+
+    printf("Random patterns against brute force: "); {
+        sds pats[64];
+        patIndex *pi = patIndexCreate();
+
+        memset(pats,0,sizeof(pats));
+        for (i = 0; i < 200000; i++) {
+            int slot = rand()%64;
+            sds s = randomChannel();
+            long a[2] = {0,0}, b[2] = {0,0};
+
+            if (pats[slot] == NULL) {
+                sds p = randomPattern();
+                if (patIndexAdd(pi,p,(void*)(long)(slot+1)) == 1) {
+                    pats[slot] = p;
+                } else {
+                    assert(patIndexFind(pi,p) != NULL);
+                    sdsfree(p);
+                }
+            } else if (rand()%3 == 0) {
+                assert(patIndexDelete(pi,pats[slot]) == (void*)(long)(slot+1));
+                assert(patIndexFind(pi,pats[slot]) == NULL);
+                sdsfree(pats[slot]);
+                pats[slot] = NULL;
+            }
+            patIndexMatch(pi,s,sdslen(s),countMatch,a);
+            linearMatch(pats,64,s,sdslen(s),b);
+            assert(a[0] == b[0] && a[1] == b[1]);
+            sdsfree(s);
+        }
+        for (i = 0; i < 64; i++) {
+            if (pats[i]) {
+                patIndexDelete(pi,pats[i]);
+                sdsfree(pats[i]);
+            }
+        }
+        assert(patIndexSize(pi) == 0);
+        assert(pi->root->numchildren == 0);
+        patIndexRelease(pi);
+        printf("OK\n");
+    }
+
+    printf("\nPUBLISH pattern matching, %d channels:\n", publishes);
+    printf("%10s %14s %14s %10s\n","patterns","linear us/op","index us/op",
+        "matches");
+    for (c = 0; c < sizeof(counts)/sizeof(*counts); c++) {
+        int n = counts[c];
+        sds *pats = zmalloc(sizeof(sds)*n);
+        sds *chans = zmalloc(sizeof(sds)*publishes);
+        patIndex *pi = patIndexCreate();
+        long a[2] = {0,0}, b[2] = {0,0};
+        long long start, tlinear, tindex;
+
+        for (i = 0; i < n; i++) {
+            pats[i] = benchPattern(i);
+            patIndexAdd(pi,pats[i],(void*)(long)(i+1));
+        }
+        for (j = 0; j < publishes; j++) {
+            int r = rand()%n;
+            switch(j % 4) {
+            case 0: chans[j] = sdscatprintf(sdsempty(),"news.%d.sports",r); break;
+            case 1: chans[j] = sdscatprintf(sdsempty(),"user:%d:inbox",r); break;
+            case 2: chans[j] = sdscatprintf(sdsempty(),"x.%d.alert",r); break;
+            default: chans[j] = sdscatprintf(sdsempty(),"other.%d",r); break;
+            }
+        }
+
+        start = usec();
+        for (j = 0; j < publishes; j++)
+            linearMatch(pats,n,chans[j],sdslen(chans[j]),b);
+        tlinear = usec()-start;
+        start = usec();
+        for (j = 0; j < publishes; j++)
+            patIndexMatch(pi,chans[j],sdslen(chans[j]),countMatch,a);
+        tindex = usec()-start;
+        assert(a[0] == b[0] && a[1] == b[1]);
+
+        printf("%10d %14.3f %14.3f %10ld\n", n,
+            (double)tlinear/publishes, (double)tindex/publishes, a[0]);
+
+        for (i = 0; i < n; i++) sdsfree(pats[i]);
+        for (j = 0; j < publishes; j++) sdsfree(chans[j]);
+        zfree(pats);
+        zfree(chans);
+        patIndexRelease(pi);
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,62 @@
+/* patindex.h - Index of glob-style patterns by literal prefix.
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __PATINDEX_H
+#define __PATINDEX_H
+
+#include "sds.h"
+
+/*  patIndex保存一组互不相同的glob风格模式（与stringmatchlen的语法相同），每个模式关联一个调用者的指针。
+    模式按照其字面前缀（第一个通配符之前的部分）保存在一棵基数树中，查找与某个字符串匹配的模式时，
+    只需要沿着该字符串往下走，对路径上挂着的模式做匹配即可，而不需要遍历所有模式。
+    没有字面前缀的模式（例如"*foo"）挂在根节点上，对每个字符串都要做一次匹配。 */
+
+typedef struct patIndex patIndex;
+
+/* 匹配回调：value为模式关联的指针 */
+typedef void patIndexMatchProc(void *privdata, void *value);
+
+/* 创建一个空的索引 */
+patIndex *patIndexCreate(void);
+/* 释放索引，不会释放模式关联的指针 */
+void patIndexRelease(patIndex *pi);
+/* 添加模式pattern并关联value，如果模式已经存在返回0，否则返回1 */
+int patIndexAdd(patIndex *pi, sds pattern, void *value);
+/* 删除模式pattern，返回它关联的指针，如果模式不存在返回NULL */
+void *patIndexDelete(patIndex *pi, sds pattern);
+/* 返回模式pattern关联的指针，如果模式不存在返回NULL */
+void *patIndexFind(patIndex *pi, sds pattern);
+/* 对每一个与字符串s匹配的模式调用proc，返回匹配的模式数量 */
+unsigned long patIndexMatch(patIndex *pi, const char *s, size_t len,
+                            patIndexMatchProc *proc, void *privdata);
+/* 返回索引中的模式数量 */
+unsigned long patIndexSize(patIndex *pi);
+
+#endif
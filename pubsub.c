@@ -28,6 +28,7 @@
  */
 
 #include "redis.h"
+#include "patindex.h"
 
 /*-----------------------------------------------------------------------------
  * Pubsub low level API    发布（Publish）订阅（Subscribe）底层API
@@ -53,6 +54,188 @@ int listMatchPubsubPattern(void *a, void *b) {
            (equalStringObjects(pa->pattern,pb->pattern));
 }
 
+/* Pattern subscriptions are kept both in server.pubsub_patterns, in
+ * subscription order, and in an index of the distinct patterns (see
+ * patindex.c) so that PUBLISH only matches the channel against the patterns
+ * that share its literal prefix, instead of all of them. Every distinct
+ * pattern is associated with the list of its subscriptions. */
+/*  模式订阅既按照订阅的先后顺序保存在server.pubsub_patterns链表中，也保存在一个以互不相同的模式为key的
+    索引中（见patindex.c），这样PUBLISH只需要用频道去匹配那些与它字面前缀相同的模式，而不需要匹配所有模式。
+    索引中的每个模式关联一个链表，保存订阅了该模式的所有订阅记录。 */
+
+/* 索引中的一个订阅记录 */
+typedef struct pubsubPatternSub {
+    // server.pubsub_patterns链表中相应的记录及其节点
+    pubsubPattern *pat;
+    listNode *ln;
+    // 订阅的序号，用来按照订阅的先后顺序发送消息
+    unsigned long long id;
+} pubsubPatternSub;
+
+static patIndex *pubsub_pattern_index = NULL;
+static unsigned long long pubsub_pattern_next_id = 0;
+
+/* A matching subscription, with the message already encoded for it. */
+/* 一个匹配的订阅记录，以及为它编码好的消息 */
+typedef struct pubsubMatch {
+    pubsubPatternSub *sub;
+    robj *payload;
+} pubsubMatch;
+
+/* PUBLISH collects here the subscriptions of the matching patterns. */
+// PUBLISH将匹配的模式的订阅记录收集到这个数组中
+static pubsubMatch *pubsub_matches = NULL;
+static size_t pubsub_matches_len = 0, pubsub_matches_size = 0;
+
+/* The channel and message being published, see pubsubCollectPatternSubs(). */
+typedef struct pubsubPublishing {
+    robj *channel;
+    robj *message;
+} pubsubPublishing;
+
+/* The subscribers of a channel are a dict of clients (without values), so
+ * that a client can be removed in O(1). The key is the client pointer. */
+/* 订阅某个频道的客户端保存在一个字典中（没有值），以客户端指针为key，这样删除一个客户端只需要O(1) */
+static unsigned int pubsubHashClient(const void *key) {
+    return dictGenHashFunction(&key,sizeof(key));
+}
+
+static dictType pubsubClientsDictType = {
+    pubsubHashClient,           /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    NULL,                       /* key compare: pointers */
+    NULL,                       /* key destructor */
+    NULL                        /* val destructor */
+};
+
+/* Append 'o', that must be a decoded string object, as a bulk. */
+/* 将字符串对象o（必须是解码后的）以bulk格式追加到s后面 */
+static sds pubsubCatBulk(sds s, robj *o) {
+    s = sdscatfmt(s,"$%U\r\n",(unsigned long long)sdslen(o->ptr));
+    s = sdscatlen(s,o->ptr,sdslen(o->ptr));
+    return sdscatlen(s,"\r\n",2);
+}
+
+/* Encode the whole message a subscriber receives, "message" (or "pmessage"
+ * when 'pattern' is not NULL) followed by the channel and the message, into
+ * a single string object.
+ *
+ * Every subscriber is sent the same object: addReply() copies the already
+ * encoded bytes into the static buffer of the client, or, when they don't
+ * fit, links the object itself into the reply list incrementing its
+ * reference count. An object in a reply list that is shared is never
+ * modified: dupLastObjectIfNeeded() copies it before appending to it. So
+ * the framing is serialized once per PUBLISH, not once per subscriber. */
+/*  将订阅者收到的整条消息编码到一个字符串对象中：开头是"message"（pattern不为NULL时是"pmessage"），
+    然后是频道和消息内容。
+    所有订阅者发送同一个对象：addReply()会把已经编码好的数据拷贝到客户端的静态缓冲区中，如果放不下，
+    则直接将对象本身加入回复链表并增加它的引用计数。回复链表中被共享的对象永远不会被修改，
+    dupLastObjectIfNeeded()会在追加数据之前复制它。这样每次PUBLISH只需要编码一次，而不是每个订阅者编码一次。 */
+static robj *pubsubCreatePayload(robj *pattern, robj *channel, robj *message) {
+    robj *msg = getDecodedObject(message);
+    size_t patlen = pattern ? sdslen(pattern->ptr) : 0;
+    sds s = sdsMakeRoomFor(sdsempty(),
+        96+patlen+sdslen(channel->ptr)+sdslen(msg->ptr));
+
+    if (pattern) {
+        s = sdscatlen(s,"*4\r\n",4);
+        s = sdscatsds(s,shared.pmessagebulk->ptr);
+        s = pubsubCatBulk(s,pattern);
+    } else {
+        s = sdscatlen(s,"*3\r\n",4);
+        s = sdscatsds(s,shared.messagebulk->ptr);
+    }
+    s = pubsubCatBulk(s,channel);
+    s = pubsubCatBulk(s,msg);
+    decrRefCount(msg);
+    return createObject(REDIS_STRING,s);
+}
+
+/* Add the subscription 'pat', stored at node 'ln' of server.pubsub_patterns,
+ * to the index. */
+/*  将server.pubsub_patterns中节点ln上的订阅记录pat添加到索引中 */
+static void pubsubIndexPattern(pubsubPattern *pat, listNode *ln) {
+    pubsubPatternSub *sub = zmalloc(sizeof(*sub));
+    list *subs;
+
+    if (pubsub_pattern_index == NULL) pubsub_pattern_index = patIndexCreate();
+    subs = patIndexFind(pubsub_pattern_index,pat->pattern->ptr);
+    if (subs == NULL) {
+        // 第一次有客户端订阅该模式
+        subs = listCreate();
+        listSetFreeMethod(subs,zfree);
+        patIndexAdd(pubsub_pattern_index,pat->pattern->ptr,subs);
+    }
+    sub->pat = pat;
+    sub->ln = ln;
+    sub->id = pubsub_pattern_next_id++;
+    listAddNodeTail(subs,sub);
+}
+
+/* Remove the subscription of client 'c' to 'pattern' from the index and
+ * from server.pubsub_patterns. */
+/*  将客户端c对模式pattern的订阅记录从索引以及server.pubsub_patterns链表中删除 */
+static void pubsubUnindexPattern(redisClient *c, robj *pattern) {
+    robj *decoded = getDecodedObject(pattern);
+    list *subs = patIndexFind(pubsub_pattern_index,decoded->ptr);
+    listNode *ln;
+    listIter li;
+
+    listRewind(subs,&li);
+    while ((ln = listNext(&li)) != NULL) {
+        pubsubPatternSub *sub = ln->value;
+
+        if (sub->pat->client == c) {
+            listDelNode(server.pubsub_patterns,sub->ln);
+            listDelNode(subs,ln);
+            break;
+        }
+    }
+    // 已经没有客户端订阅该模式，将它从索引中删除
+    if (listLength(subs) == 0) {
+        patIndexDelete(pubsub_pattern_index,decoded->ptr);
+        listRelease(subs);
+    }
+    decrRefCount(decoded);
+}
+
+/* patIndexMatch() callback: collect the subscriptions of a pattern, all
+ * referencing the message encoded once for the pattern. */
+/* patIndexMatch()的回调函数：收集一个模式的所有订阅记录，它们共享为该模式编码一次的消息 */
+static void pubsubCollectPatternSubs(void *privdata, void *value) {
+    pubsubPublishing *pub = privdata;
+    list *subs = value;
+    robj *payload;
+    listNode *ln;
+    listIter li;
+
+    if (pubsub_matches_len+listLength(subs) > pubsub_matches_size) {
+        pubsub_matches_size = (pubsub_matches_len+listLength(subs))*2;
+        pubsub_matches = zrealloc(pubsub_matches,
+            sizeof(pubsubMatch)*pubsub_matches_size);
+    }
+    ln = listFirst(subs);
+    payload = pubsubCreatePayload(((pubsubPatternSub*)ln->value)->pat->pattern,
+        pub->channel,pub->message);
+    listRewind(subs,&li);
+    while ((ln = listNext(&li)) != NULL) {
+        pubsub_matches[pubsub_matches_len].sub = ln->value;
+        pubsub_matches[pubsub_matches_len].payload = payload;
+        incrRefCount(payload);
+        pubsub_matches_len++;
+    }
+    decrRefCount(payload);
+}
+
+static int pubsubComparePatternSubs(const void *a, const void *b) {
+    const pubsubPatternSub *sa = ((pubsubMatch*)a)->sub,
+                           *sb = ((pubsubMatch*)b)->sub;
+
+    if (sa->id == sb->id) return 0;
+    return (sa->id < sb->id) ? -1 : 1;
+}
+
 /* Return the number of channels + patterns a client is subscribed to. */
 /*	统计该客户端订阅的频道和模式数量之和	*/
 int clientSubscriptionsCount(redisClient *c) {
@@ -65,7 +248,7 @@ int clientSubscriptionsCount(redisClient *c) {
 /*	频道订阅，即设置客户端订阅频道，如果操作成功返回1，如果该客户端已经订阅了指定频道则返回0 	*/
 int pubsubSubscribeChannel(redisClient *c, robj *channel) {
     dictEntry *de;
-    list *clients = NULL;
+    dict *clients = NULL;
     int retval = 0;
 
     /* Add the channel to the client -> channels hash table */
@@ -79,14 +262,14 @@ int pubsubSubscribeChannel(redisClient *c, robj *channel) {
         de = dictFind(server.pubsub_channels,channel);
         if (de == NULL) {
         	// 频道不存在，则将其加入server.pubsub_channels中
-            clients = listCreate();
+            clients = dictCreate(&pubsubClientsDictType,NULL);
             dictAdd(server.pubsub_channels,channel,clients);
             incrRefCount(channel);
         } else {
             clients = dictGetVal(de);
         }
-        // 将客户端添加到指定频道对应的客户端链表中
-        listAddNodeTail(clients,c);
+        // 将客户端添加到指定频道对应的客户端字典中
+        dictAdd(clients,c,NULL);
     }
     /* Notify the client */
     // 回复客户端
@@ -102,9 +285,8 @@ int pubsubSubscribeChannel(redisClient *c, robj *channel) {
 /*	退订频道，即取消客户端对某频道的订阅。如果操作成功返回1，如果该客户端没有订阅该频道则返回0	*/
 int pubsubUnsubscribeChannel(redisClient *c, robj *channel, int notify) {
     dictEntry *de;
-    list *clients;
-    listNode *ln;
-    int retval = 0;
+    dict *clients;
+    int retval = 0, deleted;
 
     /* Remove the channel from the client -> channels hash table */
     incrRefCount(channel); /* channel may be just a pointer to the same object
@@ -115,17 +297,15 @@ int pubsubUnsubscribeChannel(redisClient *c, robj *channel, int notify) {
         /* Remove the client from the channel -> clients list hash table */
         /* 将客户端从server.pubsub_channels字典中移除	*/
 
-        // 找到订阅该频道的客户端链表
+        // 找到订阅该频道的客户端字典
         de = dictFind(server.pubsub_channels,channel);
         redisAssertWithInfo(c,NULL,de != NULL);
         clients = dictGetVal(de);
-        // 在链表中查找该客户端
-        ln = listSearchKey(clients,c);
-        redisAssertWithInfo(c,NULL,ln != NULL);
-        // 移除客户端
-        listDelNode(clients,ln);
-        // 如果订阅该频道的客户端链表为空，则删除之
-        if (listLength(clients) == 0) {
+        // 移除客户端，不需要再遍历整个链表
+        deleted = dictDelete(clients,c);
+        redisAssertWithInfo(c,NULL,deleted == DICT_OK);
+        // 如果订阅该频道的客户端字典为空，则删除之
+        if (dictSize(clients) == 0) {
             /* Free the list and associated hash entry at all if this was
              * the latest client, so that it will be possible to abuse
              * Redis PUBSUB creating millions of channels. */
@@ -164,8 +344,9 @@ int pubsubSubscribePattern(redisClient *c, robj *pattern) {
         pat = zmalloc(sizeof(*pat));
         pat->pattern = getDecodedObject(pattern);
         pat->client = c;
-        // 将pubsubPattern结构添加到server.pubsub_patterns链表中
+        // 将pubsubPattern结构添加到server.pubsub_patterns链表中，并加入索引
         listAddNodeTail(server.pubsub_patterns,pat);
+        pubsubIndexPattern(pat,listLast(server.pubsub_patterns));
     }
     /* Notify the client */
     // 回复客户端
@@ -184,7 +365,6 @@ int pubsubSubscribePattern(redisClient *c, robj *pattern) {
 /*	退订模式，即取消客户端对某模式的订阅。如果取消成功返回1，如果客户端并没有订阅该模式则返回0。*/
 int pubsubUnsubscribePattern(redisClient *c, robj *pattern, int notify) {
     listNode *ln;
-    pubsubPattern pat;
     int retval = 0;
 
     incrRefCount(pattern); /* Protect the object. May be the same we remove */
@@ -194,11 +374,8 @@ int pubsubUnsubscribePattern(redisClient *c, robj *pattern, int notify) {
         retval = 1;
         // 从c->pubsub_patterns链表中删除该模式
         listDelNode(c->pubsub_patterns,ln);
-        pat.client = c;
-        pat.pattern = pattern;
-        // 从server.pubsub_patterns链表中删除该模式
-        ln = listSearchKey(server.pubsub_patterns,&pat);
-        listDelNode(server.pubsub_patterns,ln);
+        // 从索引以及server.pubsub_patterns链表中删除该订阅记录，不需要再遍历整个链表
+        pubsubUnindexPattern(c,pattern);
     }
     /* Notify the client */
     // 回复客户端
@@ -277,60 +454,57 @@ int pubsubUnsubscribeAllPatterns(redisClient *c, int notify) {
 int pubsubPublishMessage(robj *channel, robj *message) {
     int receivers = 0;
     dictEntry *de;
-    listNode *ln;
-    listIter li;
 
+    channel = getDecodedObject(channel);
     /* Send to clients listening for that channel */
-    // 取出订阅指定频道的客户端链表
+    // 取出订阅指定频道的客户端字典
     de = dictFind(server.pubsub_channels,channel);
     if (de) {
-        list *list = dictGetVal(de);
-        listNode *ln;
-        listIter li;
-
-        listRewind(list,&li);
-        // 遍历该客户端链表，并将消息逐一发送给这些客户端
-        while ((ln = listNext(&li)) != NULL) {
-            redisClient *c = ln->value;
-
-            // 发送消息
-            addReply(c,shared.mbulkhdr[3]);
-            // 回复“message”字符串
-            addReply(c,shared.messagebulk);
-            // 回复消息的来源频道
-            addReplyBulk(c,channel);
-            // 回复消息内容
-            addReplyBulk(c,message);
+        dict *clients = dictGetVal(de);
+        dictIterator *di = dictGetIterator(clients);
+        // 消息只编码一次，所有客户端共享同一个对象
+        robj *payload = pubsubCreatePayload(NULL,channel,message);
+
+        // 遍历该客户端字典，并将消息逐一发送给这些客户端
+        while ((de = dictNext(di)) != NULL) {
+            addReply(dictGetKey(de),payload);
             // 统计接收客户端的数量
             receivers++;
         }
+        dictReleaseIterator(di);
+        decrRefCount(payload);
     }
     /* Send to clients listening to matching channels */
     // 将消息发送个订阅了和指定频道匹配的模式的客户端
     if (listLength(server.pubsub_patterns)) {
-        listRewind(server.pubsub_patterns,&li);
-        channel = getDecodedObject(channel);
-        // 遍历server.pubsub_patterns
-        while ((ln = listNext(&li)) != NULL) {
-        	// 取出当前模式
-            pubsubPattern *pat = ln->value;
-
-            // 判断当前模式是否和给定频道相匹配
-            if (stringmatchlen((char*)pat->pattern->ptr,
-                                sdslen(pat->pattern->ptr),
-                                (char*)channel->ptr,
-                                sdslen(channel->ptr),0)) {
-            	// 发送消息
-                addReply(pat->client,shared.mbulkhdr[4]);
-                addReply(pat->client,shared.pmessagebulk);
-                addReplyBulk(pat->client,pat->pattern);
-                addReplyBulk(pat->client,channel);
-                addReplyBulk(pat->client,message);
-                receivers++;
-            }
+        pubsubPublishing pub;
+        size_t j;
+
+        /* Ask the index for the matching patterns only. Messages are sent
+         * in subscription order, as when the whole list was scanned: the
+         * subscriptions of a single pattern are already in order, the ones
+         * of different patterns need to be sorted. */
+        // 只从索引中取出与频道匹配的模式。消息按照订阅的先后顺序发送，与遍历整个链表时的顺序相同：
+        // 同一个模式的订阅记录本来就是有序的，只有匹配多个模式时才需要排序
+        pub.channel = channel;
+        pub.message = message;
+        pubsub_matches_len = 0;
+        if (patIndexMatch(pubsub_pattern_index,channel->ptr,
+                          sdslen(channel->ptr),pubsubCollectPatternSubs,
+                          &pub) > 1)
+        {
+            qsort(pubsub_matches,pubsub_matches_len,
+                sizeof(pubsubMatch),pubsubComparePatternSubs);
+        }
+        for (j = 0; j < pubsub_matches_len; j++) {
+            // 发送消息
+            addReply(pubsub_matches[j].sub->pat->client,
+                pubsub_matches[j].payload);
+            decrRefCount(pubsub_matches[j].payload);
+            receivers++;
         }
-        decrRefCount(channel);
     }
+    decrRefCount(channel);
     return receivers;
 }
 
@@ -433,10 +607,10 @@ void pubsubCommand(redisClient *c) {
 
         addReplyMultiBulkLen(c,(c->argc-2)*2);
         for (j = 2; j < c->argc; j++) {
-            list *l = dictFetchValue(server.pubsub_channels,c->argv[j]);
+            dict *d = dictFetchValue(server.pubsub_channels,c->argv[j]);
 
             addReplyBulk(c,c->argv[j]);
-            addReplyLongLong(c,l ? listLength(l) : 0);
+            addReplyLongLong(c,d ? dictSize(d) : 0);
         }
     } 
     // 处理PUBSUB NUMPA命令
@@ -0,0 +1,1038 @@
+/* quicklist.c - A generic doubly linked list of listpacks
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include "quicklist.h"
+#include "zmalloc.h"
+#include "listpack.h"
+#include "ziplist.h"
+#include "util.h"
+
+/*********************************************************************************
+    quicklist是list类型的底层实现。listpack内存紧凑但插入、删除需要内存重分配，元素较多时
+    代价很高；adlist插入删除高效，但每个元素都需要一个listNode和一个robj，内存开销很大。
+    quicklist将两者结合：用adlist把多个大小受限的listpack串联起来，每个listpack只保存一部分元素。
+
+    每个listpack的大小由fill值控制：
+        fill > 0 ：每个listpack最多保存fill个元素（同时受SIZE_SAFETY_LIMIT字节数的限制）
+        fill < 0 ：每个listpack的字节数上限，-1~-5分别对应4KB、8KB、16KB、32KB、64KB
+ ************************************************************************************/
+
+/* Optimization levels for size-based filling */
+/* fill为负数时对应的listpack字节数上限 */
+static const size_t optimization_level[] = {4096, 8192, 16384, 32768, 65536};
+
+/* Maximum size in bytes of any multi-element listpack.
+ * Larger values will live in their own isolated listpacks. */
+/* 按元素个数限制时，listpack的字节数仍不能超过该值，过大的元素会单独放在一个listpack中 */
+#define SIZE_SAFETY_LIMIT 8192
+
+/* fill值的上限 */
+#define FILL_MAX (1 << 15)
+
+/* 默认fill值 */
+#define QUICKLIST_DEFAULT_FILL -2
+
+/* 释放一个quicklistNode，作为adlist的free回调 */
+static void quicklistNodeFree(void *ptr) {
+    quicklistNode *node = ptr;
+    lpFree(node->lp);
+    zfree(node);
+}
+
+/* Create a new quicklist with the specified fill factor. */
+/* 创建一个空的quicklist，fill参数指定单个ziplist的大小限制 */
+quicklist *quicklistNew(int fill) {
+    quicklist *quicklist;
+
+    quicklist = zmalloc(sizeof(*quicklist));
+    quicklist->nodes = listCreate();
+    // 删除adlist节点时自动释放其中的quicklistNode
+    listSetFreeMethod(quicklist->nodes,quicklistNodeFree);
+    quicklist->count = 0;
+    quicklistSetFill(quicklist,fill);
+    return quicklist;
+}
+
+/* Create a new quicklist using the default fill factor. */
+/* 创建一个空的quicklist，使用默认的fill值 */
+quicklist *quicklistCreate(void) {
+    return quicklistNew(QUICKLIST_DEFAULT_FILL);
+}
+
+/* 设置fill值，超出范围的值会被修正 */
+void quicklistSetFill(quicklist *quicklist, int fill) {
+    if (fill > FILL_MAX) {
+        fill = FILL_MAX;
+    } else if (fill < -5) {
+        fill = -5;
+    } else if (fill == 0) {
+        fill = 1;
+    }
+    quicklist->fill = fill;
+}
+
+/* Free entire quicklist. */
+/* 释放整个quicklist */
+void quicklistRelease(quicklist *quicklist) {
+    listRelease(quicklist->nodes);
+    zfree(quicklist);
+}
+
+/* 创建一个保存空listpack的quicklistNode */
+static quicklistNode *quicklistCreateNode(void) {
+    quicklistNode *node = zmalloc(sizeof(*node));
+    node->lp = lpNew();
+    node->sz = lpBytes(node->lp);
+    node->count = 0;
+    return node;
+}
+
+/* 更新quicklistNode中记录的listpack字节数 */
+#define quicklistNodeUpdateSz(node) do {                                       \
+    (node)->sz = lpBytes((node)->lp);                                          \
+} while (0)
+
+/* 检查字节数sz是否满足fill为负数时的大小限制 */
+static int _quicklistNodeSizeMeetsOptimizationRequirement(const size_t sz,
+                                                          const int fill) {
+    size_t offset;
+
+    if (fill >= 0) return 0;
+
+    offset = (-fill) - 1;
+    if (offset < (sizeof(optimization_level) / sizeof(*optimization_level))) {
+        return sz <= optimization_level[offset];
+    }
+    return 0;
+}
+
+/* Return 1 if a new entry of 'sz' bytes can be added to 'node' without
+ * violating the fill factor, 0 otherwise. */
+/*  检查往node中插入一个长度为sz的元素后是否仍满足fill的限制，满足返回1，否则返回0。
+    这里只是估算插入后listpack的大小：元素本身长度加上encoding及backlen字段的长度。 */
+static int _quicklistNodeAllowInsert(const quicklistNode *node, const int fill,
+                                     const size_t sz) {
+    size_t new_sz;
+
+    if (node == NULL) return 0;
+
+    new_sz = node->sz + lpEntrySizeUpperBound(sz);
+    if (_quicklistNodeSizeMeetsOptimizationRequirement(new_sz,fill))
+        return 1;
+    else if (new_sz > SIZE_SAFETY_LIMIT)
+        return 0;
+    else if ((int)node->count < fill)
+        return 1;
+    else
+        return 0;
+}
+
+/* Add new entry to head of quicklist.
+ *
+ * Returns 0 if used existing head.
+ * Returns 1 if new head created. */
+/*  往quicklist头部插入一个元素。如果头节点的listpack还有空间则直接插入，否则创建一个新的头节点。
+    使用已有头节点返回0，创建了新的头节点返回1。 */
+int quicklistPushHead(quicklist *quicklist, void *value, size_t sz) {
+    listNode *orig_head = listFirst(quicklist->nodes);
+    quicklistNode *node;
+
+    if (orig_head &&
+        _quicklistNodeAllowInsert(quicklistNodeOf(orig_head),quicklist->fill,sz))
+    {
+        node = quicklistNodeOf(orig_head);
+    } else {
+        node = quicklistCreateNode();
+        listAddNodeHead(quicklist->nodes,node);
+    }
+    node->lp = lpPush(node->lp,value,sz,LP_HEAD);
+    node->count++;
+    quicklistNodeUpdateSz(node);
+    quicklist->count++;
+    return (orig_head != listFirst(quicklist->nodes));
+}
+
+/* Add new entry to tail of quicklist.
+ *
+ * Returns 0 if used existing tail.
+ * Returns 1 if new tail created. */
+/*  往quicklist尾部插入一个元素。使用已有尾节点返回0，创建了新的尾节点返回1。 */
+int quicklistPushTail(quicklist *quicklist, void *value, size_t sz) {
+    listNode *orig_tail = listLast(quicklist->nodes);
+    quicklistNode *node;
+
+    if (orig_tail &&
+        _quicklistNodeAllowInsert(quicklistNodeOf(orig_tail),quicklist->fill,sz))
+    {
+        node = quicklistNodeOf(orig_tail);
+    } else {
+        node = quicklistCreateNode();
+        listAddNodeTail(quicklist->nodes,node);
+    }
+    node->lp = lpPush(node->lp,value,sz,LP_TAIL);
+    node->count++;
+    quicklistNodeUpdateSz(node);
+    quicklist->count++;
+    return (orig_tail != listLast(quicklist->nodes));
+}
+
+/* Wrapper to allow argument-based switching between HEAD/TAIL pop */
+/* 往quicklist头部或尾部插入一个元素，由参数where决定 */
+void quicklistPush(quicklist *quicklist, void *value, const size_t sz,
+                   int where) {
+    if (where == QUICKLIST_HEAD) {
+        quicklistPushHead(quicklist,value,sz);
+    } else if (where == QUICKLIST_TAIL) {
+        quicklistPushTail(quicklist,value,sz);
+    }
+}
+
+/* Create new node consisting of a pre-formed listpack.
+ * Used for loading RDBs where entire listpacks have been stored
+ * to be retrieved later. */
+/*  将一个完整的listpack作为新节点追加到quicklist尾部，quicklist接管lp的内存。
+    主要用于从RDB中载入quicklist编码的list，空的listpack会被直接释放。 */
+void quicklistAppendListpack(quicklist *quicklist, unsigned char *lp) {
+    quicklistNode *node;
+
+    if (lpLen(lp) == 0) {
+        lpFree(lp);
+        return;
+    }
+
+    node = zmalloc(sizeof(*node));
+    node->lp = lp;
+    node->count = lpLen(lp);
+    node->sz = lpBytes(lp);
+    listAddNodeTail(quicklist->nodes,node);
+    quicklist->count += node->count;
+}
+
+/* Append all values of ziplist 'zl' individually into 'quicklist'.
+ *
+ * This allows us to restore old RDB ziplists into new quicklists
+ * with smaller ziplist sizes than the saved RDB ziplist.
+ *
+ * Returns 'quicklist' argument. Frees passed-in ziplist 'zl' */
+/*  将ziplist中的元素逐个追加到quicklist尾部，这样旧的大ziplist会按照当前fill值重新切分。
+    操作完成后释放zl。 */
+quicklist *quicklistAppendValuesFromZiplist(quicklist *quicklist,
+                                            unsigned char *zl) {
+    unsigned char *value;
+    unsigned int sz;
+    long long longval;
+    char longstr[32] = {0};
+
+    unsigned char *p = ziplistIndex(zl,0);
+    while (ziplistGet(p,&value,&sz,&longval)) {
+        if (!value) {
+            /* Write the longval as a string so we can re-add it */
+            // 整数元素需要先转换为字符串，ziplistPush会重新尝试整数编码
+            sz = ll2string(longstr,sizeof(longstr),longval);
+            value = (unsigned char *)longstr;
+        }
+        quicklistPushTail(quicklist,value,sz);
+        p = ziplistNext(zl,p);
+    }
+    zfree(zl);
+    return quicklist;
+}
+
+/* Create new (potentially multi-node) quicklist from a single existing ziplist.
+ *
+ * Returns new quicklist.  Frees passed-in ziplist 'zl'. */
+/* 根据一个ziplist创建一个新的quicklist，操作完成后释放zl */
+quicklist *quicklistCreateFromZiplist(int fill, unsigned char *zl) {
+    return quicklistAppendValuesFromZiplist(quicklistNew(fill),zl);
+}
+
+/* Delete one entry from list given the node for the entry and a pointer
+ * to the entry in the node.
+ *
+ * Returns 1 if the entire node was deleted, 0 if node still exists.
+ * Also updates in/out param 'p' with the next offset in the listpack. */
+/*  删除ln节点的listpack中p指向的元素，如果删除后listpack为空则同时删除该节点。
+    删除了整个节点返回1，否则返回0。操作完成后p指向listpack中的下一个元素。 */
+static int quicklistDelIndex(quicklist *quicklist, listNode *ln,
+                             unsigned char **p) {
+    quicklistNode *node = quicklistNodeOf(ln);
+    int gone = 0;
+
+    node->lp = lpDelete(node->lp,p);
+    node->count--;
+    if (node->count == 0) {
+        gone = 1;
+        listDelNode(quicklist->nodes,ln);
+    } else {
+        quicklistNodeUpdateSz(node);
+    }
+    quicklist->count--;
+    /* If we deleted the node, the original node is no longer valid */
+    return gone ? 1 : 0;
+}
+
+/* Delete one element represented by 'entry'
+ *
+ * 'entry' stores enough metadata to delete the proper position in
+ * the correct listpack in the correct quicklist node. */
+/*  删除迭代器返回的当前元素entry，并修正迭代器的位置，使得随后的quicklistNext
+    能够继续返回被删除元素的下一个元素。 */
+void quicklistDelEntry(quicklistIter *iter, quicklistEntry *entry) {
+    listNode *prev = entry->node->prev;
+    listNode *next = entry->node->next;
+    int deleted_node = quicklistDelIndex((quicklist *)entry->quicklist,
+                                         entry->node, &entry->zi);
+
+    /* after delete, the zi is now invalid for any future usage. */
+    // 删除操作可能引起listpack的内存重分配，这里让quicklistNext根据offset重新定位
+    iter->zi = NULL;
+
+    /* If current node is deleted, we must update iterator node and offset. */
+    if (deleted_node) {
+        if (iter->direction == AL_START_HEAD) {
+            iter->current = next;
+            iter->offset = 0;
+        } else if (iter->direction == AL_START_TAIL) {
+            iter->current = prev;
+            iter->offset = -1;
+        }
+    } else if (iter->direction == AL_START_TAIL && iter->offset >= 0) {
+        /* When iterating backwards with a positive offset the previous
+         * element moved to offset-1. Offsets counted from the tail are not
+         * affected by the deletion. */
+        // 反向迭代且offset为正数时，下一个元素的偏移量为offset-1；
+        // 如果删除的是listpack的第一个元素，则下一个元素位于前一个节点的尾部
+        if (iter->offset == 0) {
+            iter->current = prev;
+            iter->offset = -1;
+        } else {
+            iter->offset--;
+        }
+    }
+    /* else, for forward iteration the next element took the offset of the
+     * deleted one, and when we deleted the last element of the listpack the
+     * next call to quicklistNext() will jump to the next node. */
+}
+
+/* Replace quicklist entry at offset 'index' by 'data' with length 'sz'.
+ *
+ * Returns 1 if replace happened.
+ * Returns 0 if replace failed and no changes happened. */
+/*  用data替换索引为index的元素，替换成功返回1，index越界返回0。
+    和原来lset命令的实现一样，在listpack中先删除旧值再插入新值。 */
+int quicklistReplaceAtIndex(quicklist *quicklist, long index, void *data,
+                            int sz) {
+    quicklistEntry entry;
+    quicklistNode *node;
+
+    if (!quicklistIndex(quicklist,index,&entry)) return 0;
+
+    node = quicklistNodeOf(entry.node);
+    node->lp = lpDelete(node->lp,&entry.zi);
+    node->lp = lpInsert(node->lp,entry.zi,data,sz);
+    quicklistNodeUpdateSz(node);
+    return 1;
+}
+
+/* Split 'node' into two parts, parameterized by 'offset' and 'after'.
+ *
+ * The 'after' argument controls which quicklistNode gets returned.
+ * If 'after'==1, returned node has elements after 'offset'.
+ *                input node keeps elements up to 'offset', including 'offset'.
+ * If 'after'==0, returned node has elements up to 'offset', not including
+ *                'offset'. input node keeps elements starting at 'offset'.
+ *
+ * The new node is linked next to the input node and returned. */
+/*  以offset为界将ln节点的listpack一分为二，新节点插入到ln的后面（after为1）或前面（after为0）。
+    after为1时，ln保留[0, offset]，新节点保存offset之后的元素；
+    after为0时，ln保留[offset, count)，新节点保存offset之前的元素。 */
+static listNode *_quicklistSplitNode(quicklist *quicklist, listNode *ln,
+                                     int offset, int after) {
+    quicklistNode *node = quicklistNodeOf(ln);
+    quicklistNode *new_node = zmalloc(sizeof(*new_node));
+    unsigned int orig_start, orig_extent, new_start, new_extent;
+
+    if (offset < 0) offset += node->count;
+
+    orig_start = after ? offset + 1 : 0;
+    orig_extent = after ? node->count - (offset + 1) : (unsigned int)offset;
+    new_start = after ? 0 : offset;
+    new_extent = after ? (unsigned int)offset + 1 : node->count - offset;
+
+    // 复制一份listpack，然后两边各自删除不需要的部分
+    new_node->lp = zmalloc(node->sz);
+    memcpy(new_node->lp,node->lp,node->sz);
+
+    node->lp = lpDeleteRange(node->lp,orig_start,orig_extent);
+    node->count = lpLen(node->lp);
+    quicklistNodeUpdateSz(node);
+
+    new_node->lp = lpDeleteRange(new_node->lp,new_start,new_extent);
+    new_node->count = lpLen(new_node->lp);
+    quicklistNodeUpdateSz(new_node);
+
+    listInsertNode(quicklist->nodes,ln,new_node,after);
+    return after ? ln->next : ln->prev;
+}
+
+/* Insert a new entry before or after existing entry 'entry'.
+ *
+ * If after==1, the new value is inserted after 'entry', otherwise
+ * the new value is inserted before 'entry'. */
+/*  在entry指向的元素之前或之后插入一个新元素，由参数after决定。
+    如果entry所在节点已满，依次尝试：插入到相邻节点、创建新节点、分裂当前节点。 */
+static void _quicklistInsert(quicklist *quicklist, quicklistEntry *entry,
+                             void *value, const size_t sz, int after) {
+    int full = 0, at_tail = 0, at_head = 0, full_next = 0, full_prev = 0;
+    int fill = quicklist->fill;
+    listNode *ln = entry->node;
+    quicklistNode *node, *new_node;
+
+    if (ln == NULL) {
+        /* we have no reference node, so let's create only node in the list */
+        // 空列表，直接创建一个节点
+        new_node = quicklistCreateNode();
+        new_node->lp = lpPush(new_node->lp,value,sz,LP_HEAD);
+        new_node->count++;
+        quicklistNodeUpdateSz(new_node);
+        listAddNodeHead(quicklist->nodes,new_node);
+        quicklist->count++;
+        return;
+    }
+
+    node = quicklistNodeOf(ln);
+
+    /* Populate accounting flags for easier boolean checks later */
+    // 检查当前节点是否已满
+    if (!_quicklistNodeAllowInsert(node,fill,sz)) full = 1;
+
+    // 在当前listpack的最后一个元素之后插入，检查后一个节点是否已满
+    if (after && (entry->offset == (int)node->count - 1 || entry->offset == -1)) {
+        at_tail = 1;
+        if (!ln->next ||
+            !_quicklistNodeAllowInsert(quicklistNodeOf(ln->next),fill,sz))
+            full_next = 1;
+    }
+
+    // 在当前listpack的第一个元素之前插入，检查前一个节点是否已满
+    if (!after && (entry->offset == 0 || entry->offset == -(int)node->count)) {
+        at_head = 1;
+        if (!ln->prev ||
+            !_quicklistNodeAllowInsert(quicklistNodeOf(ln->prev),fill,sz))
+            full_prev = 1;
+    }
+
+    /* Now determine where and how to insert the new element */
+    if (!full && after) {
+        // 当前节点未满，直接插入到entry之后
+        unsigned char *next = lpNext(node->lp,entry->zi);
+        if (next == NULL) {
+            node->lp = lpPush(node->lp,value,sz,LP_TAIL);
+        } else {
+            node->lp = lpInsert(node->lp,next,value,sz);
+        }
+        node->count++;
+        quicklistNodeUpdateSz(node);
+    } else if (!full && !after) {
+        // 当前节点未满，直接插入到entry之前
+        node->lp = lpInsert(node->lp,entry->zi,value,sz);
+        node->count++;
+        quicklistNodeUpdateSz(node);
+    } else if (full && at_tail && !full_next && after) {
+        /* If we are: at tail, next has free space, and inserting after:
+         *   - insert entry at head of next node. */
+        // 当前节点已满，插入到后一个节点的头部
+        new_node = quicklistNodeOf(ln->next);
+        new_node->lp = lpPush(new_node->lp,value,sz,LP_HEAD);
+        new_node->count++;
+        quicklistNodeUpdateSz(new_node);
+    } else if (full && at_head && !full_prev && !after) {
+        /* If we are: at head, previous has free space, and inserting before:
+         *   - insert entry at tail of previous node. */
+        // 当前节点已满，插入到前一个节点的尾部
+        new_node = quicklistNodeOf(ln->prev);
+        new_node->lp = lpPush(new_node->lp,value,sz,LP_TAIL);
+        new_node->count++;
+        quicklistNodeUpdateSz(new_node);
+    } else if (full && ((at_tail && full_next && after) ||
+                        (at_head && full_prev && !after))) {
+        /* If we are: full, and our prev/next is full, then:
+         *   - create new node and attach to quicklist */
+        // 当前节点和相邻节点都已满，创建一个新节点
+        new_node = quicklistCreateNode();
+        new_node->lp = lpPush(new_node->lp,value,sz,LP_HEAD);
+        new_node->count++;
+        quicklistNodeUpdateSz(new_node);
+        listInsertNode(quicklist->nodes,ln,new_node,after);
+    } else {
+        /* else, node is full we need to split it. */
+        // 在listpack中间插入且当前节点已满，需要分裂当前节点
+        new_node = quicklistNodeOf(_quicklistSplitNode(quicklist,ln,
+                                                       entry->offset,after));
+        new_node->lp = lpPush(new_node->lp,value,sz,
+                              after ? LP_HEAD : LP_TAIL);
+        new_node->count++;
+        quicklistNodeUpdateSz(new_node);
+    }
+
+    quicklist->count++;
+}
+
+/* 在entry指向的元素之前插入一个元素 */
+void quicklistInsertBefore(quicklist *quicklist, quicklistEntry *entry,
+                           void *value, const size_t sz) {
+    _quicklistInsert(quicklist,entry,value,sz,0);
+}
+
+/* 在entry指向的元素之后插入一个元素 */
+void quicklistInsertAfter(quicklist *quicklist, quicklistEntry *entry,
+                          void *value, const size_t sz) {
+    _quicklistInsert(quicklist,entry,value,sz,1);
+}
+
+/* Delete a range of elements from the quicklist.
+ *
+ * elements may span across multiple quicklistNodes, so we
+ * have to be careful about tracking where we start and end.
+ *
+ * Returns 1 if entries were deleted, 0 if nothing was deleted. */
+/*  从索引start开始（可以为负数）删除count个元素，删除的元素可能跨越多个节点。
+    如果完整覆盖了某个节点，则直接删除整个节点而无需逐个删除元素。
+    删除了元素返回1，否则返回0。 */
+int quicklistDelRange(quicklist *quicklist, const long start,
+                      const long count) {
+    quicklistEntry entry;
+    unsigned long extent;
+    listNode *ln;
+    long offset;
+
+    if (count <= 0) return 0;
+
+    // 修正删除的元素个数，不能超过start之后的元素个数
+    extent = count;
+    if (start >= 0 && extent > (quicklist->count - start)) {
+        /* if requesting delete more elements than exist, limit to list size. */
+        extent = quicklist->count - start;
+    } else if (start < 0 && extent > (unsigned long)(-start)) {
+        /* else, if at negative offset, limit max size to rest of list. */
+        extent = -start; /* c.f. LREM -29 29; just delete until end. */
+    }
+
+    if (!quicklistIndex(quicklist,start,&entry)) return 0;
+
+    ln = entry.node;
+    offset = entry.offset;
+    if (offset < 0) offset += quicklistNodeOf(ln)->count;
+
+    /* iterate over next nodes until everything is deleted. */
+    while (extent) {
+        listNode *next = ln->next;
+        quicklistNode *node = quicklistNodeOf(ln);
+        unsigned long del;
+
+        if (offset == 0 && extent >= node->count) {
+            /* If we are deleting more than the count of this node, we
+             * can just delete the entire node without listpack math. */
+            // 整个节点都需要删除
+            del = node->count;
+            listDelNode(quicklist->nodes,ln);
+        } else {
+            // 删除当前节点中从offset开始的部分元素
+            del = node->count - offset;
+            if (del > extent) del = extent;
+            node->lp = lpDeleteRange(node->lp,offset,del);
+            node->count -= del;
+            if (node->count == 0) {
+                listDelNode(quicklist->nodes,ln);
+            } else {
+                quicklistNodeUpdateSz(node);
+            }
+        }
+
+        quicklist->count -= del;
+        extent -= del;
+        ln = next;
+        offset = 0;
+    }
+    return 1;
+}
+
+/* Passthrough to lpCompare() */
+/* 比较listpack中p1指向的元素与字符串p2是否相等 */
+int quicklistCompare(unsigned char *p1, unsigned char *p2, int p2_len) {
+    return lpCompare(p1,p2,p2_len);
+}
+
+/* Returns a quicklist iterator 'iter'. After the initialization every
+ * call to quicklistNext() will return the next element of the quicklist. */
+/*  获取quicklist的迭代器，direction为AL_START_HEAD表示从头到尾迭代，
+    为AL_START_TAIL表示从尾到头迭代。 */
+quicklistIter *quicklistGetIterator(const quicklist *quicklist, int direction) {
+    quicklistIter *iter;
+
+    iter = zmalloc(sizeof(*iter));
+
+    if (direction == AL_START_HEAD) {
+        iter->current = listFirst(quicklist->nodes);
+        iter->offset = 0;
+    } else {
+        iter->current = listLast(quicklist->nodes);
+        iter->offset = -1;
+    }
+
+    iter->direction = direction;
+    iter->quicklist = quicklist;
+    // zi为NULL表示需要根据offset定位当前元素
+    iter->zi = NULL;
+    return iter;
+}
+
+/* Initialize an iterator at a specific offset 'idx' and make the iterator
+ * return nodes in 'direction' direction. */
+/* 获取一个从索引idx开始迭代的迭代器，idx越界返回NULL */
+quicklistIter *quicklistGetIteratorAtIdx(const quicklist *quicklist,
+                                         const int direction,
+                                         const long long idx) {
+    quicklistEntry entry;
+
+    if (quicklistIndex(quicklist,idx,&entry)) {
+        quicklistIter *base = quicklistGetIterator(quicklist,direction);
+        base->zi = NULL;
+        base->current = entry.node;
+        base->offset = entry.offset;
+        return base;
+    } else {
+        return NULL;
+    }
+}
+
+/* Release iterator. */
+/* 释放迭代器 */
+void quicklistReleaseIterator(quicklistIter *iter) {
+    zfree(iter);
+}
+
+/* Get next element in iterator.
+ *
+ * Note: You must NOT insert into the list while iterating over it.
+ * You *may* delete from the list while iterating using the
+ * quicklistDelEntry() function.
+ * If you insert into the quicklist while iterating, you should
+ * re-create the iterator after your addition.
+ *
+ * Returns 0 when iteration has ended, 1 otherwise. */
+/*  获取迭代器的下一个元素并保存在entry中，如果还有元素返回1，否则返回0。
+    迭代过程中不能往quicklist中插入元素，但可以通过quicklistDelEntry删除元素。 */
+int quicklistNext(quicklistIter *iter, quicklistEntry *entry) {
+    quicklistNode *node;
+
+    entry->quicklist = iter->quicklist;
+    entry->value = NULL;
+    entry->sz = 0;
+    entry->longval = -123456789;
+
+    while (iter->current) {
+        node = quicklistNodeOf(iter->current);
+        if (!iter->zi) {
+            /* If !zi, use current index. */
+            iter->zi = lpIndex(node->lp,iter->offset);
+        } else {
+            /* else, use existing iterator offset and get prev/next. */
+            if (iter->direction == AL_START_HEAD) {
+                iter->zi = lpNext(node->lp,iter->zi);
+                iter->offset++;
+            } else {
+                iter->zi = lpPrev(node->lp,iter->zi);
+                iter->offset--;
+            }
+        }
+
+        if (iter->zi) {
+            /* Populate value from existing listpack position */
+            entry->node = iter->current;
+            entry->zi = iter->zi;
+            entry->offset = iter->offset;
+            lpGet(entry->zi,&entry->value,&entry->sz,&entry->longval);
+            return 1;
+        }
+
+        /* We ran out of listpack entries: pick next node and update offset. */
+        // 当前listpack已经迭代完毕，移动到下一个节点
+        if (iter->direction == AL_START_HEAD) {
+            iter->current = iter->current->next;
+            iter->offset = 0;
+        } else {
+            iter->current = iter->current->prev;
+            iter->offset = -1;
+        }
+        iter->zi = NULL;
+    }
+
+    entry->node = NULL;
+    entry->zi = NULL;
+    return 0;
+}
+
+/* Duplicate the quicklist.
+ * On success a copy of the original quicklist is returned. */
+/* 复制一个quicklist，返回其副本 */
+quicklist *quicklistDup(quicklist *orig) {
+    quicklist *copy;
+    listIter li;
+    listNode *ln;
+
+    copy = quicklistNew(orig->fill);
+
+    listRewind(orig->nodes,&li);
+    while ((ln = listNext(&li)) != NULL) {
+        quicklistNode *node = quicklistNodeOf(ln);
+        quicklistNode *new_node = zmalloc(sizeof(*new_node));
+
+        new_node->lp = zmalloc(node->sz);
+        memcpy(new_node->lp,node->lp,node->sz);
+        new_node->sz = node->sz;
+        new_node->count = node->count;
+        listAddNodeTail(copy->nodes,new_node);
+    }
+
+    copy->count = orig->count;
+    return copy;
+}
+
+/* Populate 'entry' with the element at the specified zero-based index
+ * where 0 is the head, 1 is the element next to head
+ * and so on. Negative integers are used in order to count
+ * from the tail, -1 is the last element, -2 the penultimate
+ * and so on. If the index is out of range 0 is returned.
+ *
+ * Returns 1 if element found
+ * Returns 0 if element not found */
+/*  根据索引值获取元素并保存在entry中，index为负数表示从尾部开始计数。
+    由于每个节点都记录了其listpack的元素个数，所以这里只需要按节点跳跃，而不必逐个元素遍历。
+    找到返回1，index越界返回0。 */
+int quicklistIndex(const quicklist *quicklist, const long long idx,
+                   quicklistEntry *entry) {
+    int forward = idx < 0 ? 0 : 1; /* < 0 -> reverse, 0+ -> forward */
+    unsigned long long index, accum = 0;
+    listNode *ln;
+    quicklistNode *node = NULL;
+
+    entry->quicklist = quicklist;
+    entry->node = NULL;
+    entry->zi = NULL;
+    entry->value = NULL;
+    entry->sz = 0;
+    entry->longval = -123456789;
+
+    index = forward ? idx : (-idx) - 1;
+    if (index >= quicklist->count) return 0;
+
+    // 从头部或尾部开始按节点查找
+    ln = forward ? listFirst(quicklist->nodes) : listLast(quicklist->nodes);
+    while (ln) {
+        node = quicklistNodeOf(ln);
+        if ((accum + node->count) > index) break;
+        accum += node->count;
+        ln = forward ? ln->next : ln->prev;
+    }
+
+    if (!ln) return 0;
+
+    entry->node = ln;
+    if (forward) {
+        /* forward = normal head-to-tail offset. */
+        entry->offset = index - accum;
+    } else {
+        /* reverse = need negative offset for tail-to-head, so undo
+         * the result of the original if (index < 0) above. */
+        entry->offset = (-index) - 1 + accum;
+    }
+
+    entry->zi = lpIndex(node->lp,entry->offset);
+    lpGet(entry->zi,&entry->value,&entry->sz,&entry->longval);
+    return 1;
+}
+
+/* pop from quicklist and return result in 'data' ptr.  Value of 'data'
+ * is the return value of 'saver' function pointer if the data is NOT a number.
+ *
+ * If the quicklist element is a long long, then the return value is returned in
+ * 'sval'.
+ *
+ * Return value of 0 means no elements available.
+ * Return value of 1 means check 'data' and 'sval' for values.
+ * If 'data' is set, use 'data' and 'sz'.  Otherwise, use 'sval'. */
+/*  从quicklist的头部或尾部弹出一个元素。如果元素是字符串，则通过saver回调得到其副本保存在data中；
+    如果元素是整数，则保存在sval中。quicklist为空返回0，否则返回1。 */
+int quicklistPopCustom(quicklist *quicklist, int where, unsigned char **data,
+                       unsigned int *sz, long long *sval,
+                       void *(*saver)(unsigned char *data, unsigned int sz)) {
+    unsigned char *p;
+    unsigned char *vstr;
+    unsigned int vlen;
+    long long vlong;
+    int pos = (where == QUICKLIST_HEAD) ? 0 : -1;
+    listNode *ln;
+
+    if (quicklist->count == 0) return 0;
+
+    if (data) *data = NULL;
+    if (sz) *sz = 0;
+    if (sval) *sval = -123456789;
+
+    if (where == QUICKLIST_HEAD)
+        ln = listFirst(quicklist->nodes);
+    else
+        ln = listLast(quicklist->nodes);
+
+    p = lpIndex(quicklistNodeOf(ln)->lp,pos);
+    if (lpGet(p,&vstr,&vlen,&vlong)) {
+        if (vstr) {
+            if (data) *data = saver(vstr,vlen);
+            if (sz) *sz = vlen;
+        } else {
+            if (data) *data = NULL;
+            if (sval) *sval = vlong;
+        }
+        quicklistDelIndex(quicklist,ln,&p);
+        return 1;
+    }
+    return 0;
+}
+
+/* Return a malloc'd copy of data passed in */
+/* quicklistPop使用的默认saver，复制一份字符串 */
+static void *_quicklistSaver(unsigned char *data, unsigned int sz) {
+    unsigned char *vstr;
+
+    if (data) {
+        vstr = zmalloc(sz);
+        memcpy(vstr,data,sz);
+        return vstr;
+    }
+    return NULL;
+}
+
+/* Default pop function
+ *
+ * Returns malloc'd value from quicklist */
+/* 从quicklist的头部或尾部弹出一个元素，字符串元素返回一个zmalloc分配的副本 */
+int quicklistPop(quicklist *quicklist, int where, unsigned char **data,
+                 unsigned int *sz, long long *slong) {
+    unsigned char *vstr;
+    unsigned int vlen;
+    long long vlong;
+
+    if (quicklist->count == 0) return 0;
+    int ret = quicklistPopCustom(quicklist,where,&vstr,&vlen,&vlong,
+                                 _quicklistSaver);
+    if (data) *data = vstr;
+    if (slong) *slong = vlong;
+    if (sz) *sz = vlen;
+    return ret;
+}
+
+/* Return the number of elements in the quicklist. */
+/* 返回quicklist中保存的元素总数 */
+unsigned long quicklistCount(const quicklist *ql) {
+    return ql->count;
+}
+
+#ifdef QUICKLIST_TEST_MAIN
+#include <stdio.h>
+#include <stdlib.h>
+#include "testhelp.h"
+
+/* 逐个遍历quicklist，检查元素总数以及各节点的计数是否一致 */
+static int ql_verify(quicklist *ql, unsigned long expected) {
+    listIter li;
+    listNode *ln;
+    unsigned long count = 0, iterated = 0;
+    quicklistIter *iter;
+    quicklistEntry entry;
+
+    listRewind(ql->nodes,&li);
+    while ((ln = listNext(&li)) != NULL) {
+        quicklistNode *node = quicklistNodeOf(ln);
+        if (node->count == 0 || node->count != lpLen(node->lp)) return 0;
+        if (node->sz != lpBytes(node->lp)) return 0;
+        count += node->count;
+    }
+
+    iter = quicklistGetIterator(ql,AL_START_HEAD);
+    while (quicklistNext(iter,&entry)) iterated++;
+    quicklistReleaseIterator(iter);
+
+    return count == expected && iterated == expected && ql->count == expected;
+}
+
+/* 返回索引为idx的元素的整数值，元素必须是整数 */
+static long long ql_get_int(quicklist *ql, long long idx) {
+    quicklistEntry entry;
+    if (!quicklistIndex(ql,idx,&entry) || entry.value) return -1;
+    return entry.longval;
+}
+
+int main(void) {
+    quicklist *ql;
+    quicklistIter *iter;
+    quicklistEntry entry;
+    char buf[64];
+    int i, ok;
+
+    {
+        ql = quicklistNew(4);
+        for (i = 0; i < 100; i++) {
+            int len = snprintf(buf,sizeof(buf),"%d",i);
+            quicklistPushTail(ql,buf,len);
+        }
+        test_cond("Push 100 elements with fill 4",
+            ql_verify(ql,100) && listLength(ql->nodes) == 25);
+        test_cond("Index from head and tail",
+            ql_get_int(ql,0) == 0 && ql_get_int(ql,57) == 57 &&
+            ql_get_int(ql,-1) == 99 && ql_get_int(ql,-42) == 58 &&
+            !quicklistIndex(ql,100,&entry) && !quicklistIndex(ql,-101,&entry));
+        quicklistRelease(ql);
+    }
+
+    {
+        ql = quicklistNew(4);
+        for (i = 0; i < 16; i++) {
+            int len = snprintf(buf,sizeof(buf),"%d",i*2);
+            quicklistPushTail(ql,buf,len);
+        }
+        /* Insert odd numbers in the middle of full nodes, forcing splits. */
+        for (i = 7; i >= 0; i--) {
+            int len = snprintf(buf,sizeof(buf),"%d",i*4+1);
+            quicklistIndex(ql,i*2,&entry);
+            quicklistInsertAfter(ql,&entry,buf,len);
+        }
+        ok = ql_verify(ql,24);
+        for (i = 0; i < 8; i++) {
+            if (ql_get_int(ql,i*3) != i*4 ||
+                ql_get_int(ql,i*3+1) != i*4+1 ||
+                ql_get_int(ql,i*3+2) != i*4+2) ok = 0;
+        }
+        test_cond("Insert after entries of full nodes", ok);
+
+        quicklistIndex(ql,0,&entry);
+        quicklistInsertBefore(ql,&entry,"-1",2);
+        quicklistIndex(ql,-1,&entry);
+        quicklistInsertAfter(ql,&entry,"1000",4);
+        test_cond("Insert before head and after tail",
+            ql_verify(ql,26) && ql_get_int(ql,0) == -1 &&
+            ql_get_int(ql,-1) == 1000);
+        quicklistRelease(ql);
+    }
+
+    {
+        ql = quicklistNew(-2);
+        for (i = 0; i < 1000; i++) {
+            int len = snprintf(buf,sizeof(buf),"%d",i);
+            quicklistPushTail(ql,buf,len);
+        }
+        /* Delete every even element while iterating forward. */
+        iter = quicklistGetIterator(ql,AL_START_HEAD);
+        while (quicklistNext(iter,&entry)) {
+            if (!entry.value && entry.longval % 2 == 0)
+                quicklistDelEntry(iter,&entry);
+        }
+        quicklistReleaseIterator(iter);
+        ok = ql_verify(ql,500);
+        for (i = 0; i < 500; i++)
+            if (ql_get_int(ql,i) != i*2+1) ok = 0;
+        test_cond("Delete while iterating forward", ok);
+
+        /* Delete every element divisible by 3 iterating backwards
+         * starting from a positive index. */
+        iter = quicklistGetIteratorAtIdx(ql,AL_START_TAIL,250);
+        while (quicklistNext(iter,&entry)) {
+            if (!entry.value && entry.longval % 3 == 0)
+                quicklistDelEntry(iter,&entry);
+        }
+        quicklistReleaseIterator(iter);
+        ok = ql_verify(ql,416) && ql_get_int(ql,0) == 1 &&
+             ql_get_int(ql,1) == 5 && ql_get_int(ql,-1) == 999;
+        test_cond("Delete while iterating backwards from index", ok);
+
+        quicklistDelRange(ql,10,300);
+        ok = ql_verify(ql,116);
+        quicklistDelRange(ql,-20,1000);
+        ok = ok && ql_verify(ql,96);
+        quicklistDelRange(ql,0,96);
+        test_cond("Delete ranges", ok && ql_verify(ql,0) &&
+            listLength(ql->nodes) == 0);
+        quicklistRelease(ql);
+    }
+
+    {
+        unsigned char *data;
+        unsigned int sz;
+        long long sval;
+        quicklist *copy;
+
+        ql = quicklistNew(3);
+        quicklistPushHead(ql,"hello",5);
+        quicklistPushHead(ql,"42",2);
+        quicklistPushTail(ql,"world",5);
+        copy = quicklistDup(ql);
+        quicklistReplaceAtIndex(ql,1,"bar",3);
+
+        ok = quicklistPop(ql,QUICKLIST_HEAD,&data,&sz,&sval) &&
+             data == NULL && sval == 42;
+        ok = ok && quicklistPop(ql,QUICKLIST_TAIL,&data,&sz,&sval) &&
+             sz == 5 && memcmp(data,"world",5) == 0;
+        zfree(data);
+        ok = ok && quicklistIndex(ql,0,&entry) &&
+             quicklistCompare(entry.zi,(unsigned char*)"bar",3);
+        test_cond("Pop, replace and dup", ok && ql_verify(ql,1) &&
+            ql_verify(copy,3));
+        quicklistRelease(ql);
+        quicklistRelease(copy);
+    }
+
+    {
+        unsigned char *zl = ziplistNew();
+        for (i = 0; i < 100; i++) {
+            int len = snprintf(buf,sizeof(buf),"%d",i);
+            zl = ziplistPush(zl,(unsigned char*)buf,len,ZIPLIST_TAIL);
+        }
+        ql = quicklistCreateFromZiplist(8,zl);
+        test_cond("Create from ziplist",
+            ql_verify(ql,100) && listLength(ql->nodes) == 13 &&
+            ql_get_int(ql,99) == 99);
+        quicklistRelease(ql);
+    }
+
+    test_report();
+    return 0;
+}
+#endif
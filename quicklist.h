@@ -0,0 +1,150 @@
+/* quicklist.h - A generic doubly linked list of listpacks
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __QUICKLIST_H__
+#define __QUICKLIST_H__
+
+#include "adlist.h"
+
+/*  quicklist是由多个listpack串联而成的双向链表：链表部分直接复用adlist，
+    链表中每个节点的value指向一个quicklistNode，quicklistNode中保存一个大小受限的listpack。
+    这样既保留了listpack紧凑的内存布局，又保证了头尾操作的时间复杂度为O(1)。 */
+
+/* quicklist的节点，保存一个listpack */
+typedef struct quicklistNode {
+    // 指向listpack
+    unsigned char *lp;
+    // listpack占用的字节数
+    unsigned int sz;
+    // listpack中保存的元素个数
+    unsigned int count;
+} quicklistNode;
+
+/* quicklist结构体 */
+typedef struct quicklist {
+    // adlist双向链表，每个listNode的value指向一个quicklistNode
+    list *nodes;
+    // 所有listpack中的元素总数
+    unsigned long count;
+    // 单个listpack的大小限制：正数表示元素个数上限，-1~-5分别表示4KB~64KB的字节数上限
+    int fill;
+} quicklist;
+
+/* quicklist迭代器 */
+typedef struct quicklistIter {
+    const quicklist *quicklist;
+    // 当前所在的adlist节点
+    listNode *current;
+    // 当前所在listpack中的元素指针
+    unsigned char *zi;
+    // 当前元素在listpack中的偏移量
+    long offset;
+    // 迭代方向，AL_START_HEAD或AL_START_TAIL
+    int direction;
+} quicklistIter;
+
+/* 对quicklist中一个元素的描述 */
+typedef struct quicklistEntry {
+    const quicklist *quicklist;
+    // 元素所在的adlist节点
+    listNode *node;
+    // 元素在listpack中的位置
+    unsigned char *zi;
+    // 如果元素是字符串，value和sz保存其值和长度
+    unsigned char *value;
+    unsigned int sz;
+    // 如果元素是整数，则其值保存在longval中
+    long long longval;
+    // 元素在listpack中的偏移量
+    int offset;
+} quicklistEntry;
+
+#define QUICKLIST_HEAD 0
+#define QUICKLIST_TAIL -1
+
+/* 获取adlist节点中保存的quicklistNode */
+#define quicklistNodeOf(ln) ((quicklistNode*)listNodeValue(ln))
+
+/* Prototypes */
+/* 创建一个空的quicklist，使用默认的fill值 */
+quicklist *quicklistCreate(void);
+/* 创建一个空的quicklist，并指定fill值 */
+quicklist *quicklistNew(int fill);
+/* 设置fill值 */
+void quicklistSetFill(quicklist *quicklist, int fill);
+/* 释放整个quicklist */
+void quicklistRelease(quicklist *quicklist);
+/* 往quicklist头部插入一个元素 */
+int quicklistPushHead(quicklist *quicklist, void *value, const size_t sz);
+/* 往quicklist尾部插入一个元素 */
+int quicklistPushTail(quicklist *quicklist, void *value, const size_t sz);
+/* 往quicklist头部或尾部插入一个元素，由where决定 */
+void quicklistPush(quicklist *quicklist, void *value, const size_t sz, int where);
+/* 将一个已有的listpack作为一个新节点追加到quicklist尾部 */
+void quicklistAppendListpack(quicklist *quicklist, unsigned char *lp);
+/* 将ziplist中的所有元素逐个追加到quicklist尾部，随后释放该ziplist */
+quicklist *quicklistAppendValuesFromZiplist(quicklist *quicklist, unsigned char *zl);
+/* 根据一个ziplist创建一个quicklist */
+quicklist *quicklistCreateFromZiplist(int fill, unsigned char *zl);
+/* 在entry指向的元素之后插入一个元素 */
+void quicklistInsertAfter(quicklist *quicklist, quicklistEntry *entry, void *value, const size_t sz);
+/* 在entry指向的元素之前插入一个元素 */
+void quicklistInsertBefore(quicklist *quicklist, quicklistEntry *entry, void *value, const size_t sz);
+/* 删除迭代器当前返回的元素 */
+void quicklistDelEntry(quicklistIter *iter, quicklistEntry *entry);
+/* 替换指定索引上的元素 */
+int quicklistReplaceAtIndex(quicklist *quicklist, long index, void *data, int sz);
+/* 从start开始删除count个元素 */
+int quicklistDelRange(quicklist *quicklist, const long start, const long count);
+/* 获取一个迭代器 */
+quicklistIter *quicklistGetIterator(const quicklist *quicklist, int direction);
+/* 获取一个从指定索引开始迭代的迭代器 */
+quicklistIter *quicklistGetIteratorAtIdx(const quicklist *quicklist, int direction, const long long idx);
+/* 获取迭代器的下一个元素 */
+int quicklistNext(quicklistIter *iter, quicklistEntry *node);
+/* 释放迭代器 */
+void quicklistReleaseIterator(quicklistIter *iter);
+/* 复制一个quicklist */
+quicklist *quicklistDup(quicklist *orig);
+/* 根据索引获取元素 */
+int quicklistIndex(const quicklist *quicklist, const long long index, quicklistEntry *entry);
+/* 从头部或尾部弹出一个元素，字符串元素通过saver回调保存 */
+int quicklistPopCustom(quicklist *quicklist, int where, unsigned char **data,
+                       unsigned int *sz, long long *sval,
+                       void *(*saver)(unsigned char *data, unsigned int sz));
+/* 从头部或尾部弹出一个元素，字符串元素会被复制一份 */
+int quicklistPop(quicklist *quicklist, int where, unsigned char **data,
+                 unsigned int *sz, long long *slong);
+/* 返回quicklist中的元素个数 */
+unsigned long quicklistCount(const quicklist *ql);
+/* 比较listpack元素与给定字符串是否相等 */
+int quicklistCompare(unsigned char *p1, unsigned char *p2, int p2_len);
+
+#endif /* __QUICKLIST_H__ */
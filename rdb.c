@@ -31,6 +31,8 @@
 #include "lzf.h"    /* LZF compression library */
 #include "zipmap.h"
 #include "endianconv.h"
+#include "crc64.h"
+#include "rdbcodec.h"
 
 #include <math.h>
 #include <sys/types.h>
@@ -39,6 +41,7 @@
 #include <sys/wait.h>
 #include <arpa/inet.h>
 #include <sys/stat.h>
+#include <pthread.h>
 
 /* ！！！！ 下面使用的rio类型定义在rio.h文件中 ！！！！ */
 
@@ -261,9 +264,10 @@ int rdbTryIntegerEncoding(char *s, size_t len, unsigned char *enc) {
     return rdbEncodeInteger(value,enc);
 }
 
-/*  使用lzf算法对参数s表示的字符串进行压缩后再写入RDB文件中。
+/*  使用codec指定的算法对参数s表示的字符串进行压缩后再写入RDB文件中，格式为：
+    [ENCVAL|编码类型][压缩后的长度][原始长度][压缩后的数据]
     该函数在操作成功时返回写入RDB文件中的字节数，如果内存不足或压缩失败返回0，如果写入失败返回-1。*/
-int rdbSaveLzfStringObject(rio *rdb, unsigned char *s, size_t len) {
+static int rdbSaveCompressedStringObject(rio *rdb, int codec, unsigned char *s, size_t len) {
     size_t comprlen, outlen;
     unsigned char byte;
     int n, nwritten = 0;
@@ -275,8 +279,8 @@ int rdbSaveLzfStringObject(rio *rdb, unsigned char *s, size_t len) {
     outlen = len-4;
     // 内存不足，返回0
     if ((out = zmalloc(outlen+1)) == NULL) return 0;
-    // 使用lzf算法进行字符串压缩
-    comprlen = lzf_compress(s, len, out, outlen);
+    // 进行字符串压缩
+    comprlen = rdbCodecCompress(codec, s, len, out, outlen);
     // 压缩失败，释放空间后返回0
     if (comprlen == 0) {
         zfree(out);
@@ -285,8 +289,8 @@ int rdbSaveLzfStringObject(rio *rdb, unsigned char *s, size_t len) {
     /* Data compressed! Let's save it on disk */
     /*  经过上面的操作得到压缩后的字符串，现在讲其保存在RDB文件中。*/
 
-    // 写入类型信息，指明这是一个使用lzf压缩后得到的字符串
-    byte = (REDIS_RDB_ENCVAL<<6)|REDIS_RDB_ENC_LZF;
+    // 写入类型信息，指明这是一个压缩后得到的字符串以及所使用的压缩算法
+    byte = (REDIS_RDB_ENCVAL<<6)|rdbEncodingOfCodec(codec);
     if ((n = rdbWriteRaw(rdb,&byte,1)) == -1) goto writeerr;
     // 记录写入的字节数
     nwritten += n;
@@ -315,8 +319,14 @@ writeerr:
     return -1;
 }
 
-/*  从RDB中加载被压缩的字符串，解析返回原始字符串对象。*/
-robj *rdbLoadLzfStringObject(rio *rdb) {
+/*  使用lzf算法对参数s表示的字符串进行压缩后再写入RDB文件中。
+    该函数在操作成功时返回写入RDB文件中的字节数，如果内存不足或压缩失败返回0，如果写入失败返回-1。*/
+int rdbSaveLzfStringObject(rio *rdb, unsigned char *s, size_t len) {
+    return rdbSaveCompressedStringObject(rdb,RDB_CODEC_LZF,s,len);
+}
+
+/*  从RDB中加载被压缩的字符串，codec为所使用的压缩算法，解析返回原始字符串对象。*/
+static robj *rdbLoadCompressedStringObject(rio *rdb, int codec) {
     unsigned int len, clen;
     unsigned char *c = NULL;
     sds val = NULL;
@@ -331,7 +341,7 @@ robj *rdbLoadLzfStringObject(rio *rdb) {
     // 读取压缩后的字符串信息
     if (rioRead(rdb,c,clen) == 0) goto err;
     // 解压缩得到原始字符串
-    if (lzf_decompress(c,clen,val,len) == 0) goto err;
+    if (rdbCodecDecompress(codec,c,clen,val,len) == 0) goto err;
     zfree(c);
     // 创建字符串对象并返回之
     return createObject(REDIS_STRING,val);
@@ -342,6 +352,11 @@ err:
     return NULL;
 }
 
+/*  从RDB中加载被lzf压缩的字符串，解析返回原始字符串对象。*/
+robj *rdbLoadLzfStringObject(rio *rdb) {
+    return rdbLoadCompressedStringObject(rdb,RDB_CODEC_LZF);
+}
+
 /* Save a string object as [len][data] on disk. If the object is a string
  * representation of an integer value we try to save it in a special form */
 /*  以[len][data]的形式将字符串对象写入RDB中。如果该对象是字符串形式表示的整型数，则尝试用特殊的形式保存它。
@@ -364,9 +379,9 @@ int rdbSaveRawString(rio *rdb, unsigned char *s, size_t len) {
 
     /* Try LZF compression - under 20 bytes it's unable to compress even
      * aaaaaaaaaaaaaaaaaa so skip it */
-    // 如果服务器开启了lzf压缩功能并且待写入字符串长度超过20字节，则先进行lzf压缩后再写入RDB中
+    // 如果服务器开启了压缩功能并且待写入字符串长度超过20字节，则先使用配置的压缩算法进行压缩后再写入RDB中
     if (server.rdb_compression && len > 20) {
-        n = rdbSaveLzfStringObject(rdb,s,len);
+        n = rdbSaveCompressedStringObject(rdb,server.rdb_compression_codec,s,len);
         if (n == -1) return -1;
         if (n > 0) return n;
         /* Return value of 0 means data can't be compressed, save the old way */
@@ -451,6 +466,15 @@ robj *rdbGenericLoadStringObject(rio *rdb, int encode) {
         // 使用lzf算法压缩后的字符串
         case REDIS_RDB_ENC_LZF:
             return rdbLoadLzfStringObject(rdb);
+        // 使用lz4或zstd算法压缩后的字符串
+        case REDIS_RDB_ENC_LZ4:
+        case REDIS_RDB_ENC_ZSTD:
+            if (!rdbCodecAvailable(rdbCodecOfEncoding(len))) {
+                redisLog(REDIS_WARNING,"RDB string compressed with %s, but this server was compiled without %s support",
+                    rdbCodecName(rdbCodecOfEncoding(len)),rdbCodecName(rdbCodecOfEncoding(len)));
+                return NULL;
+            }
+            return rdbLoadCompressedStringObject(rdb,rdbCodecOfEncoding(len));
         default:
             redisPanic("Unknown RDB encoding type");
         }
@@ -563,12 +587,9 @@ int rdbSaveObjectType(rio *rdb, robj *o) {
         // REDIS_RDB_TYPE_STRING编码
         return rdbSaveType(rdb,REDIS_RDB_TYPE_STRING);
     case REDIS_LIST:
-        if (o->encoding == REDIS_ENCODING_ZIPLIST)
-            // REDIS_ENCODING_ZIPLIST编码的list
-            return rdbSaveType(rdb,REDIS_RDB_TYPE_LIST_ZIPLIST);
-        else if (o->encoding == REDIS_ENCODING_LINKEDLIST)
-            // REDIS_ENCODING_LINKEDLIST编码的list
-            return rdbSaveType(rdb,REDIS_RDB_TYPE_LIST);
+        if (o->encoding == REDIS_ENCODING_QUICKLIST)
+            // REDIS_ENCODING_QUICKLIST编码的list
+            return rdbSaveType(rdb,REDIS_RDB_TYPE_LIST_QUICKLIST_LISTPACK);
         else
             redisPanic("Unknown list encoding");
     case REDIS_SET:
@@ -578,21 +599,27 @@ int rdbSaveObjectType(rio *rdb, robj *o) {
         else if (o->encoding == REDIS_ENCODING_HT)
             // REDIS_ENCODING_HT编码的set
             return rdbSaveType(rdb,REDIS_RDB_TYPE_SET);
+        else if (o->encoding == REDIS_ENCODING_ROARING)
+            // REDIS_ENCODING_ROARING编码的set
+            return rdbSaveType(rdb,REDIS_RDB_TYPE_SET_ROARING);
         else
             redisPanic("Unknown set encoding");
     case REDIS_ZSET:
-        if (o->encoding == REDIS_ENCODING_ZIPLIST)
-            // REDIS_ENCODING_ZIPLIST编码的zset
-            return rdbSaveType(rdb,REDIS_RDB_TYPE_ZSET_ZIPLIST);
+        if (o->encoding == REDIS_ENCODING_LISTPACK)
+            // REDIS_ENCODING_LISTPACK编码的zset
+            return rdbSaveType(rdb,REDIS_RDB_TYPE_ZSET_LISTPACK);
         else if (o->encoding == REDIS_ENCODING_SKIPLIST)
             //  REDIS_ENCODING_SKIPLIST编码的zset
             return rdbSaveType(rdb,REDIS_RDB_TYPE_ZSET);
         else
             redisPanic("Unknown sorted set encoding");
     case REDIS_HASH:
-        if (o->encoding == REDIS_ENCODING_ZIPLIST)
-            // REDIS_ENCODING_ZIPLIST编码的hash
-            return rdbSaveType(rdb,REDIS_RDB_TYPE_HASH_ZIPLIST);
+        if (o->encoding == REDIS_ENCODING_LISTPACK)
+            // REDIS_ENCODING_LISTPACK编码的hash
+            return rdbSaveType(rdb,REDIS_RDB_TYPE_HASH_LISTPACK);
+        else if (o->encoding == REDIS_ENCODING_LISTPACK_EX)
+            // REDIS_ENCODING_LISTPACK_EX编码的hash
+            return rdbSaveType(rdb,REDIS_RDB_TYPE_HASH_LISTPACK_EX);
         else if (o->encoding == REDIS_ENCODING_HT)
             //  REDIS_ENCODING_HT编码的hash
             return rdbSaveType(rdb,REDIS_RDB_TYPE_HASH);
@@ -632,32 +659,21 @@ int rdbSaveObject(rio *rdb, robj *o) {
     // 处理REDIS_LIST类型对象
     else if (o->type == REDIS_LIST) {
         /* Save a list value */
-        // 处理REDIS_ENCODING_ZIPLIST编码的list
-        if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-            // 获取ziplist占用的空间大小
-            size_t l = ziplistBlobLen((unsigned char*)o->ptr);
-
-            // ziplist本身就是一个字符数组，这里以字符串的形式保存整个ziplist
-            if ((n = rdbSaveRawString(rdb,o->ptr,l)) == -1) return -1;
-            nwritten += n;
-        } 
-        // 处理REDIS_ENCODING_LINKEDLIST编码的list
-        else if (o->encoding == REDIS_ENCODING_LINKEDLIST) {
-            list *list = o->ptr;
+        // 处理REDIS_ENCODING_QUICKLIST编码的list
+        if (o->encoding == REDIS_ENCODING_QUICKLIST) {
+            quicklist *ql = o->ptr;
             listIter li;
             listNode *ln;
 
-            // 写入长度信息（节点个数）
-            if ((n = rdbSaveLen(rdb,listLength(list))) == -1) return -1;
+            // 写入长度信息（quicklist的节点个数）
+            if ((n = rdbSaveLen(rdb,listLength(ql->nodes))) == -1) return -1;
             nwritten += n;
 
-            listRewind(list,&li);
-            // 遍历list中的每一项
+            // 每个节点中的listpack本身就是一个字符数组，这里以字符串的形式逐个保存
+            listRewind(ql->nodes,&li);
             while((ln = listNext(&li))) {
-                // 获取当前节点中的保存的数据内容
-                robj *eleobj = listNodeValue(ln);
-                // 以字符串的形式保存当前节点的内容
-                if ((n = rdbSaveStringObject(rdb,eleobj)) == -1) return -1;
+                quicklistNode *node = quicklistNodeOf(ln);
+                if ((n = rdbSaveRawString(rdb,node->lp,node->sz)) == -1) return -1;
                 nwritten += n;
             }
         } else {
@@ -695,6 +711,17 @@ int rdbSaveObject(rio *rdb, robj *o) {
             // inset本身是一个字符数组，这里以字符串的形式保存整个inset
             if ((n = rdbSaveRawString(rdb,o->ptr,l)) == -1) return -1;
             nwritten += n;
+        } 
+        // 处理REDIS_ENCODING_ROARING编码的set，先序列化再以字符串的形式保存
+        else if (o->encoding == REDIS_ENCODING_ROARING) {
+            size_t l = roaringSerializedSize(o->ptr);
+            unsigned char *buf = zmalloc(l);
+
+            roaringSerialize(o->ptr,buf);
+            n = rdbSaveRawString(rdb,buf,l);
+            zfree(buf);
+            if (n == -1) return -1;
+            nwritten += n;
         } else {
             redisPanic("Unknown set encoding");
         }
@@ -702,12 +729,12 @@ int rdbSaveObject(rio *rdb, robj *o) {
     // 处理REDIS_ZSET类型对象
     else if (o->type == REDIS_ZSET) {
         /* Save a sorted set value */
-        // 处理REDIS_ENCODING_ZIPLIST编码的zset
-        if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-            // 计算ziplist所占用空间大小
-            size_t l = ziplistBlobLen((unsigned char*)o->ptr);
+        // 处理REDIS_ENCODING_LISTPACK编码的zset
+        if (o->encoding == REDIS_ENCODING_LISTPACK) {
+            // 计算listpack所占用空间大小
+            size_t l = lpBytes((unsigned char*)o->ptr);
 
-            // ziplist本身是一个字符数组，这里以字符串的形式保存整个ziplist
+            // listpack本身是一个字符数组，这里以字符串的形式保存整个listpack
             if ((n = rdbSaveRawString(rdb,o->ptr,l)) == -1) return -1;
             nwritten += n;
         } 
@@ -744,16 +771,24 @@ int rdbSaveObject(rio *rdb, robj *o) {
     // 处理REDIS_HASH类型对象
     else if (o->type == REDIS_HASH) {
         /* Save a hash value */
-        // 处理REDIS_ENCODING_ZIPLIST编码的hash
-        if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-            // 计算ziplist所占用空间大小
-            size_t l = ziplistBlobLen((unsigned char*)o->ptr);
+        // 处理REDIS_ENCODING_LISTPACK编码的hash
+        if (o->encoding == REDIS_ENCODING_LISTPACK) {
+            // 计算listpack所占用空间大小
+            size_t l = lpBytes((unsigned char*)o->ptr);
 
-            // ziplist本身是一个字符数组，这里以字符串的形式保存整个ziplist
+            // listpack本身是一个字符数组，这里以字符串的形式保存整个listpack
             if ((n = rdbSaveRawString(rdb,o->ptr,l)) == -1) return -1;
             nwritten += n;
 
-        } 
+        }
+        // 处理REDIS_ENCODING_LISTPACK_EX编码的hash，只保存listpack，索引在载入后按需重建
+        else if (o->encoding == REDIS_ENCODING_LISTPACK_EX) {
+            hashpack *hp = o->ptr;
+
+            if ((n = rdbSaveRawString(rdb,hp->lp,lpBytes(hp->lp))) == -1) return -1;
+            nwritten += n;
+
+        }
         // 处理REDIS_ENCODING_HT编码的hash
         else if (o->encoding == REDIS_ENCODING_HT) {
             dictIterator *di = dictGetIterator(o->ptr);
@@ -829,6 +864,82 @@ int rdbSaveKeyValuePair(rio *rdb, robj *key, robj *val,
     return 1;
 }
 
+/* Number of values sampled to train the Zstd dictionary, and the range of
+ * lengths of the sampled values. */
+// 训练Zstd字典时采样的value个数，以及被采样的value的长度范围
+#define RDB_DICT_MAX_SAMPLES 10000
+#define RDB_DICT_MIN_SAMPLES 100
+#define RDB_DICT_MAX_SAMPLE_LEN 4096
+
+/* When Zstd compression with a dictionary is configured, train a dictionary
+ * on a random sample of the string values and save it right after the RDB
+ * header. The dictionary is then used to compress every string of this
+ * save. Returns -1 on write error, 0 otherwise (including when no
+ * dictionary could be trained). */
+/*  如果配置了使用字典的Zstd压缩，则从所有字符串类型的value中随机采样并训练出一个字典，
+    紧接着RDB文件头写入文件中，此后本次保存的所有字符串都使用该字典进行压缩。
+    写入出错时返回-1，否则返回0（包括无法训练出字典的情况）。*/
+static int rdbSaveCompressionDict(rio *rdb) {
+    unsigned long total = 0;
+    unsigned int nsamples = 0;
+    size_t *sizes;
+    sds samples, dict;
+    int j, retval = 0;
+
+    if (!server.rdb_compression ||
+        server.rdb_compression_codec != RDB_CODEC_ZSTD ||
+        server.rdb_compression_dict_size == 0) return 0;
+
+    for (j = 0; j < server.dbnum; j++) total += dictSize(server.db[j].dict);
+    if (total == 0) return 0;
+
+    // 每个数据库的采样数与其大小成正比
+    sizes = zmalloc(sizeof(size_t)*RDB_DICT_MAX_SAMPLES);
+    samples = sdsempty();
+    for (j = 0; j < server.dbnum && nsamples < RDB_DICT_MAX_SAMPLES; j++) {
+        dict *d = server.db[j].dict;
+        unsigned long want;
+
+        if (dictSize(d) == 0) continue;
+        want = (unsigned long long)RDB_DICT_MAX_SAMPLES*dictSize(d)/total+1;
+        while (want-- && nsamples < RDB_DICT_MAX_SAMPLES) {
+            dictEntry *de = dictGetRandomKey(d);
+            packedObjectView view;
+            robj *o = keyspaceValueView(dictGetVal(de),&view);
+            size_t len;
+
+            // 只采样字符串类型、并且会被压缩的value
+            if (o->type != REDIS_STRING || !sdsEncodedObject(o)) continue;
+            len = sdslen(o->ptr);
+            if (len <= 20 || len > RDB_DICT_MAX_SAMPLE_LEN) continue;
+            samples = sdscatlen(samples,o->ptr,len);
+            sizes[nsamples++] = len;
+        }
+    }
+
+    dict = (nsamples >= RDB_DICT_MIN_SAMPLES) ?
+        rdbCodecTrainDict(samples,sizes,nsamples,server.rdb_compression_dict_size) :
+        NULL;
+    sdsfree(samples);
+    zfree(sizes);
+    if (dict == NULL) return 0;
+
+    /* The dictionary is saved verbatim, it can't be compressed with
+     * itself. */
+    // 字典本身以原始形式保存，不能用它自己来压缩
+    if (rdbSaveType(rdb,REDIS_RDB_OPCODE_COMPRESSION_DICT) == -1 ||
+        rdbSaveLen(rdb,sdslen(dict)) == -1 ||
+        rdbWriteRaw(rdb,dict,sdslen(dict)) == -1)
+    {
+        retval = -1;
+    } else if (rdbCodecSetDict(dict,sdslen(dict)) == -1) {
+        /* The dictionary is in the file but not used: harmless. */
+        redisLog(REDIS_WARNING,"Unable to use the trained Zstd dictionary");
+    }
+    sdsfree(dict);
+    return retval;
+}
+
 /* Produces a dump of the database in RDB format sending it to the specified
  * Redis I/O channel. On success REDIS_OK is returned, otherwise REDIS_ERR
  * is returned and part of the output, or all the output, can be
@@ -854,6 +965,8 @@ int rdbSaveRio(rio *rdb, int *error) {
     snprintf(magic,sizeof(magic),"REDIS%04d",REDIS_RDB_VERSION);
     // 写入RDB版本号
     if (rdbWriteRaw(rdb,magic,9) == -1) goto werr;
+    // 如果需要的话，写入Zstd字典
+    if (rdbSaveCompressionDict(rdb) == -1) goto werr;
 
     // 遍历Redis服务器上的所有数据库
     for (j = 0; j < server.dbnum; j++) {
@@ -876,7 +989,8 @@ int rdbSaveRio(rio *rdb, int *error) {
         while((de = dictNext(di)) != NULL) {
             // 获取key和value
             sds keystr = dictGetKey(de);
-            robj key, *o = dictGetVal(de);
+            packedObjectView view;
+            robj key, *o = keyspaceValueView(dictGetVal(de),&view);
             long long expire;
 
             // 创建一个key对象
@@ -902,11 +1016,13 @@ int rdbSaveRio(rio *rdb, int *error) {
     memrev64ifbe(&cksum);
     // 写入校验和
     if (rioWrite(rdb,&cksum,8) == 0) goto werr;
+    rdbCodecResetDict();
     return REDIS_OK;
 
 werr:
     if (error) *error = errno;
     if (di) dictReleaseIterator(di);
+    rdbCodecResetDict();
     return REDIS_ERR;
 }
 
@@ -943,6 +1059,334 @@ werr: /* Write error. */
     return REDIS_ERR;
 }
 
+/* --------------------------- Thread-safe queue ---------------------------- */
+
+/* Used by the parallel saving and the threaded loading code below. */
+/* 下面的多线程保存和多线程载入都使用该队列在线程之间传递数据 */
+
+/* A bounded FIFO queue of pointers shared between threads. */
+/* 线程间共享的有界FIFO队列 */
+typedef struct rdbQueue {
+    // 保存元素的环形数组
+    void **items;
+    // 队列容量
+    int size;
+    // 队首元素的下标
+    int head;
+    // 队列中元素的个数
+    int len;
+    // 为1表示不会再有新的元素入队
+    int closed;
+    pthread_mutex_t lock;
+    pthread_cond_t notempty;
+    pthread_cond_t notfull;
+} rdbQueue;
+
+/* 初始化容量为size的队列 */
+static void rdbQueueInit(rdbQueue *q, int size) {
+    q->items = zmalloc(sizeof(void*)*size);
+    q->size = size;
+    q->head = 0;
+    q->len = 0;
+    q->closed = 0;
+    pthread_mutex_init(&q->lock,NULL);
+    pthread_cond_init(&q->notempty,NULL);
+    pthread_cond_init(&q->notfull,NULL);
+}
+
+/* 释放队列，调用者需要保证队列已经为空 */
+static void rdbQueueFree(rdbQueue *q) {
+    zfree(q->items);
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->notempty);
+    pthread_cond_destroy(&q->notfull);
+}
+
+/* 将item加入队尾，队列已满时阻塞等待 */
+static void rdbQueuePush(rdbQueue *q, void *item) {
+    pthread_mutex_lock(&q->lock);
+    while (q->len == q->size) pthread_cond_wait(&q->notfull,&q->lock);
+    q->items[(q->head+q->len) % q->size] = item;
+    q->len++;
+    pthread_cond_signal(&q->notempty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/* Pop the item at the head of the queue. When 'block' is non zero wait for
+ * an item to be available. NULL is returned if the queue is empty and
+ * either 'block' is zero or the queue was closed. */
+/*  弹出队首元素。如果block不为0，则在队列为空时阻塞等待。
+    如果队列为空且block为0或者队列已关闭，返回NULL。*/
+static void *rdbQueuePop(rdbQueue *q, int block) {
+    void *item;
+
+    pthread_mutex_lock(&q->lock);
+    while (q->len == 0 && block && !q->closed)
+        pthread_cond_wait(&q->notempty,&q->lock);
+    if (q->len == 0) {
+        pthread_mutex_unlock(&q->lock);
+        return NULL;
+    }
+    item = q->items[q->head];
+    q->head = (q->head+1) % q->size;
+    q->len--;
+    pthread_cond_signal(&q->notfull);
+    pthread_mutex_unlock(&q->lock);
+    return item;
+}
+
+/* 关闭队列，唤醒所有等待的线程 */
+static void rdbQueueClose(rdbQueue *q) {
+    pthread_mutex_lock(&q->lock);
+    q->closed = 1;
+    pthread_cond_broadcast(&q->notempty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/* --------------------------- Chunked RDB saving --------------------------- */
+
+/*  分块RDB格式（REDIS_RDB_VERSION_CHUNKED）。每个数据库的键空间被拆分为若干个自包含的块，每个块可以独立地校验和解析：
+
+    CHUNK <dbid> <nkeys> <payload len (8 bytes)> <payload> <crc64 (8 bytes)>
+
+    payload中的内容与普通RDB文件中的键值对完全相同（[EXPIRETIME_MS] TYPE KEY VALUE）。
+    所有块之后是EOF和整个文件的校验和。rdbLoad顺序读取所有的块；文件中没有块索引，因为没有任何读取者会使用它。
+
+    保存时每个数据库的字典按照dictScan的游标空间被分成numthreads个片段，每个线程负责一个片段，
+    将其中的键值对序列化到内存中的块里，调用线程负责按顺序将块写入rio。 */
+
+#define RDB_CHUNK_TARGET_SIZE (4*1024*1024) /* Flush a chunk over this size. */
+#define RDB_SAVE_MAX_THREADS 16
+// 字典中的桶少于该值时不再拆分片段
+#define RDB_SAVE_MIN_SLICE_BUCKETS 1024
+
+/* A chunk serialized by a saving thread. */
+/* 保存线程序列化得到的一个块，写入rio之后被释放 */
+typedef struct rdbChunk {
+    // 块所属的数据库编号
+    int dbid;
+    // 块中key的个数
+    uint32_t nkeys;
+    // 序列化后的键值对，写入后被释放
+    sds payload;
+    // payload的长度
+    uint64_t len;
+    // payload的CRC64，关闭校验功能时为0
+    uint64_t crc;
+} rdbChunk;
+
+/* State of a thread saving one slice of a dict. */
+/* 负责保存字典中一个片段的线程的状态 */
+typedef struct rdbSaveSlice {
+    pthread_t thread;
+    redisDb *db;
+    int dbid;
+    // 片段在游标空间中的范围[start,end)，bits为游标的有效位数
+    unsigned long start, end;
+    int bits;
+    long long now;
+    // 序列化的目标，写入的内容保存在rdb.io.buffer.ptr中
+    rio rdb;
+    uint32_t nkeys;
+    // 完成的块会被放入该队列，NULL表示该线程已经结束
+    rdbQueue *chunks;
+    int error;
+} rdbSaveSlice;
+
+/* Hand the chunk being built to the writer. */
+/* 将当前正在构建的块交给写入线程 */
+static void rdbSaveSliceFlush(rdbSaveSlice *slice) {
+    rdbChunk *chunk;
+
+    if (slice->nkeys == 0) return;
+    chunk = zmalloc(sizeof(*chunk));
+    chunk->dbid = slice->dbid;
+    chunk->nkeys = slice->nkeys;
+    chunk->payload = slice->rdb.io.buffer.ptr;
+    chunk->len = sdslen(chunk->payload);
+    chunk->crc = server.rdb_checksum ?
+        crc64(0,(unsigned char*)chunk->payload,chunk->len) : 0;
+    rdbQueuePush(slice->chunks,chunk);
+
+    rioInitWithBuffer(&slice->rdb,sdsempty());
+    slice->nkeys = 0;
+}
+
+/* dictScan() callback serializing one key value pair. */
+/* dictScan的回调函数，序列化一个键值对 */
+static void rdbSaveScanCallback(void *privdata, const dictEntry *de) {
+    rdbSaveSlice *slice = privdata;
+    sds keystr = dictGetKey(de);
+    packedObjectView view;
+    robj key, *o = keyspaceValueView(dictGetVal(de),&view);
+    long long expire;
+    int retval;
+
+    if (slice->error) return;
+    initStaticStringObject(key,keystr);
+    expire = getExpire(slice->db,&key);
+    retval = rdbSaveKeyValuePair(&slice->rdb,&key,o,expire,slice->now);
+    if (retval == -1) {
+        slice->error = 1;
+        return;
+    }
+    // 已经过期的key不会被保存
+    if (retval == 0) return;
+    slice->nkeys++;
+}
+
+/* Saving thread: scan the slice [start,end) of the dict. */
+/* 保存线程：遍历字典中[start,end)范围内的桶 */
+static void *rdbSaveSliceMain(void *arg) {
+    rdbSaveSlice *slice = arg;
+    dict *d = slice->db->dict;
+    unsigned long v = dictScanCursorAt(slice->start,slice->bits);
+
+    do {
+        v = dictScan(d,v,rdbSaveScanCallback,slice);
+        if (slice->error) break;
+        // dictScan以桶为单位返回，所以块的大小只是近似地受RDB_CHUNK_TARGET_SIZE限制
+        if (sdslen(slice->rdb.io.buffer.ptr) >= RDB_CHUNK_TARGET_SIZE)
+            rdbSaveSliceFlush(slice);
+    } while (v != 0 && dictScanCursorPos(v,slice->bits) < slice->end);
+    if (!slice->error) rdbSaveSliceFlush(slice);
+    rdbQueuePush(slice->chunks,NULL);
+    return NULL;
+}
+
+/* 写入一个8字节的无符号整数（小端） */
+static int rdbSaveRawUint64(rio *rdb, uint64_t v) {
+    memrev64ifbe(&v);
+    return rdbWriteRaw(rdb,&v,8);
+}
+
+/* 读取一个8字节的无符号整数（小端） */
+static int rdbLoadRawUint64(rio *rdb, uint64_t *v) {
+    if (rioRead(rdb,v,8) == 0) return -1;
+    memrev64ifbe(v);
+    return 0;
+}
+
+/* Write a chunk produced by a saving thread. */
+/* 将保存线程生成的块写入rio */
+static int rdbSaveChunk(rio *rdb, rdbChunk *chunk) {
+    if (rdbSaveType(rdb,REDIS_RDB_OPCODE_CHUNK) == -1) return -1;
+    if (rdbSaveLen(rdb,chunk->dbid) == -1) return -1;
+    if (rdbSaveLen(rdb,chunk->nkeys) == -1) return -1;
+    if (rdbSaveRawUint64(rdb,chunk->len) == -1) return -1;
+    if (rdbWriteRaw(rdb,chunk->payload,chunk->len) == -1) return -1;
+    if (rdbSaveRawUint64(rdb,chunk->crc) == -1) return -1;
+    return 0;
+}
+
+/* 释放一个块 */
+static void rdbChunkFree(rdbChunk *chunk) {
+    sdsfree(chunk->payload);
+    zfree(chunk);
+}
+
+/* Save the dict of 'db' splitting it into 'numthreads' slices. */
+/* 将数据库db拆分为numthreads个片段并行保存 */
+static int rdbSaveDbChunked(rio *rdb, int dbid, int numthreads, long long now) {
+    redisDb *db = server.db+dbid;
+    dict *d = db->dict;
+    rdbSaveSlice slices[RDB_SAVE_MAX_THREADS];
+    unsigned long buckets;
+    rdbQueue chunks;
+    rdbChunk *chunk;
+    int bits, j, running, error = 0;
+
+    // 游标空间由较小的哈希表决定
+    bits = dictScanCursorBits(d);
+    buckets = 1UL << bits;
+    if (buckets < (unsigned long)numthreads*RDB_SAVE_MIN_SLICE_BUCKETS)
+        numthreads = 1;
+
+    // 各个线程并发地查找键空间和过期字典，在此期间必须暂停渐进式rehash
+    dictPauseRehashing(db->dict);
+    dictPauseRehashing(db->expires);
+    rdbQueueInit(&chunks,numthreads*2);
+    for (j = 0; j < numthreads; j++) {
+        rdbSaveSlice *slice = slices+j;
+
+        memset(slice,0,sizeof(*slice));
+        slice->db = db;
+        slice->dbid = dbid;
+        slice->bits = bits;
+        slice->start = (buckets/numthreads)*j;
+        slice->end = (j == numthreads-1) ? buckets : (buckets/numthreads)*(j+1);
+        slice->now = now;
+        slice->chunks = &chunks;
+        rioInitWithBuffer(&slice->rdb,sdsempty());
+        if (pthread_create(&slice->thread,NULL,rdbSaveSliceMain,slice) != 0) {
+            redisLog(REDIS_WARNING,"Fatal: Can't create RDB saving threads.");
+            exit(1);
+        }
+    }
+
+    // 按照完成的顺序写入各个块，直到所有线程都结束
+    running = numthreads;
+    while (running) {
+        chunk = rdbQueuePop(&chunks,1);
+        if (chunk == NULL) {
+            running--;
+            continue;
+        }
+        if (!error && rdbSaveChunk(rdb,chunk) == -1) error = 1;
+        rdbChunkFree(chunk);
+    }
+
+    for (j = 0; j < numthreads; j++) {
+        pthread_join(slices[j].thread,NULL);
+        if (slices[j].error) error = 1;
+        sdsfree(slices[j].rdb.io.buffer.ptr);
+    }
+    rdbQueueFree(&chunks);
+    dictResumeRehashing(db->dict);
+    dictResumeRehashing(db->expires);
+    return error ? -1 : 0;
+}
+
+/* Like rdbSaveRio() but produces the chunked format, serializing every DB
+ * with 'numthreads' threads. */
+/*  与rdbSaveRio类似，但是生成分块格式的RDB文件，每个数据库由numthreads个线程并行序列化。
+    如果保存成功函数返回REDIS_OK，如果保存失败则返回REDIS_ERR。*/
+int rdbSaveRioChunked(rio *rdb, int *error, int numthreads) {
+    char magic[10];
+    int j;
+    long long now = mstime();
+    uint64_t cksum;
+
+    if (numthreads < 1) numthreads = 1;
+    if (numthreads > RDB_SAVE_MAX_THREADS) numthreads = RDB_SAVE_MAX_THREADS;
+
+    if (server.rdb_checksum)
+        rdb->update_cksum = rioGenericUpdateChecksum;
+    snprintf(magic,sizeof(magic),"REDIS%04d",REDIS_RDB_VERSION);
+    if (rdbWriteRaw(rdb,magic,9) == -1) goto werr;
+    if (rdbSaveCompressionDict(rdb) == -1) goto werr;
+
+    // 逐个保存每个数据库
+    for (j = 0; j < server.dbnum; j++) {
+        if (dictSize(server.db[j].dict) == 0) continue;
+        if (rdbSaveDbChunked(rdb,j,numthreads,now) == -1) goto werr;
+    }
+
+    /* EOF opcode and CRC64 checksum, as in rdbSaveRio(). */
+    // 写入EOF符和校验和，与rdbSaveRio相同
+    if (rdbSaveType(rdb,REDIS_RDB_OPCODE_EOF) == -1) goto werr;
+    cksum = rdb->cksum;
+    memrev64ifbe(&cksum);
+    if (rioWrite(rdb,&cksum,8) == 0) goto werr;
+    rdbCodecResetDict();
+    return REDIS_OK;
+
+werr:
+    if (error) *error = errno;
+    rdbCodecResetDict();
+    return REDIS_ERR;
+}
+
 /* Save the DB on disk. Return REDIS_ERR on error, REDIS_OK on success. */
 /*  save命令的底层函数。将Redis数据库db保存到磁盘中，如果操作成功函数返回REDIS_OK，如果操作失败函数返回REDIS_ERR。*/
 int rdbSave(char *filename) {
@@ -963,8 +1407,11 @@ int rdbSave(char *filename) {
 
     // 初始化file rio对象
     rioInitWithFile(&rdb,fp);
-    // 调用rdbSaveRio将db中的数据写入RDB文件中
-    if (rdbSaveRio(&rdb,&error) == REDIS_ERR) {
+    // 调用rdbSaveRio将db中的数据写入RDB文件中，如果开启了多线程保存则生成分块格式
+    if ((server.rdb_save_threads > 0 ?
+         rdbSaveRioChunked(&rdb,&error,server.rdb_save_threads) :
+         rdbSaveRio(&rdb,&error)) == REDIS_ERR)
+    {
         errno = error;
         goto werr;
     }
@@ -1011,6 +1458,8 @@ int rdbSaveBackground(char *filename) {
     // 记录最后一次执行bgsave的时间戳
     server.lastbgsave_try = time(NULL);
 
+    // 打开子进程报告写时复制开销用的管道
+    openChildInfoPipe(REDIS_CHILD_INFO_TYPE_RDB);
     // 开始执行时间戳
     start = ustime();
     // fork一个子进程
@@ -1026,15 +1475,8 @@ int rdbSaveBackground(char *filename) {
         redisSetProcTitle("redis-rdb-bgsave");
         // 通过rdbSave函数实现保存操作
         retval = rdbSave(filename);
-        if (retval == REDIS_OK) {
-            size_t private_dirty = zmalloc_get_private_dirty();
-
-            if (private_dirty) {
-                redisLog(REDIS_NOTICE,
-                    "RDB: %zu MB of memory used by copy-on-write",
-                    private_dirty/(1024*1024));
-            }
-        }
+        // 报告写时复制的开销
+        if (retval == REDIS_OK) sendChildInfo(REDIS_CHILD_INFO_TYPE_RDB,"RDB");
         // 向父进程发送信号
         exitFromChild((retval == REDIS_OK) ? 0 : 1);
     } else {
@@ -1044,8 +1486,10 @@ int rdbSaveBackground(char *filename) {
         server.stat_fork_time = ustime()-start;
         server.stat_fork_rate = (double) zmalloc_used_memory() * 1000000 / server.stat_fork_time / (1024*1024*1024); /* GB per second. */
         latencyAddSampleIfNeeded("fork",server.stat_fork_time/1000);
+        latencyProbeAddIfNeeded(LATENCY_PROBE_FORK,server.stat_fork_time);
         // fork出错，返回
         if (childpid == -1) {
+            closeChildInfoPipe(REDIS_CHILD_INFO_TYPE_RDB);
             server.lastbgsave_status = REDIS_ERR;
             redisLog(REDIS_WARNING,"Can't save in background: fork: %s",
                 strerror(errno));
@@ -1090,57 +1534,60 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
         // 读取list的长度，即包含的节点个数
         if ((len = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) return NULL;
 
-        /* Use a real list when there are too many entries */
-        // 根据节点个数，创建linked list编码或ziplist编码的list对象
-        if (len > server.list_max_ziplist_entries) {
-            o = createListObject();
-        } else {
-            o = createZiplistObject();
-        }
+        // 老版本的linked list编码list，逐个载入元素并添加到quicklist中
+        o = createQuicklistObject();
 
         /* Load every single element of the list */
         // 载入所有的list节点
         while(len--) {
             if ((ele = rdbLoadEncodedStringObject(rdb)) == NULL) return NULL;
+            dec = getDecodedObject(ele);
+            quicklistPushTail(o->ptr,dec->ptr,sdslen(dec->ptr));
+            decrRefCount(dec);
+            decrRefCount(ele);
+        }
+    } 
+    // quicklist编码的list对象
+    else if (rdbtype == REDIS_RDB_TYPE_LIST_QUICKLIST ||
+             rdbtype == REDIS_RDB_TYPE_LIST_QUICKLIST_LISTPACK)
+    {
+        // 读取quicklist的节点个数
+        if ((len = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) return NULL;
+        o = createQuicklistObject();
 
-            /* If we are using a ziplist and the value is too big, convert
-             * the object to a real list. */
-            // 如果当前的list是linked list编码，并且当前节点的字符串对象长度超过了
-            // list_max_ziplist_value则将list转换为linke list编码
-            if (o->encoding == REDIS_ENCODING_ZIPLIST &&
-                sdsEncodedObject(ele) &&
-                sdslen(ele->ptr) > server.list_max_ziplist_value)
-                    listTypeConvert(o,REDIS_ENCODING_LINKEDLIST);
-
-            // 往ziplist中添加一个元素
-            if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-                dec = getDecodedObject(ele);
-                o->ptr = ziplistPush(o->ptr,dec->ptr,sdslen(dec->ptr),REDIS_TAIL);
-                decrRefCount(dec);
-                decrRefCount(ele);
-            } 
-            // 往linked list中添加一个元素
-            else {
-                ele = tryObjectEncoding(ele);
-                listAddNodeTail(o->ptr,ele);
+        // 逐个载入节点，旧格式中的ziplist会被转换为listpack，然后直接作为quicklist的节点
+        while (len--) {
+            robj *aux = rdbLoadStringObject(rdb);
+            unsigned char *lp;
+
+            if (aux == NULL) return NULL;
+            if (rdbtype == REDIS_RDB_TYPE_LIST_QUICKLIST) {
+                lp = lpFromZiplist(aux->ptr);
+            } else {
+                if (!lpValidate(aux->ptr,sdslen(aux->ptr))) {
+                    redisLog(REDIS_WARNING,"Listpack integrity check failed.");
+                    decrRefCount(aux);
+                    return NULL;
+                }
+                lp = zmalloc(sdslen(aux->ptr));
+                memcpy(lp,aux->ptr,sdslen(aux->ptr));
             }
+            decrRefCount(aux);
+            quicklistAppendListpack(o->ptr,lp);
         }
-    } 
+    }
     // set类型对象
     else if (rdbtype == REDIS_RDB_TYPE_SET) {
         /* Read list/set value */
         // 读取set中保存的元素个数
         if ((len = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) return NULL;
 
-        /* Use a regular set when there are too many entries. */
-        // 根据元素个数的多少，创建intset编码或dict编码的set对象
+        /* Use a roaring bitmap when there are too many entries, it is
+         * converted to a regular set as soon as a non integer shows up. */
+        // 根据元素个数的多少，创建intset编码或roaring编码的set对象，遇到非整数元素时再转换为dict编码
         if (len > server.set_max_intset_entries) {
-            o = createSetObject();
-            /* It's faster to expand the dict to the right size asap in order
-             * to avoid rehashing */
-            // 扩充空间，避免rehash操作
-            if (len > DICT_HT_INITIAL_SIZE)
-                dictExpand(o->ptr,len);
+            o = createObject(REDIS_SET,roaringNew());
+            o->encoding = REDIS_ENCODING_ROARING;
         } else {
             o = createIntsetObject();
         }
@@ -1163,6 +1610,16 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
                     setTypeConvert(o,REDIS_ENCODING_HT);
                     dictExpand(o->ptr,len);
                 }
+            } else if (o->encoding == REDIS_ENCODING_ROARING) {
+                if (isObjectRepresentableAsLongLong(ele,&llval) == REDIS_OK) {
+                    roaringAdd(o->ptr,llval);
+                } else {
+                    /* It's faster to expand the dict to the right size asap
+                     * in order to avoid rehashing */
+                    // 扩充空间，避免rehash操作
+                    setTypeConvert(o,REDIS_ENCODING_HT);
+                    dictExpand(o->ptr,len);
+                }
             }
 
             /* This will also be called when the set was just converted
@@ -1214,10 +1671,10 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
 
         /* Convert *after* loading, since sorted sets are not stored ordered. */
         //  如果有序集合zset中的元素个数并未超过zset_max_ziplist_entries且最大的元素长度也未超过
-        //  zset_max_ziplist_value，则使用ziplist编码以节省空间
+        //  zset_max_ziplist_value，则使用listpack编码以节省空间
         if (zsetLength(o) <= server.zset_max_ziplist_entries &&
             maxelelen <= server.zset_max_ziplist_value)
-                zsetConvert(o,REDIS_ENCODING_ZIPLIST);
+                zsetConvert(o,REDIS_ENCODING_LISTPACK);
     } 
     // hash类型对象
     else if (rdbtype == REDIS_RDB_TYPE_HASH) {
@@ -1236,9 +1693,9 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
         if (len > server.hash_max_ziplist_entries)
             hashTypeConvert(o, REDIS_ENCODING_HT);
 
-        /* Load every field and value into the ziplist */
-        //  如果当前hash对象为ziplist编码，载入所有的key值和value值并添加到ziplist中
-        while (o->encoding == REDIS_ENCODING_ZIPLIST && len > 0) {
+        /* Load every field and value into the listpack */
+        //  如果当前hash对象为listpack编码，载入所有的key值和value值并添加到listpack中
+        while (o->encoding == REDIS_ENCODING_LISTPACK && len > 0) {
             robj *field, *value;
 
             len--;
@@ -1252,10 +1709,10 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
             if (value == NULL) return NULL;
             redisAssert(sdsEncodedObject(value));
 
-            /* Add pair to ziplist */
-            // key值和value值组成一个键值对，添加到ziplisst中
-            o->ptr = ziplistPush(o->ptr, field->ptr, sdslen(field->ptr), ZIPLIST_TAIL);
-            o->ptr = ziplistPush(o->ptr, value->ptr, sdslen(value->ptr), ZIPLIST_TAIL);
+            /* Add pair to listpack */
+            // key值和value值组成一个键值对，添加到listpack中
+            o->ptr = lpPush(o->ptr, field->ptr, sdslen(field->ptr), LP_TAIL);
+            o->ptr = lpPush(o->ptr, value->ptr, sdslen(value->ptr), LP_TAIL);
             /* Convert to hash table if size threshold is exceeded */
             // 如果key或value的长度超过hash_max_ziplist_value，则转换为dict编码
             if (sdslen(field->ptr) > server.hash_max_ziplist_value ||
@@ -1303,17 +1760,23 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
                rdbtype == REDIS_RDB_TYPE_LIST_ZIPLIST ||
                rdbtype == REDIS_RDB_TYPE_SET_INTSET   ||
                rdbtype == REDIS_RDB_TYPE_ZSET_ZIPLIST ||
-               rdbtype == REDIS_RDB_TYPE_HASH_ZIPLIST)
+               rdbtype == REDIS_RDB_TYPE_HASH_ZIPLIST ||
+               rdbtype == REDIS_RDB_TYPE_ZSET_LISTPACK ||
+               rdbtype == REDIS_RDB_TYPE_HASH_LISTPACK ||
+               rdbtype == REDIS_RDB_TYPE_SET_ROARING ||
+               rdbtype == REDIS_RDB_TYPE_HASH_LISTPACK_EX)
     {
         // 载入字符串对象
         robj *aux = rdbLoadStringObject(rdb);
+        size_t auxlen;
 
         if (aux == NULL) return NULL;
         // 创建对象并分配空间
+        auxlen = sdslen(aux->ptr);
         o = createObject(REDIS_STRING,NULL); /* string is just placeholder */
-        o->ptr = zmalloc(sdslen(aux->ptr));
+        o->ptr = zmalloc(auxlen);
         // 数据拷贝
-        memcpy(o->ptr,aux->ptr,sdslen(aux->ptr));
+        memcpy(o->ptr,aux->ptr,auxlen);
         decrRefCount(aux);
 
         /* Fix the object encoding, and make sure to convert the encoded
@@ -1324,33 +1787,33 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
          * converted. */
         // 检查对象中保存的元素个数，如果其个数超过指定值则转换编码方式
         switch(rdbtype) {
-            // zipmap编码的哈希表已经被废弃，需要统一转换为ziplist编码
+            // zipmap编码的哈希表已经被废弃，需要统一转换为listpack编码
             case REDIS_RDB_TYPE_HASH_ZIPMAP:
-                /* Convert to ziplist encoded hash. This must be deprecated
+                /* Convert to listpack encoded hash. This must be deprecated
                  * when loading dumps created by Redis 2.4 gets deprecated. */
                 {
-                    // 创建ziplist
-                    unsigned char *zl = ziplistNew();
+                    // 创建listpack
+                    unsigned char *lp = lpNew();
                     unsigned char *zi = zipmapRewind(o->ptr);
                     unsigned char *fstr, *vstr;
                     unsigned int flen, vlen;
                     unsigned int maxlen = 0;
 
-                    // 遍历zipmap，从中取出key值和value值并逐一添加到ziplist中
+                    // 遍历zipmap，从中取出key值和value值并逐一添加到listpack中
                     while ((zi = zipmapNext(zi, &fstr, &flen, &vstr, &vlen)) != NULL) {
                         // 记录元素的最大长度，用以后面判断是否需要转换编码方式
                         if (flen > maxlen) maxlen = flen;
                         if (vlen > maxlen) maxlen = vlen;
-                        // 将key值和value顺序加入ziplist中
-                        zl = ziplistPush(zl, fstr, flen, ZIPLIST_TAIL);
-                        zl = ziplistPush(zl, vstr, vlen, ZIPLIST_TAIL);
+                        // 将key值和value顺序加入listpack中
+                        lp = lpPush(lp, fstr, flen, LP_TAIL);
+                        lp = lpPush(lp, vstr, vlen, LP_TAIL);
                     }
 
                     // 释放原zipmap对象空间，然后设置类型、编码信息
                     zfree(o->ptr);
-                    o->ptr = zl;
+                    o->ptr = lp;
                     o->type = REDIS_HASH;
-                    o->encoding = REDIS_ENCODING_ZIPLIST;
+                    o->encoding = REDIS_ENCODING_LISTPACK;
 
                     // 检查是否需要进行编码方式的转换
                     if (hashTypeLength(o) > server.hash_max_ziplist_entries ||
@@ -1361,13 +1824,11 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
                 }
                 break;
 
-            // ziplist编码的list
+            // ziplist编码的list，统一转换为quicklist编码
             case REDIS_RDB_TYPE_LIST_ZIPLIST:
                 o->type = REDIS_LIST;
                 o->encoding = REDIS_ENCODING_ZIPLIST;
-                // 检查是否需要进行编码方式的转换
-                if (ziplistLen(o->ptr) > server.list_max_ziplist_entries)
-                    listTypeConvert(o,REDIS_ENCODING_LINKEDLIST);
+                listTypeConvert(o,REDIS_ENCODING_QUICKLIST);
                 break;
 
             // inset编码的set类型对象
@@ -1376,25 +1837,80 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
                 o->encoding = REDIS_ENCODING_INTSET;
                 // 检查是否需要进行编码方式的转换
                 if (intsetLen(o->ptr) > server.set_max_intset_entries)
-                    setTypeConvert(o,REDIS_ENCODING_HT);
+                    setTypeConvert(o,REDIS_ENCODING_ROARING);
                 break;
 
-            // ziplist编码的zset
+            // roaring编码的set类型对象，反序列化时会检查数据的合法性
+            case REDIS_RDB_TYPE_SET_ROARING:
+                {
+                    roaring *r = roaringDeserialize(o->ptr,auxlen);
+
+                    if (r == NULL) {
+                        redisLog(REDIS_WARNING,"Roaring bitmap integrity check failed.");
+                        return NULL;
+                    }
+                    zfree(o->ptr);
+                    o->ptr = r;
+                    o->type = REDIS_SET;
+                    o->encoding = REDIS_ENCODING_ROARING;
+                }
+                break;
+
+            // ziplist编码的zset（REDIS_RDB_VERSION_LISTPACK之前），转换为listpack编码
             case REDIS_RDB_TYPE_ZSET_ZIPLIST:
+            // listpack编码的zset
+            case REDIS_RDB_TYPE_ZSET_LISTPACK:
+                if (rdbtype == REDIS_RDB_TYPE_ZSET_ZIPLIST) {
+                    unsigned char *lp = lpFromZiplist(o->ptr);
+                    zfree(o->ptr);
+                    o->ptr = lp;
+                } else if (!lpValidate(o->ptr,auxlen)) {
+                    redisLog(REDIS_WARNING,"Listpack integrity check failed.");
+                    return NULL;
+                }
                 o->type = REDIS_ZSET;
-                o->encoding = REDIS_ENCODING_ZIPLIST;
+                o->encoding = REDIS_ENCODING_LISTPACK;
                 // 检查是否需要进行编码方式的转换
                 if (zsetLength(o) > server.zset_max_ziplist_entries)
                     zsetConvert(o,REDIS_ENCODING_SKIPLIST);
                 break;
 
-            // ziplist编码的hash对象
+            // ziplist编码的hash对象（REDIS_RDB_VERSION_LISTPACK之前），转换为listpack编码
             case REDIS_RDB_TYPE_HASH_ZIPLIST:
+            // listpack编码的hash对象
+            case REDIS_RDB_TYPE_HASH_LISTPACK:
+                if (rdbtype == REDIS_RDB_TYPE_HASH_ZIPLIST) {
+                    unsigned char *lp = lpFromZiplist(o->ptr);
+                    zfree(o->ptr);
+                    o->ptr = lp;
+                } else if (!lpValidate(o->ptr,auxlen)) {
+                    redisLog(REDIS_WARNING,"Listpack integrity check failed.");
+                    return NULL;
+                }
                 o->type = REDIS_HASH;
-                o->encoding = REDIS_ENCODING_ZIPLIST;
+                o->encoding = REDIS_ENCODING_LISTPACK;
                 // 检查是否需要进行编码方式的转换
                 if (hashTypeLength(o) > server.hash_max_ziplist_entries)
-                    hashTypeConvert(o, REDIS_ENCODING_HT);
+                    hashTypeGrow(o, 0);
+                break;
+
+            // hashpack编码的hash对象，会检查三个一组的格式
+            case REDIS_RDB_TYPE_HASH_LISTPACK_EX:
+                {
+                    hashpack *hp = NULL;
+
+                    if (lpValidate(o->ptr,auxlen)) hp = hpLoad(o->ptr);
+                    if (hp == NULL) {
+                        redisLog(REDIS_WARNING,"Hashpack integrity check failed.");
+                        return NULL;
+                    }
+                    o->ptr = hp;
+                    o->type = REDIS_HASH;
+                    o->encoding = REDIS_ENCODING_LISTPACK_EX;
+                    // 没有域过期时间且超过限制时转换为dict编码
+                    if (hashTypeLength(o) > server.hash_max_listpack_ex_entries)
+                        hashTypeGrow(o, 0);
+                }
                 break;
             default:
                 redisPanic("Unknown encoding");
@@ -1406,6 +1922,475 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
     return o;
 }
 
+/* ---------------------------- Threaded loading ---------------------------- */
+
+/*  多线程流水线方式载入RDB文件，整个载入过程被拆分为以下几个阶段：
+    1. 预读线程：以RDB_LOAD_BLOCK_SIZE为单位从文件中读取数据，放入有界队列blocks中；
+    2. 主线程：从blocks中取出数据，解析出类型、过期时间和key，并将value的原始字节（不解压、不构建对象）
+       原样拷贝出来，打包成一个任务放入jobs队列；
+    3. 工作线程：从jobs队列中取出任务，调用rdbLoadObject完成LZF解压和对象构建，结果放入done队列；
+    4. 主线程：从done队列中取出构建好的对象，调用dbAdd将其加入数据库。
+    只有最后一步是串行的，因此数据库本身不需要加锁。
+    线程之间通过rdbQueue传递数据。需要注意的是，工作线程中使用了zmalloc，所以必须开启zmalloc的线程安全模式；另外载入期间
+    server.loading_threaded为1，此时不会使用共享整数对象，因为它们的引用计数不是原子操作。 */
+
+#define RDB_LOAD_BLOCK_SIZE (1024*1024) /* Read-ahead block size. */
+#define RDB_LOAD_READAHEAD_BLOCKS 16    /* Max number of blocks read ahead. */
+#define RDB_LOAD_MAX_INFLIGHT 1024      /* Max number of values being built. */
+#define RDB_LOAD_MAX_THREADS 16         /* Max number of worker threads. */
+
+/* 预读线程读取的一个数据块 */
+typedef struct rdbLoadBlock {
+    // 数据块中有效数据的长度
+    size_t len;
+    // 主线程在数据块中的读取位置
+    size_t pos;
+    char buf[];
+} rdbLoadBlock;
+
+/* 交给工作线程处理的任务，即一个待构建的键值对 */
+typedef struct rdbLoadJob {
+    // key所在的数据库
+    redisDb *db;
+    // key对象，由主线程读取
+    robj *key;
+    // value对象，由工作线程构建，构建失败时为NULL
+    robj *val;
+    // value的RDB类型
+    int type;
+    // 过期时间，-1表示没有设置过期时间
+    long long expiretime;
+    // value在RDB文件中的原始字节
+    sds payload;
+} rdbLoadJob;
+
+/* 载入流水线的状态 */
+typedef struct rdbLoadPipeline {
+    // RDB文件
+    FILE *fp;
+    // 工作线程的个数
+    int numworkers;
+    pthread_t reader;
+    pthread_t workers[RDB_LOAD_MAX_THREADS];
+    // 预读的数据块、待构建的任务、已构建的任务
+    rdbQueue blocks, jobs, done;
+    // 主线程当前正在读取的数据块
+    rdbLoadBlock *cur;
+    // 不为NULL时，主线程读取的字节会被追加到这里
+    sds capture;
+    // 已提交但还没有加入数据库的任务个数
+    int inflight;
+    /* Per stage stats. The read and build counters are updated by the
+     * reader and the workers while holding stats_lock. */
+    // 各阶段的统计信息，其中read和build相关字段由其它线程更新，需要加锁访问
+    pthread_mutex_t stats_lock;
+    long long start_us;
+    long long read_bytes, read_us;
+    long long build_bytes, build_us;
+    long long parsed_keys;
+    long long inserted_keys, insert_us;
+    // 主线程等待预读线程和工作线程的时间，可以用来判断瓶颈在哪个阶段
+    long long stall_read_us, stall_build_us;
+} rdbLoadPipeline;
+
+/* The pipeline of the load in progress, if any, and the last stats
+ * snapshot taken by loadingProgress(). */
+// 当前正在进行的多线程载入，以及loadingProgress中最近一次刷新的统计信息
+static rdbLoadPipeline *rdb_load_pipeline = NULL;
+static rdbLoadStageStats rdb_load_stats;
+
+/* Read-ahead thread: read the file block by block, so that disk I/O
+ * overlaps with parsing and object construction. */
+/* 预读线程：逐块读取RDB文件，使磁盘IO与解析、对象构建并行进行 */
+static void *rdbLoadReaderMain(void *arg) {
+    rdbLoadPipeline *p = arg;
+
+    while(1) {
+        rdbLoadBlock *b = zmalloc(sizeof(*b)+RDB_LOAD_BLOCK_SIZE);
+        long long start = ustime();
+
+        b->pos = 0;
+        b->len = fread(b->buf,1,RDB_LOAD_BLOCK_SIZE,p->fp);
+        if (b->len == 0) {
+            zfree(b);
+            break;
+        }
+        pthread_mutex_lock(&p->stats_lock);
+        p->read_bytes += b->len;
+        p->read_us += ustime()-start;
+        pthread_mutex_unlock(&p->stats_lock);
+        rdbQueuePush(&p->blocks,b);
+    }
+    // 文件读取完毕（或者出错），主线程读到队列末尾时会得到一个短读错误
+    rdbQueueClose(&p->blocks);
+    return NULL;
+}
+
+/* Worker thread: LZF decompression and object construction. */
+/* 工作线程：负责LZF解压和对象构建 */
+static void *rdbLoadWorkerMain(void *arg) {
+    rdbLoadPipeline *p = arg;
+    rdbLoadJob *job;
+
+    while ((job = rdbQueuePop(&p->jobs,1)) != NULL) {
+        long long start = ustime();
+        size_t len = sdslen(job->payload);
+        rio payload;
+
+        // 以内存buffer的方式读取value的原始字节，调用rdbLoadObject构建对象
+        rioInitWithBuffer(&payload,job->payload);
+        job->val = rdbLoadObject(job->type,&payload);
+        sdsfree(job->payload);
+        job->payload = NULL;
+
+        pthread_mutex_lock(&p->stats_lock);
+        p->build_bytes += len;
+        p->build_us += ustime()-start;
+        pthread_mutex_unlock(&p->stats_lock);
+        rdbQueuePush(&p->done,job);
+    }
+    return NULL;
+}
+
+/* rio backend reading from the read-ahead queue. Bytes are also appended
+ * to p->capture when it is set. */
+/* 从预读队列中读取数据的rio后端，如果设置了capture，读取的字节同时会被追加到capture中 */
+static size_t rdbLoadPipelineRead(rio *r, void *buf, size_t len) {
+    rdbLoadPipeline *p = r->io.custom.ptr;
+
+    while (len) {
+        rdbLoadBlock *b = p->cur;
+        size_t n;
+
+        // 当前数据块已经读完，从队列中取下一块
+        if (b == NULL || b->pos == b->len) {
+            long long start = ustime();
+
+            zfree(b);
+            p->cur = b = rdbQueuePop(&p->blocks,1);
+            p->stall_read_us += ustime()-start;
+            if (b == NULL) return 0;
+        }
+        n = b->len - b->pos;
+        if (n > len) n = len;
+        memcpy(buf,b->buf+b->pos,n);
+        if (p->capture) p->capture = sdscatlen(p->capture,b->buf+b->pos,n);
+        b->pos += n;
+        buf = (char*)buf + n;
+        len -= n;
+        r->io.custom.pos += n;
+    }
+    return 1;
+}
+
+/* 该后端只能用于读取 */
+static size_t rdbLoadPipelineWrite(rio *r, const void *buf, size_t len) {
+    REDIS_NOTUSED(r);
+    REDIS_NOTUSED(buf);
+    REDIS_NOTUSED(len);
+    return 0;
+}
+
+/* 返回当前偏移量 */
+static off_t rdbLoadPipelineTell(rio *r) {
+    return r->io.custom.pos;
+}
+
+/* 什么也不做 */
+static int rdbLoadPipelineFlush(rio *r) {
+    REDIS_NOTUSED(r);
+    return 1;
+}
+
+static const rio rdbLoadPipelineIO = {
+    rdbLoadPipelineRead,
+    rdbLoadPipelineWrite,
+    rdbLoadPipelineTell,
+    rdbLoadPipelineFlush,
+    NULL,           /* update_checksum */
+    0,              /* current checksum */
+    0,              /* bytes read or written */
+    0,              /* read/write chunk size */
+    { { NULL, 0 } } /* union for io-specific vars */
+};
+
+/* Skip 'len' bytes of the stream. */
+/* 跳过len个字节 */
+static int rdbSkipBytes(rio *rdb, size_t len) {
+    char buf[4096];
+
+    while (len) {
+        size_t n = len > sizeof(buf) ? sizeof(buf) : len;
+        if (rioRead(rdb,buf,n) == 0) return -1;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Skip a string saved by rdbSaveRawString() without decoding it. */
+/* 跳过一个由rdbSaveRawString写入的字符串，不做解码和解压 */
+static int rdbSkipString(rio *rdb) {
+    int isencoded;
+    uint32_t len, clen;
+
+    len = rdbLoadLen(rdb,&isencoded);
+    if (isencoded) {
+        switch(len) {
+        case REDIS_RDB_ENC_INT8: return rdbSkipBytes(rdb,1);
+        case REDIS_RDB_ENC_INT16: return rdbSkipBytes(rdb,2);
+        case REDIS_RDB_ENC_INT32: return rdbSkipBytes(rdb,4);
+        case REDIS_RDB_ENC_LZF:
+        case REDIS_RDB_ENC_LZ4:
+        case REDIS_RDB_ENC_ZSTD:
+            if ((clen = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) return -1;
+            if (rdbLoadLen(rdb,NULL) == REDIS_RDB_LENERR) return -1;
+            return rdbSkipBytes(rdb,clen);
+        default:
+            return -1;
+        }
+    }
+    if (len == REDIS_RDB_LENERR) return -1;
+    return rdbSkipBytes(rdb,len);
+}
+
+/* Skip a double saved by rdbSaveDoubleValue(). */
+/* 跳过一个由rdbSaveDoubleValue写入的double值 */
+static int rdbSkipDoubleValue(rio *rdb) {
+    unsigned char len;
+
+    if (rioRead(rdb,&len,1) == 0) return -1;
+    // 253、254、255分别表示nan、+inf和-inf，后面没有数据
+    if (len >= 253) return 0;
+    return rdbSkipBytes(rdb,len);
+}
+
+/* Skip the value of the given type, walking just enough of its structure
+ * to find where it ends. */
+/* 跳过一个指定类型的value，只解析必要的长度信息以找到它的结尾 */
+static int rdbSkipObject(int type, rio *rdb) {
+    uint32_t len, j;
+
+    switch(type) {
+    case REDIS_RDB_TYPE_STRING:
+    case REDIS_RDB_TYPE_HASH_ZIPMAP:
+    case REDIS_RDB_TYPE_LIST_ZIPLIST:
+    case REDIS_RDB_TYPE_SET_INTSET:
+    case REDIS_RDB_TYPE_ZSET_ZIPLIST:
+    case REDIS_RDB_TYPE_HASH_ZIPLIST:
+    case REDIS_RDB_TYPE_ZSET_LISTPACK:
+    case REDIS_RDB_TYPE_HASH_LISTPACK:
+    case REDIS_RDB_TYPE_SET_ROARING:
+    case REDIS_RDB_TYPE_HASH_LISTPACK_EX:
+        return rdbSkipString(rdb);
+    case REDIS_RDB_TYPE_LIST:
+    case REDIS_RDB_TYPE_SET:
+    case REDIS_RDB_TYPE_LIST_QUICKLIST:
+    case REDIS_RDB_TYPE_LIST_QUICKLIST_LISTPACK:
+        if ((len = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) return -1;
+        for (j = 0; j < len; j++)
+            if (rdbSkipString(rdb) == -1) return -1;
+        return 0;
+    case REDIS_RDB_TYPE_ZSET:
+        if ((len = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) return -1;
+        for (j = 0; j < len; j++) {
+            if (rdbSkipString(rdb) == -1) return -1;
+            if (rdbSkipDoubleValue(rdb) == -1) return -1;
+        }
+        return 0;
+    case REDIS_RDB_TYPE_HASH:
+        if ((len = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) return -1;
+        for (j = 0; j < len*2; j++)
+            if (rdbSkipString(rdb) == -1) return -1;
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+/* Create the pipeline and start the reader and the worker threads. */
+/* 创建载入流水线，并启动预读线程和工作线程 */
+static rdbLoadPipeline *rdbLoadPipelineCreate(FILE *fp, int numworkers) {
+    rdbLoadPipeline *p = zcalloc(sizeof(*p));
+    int j;
+
+    if (numworkers > RDB_LOAD_MAX_THREADS) numworkers = RDB_LOAD_MAX_THREADS;
+    p->fp = fp;
+    p->numworkers = numworkers;
+    p->start_us = ustime();
+    pthread_mutex_init(&p->stats_lock,NULL);
+    rdbQueueInit(&p->blocks,RDB_LOAD_READAHEAD_BLOCKS);
+    // 同时处理中的任务数不超过RDB_LOAD_MAX_INFLIGHT，所以这两个队列永远不会满
+    rdbQueueInit(&p->jobs,RDB_LOAD_MAX_INFLIGHT);
+    rdbQueueInit(&p->done,RDB_LOAD_MAX_INFLIGHT);
+
+    // 工作线程会共享一些全局状态，在载入结束之前禁止使用共享整数对象
+    server.loading_threaded = 1;
+    if (pthread_create(&p->reader,NULL,rdbLoadReaderMain,p) != 0) {
+        redisLog(REDIS_WARNING,"Fatal: Can't create the RDB read-ahead thread.");
+        exit(1);
+    }
+    for (j = 0; j < numworkers; j++) {
+        if (pthread_create(&p->workers[j],NULL,rdbLoadWorkerMain,p) != 0) {
+            redisLog(REDIS_WARNING,"Fatal: Can't create RDB loading worker threads.");
+            exit(1);
+        }
+    }
+    rdb_load_pipeline = p;
+    return p;
+}
+
+/* Add the objects built by the workers to the keyspace, waiting until at
+ * most 'maxinflight' jobs are still pending. Called only by the main thread,
+ * so the keyspace is never touched concurrently. */
+/*  将工作线程构建好的对象加入数据库，直到还在处理中的任务不超过maxinflight个为止。
+    该函数只在主线程中调用，所以不会并发访问数据库。有任务构建失败时返回REDIS_ERR。*/
+static int rdbLoadPipelineInstall(rdbLoadPipeline *p, int maxinflight) {
+    rdbLoadJob *job;
+
+    while (p->inflight) {
+        int block = p->inflight > maxinflight;
+        long long start = ustime();
+
+        if ((job = rdbQueuePop(&p->done,block)) == NULL) break;
+        if (block) p->stall_build_us += ustime()-start;
+        p->inflight--;
+        if (job->val == NULL) {
+            decrRefCount(job->key);
+            zfree(job);
+            return REDIS_ERR;
+        }
+        start = ustime();
+        // 将key和相应的object关联到数据库中
+        dbAdd(job->db,job->key,job->val);
+        // 设置当前key的过期时间
+        if (job->expiretime != -1) setExpire(job->db,job->key,job->expiretime);
+        decrRefCount(job->key);
+        zfree(job);
+        p->insert_us += ustime()-start;
+        p->inserted_keys++;
+    }
+    return REDIS_OK;
+}
+
+/* Copy the raw value of 'key' from the stream and queue it to the workers.
+ * When 'skip' is true the value is just skipped (e.g. the key is already
+ * expired). The reference to 'key' is always taken by this function. */
+/*  从流中拷贝key对应value的原始字节，并将其交给工作线程处理。如果skip为真（比如key已经过期），
+    则直接跳过value。该函数总是会接管key的引用。*/
+static int rdbLoadPipelineSubmit(rdbLoadPipeline *p, rio *rdb, redisDb *db,
+                                 int type, robj *key, long long expiretime,
+                                 int skip)
+{
+    rdbLoadJob *job;
+
+    // 控制处理中的任务数量，同时顺便把已经构建好的对象加入数据库
+    if (rdbLoadPipelineInstall(p,RDB_LOAD_MAX_INFLIGHT-1) == REDIS_ERR) {
+        decrRefCount(key);
+        return REDIS_ERR;
+    }
+    if (!skip) p->capture = sdsempty();
+    if (rdbSkipObject(type,rdb) == -1) {
+        sdsfree(p->capture);
+        p->capture = NULL;
+        decrRefCount(key);
+        return REDIS_ERR;
+    }
+    if (skip) {
+        decrRefCount(key);
+        return REDIS_OK;
+    }
+
+    job = zmalloc(sizeof(*job));
+    job->db = db;
+    job->key = key;
+    job->val = NULL;
+    job->type = type;
+    job->expiretime = expiretime;
+    job->payload = p->capture;
+    p->capture = NULL;
+    p->inflight++;
+    p->parsed_keys++;
+    rdbQueuePush(&p->jobs,job);
+    return REDIS_OK;
+}
+
+/* Wait for all the pending jobs, stop the threads and log per stage stats. */
+/* 等待所有任务完成并加入数据库，然后停止所有线程，记录各阶段的统计信息 */
+static int rdbLoadPipelineFinish(rdbLoadPipeline *p, rio *rdb) {
+    int j, retval;
+    rdbLoadBlock *b;
+
+    retval = rdbLoadPipelineInstall(p,0);
+    rdbQueueClose(&p->jobs);
+    for (j = 0; j < p->numworkers; j++) pthread_join(p->workers[j],NULL);
+
+    // 预读线程可能阻塞在满队列上，先把剩余的数据块取走
+    zfree(p->cur);
+    p->cur = NULL;
+    while(1) {
+        b = rdbQueuePop(&p->blocks,1);
+        if (b == NULL) break;
+        zfree(b);
+    }
+    pthread_join(p->reader,NULL);
+
+    // 如果出错，done队列中可能还有没有加入数据库的对象
+    while (p->inflight) {
+        rdbLoadJob *job = rdbQueuePop(&p->done,1);
+        p->inflight--;
+        decrRefCount(job->key);
+        if (job->val) decrRefCount(job->val);
+        zfree(job);
+    }
+
+    loadingProgress(rdb->processed_bytes);
+    redisLog(REDIS_NOTICE,
+        "RDB loaded with %d threads: read %.2f MB/s, parse %.2f MB/s, "
+        "build %.2f MB/s per thread, insert %.2f Kkeys/s "
+        "(main thread stalled %lld ms on read, %lld ms on build)",
+        p->numworkers,
+        rdb_load_stats.read_mbps, rdb_load_stats.parse_mbps,
+        rdb_load_stats.build_mbps, rdb_load_stats.insert_kkps,
+        p->stall_read_us/1000, p->stall_build_us/1000);
+
+    rdb_load_pipeline = NULL;
+    server.loading_threaded = 0;
+    rdbQueueFree(&p->blocks);
+    rdbQueueFree(&p->jobs);
+    rdbQueueFree(&p->done);
+    pthread_mutex_destroy(&p->stats_lock);
+    zfree(p);
+    return retval;
+}
+
+/* Refresh the per stage throughput of the threaded loader. */
+/* 刷新多线程载入时各阶段的吞吐量 */
+static void rdbLoadPipelineUpdateStats(rdbLoadPipeline *p, off_t pos) {
+    long long elapsed = ustime()-p->start_us;
+    rdbLoadStageStats *st = &rdb_load_stats;
+
+    pthread_mutex_lock(&p->stats_lock);
+    st->read_bytes = p->read_bytes;
+    st->build_bytes = p->build_bytes;
+    // MB/s：字节数 / 微秒数即为每秒多少MB（按10^6计算）
+    st->read_mbps = p->read_us ? (double)p->read_bytes/p->read_us : 0;
+    st->build_mbps = p->build_us ? (double)p->build_bytes/p->build_us : 0;
+    pthread_mutex_unlock(&p->stats_lock);
+    st->threads = p->numworkers;
+    st->parsed_bytes = pos;
+    st->parse_mbps = elapsed ? (double)pos/elapsed : 0;
+    st->inserted_keys = p->inserted_keys;
+    st->insert_kkps = p->insert_us ? (double)p->inserted_keys*1000/p->insert_us : 0;
+    st->stall_read_us = p->stall_read_us;
+    st->stall_build_us = p->stall_build_us;
+}
+
+/* Return the stats of the current (or last) threaded load. */
+/* 返回当前（或者最近一次）多线程载入的统计信息 */
+rdbLoadStageStats *rdbGetLoadStageStats(void) {
+    return &rdb_load_stats;
+}
+
 /* Mark that we are loading in the global state and setup the fields
  * needed to provide loading stats. */
 /*  设置相关的全局状态位（表示当前正在载入RDB文件）*/
@@ -1430,6 +2415,8 @@ void startLoading(FILE *fp) {
 /*  刷新载入进度信息。*/
 void loadingProgress(off_t pos) {
     server.loading_loaded_bytes = pos;
+    // 多线程载入时，同时刷新各阶段的吞吐量
+    if (rdb_load_pipeline) rdbLoadPipelineUpdateStats(rdb_load_pipeline,pos);
     if (server.stat_peak_memory < zmalloc_used_memory())
         server.stat_peak_memory = zmalloc_used_memory();
 }
@@ -1461,6 +2448,18 @@ void rdbLoadProgressCallback(rio *r, const void *buf, size_t len) {
     }
 }
 
+/* CRC64 of the chunk being loaded (RDB version >= REDIS_RDB_VERSION_CHUNKED). */
+// 当前正在载入的块的CRC64（RDB版本 >= REDIS_RDB_VERSION_CHUNKED）
+static uint64_t rdb_load_chunk_crc;
+
+/* Like rdbLoadProgressCallback() but also computes the CRC64 of the current
+ * chunk. Installed only while reading the payload of a chunk. */
+/* 与rdbLoadProgressCallback相同，另外还计算当前块的CRC64。只在读取块的payload时使用 */
+static void rdbLoadChunkProgressCallback(rio *r, const void *buf, size_t len) {
+    rdb_load_chunk_crc = crc64(rdb_load_chunk_crc,buf,len);
+    rdbLoadProgressCallback(r,buf,len);
+}
+
 /*  将RDB文件中的数据载入数据库中。*/
 int rdbLoad(char *filename) {
     uint32_t dbid;
@@ -1470,6 +2469,8 @@ int rdbLoad(char *filename) {
     long long expiretime, now = mstime();
     FILE *fp;
     rio rdb;
+    rdbLoadPipeline *pipe = NULL;
+    size_t chunk_end = 0;   /* End of the chunk being loaded, 0 if none. */
 
     // 打开RDB文件
     if ((fp = fopen(filename,"r")) == NULL) return REDIS_ERR;
@@ -1490,7 +2491,7 @@ int rdbLoad(char *filename) {
         return REDIS_ERR;
     }
     rdbver = atoi(buf+5);
-    if (rdbver < 1 || rdbver > REDIS_RDB_VERSION) {
+    if (!rdbIsSupportedVersion(rdbver)) {
         fclose(fp);
         redisLog(REDIS_WARNING,"Can't handle RDB format version %d",rdbver);
         errno = EINVAL;
@@ -1499,10 +2500,45 @@ int rdbLoad(char *filename) {
 
     // 设置开始载入标识
     startLoading(fp);
+
+    /* Switch to the threaded pipeline if enabled. The read-ahead thread
+     * continues to read from fp where the header ended, and the checksum
+     * computed so far is carried over. */
+    // 如果开启了多线程载入，切换到流水线方式。预读线程从文件头之后继续读取，已经计算的校验和保持不变
+    if (server.rdb_load_threads > 0) {
+        uint64_t cksum = rdb.cksum;
+        size_t processed = rdb.processed_bytes;
+
+        pipe = rdbLoadPipelineCreate(fp,server.rdb_load_threads);
+        rdb = rdbLoadPipelineIO;
+        rdb.io.custom.ptr = pipe;
+        rdb.io.custom.pos = processed;
+        rdb.cksum = cksum;
+        rdb.processed_bytes = processed;
+        rdb.update_cksum = rdbLoadProgressCallback;
+        rdb.max_processing_chunk = server.loading_process_events_interval_bytes;
+    }
+
     while(1) {
         robj *key, *val;
         expiretime = -1;
 
+        /* End of a chunk: verify its CRC64. */
+        // 当前块的数据已经读完，检查其CRC64
+        if (chunk_end && rdb.processed_bytes >= chunk_end) {
+            uint64_t crc, expected = rdb_load_chunk_crc;
+
+            rdb.update_cksum = rdbLoadProgressCallback;
+            if (rdb.processed_bytes != chunk_end) goto eoferr;
+            if (rdbLoadRawUint64(&rdb,&crc) == -1) goto eoferr;
+            if (crc != 0 && crc != expected) {
+                redisLog(REDIS_WARNING,"Wrong RDB chunk checksum at offset %llu. Aborting now.",
+                    (unsigned long long)chunk_end);
+                exit(1);
+            }
+            chunk_end = 0;
+        }
+
         /* Read type. */
         // 读取类型信息，类型信息决定如何处理后面的数据
         if ((type = rdbLoadType(&rdb)) == -1) goto eoferr;
@@ -1529,8 +2565,10 @@ int rdbLoad(char *filename) {
         }
 
         // 读入EOF标识
-        if (type == REDIS_RDB_OPCODE_EOF)
+        if (type == REDIS_RDB_OPCODE_EOF) {
+            if (chunk_end) goto eoferr;
             break;
+        }
 
         /* Handle SELECT DB opcode as a special case */
         // 读入数据库编号
@@ -1547,9 +2585,54 @@ int rdbLoad(char *filename) {
             db = server.db+dbid;
             continue;
         }
+        /* Chunks only exist in RDB version >= REDIS_RDB_VERSION_CHUNKED. The
+         * records inside a chunk are loaded by this same loop. */
+        // 块只存在于版本 >= REDIS_RDB_VERSION_CHUNKED 的RDB文件中，块中的键值对仍然由这个循环载入
+        if (type == REDIS_RDB_OPCODE_CHUNK && rdbver >= REDIS_RDB_VERSION_CHUNKED && !chunk_end) {
+            uint64_t len;
+
+            if ((dbid = rdbLoadLen(&rdb,NULL)) == REDIS_RDB_LENERR)
+                goto eoferr;
+            if (dbid >= (unsigned)server.dbnum) {
+                redisLog(REDIS_WARNING,"FATAL: Data file was created with a Redis server configured to handle more than %d databases. Exiting\n", server.dbnum);
+                exit(1);
+            }
+            if (rdbLoadLen(&rdb,NULL) == REDIS_RDB_LENERR) goto eoferr;
+            if (rdbLoadRawUint64(&rdb,&len) == -1) goto eoferr;
+            db = server.db+dbid;
+            rdb_load_chunk_crc = 0;
+            rdb.update_cksum = rdbLoadChunkProgressCallback;
+            chunk_end = rdb.processed_bytes+len;
+            continue;
+        }
+        /* The Zstd dictionary used by the strings of this file. */
+        // 读入本文件中的字符串所使用的Zstd字典
+        if (type == REDIS_RDB_OPCODE_COMPRESSION_DICT && rdbver >= REDIS_RDB_VERSION_CHUNKED && !chunk_end) {
+            robj *dict;
+
+            // 工作线程可能正在解压缩，更换字典之前先等待所有任务完成
+            if (pipe && rdbLoadPipelineInstall(pipe,0) == REDIS_ERR) goto eoferr;
+            if ((dict = rdbGenericLoadStringObject(&rdb,0)) == NULL) goto eoferr;
+            if (rdbCodecSetDict(dict->ptr,sdslen(dict->ptr)) == -1) {
+                redisLog(REDIS_WARNING,"FATAL: The RDB file uses a Zstd dictionary but it can't be loaded (is Zstd support compiled in?). Exiting.");
+                exit(1);
+            }
+            decrRefCount(dict);
+            continue;
+        }
         /* Read key */
         // 读入key
         if ((key = rdbLoadStringObject(&rdb)) == NULL) goto eoferr;
+        /* In threaded mode the value is built by a worker and added to the
+         * keyspace later by rdbLoadPipelineInstall(). */
+        // 多线程载入时，value交给工作线程构建，随后在rdbLoadPipelineInstall中加入数据库
+        if (pipe) {
+            int expired = server.masterhost == NULL && expiretime != -1 &&
+                          expiretime < now;
+            if (rdbLoadPipelineSubmit(pipe,&rdb,db,type,key,expiretime,
+                                      expired) == REDIS_ERR) goto eoferr;
+            continue;
+        }
         /* Read value */
         // 读入对应的object
         if ((val = rdbLoadObject(type,&rdb)) == NULL) goto eoferr;
@@ -1591,8 +2674,12 @@ int rdbLoad(char *filename) {
         }
     }
 
+    // 等待所有工作线程完成，并停止流水线
+    if (pipe && rdbLoadPipelineFinish(pipe,&rdb) == REDIS_ERR) goto eoferr;
+
     // 关闭RDB文件
     fclose(fp);
+    rdbCodecResetDict();
     // 设置载入完成标识
     stopLoading();
     return REDIS_OK;
@@ -1764,6 +2851,9 @@ void backgroundSaveDoneHandlerSocket(int exitcode, int bysignal) {
 /* When a background RDB saving/transfer terminates, call the right handler. */
 /*  当一个后台RDB存储操作结束后调用该函数进行处理    */
 void backgroundSaveDoneHandler(int exitcode, int bysignal) {
+    // 读取子进程报告的写时复制开销
+    if (!bysignal && exitcode == 0) receiveChildInfo(REDIS_CHILD_INFO_TYPE_RDB);
+    closeChildInfoPipe(REDIS_CHILD_INFO_TYPE_RDB);
     switch(server.rdb_child_type) {
     case REDIS_RDB_CHILD_TYPE_DISK:
         backgroundSaveDoneHandlerDisk(exitcode,bysignal);
@@ -1835,6 +2925,7 @@ int rdbSaveToSlavesSockets(void) {
 
     /* Create the child process. */
     // 创建子进程
+    openChildInfoPipe(REDIS_CHILD_INFO_TYPE_RDB);
     start = ustime();
     if ((childpid = fork()) == 0) {
         /*  下面是子进程运行的代码 */
@@ -1857,13 +2948,7 @@ int rdbSaveToSlavesSockets(void) {
             retval = REDIS_ERR;
 
         if (retval == REDIS_OK) {
-            size_t private_dirty = zmalloc_get_private_dirty();
-
-            if (private_dirty) {
-                redisLog(REDIS_NOTICE,
-                    "RDB: %zu MB of memory used by copy-on-write",
-                    private_dirty/(1024*1024));
-            }
+            sendChildInfo(REDIS_CHILD_INFO_TYPE_RDB,"RDB");
 
             /* If we are returning OK, at least one slave was served
              * with the RDB file as expected, so we need to send a report
@@ -1913,6 +2998,8 @@ int rdbSaveToSlavesSockets(void) {
             }
             zfree(msg);
         }
+        // 释放fd set rio对象，同时恢复slave socket原来的阻塞模式
+        rioFreeFdset(&slave_sockets);
         zfree(clientids);
         // 如果我们无法将消息发送给父进程，则错误退出，这样父进程将中断复制过程
         exitFromChild((retval == REDIS_OK) ? 0 : 1);
@@ -1922,6 +3009,7 @@ int rdbSaveToSlavesSockets(void) {
         server.stat_fork_time = ustime()-start;
         server.stat_fork_rate = (double) zmalloc_used_memory() * 1000000 / server.stat_fork_time / (1024*1024*1024); /* GB per second. */
         latencyAddSampleIfNeeded("fork",server.stat_fork_time/1000);
+        latencyProbeAddIfNeeded(LATENCY_PROBE_FORK,server.stat_fork_time);
 
         // 创建子进程出错
         if (childpid == -1) {
@@ -1947,6 +3035,7 @@ int rdbSaveToSlavesSockets(void) {
             // 关闭匿名管道
             close(pipefds[0]);
             close(pipefds[1]);
+            closeChildInfoPipe(REDIS_CHILD_INFO_TYPE_RDB);
         } else {
             redisLog(REDIS_NOTICE,"Background RDB transfer started by pid %d",
                 childpid);
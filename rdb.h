@@ -37,9 +37,36 @@
 #include "redis.h"
 
 /* The current RDB version. When the format changes in a way that is no longer
- * backward compatible this number gets incremented. */
-/*	当前的RDB版本，如果rdb的格式改变而不兼容前面的版本时，该数字加1。*/
-#define REDIS_RDB_VERSION 6
+ * backward compatible this number gets incremented.
+ *
+ * Versions up to REDIS_RDB_VERSION_UPSTREAM mean the same as upstream. The
+ * extensions of this tree (chunked files and compressed strings, listpack,
+ * roaring and hashpack encodings) are numbered from REDIS_RDB_VERSION_PRIVATE,
+ * far above any version upstream uses, so our files are never taken for
+ * upstream files of the same version or the other way around. Versions
+ * between the two ranges are refused. */
+/*	当前的RDB版本，如果rdb的格式改变而不兼容前面的版本时，该数字加1。
+
+	不超过REDIS_RDB_VERSION_UPSTREAM的版本与官方Redis的含义相同。本分支新增的格式（分块文件和压缩字符串、
+	listpack、roaring、hashpack编码）从REDIS_RDB_VERSION_PRIVATE开始编号，远大于官方使用的版本号，
+	这样本分支的文件与官方相同版本号的文件不会混淆。两个范围之间的版本号一律拒绝载入。*/
+#define REDIS_RDB_VERSION_UPSTREAM 7
+#define REDIS_RDB_VERSION_PRIVATE 9000
+// 分块文件、LZ4/Zstd压缩的字符串以及Zstd字典
+#define REDIS_RDB_VERSION_CHUNKED (REDIS_RDB_VERSION_PRIVATE+1)
+// listpack编码的hash、zset和quicklist节点
+#define REDIS_RDB_VERSION_LISTPACK (REDIS_RDB_VERSION_PRIVATE+2)
+// roaring编码的set
+#define REDIS_RDB_VERSION_ROARING (REDIS_RDB_VERSION_PRIVATE+3)
+// hashpack编码的hash
+#define REDIS_RDB_VERSION_HASHPACK (REDIS_RDB_VERSION_PRIVATE+4)
+#define REDIS_RDB_VERSION REDIS_RDB_VERSION_HASHPACK
+
+/* Test if a version read from the header can be loaded. */
+/*	检查文件头中的版本号是否可以载入 */
+#define rdbIsSupportedVersion(v) \
+    (((v) >= 1 && (v) <= REDIS_RDB_VERSION_UPSTREAM) || \
+     ((v) > REDIS_RDB_VERSION_PRIVATE && (v) <= REDIS_RDB_VERSION))
 
 /* Defines related to the dump file format. To store 32 bits lengths for short
  * keys requires a lot of space, so we check the most significant 2 bits of
@@ -77,6 +104,14 @@
 #define REDIS_RDB_ENC_INT16 1       /* 16 bit signed integer */
 #define REDIS_RDB_ENC_INT32 2       /* 32 bit signed integer */
 #define REDIS_RDB_ENC_LZF 3         /* string compressed with FASTLZ */
+#define REDIS_RDB_ENC_LZ4 4         /* string compressed with LZ4 */
+#define REDIS_RDB_ENC_ZSTD 5        /* string compressed with Zstd, using the
+                                       dictionary of the file if any */
+
+/* Map RDB_CODEC_* (rdbcodec.h) to REDIS_RDB_ENC_* and back. */
+/*	压缩算法RDB_CODEC_*与编码类型REDIS_RDB_ENC_*之间的相互转换 */
+#define rdbEncodingOfCodec(c) ((c)+REDIS_RDB_ENC_LZF)
+#define rdbCodecOfEncoding(e) ((e)-REDIS_RDB_ENC_LZF)
 
 /* Dup object types to RDB object types. Only reason is readability (are we
  * dealing with RDB types or with in-memory object types?). */
@@ -94,13 +129,39 @@
 #define REDIS_RDB_TYPE_SET_INTSET    11
 #define REDIS_RDB_TYPE_ZSET_ZIPLIST  12
 #define REDIS_RDB_TYPE_HASH_ZIPLIST  13
+// quicklist编码的list，依次保存每个节点的ziplist（REDIS_RDB_VERSION_LISTPACK之前）
+#define REDIS_RDB_TYPE_LIST_QUICKLIST 14
+/* Types from 15 on are only written in files with a private version: upstream
+ * gave the same numbers to other encodings in its own later versions. */
+// 15及以后的类型只出现在私有版本的文件中，官方Redis在其后续版本中为这些编号分配了不同的编码
+// listpack编码的hash和zset，以及节点为listpack的quicklist（REDIS_RDB_VERSION_LISTPACK）
+#define REDIS_RDB_TYPE_HASH_LISTPACK 15
+#define REDIS_RDB_TYPE_ZSET_LISTPACK 16
+#define REDIS_RDB_TYPE_LIST_QUICKLIST_LISTPACK 17
+// roaring编码的set，以字符串的形式保存序列化后的roaring位图（REDIS_RDB_VERSION_ROARING）
+#define REDIS_RDB_TYPE_SET_ROARING 18
+// hashpack编码的hash，以字符串的形式保存域、值、过期时间三个一组的listpack（REDIS_RDB_VERSION_HASHPACK）
+#define REDIS_RDB_TYPE_HASH_LISTPACK_EX 19
 
 /* Test if a type is an object type. */
 /*	检查给定的类型是否为Redis的对象类型。*/
-#define rdbIsObjectType(t) ((t >= 0 && t <= 4) || (t >= 9 && t <= 13))
+#define rdbIsObjectType(t) ((t >= 0 && t <= 4) || (t >= 9 && t <= 19))
 
-/* Special RDB opcodes (saved/loaded with rdbSaveType/rdbLoadType). */
-/*	特殊的RDB操作吗 */
+/* Special RDB opcodes (saved/loaded with rdbSaveType/rdbLoadType).
+ *
+ * Upstream allocates its opcodes downwards from 255, so the opcodes of this
+ * tree take a private range well below those and above every object type.
+ * They are only recognized in files with a private version. */
+/*	特殊的RDB操作吗
+
+	官方Redis从255开始向下分配操作码，本分支的操作码使用单独的私有范围，远小于官方的操作码，
+	同时大于所有的对象类型。只有私有版本的文件才会识别这些操作码。*/
+#define REDIS_RDB_OPCODE_PRIVATE_MIN 200
+#define REDIS_RDB_OPCODE_PRIVATE_MAX 209
+// Zstd压缩使用的字典，位于文件头部、所有数据之前（REDIS_RDB_VERSION_CHUNKED）
+#define REDIS_RDB_OPCODE_COMPRESSION_DICT 200
+// 分块RDB文件（REDIS_RDB_VERSION_CHUNKED）中一个自包含的块，后面跟着：数据库编号、key个数、数据长度、数据、CRC64
+#define REDIS_RDB_OPCODE_CHUNK        202
 // 以毫秒为单位的过期时间
 #define REDIS_RDB_OPCODE_EXPIRETIME_MS 252
 // 以秒为单位的过期时间
@@ -110,6 +171,24 @@
 // 结尾符
 #define REDIS_RDB_OPCODE_EOF        255
 
+/* Per stage throughput of the threaded RDB loader, refreshed by
+ * loadingProgress(). Rates are in MB (10^6 bytes) per second of busy time,
+ * and in thousands of keys per second for the insert stage. */
+/*	多线程载入RDB时各阶段的吞吐量，由loadingProgress负责刷新 */
+typedef struct rdbLoadStageStats {
+    int threads;                /* Number of worker threads. */
+    long long read_bytes;       /* Bytes read ahead from disk. */
+    long long parsed_bytes;     /* Bytes parsed by the main thread. */
+    long long build_bytes;      /* Bytes decompressed / decoded by workers. */
+    long long inserted_keys;    /* Keys added to the keyspace. */
+    double read_mbps;
+    double parse_mbps;
+    double build_mbps;
+    double insert_kkps;
+    long long stall_read_us;    /* Main thread waiting for read-ahead. */
+    long long stall_build_us;   /* Main thread waiting for workers. */
+} rdbLoadStageStats;
+
 int rdbSaveType(rio *rdb, unsigned char type);
 int rdbLoadType(rio *rdb);
 int rdbSaveTime(rio *rdb, time_t t);
@@ -130,5 +209,7 @@ robj *rdbLoadObject(int type, rio *rdb);
 void backgroundSaveDoneHandler(int exitcode, int bysignal);
 int rdbSaveKeyValuePair(rio *rdb, robj *key, robj *val, long long expiretime, long long now);
 robj *rdbLoadStringObject(rio *rdb);
+rdbLoadStageStats *rdbGetLoadStageStats(void);
+int rdbSaveRioChunked(rio *rdb, int *error, int numthreads);
 
 #endif
@@ -0,0 +1,417 @@
+/* rdbcodec.c - Compression codecs for RDB strings
+ *
+ * LZF is always available. LZ4 and Zstd are compiled in when USE_LZ4 and
+ * USE_ZSTD are defined. Zstd can use a shared dictionary trained from a
+ * sample of the dataset, which helps a lot with small values sharing the
+ * same structure (e.g. small JSON objects) that don't compress on their own.
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+
+#include "rdbcodec.h"
+#include "zmalloc.h"
+#include "lzf.h"
+
+#ifdef USE_LZ4
+#include <lz4.h>
+#endif
+
+#ifdef USE_ZSTD
+#include <zstd.h>
+#include <zdict.h>
+#endif
+
+/* 默认的Zstd压缩级别 */
+#define RDB_ZSTD_LEVEL 3
+/* 缓存的Zstd压缩、解压缩上下文的最大个数 */
+#define RDB_ZSTD_POOL_SIZE 16
+
+static const char *rdbCodecNames[] = {"lzf", "lz4", "zstd"};
+
+#ifdef USE_ZSTD
+/*  Zstd的压缩和解压缩上下文创建代价较高，所以缓存起来重复使用。多线程保存和载入时多个线程会同时
+    调用压缩和解压缩函数，因此需要加锁。当前的字典也由同一个锁保护，字典只会在没有其它线程
+    使用时被修改（保存或载入开始和结束时）。 */
+static pthread_mutex_t zstd_lock = PTHREAD_MUTEX_INITIALIZER;
+static ZSTD_CCtx *zstd_cctx_pool[RDB_ZSTD_POOL_SIZE];
+static int zstd_cctx_free = 0;
+static ZSTD_DCtx *zstd_dctx_pool[RDB_ZSTD_POOL_SIZE];
+static int zstd_dctx_free = 0;
+static ZSTD_CDict *zstd_cdict = NULL;
+static ZSTD_DDict *zstd_ddict = NULL;
+
+/* 从缓存中取出一个压缩上下文，缓存为空时新建一个 */
+static ZSTD_CCtx *rdbZstdGetCCtx(void) {
+    ZSTD_CCtx *cctx;
+
+    pthread_mutex_lock(&zstd_lock);
+    cctx = zstd_cctx_free ? zstd_cctx_pool[--zstd_cctx_free] : NULL;
+    pthread_mutex_unlock(&zstd_lock);
+    return cctx ? cctx : ZSTD_createCCtx();
+}
+
+/* 将压缩上下文放回缓存，缓存已满时直接释放 */
+static void rdbZstdPutCCtx(ZSTD_CCtx *cctx) {
+    pthread_mutex_lock(&zstd_lock);
+    if (zstd_cctx_free < RDB_ZSTD_POOL_SIZE) {
+        zstd_cctx_pool[zstd_cctx_free++] = cctx;
+        cctx = NULL;
+    }
+    pthread_mutex_unlock(&zstd_lock);
+    if (cctx) ZSTD_freeCCtx(cctx);
+}
+
+/* 从缓存中取出一个解压缩上下文，缓存为空时新建一个 */
+static ZSTD_DCtx *rdbZstdGetDCtx(void) {
+    ZSTD_DCtx *dctx;
+
+    pthread_mutex_lock(&zstd_lock);
+    dctx = zstd_dctx_free ? zstd_dctx_pool[--zstd_dctx_free] : NULL;
+    pthread_mutex_unlock(&zstd_lock);
+    return dctx ? dctx : ZSTD_createDCtx();
+}
+
+/* 将解压缩上下文放回缓存，缓存已满时直接释放 */
+static void rdbZstdPutDCtx(ZSTD_DCtx *dctx) {
+    pthread_mutex_lock(&zstd_lock);
+    if (zstd_dctx_free < RDB_ZSTD_POOL_SIZE) {
+        zstd_dctx_pool[zstd_dctx_free++] = dctx;
+        dctx = NULL;
+    }
+    pthread_mutex_unlock(&zstd_lock);
+    if (dctx) ZSTD_freeDCtx(dctx);
+}
+#endif
+
+/* Return the codec with the given name, or -1 if it is unknown or was not
+ * compiled in. */
+/* 根据名字返回压缩算法，名字不合法或者该算法在编译时没有开启则返回-1 */
+int rdbCodecByName(const char *name) {
+    int j;
+
+    for (j = 0; j < (int)(sizeof(rdbCodecNames)/sizeof(*rdbCodecNames)); j++) {
+        if (!strcasecmp(name,rdbCodecNames[j]))
+            return rdbCodecAvailable(j) ? j : -1;
+    }
+    return -1;
+}
+
+/* 返回压缩算法的名字 */
+const char *rdbCodecName(int codec) {
+    if (codec < 0 || codec >= (int)(sizeof(rdbCodecNames)/sizeof(*rdbCodecNames)))
+        return "unknown";
+    return rdbCodecNames[codec];
+}
+
+/* 检查压缩算法在编译时是否开启 */
+int rdbCodecAvailable(int codec) {
+    switch(codec) {
+    case RDB_CODEC_LZF: return 1;
+#ifdef USE_LZ4
+    case RDB_CODEC_LZ4: return 1;
+#endif
+#ifdef USE_ZSTD
+    case RDB_CODEC_ZSTD: return 1;
+#endif
+    default: return 0;
+    }
+}
+
+/* Compress 'in' into 'out'. Returns the compressed length, or 0 if the
+ * data does not fit in 'outlen' bytes (not compressible) or on error. */
+/* 压缩in，结果保存在容量为outlen的out中。返回压缩后的长度，无法压缩或者出错时返回0 */
+size_t rdbCodecCompress(int codec, const void *in, size_t inlen, void *out, size_t outlen) {
+    switch(codec) {
+    case RDB_CODEC_LZF:
+        return lzf_compress(in,inlen,out,outlen);
+#ifdef USE_LZ4
+    case RDB_CODEC_LZ4: {
+        int n;
+
+        if (inlen > LZ4_MAX_INPUT_SIZE) return 0;
+        n = LZ4_compress_default(in,out,inlen,outlen);
+        return n > 0 ? (size_t)n : 0;
+    }
+#endif
+#ifdef USE_ZSTD
+    case RDB_CODEC_ZSTD: {
+        ZSTD_CCtx *cctx = rdbZstdGetCCtx();
+        size_t n;
+
+        if (cctx == NULL) return 0;
+        /* The original length is already stored in the RDB, and the
+         * dictionary is the one of the file: skip both in the frame
+         * header to save a few bytes on every small value. */
+        // RDB中已经保存了原始长度，字典也是整个文件共用的，所以帧头中不需要再保存这两项
+        ZSTD_CCtx_reset(cctx,ZSTD_reset_session_and_parameters);
+        ZSTD_CCtx_setParameter(cctx,ZSTD_c_compressionLevel,RDB_ZSTD_LEVEL);
+        ZSTD_CCtx_setParameter(cctx,ZSTD_c_contentSizeFlag,0);
+        ZSTD_CCtx_setParameter(cctx,ZSTD_c_dictIDFlag,0);
+        if (zstd_cdict) ZSTD_CCtx_refCDict(cctx,zstd_cdict);
+        n = ZSTD_compress2(cctx,out,outlen,in,inlen);
+        rdbZstdPutCCtx(cctx);
+        return ZSTD_isError(n) ? 0 : n;
+    }
+#endif
+    default:
+        return 0;
+    }
+}
+
+/* Decompress 'in' into 'out'. 'outlen' must be exactly the original length.
+ * Returns 'outlen' on success, 0 on error. */
+/* 解压缩in，out的容量outlen必须正好是原始长度。成功返回outlen，出错返回0 */
+size_t rdbCodecDecompress(int codec, const void *in, size_t inlen, void *out, size_t outlen) {
+    switch(codec) {
+    case RDB_CODEC_LZF:
+        return lzf_decompress(in,inlen,out,outlen) == outlen ? outlen : 0;
+#ifdef USE_LZ4
+    case RDB_CODEC_LZ4: {
+        int n = LZ4_decompress_safe(in,out,inlen,outlen);
+        return (n >= 0 && (size_t)n == outlen) ? outlen : 0;
+    }
+#endif
+#ifdef USE_ZSTD
+    case RDB_CODEC_ZSTD: {
+        ZSTD_DCtx *dctx = rdbZstdGetDCtx();
+        size_t n;
+
+        if (dctx == NULL) return 0;
+        if (zstd_ddict)
+            n = ZSTD_decompress_usingDDict(dctx,out,outlen,in,inlen,zstd_ddict);
+        else
+            n = ZSTD_decompressDCtx(dctx,out,outlen,in,inlen);
+        rdbZstdPutDCtx(dctx);
+        return (!ZSTD_isError(n) && n == outlen) ? outlen : 0;
+    }
+#endif
+    default:
+        return 0;
+    }
+}
+
+/* Train a Zstd dictionary of at most 'dictsize' bytes. 'samples' is the
+ * concatenation of 'nsamples' samples whose lengths are in 'sizes'. */
+/* 根据样本训练一个最大为dictsize字节的Zstd字典，samples是所有样本拼接而成，sizes保存每个样本的长度 */
+sds rdbCodecTrainDict(const void *samples, const size_t *sizes, unsigned int nsamples, size_t dictsize) {
+#ifdef USE_ZSTD
+    sds dict = sdsnewlen(NULL,dictsize);
+    size_t n = ZDICT_trainFromBuffer(dict,dictsize,samples,sizes,nsamples);
+
+    if (ZDICT_isError(n)) {
+        sdsfree(dict);
+        return NULL;
+    }
+    sdsrange(dict,0,n-1);
+    return dict;
+#else
+    (void)samples; (void)sizes; (void)nsamples; (void)dictsize;
+    return NULL;
+#endif
+}
+
+/* Set the Zstd dictionary used by the next calls. Must be called when no
+ * other thread is compressing or decompressing. */
+/* 设置接下来压缩和解压缩时使用的Zstd字典，调用时不能有其它线程正在使用压缩函数 */
+int rdbCodecSetDict(const void *dict, size_t len) {
+#ifdef USE_ZSTD
+    ZSTD_CDict *cdict;
+    ZSTD_DDict *ddict;
+
+    cdict = ZSTD_createCDict(dict,len,RDB_ZSTD_LEVEL);
+    ddict = ZSTD_createDDict(dict,len);
+    if (cdict == NULL || ddict == NULL) {
+        ZSTD_freeCDict(cdict);
+        ZSTD_freeDDict(ddict);
+        return -1;
+    }
+    rdbCodecResetDict();
+    pthread_mutex_lock(&zstd_lock);
+    zstd_cdict = cdict;
+    zstd_ddict = ddict;
+    pthread_mutex_unlock(&zstd_lock);
+    return 0;
+#else
+    (void)dict; (void)len;
+    return -1;
+#endif
+}
+
+/* 清除当前使用的Zstd字典 */
+void rdbCodecResetDict(void) {
+#ifdef USE_ZSTD
+    pthread_mutex_lock(&zstd_lock);
+    ZSTD_freeCDict(zstd_cdict);
+    ZSTD_freeDDict(zstd_ddict);
+    zstd_cdict = NULL;
+    zstd_ddict = NULL;
+    pthread_mutex_unlock(&zstd_lock);
+#endif
+}
+
+/* 检查当前是否设置了Zstd字典 */
+int rdbCodecHasDict(void) {
+#ifdef USE_ZSTD
+    return zstd_cdict != NULL;
+#else
+    return 0;
+#endif
+}
+
+#ifdef RDBCODEC_BENCHMARK_MAIN
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+/* 返回当前的微秒时间戳 */
+static long long usec(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv,NULL);
+    return ((long long)tv.tv_sec)*1000000+tv.tv_usec;
+}
+
+/* 生成第i个测试数据：结构相同的小JSON对象 */
+static sds genValue(int i) {
+    static const char *cities[] = {"Beijing","Shanghai","Shenzhen","Hangzhou"};
+
+    return sdscatprintf(sdsempty(),
+        "{\"id\":%d,\"name\":\"user_%d\",\"email\":\"user%d@example.com\","
+        "\"city\":\"%s\",\"active\":%s,\"score\":%d.%02d,\"tags\":[\"t%d\",\"t%d\"]}",
+        i, i, i, cities[i%4], (i%3) ? "true" : "false", rand()%100, rand()%100,
+        rand()%10, rand()%10);
+}
+
+/*  比较各个压缩算法在同一数据集上的压缩时间（对应保存RDB）、解压缩时间（对应载入RDB）以及
+    压缩后的大小。与RDB一样，只有长度超过20字节且压缩后变小的字符串才会以压缩形式保存。
+    用法：rdbcodec-benchmark [count] [file]，指定file时每一行作为一个value，否则使用生成的JSON数据。 */
+int main(int argc, char **argv) {
+    int count = (argc > 1) ? atoi(argv[1]) : 200000, j, k, n = 0;
+    sds *values = zmalloc(sizeof(sds)*count);
+    size_t raw = 0;
+    FILE *fp = (argc > 2) ? fopen(argv[2],"r") : NULL;
+    struct {
+        int codec;
+        int dict;
+    } runs[] = {{RDB_CODEC_LZF,0},{RDB_CODEC_LZ4,0},{RDB_CODEC_ZSTD,0},{RDB_CODEC_ZSTD,1}};
+
+    /* Load or generate the dataset. */
+    srand(1234);
+    while (n < count) {
+        if (fp) {
+            char line[65536];
+            if (fgets(line,sizeof(line),fp) == NULL) break;
+            values[n] = sdsnew(line);
+            sdstrim(values[n],"\r\n");
+        } else {
+            values[n] = genValue(n);
+        }
+        raw += sdslen(values[n]);
+        n++;
+    }
+    if (fp) fclose(fp);
+    printf("%d values, %zu bytes\n", n, raw);
+    printf("%-10s %12s %8s %12s %12s\n","codec","size","ratio","save MB/s","load MB/s");
+
+    for (j = 0; j < (int)(sizeof(runs)/sizeof(*runs)); j++) {
+        int codec = runs[j].codec;
+        unsigned char **comp;
+        size_t *clen, total = 0;
+        long long start, save_us, load_us;
+        char name[32];
+
+        if (!rdbCodecAvailable(codec)) continue;
+        snprintf(name,sizeof(name),"%s%s",rdbCodecName(codec),runs[j].dict ? "+dict" : "");
+
+        /* The dictionary is trained on 10% of the values, up to 10000. */
+        if (runs[j].dict) {
+            int nsamples = n/10 < 10000 ? n/10 : 10000;
+            size_t *sizes = zmalloc(sizeof(size_t)*nsamples);
+            sds samples = sdsempty(), dict;
+
+            for (k = 0; k < nsamples; k++) {
+                sizes[k] = sdslen(values[k*10]);
+                samples = sdscatsds(samples,values[k*10]);
+            }
+            dict = rdbCodecTrainDict(samples,sizes,nsamples,64*1024);
+            if (dict == NULL || rdbCodecSetDict(dict,sdslen(dict)) == -1) {
+                printf("%-10s dictionary training failed\n",name);
+                continue;
+            }
+            total += sdslen(dict);
+            sdsfree(dict);
+            sdsfree(samples);
+            zfree(sizes);
+        }
+
+        comp = zmalloc(sizeof(unsigned char*)*n);
+        clen = zmalloc(sizeof(size_t)*n);
+        start = usec();
+        for (k = 0; k < n; k++) {
+            size_t len = sdslen(values[k]);
+
+            comp[k] = zmalloc(len);
+            clen[k] = (len > 20) ? rdbCodecCompress(codec,values[k],len,comp[k],len-1) : 0;
+            total += clen[k] ? clen[k] : len;
+        }
+        save_us = usec()-start;
+
+        start = usec();
+        for (k = 0; k < n; k++) {
+            size_t len = sdslen(values[k]);
+            sds out;
+
+            if (clen[k] == 0) continue;
+            out = sdsnewlen(NULL,len);
+            if (rdbCodecDecompress(codec,comp[k],clen[k],out,len) != len ||
+                memcmp(out,values[k],len) != 0)
+            {
+                printf("%s: decompression error at value %d\n",name,k);
+                exit(1);
+            }
+            sdsfree(out);
+        }
+        load_us = usec()-start;
+
+        printf("%-10s %12zu %8.3f %12.2f %12.2f\n", name, total,
+            (double)total/raw,
+            save_us ? (double)raw/save_us : 0,
+            load_us ? (double)raw/load_us : 0);
+
+        for (k = 0; k < n; k++) zfree(comp[k]);
+        zfree(comp);
+        zfree(clen);
+        rdbCodecResetDict();
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,64 @@
+/* rdbcodec.h - Compression codecs for RDB strings
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __RDBCODEC_H
+#define __RDBCODEC_H
+
+#include <stddef.h>
+#include "sds.h"
+
+/*  RDB字符串的压缩算法。LZF总是可用，LZ4和Zstd分别需要在编译时定义USE_LZ4和USE_ZSTD。
+    Zstd还支持使用一个共享的字典：保存RDB时从数据集中采样训练出字典并写入文件头部，
+    这样即使是很短的字符串，只要彼此结构相似，也能得到不错的压缩率。 */
+
+#define RDB_CODEC_LZF 0
+#define RDB_CODEC_LZ4 1
+#define RDB_CODEC_ZSTD 2
+
+/* 根据名字返回压缩算法，名字不合法或者该算法在编译时没有开启则返回-1 */
+int rdbCodecByName(const char *name);
+/* 返回压缩算法的名字 */
+const char *rdbCodecName(int codec);
+/* 检查压缩算法在编译时是否开启 */
+int rdbCodecAvailable(int codec);
+/* 压缩in，结果保存在容量为outlen的out中。返回压缩后的长度，无法压缩或者出错时返回0 */
+size_t rdbCodecCompress(int codec, const void *in, size_t inlen, void *out, size_t outlen);
+/* 解压缩in，out的容量outlen必须正好是原始长度。成功返回outlen，出错返回0 */
+size_t rdbCodecDecompress(int codec, const void *in, size_t inlen, void *out, size_t outlen);
+/* 根据样本训练一个Zstd字典，失败时返回NULL */
+sds rdbCodecTrainDict(const void *samples, const size_t *sizes, unsigned int nsamples, size_t dictsize);
+/* 设置接下来压缩和解压缩时使用的Zstd字典，成功返回0，失败返回-1 */
+int rdbCodecSetDict(const void *dict, size_t len);
+/* 清除当前使用的Zstd字典 */
+void rdbCodecResetDict(void);
+/* 检查当前是否设置了Zstd字典 */
+int rdbCodecHasDict(void);
+
+#endif
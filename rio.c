@@ -59,6 +59,12 @@
 #include <string.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/socket.h>
 #include "rio.h"
 #include "util.h"
 #include "crc64.h"
@@ -198,6 +204,374 @@ void rioInitWithFile(rio *r, FILE *fp) {
 /* ------------------- File descriptors set implementation ------------------- */
 /* 文件描述符集合实现，用于控制多个文件描述符 */
 
+/*  往多个slave传输RDB时，原来的实现依次阻塞地往每个socket写入1024字节，
+    只要有一个slave的网络比较慢，其它所有slave都要陪着它等待，而且同一份数据要从用户态拷贝N次到内核中。
+    现在的实现做了两点改进：
+
+    1、背压控制：所有fd都被设置成非阻塞模式，每个fd各自记录自己的发送进度，
+       通过poll()只等待那些还有数据没发完的fd。慢的slave可以落后其它slave最多
+       RIO_FDSET_MAX_BACKLOG字节，超过这个限制才会让写入者等待它；
+       某个fd超过SO_SNDTIMEO设置的时间没有任何进展则被标记为ETIMEDOUT。
+
+    2、零拷贝（仅Linux，且至少有两个socket）：数据块只写入一个源管道一次，
+       然后通过tee()把管道中的页面“复制”（只增加引用计数）到每个slave自己的管道中，
+       再用splice()从slave的管道直接发送到socket，整个过程只有一次用户态到内核的拷贝。
+       每个slave的管道同时也是它的发送缓冲区，慢的slave的数据就积压在它自己的管道里。
+       如果某个slave的管道放不下整个数据块，剩下的部分退化为普通的write()。
+
+    不满足零拷贝条件时（非Linux、只有一个fd、fd不是socket或者创建管道失败）
+    使用用户态的共享缓冲区：所有fd共用r->io.fdset.buf，只有被所有fd都发送过的数据才会被丢弃。 */
+
+/* Max number of bytes a slow target may lag behind the fastest one before
+ * the writer has to wait for it. */
+#define RIO_FDSET_MAX_BACKLOG (1024*1024)
+/* Size requested for the pipes used by the zero copy path. */
+#define RIO_FDSET_PIPE_SIZE (1024*1024)
+/* Milliseconds we wait in poll() before checking the send timeouts. */
+#define RIO_FDSET_POLL_PERIOD 100
+
+#if defined(__linux__) && defined(F_SETPIPE_SZ) && defined(SPLICE_F_NONBLOCK)
+#define HAVE_SPLICE 1
+#endif
+
+/* State of every FD of the set. */
+typedef struct rioFdsetTarget {
+    // 共享缓冲区模式下表示buf中已经发送给该fd的字节数，
+    // 零拷贝模式下表示当前数据块中已经交给该fd（管道或socket）的字节数
+    size_t offset;
+    // 零拷贝模式下连接到该fd的管道
+    int pipe[2];
+    // 管道中还没有发送到socket的字节数
+    size_t inpipe;
+    // 管道中已经占用的缓冲页数，这是一个上界，管道被清空时才归零
+    int pipebufs;
+    // fd原来的文件状态标志，释放时恢复
+    int flags;
+    // 发送超时时间（毫秒），来自SO_SNDTIMEO，0表示不超时
+    long long timeout;
+    // 最后一次有进展（或者没有数据要发送）的时间
+    long long lastio;
+} rioFdsetTarget;
+
+/* Private state of the fdset target. */
+struct rioFdsetCtx {
+    // 与fds一一对应
+    rioFdsetTarget *targets;
+    // poll()使用的数组，不需要等待的fd被设置为-1
+    struct pollfd *pfds;
+    // 上次尝试发送之后追加到缓冲区中的字节数
+    size_t pending;
+    // 以下字段只在零拷贝模式下使用，pipesize为0表示使用共享缓冲区模式
+    int srcpipe[2];
+    int devnull;
+    size_t pipesize;    /* Smallest capacity of all our pipes, in bytes. */
+    int pipebufs;       /* Smallest capacity of all our pipes, in pages. */
+    size_t pagesize;
+};
+
+/* 将第j个fd标记为出错 */
+static void rioFdsetSetError(rio *r, int j, int err) {
+    r->io.fdset.state[j] = err ? err : EIO;
+    r->io.fdset.ctx->pfds[j].fd = -1;
+}
+
+/* 返回出错的fd数量 */
+static int rioFdsetBrokenCount(rio *r) {
+    int j, broken = 0;
+
+    for (j = 0; j < r->io.fdset.numfds; j++)
+        if (r->io.fdset.state[j] != 0) broken++;
+    return broken;
+}
+
+/* Wait for at least one of the FDs flagged in the pollfd array to be
+ * writable, then mark as timed out the ones that made no progress for more
+ * than their send timeout. */
+/*  等待需要发送数据的fd变为可写，并将超过发送超时时间没有任何进展的fd标记为ETIMEDOUT */
+static void rioFdsetWait(rio *r) {
+    struct rioFdsetCtx *ctx = r->io.fdset.ctx;
+    long long now;
+    int j;
+
+    if (poll(ctx->pfds,r->io.fdset.numfds,RIO_FDSET_POLL_PERIOD) == -1 &&
+        errno != EINTR) return;
+
+    now = mstime();
+    for (j = 0; j < r->io.fdset.numfds; j++) {
+        rioFdsetTarget *t = ctx->targets+j;
+
+        if (ctx->pfds[j].fd == -1 || ctx->pfds[j].revents) continue;
+        if (t->timeout && now - t->lastio > t->timeout)
+            rioFdsetSetError(r,j,ETIMEDOUT);
+    }
+}
+
+/* Write to the FD 'j' as much of the data in p[t->offset..len] as possible
+ * without blocking. Returns 0 if the FD is now broken, otherwise 1. */
+/*  在不阻塞的前提下往第j个fd写入尽量多的p[t->offset..len]中的数据 */
+static int rioFdsetWriteTarget(rio *r, int j, const unsigned char *p, size_t len, long long now) {
+    rioFdsetTarget *t = r->io.fdset.ctx->targets+j;
+
+    while (t->offset < len) {
+        ssize_t nwritten = write(r->io.fdset.fds[j],p+t->offset,len-t->offset);
+
+        if (nwritten > 0) {
+            t->offset += nwritten;
+            t->lastio = now;
+        } else if (nwritten == -1 && errno == EINTR) {
+            continue;
+        } else if (nwritten == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            rioFdsetSetError(r,j,errno);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Shared buffer mode: push the buffer to every FD without blocking, then
+ * discard the prefix already sent to all the FDs. Returns the number of FDs
+ * that still have data to send. */
+/*  共享缓冲区模式：在不阻塞的前提下将缓冲区中的数据发送给每个fd，
+    然后丢弃已经被所有fd发送过的部分。返回还有数据没有发送完的fd数量。 */
+static int rioFdsetPumpBuffer(rio *r) {
+    struct rioFdsetCtx *ctx = r->io.fdset.ctx;
+    unsigned char *p = (unsigned char*) r->io.fdset.buf;
+    size_t len = sdslen(r->io.fdset.buf), minoffset = len;
+    long long now = mstime();
+    int j, pending = 0;
+
+    for (j = 0; j < r->io.fdset.numfds; j++) {
+        rioFdsetTarget *t = ctx->targets+j;
+
+        if (r->io.fdset.state[j] != 0) continue;
+        if (t->offset == len) t->lastio = now;
+        if (!rioFdsetWriteTarget(r,j,p,len,now)) continue;
+        if (t->offset < len) {
+            ctx->pfds[j].events = POLLOUT;
+            pending++;
+        } else {
+            ctx->pfds[j].events = 0;
+        }
+        if (t->offset < minoffset) minoffset = t->offset;
+    }
+
+    // 丢弃已经发送给所有fd的数据
+    if (minoffset) {
+        sdsrange(r->io.fdset.buf,minoffset,-1);
+        for (j = 0; j < r->io.fdset.numfds; j++) {
+            rioFdsetTarget *t = ctx->targets+j;
+
+            t->offset = (t->offset > minoffset) ? t->offset-minoffset : 0;
+        }
+    }
+    return pending;
+}
+
+/* Shared buffer mode write: returns 0 if all the FDs are broken. When
+ * 'flush' is true we wait for every FD to receive all the buffered data,
+ * otherwise only for the slowest FD to be within RIO_FDSET_MAX_BACKLOG. */
+/*  共享缓冲区模式下的写入。flush为真时等待所有fd发送完缓冲区中的数据，
+    否则只需要等到最慢的fd落后不超过RIO_FDSET_MAX_BACKLOG字节。 */
+static size_t rioFdsetWriteBuffer(rio *r, int flush) {
+    while(1) {
+        int pending = rioFdsetPumpBuffer(r);
+
+        if (rioFdsetBrokenCount(r) == r->io.fdset.numfds) return 0;
+        if (pending == 0) break;
+        if (!flush && sdslen(r->io.fdset.buf) <= RIO_FDSET_MAX_BACKLOG) break;
+        rioFdsetWait(r);
+    }
+    return 1;
+}
+
+#ifdef HAVE_SPLICE
+/* Zero copy mode: move the current block, already stored in the source pipe,
+ * towards every FD without blocking. A FD gets the block via tee() into its
+ * own pipe if there is room for all of it, otherwise it waits for its pipe to
+ * drain and gets the rest with write(). With 'drain' set (and len == 0) we
+ * just flush the FD pipes. Returns the number of FDs that still have data to
+ * send. */
+/*  零拷贝模式：在不阻塞的前提下将已经放在源管道中的当前数据块交给每个fd。
+    如果fd的管道能放下整个数据块，则通过tee()放入该管道，否则等到管道清空之后用write()写入剩下的数据。
+    drain为真（此时len为0）时只负责清空每个fd的管道。返回还有数据没有发送完的fd数量。 */
+static int rioFdsetPumpPipes(rio *r, const unsigned char *p, size_t len, int drain) {
+    struct rioFdsetCtx *ctx = r->io.fdset.ctx;
+    int blockbufs = len/ctx->pagesize+2;
+    long long now = mstime();
+    int j, pending = 0;
+
+    for (j = 0; j < r->io.fdset.numfds; j++) {
+        rioFdsetTarget *t = ctx->targets+j;
+        int fd = r->io.fdset.fds[j];
+        ssize_t n;
+
+        if (r->io.fdset.state[j] != 0) continue;
+        if (t->offset == len && t->inpipe == 0) t->lastio = now;
+
+        while(1) {
+            /* If the pipe has room for the whole block, give the FD its
+             * reference to the pages with tee(). Data already queued in the
+             * pipe is fine: this is what lets a slow FD lag behind. */
+            // 管道中有足够的空间，通过tee()将整个数据块放入管道
+            if (len && t->offset == 0 && t->pipebufs+blockbufs <= ctx->pipebufs) {
+                n = tee(ctx->srcpipe[0],t->pipe[1],len,SPLICE_F_NONBLOCK);
+                if (n > 0) {
+                    t->offset = n;
+                    t->inpipe += n;
+                    t->pipebufs += blockbufs;
+                }
+            }
+
+            // 把管道中积压的数据发送到socket
+            if (t->inpipe) {
+                n = splice(t->pipe[0],NULL,fd,NULL,t->inpipe,
+                           SPLICE_F_NONBLOCK|SPLICE_F_MORE);
+                if (n > 0) {
+                    t->inpipe -= n;
+                    if (t->inpipe == 0) t->pipebufs = 0;
+                    t->lastio = now;
+                    continue;
+                }
+                if (n == -1 && errno == EINTR) continue;
+                if (n == -1 && errno != EAGAIN) rioFdsetSetError(r,j,errno);
+                break;
+            }
+
+            /* The pipe is empty but it could not take the block (or tee()
+             * failed): fall back to a plain write of what is left. */
+            // 管道已经清空，但是放不下数据块（或者tee()失败），用write()写入剩下的数据
+            rioFdsetWriteTarget(r,j,p,len,now);
+            break;
+        }
+
+        if (r->io.fdset.state[j] != 0) continue;
+        if (t->offset < len || (drain && t->inpipe)) {
+            ctx->pfds[j].events = POLLOUT;
+            pending++;
+        } else {
+            ctx->pfds[j].events = 0;
+        }
+    }
+    return pending;
+}
+
+/* Zero copy mode write: returns 0 if all the FDs are broken. */
+/* 零拷贝模式下的写入，所有fd都出错时返回0 */
+static size_t rioFdsetWritePipes(rio *r, int flush) {
+    struct rioFdsetCtx *ctx = r->io.fdset.ctx;
+    unsigned char *p = (unsigned char*) r->io.fdset.buf;
+    size_t len = sdslen(r->io.fdset.buf);
+    size_t maxblock = ctx->pipesize-2*ctx->pagesize;
+    int j;
+
+    while(len) {
+        size_t count = len < maxblock ? len : maxblock, nwritten = 0;
+        ssize_t n;
+
+        /* Store the block in the source pipe: this is the only copy of the
+         * data from user space to the kernel. The pipe is empty here, so
+         * the write can't block. */
+        // 将数据块写入源管道，这是整个过程中唯一一次从用户态到内核的拷贝
+        while (nwritten != count) {
+            n = write(ctx->srcpipe[1],p+nwritten,count-nwritten);
+            if (n == -1 && errno == EINTR) continue;
+            if (n <= 0) return 0;
+            nwritten += n;
+        }
+
+        for (j = 0; j < r->io.fdset.numfds; j++) ctx->targets[j].offset = 0;
+        while(rioFdsetPumpPipes(r,p,count,0)) {
+            if (rioFdsetBrokenCount(r) == r->io.fdset.numfds) return 0;
+            rioFdsetWait(r);
+        }
+        if (rioFdsetBrokenCount(r) == r->io.fdset.numfds) return 0;
+
+        /* Every FD has its own reference to the pages now, discard the
+         * block from the source pipe. */
+        // 所有fd都已经持有数据块的引用了，丢弃源管道中的数据
+        nwritten = 0;
+        while (nwritten != count) {
+            char discard[4096];
+
+            n = splice(ctx->srcpipe[0],NULL,ctx->devnull,NULL,count-nwritten,0);
+            if (n == -1 && errno == EINTR) continue;
+            if (n <= 0) {
+                size_t toread = count-nwritten;
+
+                if (toread > sizeof(discard)) toread = sizeof(discard);
+                n = read(ctx->srcpipe[0],discard,toread);
+                if (n <= 0) return 0;
+            }
+            nwritten += n;
+        }
+
+        p += count;
+        len -= count;
+    }
+    sdsclear(r->io.fdset.buf);
+
+    if (flush) {
+        while(rioFdsetPumpPipes(r,NULL,0,1)) {
+            if (rioFdsetBrokenCount(r) == r->io.fdset.numfds) return 0;
+            rioFdsetWait(r);
+        }
+        if (rioFdsetBrokenCount(r) == r->io.fdset.numfds) return 0;
+    }
+    return 1;
+}
+
+/* Try to setup the zero copy path. Only used when writing to two or more
+ * sockets: with a single target a plain write() is already a single copy. */
+/*  尝试开启零拷贝模式。只有在往两个及以上的socket写入时才使用，
+    只有一个fd时直接write()本来就只有一次拷贝。 */
+static void rioFdsetSetupPipes(rio *r) {
+    struct rioFdsetCtx *ctx = r->io.fdset.ctx;
+    int j, size;
+
+    if (r->io.fdset.numfds < 2) return;
+    for (j = 0; j < r->io.fdset.numfds; j++) {
+        struct stat st;
+
+        if (fstat(r->io.fdset.fds[j],&st) == -1 || !S_ISSOCK(st.st_mode))
+            return;
+    }
+
+    ctx->pagesize = sysconf(_SC_PAGESIZE);
+    if ((ctx->devnull = open("/dev/null",O_WRONLY)) == -1) return;
+    if (pipe(ctx->srcpipe) == -1) goto err;
+    fcntl(ctx->srcpipe[1],F_SETPIPE_SZ,RIO_FDSET_PIPE_SIZE);
+    if ((size = fcntl(ctx->srcpipe[1],F_GETPIPE_SZ)) == -1) goto err;
+    ctx->pipesize = size;
+    for (j = 0; j < r->io.fdset.numfds; j++) {
+        rioFdsetTarget *t = ctx->targets+j;
+
+        if (pipe(t->pipe) == -1) goto err;
+        fcntl(t->pipe[1],F_SETPIPE_SZ,RIO_FDSET_PIPE_SIZE);
+        if ((size = fcntl(t->pipe[1],F_GETPIPE_SZ)) == -1) goto err;
+        if ((size_t)size < ctx->pipesize) ctx->pipesize = size;
+    }
+    ctx->pipebufs = ctx->pipesize/ctx->pagesize;
+    if (ctx->pipebufs >= 4) return;
+
+err:
+    // 失败时关闭所有管道，退回到共享缓冲区模式
+    for (j = 0; j < r->io.fdset.numfds; j++) {
+        rioFdsetTarget *t = ctx->targets+j;
+
+        if (t->pipe[0] != -1) close(t->pipe[0]);
+        if (t->pipe[1] != -1) close(t->pipe[1]);
+        t->pipe[0] = t->pipe[1] = -1;
+    }
+    if (ctx->srcpipe[0] != -1) close(ctx->srcpipe[0]);
+    if (ctx->srcpipe[1] != -1) close(ctx->srcpipe[1]);
+    ctx->srcpipe[0] = ctx->srcpipe[1] = -1;
+    close(ctx->devnull);
+    ctx->devnull = -1;
+    ctx->pipesize = 0;
+}
+#endif
 
 /* Returns 1 or 0 for success/failure.
  * The function returns success as long as we are able to correctly write
@@ -210,76 +584,29 @@ void rioInitWithFile(rio *r, FILE *fp) {
     该函数只有在成功往至少一个文件描述符中写入数据后才返回1。
     如果参数buf为NULL且len为0，该函数相当于flush操作。*/
 static size_t rioFdsetWrite(rio *r, const void *buf, size_t len) {
-    ssize_t retval;
-    int j;
-    unsigned char *p = (unsigned char*) buf;
+    struct rioFdsetCtx *ctx = r->io.fdset.ctx;
     // 如果参数buf为NULL且len为0，该函数相当于flush操作
     int doflush = (buf == NULL && len == 0);
+    size_t retval;
 
     /* To start we always append to our buffer. If it gets larger than
      * a given size, we actually write to the sockets. */
     // 将buf中的内容追加到r->io.fdset.buf缓冲区中。
     if (len) {
         r->io.fdset.buf = sdscatlen(r->io.fdset.buf,buf,len);
-        len = 0; /* Prevent entering the while belove if we don't flush. */
-        if (sdslen(r->io.fdset.buf) > REDIS_IOBUF_LEN) doflush = 1;
-    }
-
-    if (doflush) {
-        p = (unsigned char*) r->io.fdset.buf;
-        len = sdslen(r->io.fdset.buf);
-    }
-
-    /* Write in little chunchs so that when there are big writes we
-     * parallelize while the kernel is sending data in background to
-     * the TCP socket. */
-    while(len) {
-        size_t count = len < 1024 ? len : 1024;
-        int broken = 0;
-        for (j = 0; j < r->io.fdset.numfds; j++) {
-            // 跳过出错的fd
-            if (r->io.fdset.state[j] != 0) {
-                /* Skip FDs alraedy in error. */
-                // 记录出错的fd数量
-                broken++;
-                continue;
-            }
-
-            /* Make sure to write 'count' bytes to the socket regardless
-             * of short writes. */
-            // 记录写入的字节数
-            size_t nwritten = 0;
-            // 往当前fd中写入count字节的数据
-            while(nwritten != count) {
-                // 真正执行写入操作
-                retval = write(r->io.fdset.fds[j],p+nwritten,count-nwritten);
-                if (retval <= 0) {
-                    /* With blocking sockets, which is the sole user of this
-                     * rio target, EWOULDBLOCK is returned only because of
-                     * the SO_SNDTIMEO socket option, so we translate the error
-                     * into one more recognizable by the user. */
-                    if (retval == -1 && errno == EWOULDBLOCK) errno = ETIMEDOUT;
-                    break;
-                }
-                nwritten += retval;
-            }
-
-            if (nwritten != count) {
-                /* Mark this FD as broken. */
-                r->io.fdset.state[j] = errno;
-                if (r->io.fdset.state[j] == 0) r->io.fdset.state[j] = EIO;
-            }
-        }
-        // 如果所有的fd都出错，返回
-        if (broken == r->io.fdset.numfds) return 0; /* All the FDs in error. */
-        // 更新偏移量和剩余字节数
-        p += count;
-        len -= count;
-        r->io.fdset.pos += count;
+        r->io.fdset.pos += len;
+        ctx->pending += len;
+        if (ctx->pending <= REDIS_IOBUF_LEN) return 1;
     }
 
-    if (doflush) sdsclear(r->io.fdset.buf);
-    return 1;
+    ctx->pending = 0;
+#ifdef HAVE_SPLICE
+    if (ctx->pipesize)
+        retval = rioFdsetWritePipes(r,doflush);
+    else
+#endif
+        retval = rioFdsetWriteBuffer(r,doflush);
+    return retval;
 }
 
 /* Returns 1 or 0 for success/failure. */
@@ -322,6 +649,8 @@ static const rio rioFdsetIO = {
 
 /* 初始化fd set rio对象 */
 void rioInitWithFdset(rio *r, int *fds, int numfds) {
+    struct rioFdsetCtx *ctx;
+    long long now = mstime();
     int j;
 
     *r = rioFdsetIO;
@@ -332,10 +661,68 @@ void rioInitWithFdset(rio *r, int *fds, int numfds) {
     r->io.fdset.numfds = numfds;
     r->io.fdset.pos = 0;
     r->io.fdset.buf = sdsempty();
+
+    ctx = zmalloc(sizeof(*ctx));
+    ctx->targets = zmalloc(sizeof(rioFdsetTarget)*numfds);
+    ctx->pfds = zmalloc(sizeof(struct pollfd)*numfds);
+    ctx->pending = 0;
+    ctx->srcpipe[0] = ctx->srcpipe[1] = -1;
+    ctx->devnull = -1;
+    ctx->pipesize = 0;
+    ctx->pipebufs = 0;
+    ctx->pagesize = 0;
+    r->io.fdset.ctx = ctx;
+
+    for (j = 0; j < numfds; j++) {
+        rioFdsetTarget *t = ctx->targets+j;
+        struct timeval tv;
+        socklen_t tvlen = sizeof(tv);
+
+        t->offset = 0;
+        t->pipe[0] = t->pipe[1] = -1;
+        t->inpipe = 0;
+        t->pipebufs = 0;
+        t->lastio = now;
+
+        /* The callers setup blocking sockets with SO_SNDTIMEO: we keep the
+         * same timeout semantic, but switch to non blocking I/O so that a
+         * slow FD does not stall the others. */
+        // 调用者设置的是带有SO_SNDTIMEO的阻塞socket，这里沿用相同的超时时间，但改为非阻塞IO
+        if (getsockopt(fds[j],SOL_SOCKET,SO_SNDTIMEO,&tv,&tvlen) == 0)
+            t->timeout = (long long)tv.tv_sec*1000+tv.tv_usec/1000;
+        else
+            t->timeout = 0;
+        t->flags = fcntl(fds[j],F_GETFL);
+        if (t->flags != -1) fcntl(fds[j],F_SETFL,t->flags|O_NONBLOCK);
+
+        ctx->pfds[j].fd = fds[j];
+        ctx->pfds[j].events = 0;
+        ctx->pfds[j].revents = 0;
+    }
+#ifdef HAVE_SPLICE
+    rioFdsetSetupPipes(r);
+#endif
 }
 
 /* 释放fd set rio对象 */
 void rioFreeFdset(rio *r) {
+    struct rioFdsetCtx *ctx = r->io.fdset.ctx;
+    int j;
+
+    for (j = 0; j < r->io.fdset.numfds; j++) {
+        rioFdsetTarget *t = ctx->targets+j;
+
+        // 恢复fd原来的文件状态标志
+        if (t->flags != -1) fcntl(r->io.fdset.fds[j],F_SETFL,t->flags);
+        if (t->pipe[0] != -1) close(t->pipe[0]);
+        if (t->pipe[1] != -1) close(t->pipe[1]);
+    }
+    if (ctx->srcpipe[0] != -1) close(ctx->srcpipe[0]);
+    if (ctx->srcpipe[1] != -1) close(ctx->srcpipe[1]);
+    if (ctx->devnull != -1) close(ctx->devnull);
+    zfree(ctx->targets);
+    zfree(ctx->pfds);
+    zfree(ctx);
     zfree(r->io.fdset.fds);
     zfree(r->io.fdset.state);
     sdsfree(r->io.fdset.buf);
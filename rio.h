@@ -103,9 +103,20 @@ struct _rio {
             int numfds;
             // 偏移量
             off_t pos;
-            // 缓冲区
+            // 缓冲区，共享缓冲区模式下保存最慢的fd还没有发送的数据
             sds buf;
+            // 背压控制和零拷贝发送需要的私有状态，定义在rio.c中
+            struct rioFdsetCtx *ctx;
         } fdset;
+        /* Backend implemented outside rio.c (e.g. the threaded RDB loader
+         * read-ahead queue). */
+        // 由rio.c之外的模块实现的后端，比如多线程载入RDB时使用的预读队列
+        struct {
+            // 后端私有的状态
+            void *ptr;
+            // 偏移量
+            off_t pos;
+        } custom;
     } io;
 };
 
@@ -167,6 +178,7 @@ static inline int rioFlush(rio *r) {
 void rioInitWithFile(rio *r, FILE *fp);
 void rioInitWithBuffer(rio *r, sds s);
 void rioInitWithFdset(rio *r, int *fds, int numfds);
+void rioFreeFdset(rio *r);
 
 size_t rioWriteBulkCount(rio *r, char prefix, int count);
 size_t rioWriteBulkString(rio *r, const char *buf, size_t len);
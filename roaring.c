@@ -0,0 +1,1212 @@
+/* roaring.c - Compressed bitmaps for large integer sets
+ *
+ * Integer sets that outgrow set-max-intset-entries are stored as roaring
+ * style bitmaps: values are grouped by their high 48 bits and every group is
+ * a container holding the low 16 bits, either as a sorted array of uint16_t
+ * (up to 4096 values) or as a 65536 bit bitmap. Dense sets of IDs take a
+ * little more than one bit per member, and intersections, unions and
+ * differences of bitmap containers are computed a 64 bit word at a time.
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "roaring.h"
+#include "zmalloc.h"
+#include "rand.h"
+
+/*  roaring位图的实现。
+
+    一个64位整数被拆分为高48位的key和低16位的low：key相同的元素保存在同一个容器中，容器内只保存low。
+    为了让key的顺序与整数的大小顺序一致，拆分之前先将符号位取反，这样负数排在正数前面，
+    迭代器按key和low从小到大遍历时得到的就是从小到大排好序的整数。
+
+    容器有两种：
+    1. array容器：有序的uint16_t数组，每个元素占用2个字节，最多保存ROARING_ARRAY_MAX（4096）个元素。
+    2. bitmap容器：65536位的位图，固定占用8KB，元素个数超过4096时使用。
+
+    array容器超过4096个元素时转换为bitmap容器。bitmap容器的元素个数降到2048个以下时才转换回array容器，
+    这样在临界点附近反复增删元素时不会来回转换。
+
+    交集、并集、差集运算按key归并两个roaring位图的容器，两个bitmap容器之间按64位的字逐个进行与、或、与非运算，
+    array容器之间使用有序数组的归并，array和bitmap容器之间则逐个查询位图。
+
+    SRANDMEMBER、SPOP需要按排名查找元素。ranks数组保存每个容器之前所有容器的元素总数，
+    先二分查找元素所在的容器，再在容器内查找，复杂度为O(log n)。添加或删除元素只会使该容器之后的ranks失效，
+    ranks_valid记录仍然有效的项数，失效的部分在下一次按排名查找时才重新计算。 */
+
+/* Flip the sign bit so that the unsigned order of the encoded values matches
+ * the signed order of the original ones. */
+// 将符号位取反，使编码后的无符号整数的顺序与原来的有符号整数一致
+#define ROARING_SIGN 0x8000000000000000ULL
+#define roaringKey(v) ((((uint64_t)(v)) ^ ROARING_SIGN) >> 16)
+#define roaringLow(v) ((uint16_t)((uint64_t)(v) & 0xffff))
+#define roaringValue(key,low) ((int64_t)((((uint64_t)(key) << 16) | (low)) ^ ROARING_SIGN))
+
+/* bitmap容器的元素个数降到这个值以下时转换回array容器 */
+#define ROARING_BITMAP_MIN (ROARING_ARRAY_MAX/2)
+
+/* Without hardware support __builtin_popcountll() becomes a libgcc call,
+ * which is slower than the inline SWAR version below. */
+// 没有popcnt指令时__builtin_popcountll会变成一次库函数调用，比下面内联的SWAR实现还要慢
+#if defined(__GNUC__) && defined(__POPCNT__)
+#define roaringPopcount(w) __builtin_popcountll(w)
+#else
+static inline int roaringPopcount(uint64_t w) {
+    w = w - ((w >> 1) & 0x5555555555555555ULL);
+    w = (w & 0x3333333333333333ULL) + ((w >> 2) & 0x3333333333333333ULL);
+    w = (w + (w >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (int)((w * 0x0101010101010101ULL) >> 56);
+}
+#endif
+
+#if defined(__GNUC__)
+#define roaringCtz(w) __builtin_ctzll(w)
+#else
+static int roaringCtz(uint64_t w) {
+    int n = 0;
+    while (!(w & 1)) {
+        w >>= 1;
+        n++;
+    }
+    return n;
+}
+#endif
+
+/* ------------------------------- Containers ------------------------------ */
+
+/* 初始化一个容量为cap的空array容器 */
+static void contInitArray(roaringContainer *c, uint32_t cap) {
+    c->type = ROARING_ARRAY;
+    c->card = 0;
+    c->cap = cap;
+    c->u.array = zmalloc(sizeof(uint16_t)*(cap ? cap : 1));
+}
+
+/* 初始化一个空的bitmap容器 */
+static void contInitBitmap(roaringContainer *c) {
+    c->type = ROARING_BITMAP;
+    c->card = 0;
+    c->cap = 0;
+    c->u.words = zcalloc(sizeof(uint64_t)*ROARING_BITMAP_WORDS);
+}
+
+/* 释放容器中的数据 */
+static void contFree(roaringContainer *c) {
+    if (c->type == ROARING_ARRAY)
+        zfree(c->u.array);
+    else
+        zfree(c->u.words);
+}
+
+/* 复制一个容器，array容器的容量收缩为元素个数 */
+static void contCopy(roaringContainer *dst, const roaringContainer *src) {
+    if (src->type == ROARING_ARRAY) {
+        contInitArray(dst,src->card);
+        memcpy(dst->u.array,src->u.array,sizeof(uint16_t)*src->card);
+    } else {
+        dst->type = ROARING_BITMAP;
+        dst->cap = 0;
+        dst->u.words = zmalloc(sizeof(uint64_t)*ROARING_BITMAP_WORDS);
+        memcpy(dst->u.words,src->u.words,sizeof(uint64_t)*ROARING_BITMAP_WORDS);
+    }
+    dst->card = src->card;
+}
+
+/* 返回容器占用的内存字节数 */
+static size_t contBytes(const roaringContainer *c) {
+    if (c->type == ROARING_ARRAY)
+        return sizeof(uint16_t)*c->cap;
+    return sizeof(uint64_t)*ROARING_BITMAP_WORDS;
+}
+
+/* Return the position of the first element of the array >= v. */
+// 无分支的二分查找，返回数组中第一个大于等于v的元素的位置
+static uint32_t arrayLowerBound(const uint16_t *a, uint32_t n, uint16_t v) {
+    const uint16_t *base = a;
+
+    if (n == 0) return 0;
+    while (n > 1) {
+        uint32_t half = n >> 1;
+        base = (base[half] < v) ? base+half : base;
+        n -= half;
+    }
+    return (uint32_t)(base-a) + (*base < v);
+}
+
+/* 测试bitmap中的某一位 */
+static int bitmapTest(const uint64_t *words, uint16_t low) {
+    return (words[low >> 6] >> (low & 63)) & 1;
+}
+
+/* 计算bitmap中被设置的位数 */
+static uint32_t bitmapCount(const uint64_t *words) {
+    uint32_t j, count = 0;
+
+    for (j = 0; j < ROARING_BITMAP_WORDS; j++) count += roaringPopcount(words[j]);
+    return count;
+}
+
+/* 将array容器转换为bitmap容器 */
+static void contArrayToBitmap(roaringContainer *c) {
+    uint64_t *words = zcalloc(sizeof(uint64_t)*ROARING_BITMAP_WORDS);
+    uint32_t j;
+
+    for (j = 0; j < c->card; j++)
+        words[c->u.array[j] >> 6] |= 1ULL << (c->u.array[j] & 63);
+    zfree(c->u.array);
+    c->type = ROARING_BITMAP;
+    c->cap = 0;
+    c->u.words = words;
+}
+
+/* 将bitmap容器转换为array容器 */
+static void contBitmapToArray(roaringContainer *c) {
+    uint16_t *array = zmalloc(sizeof(uint16_t)*(c->card ? c->card : 1));
+    uint32_t j, k = 0;
+
+    for (j = 0; j < ROARING_BITMAP_WORDS; j++) {
+        uint64_t w = c->u.words[j];
+        while (w) {
+            array[k++] = (uint16_t)(j*64 + roaringCtz(w));
+            w &= w-1;
+        }
+    }
+    zfree(c->u.words);
+    c->type = ROARING_ARRAY;
+    c->cap = c->card;
+    c->u.array = array;
+}
+
+/* Results of the set operations are stored as arrays when small enough. */
+// 集合运算得到的bitmap容器如果元素不多，转换为array容器
+static void contNormalize(roaringContainer *c) {
+    if (c->type == ROARING_BITMAP && c->card <= ROARING_ARRAY_MAX)
+        contBitmapToArray(c);
+}
+
+/* 往容器中添加一个元素，成功返回1，元素已存在返回0 */
+static int contAdd(roaringContainer *c, uint16_t low) {
+    if (c->type == ROARING_ARRAY) {
+        uint32_t pos = arrayLowerBound(c->u.array,c->card,low);
+
+        if (pos < c->card && c->u.array[pos] == low) return 0;
+        if (c->card == ROARING_ARRAY_MAX) {
+            // array容器已满，转换为bitmap容器后再添加
+            contArrayToBitmap(c);
+            return contAdd(c,low);
+        }
+        if (c->card == c->cap) {
+            c->cap = c->cap < 4 ? 4 : c->cap*2;
+            if (c->cap > ROARING_ARRAY_MAX) c->cap = ROARING_ARRAY_MAX;
+            c->u.array = zrealloc(c->u.array,sizeof(uint16_t)*c->cap);
+        }
+        memmove(c->u.array+pos+1,c->u.array+pos,sizeof(uint16_t)*(c->card-pos));
+        c->u.array[pos] = low;
+    } else {
+        uint64_t bit = 1ULL << (low & 63);
+
+        if (c->u.words[low >> 6] & bit) return 0;
+        c->u.words[low >> 6] |= bit;
+    }
+    c->card++;
+    return 1;
+}
+
+/* 从容器中删除一个元素，成功返回1，元素不存在返回0 */
+static int contRemove(roaringContainer *c, uint16_t low) {
+    if (c->type == ROARING_ARRAY) {
+        uint32_t pos = arrayLowerBound(c->u.array,c->card,low);
+
+        if (pos == c->card || c->u.array[pos] != low) return 0;
+        memmove(c->u.array+pos,c->u.array+pos+1,sizeof(uint16_t)*(c->card-pos-1));
+        c->card--;
+        // 元素个数不到容量的四分之一时收缩数组
+        if (c->cap > 8 && c->card < c->cap/4) {
+            c->cap /= 2;
+            c->u.array = zrealloc(c->u.array,sizeof(uint16_t)*c->cap);
+        }
+    } else {
+        uint64_t bit = 1ULL << (low & 63);
+
+        if (!(c->u.words[low >> 6] & bit)) return 0;
+        c->u.words[low >> 6] &= ~bit;
+        c->card--;
+        if (c->card < ROARING_BITMAP_MIN) contBitmapToArray(c);
+    }
+    return 1;
+}
+
+/* 判断容器中是否包含指定的元素 */
+static int contContains(const roaringContainer *c, uint16_t low) {
+    if (c->type == ROARING_ARRAY) {
+        uint32_t pos = arrayLowerBound(c->u.array,c->card,low);
+        return pos < c->card && c->u.array[pos] == low;
+    }
+    return bitmapTest(c->u.words,low);
+}
+
+/* 返回容器中从小到大第rank个元素，rank必须小于容器的元素个数 */
+static uint16_t contSelect(const roaringContainer *c, uint32_t rank) {
+    uint32_t j;
+
+    if (c->type == ROARING_ARRAY) return c->u.array[rank];
+    for (j = 0; j < ROARING_BITMAP_WORDS; j++) {
+        uint64_t w = c->u.words[j];
+        uint32_t count = roaringPopcount(w);
+
+        if (rank < count) {
+            while (rank--) w &= w-1;
+            return (uint16_t)(j*64 + roaringCtz(w));
+        }
+        rank -= count;
+    }
+    return 0; /* Not reached when rank < card. */
+}
+
+/* Intersection of two containers into "out". */
+// 计算两个容器的交集，结果保存在out中
+static void contAnd(const roaringContainer *a, const roaringContainer *b, roaringContainer *out) {
+    uint32_t i = 0, j = 0, k = 0;
+
+    // 让a指向array容器（如果有的话）
+    if (a->type == ROARING_BITMAP && b->type == ROARING_ARRAY) {
+        const roaringContainer *t = a;
+        a = b;
+        b = t;
+    }
+    if (a->type == ROARING_ARRAY && b->type == ROARING_ARRAY) {
+        const uint16_t *x = a->u.array, *y = b->u.array;
+
+        contInitArray(out,a->card < b->card ? a->card : b->card);
+        while (i < a->card && j < b->card) {
+            uint16_t vx = x[i], vy = y[j];
+            out->u.array[k] = vx;
+            k += (vx == vy);
+            i += (vx <= vy);
+            j += (vy <= vx);
+        }
+        out->card = k;
+    } else if (a->type == ROARING_ARRAY) {
+        contInitArray(out,a->card);
+        for (i = 0; i < a->card; i++) {
+            out->u.array[k] = a->u.array[i];
+            k += bitmapTest(b->u.words,a->u.array[i]);
+        }
+        out->card = k;
+    } else {
+        // 先计算交集的元素个数，再决定直接生成array容器还是bitmap容器
+        for (i = 0; i < ROARING_BITMAP_WORDS; i++)
+            k += roaringPopcount(a->u.words[i] & b->u.words[i]);
+        if (k > ROARING_ARRAY_MAX) {
+            contInitBitmap(out);
+            for (i = 0; i < ROARING_BITMAP_WORDS; i++)
+                out->u.words[i] = a->u.words[i] & b->u.words[i];
+        } else {
+            contInitArray(out,k);
+            for (i = 0, j = 0; i < ROARING_BITMAP_WORDS; i++) {
+                uint64_t w = a->u.words[i] & b->u.words[i];
+                while (w) {
+                    out->u.array[j++] = (uint16_t)(i*64 + roaringCtz(w));
+                    w &= w-1;
+                }
+            }
+        }
+        out->card = k;
+    }
+}
+
+/* Union of two containers into "out". */
+// 计算两个容器的并集，结果保存在out中
+static void contOr(const roaringContainer *a, const roaringContainer *b, roaringContainer *out) {
+    uint32_t i = 0, j = 0, k = 0;
+
+    if (a->type == ROARING_BITMAP && b->type == ROARING_ARRAY) {
+        const roaringContainer *t = a;
+        a = b;
+        b = t;
+    }
+    if (a->type == ROARING_ARRAY && b->type == ROARING_ARRAY &&
+        a->card+b->card <= ROARING_ARRAY_MAX)
+    {
+        const uint16_t *x = a->u.array, *y = b->u.array;
+
+        contInitArray(out,a->card+b->card);
+        while (i < a->card && j < b->card) {
+            uint16_t vx = x[i], vy = y[j];
+            out->u.array[k++] = (vx <= vy) ? vx : vy;
+            i += (vx <= vy);
+            j += (vy <= vx);
+        }
+        memcpy(out->u.array+k,x+i,sizeof(uint16_t)*(a->card-i));
+        k += a->card-i;
+        memcpy(out->u.array+k,y+j,sizeof(uint16_t)*(b->card-j));
+        k += b->card-j;
+        out->card = k;
+    } else if (a->type == ROARING_ARRAY) {
+        // 结果可能超过4096个元素，先用bitmap容器保存
+        if (b->type == ROARING_BITMAP) {
+            contCopy(out,b);
+        } else {
+            contInitBitmap(out);
+            for (i = 0; i < b->card; i++)
+                out->u.words[b->u.array[i] >> 6] |= 1ULL << (b->u.array[i] & 63);
+            out->card = b->card;
+        }
+        for (i = 0; i < a->card; i++) {
+            uint16_t low = a->u.array[i];
+            uint64_t bit = 1ULL << (low & 63);
+
+            out->card += !(out->u.words[low >> 6] & bit);
+            out->u.words[low >> 6] |= bit;
+        }
+        contNormalize(out);
+    } else {
+        contInitBitmap(out);
+        for (i = 0; i < ROARING_BITMAP_WORDS; i++) {
+            out->u.words[i] = a->u.words[i] | b->u.words[i];
+            k += roaringPopcount(out->u.words[i]);
+        }
+        out->card = k;
+    }
+}
+
+/* Difference a - b of two containers into "out". */
+// 计算两个容器的差集a - b，结果保存在out中
+static void contAndNot(const roaringContainer *a, const roaringContainer *b, roaringContainer *out) {
+    uint32_t i = 0, j = 0, k = 0;
+
+    if (a->type == ROARING_ARRAY && b->type == ROARING_ARRAY) {
+        const uint16_t *x = a->u.array, *y = b->u.array;
+
+        contInitArray(out,a->card);
+        while (i < a->card && j < b->card) {
+            uint16_t vx = x[i], vy = y[j];
+            out->u.array[k] = vx;
+            k += (vx < vy);
+            i += (vx <= vy);
+            j += (vy <= vx);
+        }
+        memcpy(out->u.array+k,x+i,sizeof(uint16_t)*(a->card-i));
+        k += a->card-i;
+        out->card = k;
+    } else if (a->type == ROARING_ARRAY) {
+        contInitArray(out,a->card);
+        for (i = 0; i < a->card; i++) {
+            out->u.array[k] = a->u.array[i];
+            k += !bitmapTest(b->u.words,a->u.array[i]);
+        }
+        out->card = k;
+    } else if (b->type == ROARING_ARRAY) {
+        contCopy(out,a);
+        for (i = 0; i < b->card; i++) {
+            uint16_t low = b->u.array[i];
+            uint64_t bit = 1ULL << (low & 63);
+
+            out->card -= !!(out->u.words[low >> 6] & bit);
+            out->u.words[low >> 6] &= ~bit;
+        }
+        contNormalize(out);
+    } else {
+        contInitBitmap(out);
+        for (i = 0; i < ROARING_BITMAP_WORDS; i++) {
+            out->u.words[i] = a->u.words[i] & ~b->u.words[i];
+            k += roaringPopcount(out->u.words[i]);
+        }
+        out->card = k;
+        contNormalize(out);
+    }
+}
+
+/* --------------------------------- Bitmaps ------------------------------- */
+
+/* Create an empty roaring bitmap. */
+/*  创建一个空的roaring位图 */
+roaring *roaringNew(void) {
+    roaring *r = zmalloc(sizeof(roaring));
+
+    r->len = 0;
+    r->cap = 0;
+    r->card = 0;
+    r->keys = NULL;
+    r->conts = NULL;
+    r->ranks = NULL;
+    r->ranks_valid = 0;
+    return r;
+}
+
+/* Free a roaring bitmap and all its containers. */
+/*  释放roaring位图及其所有容器 */
+void roaringFree(roaring *r) {
+    uint32_t j;
+
+    for (j = 0; j < r->len; j++) contFree(&r->conts[j]);
+    zfree(r->keys);
+    zfree(r->conts);
+    zfree(r->ranks);
+    zfree(r);
+}
+
+/* 保证roaring位图至少能容纳cap个容器 */
+static void roaringReserve(roaring *r, uint32_t cap) {
+    if (cap <= r->cap) return;
+    r->keys = zrealloc(r->keys,sizeof(uint64_t)*cap);
+    r->conts = zrealloc(r->conts,sizeof(roaringContainer)*cap);
+    r->ranks = zrealloc(r->ranks,sizeof(uint64_t)*cap);
+    r->cap = cap;
+}
+
+/* The cardinality of the container at "pos" changed, or a container was
+ * inserted or removed there: the ranks after it are stale. */
+/*  pos位置的容器元素个数发生变化，或者在pos位置插入、删除了容器：pos之后的ranks失效。
+    ranks[pos]是pos之前所有容器的元素总数，不受影响 */
+static void roaringInvalidateRanks(roaring *r, uint32_t pos) {
+    if (r->ranks_valid > pos+1) r->ranks_valid = pos+1;
+}
+
+/* Return a deep copy of the bitmap. */
+/*  复制一个roaring位图 */
+roaring *roaringDup(roaring *r) {
+    roaring *copy = roaringNew();
+    uint32_t j;
+
+    roaringReserve(copy,r->len);
+    for (j = 0; j < r->len; j++) {
+        copy->keys[j] = r->keys[j];
+        contCopy(&copy->conts[j],&r->conts[j]);
+    }
+    copy->len = r->len;
+    copy->card = r->card;
+    return copy;
+}
+
+/* Search the container for "key". Return 1 if found, 0 otherwise; in both
+ * cases "pos" is set to the position where the key is or should be. */
+/*  查找key对应的容器，找到返回1，否则返回0。pos被设置为该容器所在或者应该插入的位置 */
+static int roaringFindKey(roaring *r, uint64_t key, uint32_t *pos) {
+    uint32_t lo = 0, hi = r->len;
+
+    // 最常见的情况是按顺序添加元素，先检查最后一个容器
+    if (r->len && r->keys[r->len-1] <= key) {
+        lo = r->len-1;
+        if (r->keys[lo] < key) lo++;
+        *pos = lo;
+        return lo < r->len;
+    }
+    while (lo < hi) {
+        uint32_t mid = lo + ((hi-lo) >> 1);
+        if (r->keys[mid] < key)
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    *pos = lo;
+    return lo < r->len && r->keys[lo] == key;
+}
+
+/* Add the value. Return 1 if it was added, 0 if it was already there. */
+/*  往roaring位图中添加一个元素，添加成功返回1，元素已经存在返回0 */
+int roaringAdd(roaring *r, int64_t value) {
+    uint64_t key = roaringKey(value);
+    uint32_t pos;
+
+    if (!roaringFindKey(r,key,&pos)) {
+        // 不存在相应的容器，在pos位置插入一个新的array容器
+        if (r->len == r->cap) roaringReserve(r,r->cap < 4 ? 4 : r->cap*2);
+        memmove(r->keys+pos+1,r->keys+pos,sizeof(uint64_t)*(r->len-pos));
+        memmove(r->conts+pos+1,r->conts+pos,sizeof(roaringContainer)*(r->len-pos));
+        r->keys[pos] = key;
+        contInitArray(&r->conts[pos],4);
+        r->len++;
+    }
+    if (!contAdd(&r->conts[pos],roaringLow(value))) return 0;
+    r->card++;
+    roaringInvalidateRanks(r,pos);
+    return 1;
+}
+
+/* Remove the value. Return 1 if it was removed, 0 if it was not there. */
+/*  从roaring位图中删除一个元素，删除成功返回1，元素不存在返回0 */
+int roaringRemove(roaring *r, int64_t value) {
+    uint32_t pos;
+
+    if (!roaringFindKey(r,roaringKey(value),&pos) ||
+        !contRemove(&r->conts[pos],roaringLow(value))) return 0;
+    r->card--;
+    roaringInvalidateRanks(r,pos);
+    // 容器变为空，将其删除
+    if (r->conts[pos].card == 0) {
+        contFree(&r->conts[pos]);
+        memmove(r->keys+pos,r->keys+pos+1,sizeof(uint64_t)*(r->len-pos-1));
+        memmove(r->conts+pos,r->conts+pos+1,sizeof(roaringContainer)*(r->len-pos-1));
+        r->len--;
+    }
+    return 1;
+}
+
+/* Return 1 if the value is in the bitmap. */
+/*  判断roaring位图中是否包含指定的元素 */
+int roaringContains(roaring *r, int64_t value) {
+    uint32_t pos;
+
+    if (!roaringFindKey(r,roaringKey(value),&pos)) return 0;
+    return contContains(&r->conts[pos],roaringLow(value));
+}
+
+/* Return the number of values in the bitmap. */
+/*  返回roaring位图中保存的元素个数 */
+uint64_t roaringCard(roaring *r) {
+    return r->card;
+}
+
+/* Return the rank-th smallest value (starting from 0). The stale part of
+ * the rank index is rebuilt first, then the container holding the value is
+ * found with a binary search, so repeated calls on a bitmap that is not
+ * modified in between are O(log n). */
+/*  返回从小到大第rank个元素（从0开始）。先重新计算ranks中失效的部分，
+    然后二分查找该元素所在的容器。位图没有被修改时，每次调用的复杂度为O(log n) */
+int64_t roaringSelect(roaring *r, uint64_t rank) {
+    uint32_t lo = 0, hi = r->len, j;
+
+    if (r->len == 0) return 0;
+    if (r->ranks_valid == 0) r->ranks[r->ranks_valid++] = 0;
+    for (j = r->ranks_valid; j < r->len; j++)
+        r->ranks[j] = r->ranks[j-1] + r->conts[j-1].card;
+    r->ranks_valid = r->len;
+    // 查找最后一个ranks[j] <= rank的容器
+    while (hi-lo > 1) {
+        uint32_t mid = lo + ((hi-lo) >> 1);
+        if (r->ranks[mid] <= rank)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    rank -= r->ranks[lo];
+    if (rank >= r->conts[lo].card) return 0; /* Not reached when rank < card. */
+    return roaringValue(r->keys[lo],contSelect(&r->conts[lo],(uint32_t)rank));
+}
+
+/* Return a random value of a non empty bitmap. */
+/*  从非空的roaring位图中随机返回一个元素。redisLrand48()每次返回31位随机数，
+    元素个数超过2^31时拼接两次的结果 */
+int64_t roaringRandom(roaring *r) {
+    uint64_t rnd = (uint64_t)redisLrand48();
+
+    if (r->card > ((uint64_t)1 << 31))
+        rnd = (rnd << 31) | (uint64_t)redisLrand48();
+    return roaringSelect(r,rnd % r->card);
+}
+
+/* Return the memory used by the bitmap, in bytes. */
+/*  返回roaring位图占用的内存字节数 */
+size_t roaringBytes(roaring *r) {
+    size_t bytes = sizeof(roaring) + r->cap*(2*sizeof(uint64_t)+sizeof(roaringContainer));
+    uint32_t j;
+
+    for (j = 0; j < r->len; j++) bytes += contBytes(&r->conts[j]);
+    return bytes;
+}
+
+/* Position the iterator on the first value >= "value". Pass INT64_MIN to
+ * iterate the whole bitmap. */
+/*  初始化迭代器，使其指向第一个大于等于value的元素。value为INT64_MIN时遍历整个位图 */
+void roaringIterInit(roaringIterator *it, roaring *r, int64_t value) {
+    uint32_t pos;
+
+    it->r = r;
+    it->pos = 0;
+    if (roaringFindKey(r,roaringKey(value),&pos)) {
+        roaringContainer *c = &r->conts[pos];
+        uint16_t low = roaringLow(value);
+
+        it->pos = (c->type == ROARING_ARRAY) ?
+            arrayLowerBound(c->u.array,c->card,low) : low;
+    }
+    it->ci = pos;
+}
+
+/* Store the next value in *value and return 1, or return 0 at the end. */
+/*  将下一个元素保存在value中并返回1，迭代结束时返回0 */
+int roaringIterNext(roaringIterator *it, int64_t *value) {
+    roaring *r = it->r;
+
+    while (it->ci < r->len) {
+        roaringContainer *c = &r->conts[it->ci];
+
+        if (c->type == ROARING_ARRAY) {
+            if (it->pos < c->card) {
+                *value = roaringValue(r->keys[it->ci],c->u.array[it->pos]);
+                it->pos++;
+                return 1;
+            }
+        } else if (it->pos < 65536) {
+            uint32_t w = it->pos >> 6;
+            uint64_t word = c->u.words[w] & (~0ULL << (it->pos & 63));
+
+            while (!word && ++w < ROARING_BITMAP_WORDS) word = c->u.words[w];
+            if (word) {
+                uint32_t bit = w*64 + roaringCtz(word);
+                *value = roaringValue(r->keys[it->ci],bit);
+                it->pos = bit+1;
+                return 1;
+            }
+        }
+        it->ci++;
+        it->pos = 0;
+    }
+    return 0;
+}
+
+/* Append a container produced by a set operation, dropping empty ones. Keys
+ * are generated in increasing order so this never needs to shift. */
+/*  将集合运算产生的容器追加到r的末尾，空容器直接丢弃。运算按key从小到大产生容器，所以只需要追加 */
+static void roaringAppend(roaring *r, uint64_t key, roaringContainer *c) {
+    if (c->card == 0) {
+        contFree(c);
+        return;
+    }
+    if (r->len == r->cap) roaringReserve(r,r->cap < 4 ? 4 : r->cap*2);
+    r->keys[r->len] = key;
+    r->conts[r->len] = *c;
+    r->len++;
+    r->card += c->card;
+}
+
+/* Return a new bitmap with the values in both a and b. */
+/*  返回一个新的roaring位图，保存a和b的交集 */
+roaring *roaringAnd(roaring *a, roaring *b) {
+    roaring *r = roaringNew();
+    uint32_t i = 0, j = 0;
+
+    roaringReserve(r,a->len < b->len ? a->len : b->len);
+    while (i < a->len && j < b->len) {
+        if (a->keys[i] < b->keys[j]) {
+            i++;
+        } else if (a->keys[i] > b->keys[j]) {
+            j++;
+        } else {
+            roaringContainer c;
+            contAnd(&a->conts[i],&b->conts[j],&c);
+            roaringAppend(r,a->keys[i],&c);
+            i++;
+            j++;
+        }
+    }
+    return r;
+}
+
+/* Return a new bitmap with the values in a, b or both. */
+/*  返回一个新的roaring位图，保存a和b的并集 */
+roaring *roaringOr(roaring *a, roaring *b) {
+    roaring *r = roaringNew();
+    uint32_t i = 0, j = 0;
+
+    roaringReserve(r,a->len+b->len);
+    while (i < a->len || j < b->len) {
+        roaringContainer c;
+
+        if (j == b->len || (i < a->len && a->keys[i] < b->keys[j])) {
+            contCopy(&c,&a->conts[i]);
+            roaringAppend(r,a->keys[i++],&c);
+        } else if (i == a->len || a->keys[i] > b->keys[j]) {
+            contCopy(&c,&b->conts[j]);
+            roaringAppend(r,b->keys[j++],&c);
+        } else {
+            contOr(&a->conts[i],&b->conts[j],&c);
+            roaringAppend(r,a->keys[i],&c);
+            i++;
+            j++;
+        }
+    }
+    return r;
+}
+
+/* Return a new bitmap with the values of a that are not in b. */
+/*  返回一个新的roaring位图，保存a和b的差集a - b */
+roaring *roaringAndNot(roaring *a, roaring *b) {
+    roaring *r = roaringNew();
+    uint32_t i, j = 0;
+
+    roaringReserve(r,a->len);
+    for (i = 0; i < a->len; i++) {
+        roaringContainer c;
+
+        while (j < b->len && b->keys[j] < a->keys[i]) j++;
+        if (j < b->len && b->keys[j] == a->keys[i])
+            contAndNot(&a->conts[i],&b->conts[j],&c);
+        else
+            contCopy(&c,&a->conts[i]);
+        roaringAppend(r,a->keys[i],&c);
+    }
+    return r;
+}
+
+/* Build a bitmap with the elements of the intset. */
+/*  根据intset创建roaring位图，intset中的元素是有序的，所以总是追加到最后一个容器中 */
+roaring *roaringFromIntset(intset *is) {
+    roaring *r = roaringNew();
+    uint32_t j;
+    int64_t v;
+
+    for (j = 0; intsetGet(is,j,&v); j++) roaringAdd(r,v);
+    return r;
+}
+
+/* Build an intset with the elements of the bitmap. */
+/*  根据roaring位图创建intset */
+intset *roaringToIntset(roaring *r) {
+    intset *is = intsetNew();
+    roaringIterator it;
+    int64_t v;
+
+    roaringIterInit(&it,r,INT64_MIN);
+    while (roaringIterNext(&it,&v)) is = intsetAdd(is,v,NULL);
+    return is;
+}
+
+/* ------------------------------ Serialization ----------------------------
+ * All the integers are little endian:
+ *
+ * <len:4> then for every container <key:8> <card:4> <data>
+ *
+ * where data is "card" 16 bit values in increasing order when card is not
+ * greater than ROARING_ARRAY_MAX, or the 1024 64 bit words of the bitmap
+ * otherwise. The container type is implied by the cardinality, so it does
+ * not depend on the in-memory hysteresis.
+ * -------------------------------------------------------------------------- */
+/*  序列化格式，所有整数都使用小端模式：
+
+    <len:4> 然后对于每个容器：<key:8> <card:4> <data>
+
+    当card不超过ROARING_ARRAY_MAX时，data是从小到大排列的card个16位整数，否则data是位图的1024个64位字。
+    容器类型完全由card决定，与内存中容器实际使用的类型无关。 */
+
+#define ROARING_CONT_HDR 12
+
+static void roaringWriteLE(unsigned char *p, uint64_t v, int bytes) {
+    int j;
+    for (j = 0; j < bytes; j++) p[j] = (unsigned char)(v >> (8*j));
+}
+
+static uint64_t roaringReadLE(const unsigned char *p, int bytes) {
+    uint64_t v = 0;
+    int j;
+    for (j = 0; j < bytes; j++) v |= (uint64_t)p[j] << (8*j);
+    return v;
+}
+
+/* 返回一个容器序列化后data部分的字节数 */
+static size_t contSerializedSize(uint32_t card) {
+    return card <= ROARING_ARRAY_MAX ? 2*(size_t)card : 8*ROARING_BITMAP_WORDS;
+}
+
+/* Return the number of bytes roaringSerialize() will write. */
+/*  返回序列化后的字节数 */
+size_t roaringSerializedSize(roaring *r) {
+    size_t size = 4;
+    uint32_t j;
+
+    for (j = 0; j < r->len; j++)
+        size += ROARING_CONT_HDR + contSerializedSize(r->conts[j].card);
+    return size;
+}
+
+/* Serialize the bitmap into buf, return the number of bytes written. */
+/*  将roaring位图序列化到buf中，返回写入的字节数 */
+size_t roaringSerialize(roaring *r, unsigned char *buf) {
+    unsigned char *p = buf;
+    uint32_t j, k;
+
+    roaringWriteLE(p,r->len,4);
+    p += 4;
+    for (j = 0; j < r->len; j++) {
+        roaringContainer *c = &r->conts[j];
+
+        roaringWriteLE(p,r->keys[j],8);
+        roaringWriteLE(p+8,c->card,4);
+        p += ROARING_CONT_HDR;
+        if (c->card > ROARING_ARRAY_MAX) {
+            for (k = 0; k < ROARING_BITMAP_WORDS; k++, p += 8)
+                roaringWriteLE(p,c->u.words[k],8);
+        } else if (c->type == ROARING_ARRAY) {
+            for (k = 0; k < c->card; k++, p += 2)
+                roaringWriteLE(p,c->u.array[k],2);
+        } else {
+            // 元素个数不多的bitmap容器，按array容器的格式保存
+            for (k = 0; k < ROARING_BITMAP_WORDS; k++) {
+                uint64_t w = c->u.words[k];
+                while (w) {
+                    roaringWriteLE(p,k*64 + roaringCtz(w),2);
+                    p += 2;
+                    w &= w-1;
+                }
+            }
+        }
+    }
+    return p-buf;
+}
+
+/* Load a bitmap serialized with roaringSerialize(). Return NULL if the
+ * data is malformed: wrong length, keys not increasing, values not sorted
+ * or a cardinality that does not match the bitmap. */
+/*  载入roaringSerialize序列化的数据。如果数据不合法（长度不对、key不是递增的、
+    array中的元素不是有序的或者元素个数与位图不符）返回NULL。 */
+roaring *roaringDeserialize(const unsigned char *buf, size_t len) {
+    const unsigned char *p = buf, *end = buf+len;
+    roaring *r;
+    uint32_t nconts, j, k;
+
+    if (len < 4) return NULL;
+    nconts = (uint32_t)roaringReadLE(p,4);
+    p += 4;
+    // 每个容器至少占用ROARING_CONT_HDR+2个字节，先排除明显不合法的长度，避免分配过多的内存
+    if ((size_t)nconts > (len-4)/(ROARING_CONT_HDR+2)) return NULL;
+
+    r = roaringNew();
+    roaringReserve(r,nconts);
+    for (j = 0; j < nconts; j++) {
+        roaringContainer *c = &r->conts[j];
+        uint64_t key;
+        uint32_t card;
+
+        if ((size_t)(end-p) < ROARING_CONT_HDR) goto err;
+        key = roaringReadLE(p,8);
+        card = (uint32_t)roaringReadLE(p+8,4);
+        p += ROARING_CONT_HDR;
+        if (key >> 48 || (j && key <= r->keys[j-1])) goto err;
+        if (card == 0 || card > 65536) goto err;
+        if ((size_t)(end-p) < contSerializedSize(card)) goto err;
+
+        if (card <= ROARING_ARRAY_MAX) {
+            contInitArray(c,card);
+            for (k = 0; k < card; k++, p += 2) {
+                c->u.array[k] = (uint16_t)roaringReadLE(p,2);
+                if (k && c->u.array[k] <= c->u.array[k-1]) {
+                    contFree(c);
+                    goto err;
+                }
+            }
+        } else {
+            contInitBitmap(c);
+            for (k = 0; k < ROARING_BITMAP_WORDS; k++, p += 8)
+                c->u.words[k] = roaringReadLE(p,8);
+            if (bitmapCount(c->u.words) != card) {
+                contFree(c);
+                goto err;
+            }
+        }
+        c->card = card;
+        r->keys[j] = key;
+        r->len++;
+        r->card += card;
+    }
+    if (p != end) goto err;
+    return r;
+
+err:
+    roaringFree(r);
+    return NULL;
+}
+
+/* 下面是一些测试代码 */
+#ifdef ROARING_TEST_MAIN
+#include <sys/time.h>
+#include <assert.h>
+
+static long long usec(void) {
+    struct timeval tv;
+    gettimeofday(&tv,NULL);
+    return (((long long)tv.tv_sec)*1000000)+tv.tv_usec;
+}
+
+static void ok(void) {
+    printf("OK\n");
+}
+
+/* Check the bitmap against an intset holding the same values. */
+static void checkSame(roaring *r, intset *is) {
+    roaringIterator it;
+    uint32_t j = 0;
+    int64_t v, expected;
+    uint32_t c;
+
+    assert(roaringCard(r) == intsetLen(is));
+    roaringIterInit(&it,r,INT64_MIN);
+    while (roaringIterNext(&it,&v)) {
+        assert(intsetGet(is,j++,&expected));
+        assert(v == expected);
+    }
+    assert(j == intsetLen(is));
+    for (c = 0; c < r->len; c++) {
+        assert(r->conts[c].card > 0);
+        if (c) assert(r->keys[c] > r->keys[c-1]);
+        if (r->conts[c].type == ROARING_ARRAY)
+            assert(r->conts[c].card <= ROARING_ARRAY_MAX);
+        else
+            assert(r->conts[c].card == bitmapCount(r->conts[c].u.words));
+    }
+}
+
+/* Create a set of "size" random values in [offset, offset+range). */
+static roaring *createBitmap(int64_t offset, uint64_t range, int size) {
+    roaring *r = roaringNew();
+    while (size--) roaringAdd(r,offset+(int64_t)((((uint64_t)rand()<<31)^rand())%range));
+    return r;
+}
+
+int main(void) {
+    roaring *r;
+    intset *is;
+    int i;
+
+    srand(1234);
+
+    printf("Add, remove and lookup: "); {
+        int64_t values[] = {0, 1, -1, 65535, 65536, -65536, -65537,
+                            INT64_MIN, INT64_MAX, INT64_MIN+1, INT64_MAX-1};
+        int n = sizeof(values)/sizeof(values[0]);
+
+        r = roaringNew();
+        for (i = 0; i < n; i++) assert(roaringAdd(r,values[i]) == 1);
+        for (i = 0; i < n; i++) assert(roaringAdd(r,values[i]) == 0);
+        assert(roaringCard(r) == (uint64_t)n);
+        for (i = 0; i < n; i++) assert(roaringContains(r,values[i]));
+        assert(!roaringContains(r,2));
+        assert(!roaringContains(r,-2));
+        assert(roaringSelect(r,0) == INT64_MIN);
+        assert(roaringSelect(r,n-1) == INT64_MAX);
+        for (i = 0; i < n; i++) assert(roaringRemove(r,values[i]) == 1);
+        for (i = 0; i < n; i++) assert(roaringRemove(r,values[i]) == 0);
+        assert(roaringCard(r) == 0 && r->len == 0);
+        roaringFree(r);
+        ok();
+    }
+
+    printf("Random operations against an intset: "); {
+        r = roaringNew();
+        is = intsetNew();
+        for (i = 0; i < 200000; i++) {
+            int64_t v = (rand() % 400000) - 200000;
+            uint8_t added;
+            int removed;
+
+            if (rand() % 3) {
+                is = intsetAdd(is,v,&added);
+                assert(roaringAdd(r,v) == added);
+            } else {
+                is = intsetRemove(is,v,&removed);
+                assert(roaringRemove(r,v) == removed);
+            }
+        }
+        checkSame(r,is);
+        for (i = 0; i < 1000; i++) {
+            int64_t v = roaringRandom(r);
+            assert(intsetFind(is,v));
+        }
+        /* Select after updates that leave part of the rank index stale. */
+        for (i = 0; i < 2000; i++) {
+            int64_t v = (rand() % 400000) - 200000, expected;
+            uint8_t added;
+            int removed;
+            uint32_t rank;
+
+            if (i & 1) {
+                is = intsetAdd(is,v,&added);
+                roaringAdd(r,v);
+            } else {
+                is = intsetRemove(is,v,&removed);
+                roaringRemove(r,v);
+            }
+            rank = rand() % intsetLen(is);
+            assert(intsetGet(is,rank,&expected));
+            assert(roaringSelect(r,rank) == expected);
+        }
+        for (i = 0; i < (int)intsetLen(is); i++) {
+            int64_t expected;
+            assert(intsetGet(is,i,&expected));
+            assert(roaringSelect(r,i) == expected);
+        }
+        zfree(is);
+        roaringFree(r);
+        ok();
+    }
+
+    printf("Array and bitmap containers: "); {
+        r = roaringNew();
+        for (i = 0; i < ROARING_ARRAY_MAX; i++) roaringAdd(r,i*2);
+        assert(r->len == 1 && r->conts[0].type == ROARING_ARRAY);
+        roaringAdd(r,1);
+        assert(r->conts[0].type == ROARING_BITMAP);
+        assert(roaringSelect(r,1) == 1 && roaringSelect(r,2) == 2);
+        for (i = 0; i < ROARING_ARRAY_MAX-ROARING_BITMAP_MIN+1; i++)
+            roaringRemove(r,i*2);
+        assert(r->conts[0].type == ROARING_BITMAP);
+        roaringRemove(r,1);
+        assert(r->conts[0].type == ROARING_ARRAY);
+        assert(roaringCard(r) == ROARING_BITMAP_MIN-1);
+        roaringFree(r);
+        ok();
+    }
+
+    printf("Iterate from a value: "); {
+        roaringIterator it;
+        int64_t v;
+
+        r = roaringNew();
+        for (i = -100000; i < 100000; i += 7) roaringAdd(r,i);
+        /* The values are -100000+7k: ..., -5, 2, 9, ... */
+        roaringIterInit(&it,r,-4);
+        assert(roaringIterNext(&it,&v) && v == 2);
+        roaringIterInit(&it,r,2);
+        assert(roaringIterNext(&it,&v) && v == 2);
+        assert(roaringIterNext(&it,&v) && v == 9);
+        roaringIterInit(&it,r,100000);
+        assert(!roaringIterNext(&it,&v));
+        roaringFree(r);
+        ok();
+    }
+
+    printf("And, or, andnot against intset operations: "); {
+        struct { int64_t offset; uint64_t range; int size; } shapes[] = {
+            {0, 200, 50},                   /* one small array container */
+            {-300000, 600000, 5000},        /* sparse arrays */
+            {0, 300000, 150000},            /* dense bitmaps */
+            {1000000, 70000, 60000},        /* bitmaps crossing a key */
+        };
+        int x, y, n = sizeof(shapes)/sizeof(shapes[0]);
+
+        for (x = 0; x < n; x++) for (y = 0; y < n; y++) {
+            roaring *a = createBitmap(shapes[x].offset,shapes[x].range,shapes[x].size);
+            roaring *b = createBitmap(shapes[y].offset,shapes[y].range,shapes[y].size);
+            intset *ia = roaringToIntset(a), *ib = roaringToIntset(b);
+            roaring *res;
+            intset *expected;
+
+            res = roaringAnd(a,b);
+            expected = intsetIntersect(ia,ib);
+            checkSame(res,expected);
+            roaringFree(res);
+            zfree(expected);
+
+            res = roaringOr(a,b);
+            expected = intsetUnion(ia,ib);
+            checkSame(res,expected);
+            roaringFree(res);
+            zfree(expected);
+
+            res = roaringAndNot(a,b);
+            expected = intsetDifference(ia,ib);
+            checkSame(res,expected);
+            roaringFree(res);
+            zfree(expected);
+
+            roaringFree(a);
+            roaringFree(b);
+            zfree(ia);
+            zfree(ib);
+        }
+        ok();
+    }
+
+    printf("Serialization: "); {
+        roaring *copy;
+        unsigned char *buf;
+        size_t len;
+
+        r = createBitmap(-1000000,3000000,400000);
+        roaringAdd(r,INT64_MAX);
+        len = roaringSerializedSize(r);
+        buf = zmalloc(len);
+        assert(roaringSerialize(r,buf) == len);
+        copy = roaringDeserialize(buf,len);
+        assert(copy != NULL);
+        is = roaringToIntset(r);
+        checkSame(copy,is);
+        roaringFree(copy);
+
+        /* Truncated or trailing data. */
+        assert(roaringDeserialize(buf,len-1) == NULL);
+        assert(roaringDeserialize(buf,3) == NULL);
+        /* Wrong cardinality in the first container header. */
+        buf[4+8]++;
+        assert(roaringDeserialize(buf,len) == NULL);
+        buf[4+8]--;
+        /* Keys out of order. */
+        buf[4] = 0xff; buf[5] = 0xff;
+        assert(roaringDeserialize(buf,len) == NULL);
+        zfree(buf);
+        zfree(is);
+        roaringFree(r);
+        ok();
+    }
+
+    printf("Memory and speed with 1M members: "); {
+        roaring *a = createBitmap(0,10000000,1000000);
+        roaring *b = createBitmap(0,10000000,1000000);
+        roaring *res;
+        intset *ia, *ib, *ires;
+        long long start, rtime, itime;
+        int rounds = 20;
+
+        printf("\n  roaring: %.2f bytes per member (intset: %d)",
+            (double)roaringBytes(a)/roaringCard(a),
+            (int)(intsetBlobLen(roaringToIntset(a))/roaringCard(a)));
+
+        ia = roaringToIntset(a);
+        ib = roaringToIntset(b);
+        start = usec();
+        for (i = 0; i < rounds; i++) {
+            res = roaringAnd(a,b);
+            roaringFree(res);
+        }
+        rtime = usec()-start;
+        start = usec();
+        for (i = 0; i < rounds; i++) {
+            ires = intsetIntersect(ia,ib);
+            zfree(ires);
+        }
+        itime = usec()-start;
+        printf("\n  intersection: roaring %lldusec, intset %lldusec",
+            rtime/rounds,itime/rounds);
+
+        start = usec();
+        for (i = 0; i < rounds; i++) {
+            res = roaringOr(a,b);
+            roaringFree(res);
+        }
+        printf("\n  union: roaring %lldusec\n",(usec()-start)/rounds);
+        roaringFree(a);
+        roaringFree(b);
+        zfree(ia);
+        zfree(ib);
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,134 @@
+/* roaring.h - Compressed bitmaps for large integer sets
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __ROARING_H
+#define __ROARING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "intset.h"
+
+/*  roaring是一种压缩位图，用来保存元素个数超过set_max_intset_entries的整数集合。
+    64位整数按高48位分组，每组对应一个容器，容器中只保存低16位：
+    元素不超过4096个时使用有序的uint16_t数组（array容器），否则使用65536位的位图（bitmap容器）。
+    这样每个元素最多占用2个字节，稠密的ID集合每个元素只占用1bit多一点，
+    而两个集合的交、并、差运算在bitmap容器上可以按64位的字逐个计算。 */
+
+/* 容器类型 */
+#define ROARING_ARRAY 1     // 有序的uint16_t数组
+#define ROARING_BITMAP 2    // 65536位的位图
+
+/* array容器最多保存的元素个数，超过后转换为bitmap容器 */
+#define ROARING_ARRAY_MAX 4096
+/* bitmap容器包含的64位字的个数 */
+#define ROARING_BITMAP_WORDS 1024
+
+/* 容器，保存一组高48位相同的整数的低16位 */
+typedef struct roaringContainer {
+    // 容器类型，ROARING_ARRAY或ROARING_BITMAP
+    uint8_t type;
+    // 容器中的元素个数，取值范围为1~65536
+    uint32_t card;
+    // array容器的容量，bitmap容器不使用该字段
+    uint32_t cap;
+    union {
+        uint16_t *array;
+        uint64_t *words;
+    } u;
+} roaringContainer;
+
+/* roaring位图 */
+typedef struct roaring {
+    // 容器的个数
+    uint32_t len;
+    // keys和conts数组的容量
+    uint32_t cap;
+    // 所有容器中的元素总数
+    uint64_t card;
+    // 每个容器对应的高48位，按从小到大的顺序排列
+    uint64_t *keys;
+    // 容器数组，与keys一一对应
+    roaringContainer *conts;
+    // ranks[j]是前j个容器的元素总数，用于二分查找第rank个元素；只有前ranks_valid项是有效的
+    uint64_t *ranks;
+    uint32_t ranks_valid;
+} roaring;
+
+/* roaring迭代器，按从小到大的顺序返回元素 */
+typedef struct roaringIterator {
+    roaring *r;
+    // 当前所在的容器
+    uint32_t ci;
+    // 当前容器中的下一个位置：array容器为数组下标，bitmap容器为位的编号
+    uint32_t pos;
+} roaringIterator;
+
+/* 创建一个空的roaring位图 */
+roaring *roaringNew(void);
+/* 释放roaring位图 */
+void roaringFree(roaring *r);
+/* 复制一个roaring位图 */
+roaring *roaringDup(roaring *r);
+/* 添加一个元素，添加成功返回1，元素已经存在返回0 */
+int roaringAdd(roaring *r, int64_t value);
+/* 删除一个元素，删除成功返回1，元素不存在返回0 */
+int roaringRemove(roaring *r, int64_t value);
+/* 判断元素是否存在 */
+int roaringContains(roaring *r, int64_t value);
+/* 返回元素个数 */
+uint64_t roaringCard(roaring *r);
+/* 返回从小到大第rank个元素（从0开始） */
+int64_t roaringSelect(roaring *r, uint64_t rank);
+/* 随机返回一个元素，r不能为空 */
+int64_t roaringRandom(roaring *r);
+/* 返回roaring位图占用的内存字节数 */
+size_t roaringBytes(roaring *r);
+/* 初始化迭代器，从第一个大于等于value的元素开始迭代 */
+void roaringIterInit(roaringIterator *it, roaring *r, int64_t value);
+/* 获取下一个元素，没有更多元素时返回0 */
+int roaringIterNext(roaringIterator *it, int64_t *value);
+/* 返回一个新的roaring位图，保存a和b的交集 */
+roaring *roaringAnd(roaring *a, roaring *b);
+/* 返回一个新的roaring位图，保存a和b的并集 */
+roaring *roaringOr(roaring *a, roaring *b);
+/* 返回一个新的roaring位图，保存a和b的差集a - b */
+roaring *roaringAndNot(roaring *a, roaring *b);
+/* 根据intset创建roaring位图 */
+roaring *roaringFromIntset(intset *is);
+/* 根据roaring位图创建intset */
+intset *roaringToIntset(roaring *r);
+/* 返回序列化后的字节数 */
+size_t roaringSerializedSize(roaring *r);
+/* 序列化到buf中，buf的大小至少为roaringSerializedSize(r)，返回写入的字节数 */
+size_t roaringSerialize(roaring *r, unsigned char *buf);
+/* 反序列化，数据不合法时返回NULL */
+roaring *roaringDeserialize(const unsigned char *buf, size_t len);
+
+#endif
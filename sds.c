@@ -33,9 +33,82 @@
 #include <string.h>
 #include <ctype.h>
 #include <assert.h>
+#include <limits.h>
 #include "sds.h"
 #include "zmalloc.h"
 
+/* 根据头部类型返回头部的大小 */
+static inline int sdsHdrSize(char type) {
+    switch(type&SDS_TYPE_MASK) {
+        case SDS_TYPE_5:
+            return sizeof(struct sdshdr5);
+        case SDS_TYPE_8:
+            return sizeof(struct sdshdr8);
+        case SDS_TYPE_16:
+            return sizeof(struct sdshdr16);
+        case SDS_TYPE_32:
+            return sizeof(struct sdshdr32);
+        case SDS_TYPE_64:
+            return sizeof(struct sdshdr64);
+    }
+    return 0;
+}
+
+/* 返回能够保存长度为string_size的字符串的最小头部类型 */
+static inline char sdsReqType(size_t string_size) {
+    if (string_size < 1<<5)
+        return SDS_TYPE_5;
+    if (string_size < 1<<8)
+        return SDS_TYPE_8;
+    if (string_size < 1<<16)
+        return SDS_TYPE_16;
+#if (LONG_MAX == LLONG_MAX)
+    if (string_size < 1ll<<32)
+        return SDS_TYPE_32;
+    return SDS_TYPE_64;
+#else
+    return SDS_TYPE_32;
+#endif
+}
+
+/* 返回头部类型type能够记录的最大容量 */
+static inline size_t sdsTypeMaxSize(char type) {
+    if (type == SDS_TYPE_5)
+        return (1<<5) - 1;
+    if (type == SDS_TYPE_8)
+        return (1<<8) - 1;
+    if (type == SDS_TYPE_16)
+        return (1<<16) - 1;
+#if (LONG_MAX == LLONG_MAX)
+    if (type == SDS_TYPE_32)
+        return (1ll<<32) - 1;
+#endif
+    return -1; /* this is equal to the max SDS_TYPE_64 or SDS_TYPE_32 */
+}
+
+/* Return the capacity of the string whose header of type 'type' starts at
+ * 'sh', allocated asking for 'size' bytes: the allocator rounds every
+ * request up to one of its size classes, so when its usable size is known
+ * the whole allocation is reported as free space instead of being wasted.
+ * Without HAVE_MALLOC_SIZE zmalloc_size() also counts the size prefix, so
+ * only the requested size can be used. */
+/*  返回头部类型为type、起始地址为sh、申请大小为size的字符串的容量：分配器会把每次申请的大小向上取整到某个尺寸等级，
+    如果能获得可用空间的大小，就将整个可用空间都作为字符串的容量，而不是白白浪费掉。
+    没有定义HAVE_MALLOC_SIZE时zmalloc_size的结果包含了记录大小的前缀，因此只能使用申请的大小。 */
+static inline size_t sdsUsableAlloc(void *sh, char type, size_t size) {
+    size_t usable, max = sdsTypeMaxSize(type);
+
+#ifdef HAVE_MALLOC_SIZE
+    ((void) size);
+    usable = zmalloc_size(sh);
+#else
+    ((void) sh);
+    usable = size;
+#endif
+    usable -= sdsHdrSize(type)+1;
+    return usable > max ? max : usable;
+}
+
 /* Create a new sds string with the content specified by the 'init' pointer
  * and 'initlen'.
  * If NULL is used for 'init' the string is initialized with zero bytes.
@@ -50,26 +123,65 @@
  * \0 characters in the middle, as the length is stored in the sds header. */
  /* 根据给定字符串和长度创建一个字符串结构 */
 sds sdsnewlen(const void *init, size_t initlen) {
-    struct sdshdr *sh;
+    void *sh;
+    sds s;
+    // 根据字符串的长度选择头部类型
+    char type = sdsReqType(initlen);
+    /* Empty strings are usually created in order to append. Use type 8
+     * since type 5 is not good at this. */
+    // 空字符串通常是为了后续的追加操作而创建的，SDS_TYPE_5不适合追加，因此使用SDS_TYPE_8
+    if (type == SDS_TYPE_5 && initlen == 0) type = SDS_TYPE_8;
+    int hdrlen = sdsHdrSize(type);
+    unsigned char *fp; /* flags pointer. */
 
-    // 注意下面调用的是两个不同的空间分配函数（以后我们再分析）
     // +1是因为字符串需要额外一个位置存放结束符‘\0’
     if (init) {
-        sh = zmalloc(sizeof(struct sdshdr)+initlen+1);
+        sh = zmalloc(hdrlen+initlen+1);
     } else {
-        sh = zcalloc(sizeof(struct sdshdr)+initlen+1);
+        sh = zcalloc(hdrlen+initlen+1);
     }
     // 分配失败直接返回
     if (sh == NULL) return NULL;
-    // 设置长度和可用空间
-    sh->len = initlen;
-    sh->free = 0;
+    s = (char*)sh+hdrlen;
+    fp = ((unsigned char*)s)-1;
+    // 设置头部类型、长度和容量，容量为分配器实际给出的可用空间
+    switch(type) {
+        case SDS_TYPE_5: {
+            *fp = type | (initlen << SDS_TYPE_BITS);
+            break;
+        }
+        case SDS_TYPE_8: {
+            SDS_HDR_VAR(8,s);
+            sh->len = initlen;
+            *fp = type;
+            break;
+        }
+        case SDS_TYPE_16: {
+            SDS_HDR_VAR(16,s);
+            sh->len = initlen;
+            *fp = type;
+            break;
+        }
+        case SDS_TYPE_32: {
+            SDS_HDR_VAR(32,s);
+            sh->len = initlen;
+            *fp = type;
+            break;
+        }
+        case SDS_TYPE_64: {
+            SDS_HDR_VAR(64,s);
+            sh->len = initlen;
+            *fp = type;
+            break;
+        }
+    }
+    sdssetalloc(s,sdsUsableAlloc(sh,type,hdrlen+initlen+1));
     // 如果提供了字符串的初始值则复制一份
     if (initlen && init)
-        memcpy(sh->buf, init, initlen);
-    sh->buf[initlen] = '\0';
-    // 注意返回值，返回的是sdshdr结构的buf[]
-    return (char*)sh->buf;
+        memcpy(s, init, initlen);
+    s[initlen] = '\0';
+    // 注意返回值，返回的是头部之后的buf[]
+    return s;
 }
 
 /* Create an empty (zero length) sds string. Even in this case the string
@@ -97,7 +209,7 @@ sds sdsdup(const sds s) {
 /* 释放sds的内存空间 */
 void sdsfree(sds s) {
     if (s == NULL) return;
-    zfree(s-sizeof(struct sdshdr));
+    zfree((char*)s-sdsHdrSize(s[-1]));
 }
 
 /* Set the sds string length to the length as obtained with strlen(), so
@@ -121,10 +233,8 @@ void sdsfree(sds s) {
     这是就需要调用sdsupdatelen(s)更新字符串长度，底层是使用strlen计算字符串长度
  */
 void sdsupdatelen(sds s) {
-    struct sdshdr *sh = (void*) (s-(sizeof(struct sdshdr)));
-    int reallen = strlen(s);
-    sh->free += (sh->len-reallen);
-    sh->len = reallen;
+    size_t reallen = strlen(s);
+    sdssetlen(s, reallen);
 }
 
 /* Modify an sds string in-place to make it empty (zero length).
@@ -133,11 +243,9 @@ void sdsupdatelen(sds s) {
  * number of bytes previously available. */
  /* 清空字符串 */
 void sdsclear(sds s) {
-    struct sdshdr *sh = (void*) (s-(sizeof(struct sdshdr)));
-    // 重置可空空间、当前长度
-    sh->free += sh->len;
-    sh->len = 0;
-    sh->buf[0] = '\0';
+    // 重置当前长度，原有空间全部变为可用空间
+    sdssetlen(s, 0);
+    s[0] = '\0';
 }
 
 /* Enlarge the free space at the end of the sds string so that the caller
@@ -148,27 +256,54 @@ void sdsclear(sds s) {
  * by sdslen(), but only the free buffer space we have. */
  /* 确保sds中的可用空间大于或等于addlen，如果当前字符串可用空间不满足则重新配置空间 */
 sds sdsMakeRoomFor(sds s, size_t addlen) {
-    struct sdshdr *sh, *newsh;
-    size_t free = sdsavail(s);
+    void *sh, *newsh;
+    size_t avail = sdsavail(s);
     size_t len, newlen;
+    char type, oldtype = s[-1] & SDS_TYPE_MASK;
+    int hdrlen;
 
+    /* Return ASAP if there is enough space left. */
     // 当前空间满足要求，直接返回
-    if (free >= addlen) return s;
+    if (avail >= addlen) return s;
+
     len = sdslen(s);
-    sh = (void*) (s-(sizeof(struct sdshdr)));
+    sh = (char*)s-sdsHdrSize(oldtype);
     // 重新分配空间时并不是分配刚刚好满足需求的空间，而是以其2倍的数量进行分配。这点类似于STL中的vector
     newlen = (len+addlen);
     if (newlen < SDS_MAX_PREALLOC)
         newlen *= 2;
     else
         newlen += SDS_MAX_PREALLOC;
-    // 调用zrealloc直接在原地进行扩展
-    newsh = zrealloc(sh, sizeof(struct sdshdr)+newlen+1);
-    if (newsh == NULL) return NULL;
 
-    // 更新可用空间
-    newsh->free = newlen - len;
-    return newsh->buf;
+    type = sdsReqType(newlen);
+
+    /* Don't use type 5: the user is appending to the string and type 5 is
+     * not able to remember empty space, so sdsMakeRoomFor() must be called
+     * at every appending operation. */
+    // SDS_TYPE_5无法记录可用空间，不适合追加操作
+    if (type == SDS_TYPE_5) type = SDS_TYPE_8;
+
+    hdrlen = sdsHdrSize(type);
+    if (oldtype == type) {
+        // 头部类型不变，调用zrealloc直接在原地进行扩展
+        newsh = zrealloc(sh, hdrlen+newlen+1);
+        if (newsh == NULL) return NULL;
+        s = (char*)newsh+hdrlen;
+    } else {
+        /* Since the header size changes, need to move the string forward,
+         * and can't use realloc */
+        // 头部大小发生了变化，需要将字符串向前移动，不能使用realloc
+        newsh = zmalloc(hdrlen+newlen+1);
+        if (newsh == NULL) return NULL;
+        memcpy((char*)newsh+hdrlen, s, len+1);
+        zfree(sh);
+        s = (char*)newsh+hdrlen;
+        s[-1] = type;
+        sdssetlen(s, len);
+    }
+    // 容量取分配器实际给出的可用空间
+    sdssetalloc(s, sdsUsableAlloc(newsh,type,hdrlen+newlen+1));
+    return s;
 }
 
 /* Reallocate the sds string so that it has no free space at the end. The
@@ -179,14 +314,41 @@ sds sdsMakeRoomFor(sds s, size_t addlen) {
  * references must be substituted with the new pointer returned by the call. */
  /* 释放字符数组buf中的多余空间，使其刚好能存放当前字符数 */
 sds sdsRemoveFreeSpace(sds s) {
-    struct sdshdr *sh;
-
-    sh = (void*) (s-(sizeof(struct sdshdr)));
-    // 重新分配空间，使其刚好能存放当前的字符数量（sizeof(struct sdshdr)+sh->len+1）
-    sh = zrealloc(sh, sizeof(struct sdshdr)+sh->len+1);
+    void *sh, *newsh;
+    char type, oldtype = s[-1] & SDS_TYPE_MASK;
+    int hdrlen, oldhdrlen = sdsHdrSize(oldtype);
+    size_t len = sdslen(s);
+    sh = (char*)s-oldhdrlen;
+
+    // 没有可用空间，直接返回
+    if (sdsavail(s) == 0) return s;
+
+    /* Check what would be the minimum SDS header that is just good enough to
+     * fit this string. */
+    type = sdsReqType(len);
+    hdrlen = sdsHdrSize(type);
+
+    /* If the type is the same, or at least a large enough type is still
+     * required, we just realloc(), letting the allocator to do the copy
+     * only if really needed. Otherwise if the change is huge, we manually
+     * reallocate the string to use the different header type. */
+    // 头部类型不变，或者仍然需要较大的头部，直接调用zrealloc；否则换用更小的头部
+    if (oldtype == type || type > SDS_TYPE_8) {
+        newsh = zrealloc(sh, oldhdrlen+len+1);
+        if (newsh == NULL) return NULL;
+        s = (char*)newsh+oldhdrlen;
+    } else {
+        newsh = zmalloc(hdrlen+len+1);
+        if (newsh == NULL) return NULL;
+        memcpy((char*)newsh+hdrlen, s, len+1);
+        zfree(sh);
+        s = (char*)newsh+hdrlen;
+        s[-1] = type;
+        sdssetlen(s, len);
+    }
     // 重新分配后当前可用空间为0
-    sh->free = 0;
-    return sh->buf;
+    sdssetalloc(s, len);
+    return s;
 }
 
 /* Return the total size of the allocation of the specifed sds string,
@@ -198,9 +360,15 @@ sds sdsRemoveFreeSpace(sds s) {
  */
 /* 获取sds实际分配的空间大小（包括最后的'\0'结束符） */
 size_t sdsAllocSize(sds s) {
-    struct sdshdr *sh = (void*) (s-(sizeof(struct sdshdr)));
+    size_t alloc = sdsalloc(s);
+    return sdsHdrSize(s[-1])+alloc+1;
+}
 
-    return sizeof(*sh)+sh->len+sh->free+1;
+/* Return the pointer of the actual SDS allocation (normally SDS strings
+ * are referenced by the start of the string buffer). */
+/* 返回sds实际分配的内存块的地址（通常sds指向的是字符数组的起始位置） */
+void *sdsAllocPtr(const sds s) {
+    return (void*) (s-sdsHdrSize(s[-1]));
 }
 
 /* Increment the sds length and decrements the left free space at the
@@ -235,18 +403,47 @@ size_t sdsAllocSize(sds s) {
         sdsIncrLen(s, nread);
  */
 void sdsIncrLen(sds s, int incr) {
-    struct sdshdr *sh = (void*) (s-(sizeof(struct sdshdr)));
+    unsigned char flags = s[-1];
+    size_t len;
 
-    // 判断参数incr是否合法，如果不合法说明数据已经发生错误
-    if (incr >= 0)
-        assert(sh->free >= (unsigned int)incr);
-    else
-        assert(sh->len >= (unsigned int)(-incr));
-    // 当前长度增加incr
-    sh->len += incr;
-    // 可用空间减少incr
-    sh->free -= incr;
-    s[sh->len] = '\0';
+    // 判断参数incr是否合法，如果不合法说明数据已经发生错误，然后更新当前长度
+    switch(flags&SDS_TYPE_MASK) {
+        case SDS_TYPE_5: {
+            unsigned char *fp = ((unsigned char*)s)-1;
+            unsigned char oldlen = SDS_TYPE_5_LEN(flags);
+            assert((incr > 0 && oldlen+incr < 32) || (incr < 0 && oldlen >= (unsigned int)(-incr)));
+            *fp = SDS_TYPE_5 | ((oldlen+incr) << SDS_TYPE_BITS);
+            len = oldlen+incr;
+            break;
+        }
+        case SDS_TYPE_8: {
+            SDS_HDR_VAR(8,s);
+            assert((incr >= 0 && sh->alloc-sh->len >= incr) || (incr < 0 && sh->len >= (unsigned int)(-incr)));
+            len = (sh->len += incr);
+            break;
+        }
+        case SDS_TYPE_16: {
+            SDS_HDR_VAR(16,s);
+            assert((incr >= 0 && sh->alloc-sh->len >= incr) || (incr < 0 && sh->len >= (unsigned int)(-incr)));
+            len = (sh->len += incr);
+            break;
+        }
+        case SDS_TYPE_32: {
+            SDS_HDR_VAR(32,s);
+            assert((incr >= 0 && sh->alloc-sh->len >= (unsigned int)incr) || (incr < 0 && sh->len >= (unsigned int)(-incr)));
+            len = (sh->len += incr);
+            break;
+        }
+        case SDS_TYPE_64: {
+            SDS_HDR_VAR(64,s);
+            assert((incr >= 0 && sh->alloc-sh->len >= (uint64_t)incr) || (incr < 0 && sh->len >= (uint64_t)(-incr)));
+            len = (sh->len += incr);
+            break;
+        }
+        default: len = 0; /* Just to avoid compilation warnings. */
+    }
+    // 设置'\0'结束符
+    s[len] = '\0';
 }
 
 /* Grow the sds to have the specified length. Bytes that were not part of
@@ -256,8 +453,7 @@ void sdsIncrLen(sds s, int incr) {
  * is performed. */
  /* 扩展字符串到指定的长度 */
 sds sdsgrowzero(sds s, size_t len) {
-    struct sdshdr *sh = (void*)(s-(sizeof(struct sdshdr)));
-    size_t totlen, curlen = sh->len;
+    size_t curlen = sdslen(s);
 
     // 如果指定长度小于sds的当前长度，则不执行任何操作
     if (len <= curlen) return s;
@@ -268,12 +464,9 @@ sds sdsgrowzero(sds s, size_t len) {
 
     /* Make sure added region doesn't contain garbage */
     // 将新增加的元素全部赋值为0，防止无效字符干扰
-    sh = (void*)(s-(sizeof(struct sdshdr)));
     memset(s+curlen,0,(len-curlen+1)); /* also set trailing \0 byte */
-    // 更新当前长度和可用空间
-    totlen = sh->len+sh->free;
-    sh->len = len;
-    sh->free = totlen-sh->len;
+    // 更新当前长度
+    sdssetlen(s, len);
     return s;
 }
 
@@ -284,18 +477,15 @@ sds sdsgrowzero(sds s, size_t len) {
  * references must be substituted with the new pointer returned by the call. */
  /* 将长度为len的字符串t连接到sds尾部 */
 sds sdscatlen(sds s, const void *t, size_t len) {
-    struct sdshdr *sh;
     size_t curlen = sdslen(s);
 
     // 确保sds有足够的剩余空间放置字符串t
     s = sdsMakeRoomFor(s,len);
     if (s == NULL) return NULL;
-    sh = (void*) (s-(sizeof(struct sdshdr)));
     // 将字符串t拷贝到sds尾部
     memcpy(s+curlen, t, len);
-    // 更新当前长度和可用长度
-    sh->len = curlen+len;
-    sh->free = sh->free-len;
+    // 更新当前长度
+    sdssetlen(s, curlen+len);
     // 设置'\0'结束符
     s[curlen+len] = '\0';
     return s;
@@ -323,23 +513,16 @@ sds sdscatsds(sds s, const sds t) {
  * safe string pointed by 't' of length 'len' bytes. */
 /* 将一个长度为len的字符串复制到sds中 */
 sds sdscpylen(sds s, const char *t, size_t len) {
-    struct sdshdr *sh = (void*) (s-(sizeof(struct sdshdr)));
-    size_t totlen = sh->free+sh->len; // 字符数组实际长度
-
-    // 判断当前字符数组的长度能否容纳给定的字符串t，如果不能则需要配置额外空间
-    if (totlen < len) {
-        // 配置额外空间
-        s = sdsMakeRoomFor(s,len-sh->len);
+    // 判断当前字符数组的容量能否容纳给定的字符串t，如果不能则需要配置额外空间
+    if (sdsalloc(s) < len) {
+        s = sdsMakeRoomFor(s,len-sdslen(s));
         if (s == NULL) return NULL;
-        sh = (void*) (s-(sizeof(struct sdshdr)));
-        totlen = sh->free+sh->len;
     }
     // 字符串复制
     memcpy(s, t, len);
-    // 更新当前长度和可用长度
+    // 更新当前长度
     s[len] = '\0';
-    sh->len = len;
-    sh->free = totlen-len;
+    sdssetlen(s, len);
     return s;
 }
 
@@ -528,7 +711,6 @@ sds sdscatprintf(sds s, const char *fmt, ...) {
  */
  /* 格式化输入 */
 sds sdscatfmt(sds s, char const *fmt, ...) {
-    struct sdshdr *sh = (void*) (s-(sizeof(struct sdshdr)));
     size_t initlen = sdslen(s);
     const char *f = fmt;
     int i;
@@ -549,9 +731,8 @@ sds sdscatfmt(sds s, char const *fmt, ...) {
 
         /* Make sure there is always space for at least 1 char. */
         // 确保至少有一个位置的可用空间
-        if (sh->free == 0) {
+        if (sdsavail(s) == 0) {
             s = sdsMakeRoomFor(s,1);
-            sh = (void*) (s-(sizeof(struct sdshdr)));
         }
 
         switch(*f) {
@@ -563,13 +744,11 @@ sds sdscatfmt(sds s, char const *fmt, ...) {
             case 'S':
                 str = va_arg(ap,char*);
                 l = (next == 's') ? strlen(str) : sdslen(str);
-                if (sh->free < l) {
+                if (sdsavail(s) < l) {
                     s = sdsMakeRoomFor(s,l);
-                    sh = (void*) (s-(sizeof(struct sdshdr)));
                 }
                 memcpy(s+i,str,l);
-                sh->len += l;
-                sh->free -= l;
+                sdsinclen(s,l);
                 i += l;
                 break;
             case 'i':
@@ -581,13 +760,11 @@ sds sdscatfmt(sds s, char const *fmt, ...) {
                 {
                     char buf[SDS_LLSTR_SIZE];
                     l = sdsll2str(buf,num);
-                    if (sh->free < l) {
+                    if (sdsavail(s) < l) {
                         s = sdsMakeRoomFor(s,l);
-                        sh = (void*) (s-(sizeof(struct sdshdr)));
                     }
                     memcpy(s+i,buf,l);
-                    sh->len += l;
-                    sh->free -= l;
+                    sdsinclen(s,l);
                     i += l;
                 }
                 break;
@@ -600,27 +777,23 @@ sds sdscatfmt(sds s, char const *fmt, ...) {
                 {
                     char buf[SDS_LLSTR_SIZE];
                     l = sdsull2str(buf,unum);
-                    if (sh->free < l) {
+                    if (sdsavail(s) < l) {
                         s = sdsMakeRoomFor(s,l);
-                        sh = (void*) (s-(sizeof(struct sdshdr)));
                     }
                     memcpy(s+i,buf,l);
-                    sh->len += l;
-                    sh->free -= l;
+                    sdsinclen(s,l);
                     i += l;
                 }
                 break;
             default: /* Handle %% and generally %<unknown>. */
                 s[i++] = next;
-                sh->len += 1;
-                sh->free -= 1;
+                sdsinclen(s,1);
                 break;
             }
             break;
         default:
             s[i++] = *f;
-            sh->len += 1;
-            sh->free -= 1;
+            sdsinclen(s,1);
             break;
         }
         f++;
@@ -648,7 +821,6 @@ sds sdscatfmt(sds s, char const *fmt, ...) {
  */
  /* 字符串的trim操作，即将字符串头部和尾部出现的特定字符删除，类似java.lang.String的trim方法 */
 sds sdstrim(sds s, const char *cset) {
-    struct sdshdr *sh = (void*) (s-(sizeof(struct sdshdr)));
     char *start, *end, *sp, *ep;
     size_t len;
 
@@ -661,11 +833,10 @@ sds sdstrim(sds s, const char *cset) {
     // 剩余字符的长度
     len = (sp > ep) ? 0 : ((ep-sp)+1);
     // 子串移动
-    if (sh->buf != sp) memmove(sh->buf, sp, len);
-    // 更新当前长度和可用空间
-    sh->buf[len] = '\0';
-    sh->free = sh->free+(sh->len-len);
-    sh->len = len;
+    if (s != sp) memmove(s, sp, len);
+    // 更新当前长度
+    s[len] = '\0';
+    sdssetlen(s,len);
     return s;
 }
 
@@ -687,7 +858,6 @@ sds sdstrim(sds s, const char *cset) {
  */
  /* 根据参数start和参数end指定的范围截取字符串 */
 void sdsrange(sds s, int start, int end) {
-    struct sdshdr *sh = (void*) (s-(sizeof(struct sdshdr)));
     size_t newlen, len = sdslen(s);
 
     if (len == 0) return;
@@ -714,11 +884,10 @@ void sdsrange(sds s, int start, int end) {
         start = 0;
     }
     // 移动子串
-    if (start && newlen) memmove(sh->buf, sh->buf+start, newlen);
-    // 重置字符串长度和可用空间
-    sh->buf[newlen] = 0;
-    sh->free = sh->free+(sh->len-newlen);
-    sh->len = newlen;
+    if (start && newlen) memmove(s, s+start, newlen);
+    // 重置字符串长度
+    s[newlen] = 0;
+    sdssetlen(s,newlen);
 }
 
 /* Apply tolower() to every character of the sds string 's'. */
@@ -1107,7 +1276,6 @@ sds sdsjoin(char **argv, int argc, char *sep) {
 
 int main(void) {
     {
-        struct sdshdr *sh;
         sds x = sdsnew("foo"), y;
 
         test_cond("Create a string and obtain the length",
@@ -1218,25 +1386,69 @@ int main(void) {
             memcmp(y,"\"\\a\\n\\x00foo\\r\"",15) == 0)
 
         {
-            int oldfree;
+            unsigned int oldfree;
+            char *p;
+            int step = 10, j, i;
 
             sdsfree(x);
             sdsfree(y);
             x = sdsnew("0");
-            sh = (void*) (x-(sizeof(struct sdshdr)));
-            test_cond("sdsnew() free/len buffers", sh->len == 1 && sh->free == 0);
-            x = sdsMakeRoomFor(x,1);
-            sh = (void*) (x-(sizeof(struct sdshdr)));
-            test_cond("sdsMakeRoomFor()", sh->len == 1 && sh->free > 0);
-            oldfree = sh->free;
-            x[1] = '1';
-            sdsIncrLen(x,1);
-            test_cond("sdsIncrLen() -- content", x[0] == '0' && x[1] == '1');
-            test_cond("sdsIncrLen() -- len", sh->len == 2);
-            test_cond("sdsIncrLen() -- free", sh->free == oldfree-1);
-
+            test_cond("sdsnew() free/len buffers", sdslen(x) == 1 && sdsavail(x) == 0);
+
+            /* Run the test a few times in order to hit the first two
+             * SDS header types. */
+            for (i = 0; i < 10; i++) {
+                int oldlen = sdslen(x);
+                x = sdsMakeRoomFor(x,step);
+                int type = x[-1]&SDS_TYPE_MASK;
+
+                test_cond("sdsMakeRoomFor() len", sdslen(x) == oldlen);
+                if (type != SDS_TYPE_5) {
+                    test_cond("sdsMakeRoomFor() free", sdsavail(x) >= step);
+                    oldfree = sdsavail(x);
+                }
+                p = x+oldlen;
+                for (j = 0; j < step; j++) {
+                    p[j] = 'A'+j;
+                }
+                sdsIncrLen(x,step);
+                if (type != SDS_TYPE_5)
+                    test_cond("sdsIncrLen() -- free", sdsavail(x) == oldfree-step);
+            }
+            test_cond("sdsMakeRoomFor() content",
+                memcmp("0ABCDEFGHIJ",x,11) == 0 &&
+                memcmp("ABCDEFGHIJ",x+91,10) == 0);
+            test_cond("sdsMakeRoomFor() final length",sdslen(x)==101);
+
+#ifdef HAVE_MALLOC_SIZE
+            test_cond("sdsAllocSize() matches the allocator usable size",
+                sdsAllocSize(x) == zmalloc_size(sdsAllocPtr(x)));
+#endif
             sdsfree(x);
         }
+
+        {
+            sds hdr;
+
+            hdr = sdsnew("foo");
+            test_cond("Short strings use the sdshdr5 header",
+                (hdr[-1]&SDS_TYPE_MASK) == SDS_TYPE_5 && sdslen(hdr) == 3);
+            hdr = sdscat(hdr,"bar");
+            test_cond("Appending moves to a header with free space",
+                (hdr[-1]&SDS_TYPE_MASK) == SDS_TYPE_8 &&
+                sdslen(hdr) == 6 && memcmp(hdr,"foobar\0",7) == 0);
+            hdr = sdsgrowzero(hdr,70000);
+            test_cond("Growing past 64k moves to sdshdr32",
+                (hdr[-1]&SDS_TYPE_MASK) == SDS_TYPE_32 &&
+                sdslen(hdr) == 70000 && hdr[69999] == 0 &&
+                memcmp(hdr,"foobar",6) == 0);
+            sdsrange(hdr,0,2);
+            hdr = sdsRemoveFreeSpace(hdr);
+            test_cond("sdsRemoveFreeSpace() shrinks the header",
+                (hdr[-1]&SDS_TYPE_MASK) == SDS_TYPE_5 &&
+                sdslen(hdr) == 3 && memcmp(hdr,"foo\0",4) == 0);
+            sdsfree(hdr);
+        }
     }
     test_report()
     return 0;
@@ -36,38 +36,208 @@
 
 #include <sys/types.h>
 #include <stdarg.h>
+#include <stdint.h>
 
 /* 为char *类型定义别名为sds */
 typedef char *sds;
 
-/* 字符串结构体（字符串就是字符数组） */
-struct sdshdr {
-	// 字符串当前长度
-    unsigned int len;
-    // 剩余可用长度
-    unsigned int free;
+/* The header of a sds string comes in five types, from sdshdr5 to sdshdr64,
+ * according to the number of bits needed to store the length and the
+ * allocated size: short strings, like most command arguments and keys, pay
+ * just 3 bytes of header instead of 8. The byte right before the buffer is
+ * always the flags byte: the 3 low bits are the type, so the header can be
+ * found from the sds pointer alone.
+ *
+ * Note: sdshdr5 is never used to hold free space, its length is stored in
+ * the 5 high bits of the flags byte.
+ *
+ *  sds的头部有五种类型，从sdshdr5到sdshdr64，根据保存长度和分配空间所需的位数选择：
+ *  大多数命令参数和key这样的短字符串只需要3个字节的头部，而不是原来的8个字节。
+ *  紧挨着字符数组buf之前的一个字节总是flags，其低3位表示头部的类型，因此根据sds指针就可以找到头部。
+ *  注意：sdshdr5不保存可用空间，其长度保存在flags的高5位中。 */
+struct __attribute__ ((__packed__)) sdshdr5 {
+    unsigned char flags; /* 3 lsb of type, and 5 msb of string length */
+    char buf[];
+};
+struct __attribute__ ((__packed__)) sdshdr8 {
+    // 字符串当前长度
+    uint8_t len; /* used */
+    // 字符数组的容量，不包括头部和'\0'结束符
+    uint8_t alloc; /* excluding the header and null terminator */
+    // 低3位为头部类型，其余各位为标志位
+    unsigned char flags; /* 3 lsb of type, 5 unused bits */
     // 字符数组（具体存放字符串的地方）
     char buf[];
 };
+struct __attribute__ ((__packed__)) sdshdr16 {
+    uint16_t len; /* used */
+    uint16_t alloc; /* excluding the header and null terminator */
+    unsigned char flags; /* 3 lsb of type, 5 unused bits */
+    char buf[];
+};
+struct __attribute__ ((__packed__)) sdshdr32 {
+    uint32_t len; /* used */
+    uint32_t alloc; /* excluding the header and null terminator */
+    unsigned char flags; /* 3 lsb of type, 5 unused bits */
+    char buf[];
+};
+struct __attribute__ ((__packed__)) sdshdr64 {
+    uint64_t len; /* used */
+    uint64_t alloc; /* excluding the header and null terminator */
+    unsigned char flags; /* 3 lsb of type, 5 unused bits */
+    char buf[];
+};
 
-/*	下面两个是static函数，仅在本文件可见 */
+/* 头部类型 */
+#define SDS_TYPE_5  0
+#define SDS_TYPE_8  1
+#define SDS_TYPE_16 2
+#define SDS_TYPE_32 3
+#define SDS_TYPE_64 4
+#define SDS_TYPE_MASK 7
+#define SDS_TYPE_BITS 3
+#define SDS_HDR_VAR(T,s) struct sdshdr##T *sh = (void*)((s)-(sizeof(struct sdshdr##T)));
+#define SDS_HDR(T,s) ((struct sdshdr##T *)((s)-(sizeof(struct sdshdr##T))))
+#define SDS_TYPE_5_LEN(f) ((f)>>SDS_TYPE_BITS)
+
+/*	下面几个是static函数，仅在本文件可见 */
 
 /* 获取字符串长度 */
 static inline size_t sdslen(const sds s) {
-	//	sizeof(struct sdshdr)的值为8
-	/*	这里为什么用s-(sizeof(struct sdshdr))就得到sdshdr *指针？
-		从后面我们可以看到sds指向sdshdr结构的buf[]字符数组，所以
-		s-(sizeof(struct sdshdr))就是sdshdr结构的地址。
-	*/
-    struct sdshdr *sh = (void*)(s-(sizeof(struct sdshdr)));
-    return sh->len;
+    unsigned char flags = s[-1];
+    // 根据flags中的类型找到头部
+    switch(flags&SDS_TYPE_MASK) {
+        case SDS_TYPE_5:
+            return SDS_TYPE_5_LEN(flags);
+        case SDS_TYPE_8:
+            return SDS_HDR(8,s)->len;
+        case SDS_TYPE_16:
+            return SDS_HDR(16,s)->len;
+        case SDS_TYPE_32:
+            return SDS_HDR(32,s)->len;
+        case SDS_TYPE_64:
+            return SDS_HDR(64,s)->len;
+    }
+    return 0;
 }
 
 /* 获取字符数组中的可用空间 */
 static inline size_t sdsavail(const sds s) {
-	//	sizeof(struct sdshdr)的值为8
-    struct sdshdr *sh = (void*)(s-(sizeof(struct sdshdr)));
-    return sh->free;
+    unsigned char flags = s[-1];
+    switch(flags&SDS_TYPE_MASK) {
+        case SDS_TYPE_5: {
+            return 0;
+        }
+        case SDS_TYPE_8: {
+            SDS_HDR_VAR(8,s);
+            return sh->alloc - sh->len;
+        }
+        case SDS_TYPE_16: {
+            SDS_HDR_VAR(16,s);
+            return sh->alloc - sh->len;
+        }
+        case SDS_TYPE_32: {
+            SDS_HDR_VAR(32,s);
+            return sh->alloc - sh->len;
+        }
+        case SDS_TYPE_64: {
+            SDS_HDR_VAR(64,s);
+            return sh->alloc - sh->len;
+        }
+    }
+    return 0;
+}
+
+/* 设置字符串长度，调用者保证不超过容量 */
+static inline void sdssetlen(sds s, size_t newlen) {
+    unsigned char flags = s[-1];
+    switch(flags&SDS_TYPE_MASK) {
+        case SDS_TYPE_5:
+            {
+                unsigned char *fp = ((unsigned char*)s)-1;
+                *fp = SDS_TYPE_5 | (newlen << SDS_TYPE_BITS);
+            }
+            break;
+        case SDS_TYPE_8:
+            SDS_HDR(8,s)->len = newlen;
+            break;
+        case SDS_TYPE_16:
+            SDS_HDR(16,s)->len = newlen;
+            break;
+        case SDS_TYPE_32:
+            SDS_HDR(32,s)->len = newlen;
+            break;
+        case SDS_TYPE_64:
+            SDS_HDR(64,s)->len = newlen;
+            break;
+    }
+}
+
+/* 字符串长度增加inc，调用者保证不超过容量 */
+static inline void sdsinclen(sds s, size_t inc) {
+    unsigned char flags = s[-1];
+    switch(flags&SDS_TYPE_MASK) {
+        case SDS_TYPE_5:
+            {
+                unsigned char *fp = ((unsigned char*)s)-1;
+                unsigned char newlen = SDS_TYPE_5_LEN(flags)+inc;
+                *fp = SDS_TYPE_5 | (newlen << SDS_TYPE_BITS);
+            }
+            break;
+        case SDS_TYPE_8:
+            SDS_HDR(8,s)->len += inc;
+            break;
+        case SDS_TYPE_16:
+            SDS_HDR(16,s)->len += inc;
+            break;
+        case SDS_TYPE_32:
+            SDS_HDR(32,s)->len += inc;
+            break;
+        case SDS_TYPE_64:
+            SDS_HDR(64,s)->len += inc;
+            break;
+    }
+}
+
+/* sdsalloc() = sdsavail() + sdslen() */
+/* 获取字符数组的容量 */
+static inline size_t sdsalloc(const sds s) {
+    unsigned char flags = s[-1];
+    switch(flags&SDS_TYPE_MASK) {
+        case SDS_TYPE_5:
+            return SDS_TYPE_5_LEN(flags);
+        case SDS_TYPE_8:
+            return SDS_HDR(8,s)->alloc;
+        case SDS_TYPE_16:
+            return SDS_HDR(16,s)->alloc;
+        case SDS_TYPE_32:
+            return SDS_HDR(32,s)->alloc;
+        case SDS_TYPE_64:
+            return SDS_HDR(64,s)->alloc;
+    }
+    return 0;
+}
+
+/* 设置字符数组的容量，SDS_TYPE_5没有容量字段 */
+static inline void sdssetalloc(sds s, size_t newlen) {
+    unsigned char flags = s[-1];
+    switch(flags&SDS_TYPE_MASK) {
+        case SDS_TYPE_5:
+            /* Nothing to do, this type has no total allocation info. */
+            break;
+        case SDS_TYPE_8:
+            SDS_HDR(8,s)->alloc = newlen;
+            break;
+        case SDS_TYPE_16:
+            SDS_HDR(16,s)->alloc = newlen;
+            break;
+        case SDS_TYPE_32:
+            SDS_HDR(32,s)->alloc = newlen;
+            break;
+        case SDS_TYPE_64:
+            SDS_HDR(64,s)->alloc = newlen;
+            break;
+    }
 }
 
 /* 下面是字符串的操作函数，从其实现上看sds指向sdshdr结构的buf[]字符数组。所以
@@ -157,5 +327,7 @@ void sdsIncrLen(sds s, int incr);
 sds sdsRemoveFreeSpace(sds s);
 /* 获取sds实际分配的空间大小（包括最后的'\0'结束符） */
 size_t sdsAllocSize(sds s);
+/* 获取sds头部的起始地址，即实际分配的内存块的地址 */
+void *sdsAllocPtr(const sds s);
 
 #endif
@@ -34,18 +34,109 @@
  * Hash type API    Hash数据类型的操作接口
  *----------------------------------------------------------------------------*/
 
-/* Hash数据类型有两种编码方式：REDIS_ENCODING_ZIPLIST和REDIS_ENCODING_HT，在下面的注释中我们分别称之为ziplist编码和dict编码。 */
+/* Hash数据类型有两种编码方式：REDIS_ENCODING_LISTPACK和REDIS_ENCODING_HT，在下面的注释中我们分别称之为listpack编码和dict编码。 */
+
+/*  另外还有第三种编码REDIS_ENCODING_LISTPACK_EX（下面称之为hashpack编码，见hashpack.c），此时o->ptr指向一个hashpack结构。
+    当listpack编码的hash的域个数超过hash_max_ziplist_entries，但不超过hash_max_listpack_ex_entries时，转换为hashpack编码，
+    仍然紧凑地保存在listpack中，但查找一个域只需要O(1)。只有hashpack编码支持为单个域设置过期时间（HEXPIRE等命令），
+    因此设置了域过期时间的hash会一直保持hashpack编码，不会再转换为dict编码。
+    为了不让这样的hash无限增长，会使其超过hash_max_listpack_ex_entries或hash_max_ziplist_value限制的写操作
+    都会返回错误，见hashTypeCheckExpiresLimits。 */
+
+/* Return true if the hash has fields with a TTL, so it must stay a hashpack. */
+/* 判断hash对象中是否有设置了过期时间的域，这样的hash必须保持hashpack编码 */
+int hashTypeHasFieldExpires(robj *o) {
+    return o->encoding == REDIS_ENCODING_LISTPACK_EX &&
+           ((hashpack*)o->ptr)->min_expire != 0;
+}
+
+/* Convert a listpack or hashpack encoded hash that outgrew its limits: a plain
+ * listpack becomes a hashpack while the hash is small enough, everything else
+ * becomes a real hash table, unless a field TTL forces the hashpack encoding.
+ * Writes that would take such a hash past the limits are refused before
+ * getting here, see hashTypeCheckExpiresLimits(): only a hash loaded with a
+ * larger limit can be over them. */
+/*  当listpack编码或hashpack编码的hash超出限制时调用，参数long_value表示是因为插入了过长的字符串。
+    listpack编码的hash如果域个数不超过hash_max_listpack_ex_entries，转换为hashpack编码，其余情况转换为dict编码。
+    设置了域过期时间的hash保持hashpack编码，会使其超过限制的写操作已经被hashTypeCheckExpiresLimits拒绝，
+    只有以更大的限制载入的hash才可能超过限制。 */
+void hashTypeGrow(robj *o, int long_value) {
+    unsigned long len = hashTypeLength(o);
+
+    if (hashTypeHasFieldExpires(o)) return;
+    if (!long_value && server.hash_max_listpack_ex_entries &&
+        len <= server.hash_max_listpack_ex_entries)
+    {
+        if (o->encoding == REDIS_ENCODING_LISTPACK)
+            hashTypeConvert(o, REDIS_ENCODING_LISTPACK_EX);
+        return;
+    }
+    hashTypeConvert(o, REDIS_ENCODING_HT);
+}
+
+/* A hash with field TTLs can't be converted to a hash table, so a write that
+ * would make it outgrow hash_max_listpack_ex_entries or
+ * hash_max_ziplist_value is refused: argv[start..end] are the field/value
+ * pairs about to be set. Like checkType() returns 1 after replying with an
+ * error when the write must not happen, 0 otherwise. */
+/*  设置了域过期时间的hash不能转换为dict编码，因此如果一个写操作会让它超过hash_max_listpack_ex_entries
+    或hash_max_ziplist_value的限制，就拒绝这个操作。argv[start..end]为将要设置的域、值对。
+    和checkType一样，需要拒绝时回复错误并返回1，否则返回0。 */
+static int hashTypeCheckExpiresLimits(redisClient *c, robj *o, robj **argv,
+                                      int start, int end)
+{
+    unsigned long added = 0;
+    int i;
+
+    if (!hashTypeHasFieldExpires(o)) return 0;
+    for (i = start; i <= end; i++) {
+        if (sdsEncodedObject(argv[i]) &&
+            sdslen(argv[i]->ptr) > server.hash_max_ziplist_value)
+        {
+            addReplyError(c,"value too large for a hash with field expires, see hash-max-ziplist-value");
+            return 1;
+        }
+        // 统计新增的域的个数（重复出现的新域会被多算，只会让限制更保守）
+        if ((i-start) % 2 == 0 && !hashTypeExists(o,argv[i])) added++;
+    }
+    if (hashTypeLength(o)+added > server.hash_max_listpack_ex_entries) {
+        addReplyError(c,"too many fields for a hash with field expires, see hash-max-listpack-ex-entries");
+        return 1;
+    }
+    return 0;
+}
+
+/* Return true if a field or a value of the hash table encoded hash 'o' is
+ * longer than hash_max_ziplist_value. */
+/* 判断dict编码的hash对象o中是否有长度超过hash_max_ziplist_value的域或值 */
+static int hashTypeHasLongStrings(robj *o) {
+    dictIterator *di = dictGetIterator(o->ptr);
+    dictEntry *de;
+    int found = 0;
+
+    while (!found && (de = dictNext(di)) != NULL) {
+        robj *field = dictGetKey(de), *value = dictGetVal(de);
+
+        found = (sdsEncodedObject(field) &&
+                 sdslen(field->ptr) > server.hash_max_ziplist_value) ||
+                (sdsEncodedObject(value) &&
+                 sdslen(value->ptr) > server.hash_max_ziplist_value);
+    }
+    dictReleaseIterator(di);
+    return found;
+}
 
 /* Check the length of a number of objects to see if we need to convert a
- * ziplist to a real hash. Note that we only check string encoded objects
+ * listpack to a real hash. Note that we only check string encoded objects
  * as their string length can be queried in constant time. */
-/*  检查argv数组中每个字符串的长度，看看是否需要将Hash类型对象o从ziplist编码转换为指针的dict编码。
+/*  检查argv数组中每个字符串的长度，看看是否需要将Hash类型对象o从listpack编码转换为指针的dict编码。
     注意这里我们只检查REDIS_ENCODING_RAW编码的字符串对象，因为它们的长度可以在常数时间内获取到。*/
 void hashTypeTryConversion(robj *o, robj **argv, int start, int end) {
     int i;
 
-    // 如果不是ziplist编码，直接返回
-    if (o->encoding != REDIS_ENCODING_ZIPLIST) return;
+    // 如果不是listpack编码或hashpack编码，直接返回
+    if (o->encoding != REDIS_ENCODING_LISTPACK &&
+        o->encoding != REDIS_ENCODING_LISTPACK_EX) return;
 
     // 检查所有输入对象的长度，看看它们的字符串长度是否超过了指定值
     for (i = start; i <= end; i++) {
@@ -53,8 +144,8 @@ void hashTypeTryConversion(robj *o, robj **argv, int start, int end) {
         if (argv[i]->encoding == REDIS_ENCODING_RAW &&
             sdslen(argv[i]->ptr) > server.hash_max_ziplist_value)
         {
-            // 将ziplist装换为dict存储
-            hashTypeConvert(o, REDIS_ENCODING_HT);
+            // 将listpack装换为dict存储（设置了域过期时间的hashpack除外）
+            hashTypeGrow(o, 1);
             break;
         }
     }
@@ -71,12 +162,12 @@ void hashTypeTryObjectEncoding(robj *subject, robj **o1, robj **o2) {
     }
 }
 
-/* Get the value from a ziplist encoded hash, identified by field.
+/* Get the value from a listpack encoded hash, identified by field.
  * Returns -1 when the field cannot be found. */
-/*  从ziplist编码hashType类型对象中取出key对应的value值。
-    ziplist中相邻的两个节点被当做一个键值对，如果value域是字符串则保存在参数vstr中，如果是整数，则保存在参数vll中。
-    如果ziplist不存在这样的key节点，函数返回-1，否则返回0。 */
-int hashTypeGetFromZiplist(robj *o, robj *field,
+/*  从listpack编码（或hashpack编码）hashType类型对象中取出key对应的value值。
+    listpack中相邻的两个节点被当做一个键值对，如果value域是字符串则保存在参数vstr中，如果是整数，则保存在参数vll中。
+    如果listpack不存在这样的key节点，函数返回-1，否则返回0。 */
+int hashTypeGetFromListpack(robj *o, robj *field,
                            unsigned char **vstr,
                            unsigned int *vlen,
                            long long *vll)
@@ -84,21 +175,29 @@ int hashTypeGetFromZiplist(robj *o, robj *field,
     unsigned char *zl, *fptr = NULL, *vptr = NULL;
     int ret;
 
-    redisAssert(o->encoding == REDIS_ENCODING_ZIPLIST);
+    redisAssert(o->encoding == REDIS_ENCODING_LISTPACK ||
+                o->encoding == REDIS_ENCODING_LISTPACK_EX);
 
     // 对输入的key值进行解析
     field = getDecodedObject(field);
 
     zl = o->ptr;
-    // 获取第一个节点的首地址
-    fptr = ziplistIndex(zl, ZIPLIST_HEAD);
+    if (o->encoding == REDIS_ENCODING_LISTPACK_EX) {
+        // hashpack编码：通过索引直接定位域节点
+        fptr = hpFind(o->ptr, field->ptr, sdslen(field->ptr));
+        if (fptr != NULL) vptr = hpValue(o->ptr, fptr);
+        fptr = NULL;
+    } else {
+        // 获取第一个节点的首地址
+        fptr = lpIndex(zl, 0);
+    }
     if (fptr != NULL) {
-        // 调用ziplist的ziplistFind在ziplis中查找是否存在值为field->ptr的节点，也就是查找key节点
-        fptr = ziplistFind(fptr, field->ptr, sdslen(field->ptr), 1);
+        // 调用listpack的lpFind在listpack中查找是否存在值为field->ptr的节点，也就是查找key节点
+        fptr = lpFind(fptr, field->ptr, sdslen(field->ptr), 1);
         if (fptr != NULL) {
             /* Grab pointer to the value (fptr points to the field) */
             // 将相邻的两个节点看做是键值对，找到key节点则下一个节点就是value节点
-            vptr = ziplistNext(zl, fptr);
+            vptr = lpNext(zl, fptr);
             redisAssert(vptr != NULL);
         }
     }
@@ -107,7 +206,7 @@ int hashTypeGetFromZiplist(robj *o, robj *field,
 
     if (vptr != NULL) {
         // 获取value值
-        ret = ziplistGet(vptr, vstr, vlen, vll);
+        ret = lpGet(vptr, vstr, vlen, vll);
         redisAssert(ret);
         return 0;
     }
@@ -117,7 +216,7 @@ int hashTypeGetFromZiplist(robj *o, robj *field,
 
 /* Get the value from a hash table encoded hash, identified by field.
  * Returns -1 when the field cannot be found. */
-/*  从ziplist编码hashType类型对象中取出key对应的value值，该key由参数field指定。
+/*  从listpack编码hashType类型对象中取出key对应的value值，该key由参数field指定。
     如果操作成功，函数返回0，否则返回-1，表示对应的key不存在。 */
 int hashTypeGetFromHashTable(robj *o, robj *field, robj **value) {
     dictEntry *de;
@@ -139,21 +238,22 @@ int hashTypeGetFromHashTable(robj *o, robj *field, robj **value) {
  *
  * The lower level function can prevent copy on write so it is
  * the preferred way of doing read operations. */
-/*  该函数是hashTypeGetFromZiplist和hashTypeGetFromHashTable的高层封装函数，
+/*  该函数是hashTypeGetFromListpack和hashTypeGetFromHashTable的高层封装函数，
     总是返回一个redisObject类型的值对象。
     这是执行读操作的首选方式。*/
 robj *hashTypeGetObject(robj *o, robj *field) {
     robj *value = NULL;
 
-    // 处理ziplist编码的情况
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-        // 从ziplist中查找
+    // 处理listpack编码和hashpack编码的情况
+    if (o->encoding == REDIS_ENCODING_LISTPACK ||
+        o->encoding == REDIS_ENCODING_LISTPACK_EX) {
+        // 从listpack中查找
         unsigned char *vstr = NULL;
         unsigned int vlen = UINT_MAX;
         long long vll = LLONG_MAX;
 
-        if (hashTypeGetFromZiplist(o, field, &vstr, &vlen, &vll) == 0) {
-            // ziplist节点中存储的数据有字符串和整型之分
+        if (hashTypeGetFromListpack(o, field, &vstr, &vlen, &vll) == 0) {
+            // listpack节点中存储的数据有字符串和整型之分
             if (vstr) {
                 value = createStringObject((char*)vstr, vlen);
             } else {
@@ -182,13 +282,14 @@ robj *hashTypeGetObject(robj *o, robj *field) {
  * exists, and 0 when it doesn't. */
 /* 判断hashType类型中某个给定的key是否存在，如果存在返回1，否则返回0 */
 int hashTypeExists(robj *o, robj *field) {
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (o->encoding == REDIS_ENCODING_LISTPACK ||
+        o->encoding == REDIS_ENCODING_LISTPACK_EX) {
         unsigned char *vstr = NULL;
         unsigned int vlen = UINT_MAX;
         long long vll = LLONG_MAX;
 
-        // 调用hashTypeGetFromZiplist函数在ziplist查找指定key值
-        if (hashTypeGetFromZiplist(o, field, &vstr, &vlen, &vll) == 0) return 1;
+        // 调用hashTypeGetFromListpack函数在listpack查找指定key值
+        if (hashTypeGetFromListpack(o, field, &vstr, &vlen, &vll) == 0) return 1;
     } else if (o->encoding == REDIS_ENCODING_HT) {
         robj *aux;
 
@@ -210,8 +311,8 @@ int hashTypeExists(robj *o, robj *field) {
 int hashTypeSet(robj *o, robj *field, robj *value) {
     int update = 0;
 
-    // 处理ziplist编码的情况
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    // 处理listpack编码的情况
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl, *fptr, *vptr;
 
         // 解码操作
@@ -219,45 +320,57 @@ int hashTypeSet(robj *o, robj *field, robj *value) {
         value = getDecodedObject(value);
 
         zl = o->ptr;
-        // 获取ziplist第一个节点的首地址
-        fptr = ziplistIndex(zl, ZIPLIST_HEAD);
+        // 获取listpack第一个节点的首地址
+        fptr = lpIndex(zl, 0);
         if (fptr != NULL) {
-            // 如果ziplist不为空，则尝试查找指定key值的一个节点
-            fptr = ziplistFind(fptr, field->ptr, sdslen(field->ptr), 1);
+            // 如果listpack不为空，则尝试查找指定key值的一个节点
+            fptr = lpFind(fptr, field->ptr, sdslen(field->ptr), 1);
             if (fptr != NULL) {
                 /* Grab pointer to the value (fptr points to the field) */
-                // Redis将ziplist中相邻的两个节点当做一个键值对，fptr所指向节点的下一个节点就是value节点
-                vptr = ziplistNext(zl, fptr);
+                // Redis将listpack中相邻的两个节点当做一个键值对，fptr所指向节点的下一个节点就是value节点
+                vptr = lpNext(zl, fptr);
                 redisAssert(vptr != NULL);
                 update = 1;
 
                 /* Delete value */
                 // 将旧的value节点删除
-                zl = ziplistDelete(zl, &vptr);
+                zl = lpDelete(zl, &vptr);
 
                 /* Insert new value */
                 // 在原位置插入一个新的value节点
-                zl = ziplistInsert(zl, vptr, value->ptr, sdslen(value->ptr));
+                zl = lpInsert(zl, vptr, value->ptr, sdslen(value->ptr));
             }
         }
 
-        // 如果ziplist为空或者不存在指定key值得节点，则在其尾部插入两个节点，分别保存key值和value值
+        // 如果listpack为空或者不存在指定key值得节点，则在其尾部插入两个节点，分别保存key值和value值
         if (!update) {
-            /* Push new field/value pair onto the tail of the ziplist */
-            zl = ziplistPush(zl, field->ptr, sdslen(field->ptr), ZIPLIST_TAIL);
-            zl = ziplistPush(zl, value->ptr, sdslen(value->ptr), ZIPLIST_TAIL);
+            /* Push new field/value pair onto the tail of the listpack */
+            zl = lpPush(zl, field->ptr, sdslen(field->ptr), LP_TAIL);
+            zl = lpPush(zl, value->ptr, sdslen(value->ptr), LP_TAIL);
         }
-        // ziplist的添加或删除会引起内存的重新分配，这里需要更新ptr指针
+        // listpack的添加或删除会引起内存的重新分配，这里需要更新ptr指针
         o->ptr = zl;
         decrRefCount(field);
         decrRefCount(value);
 
-        /* Check if the ziplist needs to be converted to a hash table */
-        // 如果ziplist保存的键值对数量超过指定值，则将其转换为dict存储
+        /* Check if the listpack needs to be converted to a hash table */
+        // 如果listpack保存的键值对数量超过指定值，则将其转换为hashpack或dict存储
         // server.hash_max_ziplist_entries配置在redis.conf中，初始值为512
         if (hashTypeLength(o) > server.hash_max_ziplist_entries)
-            hashTypeConvert(o, REDIS_ENCODING_HT);
-    } 
+            hashTypeGrow(o, 0);
+    }
+    // 处理hashpack编码的情况，设置新值的同时会清除该域的过期时间
+    else if (o->encoding == REDIS_ENCODING_LISTPACK_EX) {
+        field = getDecodedObject(field);
+        value = getDecodedObject(value);
+        update = hpSet(o->ptr, field->ptr, sdslen(field->ptr),
+                       value->ptr, sdslen(value->ptr));
+        decrRefCount(field);
+        decrRefCount(value);
+
+        if (hashTypeLength(o) > server.hash_max_listpack_ex_entries)
+            hashTypeGrow(o, 0);
+    }
     // 处理dict编码的情况
     else if (o->encoding == REDIS_ENCODING_HT) {
 
@@ -280,23 +393,23 @@ int hashTypeSet(robj *o, robj *field, robj *value) {
 int hashTypeDelete(robj *o, robj *field) {
     int deleted = 0;
 
-    // 处理ziplist编码的情况
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    // 处理listpack编码的情况
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
 
         unsigned char *zl, *fptr;
 
         field = getDecodedObject(field);
 
         zl = o->ptr;
-        // 获取ziplist第一个节点的首地址
-        fptr = ziplistIndex(zl, ZIPLIST_HEAD);
+        // 获取listpack第一个节点的首地址
+        fptr = lpIndex(zl, 0);
         if (fptr != NULL) {
-            // 在ziplist中查找指定key值得节点
-            fptr = ziplistFind(fptr, field->ptr, sdslen(field->ptr), 1);
+            // 在listpack中查找指定key值得节点
+            fptr = lpFind(fptr, field->ptr, sdslen(field->ptr), 1);
             if (fptr != NULL) {
                 // 如果找到目标节点，则连续删除该节点和下一个节点（相邻的两个节点看做一个键值对）
-                zl = ziplistDelete(zl,&fptr);
-                zl = ziplistDelete(zl,&fptr);
+                zl = lpDelete(zl,&fptr);
+                zl = lpDelete(zl,&fptr);
                 o->ptr = zl;
                 // 设置删除成功标识
                 deleted = 1;
@@ -305,7 +418,13 @@ int hashTypeDelete(robj *o, robj *field) {
 
         decrRefCount(field);
 
-    } 
+    }
+    // 处理hashpack编码的情况
+    else if (o->encoding == REDIS_ENCODING_LISTPACK_EX) {
+        field = getDecodedObject(field);
+        deleted = hpDelete(o->ptr, field->ptr, sdslen(field->ptr));
+        decrRefCount(field);
+    }
     // 处理dict编码的情况
     else if (o->encoding == REDIS_ENCODING_HT) {
         // dict类型定义了专门的函数处理删除操作，直接调用
@@ -329,9 +448,11 @@ int hashTypeDelete(robj *o, robj *field) {
 unsigned long hashTypeLength(robj *o) {
     unsigned long length = ULONG_MAX;
 
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-        // ziplist中两个相邻的节点作为一个键值对，因此需要除以2
-        length = ziplistLen(o->ptr) / 2;
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
+        // listpack中两个相邻的节点作为一个键值对，因此需要除以2
+        length = lpLen(o->ptr) / 2;
+    } else if (o->encoding == REDIS_ENCODING_LISTPACK_EX) {
+        length = hpLength(o->ptr);
     } else if (o->encoding == REDIS_ENCODING_HT) {
         // 直接调用dict的专属函数返回其键值对数量
         length = dictSize((dict*)o->ptr);
@@ -350,8 +471,9 @@ hashTypeIterator *hashTypeInitIterator(robj *subject) {
     hi->subject = subject;
     hi->encoding = subject->encoding;
 
-    // 处理ziplist编码的情况
-    if (hi->encoding == REDIS_ENCODING_ZIPLIST) {
+    // 处理listpack编码和hashpack编码的情况
+    if (hi->encoding == REDIS_ENCODING_LISTPACK ||
+        hi->encoding == REDIS_ENCODING_LISTPACK_EX) {
         hi->fptr = NULL;
         hi->vptr = NULL;
     } 
@@ -377,13 +499,13 @@ void hashTypeReleaseIterator(hashTypeIterator *hi) {
 
 /* Move to the next entry in the hash. Return REDIS_OK when the next entry
  * could be found and REDIS_ERR when the iterator reaches the end. */
-/*  通过迭代器获取下一个元素，迭代器有ziplist和dict两种，通过encoding字段区别。如果操作成功返回REDIS_OK
+/*  通过迭代器获取下一个元素，迭代器有listpack和dict两种，通过encoding字段区别。如果操作成功返回REDIS_OK
     否则返回REDIS_ERR。 */
 int hashTypeNext(hashTypeIterator *hi) {
-    // 处理ziplist编码的情况
-    if (hi->encoding == REDIS_ENCODING_ZIPLIST) {
-        /*  下面这段代码实现了一个简单的ziplist迭代器操作，具体是这样的：第一次调用hashTypeNext时迭代器的fptr指向
-            ziplist第一个节点的指针（相当于key），而vptr指向下一个节点（相当于value）。下次调用hashTypeNext函数，
+    // 处理listpack编码的情况
+    if (hi->encoding == REDIS_ENCODING_LISTPACK) {
+        /*  下面这段代码实现了一个简单的listpack迭代器操作，具体是这样的：第一次调用hashTypeNext时迭代器的fptr指向
+            listpack第一个节点的指针（相当于key），而vptr指向下一个节点（相当于value）。下次调用hashTypeNext函数，
             fptr指向vptr的下一个节点（相当于key），而vptr又更新为指向fptr的下一个节点（相当于value）。这样每次调用
             hashTypeNext函数，迭代器的fptr和vptr都指向两个相邻的节点，相当于一个key-value对。
         */
@@ -398,24 +520,34 @@ int hashTypeNext(hashTypeIterator *hi) {
             /* Initialize cursor */
             redisAssert(vptr == NULL);
             // 获得第一个节点的首地址
-            fptr = ziplistIndex(zl, 0);
+            fptr = lpIndex(zl, 0);
         } else {
             /* Advance cursor */
             redisAssert(vptr != NULL);
             // 获得vptr节点的下一个节点的首地址
-            fptr = ziplistNext(zl, vptr);
+            fptr = lpNext(zl, vptr);
         }
         if (fptr == NULL) return REDIS_ERR;
 
         /* Grab pointer to the value (fptr points to the field) */
         // vptr指向fptr的下一个节点，相当于value值
-        vptr = ziplistNext(zl, fptr);
+        vptr = lpNext(zl, fptr);
         redisAssert(vptr != NULL);
 
         /* fptr, vptr now point to the first or next pair */
         // 此时，fptr和vptr指向相邻的两个节点，相当于一个key-value对
         hi->fptr = fptr;
         hi->vptr = vptr;
+    } else if (hi->encoding == REDIS_ENCODING_LISTPACK_EX) {
+        // hashpack中每个域占用三个节点，跳过过期时间节点
+        hashpack *hp = hi->subject->ptr;
+
+        if (hi->fptr == NULL)
+            hi->fptr = hpFirst(hp);
+        else
+            hi->fptr = hpNextField(hp, hi->fptr);
+        if (hi->fptr == NULL) return REDIS_ERR;
+        hi->vptr = hpValue(hp, hi->fptr);
     } else if (hi->encoding == REDIS_ENCODING_HT) {
         // 如果是dict对象的迭代器，直接调用dict自身的迭代器实现
         if ((hi->de = dictNext(hi->di)) == NULL) return REDIS_ERR;
@@ -426,33 +558,34 @@ int hashTypeNext(hashTypeIterator *hi) {
 }
 
 /* Get the field or value at iterator cursor, for an iterator on a hash value
- * encoded as a ziplist. Prototype is similar to `hashTypeGetFromZiplist`. */
-/*  从ziplist编码的hashType对象中获取当前迭代器所指向的键值对的key值和value值。前面我们分析过，
-    Redis将ziplist的迭代器指向的两个相邻的节点当做一个键值对。参数what指明获取key值还是value值。 */
-void hashTypeCurrentFromZiplist(hashTypeIterator *hi, int what,
+ * encoded as a listpack. Prototype is similar to `hashTypeGetFromListpack`. */
+/*  从listpack编码的hashType对象中获取当前迭代器所指向的键值对的key值和value值。前面我们分析过，
+    Redis将listpack的迭代器指向的两个相邻的节点当做一个键值对。参数what指明获取key值还是value值。 */
+void hashTypeCurrentFromListpack(hashTypeIterator *hi, int what,
                                 unsigned char **vstr,
                                 unsigned int *vlen,
                                 long long *vll)
 {
     int ret;
 
-    // 只支持ziplist结构
-    redisAssert(hi->encoding == REDIS_ENCODING_ZIPLIST);
+    // 只支持listpack结构（包括hashpack编码）
+    redisAssert(hi->encoding == REDIS_ENCODING_LISTPACK ||
+                hi->encoding == REDIS_ENCODING_LISTPACK_EX);
 
     // what的取值有REDIS_HASH_KEY和REDIS_HASH_VALUE之分
     if (what & REDIS_HASH_KEY) {
         // 取key值，也就是fptr指向节点的值
-        ret = ziplistGet(hi->fptr, vstr, vlen, vll);
+        ret = lpGet(hi->fptr, vstr, vlen, vll);
         redisAssert(ret);
     } else {
         // 取value值，也就是vptr指向节点的值
-        ret = ziplistGet(hi->vptr, vstr, vlen, vll);
+        ret = lpGet(hi->vptr, vstr, vlen, vll);
         redisAssert(ret);
     }
 }
 
 /* Get the field or value at iterator cursor, for an iterator on a hash value
- * encoded as a ziplist. Prototype is similar to `hashTypeGetFromHashTable`. */
+ * encoded as a listpack. Prototype is similar to `hashTypeGetFromHashTable`. */
 /* 根据当前迭代器的位置，从dict编码的hashType对象中获取相关的key值或value值。 */ 
 void hashTypeCurrentFromHashTable(hashTypeIterator *hi, int what, robj **dst) {
     // 该函数只处理dict编码的情况
@@ -468,20 +601,21 @@ void hashTypeCurrentFromHashTable(hashTypeIterator *hi, int what, robj **dst) {
 /* A non copy-on-write friendly but higher level version of hashTypeCurrent*()
  * that returns an object with incremented refcount (or a new object). It is up
  * to the caller to decrRefCount() the object if no reference is retained. */
-/*  根据当前迭代器的位置，从hashType对象中获取指定的key值或value值，其实就是hashTypeCurrentFromZiplist
+/*  根据当前迭代器的位置，从hashType对象中获取指定的key值或value值，其实就是hashTypeCurrentFromListpack
     和hashTypeCurrentFromHashTable函数的封装。
     该函数会返回一个增加了引用计数值的对象或者一个新对象，需要调用者调用decrRefCount函数减少引用计数值。 */
 robj *hashTypeCurrentObject(hashTypeIterator *hi, int what) {
     robj *dst;
 
-    // 处理ziplist编码的情况
-    if (hi->encoding == REDIS_ENCODING_ZIPLIST) {
+    // 处理listpack编码和hashpack编码的情况
+    if (hi->encoding == REDIS_ENCODING_LISTPACK ||
+        hi->encoding == REDIS_ENCODING_LISTPACK_EX) {
         unsigned char *vstr = NULL;
         unsigned int vlen = UINT_MAX;
         long long vll = LLONG_MAX;
 
-        hashTypeCurrentFromZiplist(hi, what, &vstr, &vlen, &vll);
-        // ziplist中存储的数据有字符串和整型之分。
+        hashTypeCurrentFromListpack(hi, what, &vstr, &vlen, &vll);
+        // listpack中存储的数据有字符串和整型之分。
         // 这里创建了新对象
         if (vstr) {
             dst = createStringObject((char*)vstr, vlen);
@@ -503,9 +637,103 @@ robj *hashTypeCurrentObject(hashTypeIterator *hi, int what) {
     return dst;
 }
 
+/* State of hashTypeExpireFields() for the hpExpire() callback. */
+/* hashTypeExpireFields传给hpExpire回调函数的状态 */
+typedef struct hashFieldExpireCtx {
+    redisDb *db;
+    robj *key;
+} hashFieldExpireCtx;
+
+/* Propagate the expire of a hash field as HDEL, the same way propagateExpire()
+ * turns the expire of a key into a DEL. */
+/* 将一个域的过期作为HDEL命令传播到AOF文件和slave节点，就像propagateExpire将key的过期作为DEL命令传播一样 */
+static void hashFieldPropagateExpire(void *privdata, unsigned char *fptr) {
+    static struct redisCommand *hdelCommand = NULL;
+    hashFieldExpireCtx *ctx = privdata;
+    unsigned char *vstr;
+    unsigned int vlen;
+    long long vll;
+    robj *argv[3];
+    int ret;
+
+    if (hdelCommand == NULL) hdelCommand = lookupCommandByCString("hdel");
+    ret = lpGet(fptr, &vstr, &vlen, &vll);
+    redisAssert(ret);
+
+    // 构造一个HDEL命令
+    argv[0] = createStringObject("HDEL",4);
+    argv[1] = ctx->key;
+    argv[2] = vstr ? createStringObject((char*)vstr,vlen) :
+                     createStringObjectFromLongLong(vll);
+    incrRefCount(argv[1]);
+
+    if (server.aof_state != REDIS_AOF_OFF)
+        feedAppendOnlyFile(hdelCommand,ctx->db->id,argv,3);
+    replicationFeedSlaves(server.slaves,ctx->db->id,argv,3);
+
+    decrRefCount(argv[0]);
+    decrRefCount(argv[1]);
+    decrRefCount(argv[2]);
+}
+
+/* Delete the expired fields of the hash 'o' stored at 'key', propagating them
+ * as HDEL. When no field is left the key is deleted as well and NULL is
+ * returned, otherwise 'o' is returned. If 'expired' is not NULL the number
+ * of deleted fields is stored there. Slaves wait for the HDEL of the master,
+ * like they do for expired keys. */
+/*  删除key对应的hash对象o中已经过期的域，并作为HDEL命令传播出去。如果hash对象中已经没有域，则同时删除key并返回NULL，
+    否则返回o。如果expired不为NULL，则将删除的域的个数保存在其中。
+    和过期的key一样，slave节点不会自己删除过期的域，而是等待master节点发来的HDEL命令。 */
+robj *hashTypeExpireFields(redisDb *db, robj *key, robj *o, unsigned long *expired) {
+    hashFieldExpireCtx ctx;
+    unsigned long deleted;
+
+    if (expired) *expired = 0;
+    if (o == NULL || o->type != REDIS_HASH || !hashTypeHasFieldExpires(o))
+        return o;
+    if (server.loading || server.masterhost != NULL) return o;
+
+    ctx.db = db;
+    ctx.key = key;
+    deleted = hpExpire(o->ptr, mstime(), hashFieldPropagateExpire, &ctx);
+    if (deleted == 0) return o;
+    if (expired) *expired = deleted;
+
+    signalModifiedKey(db,key);
+    notifyKeyspaceEvent(REDIS_NOTIFY_HASH,"hexpired",key,db->id);
+    server.dirty += deleted;
+    if (hashTypeLength(o) == 0) {
+        dbDelete(db,key);
+        notifyKeyspaceEvent(REDIS_NOTIFY_GENERIC,"del",key,db->id);
+        return NULL;
+    }
+    return o;
+}
+
+/* Lookup the hash at 'key' for a hash command, deleting its expired fields.
+ * Like lookupKeyReadOrReply() 'reply' is sent when the key does not exist
+ * (or no field is left), and NULL is returned, also on a type error. */
+/*  hash命令查找key对应的hash对象，并删除其中已经过期的域。
+    和lookupKeyReadOrReply一样，key不存在（或者已经没有域）时发送回复reply并返回NULL，类型错误时也返回NULL。 */
+static robj *hashTypeLookupOrReply(redisClient *c, robj *key, robj *reply, int write) {
+    robj *o = write ? lookupKeyWrite(c->db,key) : lookupKeyRead(c->db,key);
+
+    if (o == NULL) {
+        addReply(c,reply);
+        return NULL;
+    }
+    if (checkType(c,o,REDIS_HASH)) return NULL;
+    if ((o = hashTypeExpireFields(c->db,key,o,NULL)) == NULL) addReply(c,reply);
+    return o;
+}
+
 /* 判断给定名称相应的hash对象是否存在，如果不存在则创建 */
 robj *hashTypeLookupWriteOrCreate(redisClient *c, robj *key) {
     robj *o = lookupKeyWrite(c->db,key);
+
+    // 先删除已经过期的域，hash对象因此被删除时重新创建
+    if (o != NULL && o->type == REDIS_HASH)
+        o = hashTypeExpireFields(c->db,key,o,NULL);
     if (o == NULL) {
         o = createHashObject();
         dbAdd(c->db,key,o);
@@ -519,25 +747,32 @@ robj *hashTypeLookupWriteOrCreate(redisClient *c, robj *key) {
     return o;
 }
 
-/* 从ziplist编码到dict编码的转换，参数enc指明目标编码方式。 */
-void hashTypeConvertZiplist(robj *o, int enc) {
-    // 原对象必须为ziplist编码
-    redisAssert(o->encoding == REDIS_ENCODING_ZIPLIST);
+/*  从listpack编码（或hashpack编码）到hashpack编码或dict编码的转换，参数enc指明目标编码方式。
+    listpack编码到hashpack编码的转换只需要把域、值两个一组的listpack改写为三个一组。 */
+void hashTypeConvertListpack(robj *o, int enc) {
+    // 原对象必须为listpack编码或hashpack编码
+    redisAssert(o->encoding == REDIS_ENCODING_LISTPACK ||
+                o->encoding == REDIS_ENCODING_LISTPACK_EX);
 
-    if (enc == REDIS_ENCODING_ZIPLIST) {
+    if (enc == o->encoding) {
         /* Nothing to do... */
 
+    } else if (enc == REDIS_ENCODING_LISTPACK_EX) {
+        redisAssert(o->encoding == REDIS_ENCODING_LISTPACK);
+        o->ptr = hpFromListpack(o->ptr);
+        o->encoding = REDIS_ENCODING_LISTPACK_EX;
+
     } else if (enc == REDIS_ENCODING_HT) {
         hashTypeIterator *hi;
         dict *dict;
         int ret;
 
-        // 获取待转换ziplist对象的迭代器
+        // 获取待转换listpack对象的迭代器
         hi = hashTypeInitIterator(o);
         // 创建一个空的dict结构
         dict = dictCreate(&hashDictType, NULL);
 
-        // 从前往后遍历ziplist，每次取出两个节点作为key-value对添加到dict中
+        // 从前往后遍历listpack，每次取出两个节点作为key-value对添加到dict中
         while (hashTypeNext(hi) != REDIS_ERR) {
             robj *field, *value;
 
@@ -550,16 +785,21 @@ void hashTypeConvertZiplist(robj *o, int enc) {
             // 将当前的key和value添加到dict中
             ret = dictAdd(dict, field, value);
             if (ret != DICT_OK) {
-                redisLogHexDump(REDIS_WARNING,"ziplist with dup elements dump",
-                    o->ptr,ziplistBlobLen(o->ptr));
+                unsigned char *lp = (o->encoding == REDIS_ENCODING_LISTPACK) ?
+                                    o->ptr : ((hashpack*)o->ptr)->lp;
+                redisLogHexDump(REDIS_WARNING,"listpack with dup elements dump",
+                    lp,lpBytes(lp));
                 redisAssert(ret == DICT_OK);
             }
         }
 
         // 释放迭代器
         hashTypeReleaseIterator(hi);
-        // 释放原ziplist对象空间
-        zfree(o->ptr);
+        // 释放原listpack对象空间
+        if (o->encoding == REDIS_ENCODING_LISTPACK_EX)
+            hpFree(o->ptr);
+        else
+            zfree(o->ptr);
 
         // 更新redis object对象信息
         o->encoding = REDIS_ENCODING_HT;
@@ -570,13 +810,45 @@ void hashTypeConvertZiplist(robj *o, int enc) {
     }
 }
 
-/* 内置存储类型转换，只支持从ziplist到dict的转换 */
+/* Convert a hash table encoded hash into a hashpack, used when a field TTL is
+ * set on a hash that is small enough. */
+/* 从dict编码到hashpack编码的转换，在为一个不太大的dict编码hash设置域过期时间时使用 */
+void hashTypeConvertHashTable(robj *o, int enc) {
+    hashTypeIterator *hi;
+    hashpack *hp;
+
+    redisAssert(o->encoding == REDIS_ENCODING_HT);
+    if (enc == REDIS_ENCODING_HT) return;
+    if (enc != REDIS_ENCODING_LISTPACK_EX) redisPanic("Not implemented");
+
+    hp = hpNew();
+    hi = hashTypeInitIterator(o);
+    while (hashTypeNext(hi) != REDIS_ERR) {
+        robj *field, *value;
+
+        hashTypeCurrentFromHashTable(hi, REDIS_HASH_KEY, &field);
+        hashTypeCurrentFromHashTable(hi, REDIS_HASH_VALUE, &value);
+        field = getDecodedObject(field);
+        value = getDecodedObject(value);
+        hpSet(hp, field->ptr, sdslen(field->ptr), value->ptr, sdslen(value->ptr));
+        decrRefCount(field);
+        decrRefCount(value);
+    }
+    hashTypeReleaseIterator(hi);
+    dictRelease(o->ptr);
+
+    o->encoding = REDIS_ENCODING_LISTPACK_EX;
+    o->ptr = hp;
+}
+
+/* 内置存储类型转换，支持listpack、hashpack和dict编码之间的转换（dict编码只能转换为hashpack编码） */
 void hashTypeConvert(robj *o, int enc) {
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-        // 调用hashTypeConvertZiplist完成真正的转换操作
-        hashTypeConvertZiplist(o, enc);
+    if (o->encoding == REDIS_ENCODING_LISTPACK ||
+        o->encoding == REDIS_ENCODING_LISTPACK_EX) {
+        // 调用hashTypeConvertListpack完成真正的转换操作
+        hashTypeConvertListpack(o, enc);
     } else if (o->encoding == REDIS_ENCODING_HT) {
-        redisPanic("Not implemented");
+        hashTypeConvertHashTable(o, enc);
     } else {
         redisPanic("Unknown hash encoding");
     }
@@ -593,6 +865,7 @@ void hsetCommand(redisClient *c) {
 
     // 检测hash对象是否需要创建
     if ((o = hashTypeLookupWriteOrCreate(c,c->argv[1])) == NULL) return;
+    if (hashTypeCheckExpiresLimits(c,o,c->argv,2,3)) return;
     // 检测该hash对象是否需要转换编码方式
     hashTypeTryConversion(o,c->argv,2,3);
     hashTypeTryObjectEncoding(o,&c->argv[2], &c->argv[3]);
@@ -620,6 +893,7 @@ void hsetnxCommand(redisClient *c) {
         addReply(c, shared.czero);
     } else {
     	// 如果key不存在，则创建之
+        if (hashTypeCheckExpiresLimits(c,o,c->argv,2,3)) return;
         hashTypeTryObjectEncoding(o,&c->argv[2], &c->argv[3]);
         hashTypeSet(o,c->argv[2],c->argv[3]);
         addReply(c, shared.cone);
@@ -642,6 +916,7 @@ void hmsetCommand(redisClient *c) {
 
     // 检测hash对象是否需要创建
     if ((o = hashTypeLookupWriteOrCreate(c,c->argv[1])) == NULL) return;
+    if (hashTypeCheckExpiresLimits(c,o,c->argv,2,c->argc-1)) return;
     // 检测该hash对象是否需要转换编码方式
     hashTypeTryConversion(o,c->argv,2,c->argc-1);
     // 两两一组组成一个键值对分别插入
@@ -659,7 +934,7 @@ void hmsetCommand(redisClient *c) {
 /* hincrby命令的实现，对指定键进行增量操作 */
 void hincrbyCommand(redisClient *c) {
     long long value, incr, oldvalue;
-    robj *o, *current, *new;
+    robj *o, *current, *new, *pair[2];
 
     if (getLongLongFromObjectOrReply(c,c->argv[3],&incr,NULL) != REDIS_OK) return;
     // 检测hash对象是否需要创建
@@ -686,6 +961,12 @@ void hincrbyCommand(redisClient *c) {
     value += incr;
     // 构造新值
     new = createStringObjectFromLongLong(value);
+    pair[0] = c->argv[2];
+    pair[1] = new;
+    if (hashTypeCheckExpiresLimits(c,o,pair,0,1)) {
+        decrRefCount(new);
+        return;
+    }
     hashTypeTryObjectEncoding(o,&c->argv[2],NULL);
     // 设置新值
     hashTypeSet(o,c->argv[2],new);
@@ -700,7 +981,7 @@ void hincrbyCommand(redisClient *c) {
 /* hincrbyfloat命令的实现，类似hincrby命令  */
 void hincrbyfloatCommand(redisClient *c) {
     double long value, incr;
-    robj *o, *current, *new, *aux;
+    robj *o, *current, *new, *aux, *pair[2];
 
     if (getLongDoubleFromObjectOrReply(c,c->argv[3],&incr,NULL) != REDIS_OK) return;
     if ((o = hashTypeLookupWriteOrCreate(c,c->argv[1])) == NULL) return;
@@ -717,6 +998,12 @@ void hincrbyfloatCommand(redisClient *c) {
 
     value += incr;
     new = createStringObjectFromLongDouble(value,1);
+    pair[0] = c->argv[2];
+    pair[1] = new;
+    if (hashTypeCheckExpiresLimits(c,o,pair,0,1)) {
+        decrRefCount(new);
+        return;
+    }
     hashTypeTryObjectEncoding(o,&c->argv[2],NULL);
     hashTypeSet(o,c->argv[2],new);
     addReplyBulk(c,new);
@@ -744,14 +1031,15 @@ static void addHashFieldToReply(redisClient *c, robj *o, robj *field) {
         return;
     }
 
-    // 处理ziplist编码的情况
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    // 处理listpack编码和hashpack编码的情况
+    if (o->encoding == REDIS_ENCODING_LISTPACK ||
+        o->encoding == REDIS_ENCODING_LISTPACK_EX) {
         unsigned char *vstr = NULL;
         unsigned int vlen = UINT_MAX;
         long long vll = LLONG_MAX;
 
-        // 从ziplist中取出key指定的value值 
-        ret = hashTypeGetFromZiplist(o, field, &vstr, &vlen, &vll);
+        // 从listpack中取出key指定的value值 
+        ret = hashTypeGetFromListpack(o, field, &vstr, &vlen, &vll);
         if (ret < 0) {
             addReply(c, shared.nullbulk);
         } else {
@@ -785,8 +1073,8 @@ static void addHashFieldToReply(redisClient *c, robj *o, robj *field) {
 void hgetCommand(redisClient *c) {
     robj *o;
 
-    if ((o = lookupKeyReadOrReply(c,c->argv[1],shared.nullbulk)) == NULL ||
-        checkType(c,o,REDIS_HASH)) return;
+    if ((o = hashTypeLookupOrReply(c,c->argv[1],shared.nullbulk,0)) == NULL)
+        return;
 
     addHashFieldToReply(c, o, c->argv[2]);
 }
@@ -803,6 +1091,7 @@ void hmgetCommand(redisClient *c) {
         addReply(c, shared.wrongtypeerr);
         return;
     }
+    o = hashTypeExpireFields(c->db, c->argv[1], o, NULL);
 
     addReplyMultiBulkLen(c, c->argc-2);
     // 遍历所有输入的key值，取出相对应的value值
@@ -817,8 +1106,8 @@ void hdelCommand(redisClient *c) {
     int j, deleted = 0, keyremoved = 0;
 
     // 取出hashType对象并进行类型检查
-    if ((o = lookupKeyWriteOrReply(c,c->argv[1],shared.czero)) == NULL ||
-        checkType(c,o,REDIS_HASH)) return;
+    if ((o = hashTypeLookupOrReply(c,c->argv[1],shared.czero,1)) == NULL)
+        return;
 
     // 遍历所有输入的待删除key，逐一执行删除操作
     for (j = 2; j < c->argc; j++) {
@@ -853,21 +1142,22 @@ void hdelCommand(redisClient *c) {
 /* hlen命令实现 */
 void hlenCommand(redisClient *c) {
     robj *o;
-    if ((o = lookupKeyReadOrReply(c,c->argv[1],shared.czero)) == NULL ||
-        checkType(c,o,REDIS_HASH)) return;
+    if ((o = hashTypeLookupOrReply(c,c->argv[1],shared.czero,0)) == NULL)
+        return;
 
     addReplyLongLong(c,hashTypeLength(o));
 }
 
 /* 根据当前迭代器，取出listType对象的key值或value值并添加到回复消息中。*/
 static void addHashIteratorCursorToReply(redisClient *c, hashTypeIterator *hi, int what) {
-    // 处理ziplist编码的情况
-    if (hi->encoding == REDIS_ENCODING_ZIPLIST) {
+    // 处理listpack编码和hashpack编码的情况
+    if (hi->encoding == REDIS_ENCODING_LISTPACK ||
+        hi->encoding == REDIS_ENCODING_LISTPACK_EX) {
         unsigned char *vstr = NULL;
         unsigned int vlen = UINT_MAX;
         long long vll = LLONG_MAX;
 
-        hashTypeCurrentFromZiplist(hi, what, &vstr, &vlen, &vll);
+        hashTypeCurrentFromListpack(hi, what, &vstr, &vlen, &vll);
         if (vstr) {
             addReplyBulkCBuffer(c, vstr, vlen);
         } else {
@@ -895,8 +1185,8 @@ void genericHgetallCommand(redisClient *c, int flags) {
     int length, count = 0;
 
     // 取出listType对象并进行类型检查
-    if ((o = lookupKeyReadOrReply(c,c->argv[1],shared.emptymultibulk)) == NULL
-        || checkType(c,o,REDIS_HASH)) return;
+    if ((o = hashTypeLookupOrReply(c,c->argv[1],shared.emptymultibulk,0)) == NULL)
+        return;
 
     if (flags & REDIS_HASH_KEY) multiplier++;
     if (flags & REDIS_HASH_VALUE) multiplier++;
@@ -940,8 +1230,8 @@ void hgetallCommand(redisClient *c) {
 /* hexists命令实现 */
 void hexistsCommand(redisClient *c) {
     robj *o;
-    if ((o = lookupKeyReadOrReply(c,c->argv[1],shared.czero)) == NULL ||
-        checkType(c,o,REDIS_HASH)) return;
+    if ((o = hashTypeLookupOrReply(c,c->argv[1],shared.czero,0)) == NULL)
+        return;
 
     addReply(c, hashTypeExists(o,c->argv[2]) ? shared.cone : shared.czero);
 }
@@ -952,8 +1242,234 @@ void hscanCommand(redisClient *c) {
     unsigned long cursor;
 
     if (parseScanCursorOrReply(c,c->argv[2],&cursor) == REDIS_ERR) return;
-    if ((o = lookupKeyReadOrReply(c,c->argv[1],shared.emptyscan)) == NULL ||
-        checkType(c,o,REDIS_HASH)) return;
+    if ((o = hashTypeLookupOrReply(c,c->argv[1],shared.emptyscan,0)) == NULL)
+        return;
     // scanGenericCommand命令定义在db.c命令中
     scanGenericCommand(c,o,cursor);
 }
+
+/*-----------------------------------------------------------------------------
+ * Hash field expire commands 域过期相关命令的实现
+ *----------------------------------------------------------------------------*/
+
+/* This is the generic command implementation for HEXPIRE, HPEXPIRE,
+ * HEXPIREAT and HPEXPIREAT:
+ *
+ *   HEXPIRE key seconds field [field ...]
+ *
+ * 'basetime' and 'unit' have the same meaning as in expireGenericCommand().
+ * The reply has one integer per field: -2 if the field does not exist, 1 if
+ * the expire was set, 2 if the field was deleted because the time is already
+ * in the past. The command is always propagated as HPEXPIREAT. */
+/*  HEXPIRE、HPEXPIRE、HEXPIREAT和HPEXPIREAT命令的底层实现，参数basetime和unit的含义与expireGenericCommand相同。
+    对每个域回复一个整数：域不存在时为-2，设置成功时为1，过期时间已经过去、域被直接删除时为2。
+    命令总是以HPEXPIREAT的形式传播，过期时间为绝对的毫秒时间戳。 */
+void hexpireGenericCommand(redisClient *c, long long basetime, int unit) {
+    robj *key = c->argv[1], *o;
+    long long when, now = mstime();
+    int j, numfields = c->argc-3, set = 0, past;
+    int *codes;
+
+    if (getLongLongFromObjectOrReply(c, c->argv[2], &when, NULL) != REDIS_OK)
+        return;
+    if (unit == UNIT_SECONDS) when *= 1000;
+    when += basetime;
+    // 过期时间0在hashpack中表示没有过期时间
+    if (when <= 0) {
+        addReplyError(c,"invalid expire time");
+        return;
+    }
+
+    o = lookupKeyWrite(c->db,key);
+    if (o != NULL && checkType(c,o,REDIS_HASH)) return;
+    o = hashTypeExpireFields(c->db,key,o,NULL);
+    if (o == NULL) {
+        addReplyMultiBulkLen(c,numfields);
+        for (j = 0; j < numfields; j++) addReplyLongLong(c,-2);
+        return;
+    }
+
+    /* Only the hashpack encoding can carry field expires. */
+    // 只有hashpack编码支持域的过期时间，dict编码的hash只有不太大、并且没有过长的域和值时才能转换
+    if (o->encoding == REDIS_ENCODING_HT &&
+        (hashTypeLength(o) > server.hash_max_listpack_ex_entries ||
+         hashTypeHasLongStrings(o)))
+    {
+        addReplyError(c,"hash too large for field expires, see hash-max-listpack-ex-entries and hash-max-ziplist-value");
+        return;
+    }
+    if (o->encoding != REDIS_ENCODING_LISTPACK_EX)
+        hashTypeConvert(o, REDIS_ENCODING_LISTPACK_EX);
+
+    /* A time already in the past deletes the fields, unless we are loading
+     * or are a slave: then the HDEL of the master will do it. */
+    // 过期时间已经过去时直接删除域，但载入数据时或者作为slave节点时只设置过期时间，等待master节点的HDEL命令
+    past = when < now && !server.loading && !server.masterhost;
+    codes = zmalloc(sizeof(int)*numfields);
+    for (j = 0; j < numfields; j++) {
+        robj *field = getDecodedObject(c->argv[j+3]);
+        unsigned char *fptr = hpFind(o->ptr, field->ptr, sdslen(field->ptr));
+
+        if (fptr == NULL) {
+            codes[j] = -2;
+        } else {
+            hpSetExpire(o->ptr, fptr, when);
+            codes[j] = past ? 2 : 1;
+            set++;
+        }
+        decrRefCount(field);
+    }
+
+    addReplyMultiBulkLen(c,numfields);
+    for (j = 0; j < numfields; j++) addReplyLongLong(c,codes[j]);
+    zfree(codes);
+    if (set == 0) return;
+
+    /* Propagate as HPEXPIREAT, also when the fields are deleted below: then
+     * it follows their HDELs and finds nothing left to expire, while a
+     * relative time would be resolved again by slaves and the AOF. */
+    // 以HPEXPIREAT的形式传播，避免slave节点和AOF载入时因为时间不同导致数据不一致。
+    // 域被立即删除时也是如此：此时它跟在这些域的HDEL命令之后传播，已经没有可以设置过期时间的域
+    if (basetime != 0 || unit != UNIT_MILLISECONDS) {
+        robj *aux = createStringObject("HPEXPIREAT",10);
+
+        rewriteClientCommandArgument(c,0,aux);
+        decrRefCount(aux);
+        aux = createStringObjectFromLongLong(when);
+        rewriteClientCommandArgument(c,2,aux);
+        decrRefCount(aux);
+    }
+
+    if (past) {
+        /* The fields are deleted (and propagated as HDEL) right now. */
+        // 立即删除这些域，并作为HDEL命令传播
+        hashTypeExpireFields(c->db,key,o,NULL);
+        return;
+    }
+    hashFieldExpireTrack(c->db,key);
+    signalModifiedKey(c->db,key);
+    notifyKeyspaceEvent(REDIS_NOTIFY_HASH,"hexpire",key,c->db->id);
+    server.dirty += set;
+}
+
+/* HEXPIRE key seconds field [field ...] */
+void hexpireCommand(redisClient *c) {
+    hexpireGenericCommand(c,mstime(),UNIT_SECONDS);
+}
+
+/* HEXPIREAT key timestamp field [field ...] */
+void hexpireatCommand(redisClient *c) {
+    hexpireGenericCommand(c,0,UNIT_SECONDS);
+}
+
+/* HPEXPIRE key milliseconds field [field ...] */
+void hpexpireCommand(redisClient *c) {
+    hexpireGenericCommand(c,mstime(),UNIT_MILLISECONDS);
+}
+
+/* HPEXPIREAT key milliseconds-timestamp field [field ...] */
+void hpexpireatCommand(redisClient *c) {
+    hexpireGenericCommand(c,0,UNIT_MILLISECONDS);
+}
+
+/* Lookup the hash of a HTTL/HPTTL/HPERSIST command, deleting its expired
+ * fields. When the key does not exist -2 is replied for every field and NULL
+ * is returned, NULL is also returned on a type error. Otherwise the multi
+ * bulk length of the reply is already emitted. */
+/*  查找HTTL、HPTTL和HPERSIST命令的hash对象，并删除其中已经过期的域。key不存在时对每个域回复-2并返回NULL，
+    类型错误时也返回NULL，否则返回hash对象，此时回复的数组长度已经发送。 */
+static robj *hashFieldTTLLookupOrReply(redisClient *c, int write) {
+    int j, numfields = c->argc-2;
+    robj *o = write ? lookupKeyWrite(c->db,c->argv[1]) :
+                      lookupKeyRead(c->db,c->argv[1]);
+
+    if (o != NULL && checkType(c,o,REDIS_HASH)) return NULL;
+    o = hashTypeExpireFields(c->db,c->argv[1],o,NULL);
+    addReplyMultiBulkLen(c,numfields);
+    if (o == NULL) {
+        for (j = 0; j < numfields; j++) addReplyLongLong(c,-2);
+    }
+    return o;
+}
+
+/* Return the expire of 'field' in the hash 'o': -2 if the field does not
+ * exist, 0 if it has no expire. */
+/* 返回hash对象o中域field的过期时间，域不存在时返回-2，没有过期时间时返回0 */
+static long long hashTypeGetFieldExpire(robj *o, robj *field) {
+    unsigned char *fptr;
+    long long when;
+
+    if (o->encoding != REDIS_ENCODING_LISTPACK_EX)
+        return hashTypeExists(o,field) ? 0 : -2;
+    field = getDecodedObject(field);
+    fptr = hpFind(o->ptr, field->ptr, sdslen(field->ptr));
+    when = fptr ? hpGetExpire(o->ptr, fptr) : -2;
+    decrRefCount(field);
+    return when;
+}
+
+/* Implementation of HTTL and HPTTL, see ttlGenericCommand(): -2 for a missing
+ * field, -1 for a field without expire, the remaining time to live otherwise. */
+/* HTTL和HPTTL命令的底层实现，参见ttlGenericCommand：域不存在时为-2，没有过期时间时为-1，否则为剩余生存时间 */
+void httlGenericCommand(redisClient *c, int output_ms) {
+    robj *o;
+    int j;
+
+    if ((o = hashFieldTTLLookupOrReply(c,0)) == NULL) return;
+    for (j = 2; j < c->argc; j++) {
+        long long when = hashTypeGetFieldExpire(o,c->argv[j]), ttl;
+
+        if (when <= 0) {
+            addReplyLongLong(c, when == 0 ? -1 : -2);
+            continue;
+        }
+        ttl = when-mstime();
+        if (ttl < 0) ttl = 0;
+        addReplyLongLong(c,output_ms ? ttl : ((ttl+500)/1000));
+    }
+}
+
+/* HTTL key field [field ...] */
+void httlCommand(redisClient *c) {
+    httlGenericCommand(c,0);
+}
+
+/* HPTTL key field [field ...] */
+void hpttlCommand(redisClient *c) {
+    httlGenericCommand(c,1);
+}
+
+/* HPERSIST key field [field ...]: remove the expire of the fields. Replies
+ * -2 for a missing field, -1 for a field without expire, 1 otherwise. */
+/* HPERSIST命令，移除域的过期时间。域不存在时回复-2，没有过期时间时回复-1，成功移除时回复1 */
+void hpersistCommand(redisClient *c) {
+    robj *o;
+    int j, removed = 0;
+
+    if ((o = hashFieldTTLLookupOrReply(c,1)) == NULL) return;
+    for (j = 2; j < c->argc; j++) {
+        long long when = hashTypeGetFieldExpire(o,c->argv[j]);
+
+        if (when <= 0) {
+            addReplyLongLong(c, when == 0 ? -1 : -2);
+        } else {
+            robj *field = getDecodedObject(c->argv[j]);
+
+            hpSetExpire(o->ptr, hpFind(o->ptr, field->ptr, sdslen(field->ptr)), 0);
+            decrRefCount(field);
+            addReplyLongLong(c,1);
+            removed++;
+        }
+    }
+    if (removed) {
+        /* Without field expires left, a hash loaded with larger limits can
+         * finally be converted. */
+        // 所有域的过期时间都已移除时，以更大的限制载入的hash终于可以转换编码了
+        if (!hashTypeHasFieldExpires(o) &&
+            hashTypeLength(o) > server.hash_max_listpack_ex_entries)
+            hashTypeGrow(o, 0);
+        signalModifiedKey(c->db,c->argv[1]);
+        notifyKeyspaceEvent(REDIS_NOTIFY_HASH,"hpersist",c->argv[1],c->db->id);
+        server.dirty += removed;
+    }
+}
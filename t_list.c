@@ -34,26 +34,11 @@
  *----------------------------------------------------------------------------*/
 
  /*********************************************************************************
-	List类型底层有ziplist和linked list两种结构，我们将其统称为listType。
-	其中，linked list是指Redis的底层内置结构list
+	List类型的底层结构为quicklist，即由多个大小受限的listpack串联而成的双向链表，我们将其统称为listType。
+	老版本RDB文件中ziplist编码和linked list编码的list在载入时都会转换为quicklist编码。
+	单个listpack的大小限制由list_max_ziplist_entries决定，具体规则见quicklist.c。
  ************************************************************************************/
 
-/* Check the argument length to see if it requires us to convert the ziplist
- * to a real list. Only check raw-encoded objects because integer encoded
- * objects are never too long. */
-/* 参数value是待插入subject中的一个字符串对象，检查参数value的长度，如果其长度超过list_max_ziplist_value
-	则将subject的底层结构从ziplist转换为双向链表list。只需要对REDIS_ENCODING_RAW编码的对象进行检查即可，
-	因为一个整数编码的值不可能太长。 */
-void listTypeTryConversion(robj *subject, robj *value) {
-    if (subject->encoding != REDIS_ENCODING_ZIPLIST) return;
-
-    if (value->encoding == REDIS_ENCODING_RAW &&
-    	// list_max_ziplist_value的默认值为64
-        sdslen(value->ptr) > server.list_max_ziplist_value)
-        	// 将list类型的底层实现从ziplist转换为双向链表
-            listTypeConvert(subject,REDIS_ENCODING_LINKEDLIST);
-}
-
 /* The function pushes an element to the specified list object 'subject',
  * at head or tail position as specified by 'where'.
  *
@@ -62,78 +47,35 @@ void listTypeTryConversion(robj *subject, robj *value) {
 /*	该函数用于往list类型中添加一个元素，可以使用参数where指定添加到表头还是表尾。
 	该函数会自动处理value的引用计数值，调用者无需关心。 */
 void listTypePush(robj *subject, robj *value, int where) {
-    /* Check if we need to convert the ziplist */
-    // 检查是否需要转换编码（REDIS_ENCODING_ZIPLIST => REDIS_ENCODING_LINKEDLIST）
-    listTypeTryConversion(subject,value);
-    if (subject->encoding == REDIS_ENCODING_ZIPLIST &&
-    	// list_max_ziplist_entries的默认值为512，如果ziplist中存放的节点数超过该值也需要转换编码
-        ziplistLen(subject->ptr) >= server.list_max_ziplist_entries)
-            listTypeConvert(subject,REDIS_ENCODING_LINKEDLIST);
-
-    // 分别处理以ziplist和linked list编码的情况
-    if (subject->encoding == REDIS_ENCODING_ZIPLIST) {
-    	/* 处理底层结构为ziplist的情况 */
-
+    if (subject->encoding == REDIS_ENCODING_QUICKLIST) {
     	// 确定新元素是插入到头部还是尾部
-        int pos = (where == REDIS_HEAD) ? ZIPLIST_HEAD : ZIPLIST_TAIL;
+        int pos = (where == REDIS_HEAD) ? QUICKLIST_HEAD : QUICKLIST_TAIL;
         value = getDecodedObject(value);
-        // 直接调用ziplist的内部函数实现插入操作
-        subject->ptr = ziplistPush(subject->ptr,value->ptr,sdslen(value->ptr),pos);
+        quicklistPush(subject->ptr,value->ptr,sdslen(value->ptr),pos);
         decrRefCount(value);
-    } else if (subject->encoding == REDIS_ENCODING_LINKEDLIST) {
-    	/* 下面处理底层结构为linked list的情况 */
-        if (where == REDIS_HEAD) {
-            listAddNodeHead(subject->ptr,value);
-        } else {
-            listAddNodeTail(subject->ptr,value);
-        }
-        incrRefCount(value);
     } else {
         redisPanic("Unknown list encoding");
     }
 }
 
+/* quicklistPopCustom使用的回调函数，根据弹出的字符串创建一个字符串对象 */
+void *listPopSaver(unsigned char *data, unsigned int sz) {
+    return createStringObject((char*)data,sz);
+}
+
 /* 从listType中pop出一个元素 */
 robj *listTypePop(robj *subject, int where) {
+    long long vlong;
     robj *value = NULL;
-    if (subject->encoding == REDIS_ENCODING_ZIPLIST) {
-    	// 下面处理底层为ziplist的情况
-        unsigned char *p;
-        unsigned char *vstr;
-        unsigned int vlen;
-        long long vlong;
-        // 确定待删除元素的位置
-        int pos = (where == REDIS_HEAD) ? 0 : -1;
-        // 根据索引值获取节点
-        p = ziplistIndex(subject->ptr,pos);
-        // 获取该节点的值，有可能是字符串或整型
-        if (ziplistGet(p,&vstr,&vlen,&vlong)) {
-            if (vstr) {
-                value = createStringObject((char*)vstr,vlen);
-            } else {
+
+    // 确定弹出的是头部元素还是尾部元素
+    int ql_where = where == REDIS_HEAD ? QUICKLIST_HEAD : QUICKLIST_TAIL;
+    if (subject->encoding == REDIS_ENCODING_QUICKLIST) {
+        // 字符串元素由listPopSaver直接构造成字符串对象，整数元素保存在vlong中
+        if (quicklistPopCustom(subject->ptr,ql_where,(unsigned char **)&value,
+                               NULL,&vlong,listPopSaver)) {
+            if (!value)
                 value = createStringObjectFromLongLong(vlong);
-            }
-            /* We only need to delete an element when it exists */
-            // 删除节点
-            subject->ptr = ziplistDelete(subject->ptr,&p);
-        }
-    } else if (subject->encoding == REDIS_ENCODING_LINKEDLIST) {
-    	// 下面处理底层为linked list的情况
-
-    	// 获取双向链表list对象
-        list *list = subject->ptr;
-        listNode *ln;
-        // 获取头部或尾部节点
-        if (where == REDIS_HEAD) {
-            ln = listFirst(list);
-        } else {
-            ln = listLast(list);
-        }
-        if (ln != NULL) {
-        	// 删除节点
-            value = listNodeValue(ln);
-            incrRefCount(value);
-            listDelNode(list,ln);
         }
     } else {
         redisPanic("Unknown list encoding");
@@ -144,13 +86,8 @@ robj *listTypePop(robj *subject, int where) {
 
 /* 返回listType中存储的节点数量 */
 unsigned long listTypeLength(robj *subject) {
-	// 处理底层为ziplist的情况
-    if (subject->encoding == REDIS_ENCODING_ZIPLIST) {
-        return ziplistLen(subject->ptr);
-    } 
-    // 处理底层为linked list的情况
-    else if (subject->encoding == REDIS_ENCODING_LINKEDLIST) {
-        return listLength((list*)subject->ptr);
+    if (subject->encoding == REDIS_ENCODING_QUICKLIST) {
+        return quicklistCount(subject->ptr);
     } else {
         redisPanic("Unknown list encoding");
     }
@@ -166,12 +103,15 @@ listTypeIterator *listTypeInitIterator(robj *subject, long index, unsigned char
     li->subject = subject;
     li->encoding = subject->encoding;
     li->direction = direction;
-    if (li->encoding == REDIS_ENCODING_ZIPLIST) {
-    	// 获取当前迭代器指向节点
-        li->zi = ziplistIndex(subject->ptr,index);
-    } else if (li->encoding == REDIS_ENCODING_LINKEDLIST) {
-    	// 获取当前迭代器指向节点
-        li->ln = listIndex(subject->ptr,index);
+    li->iter = NULL;
+    /* REDIS_HEAD means start at TAIL and move *towards* head.
+     * REDIS_TAIL means start at HEAD and move *towards tail. */
+    // 注意迭代方向的对应关系：REDIS_TAIL表示从头部往尾部迭代，即AL_START_HEAD
+    int iter_direction =
+        direction == REDIS_HEAD ? AL_START_TAIL : AL_START_HEAD;
+    if (li->encoding == REDIS_ENCODING_QUICKLIST) {
+        li->iter = quicklistGetIteratorAtIdx(li->subject->ptr,
+                                             iter_direction, index);
     } else {
         redisPanic("Unknown list encoding");
     }
@@ -181,6 +121,8 @@ listTypeIterator *listTypeInitIterator(robj *subject, long index, unsigned char
 /* Clean up the iterator. */
 /* 释放listType的迭代器 */
 void listTypeReleaseIterator(listTypeIterator *li) {
+    // 如果index越界，li->iter为NULL
+    if (li->iter) quicklistReleaseIterator(li->iter);
     zfree(li);
 }
 
@@ -195,31 +137,9 @@ int listTypeNext(listTypeIterator *li, listTypeEntry *entry) {
     redisAssert(li->subject->encoding == li->encoding);
 
     entry->li = li;
-    // 处理底层结构为ziplist的情况
-    if (li->encoding == REDIS_ENCODING_ZIPLIST) {
-    	// 将当前迭代器所指节点的指针存储在entry中
-        entry->zi = li->zi;
-        // 迭代到下一个节点，实质调用ziplist的内部函数
-        if (entry->zi != NULL) {
-            if (li->direction == REDIS_TAIL)
-                li->zi = ziplistNext(li->subject->ptr,li->zi);
-            else
-                li->zi = ziplistPrev(li->subject->ptr,li->zi);
-            return 1;
-        }
-    } 
-    // 处理底层结构为linked list的情况
-    else if (li->encoding == REDIS_ENCODING_LINKEDLIST) {
-    	// 将当前迭代器所指节点的指针存储在entry中
-        entry->ln = li->ln;
-        // 迭代到下一个节点，简单的指针运算
-        if (entry->ln != NULL) {
-            if (li->direction == REDIS_TAIL)
-                li->ln = li->ln->next;
-            else
-                li->ln = li->ln->prev;
-            return 1;
-        }
+    if (li->encoding == REDIS_ENCODING_QUICKLIST) {
+        if (li->iter == NULL) return 0;
+        return quicklistNext(li->iter,&entry->entry);
     } else {
         redisPanic("Unknown list encoding");
     }
@@ -227,31 +147,17 @@ int listTypeNext(listTypeIterator *li, listTypeEntry *entry) {
 }
 
 /* Return entry or NULL at the current position of the iterator. */
-/* 返回当前listTypeEntry结构所保存的节点。ListTypeEntry结构体是对ziplist节点和linked list节点的封装。*/
+/* 返回当前listTypeEntry结构所保存的节点。ListTypeEntry结构体是对quicklistEntry的封装。*/
 robj *listTypeGet(listTypeEntry *entry) {
-	// 获得相应的迭代器对象
-    listTypeIterator *li = entry->li;
     robj *value = NULL;
-    // 处理底层结构为ziplist的情况
-    if (li->encoding == REDIS_ENCODING_ZIPLIST) {
-        unsigned char *vstr;
-        unsigned int vlen;
-        long long vlong;
-        redisAssert(entry->zi != NULL);
-        // ziplist节点中存放的可能是整数或字符串
-        if (ziplistGet(entry->zi,&vstr,&vlen,&vlong)) {
-            if (vstr) {
-                value = createStringObject((char*)vstr,vlen);
-            } else {
-                value = createStringObjectFromLongLong(vlong);
-            }
+    if (entry->li->encoding == REDIS_ENCODING_QUICKLIST) {
+        // quicklist节点中存放的可能是整数或字符串
+        if (entry->entry.value) {
+            value = createStringObject((char *)entry->entry.value,
+                                       entry->entry.sz);
+        } else {
+            value = createStringObjectFromLongLong(entry->entry.longval);
         }
-    } 
-    // 处理底层结构为linked list的情况
-    else if (li->encoding == REDIS_ENCODING_LINKEDLIST) {
-        redisAssert(entry->ln != NULL);
-        value = listNodeValue(entry->ln);
-        incrRefCount(value);
     } else {
         redisPanic("Unknown list encoding");
     }
@@ -260,39 +166,22 @@ robj *listTypeGet(listTypeEntry *entry) {
 
 /*	往listType对象指定节点前面或后面插入一个新节点，由参数where决定。*/
 void listTypeInsert(listTypeEntry *entry, robj *value, int where) {
-	// 获取listType对象
-    robj *subject = entry->li->subject;
-    // 处理底层结构为ziplist的情况
-    if (entry->li->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (entry->entry.quicklist &&
+        entry->li->encoding == REDIS_ENCODING_QUICKLIST) {
     	// 返回待插入对象的未编码值
         value = getDecodedObject(value);
-        // 新节点插入到指定节点之后
+        sds str = value->ptr;
+        size_t len = sdslen(str);
         if (where == REDIS_TAIL) {
-            unsigned char *next = ziplistNext(subject->ptr,entry->zi);
-
-            /* When we insert after the current element, but the current element
-             * is the tail of the list, we need to do a push. */
-            if (next == NULL) {
-            	// 当前节点是最后一个节点，则新节点直接加到ziplist尾部
-                subject->ptr = ziplistPush(subject->ptr,value->ptr,sdslen(value->ptr),REDIS_TAIL);
-            } else {
-            	// 新节点插入到当前节点之后
-                subject->ptr = ziplistInsert(subject->ptr,next,value->ptr,sdslen(value->ptr));
-            }
-        } else {
-        	// 新节点插入到当前节点前面
-            subject->ptr = ziplistInsert(subject->ptr,entry->zi,value->ptr,sdslen(value->ptr));
+            // 新节点插入到指定节点之后
+            quicklistInsertAfter((quicklist *)entry->entry.quicklist,
+                                 &entry->entry,str,len);
+        } else if (where == REDIS_HEAD) {
+            // 新节点插入到指定节点之前
+            quicklistInsertBefore((quicklist *)entry->entry.quicklist,
+                                  &entry->entry,str,len);
         }
         decrRefCount(value);
-    } 
-    // 处理底层结构为linked list的情况
-    else if (entry->li->encoding == REDIS_ENCODING_LINKEDLIST) {
-        if (where == REDIS_TAIL) {
-            listInsertNode(subject->ptr,entry->ln,value,AL_START_TAIL);
-        } else {
-            listInsertNode(subject->ptr,entry->ln,value,AL_START_HEAD);
-        }
-        incrRefCount(value);
     } else {
         redisPanic("Unknown list encoding");
     }
@@ -301,75 +190,36 @@ void listTypeInsert(listTypeEntry *entry, robj *value, int where) {
 /* Compare the given object with the entry at the current position. */
 /* 将当前节点和给定对象o比较，如果相等返回1，否则返回0。*/
 int listTypeEqual(listTypeEntry *entry, robj *o) {
-	// 获取当前迭代器
-    listTypeIterator *li = entry->li;
-    if (li->encoding == REDIS_ENCODING_ZIPLIST) {
-        redisAssertWithInfo(NULL,o,o->encoding == REDIS_ENCODING_RAW);
-        return ziplistCompare(entry->zi,o->ptr,sdslen(o->ptr));
-    } else if (li->encoding == REDIS_ENCODING_LINKEDLIST) {
-    	// equalStringObjects定义在redis.h中，用于比较两个redisObject对象是否相等
-        return equalStringObjects(o,listNodeValue(entry->ln));
+    if (entry->li->encoding == REDIS_ENCODING_QUICKLIST) {
+        redisAssertWithInfo(NULL,o,sdsEncodedObject(o));
+        return quicklistCompare(entry->entry.zi,o->ptr,sdslen(o->ptr));
     } else {
         redisPanic("Unknown list encoding");
     }
 }
 
 /* Delete the element pointed to. */
-/* 删除entry指向的当前节点 */
+/* 删除entry指向的当前节点，quicklistDelEntry会同时更新迭代器的位置 */
 void listTypeDelete(listTypeEntry *entry) {
-	// 获取当前迭代器
-    listTypeIterator *li = entry->li;
-    // 处理底层结构为ziplist的情况
-    if (li->encoding == REDIS_ENCODING_ZIPLIST) {
-        unsigned char *p = entry->zi;
-        // 调用ziplistDelete后p指向被删除节点的下一个节点
-        li->subject->ptr = ziplistDelete(li->subject->ptr,&p);
-
-        /* Update position of the iterator depending on the direction */
-        // 删除节点后需要更新迭代器指向的节点
-        if (li->direction == REDIS_TAIL)
-            li->zi = p;
-        else
-            li->zi = ziplistPrev(li->subject->ptr,p);
-    } 
-    // 处理底层结构是linked list的情况
-    else if (entry->li->encoding == REDIS_ENCODING_LINKEDLIST) {
-    	// 用于记录被删除节点的下一个节点
-        listNode *next;
-        if (li->direction == REDIS_TAIL)
-            next = entry->ln->next;
-        else
-            next = entry->ln->prev;
-        listDelNode(li->subject->ptr,entry->ln);
-        // 更新迭代器指针
-        li->ln = next;
+    if (entry->li->encoding == REDIS_ENCODING_QUICKLIST) {
+        quicklistDelEntry(entry->li->iter,&entry->entry);
     } else {
         redisPanic("Unknown list encoding");
     }
 }
 
-/* 将listType从REDIS_ENCODING_ZIPLIST编码转换为REDIS_ENCODING_LINKEDLIST编码*/
+/* Create a quicklist from a single ziplist */
+/* 将listType从REDIS_ENCODING_ZIPLIST编码转换为REDIS_ENCODING_QUICKLIST编码，
+	主要用于载入老版本的RDB文件 */
 void listTypeConvert(robj *subject, int enc) {
-    listTypeIterator *li;
-    listTypeEntry entry;
     redisAssertWithInfo(NULL,subject,subject->type == REDIS_LIST);
+    redisAssertWithInfo(NULL,subject,subject->encoding == REDIS_ENCODING_ZIPLIST);
 
-    if (enc == REDIS_ENCODING_LINKEDLIST) {
-        list *l = listCreate();
-        listSetFreeMethod(l,decrRefCountVoid);
-
-        /* listTypeGet returns a robj with incremented refcount */
-        // 遍历ziplist，并将每一个节点添加到linked list中，然后释放迭代器
-        li = listTypeInitIterator(subject,0,REDIS_TAIL);
-        while (listTypeNext(li,&entry)) listAddNodeTail(l,listTypeGet(&entry));
-        listTypeReleaseIterator(li);
-
-        // 更新编码方式
-        subject->encoding = REDIS_ENCODING_LINKEDLIST;
-        // 释放原来ziplist的空间
-        zfree(subject->ptr);
-        /* 更新对象指针 */
-        subject->ptr = l;
+    if (enc == REDIS_ENCODING_QUICKLIST) {
+        // 旧的ziplist中的元素会按照当前配置重新切分到多个节点中，原ziplist随后被释放
+        subject->ptr = quicklistCreateFromZiplist(server.list_max_ziplist_entries,
+                                                  subject->ptr);
+        subject->encoding = REDIS_ENCODING_QUICKLIST;
     } else {
         redisPanic("Unsupported list conversion");
     }
@@ -396,9 +246,9 @@ void pushGenericCommand(redisClient *c, int where) {
     // 遍历每个输入值并添加到listType中
     for (j = 2; j < c->argc; j++) {
         c->argv[j] = tryObjectEncoding(c->argv[j]);
-        // 如果listType不存在，则创建一个。默认是ziplist编码的
+        // 如果listType不存在，则创建一个quicklist编码的listType
         if (!lobj) {
-            lobj = createZiplistObject();
+            lobj = createQuicklistObject();
             dbAdd(c->db,c->argv[1],lobj);
         }
         listTypePush(lobj,c->argv[j],where);
@@ -440,14 +290,6 @@ void pushxGenericCommand(redisClient *c, robj *refval, robj *val, int where) {
 
     /* 如果refval不为空，执行linsert命令，在refval前面或后面插入一个节点 */
     if (refval != NULL) {
-        /* We're not sure if this value can be inserted yet, but we cannot
-         * convert the list inside the iterator. We don't want to loop over
-         * the list twice (once to see if the value can be inserted and once
-         * to do the actual insert), so we assume this value can be inserted
-         * and convert the ziplist to a regular list if necessary. */
-		// 检查保存val值会不会引起listType编码转换
-        listTypeTryConversion(subject,val);
-
         /* Seek refval from head to tail */
         // 遍历一遍listType以查找refval对象并在其前面或后面插入一个新节点
         iter = listTypeInitIterator(subject,0,REDIS_TAIL);
@@ -462,12 +304,6 @@ void pushxGenericCommand(redisClient *c, robj *refval, robj *val, int where) {
         listTypeReleaseIterator(iter);
 
         if (inserted) {
-            /* Check if the length exceeds the ziplist length threshold. */
-            // 插入一个新节点后引起listType节点数量增加，如果节点数量超过list_max_ziplist_entries
-            // 则要转换编码。list_max_ziplist_entries默认值为512。
-            if (subject->encoding == REDIS_ENCODING_ZIPLIST &&
-                ziplistLen(subject->ptr) > server.list_max_ziplist_entries)
-                    listTypeConvert(subject,REDIS_ENCODING_LINKEDLIST);
             signalModifiedKey(c->db,c->argv[1]);
             notifyKeyspaceEvent(REDIS_NOTIFY_LIST,"linsert",
                                 c->argv[1],c->db->id);
@@ -534,37 +370,21 @@ void lindexCommand(redisClient *c) {
     if ((getLongFromObjectOrReply(c, c->argv[2], &index, NULL) != REDIS_OK))
         return;
 
-    // 处理底层结构为ziplist的情况
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-        unsigned char *p;
-        unsigned char *vstr;
-        unsigned int vlen;
-        long long vlong;
-        // 根据下标值取出节点
-        p = ziplistIndex(o->ptr,index);
-        // 获取节点中存储的数值
-        if (ziplistGet(p,&vstr,&vlen,&vlong)) {
-            if (vstr) {
-                value = createStringObject((char*)vstr,vlen);
+    if (o->encoding == REDIS_ENCODING_QUICKLIST) {
+        quicklistEntry entry;
+        // 根据下标值取出节点，quicklist会先按节点跳跃再在listpack中定位
+        if (quicklistIndex(o->ptr, index, &entry)) {
+            // 获取节点中存储的数值，可能是字符串或整数
+            if (entry.value) {
+                value = createStringObject((char*)entry.value,entry.sz);
             } else {
-                value = createStringObjectFromLongLong(vlong);
+                value = createStringObjectFromLongLong(entry.longval);
             }
             addReplyBulk(c,value);
             decrRefCount(value);
         } else {
             addReply(c,shared.nullbulk);
         }
-    } 
-    // 处理底层结构为linked list的情况
-    else if (o->encoding == REDIS_ENCODING_LINKEDLIST) {
-    	// 根据下标值获取节点
-        listNode *ln = listIndex(o->ptr,index);
-        if (ln != NULL) {
-            value = listNodeValue(ln);
-            addReplyBulk(c,value);
-        } else {
-            addReply(c,shared.nullbulk);
-        }
     } else {
         redisPanic("Unknown list encoding");
     }
@@ -582,35 +402,16 @@ void lsetCommand(redisClient *c) {
     if ((getLongFromObjectOrReply(c, c->argv[2], &index, NULL) != REDIS_OK))
         return;
 
-    // 检查保存value值后是否需要编码转换
-    listTypeTryConversion(o,value);
-    // 不需要编码转换，直接在ziplis中更新
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-        unsigned char *p, *zl = o->ptr;
-        p = ziplistIndex(zl,index);
-        if (p == NULL) {
-            addReply(c,shared.outofrangeerr);
-        } else {
-        	// ziplist的节点更新操作：先删除旧值再插入新值
-            o->ptr = ziplistDelete(o->ptr,&p);
-            value = getDecodedObject(value);
-            o->ptr = ziplistInsert(o->ptr,p,value->ptr,sdslen(value->ptr));
-            decrRefCount(value);
-            addReply(c,shared.ok);
-            signalModifiedKey(c->db,c->argv[1]);
-            notifyKeyspaceEvent(REDIS_NOTIFY_LIST,"lset",c->argv[1],c->db->id);
-            server.dirty++;
-        }
-    } 
-    // 处理底层结构为linked list的情况
-    else if (o->encoding == REDIS_ENCODING_LINKEDLIST) {
-        listNode *ln = listIndex(o->ptr,index);
-        if (ln == NULL) {
+    if (o->encoding == REDIS_ENCODING_QUICKLIST) {
+        quicklist *ql = o->ptr;
+        // 在quicklist中先删除旧值再插入新值
+        value = getDecodedObject(value);
+        int replaced = quicklistReplaceAtIndex(ql, index,
+                                               value->ptr, sdslen(value->ptr));
+        decrRefCount(value);
+        if (!replaced) {
             addReply(c,shared.outofrangeerr);
         } else {
-            decrRefCount((robj*)listNodeValue(ln));
-            listNodeValue(ln) = value;
-            incrRefCount(value);
             addReply(c,shared.ok);
             signalModifiedKey(c->db,c->argv[1]);
             notifyKeyspaceEvent(REDIS_NOTIFY_LIST,"lset",c->argv[1],c->db->id);
@@ -698,50 +499,34 @@ void lrangeCommand(redisClient *c) {
 
     /* Return the result in form of a multi-bulk reply */
     addReplyMultiBulkLen(c,rangelen);
-    // 处理底层结构为ziplist的情况
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-    	// 获取指定索引值的节点指针
-        unsigned char *p = ziplistIndex(o->ptr,start);
-        unsigned char *vstr;
-        unsigned int vlen;
-        long long vlong;
+    if (o->encoding == REDIS_ENCODING_QUICKLIST) {
+        /* If we are nearest to the end of the list, reach the element
+         * starting from tail and going backward, as it is faster. */
+        // 和原来linked list的处理一样：如果start离尾部更近，则使用负数索引从尾部开始定位
+        listTypeIterator *iter = listTypeInitIterator(o,
+            (start > llen/2) ? start-llen : start, REDIS_TAIL);
 
         // 遍历下标范围为[start, end]的元素，将其值添加到回复中
         while(rangelen--) {
-            ziplistGet(p,&vstr,&vlen,&vlong);
-            if (vstr) {
-                addReplyBulkCBuffer(c,vstr,vlen);
+            listTypeEntry entry;
+            listTypeNext(iter, &entry);
+            quicklistEntry *qe = &entry.entry;
+            if (qe->value) {
+                addReplyBulkCBuffer(c,qe->value,qe->sz);
             } else {
-                addReplyBulkLongLong(c,vlong);
+                addReplyBulkLongLong(c,qe->longval);
             }
-            p = ziplistNext(o->ptr,p);
-        }
-    } 
-    // 处理底层结构为linked list的情况
-    else if (o->encoding == REDIS_ENCODING_LINKEDLIST) {
-        listNode *ln;
-
-        /* If we are nearest to the end of the list, reach the element
-         * starting from tail and going backward, as it is faster. */
-        // 注意这里有一个加速查找的小技巧：如果start离linked list尾部近，则从其尾部开始查找
-        if (start > llen/2) start -= llen;
-        ln = listIndex(o->ptr,start);
-
-        while(rangelen--) {
-            addReplyBulk(c,ln->value);
-            ln = ln->next;
         }
+        listTypeReleaseIterator(iter);
     } else {
-        redisPanic("List encoding is not LINKEDLIST nor ZIPLIST!");
+        redisPanic("List encoding is not QUICKLIST!");
     }
 }
 
 /* ltrim命令实现 */
 void ltrimCommand(redisClient *c) {
     robj *o;
-    long start, end, llen, j, ltrim, rtrim;
-    list *list;
-    listNode *ln;
+    long start, end, llen, ltrim, rtrim;
 
     // 获取下标范围，主要是star开始下标值和end结束下标值
     if ((getLongFromObjectOrReply(c, c->argv[2], &start, NULL) != REDIS_OK) ||
@@ -774,25 +559,10 @@ void ltrimCommand(redisClient *c) {
     }
 
     /* Remove list elements to perform the trim */
-    // 处理底层结构为ziplist的情况
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-    	// 分别删除ziplis头部和尾部“多余”的元素
-        o->ptr = ziplistDeleteRange(o->ptr,0,ltrim);
-        o->ptr = ziplistDeleteRange(o->ptr,-rtrim,rtrim);
-    } 
-    // 处理底层结构为linked list的情形
-    else if (o->encoding == REDIS_ENCODING_LINKEDLIST) {
-        list = o->ptr;
-        // 删除左端元素
-        for (j = 0; j < ltrim; j++) {
-            ln = listFirst(list);
-            listDelNode(list,ln);
-        }
-        // 删除右端元素
-        for (j = 0; j < rtrim; j++) {
-            ln = listLast(list);
-            listDelNode(list,ln);
-        }
+    if (o->encoding == REDIS_ENCODING_QUICKLIST) {
+    	// 分别删除quicklist头部和尾部“多余”的元素，被完整覆盖的节点会被整个删除
+        quicklistDelRange(o->ptr,0,ltrim);
+        quicklistDelRange(o->ptr,-rtrim,rtrim);
     } else {
         redisPanic("Unknown list encoding");
     }
@@ -825,9 +595,8 @@ void lremCommand(redisClient *c) {
     subject = lookupKeyWriteOrReply(c,c->argv[1],shared.czero);
     if (subject == NULL || checkType(c,subject,REDIS_LIST)) return;
 
-    /* Make sure obj is raw when we're dealing with a ziplist */
-    if (subject->encoding == REDIS_ENCODING_ZIPLIST)
-        obj = getDecodedObject(obj);
+    /* Make sure obj is raw when we're dealing with a quicklist */
+    obj = getDecodedObject(obj);
 
     listTypeIterator *li;
     // 确定从表头开始删除还是从表尾开始删除
@@ -852,8 +621,7 @@ void lremCommand(redisClient *c) {
     listTypeReleaseIterator(li);
 
     /* Clean up raw encoded object */
-    if (subject->encoding == REDIS_ENCODING_ZIPLIST)
-        decrRefCount(obj);
+    decrRefCount(obj);
 
     // 如果listType为空，则从db中删除
     if (listTypeLength(subject) == 0) dbDelete(c->db,c->argv[1]);
@@ -882,7 +650,7 @@ void rpoplpushHandlePush(redisClient *c, robj *dstkey, robj *dstobj, robj *value
     /* Create the list if the key does not exist */
     /* 如果目标节点不存在则创建一个并加入到db中 */
     if (!dstobj) {
-        dstobj = createZiplistObject();
+        dstobj = createQuicklistObject();
         dbAdd(c->db,dstkey,dstobj);
     }
     signalModifiedKey(c->db,dstkey);
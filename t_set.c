@@ -33,8 +33,12 @@
  * Set Commands  集合set命令
  *----------------------------------------------------------------------------*/
 
- /* Set数据类型有两种编码方式：REDIS_ENCODING_INSET和REDIS_ENCODING_HT，在下面的注释中我们分别称之为inset编码和dict编码。 
-    当使用dict编码的时候，往集合中插入一个元素key相当于往dict中插入<key, NULL>这样一个键值对。*/
+ /* Set数据类型有三种编码方式：REDIS_ENCODING_INSET、REDIS_ENCODING_ROARING和REDIS_ENCODING_HT，在下面的注释中我们分别称之为
+    inset编码、roaring编码和dict编码。 
+    当使用dict编码的时候，往集合中插入一个元素key相当于往dict中插入<key, NULL>这样一个键值对。
+    只包含整数的集合在元素个数超过set_max_intset_entries后转换为roaring编码，而不是dict编码，
+    roaring位图中每个元素最多只占用2个字节，而dict编码中每个元素都是一个字符串对象。
+    一旦往intset或roaring编码的集合中插入非整数元素，集合就会转换为dict编码。*/
 
 void sunionDiffGenericCommand(redisClient *c, robj **setkeys, int setnum, robj *dstkey, int op);
 
@@ -71,9 +75,9 @@ int setTypeAdd(robj *subject, robj *value) {
             if (success) {
                 /* Convert to regular set when the intset contains
                  * too many entries. */
-                // 如果inset中元素个数超过set_max_intset_entries（默认值为512）时，转换为dict编码
+                // 如果inset中元素个数超过set_max_intset_entries（默认值为512）时，转换为roaring编码
                 if (intsetLen(subject->ptr) > server.set_max_intset_entries)
-                    setTypeConvert(subject,REDIS_ENCODING_HT);
+                    setTypeConvert(subject,REDIS_ENCODING_ROARING);
                 return 1;
             }
         } 
@@ -90,6 +94,16 @@ int setTypeAdd(robj *subject, robj *value) {
             incrRefCount(value);
             return 1;
         }
+    }
+    // 处理roaring编码的情况，与intset编码一样，插入非整数元素时需要先转换为dict编码
+    else if (subject->encoding == REDIS_ENCODING_ROARING) {
+        if (isObjectRepresentableAsLongLong(value,&llval) == REDIS_OK)
+            return roaringAdd(subject->ptr,llval);
+
+        setTypeConvert(subject,REDIS_ENCODING_HT);
+        redisAssertWithInfo(NULL,value,dictAdd(subject->ptr,value,NULL) == DICT_OK);
+        incrRefCount(value);
+        return 1;
     } else {
         redisPanic("Unknown set encoding");
     }
@@ -116,6 +130,11 @@ int setTypeRemove(robj *setobj, robj *value) {
             setobj->ptr = intsetRemove(setobj->ptr,llval,&success);
             if (success) return 1;
         }
+    } 
+    // 处理roaring编码的情况
+    else if (setobj->encoding == REDIS_ENCODING_ROARING) {
+        if (isObjectRepresentableAsLongLong(value,&llval) == REDIS_OK)
+            return roaringRemove(setobj->ptr,llval);
     } else {
         redisPanic("Unknown set encoding");
     }
@@ -135,6 +154,11 @@ int setTypeIsMember(robj *subject, robj *value) {
         if (isObjectRepresentableAsLongLong(value,&llval) == REDIS_OK) {
             return intsetFind((intset*)subject->ptr,llval);
         }
+    } 
+    // 处理roaring编码的情况
+    else if (subject->encoding == REDIS_ENCODING_ROARING) {
+        if (isObjectRepresentableAsLongLong(value,&llval) == REDIS_OK)
+            return roaringContains(subject->ptr,llval);
     } else {
         redisPanic("Unknown set encoding");
     }
@@ -157,6 +181,10 @@ setTypeIterator *setTypeInitIterator(robj *subject) {
     else if (si->encoding == REDIS_ENCODING_INTSET) {
         // 设置索引值
         si->ii = 0;
+    } 
+    // 处理roaring编码的情况，从最小的元素开始迭代
+    else if (si->encoding == REDIS_ENCODING_ROARING) {
+        roaringIterInit(&si->ri,subject->ptr,INT64_MIN);
     } else {
         redisPanic("Unknown set encoding");
     }
@@ -185,6 +213,7 @@ void setTypeReleaseIterator(setTypeIterator *si) {
 
     由于集合set可能是dict编码或者intset编码，所以该函数返回set集合对象的编码方式，方便调用者判断。
     如果set对象的inset编码，则将当前元素保存在参数llele中，如果set对象是dict编码，则将当前元素保存在objele中。
+    roaring编码的集合同样把元素保存在llele中，并且同样返回REDIS_ENCODING_INTSET，这样调用者只需要根据返回值区分整数和对象两种情况。
 
     当集合中如果没有别的元素则返回-1。该函数所返回的对象并没有增加其引用计数值。*/
 int setTypeNext(setTypeIterator *si, robj **objele, int64_t *llele) {
@@ -200,6 +229,12 @@ int setTypeNext(setTypeIterator *si, robj **objele, int64_t *llele) {
         // 注意si->ii++，表示先获取下标为ii的元素，再使迭代器移动到下一个元素
         if (!intsetGet(si->subject->ptr,si->ii++,llele))
             return -1;
+    } 
+    // 处理roaring编码的情况
+    else if (si->encoding == REDIS_ENCODING_ROARING) {
+        if (!roaringIterNext(&si->ri,llele))
+            return -1;
+        return REDIS_ENCODING_INTSET;
     }
     return si->encoding;
 }
@@ -254,6 +289,8 @@ robj *setTypeNextObject(setTypeIterator *si) {
     调用者需要提供参数objele和llele供函数存放相应的对象。函数的返回值是setType对象的编码方式，
     这样调用者就可以方便地判断出那个指针保存了元素的值。
 
+    roaring编码的集合与intset编码一样把元素保存在参数llele中，并返回REDIS_ENCODING_INTSET。
+
     该函数并没有增加所返回对象的引用计数值，所以这个函数可以视为copy-on-write友好的。*/
 int setTypeRandomElement(robj *setobj, robj **objele, int64_t *llele) {
     // 处理dict编码的情况
@@ -267,6 +304,11 @@ int setTypeRandomElement(robj *setobj, robj **objele, int64_t *llele) {
     else if (setobj->encoding == REDIS_ENCODING_INTSET) {
         // 调用inset内部函数实现
         *llele = intsetRandom(setobj->ptr);
+    } 
+    // 处理roaring编码的情况
+    else if (setobj->encoding == REDIS_ENCODING_ROARING) {
+        *llele = roaringRandom(setobj->ptr);
+        return REDIS_ENCODING_INTSET;
     } else {
         redisPanic("Unknown set encoding");
     }
@@ -280,6 +322,8 @@ unsigned long setTypeSize(robj *subject) {
         return dictSize((dict*)subject->ptr);
     } else if (subject->encoding == REDIS_ENCODING_INTSET) {
         return intsetLen((intset*)subject->ptr);
+    } else if (subject->encoding == REDIS_ENCODING_ROARING) {
+        return roaringCard((roaring*)subject->ptr);
     } else {
         redisPanic("Unknown set encoding");
     }
@@ -288,15 +332,16 @@ unsigned long setTypeSize(robj *subject) {
 /* Convert the set to specified encoding. The resulting dict (when converting
  * to a hash table) is presized to hold the number of elements in the original
  * set. */
-/*  将集合set转换为指定的编码方式，从实现上看，该函数只能讲inset编码的set转换为dict编码。
+/*  将集合set转换为指定的编码方式，支持intset编码转换为roaring编码或dict编码，以及roaring编码转换为dict编码。
     新创建的dict会被预先分配与原集合元素个数一样大的空间。*/
 void setTypeConvert(robj *setobj, int enc) {
     setTypeIterator *si;
     // 检查参数setobj对象的类型和编码方式
     redisAssertWithInfo(NULL,setobj,setobj->type == REDIS_SET &&
-                             setobj->encoding == REDIS_ENCODING_INTSET);
+                             (setobj->encoding == REDIS_ENCODING_INTSET ||
+                              setobj->encoding == REDIS_ENCODING_ROARING));
 
-    // 只支持目标编码方式为dict编码的转换
+    // 转换为dict编码
     if (enc == REDIS_ENCODING_HT) {
         int64_t intele;
         // 创建一个dict
@@ -305,7 +350,7 @@ void setTypeConvert(robj *setobj, int enc) {
 
         /* Presize the dict to avoid rehashing */
         // 预先分配与原集合元素个数一样大的空间，避免在插入元素过程中发生rehashing操作
-        dictExpand(d,intsetLen(setobj->ptr));
+        dictExpand(d,setTypeSize(setobj));
 
         /* To add the elements we extract integers and create redis objects */
         // 遍历原集合中的每个元素并插入到dict中
@@ -318,9 +363,22 @@ void setTypeConvert(robj *setobj, int enc) {
         setTypeReleaseIterator(si);
 
         // 更新原对象的编码方式
+        if (setobj->encoding == REDIS_ENCODING_INTSET)
+            zfree(setobj->ptr);
+        else
+            roaringFree(setobj->ptr);
         setobj->encoding = REDIS_ENCODING_HT;
-        zfree(setobj->ptr);
         setobj->ptr = d;
+    } 
+    // intset编码转换为roaring编码
+    else if (enc == REDIS_ENCODING_ROARING &&
+               setobj->encoding == REDIS_ENCODING_INTSET)
+    {
+        roaring *r = roaringFromIntset(setobj->ptr);
+
+        zfree(setobj->ptr);
+        setobj->encoding = REDIS_ENCODING_ROARING;
+        setobj->ptr = r;
     } else {
         redisPanic("Unsupported set conversion");
     }
@@ -503,7 +561,10 @@ void spopCommand(redisClient *c) {
     // 从原集合中删除该元素
     if (encoding == REDIS_ENCODING_INTSET) {
         ele = createStringObjectFromLongLong(llele);
-        set->ptr = intsetRemove(set->ptr,llele,NULL);
+        if (set->encoding == REDIS_ENCODING_ROARING)
+            roaringRemove(set->ptr,llele);
+        else
+            set->ptr = intsetRemove(set->ptr,llele,NULL);
     } else {
         incrRefCount(ele);
         setTypeRemove(set,ele);
@@ -744,6 +805,80 @@ int qsortCompareSetsByRevCardinality(const void *s1, const void *s2) {
     return  (o2 ? setTypeSize(o2) : 0) - (o1 ? setTypeSize(o1) : 0);
 }
 
+/* Return a bitmask with the bit (1<<encoding) set for every encoding used by
+ * the given sets, NULL entries (non existing keys) are ignored. */
+/*  返回给定集合所使用的编码的掩码，每种编码对应(1<<encoding)这一位，NULL（即不存在的key）不计入 */
+static int setsEncodingMask(robj **sets, unsigned long setnum) {
+    unsigned long j;
+    int mask = 0;
+
+    for (j = 0; j < setnum; j++)
+        if (sets[j]) mask |= 1<<sets[j]->encoding;
+    return mask;
+}
+
+/* Replace the content of the intset or roaring encoded set "o" with the
+ * result "r" of a roaring set operation, that is stored as an intset if
+ * small enough. Takes ownership of "r". */
+/*  用roaring集合运算的结果r替换intset或roaring编码的集合o的内容，如果结果足够小则转换为intset编码保存。
+    r由该函数负责释放。 */
+static void setTypeSetRoaring(robj *o, roaring *r) {
+    if (o->encoding == REDIS_ENCODING_INTSET)
+        zfree(o->ptr);
+    else
+        roaringFree(o->ptr);
+
+    if (roaringCard(r) <= server.set_max_intset_entries) {
+        o->ptr = roaringToIntset(r);
+        o->encoding = REDIS_ENCODING_INTSET;
+        roaringFree(r);
+    } else {
+        o->ptr = r;
+        o->encoding = REDIS_ENCODING_ROARING;
+    }
+}
+
+/* Intersect the intsets of all the given sets, that must be sorted from the
+ * smallest to the largest. Every step is a sorted merge whose result can
+ * only shrink, and we stop as soon as it becomes empty. Always returns a new
+ * intset. */
+/*  计算所有给定集合（必须都是intset编码，并且已经按元素个数从少到多排序）的交集。
+    每一步都是两个有序数组的归并，中间结果只会越来越小，一旦为空就可以直接结束。总是返回一个新的intset。 */
+static intset *sinterIntsets(robj **sets, unsigned long setnum) {
+    intset *res = NULL;
+    unsigned long j;
+
+    for (j = 1; j < setnum; j++) {
+        intset *tmp;
+
+        if (sets[j] == sets[0]) continue;
+        tmp = intsetIntersect(res ? res : sets[0]->ptr,sets[j]->ptr);
+        if (res) zfree(res);
+        res = tmp;
+        if (intsetLen(res) == 0) break;
+    }
+    return res ? res : intsetDup(sets[0]->ptr);
+}
+
+/* Same as sinterIntsets() for sets that are all roaring encoded. The
+ * intersection of the bitmap containers is computed a word at a time. */
+/*  与sinterIntsets相同，用于所有集合都是roaring编码的情况，bitmap容器之间按64位的字计算交集 */
+static roaring *sinterRoarings(robj **sets, unsigned long setnum) {
+    roaring *res = NULL;
+    unsigned long j;
+
+    for (j = 1; j < setnum; j++) {
+        roaring *tmp;
+
+        if (sets[j] == sets[0]) continue;
+        tmp = roaringAnd(res ? res : sets[0]->ptr,sets[j]->ptr);
+        if (res) roaringFree(res);
+        res = tmp;
+        if (roaringCard(res) == 0) break;
+    }
+    return res ? res : roaringDup(sets[0]->ptr);
+}
+
 /*  sinter命令，返回所有给定集合的交集中的所有成员。
     参数setkey为给定的所有集合所分别关联的key，参数setnum指明输入集合的个数。
     参数dstkey主要用于sinterstore，用来存放给定所有集合的交集。 */
@@ -804,6 +939,50 @@ void sinterGenericCommand(redisClient *c, robj **setkeys, unsigned long setnum,
         dstset = createIntsetObject();
     }
 
+    /* When all the sets are intsets the intersection is computed merging
+     * the sorted arrays instead of probing every element. */
+    // 如果所有集合都是intset编码，直接对有序数组做归并求交集，不需要逐个元素查找
+    if (setsEncodingMask(sets,setnum) == (1<<REDIS_ENCODING_INTSET)) {
+        intset *is = sinterIntsets(sets,setnum);
+
+        if (!dstkey) {
+            for (j = 0; j < intsetLen(is); j++) {
+                intsetGet(is,j,&intobj);
+                addReplyBulkLongLong(c,intobj);
+            }
+            setDeferredMultiBulkLength(c,replylen,intsetLen(is));
+            zfree(is);
+            zfree(sets);
+            return;
+        }
+        zfree(dstset->ptr);
+        dstset->ptr = is;
+        goto store;
+    }
+
+    /* Same for roaring encoded sets. When intsets and roaring bitmaps are
+     * mixed the smallest set is usually an intset, and probing its few
+     * elements below is the fastest way. */
+    // roaring编码的集合同理。如果intset和roaring编码的集合混合在一起，最小的集合通常是intset编码的，
+    // 使用下面的方法逐个查找它的元素是最快的
+    if (setsEncodingMask(sets,setnum) == (1<<REDIS_ENCODING_ROARING)) {
+        roaring *r = sinterRoarings(sets,setnum);
+
+        if (!dstkey) {
+            roaringIterator it;
+
+            roaringIterInit(&it,r,INT64_MIN);
+            while (roaringIterNext(&it,&intobj))
+                addReplyBulkLongLong(c,intobj);
+            setDeferredMultiBulkLength(c,replylen,roaringCard(r));
+            roaringFree(r);
+            zfree(sets);
+            return;
+        }
+        setTypeSetRoaring(dstset,r);
+        goto store;
+    }
+
     /* Iterate all the elements of the first (smallest) set, and test
      * the element against all the other sets, if at least one set does
      * not include the element it is discarded */
@@ -826,6 +1005,10 @@ void sinterGenericCommand(redisClient *c, robj **setkeys, unsigned long setnum,
                     !intsetFind((intset*)sets[j]->ptr,intobj))
                 {
                     break;
+                } else if (sets[j]->encoding == REDIS_ENCODING_ROARING &&
+                           !roaringContains((roaring*)sets[j]->ptr,intobj))
+                {
+                    break;
                 /* in order to compare an integer with an object we
                  * have to use the generic function, creating an object
                  * for this */
@@ -849,6 +1032,11 @@ void sinterGenericCommand(redisClient *c, robj **setkeys, unsigned long setnum,
                     !intsetFind((intset*)sets[j]->ptr,(long)eleobj->ptr))
                 {
                     break;
+                } else if (eleobj->encoding == REDIS_ENCODING_INT &&
+                           sets[j]->encoding == REDIS_ENCODING_ROARING &&
+                           !roaringContains((roaring*)sets[j]->ptr,(long)eleobj->ptr))
+                {
+                    break;
                 /* else... object to object check is easy as we use the
                  * type agnostic API here. */
                 } else if (!setTypeIsMember(sets[j],eleobj)) {
@@ -884,6 +1072,7 @@ void sinterGenericCommand(redisClient *c, robj **setkeys, unsigned long setnum,
     }
     setTypeReleaseIterator(si);
 
+store:
     // 目标集合dstkey不为空，执行sinterstore命令，需要将目标集合添加到数据库中
     if (dstkey) {
         /* Store the resulting set into the target, if the intersection
@@ -929,6 +1118,91 @@ void sinterstoreCommand(redisClient *c) {
 #define REDIS_OP_DIFF 1     // 差集
 #define REDIS_OP_INTER 2    // 交集
 
+/* Union of sets that are all intset or roaring encoded (or NULL) into the
+ * empty intset encoded "dstset". Intsets are merged while the result is small
+ * enough, then the result moves to a roaring bitmap. */
+/*  计算所有intset或roaring编码的集合（或者NULL）的并集，结果保存在intset编码的空集合dstset中。
+    结果较小的时候直接归并intset，超出intset的元素个数限制后改用roaring位图继续计算。 */
+static void sunionIntegerSets(robj *dstset, robj **sets, int setnum) {
+    roaring *r = NULL, *tmp;
+    int64_t llval;
+    uint32_t ii;
+    int j;
+
+    for (j = 0; j < setnum; j++) {
+        if (!sets[j]) continue;
+
+        if (!r && sets[j]->encoding == REDIS_ENCODING_INTSET) {
+            intset *is = intsetUnion(dstset->ptr,sets[j]->ptr);
+
+            zfree(dstset->ptr);
+            dstset->ptr = is;
+            // 并集超出了intset的元素个数限制，改用roaring位图继续计算
+            if (intsetLen(is) > server.set_max_intset_entries)
+                r = roaringFromIntset(is);
+            continue;
+        }
+        if (!r) r = roaringFromIntset(dstset->ptr);
+        if (sets[j]->encoding == REDIS_ENCODING_INTSET) {
+            // intset中的元素不多，直接添加到结果中
+            for (ii = 0; intsetGet(sets[j]->ptr,ii,&llval); ii++)
+                roaringAdd(r,llval);
+        } else {
+            tmp = roaringOr(r,sets[j]->ptr);
+            roaringFree(r);
+            r = tmp;
+        }
+    }
+    if (r) setTypeSetRoaring(dstset,r);
+}
+
+/* Difference sets[0] - sets[1] - ... for sets that are all intset or roaring
+ * encoded (or NULL, but sets[0] must exist) into the empty intset encoded
+ * "dstset". */
+/*  计算sets[0] - sets[1] - ...，所有集合都是intset或roaring编码（或者NULL，但sets[0]必须存在），
+    结果保存在intset编码的空集合dstset中。 */
+static void sdiffIntegerSets(robj *dstset, robj **sets, int setnum) {
+    int64_t llval;
+    uint32_t ii;
+    int j;
+
+    // 结果是sets[0]的子集，sets[0]是intset编码时结果也用intset保存
+    if (sets[0]->encoding == REDIS_ENCODING_INTSET) {
+        intset *is = intsetDup(sets[0]->ptr), *tmp;
+
+        for (j = 1; j < setnum && intsetLen(is); j++) {
+            if (!sets[j]) continue;
+            if (sets[j]->encoding == REDIS_ENCODING_INTSET) {
+                tmp = intsetDifference(is,sets[j]->ptr);
+            } else {
+                tmp = intsetNew();
+                for (ii = 0; intsetGet(is,ii,&llval); ii++)
+                    if (!roaringContains(sets[j]->ptr,llval))
+                        tmp = intsetAdd(tmp,llval,NULL);
+            }
+            zfree(is);
+            is = tmp;
+        }
+        zfree(dstset->ptr);
+        dstset->ptr = is;
+    } else {
+        roaring *r = roaringDup(sets[0]->ptr), *tmp;
+
+        for (j = 1; j < setnum && roaringCard(r); j++) {
+            if (!sets[j]) continue;
+            if (sets[j]->encoding == REDIS_ENCODING_INTSET) {
+                for (ii = 0; intsetGet(sets[j]->ptr,ii,&llval); ii++)
+                    roaringRemove(r,llval);
+            } else {
+                tmp = roaringAndNot(r,sets[j]->ptr);
+                roaringFree(r);
+                r = tmp;
+            }
+        }
+        setTypeSetRoaring(dstset,r);
+    }
+}
+
 /*  参数setkeys是给定的所有集合所关联的key数组。
     参数setnum指明了输入集合的数量。
     参数dstkey主要用于XXXstore命令，指明目标集合所关联的key。
@@ -1007,8 +1281,19 @@ void sunionDiffGenericCommand(redisClient *c, robj **setkeys, int setnum, robj *
     // 当做结果集合关联到目标key上
     dstset = createIntsetObject();
 
+    /* When all the existing sets hold only integers (intset or roaring
+     * encoded) the union or the difference is computed merging the sorted
+     * intsets and the roaring containers. */
+    // 如果所有存在的集合都只包含整数（intset或roaring编码），直接对有序的intset和roaring容器做归并求并集或差集
+    if (!(setsEncodingMask(sets,setnum) & (1<<REDIS_ENCODING_HT))) {
+        if (op == REDIS_OP_UNION)
+            sunionIntegerSets(dstset,sets,setnum);
+        else if (sets[0])
+            sdiffIntegerSets(dstset,sets,setnum);
+        cardinality = setTypeSize(dstset);
+    }
     // 执行union操作，求并集
-    if (op == REDIS_OP_UNION) {
+    else if (op == REDIS_OP_UNION) {
         /* Union is trivial, just add every element of every set to the
          * temporary set. */
         // union操作就是讲所有集合中的所有元素注意添加到临时集合dstset中（集合对象自己会负责取出重复数据）
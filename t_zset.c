@@ -69,14 +69,194 @@
 static int zslLexValueGteMin(robj *value, zlexrangespec *spec);
 static int zslLexValueLteMax(robj *value, zlexrangespec *spec);
 
-/*	创建一个层数为level的跳跃表节点，并设置该节点的分值、元素值。*/
-zskiplistNode *zslCreateNode(int level, double score, robj *obj) {
-	// zskiplistNode中的level数组并不是固定大小的，而是可变大小的，每次创建节点需要动态计算
-	//	level*sizeof(struct zskiplistLevel)为level[]所占用空间
-    zskiplistNode *zn = zmalloc(sizeof(*zn)+level*sizeof(struct zskiplistLevel));
-    // 设置分值、节点数据
+/* ---------------------------- Skiplist node pool ----------------------------
+ *
+ * Skiplist nodes are not allocated one by one with zmalloc(): every skiplist
+ * owns a pool made of large slabs, and nodes are carved out of the current
+ * slab with a bump pointer. Freed nodes are kept in per-level free lists and
+ * reused by the next node of the same level, so the size of the node always
+ * matches exactly. Nodes inserted close in time end up close in memory, there
+ * is no per-node allocator header, and zslFree() releases the whole skiplist
+ * by freeing a handful of slabs.
+ *
+ * Memory of deleted nodes is only returned to the allocator when the skiplist
+ * itself is freed (or converted back to a listpack), and the free lists of one
+ * skiplist can't serve another one. To bound that waste the slabs of a pool
+ * add up to at most ZSL_POOL_MAX_BYTES: once the cap is reached (and the free
+ * list of the level is empty) nodes are allocated one by one with zmalloc(),
+ * flagged with ZSL_NODE_HEAP, and given back with zfree() as soon as they are
+ * deleted. Small skiplists, the common case, live entirely in the pool.
+ *
+ * 跳跃表节点不再逐个调用zmalloc分配：每个跳跃表拥有一个内存池，内存池由若干个大块slab组成，
+ * 新节点直接从当前slab中按顺序切分出来。被释放的节点按层数挂到对应的空闲链表上，供下一个相同层数的节点复用，
+ * 因此节点的大小总是完全匹配的。这样做的好处是：先后插入的节点在内存中相邻，没有分配器的额外头部开销，
+ * 释放整个跳跃表时也只需要释放少量的slab。
+ * 被删除节点占用的内存只有在跳跃表被释放（或转换回listpack）时才归还，而且一个跳跃表的空闲链表不能被其他跳跃表使用。
+ * 为了限制这部分浪费，每个内存池的slab总大小不超过ZSL_POOL_MAX_BYTES：达到上限后（且对应层数的空闲链表为空），
+ * 节点改为逐个调用zmalloc分配，并打上ZSL_NODE_HEAP标记，删除时立即zfree归还。常见的小跳跃表全部在内存池中分配。
+ * ------------------------------------------------------------------------- */
+
+/* slab的初始大小，每申请一个新slab大小翻倍；一个内存池中所有slab的总大小不超过ZSL_POOL_MAX_BYTES */
+#define ZSL_POOL_MIN_SLAB (4*1024)
+#define ZSL_POOL_MAX_BYTES (256*1024)
+
+/* slab头部，slab之间通过next指针串联起来，节点数据紧跟在头部之后 */
+typedef struct zslSlab {
+    struct zslSlab *next;
+    size_t size;
+} zslSlab;
+
+/* 跳跃表节点内存池 */
+typedef struct zslPool {
+    // 已分配的slab链表
+    zslSlab *slabs;
+    // 当前slab中尚未使用的内存区间[cur, end)
+    char *cur, *end;
+    // 下一个slab的大小
+    size_t next_slab;
+    // 所有slab的总大小，以及超出上限后逐个用zmalloc分配的节点总大小
+    size_t slab_bytes, heap_bytes;
+    // 按层数划分的空闲节点链表，空闲节点通过backward指针串联
+    zskiplistNode *free[ZSKIPLIST_MAXLEVEL+1];
+} zslPool;
+
+/* The node prefix packs the first 7 bytes of the member (big endian, zero
+ * padded) in the high 56 bits, and the level of the node in the low 8 bits.
+ * Comparing the prefixes of two members gives the same result memcmp() would
+ * on those bytes, so most comparisons during the descent are resolved by
+ * reading the node itself, without touching the robj and its sds. */
+/* The ZSL_NODE_HEAP bit of the low byte marks nodes allocated with zmalloc()
+ * because the pool was full; the level only needs the other 7 bits. */
+/*  节点的prefix字段：高56位保存成员的前7个字节（大端序，不足补0），低8位保存节点的层数。
+    低8位中的ZSL_NODE_HEAP位标记内存池已满时用zmalloc单独分配的节点，层数只需要其余7位。
+    比较两个成员的前缀与memcmp比较这几个字节的结果一致，因此在逐层查找的过程中大部分比较只需读取节点本身，
+    无需访问robj和sds。只有前缀相同时才需要调用compareStringObjects做完整比较。*/
+#define ZSL_PREFIX_MASK (~(uint64_t)0xff)
+#define zslNodePrefix(n) ((n)->prefix & ZSL_PREFIX_MASK)
+#define ZSL_NODE_HEAP 0x80
+#define zslNodeLevel(n) ((int)((n)->prefix & 0x7f))
+#define zslNodeIsHeap(n) (((n)->prefix & ZSL_NODE_HEAP) != 0)
+
+/* Prefetch the next node of the current level while comparing with the
+ * current one, hiding part of the cache miss of the next step. */
+/* 在比较当前节点时预取同一层的下一个节点，隐藏下一步的部分缓存未命中延迟 */
+#if defined(__GNUC__)
+#define zslPrefetch(p) __builtin_prefetch(p)
+#else
+#define zslPrefetch(p) ((void)(p))
+#endif
+
+/* 计算成员对象obj的前缀，低8位为0 */
+static uint64_t zslObjPrefix(robj *obj) {
+    char buf[32], *p;
+    size_t len, j;
+    uint64_t prefix = 0;
+
+    if (sdsEncodedObject(obj)) {
+        p = obj->ptr;
+        len = sdslen(p);
+    } else {
+        len = ll2string(buf,sizeof(buf),(long)obj->ptr);
+        p = buf;
+    }
+    if (len > 7) len = 7;
+    for (j = 0; j < len; j++)
+        prefix |= (uint64_t)(unsigned char)p[j] << (56-j*8);
+    return prefix;
+}
+
+/* Compare the member of node 'x' with 'obj', whose prefix is 'prefix'.
+ * Same return value semantic as compareStringObjects(). */
+/* 比较节点x的成员与obj，prefix为obj的前缀，返回值含义与compareStringObjects相同 */
+static inline int zslCompareNode(zskiplistNode *x, uint64_t prefix, robj *obj) {
+    uint64_t xp = zslNodePrefix(x);
+
+    if (xp != prefix) return (xp < prefix) ? -1 : 1;
+    return compareStringObjects(x->obj,obj);
+}
+
+/* 创建一个空的内存池 */
+static zslPool *zslPoolCreate(void) {
+    zslPool *pool = zcalloc(sizeof(*pool));
+
+    pool->next_slab = ZSL_POOL_MIN_SLAB;
+    return pool;
+}
+
+/* 释放内存池以及其中的所有节点，节点引用的成员对象需要由调用者事先释放 */
+static void zslPoolRelease(zslPool *pool) {
+    zslSlab *slab = pool->slabs, *next;
+
+    while(slab) {
+        next = slab->next;
+        zfree(slab);
+        slab = next;
+    }
+    zfree(pool);
+}
+
+/* 节点占用的字节数 */
+static size_t zslNodeSize(int level) {
+    return sizeof(zskiplistNode)+level*sizeof(struct zskiplistLevel);
+}
+
+/* 从内存池中分配一个层数为level的节点：优先复用空闲链表，否则从当前slab中切分；
+ * slab总大小达到上限后改为用zmalloc单独分配。返回节点的prefix低8位已设置好层数和ZSL_NODE_HEAP标记 */
+static zskiplistNode *zslPoolAlloc(zslPool *pool, int level) {
+    size_t size = zslNodeSize(level);
+    zskiplistNode *zn;
+
+    if ((zn = pool->free[level]) != NULL) {
+        pool->free[level] = zn->backward;
+        zn->prefix = level;
+        return zn;
+    }
+    if ((size_t)(pool->end - pool->cur) < size) {
+        zslSlab *slab;
+
+        if (pool->slab_bytes + sizeof(zslSlab)+pool->next_slab > ZSL_POOL_MAX_BYTES) {
+            // 内存池已满，单独分配，删除时直接释放
+            zn = zmalloc(size);
+            pool->heap_bytes += size;
+            zn->prefix = ZSL_NODE_HEAP | level;
+            return zn;
+        }
+        slab = zmalloc(sizeof(zslSlab)+pool->next_slab);
+        slab->size = pool->next_slab;
+        slab->next = pool->slabs;
+        pool->slabs = slab;
+        pool->slab_bytes += sizeof(zslSlab)+slab->size;
+        pool->cur = (char*)(slab+1);
+        pool->end = pool->cur + slab->size;
+        pool->next_slab *= 2;
+    }
+    zn = (zskiplistNode*)pool->cur;
+    pool->cur += size;
+    zn->prefix = level;
+    return zn;
+}
+
+/* 归还一个节点：单独分配的节点直接释放，slab中的节点挂到对应层数的空闲链表中 */
+static void zslPoolFree(zslPool *pool, zskiplistNode *zn) {
+    int level = zslNodeLevel(zn);
+
+    if (zslNodeIsHeap(zn)) {
+        pool->heap_bytes -= zslNodeSize(level);
+        zfree(zn);
+        return;
+    }
+    zn->backward = pool->free[level];
+    pool->free[level] = zn;
+}
+
+/*	创建一个层数为level的跳跃表节点，并设置该节点的分值、元素值。节点内存从跳跃表的内存池中分配。*/
+zskiplistNode *zslCreateNode(zskiplist *zsl, int level, double score, robj *obj) {
+	// zskiplistNode中的level数组并不是固定大小的，而是可变大小的，由内存池根据level计算节点大小
+    zskiplistNode *zn = zslPoolAlloc(zsl->pool,level);
+    // 设置分值、节点数据以及前缀
     zn->score = score;
     zn->obj = obj;
+    zn->prefix = zslObjPrefix(obj) | (zn->prefix & 0xff);
     // 返回节点指针
     return zn;
 }
@@ -88,12 +268,16 @@ zskiplist *zslCreate(void) {
 
     // 分配空间
     zsl = zmalloc(sizeof(*zsl));
+    zsl->pool = zslPoolCreate();
     // 当前最大层数为1，节点数量为0
     zsl->level = 1;
     zsl->length = 0;
     // 列表的初始化需要初始化头部，并使头部每层（根据事先定义的ZSKIPLIST_MAXLEVEL）指向末尾（NULL）
-    // ZSKIPLIST_MAXLEVEL的默认值为32
-    zsl->header = zslCreateNode(ZSKIPLIST_MAXLEVEL,0,NULL);
+    // ZSKIPLIST_MAXLEVEL的默认值为32。头结点不从内存池中分配
+    zsl->header = zmalloc(sizeof(zskiplistNode)+ZSKIPLIST_MAXLEVEL*sizeof(struct zskiplistLevel));
+    zsl->header->score = 0;
+    zsl->header->obj = NULL;
+    zsl->header->prefix = ZSKIPLIST_MAXLEVEL;
     for (j = 0; j < ZSKIPLIST_MAXLEVEL; j++) {
         zsl->header->level[j].forward = NULL;
         zsl->header->level[j].span = 0;
@@ -104,27 +288,42 @@ zskiplist *zslCreate(void) {
     return zsl;
 }
 
-/* 释放指定的跳跃表节点 */
-void zslFreeNode(zskiplistNode *node) {
+/* 释放指定的跳跃表节点，节点内存归还到跳跃表的内存池中 */
+void zslFreeNode(zskiplist *zsl, zskiplistNode *node) {
     decrRefCount(node->obj);
-    zfree(node);
+    zslPoolFree(zsl->pool,node);
 }
 
-/* 释放跳跃表 */
+/* 释放跳跃表：释放每个节点引用的成员对象，slab中的节点随内存池一起释放，单独分配的节点逐个释放 */
 void zslFree(zskiplist *zsl) {
     zskiplistNode *node = zsl->header->level[0].forward, *next;
 
     // 释放表头
     zfree(zsl->header);
-    // 逐一释放每个节点
+    // 逐一释放每个节点的成员对象
     while(node) {
         next = node->level[0].forward;
-        zslFreeNode(node);
+        decrRefCount(node->obj);
+        if (zslNodeIsHeap(node)) zfree(node);
         node = next;
     }
+    zslPoolRelease(zsl->pool);
     zfree(zsl);
 }
 
+/* Return the bytes allocated for the structure of the skiplist: the header,
+ * the pool and its slabs (including the free nodes still kept in them), and
+ * the nodes allocated outside the pool. The member objects are not counted.
+ * The pool keeps both totals, so this is O(1). */
+/*  返回跳跃表结构本身占用的内存字节数：表头、内存池及其slab（包括尚未复用的空闲节点），
+    以及内存池之外单独分配的节点，不包括成员对象。内存池记录了这两部分的总大小，因此该函数是O(1)的。 */
+size_t zslAllocSize(zskiplist *zsl) {
+    zslPool *pool = zsl->pool;
+
+    return sizeof(*zsl) + sizeof(zslPool) + zslNodeSize(ZSKIPLIST_MAXLEVEL) +
+           pool->slab_bytes + pool->heap_bytes;
+}
+
 /* Returns a random level for the new skiplist node we are going to create.
  * The return value of this function is between 1 and ZSKIPLIST_MAXLEVEL
  * (both inclusive), with a powerlaw-alike distribution where higher
@@ -147,6 +346,7 @@ zskiplistNode *zslInsert(zskiplist *zsl, double score, robj *obj) {
     zskiplistNode *update[ZSKIPLIST_MAXLEVEL], *x;
     // 记录沿途跨越的节点数，用来计算新节点的span值
     unsigned int rank[ZSKIPLIST_MAXLEVEL];
+    uint64_t prefix = zslObjPrefix(obj);
     int i, level;
 
     redisAssert(!isnan(score));
@@ -159,10 +359,11 @@ zskiplistNode *zslInsert(zskiplist *zsl, double score, robj *obj) {
         while (x->level[i].forward &&
             (x->level[i].forward->score < score ||
                 (x->level[i].forward->score == score &&
-                compareStringObjects(x->level[i].forward->obj,obj) < 0))) {
+                zslCompareNode(x->level[i].forward,prefix,obj) < 0))) {
         	// 记录跨越的节点数
             rank[i] += x->level[i].span;
             x = x->level[i].forward;
+            zslPrefetch(x->level[i].forward);
         }
        	// update[i]就是要和新节点直接相连的节点
         update[i] = x;
@@ -185,7 +386,7 @@ zskiplistNode *zslInsert(zskiplist *zsl, double score, robj *obj) {
         zsl->level = level;
     }
     // 创建新节点
-    x = zslCreateNode(level,score,obj);
+    x = zslCreateNode(zsl,level,score,obj);
     // 从低往高逐层更新节点指针，类似于链表的插入
     for (i = 0; i < level; i++) {
     	// 设置新节点的forward指针，指向原节点的下一个节点
@@ -216,6 +417,88 @@ zskiplistNode *zslInsert(zskiplist *zsl, double score, robj *obj) {
     return x;
 }
 
+/* Bulk loading of sorted entries. zslBulkEntry, zslBulkSort() and
+ * zslBulkLoad() are declared in redis.h next to zskiplist, since db.c
+ * builds the SCAN PREFIX index with them as well. */
+/*  批量加载已排序的元素。zslBulkEntry、zslBulkSort和zslBulkLoad声明在redis.h中，
+    与zskiplist放在一起，因为db.c构建SCAN PREFIX索引时也会用到它们。*/
+
+/* Order entries the same way zslInsert() orders nodes: by score, then by
+ * member. */
+/* 按照与zslInsert相同的顺序比较两个元素：先比较分值，分值相同再比较成员 */
+static int zslBulkEntryCompare(const void *a, const void *b) {
+    const zslBulkEntry *x = a, *y = b;
+
+    if (x->score != y->score) return (x->score < y->score) ? -1 : 1;
+    if (x->prefix != y->prefix) return (x->prefix < y->prefix) ? -1 : 1;
+    return compareStringObjects(x->obj,y->obj);
+}
+
+/* Sort the n entries of 'e' by (score, member). When 'scoresorted' is true
+ * the array is already ordered by score, and only the runs of entries with
+ * the same score need to be sorted by member. */
+/*  将数组e中的n个元素按(分值,成员)排序。如果scoresorted为真，说明数组已经按分值有序，
+    只需对分值相同的连续元素按成员排序。*/
+void zslBulkSort(zslBulkEntry *e, unsigned long n, int scoresorted) {
+    unsigned long j, start;
+
+    for (j = 0; j < n; j++) e[j].prefix = zslObjPrefix(e[j].obj);
+    if (!scoresorted) {
+        qsort(e,n,sizeof(zslBulkEntry),zslBulkEntryCompare);
+        return;
+    }
+    for (start = 0, j = 1; j <= n; j++) {
+        if (j == n || e[j].score != e[start].score) {
+            if (j-start > 1)
+                qsort(e+start,j-start,sizeof(zslBulkEntry),zslBulkEntryCompare);
+            start = j;
+        }
+    }
+}
+
+/* Append the n entries of 'e', sorted by zslBulkSort(), to the empty
+ * skiplist 'zsl'. Every node goes to the tail, so instead of searching the
+ * insert position from the header we just remember the last node (and its
+ * rank) of every level: the whole load is O(N) and walks memory only
+ * forward. The node of every entry is stored in e[j].node, and the caller
+ * owns the references to the members exactly as with zslInsert(). */
+/*  将数组e中已经排好序的n个元素追加到空跳跃表zsl中。由于每个节点都插入到表尾，这里不需要从表头开始查找插入位置，
+    只需记录每一层的最后一个节点及其排位即可，整个过程的时间复杂度为O(N)。
+    每个元素对应的节点保存在e[j].node中，成员对象的引用计数处理与zslInsert相同，由调用者负责。*/
+void zslBulkLoad(zskiplist *zsl, zslBulkEntry *e, unsigned long n) {
+    zskiplistNode *last[ZSKIPLIST_MAXLEVEL], *x;
+    unsigned long rank[ZSKIPLIST_MAXLEVEL];
+    unsigned long j;
+    int i, level;
+
+    redisAssert(zsl->length == 0);
+    for (i = 0; i < ZSKIPLIST_MAXLEVEL; i++) {
+        last[i] = zsl->header;
+        rank[i] = 0;
+    }
+    for (j = 0; j < n; j++) {
+        redisAssert(!isnan(e[j].score));
+        level = zslRandomLevel();
+        if (level > zsl->level) zsl->level = level;
+        x = zslCreateNode(zsl,level,e[j].score,e[j].obj);
+        x->backward = (j == 0) ? NULL : last[0];
+        for (i = 0; i < level; i++) {
+            x->level[i].forward = NULL;
+            last[i]->level[i].forward = x;
+            last[i]->level[i].span = (j+1) - rank[i];
+            last[i] = x;
+            rank[i] = j+1;
+        }
+        e[j].node = x;
+    }
+    /* The last node of every level spans the nodes that follow it. */
+    // 每一层最后一个节点的span为其后面的节点个数，与zslInsert保持一致
+    for (i = 0; i < zsl->level; i++)
+        last[i]->level[i].span = n - rank[i];
+    zsl->tail = n ? last[0] : NULL;
+    zsl->length = n;
+}
+
 /* Internal function used by zslDelete, zslDeleteByScore and zslDeleteByRank */
 /* 删除节点函数，供zslDelete、zslDeleteByScore和zslDeleteByRank函数调用 */
 void zslDeleteNode(zskiplist *zsl, zskiplistNode *x, zskiplistNode **update) {
@@ -251,6 +534,7 @@ int zslDelete(zskiplist *zsl, double score, robj *obj) {
 
 	// update数组用来保存降层节点指针
     zskiplistNode *update[ZSKIPLIST_MAXLEVEL], *x;
+    uint64_t prefix = zslObjPrefix(obj);
     int i;
 
     // 从高往低逐层查找目标节点，并把降层节点指针保存在update中
@@ -260,8 +544,10 @@ int zslDelete(zskiplist *zsl, double score, robj *obj) {
             (x->level[i].forward->score < score ||
             	// 既比较分值score又比较节点对象
                 (x->level[i].forward->score == score &&
-                compareStringObjects(x->level[i].forward->obj,obj) < 0)))
+                zslCompareNode(x->level[i].forward,prefix,obj) < 0))) {
             x = x->level[i].forward;
+            zslPrefetch(x->level[i].forward);
+        }
         update[i] = x;
     }
     /* We may have multiple elements with the same score, what we need
@@ -272,7 +558,7 @@ int zslDelete(zskiplist *zsl, double score, robj *obj) {
     	// 删除节点
         zslDeleteNode(zsl, x, update);
         // 释放空间
-        zslFreeNode(x);
+        zslFreeNode(zsl,x);
         return 1;
     }
     return 0; /* not found */
@@ -328,8 +614,10 @@ zskiplistNode *zslFirstInRange(zskiplist *zsl, zrangespec *range) {
     for (i = zsl->level-1; i >= 0; i--) {
         /* Go forward while *OUT* of range. */
         while (x->level[i].forward &&
-            !zslValueGteMin(x->level[i].forward->score,range))
+            !zslValueGteMin(x->level[i].forward->score,range)) {
                 x = x->level[i].forward;
+                zslPrefetch(x->level[i].forward);
+        }
     }
 
     /* This is an inner range, so the next node cannot be NULL. */
@@ -359,8 +647,10 @@ zskiplistNode *zslLastInRange(zskiplist *zsl, zrangespec *range) {
     for (i = zsl->level-1; i >= 0; i--) {
         /* Go forward while *IN* range. */
         while (x->level[i].forward &&
-            zslValueLteMax(x->level[i].forward->score,range))
+            zslValueLteMax(x->level[i].forward->score,range)) {
                 x = x->level[i].forward;
+                zslPrefetch(x->level[i].forward);
+        }
     }
 
     /* This is an inner range, so this node cannot be NULL. */
@@ -410,7 +700,7 @@ unsigned long zslDeleteRangeByScore(zskiplist *zsl, zrangespec *range, dict *dic
         zslDeleteNode(zsl,x,update);
         // 删除dict中相应的元素
         dictDelete(dict,x->obj);
-        zslFreeNode(x);
+        zslFreeNode(zsl,x);
         // 记录删除节点个数
         removed++;
         // 指向下一个节点
@@ -447,7 +737,7 @@ unsigned long zslDeleteRangeByLex(zskiplist *zsl, zlexrangespec *range, dict *di
         zskiplistNode *next = x->level[0].forward;
         zslDeleteNode(zsl,x,update);
         dictDelete(dict,x->obj);
-        zslFreeNode(x);
+        zslFreeNode(zsl,x);
         removed++;
         // 继续处理下一个节点
         x = next;
@@ -487,7 +777,7 @@ unsigned long zslDeleteRangeByRank(zskiplist *zsl, unsigned int start, unsigned
         zslDeleteNode(zsl,x,update);
         // 从字典dict中删除节点
         dictDelete(dict,x->obj);
-        zslFreeNode(x);
+        zslFreeNode(zsl,x);
         // 被删除元素个数加1
         removed++;
         // 排位计数加1
@@ -508,6 +798,7 @@ unsigned long zslDeleteRangeByRank(zskiplist *zsl, unsigned int start, unsigned
 unsigned long zslGetRank(zskiplist *zsl, double score, robj *o) {
     zskiplistNode *x;
     unsigned long rank = 0;
+    uint64_t prefix = zslObjPrefix(o);
     int i;
 
     x = zsl->header;
@@ -516,15 +807,16 @@ unsigned long zslGetRank(zskiplist *zsl, double score, robj *o) {
         while (x->level[i].forward &&
             (x->level[i].forward->score < score ||
                 (x->level[i].forward->score == score &&
-                compareStringObjects(x->level[i].forward->obj,o) <= 0))) {
+                zslCompareNode(x->level[i].forward,prefix,o) <= 0))) {
         	// 更新排位信息
             rank += x->level[i].span;
             x = x->level[i].forward;
+            zslPrefetch(x->level[i].forward);
         }
 
         /* x might be equal to zsl->header, so test if obj is non-NULL */
         // x可能指向头结点，需要再次测试
-        if (x->obj && equalStringObjects(x->obj,o)) {
+        if (x->obj && zslNodePrefix(x) == prefix && equalStringObjects(x->obj,o)) {
             return rank;
         }
     }
@@ -546,6 +838,7 @@ zskiplistNode* zslGetElementByRank(zskiplist *zsl, unsigned long rank) {
         {
             traversed += x->level[i].span;
             x = x->level[i].forward;
+            zslPrefetch(x->level[i].forward);
         }
         if (traversed == rank) {
             return x;
@@ -819,11 +1112,11 @@ zskiplistNode *zslLastInLexRange(zskiplist *zsl, zlexrangespec *range) {
 }
 
 /*-----------------------------------------------------------------------------
- * Ziplist-backed sorted set API 以ziplis为底层结构的zset操作
+ * Listpack-backed sorted set API 以ziplis为底层结构的zset操作
  *----------------------------------------------------------------------------*/
 
 /****************************************************************************************
-	如果zset使用ziplist作为底层结构，则每个有序集元素以两个相邻的ziplist节点表示， 第一个节点保存元素值，
+	如果zset使用listpack作为底层结构，则每个有序集元素以两个相邻的listpack节点表示， 第一个节点保存元素值，
     接下来的第二个元素保存元素的分值score。为了方便描述，我们分别将这两个节点称之为“元素值节点”和“分值节点”
 *****************************************************************************************/
 
@@ -836,9 +1129,9 @@ double zzlGetScore(unsigned char *sptr) {
     double score;
 
     redisAssert(sptr != NULL);
-    // 调用ziplistGet获取节点的值，如果该节点保存的是字符串，则存放在vstr中，如果该节点保存的是整数，则
+    // 调用lpGet获取节点的值，如果该节点保存的是字符串，则存放在vstr中，如果该节点保存的是整数，则
     // 保存在vlong中
-    redisAssert(ziplistGet(sptr,&vstr,&vlen,&vlong));
+    redisAssert(lpGet(sptr,&vstr,&vlen,&vlong));
 
     if (vstr) {
         memcpy(buf,vstr,vlen);
@@ -852,20 +1145,20 @@ double zzlGetScore(unsigned char *sptr) {
     return score;
 }
 
-/* Return a ziplist element as a Redis string object.
+/* Return a listpack element as a Redis string object.
  * This simple abstraction can be used to simplifies some code at the
  * cost of some performance. */
 /* 	获取sptr指针所指节点的存放的数据，并以Redis对象robj的类型返回。
 	实际上就是获取有序集合中某个元素的元素值value域。*/
-robj *ziplistGetObject(unsigned char *sptr) {
+robj *lpGetObject(unsigned char *sptr) {
     unsigned char *vstr;
     unsigned int vlen;
     long long vlong;
 
     redisAssert(sptr != NULL);
-    // 调用ziplistGet获取节点的值，如果该节点保存的是字符串，则存放在vstr中，如果该节点保存的是整数，则
+    // 调用lpGet获取节点的值，如果该节点保存的是字符串，则存放在vstr中，如果该节点保存的是整数，则
     // 保存在vlong中
-    redisAssert(ziplistGet(sptr,&vstr,&vlen,&vlong));
+    redisAssert(lpGet(sptr,&vstr,&vlen,&vlong));
 
     // 更具不同类型创建Redis对象
     if (vstr) {
@@ -876,7 +1169,7 @@ robj *ziplistGetObject(unsigned char *sptr) {
 }
 
 /* Compare element in sorted set with given element. */
-/* 将ziplist中eptr所指节点的元素与cstr字符串进行比较。既然是字符串比较，那比较结果可能是：
+/* 将listpack中eptr所指节点的元素与cstr字符串进行比较。既然是字符串比较，那比较结果可能是：
 	（1）、如果两个相同，返回0
 	（2）、如果eptr中的字符串 > cstr字符串，则返回一个正数
 	（3）、如果eptr中的字符串 < cstr字符串，则返回一个负数
@@ -888,9 +1181,9 @@ int zzlCompareElements(unsigned char *eptr, unsigned char *cstr, unsigned int cl
     unsigned char vbuf[32];
     int minlen, cmp;
 
-    // 调用ziplistGet获取节点的值，如果该节点保存的是字符串，则存放在vstr中，如果该节点保存的是整数，则
+    // 调用lpGet获取节点的值，如果该节点保存的是字符串，则存放在vstr中，如果该节点保存的是整数，则
     // 保存在vlong中
-    redisAssert(ziplistGet(eptr,&vstr,&vlen,&vlong));
+    redisAssert(lpGet(eptr,&vstr,&vlen,&vlong));
     if (vstr == NULL) {
         /* Store string representation of long long in buf. */
         // 如果eptr节点保存的是一个整型，则转换为字符串
@@ -905,14 +1198,14 @@ int zzlCompareElements(unsigned char *eptr, unsigned char *cstr, unsigned int cl
     return cmp;
 }
 
-/* 返回ziplist编码的有序集合中保存的元素个数，ziplist每两个节点看作有序集合中的一个元素。*/
+/* 返回listpack编码的有序集合中保存的元素个数，listpack每两个节点看作有序集合中的一个元素。*/
 unsigned int zzlLength(unsigned char *zl) {
-    return ziplistLen(zl)/2;
+    return lpLen(zl)/2;
 }
 
 /* Move to next entry based on the values in eptr and sptr. Both are set to
  * NULL when there is no next entry. */
-/*	ziplist编码的有序集合的迭代函数，eptr和sptr是相邻的两个节点，被看做是有序集合中的一个元素，其中
+/*	listpack编码的有序集合的迭代函数，eptr和sptr是相邻的两个节点，被看做是有序集合中的一个元素，其中
 	eptr指向有序集合当前元素的元素值节点，sptr指向相应的分值节点。移动eptr和sptr分别获得下一个元素的元素值节点和分值节点。
 	如果后面已经没有元素则返回NULL。*/
 void zzlNext(unsigned char *zl, unsigned char **eptr, unsigned char **sptr) {
@@ -920,10 +1213,10 @@ void zzlNext(unsigned char *zl, unsigned char **eptr, unsigned char **sptr) {
     redisAssert(*eptr != NULL && *sptr != NULL);
 
     // 获得sptr的下一个节点，即有序集合下一个元素的元素值节点
-    _eptr = ziplistNext(zl,*sptr);
+    _eptr = lpNext(zl,*sptr);
     if (_eptr != NULL) {
     	// 获得有序集合下一个元素的分值节点
-        _sptr = ziplistNext(zl,_eptr);
+        _sptr = lpNext(zl,_eptr);
         redisAssert(_sptr != NULL);
     } else {
         /* No next entry. */
@@ -936,7 +1229,7 @@ void zzlNext(unsigned char *zl, unsigned char **eptr, unsigned char **sptr) {
 
 /* Move to the previous entry based on the values in eptr and sptr. Both are
  * set to NULL when there is no next entry. */
-/*	ziplist编码的有序集合的迭代函数，eptr和sptr是相邻的两个节点，被看做是有序集合中的一个元素，其中
+/*	listpack编码的有序集合的迭代函数，eptr和sptr是相邻的两个节点，被看做是有序集合中的一个元素，其中
 	eptr指向有序集合当前元素的元素值节点，sptr指向相应的分值节点。移动eptr和sptr分别获得前一个元素的元素值节点和分值节点。
 	如果前面已经没有元素则返回NULL。*/
 void zzlPrev(unsigned char *zl, unsigned char **eptr, unsigned char **sptr) {
@@ -944,10 +1237,10 @@ void zzlPrev(unsigned char *zl, unsigned char **eptr, unsigned char **sptr) {
     redisAssert(*eptr != NULL && *sptr != NULL);
 
     // 获得eptr的前一个节点，即分值节点
-    _sptr = ziplistPrev(zl,*eptr);
+    _sptr = lpPrev(zl,*eptr);
     if (_sptr != NULL) {
     	// 获得_sptr的前一个节点，即元素值节点
-        _eptr = ziplistPrev(zl,_sptr);
+        _eptr = lpPrev(zl,_sptr);
         redisAssert(_eptr != NULL);
     } else {
         /* No previous entry. */
@@ -960,7 +1253,7 @@ void zzlPrev(unsigned char *zl, unsigned char **eptr, unsigned char **sptr) {
 
 /* Returns if there is a part of the zset is in range. Should only be used
  * internally by zzlFirstInRange and zzlLastInRange. */
-/*  判断ziplist编码的有序集合是不是有一部分分值score落在range指定的范围内，如果有则返回1，否则返回0。
+/*  判断listpack编码的有序集合是不是有一部分分值score落在range指定的范围内，如果有则返回1，否则返回0。
 	注意这是一个内部函数，供zzlFirstInRange和zzlLastInRange函数调用。*/
 int zzlIsInRange(unsigned char *zl, zrangespec *range) {
     unsigned char *p;
@@ -972,8 +1265,8 @@ int zzlIsInRange(unsigned char *zl, zrangespec *range) {
             (range->min == range->max && (range->minex || range->maxex)))
         return 0;
 
-    // ziplist中的分值是有序排列的，最后一个为最大的分值
-    p = ziplistIndex(zl,-1); /* Last score. */
+    // listpack中的分值是有序排列的，最后一个为最大的分值
+    p = lpIndex(zl,-1); /* Last score. */
     if (p == NULL) return 0; /* Empty sorted set */
    	// 从节点中获取分值score
     score = zzlGetScore(p);
@@ -981,7 +1274,7 @@ int zzlIsInRange(unsigned char *zl, zrangespec *range) {
         return 0;
 
     // 获取最小的一个分值节点
-    p = ziplistIndex(zl,1); /* First score. */
+    p = lpIndex(zl,1); /* First score. */
     redisAssert(p != NULL);
     // 从节点中获取分值score
     score = zzlGetScore(p);
@@ -993,21 +1286,21 @@ int zzlIsInRange(unsigned char *zl, zrangespec *range) {
 
 /* Find pointer to the first element contained in the specified range.
  * Returns NULL when no element is contained in the range. */
-/*  返回ziplist编码的有序集合中第一个分值落在range范围内的元素（即元素值节点指针），
+/*  返回listpack编码的有序集合中第一个分值落在range范围内的元素（即元素值节点指针），
 	如果不存在这样的节点则返回NULL。*/
 unsigned char *zzlFirstInRange(unsigned char *zl, zrangespec *range) {
-	// eptr指向第一个元素（ziplist每两个相连的节点作为有序集合中的一个元素）
-    unsigned char *eptr = ziplistIndex(zl,0), *sptr;
+	// eptr指向第一个元素（listpack每两个相连的节点作为有序集合中的一个元素）
+    unsigned char *eptr = lpIndex(zl,0), *sptr;
     double score;
 
     /* If everything is out of range, return early. */
     // 先检查有序集合中是否有分值在range指定的区间中，如果没有则直接返回
     if (!zzlIsInRange(zl,range)) return NULL;
 
-    // 从表头到表尾遍历ziplist，两两一组找到第一个符合要求的节点
+    // 从表头到表尾遍历listpack，两两一组找到第一个符合要求的节点
     while (eptr != NULL) {
     	// 找到当前元素的分值节点
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
         redisAssert(sptr != NULL);
 
         // 比较分值
@@ -1021,7 +1314,7 @@ unsigned char *zzlFirstInRange(unsigned char *zl, zrangespec *range) {
 
         /* Move to next element. */
         // 处理下一个元素
-        eptr = ziplistNext(zl,sptr);
+        eptr = lpNext(zl,sptr);
     }
 
     return NULL;
@@ -1029,11 +1322,11 @@ unsigned char *zzlFirstInRange(unsigned char *zl, zrangespec *range) {
 
 /* Find pointer to the last element contained in the specified range.
  * Returns NULL when no element is contained in the range. */
-/*  返回ziplist编码的有序集合中最后一个分值落在range范围内的元素（即元素值节点指针），
+/*  返回listpack编码的有序集合中最后一个分值落在range范围内的元素（即元素值节点指针），
 	如果不存在这样的节点则返回NULL。*/
 unsigned char *zzlLastInRange(unsigned char *zl, zrangespec *range) {
-    // eptr指向最后一个元素（ziplist每两个相连的节点作为有序集合中的一个元素）
-    unsigned char *eptr = ziplistIndex(zl,-2), *sptr;
+    // eptr指向最后一个元素（listpack每两个相连的节点作为有序集合中的一个元素）
+    unsigned char *eptr = lpIndex(zl,-2), *sptr;
     double score;
 
     /* If everything is out of range, return early. */
@@ -1043,7 +1336,7 @@ unsigned char *zzlLastInRange(unsigned char *zl, zrangespec *range) {
     // 从后往前遍历，两两一组查找第一个满足要求的节点
     while (eptr != NULL) {
     	// 找到当前元素的分值节点
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
         redisAssert(sptr != NULL);
 
         // 比较分值
@@ -1057,10 +1350,10 @@ unsigned char *zzlLastInRange(unsigned char *zl, zrangespec *range) {
 
         /* Move to previous element by moving to the score of previous element.
          * When this returns NULL, we know there also is no element. */
-        // 获取前一个元素的分值节点，如果ziplistPrev返回NULL说明前面已经没有元素了
-        sptr = ziplistPrev(zl,eptr);
+        // 获取前一个元素的分值节点，如果lpPrev返回NULL说明前面已经没有元素了
+        sptr = lpPrev(zl,eptr);
         if (sptr != NULL)
-            redisAssert((eptr = ziplistPrev(zl,sptr)) != NULL);
+            redisAssert((eptr = lpPrev(zl,sptr)) != NULL);
         else
             eptr = NULL;
     }
@@ -1068,22 +1361,22 @@ unsigned char *zzlLastInRange(unsigned char *zl, zrangespec *range) {
     return NULL;
 }
 
-/*  以字典序方式判断给ziplist中p节点是否 > 或者 >= spec.min。 
-    实际是对zslLexValueGteMin的封装，因为需要先从ziplist节点中提取数据。*/
+/*  以字典序方式判断给listpack中p节点是否 > 或者 >= spec.min。 
+    实际是对zslLexValueGteMin的封装，因为需要先从listpack节点中提取数据。*/
 static int zzlLexValueGteMin(unsigned char *p, zlexrangespec *spec) {
     // 从p节点中获取其保存的数据对象
-    robj *value = ziplistGetObject(p);
+    robj *value = lpGetObject(p);
     // 调用zslLexValueGteMin进行比较
     int res = zslLexValueGteMin(value,spec);
     decrRefCount(value);
     return res;
 }
 
-/*  以字典序方式判断给ziplist中p节点是否 < 或者 <= spec.max。 
-    实际是对zslLexValueLteMax的封装，因为需要先从ziplist节点中提取数据。*/
+/*  以字典序方式判断给listpack中p节点是否 < 或者 <= spec.max。 
+    实际是对zslLexValueLteMax的封装，因为需要先从listpack节点中提取数据。*/
 static int zzlLexValueLteMax(unsigned char *p, zlexrangespec *spec) {
     // 从p节点中获取其保存的数据对象
-    robj *value = ziplistGetObject(p);
+    robj *value = lpGetObject(p);
     // 调用zslLexValueLteMax进行比较
     int res = zslLexValueLteMax(value,spec);
     decrRefCount(value);
@@ -1094,7 +1387,7 @@ static int zzlLexValueLteMax(unsigned char *p, zlexrangespec *spec) {
 
 /* Returns if there is a part of the zset is in range. Should only be used
  * internally by zzlFirstInRange and zzlLastInRange. */
-/*  按字典序判断ziplist编码的有序集合中是否有元素落在指定字典序区间内。
+/*  按字典序判断listpack编码的有序集合中是否有元素落在指定字典序区间内。
     该函数主要作为内部函数供zzlFirstInRange和zzlLastInRange函数使用。*/
 int zzlIsInLexRange(unsigned char *zl, zlexrangespec *range) {
     unsigned char *p;
@@ -1107,13 +1400,13 @@ int zzlIsInLexRange(unsigned char *zl, zlexrangespec *range) {
         return 0;
 
     // 比较最后一个元素
-    p = ziplistIndex(zl,-2); /* Last element. */
+    p = lpIndex(zl,-2); /* Last element. */
     if (p == NULL) return 0;
     if (!zzlLexValueGteMin(p,range))
         return 0;
 
     // 比较第一个元素
-    p = ziplistIndex(zl,0); /* First element. */
+    p = lpIndex(zl,0); /* First element. */
     redisAssert(p != NULL);
     if (!zzlLexValueLteMax(p,range))
         return 0;
@@ -1123,17 +1416,17 @@ int zzlIsInLexRange(unsigned char *zl, zlexrangespec *range) {
 
 /* Find pointer to the first element contained in the specified lex range.
  * Returns NULL when no element is contained in the range. */
-/*  查找ziplist编码的有序集合中落在指定字典序区间内的第一个元素。
+/*  查找listpack编码的有序集合中落在指定字典序区间内的第一个元素。
     如果不存在这样的节点则返回NULL。*/
 unsigned char *zzlFirstInLexRange(unsigned char *zl, zlexrangespec *range) {
-    // 获取ziplist中的第一个节点
-    unsigned char *eptr = ziplistIndex(zl,0), *sptr;
+    // 获取listpack中的第一个节点
+    unsigned char *eptr = lpIndex(zl,0), *sptr;
 
     /* If everything is out of range, return early. */
     // 如果没有元素在指定的字典序区间，马上返回
     if (!zzlIsInLexRange(zl,range)) return NULL;
 
-    // 从前往后，两两一组遍历ziplist查找满足要求的第一个节点
+    // 从前往后，两两一组遍历listpack查找满足要求的第一个节点
     while (eptr != NULL) {
         if (zzlLexValueGteMin(eptr,range)) {
             /* Check if score <= max. */
@@ -1143,10 +1436,10 @@ unsigned char *zzlFirstInLexRange(unsigned char *zl, zlexrangespec *range) {
         }
 
         /* Move to next element. */
-        // 处理下一个元素（ziplist中相邻的两个节点看做是有序集合中的一个元素），eptr指向元素值节点，sptr指向分值节点
-        sptr = ziplistNext(zl,eptr); /* This element score. Skip it. */
+        // 处理下一个元素（listpack中相邻的两个节点看做是有序集合中的一个元素），eptr指向元素值节点，sptr指向分值节点
+        sptr = lpNext(zl,eptr); /* This element score. Skip it. */
         redisAssert(sptr != NULL);
-        eptr = ziplistNext(zl,sptr); /* Next element. */
+        eptr = lpNext(zl,sptr); /* Next element. */
     }
 
     return NULL;
@@ -1154,11 +1447,11 @@ unsigned char *zzlFirstInLexRange(unsigned char *zl, zlexrangespec *range) {
 
 /* Find pointer to the last element contained in the specified lex range.
  * Returns NULL when no element is contained in the range. */
-/*  查找ziplist编码的有序集合中落在指定字典序区间内的最后一个元素。
+/*  查找listpack编码的有序集合中落在指定字典序区间内的最后一个元素。
     如果不存在这样的节点则返回NULL。*/
 unsigned char *zzlLastInLexRange(unsigned char *zl, zlexrangespec *range) {
-    // 获取ziplist中倒数第二个节点（即有序集合中最后一个元素）
-    unsigned char *eptr = ziplistIndex(zl,-2), *sptr;
+    // 获取listpack中倒数第二个节点（即有序集合中最后一个元素）
+    unsigned char *eptr = lpIndex(zl,-2), *sptr;
 
     /* If everything is out of range, return early. */
     // 如果没有元素在指定的字典序区间，马上返回
@@ -1176,9 +1469,9 @@ unsigned char *zzlLastInLexRange(unsigned char *zl, zlexrangespec *range) {
         /* Move to previous element by moving to the score of previous element.
          * When this returns NULL, we know there also is no element. */
         // 处理前一个元素
-        sptr = ziplistPrev(zl,eptr);
+        sptr = lpPrev(zl,eptr);
         if (sptr != NULL)
-            redisAssert((eptr = ziplistPrev(zl,sptr)) != NULL);
+            redisAssert((eptr = lpPrev(zl,sptr)) != NULL);
         else
             eptr = NULL;
     }
@@ -1189,50 +1482,44 @@ unsigned char *zzlLastInLexRange(unsigned char *zl, zlexrangespec *range) {
 /*  从ziplis编码的有序集合中查找ele元素，并将其分值保存在score中。
     如果操作成功则返回指向该元素的指针，否则返回NULL。*/
 unsigned char *zzlFind(unsigned char *zl, robj *ele, double *score) {
-    // 获取ziplist中的第一个节点指针
-    unsigned char *eptr = ziplistIndex(zl,0), *sptr;
+    // 获取listpack中的第一个节点指针
+    unsigned char *eptr = lpIndex(zl,0), *sptr;
 
     // 对参数ele解码
     ele = getDecodedObject(ele);
-    // 从前往后遍历ziplist，查找目标元素
-    while (eptr != NULL) {
-        // 获取分值节点
-        sptr = ziplistNext(zl,eptr);
+    /* Let lpFind() skip the score entries: it only tries to encode the
+     * element as an integer once, while lpCompare() did it for every
+     * integer entry met. */
+    // 借助lpFind查找目标元素，跳过分值节点
+    if (eptr != NULL &&
+        (eptr = lpFind(eptr,ele->ptr,sdslen(ele->ptr),1)) != NULL)
+    {
+        /* Matching element, pull out score. */
+        // 匹配成功，取出分值保存在score中
+        sptr = lpNext(zl,eptr);
         redisAssertWithInfo(NULL,ele,sptr != NULL);
-
-        // 对比
-        if (ziplistCompare(eptr,ele->ptr,sdslen(ele->ptr))) {
-            /* Matching element, pull out score. */
-            // 匹配成功，取出分值保存在score中
-            if (score != NULL) *score = zzlGetScore(sptr);
-            decrRefCount(ele);
-            return eptr;
-        }
-
-        /* Move to next element. */
-        // 处理下一个元素
-        eptr = ziplistNext(zl,sptr);
+        if (score != NULL) *score = zzlGetScore(sptr);
     }
 
     decrRefCount(ele);
-    return NULL;
+    return eptr;
 }
 
-/* Delete (element,score) pair from ziplist. Use local copy of eptr because we
+/* Delete (element,score) pair from listpack. Use local copy of eptr because we
  * don't want to modify the one given as argument. */
-/*  从ziplist编码的有序集合中删除一个元素，反映在ziplist中就是删除元素值节点和相邻的分值节点。
-    删除节点后返回ziplist的首地址（可能会引起空间重新分配）*/
+/*  从listpack编码的有序集合中删除一个元素，反映在listpack中就是删除元素值节点和相邻的分值节点。
+    删除节点后返回listpack的首地址（可能会引起空间重新分配）*/
 unsigned char *zzlDelete(unsigned char *zl, unsigned char *eptr) {
     unsigned char *p = eptr;
 
-    /* TODO: add function to ziplist API to delete N elements from offset. */
-    zl = ziplistDelete(zl,&p);
-    zl = ziplistDelete(zl,&p);
+    /* TODO: add function to listpack API to delete N elements from offset. */
+    zl = lpDelete(zl,&p);
+    zl = lpDelete(zl,&p);
     return zl;
 }
 
-/*  往eptr节点前面插入一个元素值节点和分值节点，如果eptr为空，则将两个新节点添加到ziplist尾部。
-    操作成功后返回ziplist的首地址。*/
+/*  往eptr节点前面插入一个元素值节点和分值节点，如果eptr为空，则将两个新节点添加到listpack尾部。
+    操作成功后返回listpack的首地址。*/
 unsigned char *zzlInsertAt(unsigned char *zl, unsigned char *eptr, robj *ele, double score) {
     unsigned char *sptr;
     char scorebuf[128];
@@ -1242,44 +1529,44 @@ unsigned char *zzlInsertAt(unsigned char *zl, unsigned char *eptr, robj *ele, do
     redisAssertWithInfo(NULL,ele,ele->encoding == REDIS_ENCODING_RAW);
     // 将double类型的分值转换为字符串
     scorelen = d2string(scorebuf,sizeof(scorebuf),score);
-    // 如果eptr为空，则将元素值节点和分值节点插入到ziplist尾部
+    // 如果eptr为空，则将元素值节点和分值节点插入到listpack尾部
     if (eptr == NULL) {
         // 先添加元素值节点
-        zl = ziplistPush(zl,ele->ptr,sdslen(ele->ptr),ZIPLIST_TAIL);
+        zl = lpPush(zl,ele->ptr,sdslen(ele->ptr),LP_TAIL);
         // 再添加分值节点
-        zl = ziplistPush(zl,(unsigned char*)scorebuf,scorelen,ZIPLIST_TAIL);
+        zl = lpPush(zl,(unsigned char*)scorebuf,scorelen,LP_TAIL);
     } 
-    // 插入到某个节点前面，实际上通过ziplist的内置函数实现
+    // 插入到某个节点前面，实际上通过listpack的内置函数实现
     else {
         /* Keep offset relative to zl, as it might be re-allocated. */
         // 插入元素值节点
         offset = eptr-zl;
-        zl = ziplistInsert(zl,eptr,ele->ptr,sdslen(ele->ptr));
+        zl = lpInsert(zl,eptr,ele->ptr,sdslen(ele->ptr));
         eptr = zl+offset;
 
         /* Insert score after the element. */
-        redisAssertWithInfo(NULL,ele,(sptr = ziplistNext(zl,eptr)) != NULL);
+        redisAssertWithInfo(NULL,ele,(sptr = lpNext(zl,eptr)) != NULL);
         // 插入分值节点
-        zl = ziplistInsert(zl,sptr,(unsigned char*)scorebuf,scorelen);
+        zl = lpInsert(zl,sptr,(unsigned char*)scorebuf,scorelen);
     }
 
     return zl;
 }
 
-/* Insert (element,score) pair in ziplist. This function assumes the element is
+/* Insert (element,score) pair in listpack. This function assumes the element is
  * not yet present in the list. */
-/* 将元素值节点和分值节点插入到ziplist中。该函数假设ele对象不在列表中。*/
+/* 将元素值节点和分值节点插入到listpack中。该函数假设ele对象不在列表中。*/
 unsigned char *zzlInsert(unsigned char *zl, robj *ele, double score) {
-    // 获取ziplist的第一个节点（即有序集合中的第一个元素）
-    unsigned char *eptr = ziplistIndex(zl,0), *sptr;
+    // 获取listpack的第一个节点（即有序集合中的第一个元素）
+    unsigned char *eptr = lpIndex(zl,0), *sptr;
     double s;
 
     // 对ele进行解码
     ele = getDecodedObject(ele);
-    // ziplist中的元素是按分值排序的，这里需要遍历查找插入位置
+    // listpack中的元素是按分值排序的，这里需要遍历查找插入位置
     while (eptr != NULL) {
         // 两两一组
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
         redisAssertWithInfo(NULL,ele,sptr != NULL);
         s = zzlGetScore(sptr);
 
@@ -1302,11 +1589,11 @@ unsigned char *zzlInsert(unsigned char *zl, robj *ele, double score) {
 
         /* Move to next element. */
         // 处理下一个元素
-        eptr = ziplistNext(zl,sptr);
+        eptr = lpNext(zl,sptr);
     }
 
     /* Push on tail of list when it was not yet inserted. */
-    // 如果ziplist为空，则直接添加到尾部
+    // 如果listpack为空，则直接添加到尾部
     if (eptr == NULL)
         zl = zzlInsertAt(zl,NULL,ele,score);
 
@@ -1314,7 +1601,7 @@ unsigned char *zzlInsert(unsigned char *zl, robj *ele, double score) {
     return zl;
 }
 
-/* 删除ziplist编码的有序集合中分值在指定范围的元素，将删除元素个数保存在deleted参数中。*/
+/* 删除listpack编码的有序集合中分值在指定范围的元素，将删除元素个数保存在deleted参数中。*/
 unsigned char *zzlDeleteRangeByScore(unsigned char *zl, zrangespec *range, unsigned long *deleted) {
     unsigned char *eptr, *sptr;
     double score;
@@ -1322,19 +1609,19 @@ unsigned char *zzlDeleteRangeByScore(unsigned char *zl, zrangespec *range, unsig
 
     if (deleted != NULL) *deleted = 0;
 
-    // 指向ziplist中分值落在指定范围的第一个节点
+    // 指向listpack中分值落在指定范围的第一个节点
     eptr = zzlFirstInRange(zl,range);
     if (eptr == NULL) return zl;
 
-    /* When the tail of the ziplist is deleted, eptr will point to the sentinel
-     * byte and ziplistNext will return NULL. */
+    /* When the tail of the listpack is deleted, eptr will point to the sentinel
+     * byte and lpNext will return NULL. */
     // 一直删除节点一直遇到不在range指定范围内的节点为止
-    while ((sptr = ziplistNext(zl,eptr)) != NULL) {
+    while ((sptr = lpNext(zl,eptr)) != NULL) {
         score = zzlGetScore(sptr);
         if (zslValueLteMax(score,range)) {
             /* Delete both the element and the score. */
-            zl = ziplistDelete(zl,&eptr);
-            zl = ziplistDelete(zl,&eptr);
+            zl = lpDelete(zl,&eptr);
+            zl = lpDelete(zl,&eptr);
             num++;
         } else {
             /* No longer in range. */
@@ -1346,25 +1633,25 @@ unsigned char *zzlDeleteRangeByScore(unsigned char *zl, zrangespec *range, unsig
     return zl;
 }
 
-/* 删除ziplist编码的有序集合中元素值字符串在指定字典序区间的元素，将删除元素个数保存在deleted参数中。*/
+/* 删除listpack编码的有序集合中元素值字符串在指定字典序区间的元素，将删除元素个数保存在deleted参数中。*/
 unsigned char *zzlDeleteRangeByLex(unsigned char *zl, zlexrangespec *range, unsigned long *deleted) {
     unsigned char *eptr, *sptr;
     unsigned long num = 0;
 
     if (deleted != NULL) *deleted = 0;
 
-    // 指向ziplist中元素值字符串落在指定字典序范围的第一个节点
+    // 指向listpack中元素值字符串落在指定字典序范围的第一个节点
     eptr = zzlFirstInLexRange(zl,range);
     if (eptr == NULL) return zl;
 
-    /* When the tail of the ziplist is deleted, eptr will point to the sentinel
-     * byte and ziplistNext will return NULL. */
+    /* When the tail of the listpack is deleted, eptr will point to the sentinel
+     * byte and lpNext will return NULL. */
     // 一直删除节点一直遇到不在range指定范围内的节点为止
-    while ((sptr = ziplistNext(zl,eptr)) != NULL) {
+    while ((sptr = lpNext(zl,eptr)) != NULL) {
         if (zzlLexValueLteMax(eptr,range)) {
             /* Delete both the element and the score. */
-            zl = ziplistDelete(zl,&eptr);
-            zl = ziplistDelete(zl,&eptr);
+            zl = lpDelete(zl,&eptr);
+            zl = lpDelete(zl,&eptr);
             num++;
         } else {
             /* No longer in range. */
@@ -1378,15 +1665,15 @@ unsigned char *zzlDeleteRangeByLex(unsigned char *zl, zlexrangespec *range, unsi
 
 /* Delete all the elements with rank between start and end from the skiplist.
  * Start and end are inclusive. Note that start and end need to be 1-based */
-/*  删除ziplist编码的有序集合中在指定排位范围内的所有元素。
+/*  删除listpack编码的有序集合中在指定排位范围内的所有元素。
     其中参数start和end指定的排位都包含在内，而且都是从1开始计算的。
     参数deleted用来保存删除的元素个数。*/
 unsigned char *zzlDeleteRangeByRank(unsigned char *zl, unsigned int start, unsigned int end, unsigned long *deleted) {
     unsigned int num = (end-start)+1;
     if (deleted) *deleted = num;
-    // ziplist中两两相邻的节点看做是有序集合的一个元素，所以实际删除的元素个数需要乘以2
-    // ziplist中的节点从0开始计算，有序集合的排位从1开始计算，所以参数start需要减1
-    zl = ziplistDeleteRange(zl,2*(start-1),2*num);
+    // listpack中两两相邻的节点看做是有序集合的一个元素，所以实际删除的元素个数需要乘以2
+    // listpack中的节点从0开始计算，有序集合的排位从1开始计算，所以参数start需要减1
+    zl = lpDeleteRange(zl,2*(start-1),2*num);
     return zl;
 }
 
@@ -1394,13 +1681,13 @@ unsigned char *zzlDeleteRangeByRank(unsigned char *zl, unsigned int start, unsig
  * Common sorted set API    zset公共接口
  *----------------------------------------------------------------------------*/
 
- /* 下面的函数实际是一组统一的对外接口，用来屏蔽ziplist编码和skiplist的差异。*/
+ /* 下面的函数实际是一组统一的对外接口，用来屏蔽listpack编码和skiplist的差异。*/
 
 /* 获得有序集合的长度（节点个数） */
 unsigned int zsetLength(robj *zobj) {
     int length = -1;
-    // 处理ziplist编码的情况
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    // 处理listpack编码的情况
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
         length = zzlLength(zobj->ptr);
     } 
     // 处理skiplist编码的情况
@@ -1415,15 +1702,15 @@ unsigned int zsetLength(robj *zobj) {
 /* 将zset对象的编码转换为参数encoding指定的编码方式。 */
 void zsetConvert(robj *zobj, int encoding) {
     zset *zs;
-    zskiplistNode *node, *next;
+    zskiplistNode *node;
     robj *ele;
     double score;
 
     // 如果zset当前的编码已经是指定的编码，则返回
     if (zobj->encoding == encoding) return;
 
-    // 如果当前编码为ziplist，目标编码只能是skiplist
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    // 如果当前编码为listpack，目标编码只能是skiplist
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
         unsigned char *vstr;
@@ -1441,19 +1728,19 @@ void zsetConvert(robj *zobj, int encoding) {
         // 创建zskiplist成员
         zs->zsl = zslCreate();
 
-        // ziplist编码的有序集合将ziplist的每两个节点看做一个元素
-        // 获取ziplist编码的有序集合的第一个元素，其中eptr之元素值节点，sptr为分值节点
-        eptr = ziplistIndex(zl,0);
+        // listpack编码的有序集合将listpack的每两个节点看做一个元素
+        // 获取listpack编码的有序集合的第一个元素，其中eptr之元素值节点，sptr为分值节点
+        eptr = lpIndex(zl,0);
         redisAssertWithInfo(NULL,zobj,eptr != NULL);
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
         redisAssertWithInfo(NULL,zobj,sptr != NULL);
 
-        // 遍历ziplist的所有节点，两两一组并添加到skiplist编码的新集合中
+        // 遍历listpack的所有节点，两两一组并添加到skiplist编码的新集合中
         while (eptr != NULL) {
             // 获取分值节点
             score = zzlGetScore(sptr);
             // 取出元素值，如果是字符串编码则保存在vstr中，如果是整型编码则保存在vlong中
-            redisAssertWithInfo(NULL,zobj,ziplistGet(eptr,&vstr,&vlen,&vlong));
+            redisAssertWithInfo(NULL,zobj,lpGet(eptr,&vstr,&vlen,&vlong));
             if (vstr == NULL)
                 ele = createStringObjectFromLongLong(vlong);
             else
@@ -1469,53 +1756,45 @@ void zsetConvert(robj *zobj, int encoding) {
             zzlNext(zl,&eptr,&sptr);
         }
 
-        // 释放源对象的ziplist成员
+        // 释放源对象的listpack成员
         zfree(zobj->ptr);
         // 更新原对象的ptr指针和编码方式
         zobj->ptr = zs;
         zobj->encoding = REDIS_ENCODING_SKIPLIST;
     } 
-    // 如果当前编码为skiplist，目标编码只能是ziplist
+    // 如果当前编码为skiplist，目标编码只能是listpack
     else if (zobj->encoding == REDIS_ENCODING_SKIPLIST) {
-        // 创建一个ziplist作为底层结构
-        unsigned char *zl = ziplistNew();
+        // 创建一个listpack作为底层结构
+        unsigned char *zl = lpNew();
 
-        // 如果目标编码不是ziplist，则出错
-        if (encoding != REDIS_ENCODING_ZIPLIST)
+        // 如果目标编码不是listpack，则出错
+        if (encoding != REDIS_ENCODING_LISTPACK)
             redisPanic("Unknown target encoding");
 
-        /* Approach similar to zslFree(), since we want to free the skiplist at
-         * the same time as creating the ziplist. */
         // 获取有序集合
         zs = zobj->ptr;
         // 释放原对象的字典成员，该成员只是为了快速定位元素值对应的分值score。后面的操作不需要用到，先删除
         dictRelease(zs->dict);
         // 获取跳跃表的第一个节点
         node = zs->zsl->header->level[0].forward;
-        // 释放跳跃表的头结点
-        zfree(zs->zsl->header);
-        zfree(zs->zsl);
 
-        // 遍历跳跃表，对每个元素，分解出元素值和分值并添加到ziplist中
+        // 遍历跳跃表，对每个元素，分解出元素值和分值并添加到listpack中
         while (node) {
             // 对元素值对象解码
             ele = getDecodedObject(node->obj);
-            // 往ziplist添加一个新元素（插入元素值节点和分值节点）
+            // 往listpack添加一个新元素（插入元素值节点和分值节点）
             zl = zzlInsertAt(zl,NULL,ele,node->score);
             decrRefCount(ele);
-
-            // 记录下一个节点
-            next = node->level[0].forward;
-            // 释放当前节点
-            zslFreeNode(node);
             // 处理下一个节点
-            node = next;
+            node = node->level[0].forward;
         }
 
-        // 更新信息
+        /* Nodes live in the skiplist pool, so release everything at once. */
+        // 节点内存都在跳跃表的内存池中，最后一次性释放整个跳跃表
+        zslFree(zs->zsl);
         zfree(zs);
         zobj->ptr = zl;
-        zobj->encoding = REDIS_ENCODING_ZIPLIST;
+        zobj->encoding = REDIS_ENCODING_LISTPACK;
     } else {
         redisPanic("Unknown sorted set encoding");
     }
@@ -1569,7 +1848,7 @@ void zaddGenericCommand(redisClient *c, int incr) {
         {
             zobj = createZsetObject();
         } else {
-            zobj = createZsetZiplistObject();
+            zobj = createZsetListpackObject();
         }
         dbAdd(c->db,key,zobj);
     } 
@@ -1586,11 +1865,11 @@ void zaddGenericCommand(redisClient *c, int incr) {
     for (j = 0; j < elements; j++) {
         score = scores[j];
 
-        // 处理ziplist编码的情况
-        if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+        // 处理listpack编码的情况
+        if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
             unsigned char *eptr;
 
-            /* Prefer non-encoded element when dealing with ziplists. */
+            /* Prefer non-encoded element when dealing with listpacks. */
             // 获取输入元素值
             ele = c->argv[3+j*2];
             // 检查该成员是否已经存在
@@ -1609,7 +1888,7 @@ void zaddGenericCommand(redisClient *c, int incr) {
                 // 对于ZADD命令，如果指定的元素已经存在则更新该元素的分数
                 // 对于ZINCRBY命令，分值改变也需要执行下列函数
                 if (score != curscore) {
-                    // 先把已有元素删除，然后再重新插入新元素，因为分值不同则其在ziplist的位置也不同
+                    // 先把已有元素删除，然后再重新插入新元素，因为分值不同则其在listpack的位置也不同
                     zobj->ptr = zzlDelete(zobj->ptr,eptr);
                     zobj->ptr = zzlInsert(zobj->ptr,ele,score);
                     server.dirty++;
@@ -1625,7 +1904,7 @@ void zaddGenericCommand(redisClient *c, int incr) {
                 // 检查有序集合中元素个数，如果超过server.zset_max_ziplist_entries则转换为skiplist编码方式
                 if (zzlLength(zobj->ptr) > server.zset_max_ziplist_entries)
                     zsetConvert(zobj,REDIS_ENCODING_SKIPLIST);
-                // 检查新添加元素长度，如果超过server.zset_max_ziplist_value则转换为ziplist编码方式
+                // 检查新添加元素长度，如果超过server.zset_max_ziplist_value则转换为listpack编码方式
                 if (sdslen(ele->ptr) > server.zset_max_ziplist_value)
                     zsetConvert(zobj,REDIS_ENCODING_SKIPLIST);
                 server.dirty++;
@@ -1728,19 +2007,19 @@ void zremCommand(redisClient *c) {
     if ((zobj = lookupKeyWriteOrReply(c,key,shared.czero)) == NULL ||
         checkType(c,zobj,REDIS_ZSET)) return;
 
-    // 处理ziplist编码的情况
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    // 处理listpack编码的情况
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *eptr;
 
         // 从第三个开始遍历所有的输入元素值，即要删除的元素值
         for (j = 2; j < c->argc; j++) {
-            // 检查该元素是否存在于ziplist中
+            // 检查该元素是否存在于listpack中
             if ((eptr = zzlFind(zobj->ptr,c->argv[j],NULL)) != NULL) {
                 // 记录删除元素个数
                 deleted++;
                 // 执行真正的删除操作
                 zobj->ptr = zzlDelete(zobj->ptr,eptr);
-                // 如果ziplist已经为空，则将有序集合从db中删除
+                // 如果listpack已经为空，则将有序集合从db中删除
                 if (zzlLength(zobj->ptr) == 0) {
                     dbDelete(c->db,key);
                     keyremoved = 1;
@@ -1862,8 +2141,8 @@ void zremrangeGenericCommand(redisClient *c, int rangetype) {
     /* Step 3: Perform the range deletion operation. */
     // 步骤3：调用相关函数处理删除操作，这些函数我们都在前面介绍过
 
-    // 处理ziplist编码的形式
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    // 处理listpack编码的形式
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
         switch(rangetype) {
         case ZRANGE_RANK:
             zobj->ptr = zzlDeleteRangeByRank(zobj->ptr,start+1,end+1,&deleted);
@@ -1946,6 +2225,8 @@ typedef struct {
     // 迭代对象的编码方式
     int encoding;
     double weight;
+    // 为真时有序集合从分值最大的元素开始逆向迭代，对集合set无影响
+    int reverse;
 
     // 注意下面的是union联合体，节省空间
     union {
@@ -1957,6 +2238,8 @@ typedef struct {
                 intset *is;
                 int ii;
             } is;
+            // 对应roaring编码方式
+            roaringIterator ri;
             // 对应dict编码方式
             struct {
                 dict *dict;
@@ -1968,7 +2251,7 @@ typedef struct {
         /* Sorted set iterators. */
         // 有序集合zset迭代器
         union _iterzset {
-            // 对应ziplist编码方式
+            // 对应listpack编码方式
             struct {
                 unsigned char *zl;
                 unsigned char *eptr, *sptr;
@@ -2016,6 +2299,8 @@ void zuiInitIterator(zsetopsrc *op) {
         if (op->encoding == REDIS_ENCODING_INTSET) {
             it->is.is = op->subject->ptr;
             it->is.ii = 0;
+        } else if (op->encoding == REDIS_ENCODING_ROARING) {
+            roaringIterInit(&it->ri,op->subject->ptr,INT64_MIN);
         } else if (op->encoding == REDIS_ENCODING_HT) {
             it->ht.dict = op->subject->ptr;
             it->ht.di = dictGetIterator(op->subject->ptr);
@@ -2025,16 +2310,17 @@ void zuiInitIterator(zsetopsrc *op) {
         }
     } else if (op->type == REDIS_ZSET) {
         iterzset *it = &op->iter.zset;
-        if (op->encoding == REDIS_ENCODING_ZIPLIST) {
+        if (op->encoding == REDIS_ENCODING_LISTPACK) {
             it->zl.zl = op->subject->ptr;
-            it->zl.eptr = ziplistIndex(it->zl.zl,0);
+            it->zl.eptr = lpIndex(it->zl.zl,op->reverse ? -2 : 0);
             if (it->zl.eptr != NULL) {
-                it->zl.sptr = ziplistNext(it->zl.zl,it->zl.eptr);
+                it->zl.sptr = lpNext(it->zl.zl,it->zl.eptr);
                 redisAssert(it->zl.sptr != NULL);
             }
         } else if (op->encoding == REDIS_ENCODING_SKIPLIST) {
             it->sl.zs = op->subject->ptr;
-            it->sl.node = it->sl.zs->zsl->header->level[0].forward;
+            it->sl.node = op->reverse ? it->sl.zs->zsl->tail :
+                                        it->sl.zs->zsl->header->level[0].forward;
         } else {
             redisPanic("Unknown sorted set encoding");
         }
@@ -2049,7 +2335,8 @@ void zuiClearIterator(zsetopsrc *op) {
 
     if (op->type == REDIS_SET) {
         iterset *it = &op->iter.set;
-        if (op->encoding == REDIS_ENCODING_INTSET) {
+        if (op->encoding == REDIS_ENCODING_INTSET ||
+            op->encoding == REDIS_ENCODING_ROARING) {
             REDIS_NOTUSED(it); /* skip */
         } else if (op->encoding == REDIS_ENCODING_HT) {
             dictReleaseIterator(it->ht.di);
@@ -2058,7 +2345,7 @@ void zuiClearIterator(zsetopsrc *op) {
         }
     } else if (op->type == REDIS_ZSET) {
         iterzset *it = &op->iter.zset;
-        if (op->encoding == REDIS_ENCODING_ZIPLIST) {
+        if (op->encoding == REDIS_ENCODING_LISTPACK) {
             REDIS_NOTUSED(it); /* skip */
         } else if (op->encoding == REDIS_ENCODING_SKIPLIST) {
             REDIS_NOTUSED(it); /* skip */
@@ -2077,6 +2364,8 @@ int zuiLength(zsetopsrc *op) {
     if (op->type == REDIS_SET) {
         if (op->encoding == REDIS_ENCODING_INTSET) {
             return intsetLen(op->subject->ptr);
+        } else if (op->encoding == REDIS_ENCODING_ROARING) {
+            return roaringCard(op->subject->ptr);
         } else if (op->encoding == REDIS_ENCODING_HT) {
             dict *ht = op->subject->ptr;
             return dictSize(ht);
@@ -2084,7 +2373,7 @@ int zuiLength(zsetopsrc *op) {
             redisPanic("Unknown set encoding");
         }
     } else if (op->type == REDIS_ZSET) {
-        if (op->encoding == REDIS_ENCODING_ZIPLIST) {
+        if (op->encoding == REDIS_ENCODING_LISTPACK) {
             return zzlLength(op->subject->ptr);
         } else if (op->encoding == REDIS_ENCODING_SKIPLIST) {
             zset *zs = op->subject->ptr;
@@ -2121,6 +2410,13 @@ int zuiNext(zsetopsrc *op, zsetopval *val) {
 
             /* Move to next element. */
             it->is.ii++;
+        } else if (op->encoding == REDIS_ENCODING_ROARING) {
+            int64_t ell;
+
+            if (!roaringIterNext(&it->ri,&ell))
+                return 0;
+            val->ell = ell;
+            val->score = 1.0;
         } else if (op->encoding == REDIS_ENCODING_HT) {
             if (it->ht.de == NULL)
                 return 0;
@@ -2134,15 +2430,18 @@ int zuiNext(zsetopsrc *op, zsetopval *val) {
         }
     } else if (op->type == REDIS_ZSET) {
         iterzset *it = &op->iter.zset;
-        if (op->encoding == REDIS_ENCODING_ZIPLIST) {
+        if (op->encoding == REDIS_ENCODING_LISTPACK) {
             /* No need to check both, but better be explicit. */
             if (it->zl.eptr == NULL || it->zl.sptr == NULL)
                 return 0;
-            redisAssert(ziplistGet(it->zl.eptr,&val->estr,&val->elen,&val->ell));
+            redisAssert(lpGet(it->zl.eptr,&val->estr,&val->elen,&val->ell));
             val->score = zzlGetScore(it->zl.sptr);
 
             /* Move to next element. */
-            zzlNext(it->zl.zl,&it->zl.eptr,&it->zl.sptr);
+            if (op->reverse)
+                zzlPrev(it->zl.zl,&it->zl.eptr,&it->zl.sptr);
+            else
+                zzlNext(it->zl.zl,&it->zl.eptr,&it->zl.sptr);
         } else if (op->encoding == REDIS_ENCODING_SKIPLIST) {
             if (it->sl.node == NULL)
                 return 0;
@@ -2150,7 +2449,8 @@ int zuiNext(zsetopsrc *op, zsetopval *val) {
             val->score = it->sl.node->score;
 
             /* Move to next element. */
-            it->sl.node = it->sl.node->level[0].forward;
+            it->sl.node = op->reverse ? it->sl.node->backward :
+                                        it->sl.node->level[0].forward;
         } else {
             redisPanic("Unknown sorted set encoding");
         }
@@ -2233,6 +2533,15 @@ int zuiFind(zsetopsrc *op, zsetopval *val, double *score) {
             } else {
                 return 0;
             }
+        } else if (op->encoding == REDIS_ENCODING_ROARING) {
+            if (zuiLongLongFromValue(val) &&
+                roaringContains(op->subject->ptr,val->ell))
+            {
+                *score = 1.0;
+                return 1;
+            } else {
+                return 0;
+            }
         } else if (op->encoding == REDIS_ENCODING_HT) {
             dict *ht = op->subject->ptr;
             zuiObjectFromValue(val);
@@ -2248,7 +2557,7 @@ int zuiFind(zsetopsrc *op, zsetopval *val, double *score) {
     } else if (op->type == REDIS_ZSET) {
         zuiObjectFromValue(val);
 
-        if (op->encoding == REDIS_ENCODING_ZIPLIST) {
+        if (op->encoding == REDIS_ENCODING_LISTPACK) {
             if (zzlFind(op->subject->ptr,val->ele,score) != NULL) {
                 /* Score is already set by zzlFind. */
                 return 1;
@@ -2272,8 +2581,32 @@ int zuiFind(zsetopsrc *op, zsetopval *val, double *score) {
     }
 }
 
+/* Cost class of a zuiFind() probe into 'op': hash tables answer in O(1),
+ * intsets and roaring bitmaps in O(log(N)), listpacks need a linear scan. */
+/* zuiFind在op中查找一个元素的代价：哈希表为O(1)，intset和roaring为O(log(N))，listpack需要线性扫描 */
+static int zuiProbeCost(zsetopsrc *op) {
+    if (op->subject == NULL) return 0;
+    switch(op->encoding) {
+    case REDIS_ENCODING_HT:
+    case REDIS_ENCODING_SKIPLIST: return 1;
+    case REDIS_ENCODING_INTSET:
+    case REDIS_ENCODING_ROARING: return 2;
+    default: return 3;
+    }
+}
+
+/* Sort inputs from the smallest to the largest. The smallest set drives
+ * ZINTERSTORE and the others are probed in this order, so on equal sizes
+ * the cheapest inputs to probe come first: an element missing from one of
+ * them is discarded before the expensive lookups. */
+/*  按基数从小到大排序输入集合。ZINTERSTORE由最小的集合驱动，其余集合按此顺序依次查找，
+    因此基数相同时查找代价小的集合排在前面，不在其中的元素可以在代价大的查找之前就被丢弃。*/
 int zuiCompareByCardinality(const void *s1, const void *s2) {
-    return zuiLength((zsetopsrc*)s1) - zuiLength((zsetopsrc*)s2);
+    zsetopsrc *a = (zsetopsrc*)s1, *b = (zsetopsrc*)s2;
+    int la = zuiLength(a), lb = zuiLength(b);
+
+    if (la != lb) return (la < lb) ? -1 : 1;
+    return zuiProbeCost(a) - zuiProbeCost(b);
 }
 
 #define REDIS_AGGR_SUM 1
@@ -2298,6 +2631,131 @@ inline static void zunionInterAggregate(double *target, double val, int aggregat
     }
 }
 
+/* ZUNIONSTORE with AGGREGATE MIN or MAX as a k-way merge.
+ *
+ * Every input is iterated in the order of its weighted scores (ascending for
+ * MIN, descending for MAX: a zset with a negative weight is simply iterated
+ * backward, a set or a zero weight yields a constant score), and a binary
+ * heap holding the head of every input yields the elements in global order.
+ * The first time an element is seen its final score is already known, so
+ * later instances are dropped with a single lookup in 'seen' instead of
+ * being aggregated, and the output comes out sorted by score.
+ *
+ * The result is appended to 'e' (ascending by score), elements are added to
+ * the 'seen' dictionary that owns one reference. Returns the number of
+ * elements. */
+/*  使用k路归并实现AGGREGATE MIN和AGGREGATE MAX的ZUNIONSTORE。
+    每个输入按加权分值的顺序迭代（MIN为升序，MAX为降序：权重为负数的有序集合逆向迭代即可，集合set或者权重为0时分值为常数），
+    用一个二叉堆保存每个输入当前的元素，依次弹出全局有序的元素。一个元素第一次出现时它的最终分值就已经确定了，
+    后面再出现时只需在seen中查找一次即可丢弃，无需再做聚合，同时输出结果已经按分值有序。
+    结果按分值升序保存到数组e中，元素被加入到seen字典中（由seen持有一个引用）。函数返回结果元素个数。*/
+static int zunionMergeBefore(double a, double b, int aggregate) {
+    return (aggregate == REDIS_AGGR_MIN) ? (a < b) : (a > b);
+}
+
+static unsigned long zunionMerge(zsetopsrc *src, long setnum, int aggregate,
+                                 dict *seen, zslBulkEntry *e,
+                                 unsigned int *maxelelen)
+{
+    zsetopval *vals = zcalloc(sizeof(zsetopval)*setnum);
+    double *scores = zmalloc(sizeof(double)*setnum);
+    long *heap = zmalloc(sizeof(long)*setnum);
+    long i, hlen = 0, top, child, pos;
+    unsigned long n = 0;
+    robj *tmp;
+
+    /* Initialize every non empty input and push it into the heap. */
+    // 初始化每个非空的输入，并将其加入堆中
+    for (i = 0; i < setnum; i++) {
+        if (zuiLength(&src[i]) == 0) continue;
+        src[i].reverse = (aggregate == REDIS_AGGR_MIN) != (src[i].weight >= 0);
+        zuiInitIterator(&src[i]);
+        if (!zuiNext(&src[i],&vals[i])) {
+            zuiClearIterator(&src[i]);
+            continue;
+        }
+        scores[i] = src[i].weight * vals[i].score;
+        if (isnan(scores[i])) scores[i] = 0;
+        pos = hlen++;
+        while (pos > 0 &&
+               zunionMergeBefore(scores[i],scores[heap[(pos-1)/2]],aggregate))
+        {
+            heap[pos] = heap[(pos-1)/2];
+            pos = (pos-1)/2;
+        }
+        heap[pos] = i;
+    }
+
+    while (hlen) {
+        top = heap[0];
+        tmp = zuiObjectFromValue(&vals[top]);
+        if (dictAdd(seen,tmp,NULL) == DICT_OK) {
+            incrRefCount(tmp);
+            if (tmp->encoding == REDIS_ENCODING_RAW &&
+                sdslen(tmp->ptr) > *maxelelen)
+                *maxelelen = sdslen(tmp->ptr);
+            e[n].obj = tmp;
+            e[n].score = scores[top];
+            n++;
+        }
+
+        /* Advance the input on top of the heap, drop it when exhausted. */
+        // 移动堆顶的输入到下一个元素，如果该输入已经迭代完毕则从堆中删除
+        if (zuiNext(&src[top],&vals[top])) {
+            scores[top] = src[top].weight * vals[top].score;
+            if (isnan(scores[top])) scores[top] = 0;
+        } else {
+            zuiClearIterator(&src[top]);
+            top = heap[--hlen];
+        }
+        /* Sift down. */
+        pos = 0;
+        while ((child = pos*2+1) < hlen) {
+            if (child+1 < hlen &&
+                zunionMergeBefore(scores[heap[child+1]],scores[heap[child]],aggregate))
+                child++;
+            if (!zunionMergeBefore(scores[heap[child]],scores[top],aggregate))
+                break;
+            heap[pos] = heap[child];
+            pos = child;
+        }
+        if (hlen) heap[pos] = top;
+    }
+
+    /* MAX produced a descending sequence. */
+    // MAX得到的是降序序列，反转成升序
+    if (aggregate == REDIS_AGGR_MAX) {
+        unsigned long a, b;
+        for (a = 0, b = n; n && a < --b; a++) {
+            zslBulkEntry t = e[a];
+            e[a] = e[b];
+            e[b] = t;
+        }
+    }
+    zfree(heap);
+    zfree(scores);
+    zfree(vals);
+    return n;
+}
+
+/* Build the destination skiplist and dictionary from the n entries of 'e'.
+ * The members take one reference for the skiplist and one for the dict. */
+/* 根据数组e中的n个元素构建目标有序集合的跳跃表和字典，成员对象分别被跳跃表和字典各持有一个引用 */
+static void zunionInterBulkLoad(zset *dstzset, zslBulkEntry *e, unsigned long n,
+                                int scoresorted)
+{
+    unsigned long j;
+
+    zslBulkSort(e,n,scoresorted);
+    zslBulkLoad(dstzset->zsl,e,n);
+    dictExpand(dstzset->dict,n);
+    for (j = 0; j < n; j++) {
+        incrRefCount(e[j].obj); /* added to skiplist */
+        dictAdd(dstzset->dict,e[j].obj,&e[j].node->score);
+        incrRefCount(e[j].obj); /* added to dictionary */
+    }
+}
+
 void zunionInterGenericCommand(redisClient *c, robj *dstkey, int op) {
     int i, j;
     long setnum;
@@ -2308,7 +2766,8 @@ void zunionInterGenericCommand(redisClient *c, robj *dstkey, int op) {
     unsigned int maxelelen = 0;
     robj *dstobj;
     zset *dstzset;
-    zskiplistNode *znode;
+    zslBulkEntry *entries;
+    unsigned long count = 0;
     int touched = 0;
 
     /* expect setnum input keys to be given */
@@ -2397,6 +2856,12 @@ void zunionInterGenericCommand(redisClient *c, robj *dstkey, int op) {
     if (op == REDIS_OP_INTER) {
         /* Skip everything if the smallest input is empty. */
         if (zuiLength(&src[0]) > 0) {
+            /* The result can't be larger than the smallest input. The
+             * elements are collected in an array and the destination is
+             * bulk loaded at the end instead of inserted one by one. */
+            // 结果不会超过最小的输入集合，先将结果元素收集到数组中，最后一次性构建目标有序集合
+            entries = zmalloc(sizeof(zslBulkEntry)*zuiLength(&src[0]));
+
             /* Precondition: as src[0] is non-empty and the inputs are ordered
              * by size, all src[i > 0] are non-empty too. */
             zuiInitIterator(&src[0]);
@@ -2423,10 +2888,10 @@ void zunionInterGenericCommand(redisClient *c, robj *dstkey, int op) {
                 /* Only continue when present in every input. */
                 if (j == setnum) {
                     tmp = zuiObjectFromValue(&zval);
-                    znode = zslInsert(dstzset->zsl,score,tmp);
-                    incrRefCount(tmp); /* added to skiplist */
-                    dictAdd(dstzset->dict,tmp,&znode->score);
-                    incrRefCount(tmp); /* added to dictionary */
+                    incrRefCount(tmp); /* owned by the entries array */
+                    entries[count].obj = tmp;
+                    entries[count].score = score;
+                    count++;
 
                     if (tmp->encoding == REDIS_ENCODING_RAW)
                         if (sdslen(tmp->ptr) > maxelelen)
@@ -2434,12 +2899,21 @@ void zunionInterGenericCommand(redisClient *c, robj *dstkey, int op) {
                 }
             }
             zuiClearIterator(&src[0]);
+
+            /* When the driver is a zset with a non negative weight and the
+             * scores are not aggregated from other inputs, the result is
+             * already sorted by score. */
+            zunionInterBulkLoad(dstzset,entries,count,
+                setnum == 1 && src[0].type == REDIS_ZSET && src[0].weight >= 0);
+            for (j = 0; j < (long)count; j++) decrRefCount(entries[j].obj);
+            zfree(entries);
         }
     } else if (op == REDIS_OP_UNION) {
         dict *accumulator = dictCreate(&setDictType,NULL);
         dictIterator *di;
         dictEntry *de;
         double score;
+        unsigned long maxlen = 0;
 
         if (setnum) {
             /* Our union is at least as large as the largest set.
@@ -2447,6 +2921,20 @@ void zunionInterGenericCommand(redisClient *c, robj *dstkey, int op) {
             dictExpand(accumulator,zuiLength(&src[setnum-1]));
         }
 
+        /* MIN and MAX are computed with a k-way merge of the inputs: see
+         * zunionMerge(). */
+        // MIN和MAX通过对输入做k路归并计算，见zunionMerge
+        if (aggregate != REDIS_AGGR_SUM) {
+            for (i = 0; i < setnum; i++) maxlen += zuiLength(&src[i]);
+            entries = zmalloc(sizeof(zslBulkEntry)*(maxlen ? maxlen : 1));
+            count = zunionMerge(src,setnum,aggregate,accumulator,entries,
+                                &maxelelen);
+            zunionInterBulkLoad(dstzset,entries,count,1);
+            zfree(entries);
+            dictRelease(accumulator);
+            goto store;
+        }
+
         /* Step 1: Create a dictionary of elements -> aggregated-scores
          * by iterating one sorted set after the other. */
         for (i = 0; i < setnum; i++) {
@@ -2464,7 +2952,7 @@ void zunionInterGenericCommand(redisClient *c, robj *dstkey, int op) {
                 if (de == NULL) {
                     tmp = zuiObjectFromValue(&zval);
                     /* Remember the longest single element encountered,
-                     * to understand if it's possible to convert to ziplist
+                     * to understand if it's possible to convert to listpack
                      * at the end. */
                     if (tmp->encoding == REDIS_ENCODING_RAW) {
                         if (sdslen(tmp->ptr) > maxelelen)
@@ -2487,23 +2975,20 @@ void zunionInterGenericCommand(redisClient *c, robj *dstkey, int op) {
             zuiClearIterator(&src[i]);
         }
 
-        /* Step 2: convert the dictionary into the final sorted set. */
+        /* Step 2: convert the dictionary into the final sorted set. The
+         * elements are sorted once and appended to the skiplist, which is
+         * much cheaper than a random insertion per element. */
+        // 步骤2：将字典转换为最终的有序集合。先对所有元素排序一次再追加到跳跃表中，比逐个随机插入的代价小得多
+        entries = zmalloc(sizeof(zslBulkEntry)*(dictSize(accumulator)+1));
         di = dictGetIterator(accumulator);
-
-        /* We now are aware of the final size of the resulting sorted set,
-         * let's resize the dictionary embedded inside the sorted set to the
-         * right size, in order to save rehashing time. */
-        dictExpand(dstzset->dict,dictSize(accumulator));
-
         while((de = dictNext(di)) != NULL) {
-            robj *ele = dictGetKey(de);
-            score = dictGetDoubleVal(de);
-            znode = zslInsert(dstzset->zsl,score,ele);
-            incrRefCount(ele); /* added to skiplist */
-            dictAdd(dstzset->dict,ele,&znode->score);
-            incrRefCount(ele); /* added to dictionary */
+            entries[count].obj = dictGetKey(de);
+            entries[count].score = dictGetDoubleVal(de);
+            count++;
         }
         dictReleaseIterator(di);
+        zunionInterBulkLoad(dstzset,entries,count,0);
+        zfree(entries);
 
         /* We can free the accumulator dictionary now. */
         dictRelease(accumulator);
@@ -2511,16 +2996,18 @@ void zunionInterGenericCommand(redisClient *c, robj *dstkey, int op) {
         redisPanic("Unknown operator");
     }
 
+store:
+
     if (dbDelete(c->db,dstkey)) {
         signalModifiedKey(c->db,dstkey);
         touched = 1;
         server.dirty++;
     }
     if (dstzset->zsl->length) {
-        /* Convert to ziplist when in limits. */
+        /* Convert to listpack when in limits. */
         if (dstzset->zsl->length <= server.zset_max_ziplist_entries &&
             maxelelen <= server.zset_max_ziplist_value)
-                zsetConvert(dstobj,REDIS_ENCODING_ZIPLIST);
+                zsetConvert(dstobj,REDIS_ENCODING_LISTPACK);
 
         dbAdd(c->db,dstkey,dstobj);
         addReplyLongLong(c,zsetLength(dstobj));
@@ -2595,8 +3082,8 @@ void zrangeGenericCommand(redisClient *c, int reverse) {
     /* Return the result in form of a multi-bulk reply */
     addReplyMultiBulkLen(c, withscores ? (rangelen*2) : rangelen);
 
-    // 处理ziplist编码的情况
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    // 处理listpack编码的情况
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
         unsigned char *vstr;
@@ -2605,19 +3092,19 @@ void zrangeGenericCommand(redisClient *c, int reverse) {
 
         // 根据迭代方向获取第一个开始的迭代节点
         if (reverse)
-            eptr = ziplistIndex(zl,-2-(2*start));
+            eptr = lpIndex(zl,-2-(2*start));
         else
-            eptr = ziplistIndex(zl,2*start);
+            eptr = lpIndex(zl,2*start);
 
         redisAssertWithInfo(c,zobj,eptr != NULL);
         // 获取分值节点
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
 
         // 依次遍历，取出在指定排位范围的元素
         while (rangelen--) {
             redisAssertWithInfo(c,zobj,eptr != NULL && sptr != NULL);
             // 取出元素值，如果是字符串编码则保存在vstr中，如果是整数编码则保存在vlong中
-            redisAssertWithInfo(c,zobj,ziplistGet(eptr,&vstr,&vlen,&vlong));
+            redisAssertWithInfo(c,zobj,lpGet(eptr,&vstr,&vlen,&vlong));
             if (vstr == NULL)
                 addReplyBulkLongLong(c,vlong);
             else
@@ -2741,8 +3228,8 @@ void genericZrangebyscoreCommand(redisClient *c, int reverse) {
     if ((zobj = lookupKeyReadOrReply(c,key,shared.emptymultibulk)) == NULL ||
         checkType(c,zobj,REDIS_ZSET)) return;
 
-    // 处理ziplist编码的情况
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    // 处理listpack编码的情况
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
         unsigned char *vstr;
@@ -2768,7 +3255,7 @@ void genericZrangebyscoreCommand(redisClient *c, int reverse) {
         /* Get score pointer for the first element. */
         redisAssertWithInfo(c,zobj,eptr != NULL);
         // 获取分值节点
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
 
         /* We don't know in advance how many matching elements there are in the
          * list, so we push this object that will represent the multi-bulk
@@ -2800,9 +3287,9 @@ void genericZrangebyscoreCommand(redisClient *c, int reverse) {
                 if (!zslValueLteMax(score,&range)) break;
             }
 
-            /* We know the element exists, so ziplistGet should always succeed */
+            /* We know the element exists, so lpGet should always succeed */
             // 获取元素值
-            redisAssertWithInfo(c,zobj,ziplistGet(eptr,&vstr,&vlen,&vlong));
+            redisAssertWithInfo(c,zobj,lpGet(eptr,&vstr,&vlen,&vlong));
 
             rangelen++;
             if (vstr == NULL) {
@@ -2926,14 +3413,14 @@ void zcountCommand(redisClient *c) {
     if ((zobj = lookupKeyReadOrReply(c, key, shared.czero)) == NULL ||
         checkType(c, zobj, REDIS_ZSET)) return;
 
-    // 处理ziplist编码的类型
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    // 处理listpack编码的类型
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
         double score;
 
         /* Use the first element in range as the starting point */
-        // 获取ziplist在指定分值范围内的第一个节点
+        // 获取listpack在指定分值范围内的第一个节点
         eptr = zzlFirstInRange(zl,&range);
 
         /* No "first" element */
@@ -2945,7 +3432,7 @@ void zcountCommand(redisClient *c) {
 
         /* First element is in range */
         // 取出当前元素的分值节点
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
         // 获取分值
         score = zzlGetScore(sptr);
         // 验证分值是否操作指定范围的右边界
@@ -3031,13 +3518,13 @@ void zlexcountCommand(redisClient *c) {
         return;
     }
 
-    // 处理ziplist编码的情况
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    // 处理listpack编码的情况
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
 
         /* Use the first element in range as the starting point */
-        // 返回ziplist编码的有序集合中在指定字典序区间范围内的第一个节点
+        // 返回listpack编码的有序集合中在指定字典序区间范围内的第一个节点
         eptr = zzlFirstInLexRange(zl,&range);
 
         /* No "first" element */
@@ -3050,7 +3537,7 @@ void zlexcountCommand(redisClient *c) {
 
         /* First element is in range */
         // 获取分值节点
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
         // 检查指定字典序区间范围内的第一个节点是否操作字典序区间的右边界
         redisAssertWithInfo(c,zobj,zzlLexValueLteMax(eptr,&range));
 
@@ -3172,7 +3659,7 @@ void genericZrangebylexCommand(redisClient *c, int reverse) {
         return;
     }
 
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
         unsigned char *vstr;
@@ -3198,7 +3685,7 @@ void genericZrangebylexCommand(redisClient *c, int reverse) {
         /* Get score pointer for the first element. */
         redisAssertWithInfo(c,zobj,eptr != NULL);
         // 获取分值节点
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
 
         /* We don't know in advance how many matching elements there are in the
          * list, so we push this object that will represent the multi-bulk
@@ -3227,10 +3714,10 @@ void genericZrangebylexCommand(redisClient *c, int reverse) {
                 if (!zzlLexValueLteMax(eptr,&range)) break;
             }
 
-            /* We know the element exists, so ziplistGet should always
+            /* We know the element exists, so lpGet should always
              * succeed. */
             // 从当前节点中获取元素值
-            redisAssertWithInfo(c,zobj,ziplistGet(eptr,&vstr,&vlen,&vlong));
+            redisAssertWithInfo(c,zobj,lpGet(eptr,&vstr,&vlen,&vlong));
 
             rangelen++;
             if (vstr == NULL) {
@@ -3345,8 +3832,8 @@ void zscoreCommand(redisClient *c) {
     if ((zobj = lookupKeyReadOrReply(c,key,shared.nullbulk)) == NULL ||
         checkType(c,zobj,REDIS_ZSET)) return;
 
-    // 处理ziplist编码的情况
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    // 处理listpack编码的情况
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
         if (zzlFind(zobj->ptr,c->argv[2],&score) != NULL)
             addReplyDouble(c,score);
         else
@@ -3385,22 +3872,22 @@ void zrankGenericCommand(redisClient *c, int reverse) {
     llen = zsetLength(zobj);
 
     redisAssertWithInfo(c,ele,ele->encoding == REDIS_ENCODING_RAW);
-    // 处理ziplist编码的情况
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    // 处理listpack编码的情况
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
 
-        // 获取ziplist中第一个节点，对应有序集合中第一个元素
-        eptr = ziplistIndex(zl,0);
+        // 获取listpack中第一个节点，对应有序集合中第一个元素
+        eptr = lpIndex(zl,0);
         redisAssertWithInfo(c,zobj,eptr != NULL);
         // 获取分数值
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
         redisAssertWithInfo(c,zobj,sptr != NULL);
 
         rank = 1;
-        // ziplist节点顺序存储元素，只能遍历一遍找到目标元素
+        // listpack节点顺序存储元素，只能遍历一遍找到目标元素
         while(eptr != NULL) {
-            if (ziplistCompare(eptr,ele->ptr,sdslen(ele->ptr)))
+            if (lpCompare(eptr,ele->ptr,sdslen(ele->ptr)))
                 break;
             rank++;
             zzlNext(zl,&eptr,&sptr);
@@ -1054,13 +1054,56 @@ unsigned int ziplistCompare(unsigned char *p, unsigned char *sstr, unsigned int
     return 0;
 }
 
+/* Load 2, 4 or 8 unaligned bytes from 'p'. The values are only compared for
+ * equality, so the byte order does not matter. */
+/* 从p中读取2、4、8个字节（不要求对齐），这些值只用于比较是否相等，所以不关心字节序 */
+static inline uint16_t zipLoad16(const unsigned char *p) { uint16_t v; memcpy(&v,p,2); return v; }
+static inline uint32_t zipLoad32(const unsigned char *p) { uint32_t v; memcpy(&v,p,4); return v; }
+static inline uint64_t zipLoad64(const unsigned char *p) { uint64_t v; memcpy(&v,p,8); return v; }
+
 /* Find pointer to the entry equal to the specified entry. Skip 'skip' entries
- * between every comparison. Returns NULL when the field could not be found. */
-/* 在ziplist查找包含给定数据的节点，可以通过参数skip指定跳过的节点数 */
+ * between every comparison. Returns NULL when the field could not be found.
+ *
+ * This is the hot path of HGET/ZSCORE on small hashes and sorted sets, so
+ * string entries of the right length are compared a word at a time: the
+ * first and the last 8 (or 4, or 2) bytes of the entry are loaded and
+ * compared with the same words of the searched string, computed once. For strings of up to 16 bytes the two
+ * overlapping words cover the whole string, longer strings are compared with
+ * memcmp() only if both words match. Keys sharing a long common prefix (like
+ * "user:1000", "user:1001") are rejected by the second word without any
+ * call. The integer form of the searched value is computed only once, and
+ * only if an integer entry is actually met. */
+/*  在ziplist查找包含给定数据的节点，可以通过参数skip指定跳过的节点数。
+
+    这是小哈希表和小有序集合上HGET、ZSCORE等命令的热点路径，所以这里以字（word）为单位比较字符串：
+    对于长度相同的字符串节点，读取它开头和结尾的8个（或4个、2个）字节，与预先计算好的被查找字符串的相应部分比较。长度不超过16字节的字符串，这两个互相重叠的字已经覆盖了整个字符串；
+    更长的字符串只有在两个字都相同时才调用memcmp。像"user:1000"、"user:1001"这样有很长公共前缀的key
+    通过结尾的字就可以被排除，不需要任何函数调用。
+    由于每个节点的头部都是变长的，没有办法用SIMD指令同时比较多个节点，所以这里使用的是在寄存器内并行比较的方法。
+    被查找的值只有在遇到整数节点时才会尝试编码为整数，并且只尝试一次。 */
 unsigned char *ziplistFind(unsigned char *p, unsigned char *vstr, unsigned int vlen, unsigned int skip) {
-    int skipcnt = 0;
+    unsigned int skipcnt = 0;
     unsigned char vencoding = 0;
     long long vll = 0;
+    uint64_t vhead = 0, vtail = 0;
+    unsigned int tailpos = 0;
+
+    // 预先计算被查找字符串开头和结尾的字
+    if (vlen >= 8) {
+        vhead = zipLoad64(vstr);
+        vtail = zipLoad64(vstr+vlen-8);
+        tailpos = vlen-8;
+    } else if (vlen >= 4) {
+        vhead = zipLoad32(vstr);
+        vtail = zipLoad32(vstr+vlen-4);
+        tailpos = vlen-4;
+    } else if (vlen >= 2) {
+        vhead = zipLoad16(vstr);
+        vtail = zipLoad16(vstr+vlen-2);
+        tailpos = vlen-2;
+    } else if (vlen == 1) {
+        vhead = vtail = vstr[0];
+    }
 
     while (p[0] != ZIP_END) {
         unsigned int prevlensize, encoding, lensize, len;
@@ -1073,8 +1116,21 @@ unsigned char *ziplistFind(unsigned char *p, unsigned char *vstr, unsigned int v
         if (skipcnt == 0) {
             /* Compare current entry with specified entry */
             if (ZIP_IS_STR(encoding)) {
-                if (len == vlen && memcmp(q, vstr, vlen) == 0) {
-                    return p;
+                if (len == vlen) {
+                    int match;
+
+                    // 比较开头和结尾的字，长度不超过16字节时这已经是完整的比较
+                    if (vlen >= 8)
+                        match = zipLoad64(q) == vhead &&
+                                zipLoad64(q+tailpos) == vtail &&
+                                (vlen <= 16 || memcmp(q+8,vstr+8,vlen-16) == 0);
+                    else if (vlen >= 4)
+                        match = zipLoad32(q) == vhead && zipLoad32(q+tailpos) == vtail;
+                    else if (vlen >= 2)
+                        match = zipLoad16(q) == vhead && zipLoad16(q+tailpos) == vtail;
+                    else
+                        match = vlen == 0 || q[0] == vhead;
+                    if (match) return p;
                 }
             } else {
                 /* Find out if the searched field can be encoded. Note that
@@ -1333,6 +1389,109 @@ void verify(unsigned char *zl, zlentry *e) {
     }
 }
 
+/* The straightforward ziplistFind() we had before the word-at-a-time
+ * comparison, used as a reference by the tests and the benchmark below. */
+static unsigned char *ziplistFindReference(unsigned char *p, unsigned char *vstr, unsigned int vlen, unsigned int skip) {
+    int skipcnt = 0;
+    unsigned char vencoding = 0;
+    long long vll = 0;
+
+    while (p[0] != ZIP_END) {
+        unsigned int prevlensize, encoding, lensize, len;
+        unsigned char *q;
+
+        ZIP_DECODE_PREVLENSIZE(p, prevlensize);
+        ZIP_DECODE_LENGTH(p + prevlensize, encoding, lensize, len);
+        q = p + prevlensize + lensize;
+
+        if (skipcnt == 0) {
+            if (ZIP_IS_STR(encoding)) {
+                if (len == vlen && memcmp(q, vstr, vlen) == 0) return p;
+            } else {
+                if (vencoding == 0) {
+                    if (!zipTryEncoding(vstr, vlen, &vll, &vencoding))
+                        vencoding = UCHAR_MAX;
+                }
+                if (vencoding != UCHAR_MAX &&
+                    zipLoadInteger(q, encoding) == vll) return p;
+            }
+            skipcnt = skip;
+        } else {
+            skipcnt--;
+        }
+        p = q + len;
+    }
+    return NULL;
+}
+
+/* Build a hash-like ziplist of 'entries' field/value pairs, where fields
+ * are 'size' bytes long. Integer fields are used when 'size' is 0. */
+static unsigned char *createFindBenchList(int entries, int size) {
+    unsigned char *zl = ziplistNew();
+    char buf[1024];
+    int j, len;
+
+    for (j = 0; j < entries; j++) {
+        if (size == 0)
+            len = sprintf(buf,"%d",j*37);
+        else
+            len = sprintf(buf,"field:%0*d",size > 6 ? size-6 : 1,j);
+        zl = ziplistPush(zl,(unsigned char*)buf,len,ZIPLIST_TAIL);
+        zl = ziplistPush(zl,(unsigned char*)"value",5,ZIPLIST_TAIL);
+    }
+    return zl;
+}
+
+/* Compare ziplistFind() and the reference implementation looking up every
+ * field (and a missing one) of lists of different sizes. */
+void benchmarkFind(void) {
+    int entries[] = {8, 32, 64, 128, 256, 512};
+    int sizes[] = {0, 8, 16, 64};
+    unsigned int e, s;
+
+    printf("%8s %6s %12s %12s\n","entries","size","ref ns/op","find ns/op");
+    for (e = 0; e < sizeof(entries)/sizeof(int); e++) {
+        for (s = 0; s < sizeof(sizes)/sizeof(int); s++) {
+            int n = entries[e], j, k, rounds = 4000000/n/n+1;
+            unsigned char *zl = createFindBenchList(n,sizes[s]);
+            unsigned char *head = ziplistIndex(zl,0);
+            sds *keys = zmalloc(sizeof(sds)*(n+1));
+            long long start, ref, find, ops = (long long)rounds*(n+1);
+
+            /* keys[n] is a missing field. */
+            for (j = 0; j <= n; j++) {
+                if (sizes[s] == 0)
+                    keys[j] = sdscatprintf(sdsempty(),"%d",j*37);
+                else
+                    keys[j] = sdscatprintf(sdsempty(),"field:%0*d",
+                                           sizes[s] > 6 ? sizes[s]-6 : 1,j);
+                assert(ziplistFind(head,(unsigned char*)keys[j],sdslen(keys[j]),1) ==
+                       ziplistFindReference(head,(unsigned char*)keys[j],sdslen(keys[j]),1));
+            }
+
+            start = usec();
+            for (k = 0; k < rounds; k++)
+                for (j = 0; j <= n; j++)
+                    assert((ziplistFindReference(head,(unsigned char*)keys[j],
+                            sdslen(keys[j]),1) == NULL) == (j == n));
+            ref = usec()-start;
+
+            start = usec();
+            for (k = 0; k < rounds; k++)
+                for (j = 0; j <= n; j++)
+                    assert((ziplistFind(head,(unsigned char*)keys[j],
+                            sdslen(keys[j]),1) == NULL) == (j == n));
+            find = usec()-start;
+
+            printf("%8d %6d %12.1f %12.1f\n",n,sizes[s],
+                (double)ref*1000/ops,(double)find*1000/ops);
+            for (j = 0; j <= n; j++) sdsfree(keys[j]);
+            zfree(keys);
+            zfree(zl);
+        }
+    }
+}
+
 int main(int argc, char **argv) {
     unsigned char *zl, *p;
     unsigned char *entry;
@@ -1780,6 +1939,11 @@ int main(int argc, char **argv) {
         stress(ZIPLIST_TAIL,100000,16384,256);
     }
 
+    printf("Benchmark ziplistFind():\n");
+    {
+        benchmarkFind();
+    }
+
     return 0;
 }
 